@@ -0,0 +1,58 @@
+#!/bin/sh
+# Times kom --batch over a corpus of copies of the samples in
+# Programs/Cleared and k/ with 1, 2, 4, ... up to max jobs. The
+# listing must come out the same with every job count; speedup is
+# against one job.
+#
+#   Bench/batch.sh [files] [max jobs]
+
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+root=$(dirname "$here")
+files=${1:-20000}
+max=${2:-64}
+out=${TMPDIR:-/tmp}/kom-bench
+cc=${CC:-cc}
+
+mkdir -p "$out/batch"
+
+$cc -std=gnu11 -O2 -pthread "$root"/*.c -o "$out/kom"
+
+# distinct paths, so nothing below kom can share work between copies
+i=0
+: > "$out/batch.list"
+
+while [ "$i" -lt "$files" ]; do
+    for src in "$root"/Programs/Cleared/*.k "$here"/k/*.k; do
+        [ "$i" -lt "$files" ] || break
+        cp "$src" "$out/batch/$i.k"
+        echo "$out/batch/$i.k" >> "$out/batch.list"
+        i=$((i + 1))
+    done
+done
+
+ms() { sed -n 's/^Batch time: \([0-9.]*\) ms.*/\1/p' "$1"; }
+
+printf "%6s %10s %10s %8s\n" "jobs" "ms" "files/s" "speedup"
+
+jobs=1
+base=
+
+while [ "$jobs" -le "$max" ]; do
+    "$out/kom" --batch-list="$out/batch.list" --jobs="$jobs" > "$out/batch-$jobs.txt" 2> "$out/batch-$jobs.err" || true
+
+    if ! cmp -s "$out/batch-1.txt" "$out/batch-$jobs.txt"; then
+        echo "listing with $jobs jobs differs from 1 job" >&2
+        exit 1
+    fi
+
+    t=$(ms "$out/batch-$jobs.err")
+    base=${base:-$t}
+
+    printf "%6d %10s %10s %8s\n" "$jobs" "$t" \
+        "$(awk -v n="$files" -v t="$t" 'BEGIN { printf "%.0f", n / (t / 1000) }')" \
+        "$(awk -v b="$base" -v t="$t" 'BEGIN { printf "%.2fx", b / t }')"
+
+    jobs=$((jobs * 2))
+done
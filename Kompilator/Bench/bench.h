@@ -0,0 +1,50 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* ---------------------------------------------
+   Native baseline harness
+
+   Each program defines its globals, their
+   initial image in reset(), and entre() as the
+   C transcription of the K sample. Output
+   matches kom --repeat so run.sh can compare
+   the two directly. noinline keeps the compiler
+   from folding the whole run into a constant.
+--------------------------------------------- */
+
+static void reset(void);
+static int entre(void);
+
+int main(int argc, char *argv[])
+{
+    long repeat = (argc > 1) ? strtol(argv[1], NULL, 10) : 1;
+    int result = 0;
+    double total_ns = 0;
+
+    for (long r = 0; r < repeat; r++)
+    {
+        struct timespec start, end;
+
+        reset();
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        result = entre();
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        total_ns += (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    }
+
+    printf("ENTRE returned %d\n", result);
+    printf("Run time: %.0f ns per run over %ld runs\n", total_ns / repeat, repeat);
+
+    return 0;
+}
+
+#define NOINLINE __attribute__((noinline))
+
+#endif /* BENCH_H */
@@ -0,0 +1,58 @@
+#include "../bench.h"
+
+static int a[4096];
+static int b[4096];
+static int c[4096];
+
+static void reset(void)
+{
+    memset(a, 0, sizeof(a));
+    memset(b, 0, sizeof(b));
+    memset(c, 0, sizeof(c));
+}
+
+static NOINLINE void fyll(void)
+{
+    for (int i = 0; i < 4096; i++)
+    {
+        a[i] = i;
+        b[i] = 4096 - i;
+    }
+}
+
+static NOINLINE void addera(int *dst, int *x, int *y, int n)
+{
+    for (int i = 0; i < n; i++)
+        dst[i] = x[i] + y[i];
+}
+
+static NOINLINE void blanda(int *dst, int *x, int k, int n)
+{
+    for (int i = 0; i < n; i++)
+        dst[i] = ((dst[i] ^ x[i]) & 4095) + k;
+}
+
+static NOINLINE int summa(int *x, int n)
+{
+    int s = 0;
+
+    for (int i = 0; i < n; i++)
+        s = s + x[i];
+    return s;
+}
+
+static NOINLINE int entre(void)
+{
+    int s = 0;
+
+    fyll();
+
+    for (int r = 0; r < 50; r++)
+    {
+        addera(c, a, b, 4096);
+        blanda(c, a, r, 4096);
+        addera(a, c, b, 4096);
+        s = s + summa(a, 4096);
+    }
+    return s;
+}
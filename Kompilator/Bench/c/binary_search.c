@@ -0,0 +1,39 @@
+#include "../bench.h"
+
+static int arr[10];
+
+static void reset(void)
+{
+    static const int init[10] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 10 };
+
+    memcpy(arr, init, sizeof(arr));
+}
+
+static NOINLINE int binarsok(int target)
+{
+    int low = 0;
+    int high = 9;
+
+    while (low < high + 1)
+    {
+        int mid = (low + high) / 2;
+
+        if (arr[mid] < target)
+            low = mid + 1;
+
+        if (target < arr[mid])
+            high = mid - 1;
+
+        if (!(arr[mid] < target) && !(target < arr[mid]))
+            return mid;
+    }
+
+    return -1;
+}
+
+static NOINLINE int entre(void)
+{
+    int target = 8;
+
+    return binarsok(target);
+}
@@ -0,0 +1,43 @@
+#include "../bench.h"
+
+static int arr[4096];
+
+static void reset(void)
+{
+    memset(arr, 0, sizeof(arr));
+}
+
+static NOINLINE int binarsok(int target)
+{
+    int low = 0;
+    int high = 4095;
+
+    while (low < high + 1)
+    {
+        int mid = (low + high) / 2;
+
+        if (arr[mid] < target)
+            low = mid + 1;
+
+        if (target < arr[mid])
+            high = mid - 1;
+
+        if (!(arr[mid] < target) && !(target < arr[mid]))
+            return mid;
+    }
+
+    return -1;
+}
+
+static NOINLINE int entre(void)
+{
+    int sum = 0;
+
+    for (int i = 0; i < 4096; i++)
+        arr[i] = i * 2;
+
+    for (int t = 0; t < 8192; t++)
+        sum += binarsok(t);
+
+    return sum;
+}
@@ -0,0 +1,37 @@
+#include "../bench.h"
+
+static int arr[10];
+
+static void reset(void)
+{
+    static const int init[10] = { 5, 1, 4, 2, 8, 0, 2, 9, 3, 7 };
+
+    memcpy(arr, init, sizeof(arr));
+}
+
+static NOINLINE void bubbla(void)
+{
+    int n = 10;
+
+    for (int i = 0; i < n; i++)
+    {
+        int grans = (n - 1) - i;
+
+        for (int j = 0; j < grans; j++)
+        {
+            if (arr[j + 1] < arr[j])
+            {
+                int tmp = arr[j];
+                arr[j] = arr[j + 1];
+                arr[j + 1] = tmp;
+            }
+        }
+    }
+}
+
+static NOINLINE int entre(void)
+{
+    bubbla();
+
+    return arr[0] + arr[9];
+}
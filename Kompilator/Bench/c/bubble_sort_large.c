@@ -0,0 +1,42 @@
+#include "../bench.h"
+
+static int arr[1000];
+
+static void reset(void)
+{
+    memset(arr, 0, sizeof(arr));
+}
+
+static NOINLINE void fyll(void)
+{
+    for (int i = 0; i < 1000; i++)
+        arr[i] = 1000 - i;
+}
+
+static NOINLINE void bubbla(void)
+{
+    int n = 1000;
+
+    for (int i = 0; i < n; i++)
+    {
+        int grans = (n - 1) - i;
+
+        for (int j = 0; j < grans; j++)
+        {
+            if (arr[j + 1] < arr[j])
+            {
+                int tmp = arr[j];
+                arr[j] = arr[j + 1];
+                arr[j + 1] = tmp;
+            }
+        }
+    }
+}
+
+static NOINLINE int entre(void)
+{
+    fyll();
+    bubbla();
+
+    return arr[0] + arr[999] + arr[500];
+}
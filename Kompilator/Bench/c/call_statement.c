@@ -0,0 +1,34 @@
+#include "../bench.h"
+
+static int calls;
+
+static void reset(void)
+{
+    calls = 0;
+}
+
+static NOINLINE int sum(int x)
+{
+    calls++;
+
+    if (x < 1)
+        return 0;
+
+    return x + sum(x - 1);
+}
+
+static NOINLINE int twice(int x)
+{
+    int y = x * 3;
+
+    sum(x);
+    sum(y);
+    return y + 1;
+}
+
+static NOINLINE int entre(void)
+{
+    int r = twice(5) + sum(4);
+
+    return r + calls;
+}
@@ -0,0 +1,45 @@
+#include "../bench.h"
+
+static void reset(void)
+{
+}
+
+static NOINLINE long long summa(long long n, long long acc)
+{
+    if (n == 0)
+        return acc;
+    return summa(n - 1, acc + n % 7);
+}
+
+static NOINLINE void rakna(int *p, int n)
+{
+    if (n < 1)
+        return;
+    *p = *p + n % 3;
+    rakna(p, n - 1);
+}
+
+static NOINLINE int udda(int n);
+
+static NOINLINE int jamn(int n)
+{
+    if (n == 0)
+        return 1;
+    return udda(n - 1);
+}
+
+static NOINLINE int udda(int n)
+{
+    if (n == 0)
+        return 0;
+    return jamn(n - 1);
+}
+
+static NOINLINE int entre(void)
+{
+    int steg = 0;
+
+    rakna(&steg, 1000000);
+
+    return (int)(summa(1000000, 0) % 100000 + steg + jamn(1000000) * 7 + udda(999999) * 11);
+}
@@ -0,0 +1,28 @@
+#include "../bench.h"
+
+static int g;
+static int arr[4];
+
+static void reset(void)
+{
+    static const int init[4] = { 1, 2, 3, 4 };
+
+    g = 5;
+    memcpy(arr, init, sizeof(arr));
+}
+
+static NOINLINE int entre(void)
+{
+    int *p = &g;
+    int *q = &arr[1];
+
+    for (int i = 0; i < 10; i++)
+    {
+        (*p)++;
+        *p += i * 2;
+        (*p)--;
+        (*q)++;
+    }
+
+    return g + arr[0] + arr[1] + arr[2];
+}
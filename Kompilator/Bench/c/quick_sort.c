@@ -0,0 +1,55 @@
+#include "../bench.h"
+
+static int arr[10];
+
+static void reset(void)
+{
+    static const int init[10] = { 5, 1, 4, 2, 8, 0, 2, 9, 3, 7 };
+
+    memcpy(arr, init, sizeof(arr));
+}
+
+static NOINLINE void byt(int i, int j)
+{
+    int tmp = arr[i];
+    arr[i] = arr[j];
+    arr[j] = tmp;
+}
+
+static NOINLINE int partition(int low, int high)
+{
+    int pivot = arr[high];
+    int i = low;
+
+    for (int j = low; j < high; j++)
+    {
+        if (arr[j] < pivot)
+        {
+            byt(i, j);
+            i++;
+        }
+    }
+
+    byt(i, high);
+    return i;
+}
+
+static NOINLINE void quicksort(int low, int high)
+{
+    if (low < high)
+    {
+        int p = partition(low, high);
+
+        if (low < p)
+            quicksort(low, p - 1);
+
+        if (p + 1 < high + 1)
+            quicksort(p + 1, high);
+    }
+}
+
+static NOINLINE int entre(void)
+{
+    quicksort(0, 9);
+    return arr[0] + arr[9];
+}
@@ -0,0 +1,32 @@
+#include "../bench.h"
+
+static void reset(void)
+{
+}
+
+static NOINLINE int entre(void)
+{
+    volatile int seed_a = 29;
+    volatile int seed_b = 14;
+    int a = seed_a;
+    int b = seed_b;
+
+    int andv = a & b;
+    int orv = a | b;
+    int xorv = a ^ b;
+    int inv = ~a;
+
+    int shl = a << 2;
+    int shr = a >> 1;
+
+    int modv = a % 5;
+
+    int combo = (a << 1) & (b >> 1);
+
+    a <<= 1;
+    a >>= 2;
+
+    a += 3;
+
+    return andv + orv + xorv + inv + shl + shr + modv + combo + a;
+}
@@ -0,0 +1,52 @@
+#include "../bench.h"
+
+static int arr[6];
+
+struct box {
+    int x;
+    int y;
+};
+
+static void reset(void)
+{
+    static const int init[6] = { 10, 20, 30, 40, 50, 60 };
+
+    memcpy(arr, init, sizeof(arr));
+}
+
+static NOINLINE void stress(void)
+{
+    int i = 0;
+    struct box b;
+
+    b.x = 1;
+    b.y = 2;
+
+    i = 2;
+    arr[i] = 99;
+
+    i++;
+    i--;
+    arr[i]++;
+    arr[i]--;
+
+    i += 5;
+    i -= 3;
+
+    arr[i] += 10 + 1;
+    arr[i] -= 2 * 3;
+
+    b.x += 7;
+    b.y -= 4;
+
+    b.x = b.x + arr[i] * 2;
+    arr[i] = arr[i] + b.y;
+
+    (void)b.x;
+}
+
+static NOINLINE int entre(void)
+{
+    stress();
+    return arr[0] + arr[5];
+}
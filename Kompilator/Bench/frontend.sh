@@ -0,0 +1,111 @@
+#!/bin/sh
+# Front-end throughput on large synthetic programs. kgen writes one
+# program per shape (mixed, expr, funcs, structs, comments, unicode);
+# kom compiles each one runs + 1 times in one process with
+# --time-report=json and the first, cold run is dropped. For each
+# phase up to sema the table gives the median, minimum and relative
+# spread (stddev / mean) of the wall time, and MB/s and tokens/s at
+# the median.
+#
+#   Bench/frontend.sh [size KB] [runs] [seed]
+
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+root=$(dirname "$here")
+size=${1:-1024}
+runs=${2:-10}
+seed=${3:-1}
+out=${TMPDIR:-/tmp}/kom-bench
+cc=${CC:-cc}
+
+mkdir -p "$out/frontend"
+
+$cc -std=gnu11 -O2 -pthread "$root"/*.c -o "$out/kom"
+$cc -std=gnu11 -O2 "$here/kgen.c" -o "$out/kgen"
+
+printf "%-9s %-12s %10s %10s %7s %9s %11s\n" "shape" "phase" "median ms" "min ms" "spread" "MB/s" "Mtokens/s"
+
+for shape in mixed expr funcs structs comments unicode; do
+    src="$out/frontend/$shape.k"
+    "$out/kgen" --shape="$shape" --size="$size" --seed="$seed" > "$src"
+
+    set --
+    i=0
+
+    while [ "$i" -le "$runs" ]; do
+        set -- "$@" "$src"
+        i=$((i + 1))
+    done
+
+    if ! "$out/kom" --batch --time-report=json "$@" > "$out/frontend/$shape.json" 2> /dev/null; then
+        echo "kom failed on $src" >&2
+        exit 1
+    fi
+
+    grep '^{' "$out/frontend/$shape.json" | awk -v shape="$shape" '
+        function field(s, key,    v) {
+            if (!match(s, "\"" key "\":[0-9.]+"))
+                return 0
+            v = substr(s, RSTART, RLENGTH)
+            sub(/^[^:]*:/, "", v)
+            return v + 0
+        }
+
+        NR > 1 {
+            n = split($0, parts, "{\"phase\":\"")
+
+            for (i = 2; i <= n; i++) {
+                phase = substr(parts[i], 1, index(parts[i], "\"") - 1)
+
+                if (phase == "read")        bytes  = field(parts[i], "items")
+                if (phase == "lex_resolve") tokens = field(parts[i], "items")
+
+                if (phase !~ /^(read|decode_utf8|lex_scan|lex_resolve|parse|sema)$/)
+                    continue
+
+                ms[phase, NR - 1] = field(parts[i], "wall_ms")
+                front[NR - 1] += ms[phase, NR - 1]
+            }
+
+            samples = NR - 1
+        }
+
+        function report(name,    i, j, t, sum, sq, mean, sd, med, v) {
+            for (i = 1; i <= samples; i++)
+                v[i] = (name == "front end") ? front[i] : ms[name, i]
+
+            for (i = 2; i <= samples; i++)
+                for (j = i; j > 1 && v[j - 1] > v[j]; j--) {
+                    t = v[j]; v[j] = v[j - 1]; v[j - 1] = t
+                }
+
+            for (i = 1; i <= samples; i++) {
+                sum += v[i]
+                sq  += v[i] * v[i]
+            }
+
+            mean = sum / samples
+            sd   = sq / samples - mean * mean
+            sd   = sd > 0 ? sqrt(sd) : 0
+            med  = (samples % 2) ? v[(samples + 1) / 2] : (v[samples / 2] + v[samples / 2 + 1]) / 2
+
+            printf "%-9s %-12s %10.3f %10.3f %6.1f%% %9.1f %11.2f\n", shape, name, med, v[1],
+                   (mean > 0 ? 100 * sd / mean : 0),
+                   (med > 0 ? bytes / 1048576 / (med / 1000) : 0),
+                   (med > 0 ? tokens / 1e6 / (med / 1000) : 0)
+        }
+
+        END {
+            if (samples < 1)
+                exit 1
+
+            report("read")
+            report("decode_utf8")
+            report("lex_scan")
+            report("lex_resolve")
+            report("parse")
+            report("sema")
+            report("front end")
+        }'
+done
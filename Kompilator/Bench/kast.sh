@@ -0,0 +1,66 @@
+#!/bin/sh
+# Loader rejection cases for .kast files. quick_sort.k is written with
+# --emit=ast-bin and must load and run to the result of the source;
+# then copies with one required child cut (kid[0] set to AST_NULL on
+# the first BINARY and on the first EXPR_STMT) must be refused before
+# sema reads them. Node kinds are the AstKind values of ast.h, and the
+# offsets those of the version 1 layout in astbin.h.
+#
+#   Bench/kast.sh
+
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+root=$(dirname "$here")
+out=${TMPDIR:-/tmp}/kom-bench/kast
+cc=${CC:-cc}
+sample=$root/Programs/Cleared/quick_sort.k
+
+mkdir -p "$out"
+
+$cc -std=gnu11 -O2 -pthread "$root"/*.c -o "$out/kom"
+
+result() { sed -n 's/^ENTRE returned //p'; }
+
+"$out/kom" --emit=ast-bin --output="$out/good.kast" "$sample" > /dev/null
+
+expect=$("$out/kom" --run "$sample" | result)
+got=$("$out/kom" --run "$out/good.kast" | result)
+
+if [ -z "$expect" ] || [ "$expect" != "$got" ]; then
+    echo "good.kast returned '$got', not '$expect'" >&2
+    exit 1
+fi
+
+nodes=$(od -An -t u8 -j 96 -N 8 "$out/good.kast" | tr -d ' ')
+count=$(od -An -t u4 -j 24 -N 4 "$out/good.kast" | tr -d ' ')
+
+# name kind: a copy of good.kast with kid[0] of the first node of that kind cut
+cut_kid() {
+    index=$(od -An -v -t d4 -w80 -j "$nodes" -N $((count * 80)) "$out/good.kast" |
+            awk -v kind="$2" '$1 == kind { print NR - 1; exit }')
+
+    if [ -z "$index" ]; then
+        echo "$1: no node of kind $2 in $sample" >&2
+        exit 1
+    fi
+
+    cp "$out/good.kast" "$out/$1.kast"
+    printf '\377\377\377\377' | dd of="$out/$1.kast" bs=1 seek=$((nodes + index * 80 + 12)) conv=notrunc 2> /dev/null
+}
+
+cut_kid binary_no_operand 29
+cut_kid expr_stmt_no_expr 22
+
+for bad in binary_no_operand expr_stmt_no_expr; do
+    status=0
+    "$out/kom" --run "$out/$bad.kast" > "$out/$bad.txt" 2>&1 || status=$?
+
+    if [ "$status" -ne 1 ] || ! grep -q "^Error: node [0-9]* of the loaded tree is missing a child" "$out/$bad.txt"; then
+        echo "$bad.kast was not refused (status $status):" >&2
+        cat "$out/$bad.txt" >&2
+        exit 1
+    fi
+
+    echo "$bad.kast: $(grep '^Error' "$out/$bad.txt")"
+done
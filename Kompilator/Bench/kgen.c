@@ -0,0 +1,389 @@
+/* ---------------------------------------------
+   Synthetic K program generator
+
+   Writes a K program of about the requested
+   size to stdout, the same bytes for the same
+   seed, size and shape. The program checks and
+   lowers cleanly, so every phase of the front
+   end sees it; it is not meant to be run.
+
+   Shapes weight what the functions are made of:
+
+     mixed     a little of everything
+     expr      deep, wide expressions
+     funcs     many small functions and calls
+     structs   struct locals and FÄLT traffic
+     comments  long comment blocks between code
+     unicode   Å/Ä/Ö in every identifier
+
+     kgen [--size=KB] [--shape=name] [--seed=N] [--depth=N]
+--------------------------------------------- */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_LOCALS  24
+#define MAX_FIELDS  6
+
+typedef struct GenShape {
+    const char *name;
+    int  expr_weight;       // chance in 100 that a statement is an assignment of a deep expression
+    int  call_weight;       // chance in 100 that a leaf is a call
+    int  field_weight;      // chance in 100 that a leaf or statement goes through FÄLT
+    int  comment_weight;    // chance in 100 of a comment block before a statement
+    int  unicode;           // Å/Ä/Ö names
+    int  statements;        // statements per function
+} GenShape;
+
+static const GenShape shapes[] = {
+    { "mixed",    30, 10, 20, 10, 0, 12 },
+    { "expr",     80, 10,  5,  2, 0,  8 },
+    { "funcs",    20, 40,  5,  5, 0,  3 },
+    { "structs",  15,  5, 70,  5, 0, 12 },
+    { "comments", 20, 10, 10, 60, 0,  8 },
+    { "unicode",  30, 10, 20, 10, 1, 12 },
+};
+
+typedef struct GenState {
+    const GenShape *shape;
+    uint64_t        rng;
+    long            size;           // bytes written so far
+    int             depth;          // deepest expression nesting
+    int             func_count;     // functions written so far, all callable
+    int             struct_count;
+    int             locals;         // HEL locals in the current function
+    int             has_struct;     // current function has a struct local in scope
+    int             in_call;        // call arguments are not calls, so leaves stay finite
+} GenState;
+
+static const char *plain_stems[] = { "v", "tal", "n", "acc", "tmp", "x", "sum", "k" };
+static const char *unicode_stems[] = { "värde", "ålder", "öka", "räkna", "gräns", "höjd", "längd", "åsna", "ärlig", "överslag" };
+
+static const char *words[] = {
+    "kompilatorn", "läser", "källkod", "och", "bygger", "ett", "syntaxträd", "för", "varje", "funktion",
+    "räckvidden", "växer", "när", "blocket", "öppnas", "åter", "stängs", "fältet", "pekar", "på", "strukturen",
+};
+
+//splitmix64: fixed, fast and the same everywhere
+static uint64_t next(GenState *g)
+{
+    uint64_t z = (g->rng += 0x9E3779B97F4A7C15ull);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static int roll(GenState *g, int n)
+{
+    return (int)(next(g) % (uint64_t)n);
+}
+
+static void emit(GenState *g, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void emit(GenState *g, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    g->size += vprintf(fmt, ap);
+    va_end(ap);
+}
+
+static void indent(GenState *g, int level)
+{
+    for (int i = 0; i < level; i++)
+        emit(g, "    ");
+}
+
+static void local_name(GenState *g, int i, char *buf, size_t size)
+{
+    if (g->shape->unicode)
+        snprintf(buf, size, "%s_%d", unicode_stems[i % 10], i);
+    else
+        snprintf(buf, size, "%s%d", plain_stems[i % 8], i);
+}
+
+static void field_name(GenState *g, int i, char *buf, size_t size)
+{
+    snprintf(buf, size, g->shape->unicode ? "FÄLTVÄRDE_%d" : "F%d", i);
+}
+
+static void func_name(GenState *g, int i, char *buf, size_t size)
+{
+    snprintf(buf, size, g->shape->unicode ? "BERÄKNA_Ö%d" : "FUNC%d", i);
+}
+
+static void comment(GenState *g, int level)
+{
+    int lines = 1 + roll(g, g->shape->comment_weight > 30 ? 12 : 3);
+
+    indent(g, level);
+    emit(g, "/%%");
+
+    for (int l = 0; l < lines; l++)
+    {
+        int count = 6 + roll(g, 10);
+
+        if (l > 0)
+        {
+            emit(g, "\n");
+            indent(g, level);
+            emit(g, "  ");
+        }
+
+        for (int w = 0; w < count; w++)
+            emit(g, " %s", words[roll(g, sizeof(words) / sizeof(words[0]))]);
+    }
+
+    emit(g, " %%/\n");
+}
+
+static void expr(GenState *g, int depth);
+
+static void leaf(GenState *g)
+{
+    char name[64];
+    int r = roll(g, 100);
+
+    if (g->func_count > 0 && !g->in_call && r < g->shape->call_weight)
+    {
+        func_name(g, roll(g, g->func_count), name, sizeof(name));
+        emit(g, "%s(", name);
+        g->in_call = 1;
+        expr(g, 1);
+        emit(g, ", ");
+        expr(g, 1);
+        g->in_call = 0;
+        emit(g, ")");
+    }
+    else if (g->has_struct && r < g->shape->call_weight + g->shape->field_weight)
+    {
+        field_name(g, roll(g, MAX_FIELDS), name, sizeof(name));
+        emit(g, "(FÄLT s %s)", name);
+    }
+    else if (r % 3 == 0)
+    {
+        emit(g, "%d", roll(g, 1000));
+    }
+    else
+    {
+        local_name(g, roll(g, g->locals), name, sizeof(name));
+        emit(g, "%s", name);
+    }
+}
+
+//no division: the values are arbitrary and the checker folds constants
+static void expr(GenState *g, int depth)
+{
+    static const char *ops[] = { "+", "-", "*", "+", "-" };
+
+    if (depth <= 0 || roll(g, 8) == 0)
+    {
+        leaf(g);
+        return;
+    }
+
+    emit(g, "(");
+    expr(g, depth - 1);
+    emit(g, " %s ", ops[roll(g, 5)]);
+    expr(g, roll(g, 3) == 0 ? depth - 1 : roll(g, 2));
+    emit(g, ")");
+}
+
+static void statement(GenState *g, int level, int nest)
+{
+    char name[64], field[64];
+    int r = roll(g, 100);
+
+    if (roll(g, 100) < g->shape->comment_weight)
+        comment(g, level);
+
+    indent(g, level);
+
+    if (r < g->shape->expr_weight)
+    {
+        local_name(g, roll(g, g->locals), name, sizeof(name));
+        emit(g, "%s: ", name);
+        expr(g, g->depth);
+        emit(g, ";\n");
+    }
+    else if (g->has_struct && r < g->shape->expr_weight + g->shape->field_weight)
+    {
+        field_name(g, roll(g, MAX_FIELDS), field, sizeof(field));
+
+        if (roll(g, 2))
+        {
+            emit(g, "FÄLT s %s: ", field);
+            expr(g, 3);
+            emit(g, ";\n");
+        }
+        else
+        {
+            emit(g, "FÄLT s %s ÖKAR MED ", field);
+            leaf(g);
+            emit(g, ";\n");
+        }
+    }
+    else if (nest < 2 && r % 4 == 0)
+    {
+        emit(g, "OM(");
+        expr(g, 2);
+        emit(g, " MINDRE ");
+        expr(g, 2);
+        emit(g, ")<\n");
+        statement(g, level + 1, nest + 1);
+        indent(g, level);
+        emit(g, "> ANNARS <\n");
+        statement(g, level + 1, nest + 1);
+        indent(g, level);
+        emit(g, ">\n");
+    }
+    else if (nest < 2 && r % 4 == 1)
+    {
+        local_name(g, 0, name, sizeof(name));
+        emit(g, "MEDAN(%s MINDRE %d)<\n", name, 10 + roll(g, 90));
+        statement(g, level + 1, nest + 1);
+        indent(g, level + 1);
+        emit(g, "%s ÖKAR;\n", name);
+        indent(g, level);
+        emit(g, ">\n");
+    }
+    else
+    {
+        local_name(g, roll(g, g->locals), name, sizeof(name));
+        emit(g, "%s %s MED ", name, roll(g, 2) ? "ÖKAR" : "MINSKAR");
+        expr(g, 2);
+        emit(g, ";\n");
+    }
+}
+
+static void structure(GenState *g, int index)
+{
+    char name[64];
+
+    emit(g, "STRUKTUR S%d <\n", index);
+
+    for (int f = 0; f < MAX_FIELDS; f++)
+    {
+        field_name(g, f, name, sizeof(name));
+        emit(g, "    HEL: %s;\n", name);
+    }
+
+    emit(g, ">\n\n");
+}
+
+static void function(GenState *g, const char *name)
+{
+    char local[64];
+
+    //a and b come first so every function has two locals before its own
+    emit(g, "HEL: %s(HEL: ", name);
+    local_name(g, 0, local, sizeof(local));
+    emit(g, "%s, HEL: ", local);
+    local_name(g, 1, local, sizeof(local));
+    emit(g, "%s)<\n", local);
+
+    int with_struct = g->struct_count > 0 && roll(g, 100) < 20 + g->shape->field_weight;
+
+    g->locals = 2;
+    g->has_struct = 0;
+
+    int extra = 2 + roll(g, MAX_LOCALS - 2);
+
+    for (int i = 0; i < extra; i++)
+    {
+        local_name(g, g->locals, local, sizeof(local));
+        emit(g, "    HEL: %s, ", local);
+        expr(g, 2);
+        emit(g, ";\n");
+        g->locals++;
+    }
+
+    if (with_struct)
+    {
+        g->has_struct = 1;
+        emit(g, "    STRUKTUR S%d: s;\n", roll(g, g->struct_count));
+
+        for (int f = 0; f < MAX_FIELDS; f++)
+        {
+            field_name(g, f, local, sizeof(local));
+            emit(g, "    FÄLT s %s: %d;\n", local, f);
+        }
+    }
+
+    emit(g, "\n");
+
+    for (int i = 0; i < g->shape->statements; i++)
+        statement(g, 1, 0);
+
+    emit(g, "\n    ÅTERVÄND ");
+    expr(g, 2);
+    emit(g, ";\n>\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+    GenState g;
+    long target = 1024 << 10;
+    uint64_t seed = 1;
+    const char *shape = "mixed";
+    char name[64];
+
+    memset(&g, 0, sizeof(g));
+    g.depth = 6;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--size=", 7) == 0)
+            target = strtol(argv[i] + 7, NULL, 10) << 10;
+        else if (strncmp(argv[i], "--seed=", 7) == 0)
+            seed = strtoull(argv[i] + 7, NULL, 10);
+        else if (strncmp(argv[i], "--depth=", 8) == 0)
+            g.depth = (int)strtol(argv[i] + 8, NULL, 10);
+        else if (strncmp(argv[i], "--shape=", 8) == 0)
+            shape = argv[i] + 8;
+        else
+        {
+            fprintf(stderr, "usage: kgen [--size=KB] [--shape=name] [--seed=N] [--depth=N]\n");
+            return 1;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++)
+    {
+        if (strcmp(shapes[i].name, shape) == 0)
+            g.shape = &shapes[i];
+    }
+
+    if (!g.shape || target <= 0 || g.depth < 0)
+    {
+        fprintf(stderr, "Error: unknown shape %s or bad size / depth\n", shape);
+        return 1;
+    }
+
+    //the shape is mixed into the seed so that shapes do not share random streams
+    g.rng = seed * 0x100000001B3ull ^ (uint64_t)(g.shape - shapes);
+
+    emit(&g, "/%% -------------------------------------------------\n"
+             "generated by kgen --shape=%s --seed=%llu --depth=%d\n"
+             "-------------------------------------------------%%/\n\n",
+         g.shape->name, (unsigned long long)seed, g.depth);
+
+    for (; g.struct_count < 4 + (g.shape->field_weight > 50 ? 12 : 0); g.struct_count++)
+        structure(&g, g.struct_count);
+
+    while (g.size < target)
+    {
+        func_name(&g, g.func_count, name, sizeof(name));
+        function(&g, name);
+        g.func_count++;
+    }
+
+    emit(&g, "HEL: ENTRE()<\n    ÅTERVÄND 0;\n>\n");
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+#!/bin/sh
+# Separate compilation. For 10, 100, ... up to max modules, each
+# module defines a global and a function that adds it and calls the
+# next module's function through EXTERN; module 0 holds ENTRE. The
+# modules are compiled to .kobj with --batch --emit=obj, then linked
+# and run. The table gives the link phase alone, the whole kom --link
+# (mapping and checking every object as well) and the link time per
+# module, which should stay flat as the module count grows. For the
+# largest count it then changes one module and compares rebuilding
+# only that module and relinking against compiling every module again.
+#
+#   Bench/link.sh [max modules] [jobs]
+
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+root=$(dirname "$here")
+max=${1:-10000}
+jobs=${2:-0}
+out=${TMPDIR:-/tmp}/kom-bench
+cc=${CC:-cc}
+
+$cc -std=gnu11 -O2 -pthread "$root"/*.c -o "$out/kom"
+
+now_ms() { echo $(($(date +%s%N) / 1000000)); }
+
+# module i of n; step is what it adds besides its global
+module() {
+    i=$1 n=$2 step=$3
+    next=$((i + 1))
+
+    if [ "$next" -lt "$n" ]; then
+        echo "EXTERN HEL: f$next(HEL: v);"
+    fi
+
+    echo "HEL: g$i, $i;"
+    echo "HEL: f$i(HEL: v)<"
+
+    if [ "$next" -lt "$n" ]; then
+        echo "    ÅTERVÄND v + g$i + $step + f$next(v);"
+    else
+        echo "    ÅTERVÄND v + g$i + $step;"
+    fi
+
+    echo ">"
+
+    if [ "$i" -eq 0 ]; then
+        echo "HEL: ENTRE()<"
+        echo "    ÅTERVÄND f0(1);"
+        echo ">"
+    fi
+}
+
+link_ms() { sed -n 's/.*{"phase":"link","wall_ms":\([0-9.]*\).*/\1/p' "$1"; }
+
+printf "%8s %10s %10s %12s %12s\n" "modules" "link ms" "kom ms" "us/module" "result"
+
+n=10
+
+while [ "$n" -le "$max" ]; do
+    dir="$out/link/$n"
+    rm -rf "$dir"
+    mkdir -p "$dir"
+
+    i=0
+
+    while [ "$i" -lt "$n" ]; do
+        module "$i" "$n" 0 > "$dir/m$i.k"
+        i=$((i + 1))
+    done
+
+    "$out/kom" --batch --emit=obj --jobs="$jobs" "$dir"/m*.k > /dev/null 2> "$dir/compile.err"
+
+    start=$(now_ms)
+    "$out/kom" --link --time-report=json --run "$dir"/m*.kobj > "$dir/link.txt"
+    end=$(now_ms)
+
+    result=$(sed -n 's/^ENTRE returned //p' "$dir/link.txt")
+    expect=$((n + n * (n - 1) / 2))
+
+    if [ "$result" != "$expect" ]; then
+        echo "$n modules returned $result, not $expect" >&2
+        exit 1
+    fi
+
+    t=$(link_ms "$dir/link.txt")
+
+    printf "%8d %10s %10d %12s %12s\n" "$n" "$t" $((end - start)) \
+        "$(awk -v n="$n" -v t="$t" 'BEGIN { printf "%.3f", t * 1000 / n }')" "$result"
+
+    last=$dir
+    n=$((n * 10))
+done
+
+# one module changes: rebuild it alone, or everything
+changed=$(ls "$last"/m*.k | wc -l)
+changed=$((changed / 2))
+count=$(ls "$last"/m*.k | wc -l)
+
+module "$changed" "$count" 1 > "$last/m$changed.k"
+
+start=$(now_ms)
+"$out/kom" --emit=obj "$last/m$changed.k" > /dev/null
+"$out/kom" --link --run "$last"/m*.kobj > "$last/incremental.txt"
+end=$(now_ms)
+incremental=$((end - start))
+
+start=$(now_ms)
+"$out/kom" --link --run --jobs="$jobs" "$last"/m*.k > "$last/full.txt"
+end=$(now_ms)
+full=$((end - start))
+
+if ! cmp -s "$last/incremental.txt" "$last/full.txt"; then
+    echo "rebuilding one module and everything disagree" >&2
+    exit 1
+fi
+
+echo
+echo "one of $count modules changed: $incremental ms to rebuild it and relink, $full ms to rebuild all"
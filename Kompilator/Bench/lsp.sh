@@ -0,0 +1,34 @@
+#!/bin/sh
+# Keystroke latency of kom --lsp on large files. kgen writes a program
+# of each size; lspbench opens it in the server, types a word into a
+# function body past the middle of it and erases it again, timing each
+# keystroke until its diagnostics arrive, then sends a burst of them
+# without waiting. Sizes are in KB: 560 KB of kgen's mixed shape is
+# about 10k lines.
+#
+#   Bench/lsp.sh [keys] [sizes...]
+
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+root=$(dirname "$here")
+keys=${1:-400}
+out=${TMPDIR:-/tmp}/kom-bench
+cc=${CC:-cc}
+
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] || set -- 60 280 560 1120
+
+mkdir -p "$out/lsp"
+
+$cc -std=gnu11 -O2 -pthread "$root"/*.c -o "$out/kom"
+$cc -std=gnu11 -O2 "$here/kgen.c" -o "$out/kgen"
+$cc -std=gnu11 -O2 "$here/lspbench.c" -o "$out/lspbench"
+
+for size in "$@"; do
+    src="$out/lsp/mixed-$size.k"
+    "$out/kgen" --size="$size" > "$src"
+
+    echo "== $size KB"
+    "$out/lspbench" --keys="$keys" "$out/kom" "$src"
+done
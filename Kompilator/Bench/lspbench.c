@@ -0,0 +1,379 @@
+/* ---------------------------------------------
+   Language server keystroke latency
+
+   Starts kom --lsp, opens a file and types into
+   a function body in the middle of it, one
+   character per didChange, the way an editor
+   sends them: a word is typed, then erased.
+   Each keystroke is timed from the change
+   being written to the diagnostics for its
+   version arriving, so lexing, parsing,
+   checking and the reply are all in it.
+
+   A burst then sends the same keystrokes
+   without waiting, as a fast typist does;
+   only the last version has to be analysed.
+
+     lspbench [--keys=N] [--burst=N] kom file.k
+--------------------------------------------- */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+typedef struct Server {
+    int    to;
+    int    from;
+    pid_t  pid;
+    char  *buffer;
+    size_t start;
+    size_t end;
+    size_t capacity;
+} Server;
+
+static double now_ms(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static void *bench_alloc(void *p, size_t size)
+{
+    p = realloc(p, size);
+
+    if (!p)
+    {
+        fprintf(stderr, "Fatal: out of memory\n");
+        exit(1);
+    }
+
+    return p;
+}
+
+static void send_json(Server *s, const char *body, size_t size)
+{
+    char header[64];
+    int len = snprintf(header, sizeof(header), "Content-Length: %zu\r\n\r\n", size);
+
+    if (write(s->to, header, len) != len || write(s->to, body, size) != (ssize_t)size)
+    {
+        fprintf(stderr, "Error: the server stopped reading\n");
+        exit(1);
+    }
+}
+
+//the next message's body, NUL-terminated; valid until the next call
+static char *receive(Server *s)
+{
+    for (;;)
+    {
+        char *header_end = NULL;
+
+        for (size_t i = s->start; i + 4 <= s->end; i++)
+        {
+            if (memcmp(s->buffer + i, "\r\n\r\n", 4) == 0)
+            {
+                header_end = s->buffer + i + 4;
+                break;
+            }
+        }
+
+        if (header_end)
+        {
+            size_t length = strtoul(strstr(s->buffer + s->start, "Content-Length:") + 15, NULL, 10);
+            size_t body = header_end - s->buffer;
+
+            if (body + length <= s->end)
+            {
+                static char *message;
+
+                message = bench_alloc(message, length + 1);
+                memcpy(message, s->buffer + body, length);
+                message[length] = '\0';
+                s->start = body + length;
+
+                return message;
+            }
+        }
+
+        if (s->start > 0)
+        {
+            memmove(s->buffer, s->buffer + s->start, s->end - s->start);
+            s->end -= s->start;
+            s->start = 0;
+        }
+
+        if (s->capacity - s->end < 65536)
+        {
+            s->capacity = s->capacity ? s->capacity * 2 : 1 << 20;
+            s->buffer = bench_alloc(s->buffer, s->capacity + 1);
+        }
+
+        ssize_t got = read(s->from, s->buffer + s->end, s->capacity - s->end);
+
+        if (got <= 0)
+        {
+            fprintf(stderr, "Error: the server closed its output\n");
+            exit(1);
+        }
+
+        s->end += got;
+        s->buffer[s->end] = '\0';
+    }
+}
+
+//waits for the diagnostics of version and returns how many there are
+static int wait_diagnostics(Server *s, long version)
+{
+    char key[32];
+
+    snprintf(key, sizeof(key), "\"version\":%ld,", version);
+
+    for (;;)
+    {
+        char *m = receive(s);
+        int count = 0;
+
+        if (!strstr(m, "textDocument/publishDiagnostics") || !strstr(m, key))
+            continue;
+
+        for (char *at = strstr(m, "\"severity\""); at; at = strstr(at + 1, "\"severity\""))
+            count++;
+
+        return count;
+    }
+}
+
+static void start_server(Server *s, const char *kom)
+{
+    int to[2], from[2];
+
+    memset(s, 0, sizeof(*s));
+
+    if (pipe(to) != 0 || pipe(from) != 0)
+    {
+        perror("pipe");
+        exit(1);
+    }
+
+    s->pid = fork();
+
+    if (s->pid == 0)
+    {
+        dup2(to[0], 0);
+        dup2(from[1], 1);
+        close(to[1]);
+        close(from[0]);
+        execl(kom, kom, "--lsp", (char *)NULL);
+        perror(kom);
+        _exit(127);
+    }
+
+    close(to[0]);
+    close(from[1]);
+    s->to = to[1];
+    s->from = from[0];
+}
+
+static char *read_file(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    char *text;
+
+    if (!f)
+    {
+        fprintf(stderr, "Error: Could not open %s\n", path);
+        exit(1);
+    }
+
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    text = bench_alloc(NULL, *size + 1);
+
+    if (fread(text, 1, *size, f) != *size)
+    {
+        fprintf(stderr, "Error: Failed to read %s\n", path);
+        exit(1);
+    }
+
+    fclose(f);
+    text[*size] = '\0';
+
+    return text;
+}
+
+//the didOpen message, with the text escaped as a JSON string
+static char *open_message(const char *text, size_t size, size_t *out_size)
+{
+    char *m = bench_alloc(NULL, size * 6 + 256);
+    size_t len = sprintf(m, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didOpen\",\"params\":{\"textDocument\":"
+                            "{\"uri\":\"file:///bench.k\",\"languageId\":\"k\",\"version\":1,\"text\":\"");
+
+    for (size_t i = 0; i < size; i++)
+    {
+        unsigned char c = (unsigned char)text[i];
+
+        if (c == '"' || c == '\\')
+        {
+            m[len++] = '\\';
+            m[len++] = c;
+        }
+        else if (c < 0x20)
+        {
+            len += sprintf(m + len, "\\u%04x", c);
+        }
+        else
+        {
+            m[len++] = c;
+        }
+    }
+
+    len += sprintf(m + len, "\"}}}");
+    *out_size = len;
+
+    return m;
+}
+
+//keystroke k of typing and erasing word at (line, col): the change it sends
+static int keystroke(char *m, size_t size, long version, int line, int col, const char *word, int k)
+{
+    int len = (int)strlen(word);
+    int at = k % (2 * len);
+
+    if (at < len)
+        return snprintf(m, size, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didChange\",\"params\":{\"textDocument\":"
+                        "{\"uri\":\"file:///bench.k\",\"version\":%ld},\"contentChanges\":[{\"range\":{\"start\":"
+                        "{\"line\":%d,\"character\":%d},\"end\":{\"line\":%d,\"character\":%d}},\"text\":\"%c\"}]}}",
+                        version, line, col + at, line, col + at, word[at]);
+
+    at = 2 * len - at;
+
+    return snprintf(m, size, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didChange\",\"params\":{\"textDocument\":"
+                    "{\"uri\":\"file:///bench.k\",\"version\":%ld},\"contentChanges\":[{\"range\":{\"start\":"
+                    "{\"line\":%d,\"character\":%d},\"end\":{\"line\":%d,\"character\":%d}},\"text\":\"\"}]}}",
+                    version, line, col + at - 1, line, col + at);
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[])
+{
+    static const char word[] = "summa";
+    static const char initialize[] = "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"initialize\",\"params\":{}}";
+    static const char shutdown[] = "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"shutdown\"}";
+    static const char leave[] = "{\"jsonrpc\":\"2.0\",\"method\":\"exit\"}";
+    const char *kom = NULL, *path = NULL;
+    long keys = 200, burst = 50;
+    Server server;
+    size_t size, open_size;
+    char *text, *open;
+    char change[512];
+    double *times, start, opened, burst_ms;
+    long version = 1;
+    int line = -1, lines = 0, errors, status;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--keys=", 7) == 0)
+            keys = strtol(argv[i] + 7, NULL, 10);
+        else if (strncmp(argv[i], "--burst=", 8) == 0)
+            burst = strtol(argv[i] + 8, NULL, 10);
+        else if (!kom)
+            kom = argv[i];
+        else if (!path)
+            path = argv[i];
+        else
+            kom = NULL;
+    }
+
+    if (!kom || !path || keys < 1 || burst < 1)
+    {
+        fprintf(stderr, "usage: lspbench [--keys=N] [--burst=N] kom file.k\n");
+        return 1;
+    }
+
+    text = read_file(path, &size);
+
+    for (size_t i = 0; i < size; i++)
+        lines += text[i] == '\n';
+
+    //the first statement of a function body past the middle of the file
+    for (size_t i = 0, at = 0; i < size; i++)
+    {
+        if ((i == 0 || text[i - 1] == '\n') && (int)at++ >= lines / 2 && strncmp(text + i, "    ", 4) == 0 && text[i + 4] != ' ')
+        {
+            line = (int)at - 1;
+            break;
+        }
+    }
+
+    if (line < 0)
+    {
+        fprintf(stderr, "Error: %s has no indented statement past its middle\n", path);
+        return 1;
+    }
+
+    start_server(&server, kom);
+    send_json(&server, initialize, strlen(initialize));
+
+    open = open_message(text, size, &open_size);
+    start = now_ms();
+    send_json(&server, open, open_size);
+    errors = wait_diagnostics(&server, version);
+    opened = now_ms() - start;
+
+    times = bench_alloc(NULL, keys * sizeof(double));
+
+    for (long k = 0; k < keys; k++)
+    {
+        int len = keystroke(change, sizeof(change), ++version, line, 4, word, (int)k);
+
+        start = now_ms();
+        send_json(&server, change, len);
+        wait_diagnostics(&server, version);
+        times[k] = now_ms() - start;
+    }
+
+    //a whole burst is written before any reply is read
+    start = now_ms();
+
+    for (long k = 0; k < burst; k++)
+    {
+        int len = keystroke(change, sizeof(change), ++version, line, 4, word, (int)k);
+        send_json(&server, change, len);
+    }
+
+    wait_diagnostics(&server, version);
+    burst_ms = now_ms() - start;
+
+    send_json(&server, shutdown, strlen(shutdown));
+    send_json(&server, leave, strlen(leave));
+    waitpid(server.pid, &status, 0);
+
+    qsort(times, keys, sizeof(double), compare_double);
+
+    printf("file        %d lines, %zu bytes, %d diagnostics\n", lines, size, errors);
+    printf("open        %.2f ms\n", opened);
+    printf("keystroke   p50 %.2f ms  p90 %.2f ms  p99 %.2f ms  max %.2f ms  (%ld keys, line %d)\n",
+           times[keys / 2], times[keys * 9 / 10], times[keys * 99 / 100], times[keys - 1], keys, line + 1);
+    printf("burst       %.2f ms for %ld keys, %.3f ms per key\n", burst_ms, burst, burst_ms / burst);
+    printf("exit        %s\n", (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? "clean" : "failed");
+
+    free(times);
+    free(open);
+    free(text);
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* ---------------------------------------------
+   Driver for kom --emit=asm output
+
+   Links against the generated assembly, whose
+   weak main it replaces, and times ENTRE the
+   same way bench.h times the C transcriptions.
+   The module's data image is saved once and
+   restored before every run.
+
+   Built with -DKOM_C it drives kom --emit=c
+   output instead, whose globals the linker
+   gathers in section kom_data.
+--------------------------------------------- */
+
+extern int ENTRE(void);
+
+#ifdef KOM_C
+//weak: a program without globals has no kom_data section
+extern unsigned char __start_kom_data[] __attribute__((weak));
+extern unsigned char __stop_kom_data[] __attribute__((weak));
+#define __kom_data_begin __start_kom_data
+#define __kom_data_end   __stop_kom_data
+#else
+extern unsigned char __kom_data_begin[];
+extern unsigned char __kom_data_end[];
+#endif
+
+int main(int argc, char *argv[])
+{
+    long repeat = (argc > 1) ? strtol(argv[1], NULL, 10) : 1;
+    size_t size = (size_t)(__kom_data_end - __kom_data_begin);
+    unsigned char *image = malloc(size ? size : 1);
+    int result = 0;
+    double total_ns = 0;
+
+    memcpy(image, __kom_data_begin, size);
+
+    for (long r = 0; r < repeat; r++)
+    {
+        struct timespec start, end;
+
+        memcpy(__kom_data_begin, image, size);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        result = ENTRE();
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        total_ns += (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    }
+
+    printf("ENTRE returned %d\n", result);
+    printf("Run time: %.0f ns per run over %ld runs\n", total_ns / repeat, repeat);
+
+    free(image);
+    return 0;
+}
@@ -0,0 +1,61 @@
+#!/bin/sh
+# Times kom's x86-64 output for each sample run.sh covers twice: with
+# the linear-scan register allocator and with --no-regalloc, where
+# every value lives in a stack slot of its own. Results must agree;
+# the ratio is naive over allocated, and the last columns are the
+# values the allocator still spilled and the phi operands it coalesced.
+#
+#   Bench/regalloc.sh [repeat]
+
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+root=$(dirname "$here")
+repeat=${1:-100000}
+out=${TMPDIR:-/tmp}/kom-bench
+cc=${CC:-cc}
+
+mkdir -p "$out"
+
+ulimit -s unlimited 2>/dev/null || ulimit -s "$(ulimit -H -s)" 2>/dev/null || true
+
+$cc -std=gnu11 -O2 -pthread "$root"/*.c -o "$out/kom"
+
+result() { echo "$1" | sed -n 's/^ENTRE returned //p'; }
+ns()     { echo "$1" | sed -n 's/^Run time: \([0-9]*\) ns.*/\1/p'; }
+ratio()  { awk -v v="$1" -v c="$2" 'BEGIN { if (c > 0) printf "%.2fx", v / c; else print "-" }'; }
+column() { echo "$1" | awk -v k="$2" '$1 == "total" { print $k }'; }
+
+printf "%-28s %8s %10s %10s %8s %8s %8s %10s\n" \
+    "program" "result" "naive ns" "alloc ns" "speedup" "values" "spilled" "coalesced"
+
+for src in "$here"/c/*.c; do
+    name=$(basename "$src" .c)
+    sample="$root/Programs/Cleared/$name.k"
+    runs=$repeat
+
+    if [ -f "$here/k/$name.k" ]; then
+        sample="$here/k/$name.k"
+    fi
+
+    case "$name" in
+        *_large) runs=$((repeat / 1000 + 1)) ;;
+    esac
+
+    report=$("$out/kom" --emit=asm --ra-report --output="$out/$name-ra.s" "$sample")
+    "$out/kom" --emit=asm --no-regalloc --output="$out/$name-naive.s" "$sample" > /dev/null
+    $cc "$here/native.c" "$out/$name-ra.s" -o "$out/$name-ra"
+    $cc "$here/native.c" "$out/$name-naive.s" -o "$out/$name-naive"
+
+    alloc=$("$out/$name-ra" "$runs")
+    naive=$("$out/$name-naive" "$runs")
+
+    if [ "$(result "$alloc")" != "$(result "$naive")" ]; then
+        echo "$name: result mismatch (allocated $(result "$alloc"), naive $(result "$naive"))" >&2
+        exit 1
+    fi
+
+    printf "%-28s %8s %10s %10s %8s %8s %8s %10s\n" "$name" "$(result "$alloc")" \
+        "$(ns "$naive")" "$(ns "$alloc")" "$(ratio "$(ns "$naive")" "$(ns "$alloc")")" \
+        "$(column "$report" 2)" "$(column "$report" 4)" "$(column "$report" 6)"
+done
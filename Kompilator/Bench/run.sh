@@ -0,0 +1,76 @@
+#!/bin/sh
+# Times each sample that has a C transcription in c/ six ways: the
+# bytecode VM with and without the JIT tier (kom --repeat, --no-jit),
+# kom's x86-64 back end (--emit=asm linked with native.c), kom's C
+# output (--emit=c, -O2), and the transcription built with -O1 and -O2.
+# Results must agree; ratios are against C -O1. The x86-64 output built
+# with --no-opt is run once as well, only to check its result.
+#
+# Samples come from Programs/Cleared, or from k/ for the scaled-up
+# *_large versions, which run repeat/1000 times.
+#
+#   Bench/run.sh [repeat]
+
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+root=$(dirname "$here")
+repeat=${1:-100000}
+out=${TMPDIR:-/tmp}/kom-bench
+cc=${CC:-cc}
+
+mkdir -p "$out"
+
+# deep_recursion_large keeps a million frames where calls are not turned into jumps (C -O1, native mutual recursion)
+ulimit -s unlimited 2>/dev/null || ulimit -s "$(ulimit -H -s)" 2>/dev/null || true
+
+$cc -std=gnu11 -O2 -pthread "$root"/*.c -o "$out/kom"
+
+result() { echo "$1" | sed -n 's/^ENTRE returned //p'; }
+ns()     { echo "$1" | sed -n 's/^Run time: \([0-9]*\) ns.*/\1/p'; }
+ratio()  { awk -v v="$1" -v c="$2" 'BEGIN { if (c > 0) printf "%.1fx", v / c; else print "-" }'; }
+
+printf "%-28s %8s %10s %10s %10s %10s %10s %10s %8s %8s\n" \
+    "program" "result" "interp ns" "jit ns" "kom ns" "kom-c ns" "c-O1 ns" "c-O2 ns" "jit/O1" "kom/O1"
+
+for src in "$here"/c/*.c; do
+    name=$(basename "$src" .c)
+    sample="$root/Programs/Cleared/$name.k"
+    runs=$repeat
+
+    if [ -f "$here/k/$name.k" ]; then
+        sample="$here/k/$name.k"
+    fi
+
+    case "$name" in
+        *_large) runs=$((repeat / 1000 + 1)) ;;
+    esac
+
+    "$out/kom" --emit=asm --output="$out/$name.s" "$sample" > /dev/null
+    $cc "$here/native.c" "$out/$name.s" -o "$out/$name-kom"
+    "$out/kom" --emit=asm --no-opt --output="$out/$name-noopt.s" "$sample" > /dev/null
+    $cc "$here/native.c" "$out/$name-noopt.s" -o "$out/$name-noopt"
+    "$out/kom" --emit=c --output="$out/$name-kc.c" "$sample" > /dev/null
+    $cc -O2 -fwrapv -DKOM_C "$here/native.c" "$out/$name-kc.c" -o "$out/$name-kc"
+    $cc -std=gnu11 -O1 "$src" -o "$out/$name-O1"
+    $cc -std=gnu11 -O2 "$src" -o "$out/$name-O2"
+
+    vm=$("$out/kom" --repeat="$runs" --no-jit "$sample" | grep -E "^(ENTRE returned|Run time)")
+    jit=$("$out/kom" --repeat="$runs" "$sample" | grep -E "^(ENTRE returned|Run time)")
+    kom=$("$out/$name-kom" "$runs")
+    noopt=$("$out/$name-noopt" 1)
+    kc=$("$out/$name-kc" "$runs")
+    o1=$("$out/$name-O1" "$runs")
+    o2=$("$out/$name-O2" "$runs")
+
+    for other in "$jit" "$kom" "$noopt" "$kc" "$o1" "$o2"; do
+        if [ "$(result "$vm")" != "$(result "$other")" ]; then
+            echo "$name: result mismatch (vm $(result "$vm"), other $(result "$other"))" >&2
+            exit 1
+        fi
+    done
+
+    printf "%-28s %8s %10s %10s %10s %10s %10s %10s %8s %8s\n" "$name" "$(result "$vm")" \
+        "$(ns "$vm")" "$(ns "$jit")" "$(ns "$kom")" "$(ns "$kc")" "$(ns "$o1")" "$(ns "$o2")" \
+        "$(ratio "$(ns "$jit")" "$(ns "$o1")")" "$(ratio "$(ns "$kom")" "$(ns "$o1")")"
+done
@@ -0,0 +1,52 @@
+#!/bin/sh
+# Compares the latency of compiling each sample with a new kom process
+# against a request to a kom --serve already running. The process
+# column is the mean wall time of a full kom run; the server columns are
+# p50 / p99 round trips of a client sending the same file over and over
+# on one connection.
+#
+#   Bench/serve.sh [requests]
+
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+root=$(dirname "$here")
+requests=${1:-1000}
+out=${TMPDIR:-/tmp}/kom-bench
+socket=$out/kom.sock
+cc=${CC:-cc}
+
+mkdir -p "$out"
+
+$cc -std=gnu11 -O2 -pthread "$root"/*.c -o "$out/kom"
+
+"$out/kom" --serve="$socket" > /dev/null &
+server=$!
+trap 'kill "$server" 2>/dev/null' EXIT
+
+while [ ! -S "$socket" ]; do sleep 0.1; done
+
+now() { date +%s%N; }
+field() { echo "$1" | sed -n "s/.* $2 \([0-9]*\) us.*/\1/p"; }
+
+printf "%-28s %12s %10s %10s %8s\n" "program" "process us" "p50 us" "p99 us" "speedup"
+
+for sample in "$root"/Programs/Cleared/*.k "$here"/k/*.k; do
+    name=$(basename "$sample" .k)
+    runs=$((requests / 10 + 1))
+
+    start=$(now)
+    i=0
+    while [ "$i" -lt "$runs" ]; do
+        "$out/kom" --batch "$sample" > /dev/null 2>&1 || true
+        i=$((i + 1))
+    done
+    process=$(( ($(now) - start) / runs / 1000 ))
+
+    latency=$("$out/kom" --client="$socket" --requests="$requests" "$sample" 2>/dev/null | tail -n 1)
+    p50=$(field "$latency" p50)
+    p99=$(field "$latency" p99)
+
+    printf "%-28s %12s %10s %10s %8s\n" "$name" "$process" "$p50" "$p99" \
+        "$(awk -v a="$process" -v b="$p50" 'BEGIN { if (b > 0) printf "%.1fx", a / b; else print "-" }')"
+done
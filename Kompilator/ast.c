@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ast.h"
+
+void init_ast(Ast *ast, TokenBuffer *tokens, char **lexemes, int token_count)
+{
+    ast->node_capacity = 64;
+    ast->node_count    = 0;
+    ast->root          = AST_NULL;
+
+    ast->tokens      = tokens;
+    ast->lexemes     = lexemes;
+    ast->token_count = token_count;
+
+    ast->mapped         = 0;
+    ast->strings        = NULL;
+    ast->lexeme_offsets = NULL;
+    ast->token_types    = NULL;
+    ast->token_kinds    = NULL;
+    ast->rows           = NULL;
+    ast->cols           = NULL;
+
+    ast->nodes = malloc(ast->node_capacity * sizeof(AstNode));
+
+    if (!ast->nodes)
+    {
+        fprintf(stderr, "Fatal: failed to allocate AST storage\n");
+        exit(1);
+    }
+}
+
+void free_ast(Ast *ast)
+{
+    if (!ast->mapped)
+        free(ast->nodes);
+
+    ast->nodes         = NULL;
+    ast->node_count    = 0;
+    ast->node_capacity = 0;
+    ast->root          = AST_NULL;
+}
+
+int ast_new(Ast *ast, AstKind kind, int tok)
+{
+    if (ast->node_count >= ast->node_capacity)
+    {
+        ast->node_capacity *= 2;
+
+        ast->nodes = realloc(ast->nodes, ast->node_capacity * sizeof(AstNode));
+
+        if (!ast->nodes)
+        {
+            fprintf(stderr, "Fatal: AST realloc failed\n");
+            exit(1);
+        }
+    }
+
+    int id = ast->node_count++;
+    AstNode *n = &ast->nodes[id];
+
+    n->kind   = kind;
+    n->op     = TOK_ERROR;
+    n->tok    = tok;
+    n->kid[0] = AST_NULL;
+    n->kid[1] = AST_NULL;
+    n->kid[2] = AST_NULL;
+    n->kid[3] = AST_NULL;
+    n->list   = AST_NULL;
+    n->next   = AST_NULL;
+    n->aux    = 0;
+    n->flags  = 0;
+    n->type   = -1;
+    n->sym    = -1;
+
+    n->value.kind = CONST_NONE;
+    n->value.i    = 0;
+    n->value.f    = 0.0;
+
+    return id;
+}
+
+int ast_binary(Ast *ast, TokenType op, int tok, int lhs, int rhs)
+{
+    int id = ast_new(ast, AST_BINARY, tok);
+
+    ast->nodes[id].op     = op;
+    ast->nodes[id].kid[0] = lhs;
+    ast->nodes[id].kid[1] = rhs;
+
+    return id;
+}
+
+//links child at the end of a list tracked by (head, tail)
+void ast_append(Ast *ast, int *head, int *tail, int child)
+{
+    if (child == AST_NULL)
+        return;
+
+    if (*head == AST_NULL)
+        *head = child;
+    else
+        ast->nodes[*tail].next = child;
+
+    *tail = child;
+}
+
+const char *ast_name(const Ast *ast, int node)
+{
+    int tok = ast->nodes[node].tok;
+
+    if (tok < 0 || tok >= ast->token_count)
+        return "?";
+
+    if (ast->strings)
+        return ast->strings + ast->lexeme_offsets[tok];
+
+    return ast->lexemes ? ast->lexemes[tok] : "?";
+}
+
+int ast_row(const Ast *ast, int node)
+{
+    int tok = ast->nodes[node].tok;
+
+    if (tok < 0 || tok >= ast->token_count)
+        return 0;
+
+    return ast->rows ? ast->rows[tok] : ast->tokens[tok].row;
+}
+
+int ast_col(const Ast *ast, int node)
+{
+    int tok = ast->nodes[node].tok;
+
+    if (tok < 0 || tok >= ast->token_count)
+        return 0;
+
+    return ast->cols ? ast->cols[tok] : ast->tokens[tok].col;
+}
+
+int ast_list_length(const Ast *ast, int first)
+{
+    int n = 0;
+
+    for (int i = first; i != AST_NULL; i = ast->nodes[i].next)
+        n++;
+
+    return n;
+}
+
+const char *ast_kind_name(AstKind kind)
+{
+    switch (kind)
+    {
+        case AST_PROGRAM:     return "PROGRAM";
+        case AST_FUNCTION:    return "FUNCTION";
+        case AST_PARAM:       return "PARAM";
+        case AST_VAR_DECL:    return "VAR_DECL";
+        case AST_STRUCT_DECL: return "STRUCT_DECL";
+        case AST_FIELD_DECL:  return "FIELD_DECL";
+        case AST_TYPEDEF:     return "TYPEDEF";
+        case AST_ENUM_DECL:   return "ENUM_DECL";
+        case AST_ENUMERATOR:  return "ENUMERATOR";
+        case AST_TYPE:        return "TYPE";
+        case AST_BLOCK:       return "BLOCK";
+        case AST_IF:          return "IF";
+        case AST_WHILE:       return "WHILE";
+        case AST_DO_WHILE:    return "DO_WHILE";
+        case AST_FOR:         return "FOR";
+        case AST_SWITCH:      return "SWITCH";
+        case AST_CASE:        return "CASE";
+        case AST_BREAK:       return "BREAK";
+        case AST_CONTINUE:    return "CONTINUE";
+        case AST_GOTO:        return "GOTO";
+        case AST_LABEL:       return "LABEL";
+        case AST_RETURN:      return "RETURN";
+        case AST_EXPR_STMT:   return "EXPR_STMT";
+        case AST_ASSIGN:      return "ASSIGN";
+        case AST_UPDATE:      return "UPDATE";
+        case AST_INT_LIT:     return "INT_LIT";
+        case AST_FLOAT_LIT:   return "FLOAT_LIT";
+        case AST_STRING_LIT:  return "STRING_LIT";
+        case AST_IDENT:       return "IDENT";
+        case AST_BINARY:      return "BINARY";
+        case AST_UNARY:       return "UNARY";
+        case AST_DEREF:       return "DEREF";
+        case AST_ADDRESS:     return "ADDRESS";
+        case AST_CAST:        return "CAST";
+        case AST_CALL:        return "CALL";
+        case AST_INDEX:       return "INDEX";
+        case AST_FIELD:       return "FIELD";
+        case AST_ARRAY_LIT:   return "ARRAY_LIT";
+        case AST_ERROR:       return "ERROR";
+        default:              return "UNKNOWN";
+    }
+}
+
+void dump_ast(const Ast *ast, int node, int depth)
+{
+    if (node == AST_NULL)
+        return;
+
+    const AstNode *n = &ast->nodes[node];
+
+    printf("%*s%s", depth * 2, "", ast_kind_name(n->kind));
+
+    switch (n->kind)
+    {
+        case AST_BINARY:
+        case AST_UNARY:
+        case AST_UPDATE:
+        case AST_TYPE:
+            printf(" %s", tok2lexeme(n->op));
+            break;
+
+        default:
+            break;
+    }
+
+    if (n->tok >= 0 && n->kind != AST_BINARY && n->kind != AST_UNARY && n->kind != AST_UPDATE)
+        printf(" '%s'", ast_name(ast, node));
+
+    if (n->kind == AST_TYPE && n->aux > 0)
+        printf(" PEK x%d", n->aux);
+
+    if (n->kind == AST_FIELD && n->type >= 0)
+        printf(" @%d", n->aux);
+
+    if (n->value.kind == CONST_INT)
+        printf(" = %lld", n->value.i);
+    else if (n->value.kind == CONST_FLOAT)
+        printf(" = %g", n->value.f);
+
+    printf("\n");
+
+    for (int k = 0; k < 4; k++)
+        dump_ast(ast, n->kid[k], depth + 1);
+
+    for (int c = n->list; c != AST_NULL; c = ast->nodes[c].next)
+        dump_ast(ast, c, depth + 1);
+}
@@ -0,0 +1,181 @@
+#ifndef AST_H
+#define AST_H
+
+#include <stdint.h>
+
+#include "lexer.h"
+#include "tokenkeytab.h"
+
+/* ---------------------------------------------
+   Abstract syntax tree
+
+   Nodes live in one flat, growable array and refer
+   to each other by index (AST_NULL when absent), so
+   the tree can be walked, copied or written out
+   without chasing pointers.
+--------------------------------------------- */
+#define AST_NULL (-1)
+
+/* flags (AstNode.flags) */
+#define AST_FLAG_EXTERN     0x01    // EXTERN on a function or declaration
+#define AST_FLAG_TYPEDEF    0x02    // struct declared through TYPDEF STRUKTUR
+#define AST_FLAG_UNSIGNED   0x04    // OSIGNERAD on a type
+#define AST_FLAG_CONST      0x08    // KONSTANT on a type
+#define AST_FLAG_STATIC     0x10    // STATISK on a declaration
+
+typedef enum AstKind {
+
+    // Program structure
+    AST_PROGRAM,
+    AST_FUNCTION,
+    AST_PARAM,
+    AST_VAR_DECL,
+    AST_STRUCT_DECL,
+    AST_FIELD_DECL,
+    AST_TYPEDEF,
+    AST_ENUM_DECL,
+    AST_ENUMERATOR,
+    AST_TYPE,
+
+    // Statements
+    AST_BLOCK,
+    AST_IF,
+    AST_WHILE,
+    AST_DO_WHILE,
+    AST_FOR,
+    AST_SWITCH,
+    AST_CASE,
+    AST_BREAK,
+    AST_CONTINUE,
+    AST_GOTO,
+    AST_LABEL,
+    AST_RETURN,
+    AST_EXPR_STMT,
+    AST_ASSIGN,
+    AST_UPDATE,
+
+    // Expressions
+    AST_INT_LIT,
+    AST_FLOAT_LIT,
+    AST_STRING_LIT,
+    AST_IDENT,
+    AST_BINARY,
+    AST_UNARY,
+    AST_DEREF,
+    AST_ADDRESS,
+    AST_CAST,
+    AST_CALL,
+    AST_INDEX,
+    AST_FIELD,
+    AST_ARRAY_LIT,
+
+    AST_ERROR
+
+} AstKind;
+
+/*
+   Child layout per kind (kid[] slots, unused = AST_NULL):
+
+   PROGRAM      list: global items
+   FUNCTION     tok: name   kid0: return type   kid1: body   list: params
+   PARAM        tok: name   kid0: type
+   VAR_DECL     tok: name   kid0: type   kid1: initializer
+   STRUCT_DECL  tok: name   list: fields
+   FIELD_DECL   tok: name   kid0: type
+   TYPEDEF      tok: name   kid0: aliased type
+   ENUM_DECL    tok: name   list: enumerators
+   ENUMERATOR   tok: name   kid0: explicit value
+   TYPE         op: base token (TOK_HEL.., TOK_IDENTIFIER, TOK_STRUKTUR)
+                tok: user type name   aux: PEK count   list: array dimensions
+                flags: AST_FLAG_UNSIGNED / AST_FLAG_CONST
+
+   BLOCK        list: statements
+   IF           kid0: condition   kid1: then block   kid2: else block
+   WHILE        kid0: condition   kid1: body
+   DO_WHILE     kid0: condition   kid1: body
+   FOR          kid0: init   kid1: condition   kid2: update   kid3: body
+   SWITCH       kid0: selector   list: cases
+   CASE         kid0: label value (AST_NULL for ANNARS)   list: statements
+   GOTO/LABEL   tok: label name
+   RETURN       kid0: value
+   EXPR_STMT    kid0: expression
+   ASSIGN       kid0: lvalue   kid1: value
+   UPDATE       op: TOK_OKAR / TOK_MINSKAR / TOK_*_ASSIGN / TOK_SHL_ASSIGN / TOK_SHR_ASSIGN
+                kid0: lvalue   kid1: operand
+
+   BINARY       op: operator token (shifts use TOK_VANSTER / TOK_HOGER)   kid0, kid1
+   UNARY        op: TOK_MINUS / TOK_PLUS / TOK_INTE / TOK_BITNOT   kid0
+   DEREF        kid0: pointer
+   ADDRESS      kid0: lvalue
+   CAST         kid0: target type   kid1: operand
+   CALL         tok: callee   list: arguments
+   INDEX        kid0: base   kid1: index
+   FIELD        kid0: base   tok: field name   aux: byte offset (after layout)
+   ARRAY_LIT    list: elements
+*/
+/* compile-time value of an expression, filled in by constant folding */
+typedef enum ConstKind {
+    CONST_NONE,
+    CONST_INT,      // i holds the value already wrapped to the node's type
+    CONST_FLOAT
+} ConstKind;
+
+typedef struct ConstValue {
+    ConstKind  kind;
+    long long  i;
+    double     f;
+} ConstValue;
+
+typedef struct AstNode {
+    AstKind    kind;
+    TokenType  op;
+    int        tok;        // token index of the name / leading token
+    int        kid[4];
+    int        list;       // first node of a child list
+    int        next;       // next sibling inside a list
+    int        aux;        // kind-specific payload, see table above
+    int        flags;      // AST_FLAG_* bits
+    int        type;       // resolved type id (-1 until semantic analysis)
+    int        sym;        // resolved symbol id (-1 until semantic analysis)
+    ConstValue value;      // folded value (CONST_NONE if not a constant)
+} AstNode;
+
+typedef struct Ast {
+    AstNode     *nodes;
+    int          node_count;
+    int          node_capacity;
+
+    int          root;
+
+    TokenBuffer *tokens;    // token stream the tree was built from
+    char       **lexemes;   // lexeme text, indexed like tokens
+    int          token_count;
+
+    //a tree loaded from a .kast file (astbin.h) reads its tokens from the mapped arrays instead
+    int             mapped;         // nodes point into the file: not freed here
+    const char     *strings;
+    size_t          strings_size;
+    const uint32_t *lexeme_offsets;
+    const int32_t  *token_types;
+    const uint8_t  *token_kinds;
+    const int32_t  *rows;
+    const int32_t  *cols;
+} Ast;
+
+
+void init_ast(Ast *ast, TokenBuffer *tokens, char **lexemes, int token_count);
+void free_ast(Ast *ast);
+
+int  ast_new(Ast *ast, AstKind kind, int tok);
+int  ast_binary(Ast *ast, TokenType op, int tok, int lhs, int rhs);
+void ast_append(Ast *ast, int *head, int *tail, int child);
+
+const char *ast_name(const Ast *ast, int node);
+int  ast_row(const Ast *ast, int node);
+int  ast_col(const Ast *ast, int node);
+int  ast_list_length(const Ast *ast, int first);
+
+const char *ast_kind_name(AstKind kind);
+void dump_ast(const Ast *ast, int node, int depth);
+
+#endif /* AST_H */
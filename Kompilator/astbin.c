@@ -0,0 +1,475 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "astbin.h"
+
+//the node layout documented in astbin.h is the in-memory one, so a mapped file is used as it is
+_Static_assert(sizeof(AstBinHeader) == 128, "AstBinHeader must stay 128 bytes");
+_Static_assert(sizeof(AstNode) == 80, "AstNode layout changed: bump AST_BIN_VERSION and astbin.h");
+_Static_assert(offsetof(AstNode, kid) == 12 && offsetof(AstNode, list) == 28 && offsetof(AstNode, sym) == 48 &&
+               offsetof(AstNode, value) == 56, "AstNode layout changed: bump AST_BIN_VERSION and astbin.h");
+_Static_assert(sizeof(TokenType) == 4 && sizeof(AstKind) == 4 && sizeof(ConstKind) == 4, "enums must be 32-bit");
+
+static uint64_t align8(uint64_t n)
+{
+    return (n + 7) & ~(uint64_t)7;
+}
+
+//token i of a tree from the parser or from a file
+static const char *token_text(const Ast *ast, int i)
+{
+    if (ast->strings)
+        return ast->strings + ast->lexeme_offsets[i];
+
+    return (ast->lexemes && ast->lexemes[i]) ? ast->lexemes[i] : "";
+}
+
+static int32_t token_type(const Ast *ast, int i)
+{
+    return ast->token_types ? ast->token_types[i] : (int32_t)ast->tokens[i].token;
+}
+
+static uint8_t token_kind(const Ast *ast, int i)
+{
+    return ast->token_kinds ? ast->token_kinds[i] : (uint8_t)ast->tokens[i].kind;
+}
+
+static int32_t token_row(const Ast *ast, int i)
+{
+    return ast->rows ? ast->rows[i] : ast->tokens[i].row;
+}
+
+static int32_t token_col(const Ast *ast, int i)
+{
+    return ast->cols ? ast->cols[i] : ast->tokens[i].col;
+}
+
+static int write_padding(FILE *out, uint64_t *at, uint64_t to)
+{
+    static const char zeros[8];
+
+    if (to > *at && fwrite(zeros, 1, to - *at, out) != to - *at)
+        return 1;
+
+    *at = to;
+    return 0;
+}
+
+//each section is written whole from one buffer
+static int write_section(FILE *out, uint64_t *at, uint64_t offset, const void *data, size_t size)
+{
+    if (write_padding(out, at, offset) != 0 || (size > 0 && fwrite(data, 1, size, out) != size))
+        return 1;
+
+    *at += size;
+    return 0;
+}
+
+static void *bin_alloc(size_t size)
+{
+    void *p = malloc(size ? size : 1);
+
+    if (!p)
+    {
+        fprintf(stderr, "Fatal: failed to allocate AST image\n");
+        exit(1);
+    }
+
+    return p;
+}
+
+int write_ast_bin(const Ast *ast, FILE *out)
+{
+    AstBinHeader h;
+    uint32_t count = (uint32_t)ast->token_count;
+    uint32_t *offsets = bin_alloc(count * sizeof(uint32_t));
+    int32_t *types = bin_alloc(count * sizeof(int32_t));
+    uint8_t *kinds = bin_alloc(count);
+    int32_t *rows = bin_alloc(count * sizeof(int32_t));
+    int32_t *cols = bin_alloc(count * sizeof(int32_t));
+    uint64_t strings_size = 0;
+    uint64_t at = 0;
+    char *strings;
+    int failed;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        offsets[i] = (uint32_t)strings_size;
+        strings_size += strlen(token_text(ast, i)) + 1;
+        types[i] = token_type(ast, i);
+        kinds[i] = token_kind(ast, i);
+        rows[i]  = token_row(ast, i);
+        cols[i]  = token_col(ast, i);
+    }
+
+    strings = bin_alloc(strings_size);
+
+    for (uint32_t i = 0; i < count; i++)
+        strcpy(strings + offsets[i], token_text(ast, i));
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, AST_BIN_MAGIC, sizeof(h.magic));
+    h.version      = AST_BIN_VERSION;
+    h.node_size    = sizeof(AstNode);
+    h.root         = ast->root;
+    h.token_count  = count;
+    h.node_count   = (uint32_t)ast->node_count;
+    h.strings      = sizeof(h);
+    h.strings_size = strings_size;
+    h.lexemes      = align8(h.strings + strings_size);
+    h.token_types  = align8(h.lexemes + count * sizeof(uint32_t));
+    h.token_kinds  = align8(h.token_types + count * sizeof(int32_t));
+    h.rows         = align8(h.token_kinds + count);
+    h.cols         = align8(h.rows + count * sizeof(int32_t));
+    h.nodes        = align8(h.cols + count * sizeof(int32_t));
+    h.file_size    = h.nodes + (uint64_t)ast->node_count * sizeof(AstNode);
+
+    failed = write_section(out, &at, 0, &h, sizeof(h)) ||
+             write_section(out, &at, h.strings, strings, strings_size) ||
+             write_section(out, &at, h.lexemes, offsets, count * sizeof(uint32_t)) ||
+             write_section(out, &at, h.token_types, types, count * sizeof(int32_t)) ||
+             write_section(out, &at, h.token_kinds, kinds, count) ||
+             write_section(out, &at, h.rows, rows, count * sizeof(int32_t)) ||
+             write_section(out, &at, h.cols, cols, count * sizeof(int32_t)) ||
+             write_section(out, &at, h.nodes, ast->nodes, (size_t)ast->node_count * sizeof(AstNode));
+
+    free(strings);
+    free(offsets);
+    free(types);
+    free(kinds);
+    free(rows);
+    free(cols);
+
+    return failed;
+}
+
+//a section of count items of size bytes lies inside the file, aligned for its type
+static int section_fits(const AstBinHeader *h, uint64_t offset, uint64_t count, uint64_t size, uint64_t align)
+{
+    return offset >= sizeof(*h) && offset % align == 0 && offset <= h->file_size &&
+           count <= (h->file_size - offset) / size;
+}
+
+int load_ast_bin(const char *path, Ast *ast, AstBinFile *file, FILE *err)
+{
+    struct stat st;
+    const AstBinHeader *h;
+    const char *base;
+    int fd = open(path, O_RDONLY);
+
+    file->map  = NULL;
+    file->size = 0;
+
+    if (fd < 0)
+    {
+        fprintf(err, "Error: Could not open %s\n", path);
+        return 1;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(AstBinHeader))
+    {
+        fprintf(err, "Error: %s is not a .kast file\n", path);
+        close(fd);
+        return 1;
+    }
+
+    //private and writable: passes annotate nodes in place, and the pages they touch are copied
+    file->map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    file->size = st.st_size;
+    close(fd);
+
+    if (file->map == MAP_FAILED)
+    {
+        fprintf(err, "Error: Could not map %s\n", path);
+        file->map = NULL;
+        return 1;
+    }
+
+    base = file->map;
+    h = file->map;
+
+    if (memcmp(h->magic, AST_BIN_MAGIC, sizeof(h->magic)) != 0 || h->version != AST_BIN_VERSION ||
+        h->node_size != sizeof(AstNode) || h->file_size != file->size || h->token_count > INT32_MAX ||
+        h->node_count > INT32_MAX ||
+        !section_fits(h, h->strings, h->strings_size, 1, 1) ||
+        !section_fits(h, h->lexemes, h->token_count, sizeof(uint32_t), 4) ||
+        !section_fits(h, h->token_types, h->token_count, sizeof(int32_t), 4) ||
+        !section_fits(h, h->token_kinds, h->token_count, 1, 1) ||
+        !section_fits(h, h->rows, h->token_count, sizeof(int32_t), 4) ||
+        !section_fits(h, h->cols, h->token_count, sizeof(int32_t), 4) ||
+        !section_fits(h, h->nodes, h->node_count, sizeof(AstNode), 8) ||
+        (h->strings_size > 0 && base[h->strings + h->strings_size - 1] != '\0') ||
+        h->root < AST_NULL || h->root >= (int32_t)h->node_count)
+    {
+        fprintf(err, "Error: %s is not a version %d .kast file of this build\n", path, AST_BIN_VERSION);
+        close_ast_bin(file);
+        return 1;
+    }
+
+    memset(ast, 0, sizeof(*ast));
+
+    ast->mapped         = 1;
+    ast->nodes          = (AstNode *)(base + h->nodes);
+    ast->node_count     = (int)h->node_count;
+    ast->node_capacity  = (int)h->node_count;
+    ast->root           = h->root;
+    ast->token_count    = (int)h->token_count;
+    ast->strings        = base + h->strings;
+    ast->strings_size   = h->strings_size;
+    ast->lexeme_offsets = (const uint32_t *)(base + h->lexemes);
+    ast->token_types    = (const int32_t *)(base + h->token_types);
+    ast->token_kinds    = (const uint8_t *)(base + h->token_kinds);
+    ast->rows           = (const int32_t *)(base + h->rows);
+    ast->cols           = (const int32_t *)(base + h->cols);
+
+    return 0;
+}
+
+void close_ast_bin(AstBinFile *file)
+{
+    if (file->map)
+        munmap(file->map, file->size);
+
+    file->map  = NULL;
+    file->size = 0;
+}
+
+//every link in range and at most one parent per node: walks from the root then end and never loop
+static int link_ok(const Ast *ast, int n, unsigned char *parents)
+{
+    if (n == AST_NULL)
+        return 1;
+
+    if (n < 0 || n >= ast->node_count || parents[n])
+        return 0;
+
+    parents[n] = 1;
+    return 1;
+}
+
+//the operator tokens the parser gives each kind; every other kind keeps TOK_ERROR
+static int op_ok(AstKind kind, TokenType op)
+{
+    switch (kind)
+    {
+        case AST_TYPE:
+            return op == TOK_HEL || op == TOK_FLYT || op == TOK_BOK || op == TOK_BIT || op == TOK_HALV ||
+                   op == TOK_BYTE || op == TOK_ORD || op == TOK_VAL || op == TOK_TOM || op == TOK_KORT ||
+                   op == TOK_LANG || op == TOK_DUBBEL || op == TOK_LANG_DUBBEL || op == TOK_IDENTIFIER ||
+                   op == TOK_STRUKTUR;
+
+        case AST_UPDATE:
+            return op == TOK_OKAR || op == TOK_MINSKAR || op == TOK_PLUS_ASSIGN || op == TOK_MINUS_ASSIGN ||
+                   op == TOK_MUL_ASSIGN || op == TOK_DIV_ASSIGN || op == TOK_SHL_ASSIGN || op == TOK_SHR_ASSIGN;
+
+        case AST_BINARY:
+            return op == TOK_OCH || op == TOK_ELLER || op == TOK_BITAND || op == TOK_BITOR || op == TOK_BITXOR ||
+                   op == TOK_EQ || op == TOK_NEQ || op == TOK_LT || op == TOK_GT || op == TOK_LTE || op == TOK_GTE ||
+                   op == TOK_VANSTER || op == TOK_HOGER || op == TOK_PLUS || op == TOK_MINUS || op == TOK_MUL ||
+                   op == TOK_DIV || op == TOK_MOD;
+
+        case AST_UNARY:
+            return op == TOK_MINUS || op == TOK_PLUS || op == TOK_INTE || op == TOK_BITNOT;
+
+        default:
+            return op == TOK_ERROR;
+    }
+}
+
+//what may fill a child slot or list, as the parser builds each kind (ast.h)
+typedef enum ChildClass {
+    CHILD_NONE,                 // always AST_NULL
+    CHILD_EXPR,
+    CHILD_STMT,
+    CHILD_BLOCK,
+    CHILD_TYPE,
+    CHILD_GLOBAL,
+    CHILD_PARAM,
+    CHILD_FIELD,
+    CHILD_ENUMERATOR,
+    CHILD_CASE
+} ChildClass;
+
+#define CHILD_OPTIONAL  0x100   // may also be AST_NULL; lists always may
+
+typedef struct NodeShape {
+    int kid[4];
+    int list;
+} NodeShape;
+
+static const NodeShape node_shapes[AST_ERROR + 1] = {
+    [AST_PROGRAM]     = { { 0 }, CHILD_GLOBAL },
+    [AST_FUNCTION]    = { { CHILD_TYPE, CHILD_BLOCK | CHILD_OPTIONAL }, CHILD_PARAM },
+    [AST_PARAM]       = { { CHILD_TYPE }, CHILD_NONE },
+    [AST_VAR_DECL]    = { { CHILD_TYPE, CHILD_EXPR | CHILD_OPTIONAL }, CHILD_NONE },
+    [AST_STRUCT_DECL] = { { 0 }, CHILD_FIELD },
+    [AST_FIELD_DECL]  = { { CHILD_TYPE }, CHILD_NONE },
+    [AST_TYPEDEF]     = { { CHILD_TYPE }, CHILD_NONE },
+    [AST_ENUM_DECL]   = { { 0 }, CHILD_ENUMERATOR },
+    [AST_ENUMERATOR]  = { { CHILD_EXPR | CHILD_OPTIONAL }, CHILD_NONE },
+    [AST_TYPE]        = { { 0 }, CHILD_EXPR },
+    [AST_BLOCK]       = { { 0 }, CHILD_STMT },
+    [AST_IF]          = { { CHILD_EXPR, CHILD_BLOCK, CHILD_STMT | CHILD_OPTIONAL }, CHILD_NONE },
+    [AST_WHILE]       = { { CHILD_EXPR, CHILD_BLOCK }, CHILD_NONE },
+    [AST_DO_WHILE]    = { { CHILD_EXPR, CHILD_BLOCK }, CHILD_NONE },
+    [AST_FOR]         = { { CHILD_STMT | CHILD_OPTIONAL, CHILD_EXPR | CHILD_OPTIONAL,
+                            CHILD_STMT | CHILD_OPTIONAL, CHILD_BLOCK }, CHILD_NONE },
+    [AST_SWITCH]      = { { CHILD_EXPR }, CHILD_CASE },
+    [AST_CASE]        = { { CHILD_EXPR | CHILD_OPTIONAL }, CHILD_STMT },
+    [AST_RETURN]      = { { CHILD_EXPR | CHILD_OPTIONAL }, CHILD_NONE },
+    [AST_EXPR_STMT]   = { { CHILD_EXPR }, CHILD_NONE },
+    [AST_ASSIGN]      = { { CHILD_EXPR, CHILD_EXPR }, CHILD_NONE },
+    [AST_UPDATE]      = { { CHILD_EXPR, CHILD_EXPR }, CHILD_NONE },
+    [AST_BINARY]      = { { CHILD_EXPR, CHILD_EXPR }, CHILD_NONE },
+    [AST_UNARY]       = { { CHILD_EXPR }, CHILD_NONE },
+    [AST_DEREF]       = { { CHILD_EXPR }, CHILD_NONE },
+    [AST_ADDRESS]     = { { CHILD_EXPR }, CHILD_NONE },
+    [AST_CAST]        = { { CHILD_TYPE, CHILD_EXPR }, CHILD_NONE },
+    [AST_CALL]        = { { 0 }, CHILD_EXPR },
+    [AST_INDEX]       = { { CHILD_EXPR, CHILD_EXPR }, CHILD_NONE },
+    [AST_FIELD]       = { { CHILD_EXPR }, CHILD_NONE },
+    [AST_ARRAY_LIT]   = { { 0 }, CHILD_EXPR }
+};
+
+static int in_class(AstKind kind, int want)
+{
+    switch (want)
+    {
+        case CHILD_EXPR:       return kind >= AST_INT_LIT && kind <= AST_ARRAY_LIT;
+        case CHILD_STMT:       return kind == AST_VAR_DECL || (kind >= AST_BLOCK && kind <= AST_UPDATE && kind != AST_CASE);
+        case CHILD_BLOCK:      return kind == AST_BLOCK;
+        case CHILD_TYPE:       return kind == AST_TYPE;
+        case CHILD_GLOBAL:     return kind == AST_FUNCTION || kind == AST_VAR_DECL || kind == AST_STRUCT_DECL ||
+                                      kind == AST_TYPEDEF || kind == AST_ENUM_DECL;
+        case CHILD_PARAM:      return kind == AST_PARAM;
+        case CHILD_FIELD:      return kind == AST_FIELD_DECL;
+        case CHILD_ENUMERATOR: return kind == AST_ENUMERATOR;
+        case CHILD_CASE:       return kind == AST_CASE;
+        default:               return 0;
+    }
+}
+
+/* every child the kind needs is there and of the kind the parser puts there. Runs once links are
+   known to be in range with one parent each, so every list ends */
+static int shape_ok(const Ast *ast, const AstNode *n)
+{
+    const NodeShape *shape = &node_shapes[n->kind];
+
+    //only the program and a bare OSIGNERAD / SIGNERAD type have no token of their own
+    if (n->kind == AST_ERROR || (n->tok == AST_NULL && n->kind != AST_PROGRAM && n->kind != AST_TYPE))
+        return 0;
+
+    for (int k = 0; k < 4; k++)
+    {
+        int want = shape->kid[k];
+
+        //ÖKAR and MINSKAR step by one; every other update has an operand
+        if (n->kind == AST_UPDATE && k == 1 && (n->op == TOK_OKAR || n->op == TOK_MINSKAR))
+            want = CHILD_NONE;
+
+        if (n->kid[k] == AST_NULL)
+        {
+            if (want != CHILD_NONE && !(want & CHILD_OPTIONAL))
+                return 0;
+        }
+        else if (!in_class(ast->nodes[n->kid[k]].kind, want & ~CHILD_OPTIONAL))
+        {
+            return 0;
+        }
+    }
+
+    for (int item = n->list; item != AST_NULL; item = ast->nodes[item].next)
+    {
+        if (!in_class(ast->nodes[item].kind, shape->list))
+            return 0;
+    }
+
+    return 1;
+}
+
+int check_ast_bin(Ast *ast, FILE *err)
+{
+    unsigned char *parents = calloc(ast->node_count + 1, 1);
+    int failed = 0;
+
+    if (!parents)
+    {
+        fprintf(stderr, "Fatal: failed to allocate AST check\n");
+        exit(1);
+    }
+
+    if (ast->root != AST_NULL)
+        parents[ast->root] = 1;
+
+    for (int i = 0; i < ast->node_count && !failed; i++)
+    {
+        const AstNode *n = &ast->nodes[i];
+        int ok = (unsigned)n->kind <= AST_ERROR && n->tok >= AST_NULL && n->tok < ast->token_count &&
+                 link_ok(ast, n->list, parents) && link_ok(ast, n->next, parents);
+
+        for (int k = 0; k < 4; k++)
+            ok = ok && link_ok(ast, n->kid[k], parents);
+
+        if (!ok)
+        {
+            fprintf(err, "Error: node %d of the loaded tree has a link out of range or a second parent\n", i);
+            failed = 1;
+            break;
+        }
+
+        //a PEK count comes from one token per PEK; only sema fills in aux for any other kind
+        if (!op_ok(n->kind, n->op) || n->aux < 0 || n->aux > (n->kind == AST_TYPE ? ast->token_count : 0))
+        {
+            fprintf(err, "Error: node %d of the loaded tree has an operator or count the parser cannot give it\n", i);
+            failed = 1;
+        }
+    }
+
+    if (!failed && ast->root != AST_NULL && ast->nodes[ast->root].kind != AST_PROGRAM)
+    {
+        fprintf(err, "Error: the root of the loaded tree is not a program\n");
+        failed = 1;
+    }
+
+    for (int i = 0; i < ast->node_count && !failed; i++)
+    {
+        if (!shape_ok(ast, &ast->nodes[i]))
+        {
+            fprintf(err, "Error: node %d of the loaded tree is missing a child or has one the parser cannot give it\n", i);
+            failed = 1;
+        }
+    }
+
+    //the file is the parser's word on shape only: types, symbols and values are sema's to work out
+    for (int i = 0; i < ast->node_count && !failed; i++)
+    {
+        AstNode *n = &ast->nodes[i];
+
+        n->type       = -1;
+        n->sym        = -1;
+        n->value.kind = CONST_NONE;
+        n->value.i    = 0;
+        n->value.f    = 0.0;
+    }
+
+    //lexeme offsets must land inside the string table, which ends in a NUL
+    for (int i = 0; i < ast->token_count && !failed; i++)
+    {
+        if (ast->lexeme_offsets[i] >= ast->strings_size)
+        {
+            fprintf(err, "Error: token %d of the loaded tree has no text in the file\n", i);
+            failed = 1;
+        }
+    }
+
+    free(parents);
+
+    return failed;
+}
@@ -0,0 +1,97 @@
+#ifndef ASTBIN_H
+#define ASTBIN_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ast.h"
+
+/* ---------------------------------------------
+   Binary token / AST files (.kast)
+
+   kom --emit=ast-bin writes the tree straight
+   from the parser, before semantic analysis,
+   so the file depends only on the source.
+   kom --load-ast=file.kast (or naming a .kast
+   file) continues from there without decoding,
+   lexing or parsing.
+
+   The file is meant to be mapped and used in
+   place: every section starts on an 8-byte
+   boundary and refers to others by offset or
+   index, never by pointer. Loading maps the
+   file and checks the header; check_ast_bin
+   then walks the nodes once, as the file is
+   not trusted, bounding every link, operator
+   and count, checking each kind has the
+   children the parser gives it and clearing
+   what sema works out.
+   Little-endian throughout.
+
+     header        AstBinHeader, 128 bytes
+     strings       lexemes, NUL-terminated
+     lexemes       uint32 per token: offset into strings
+     token types   int32 per token (TokenType)
+     token kinds   uint8 per token (LexemeKind)
+     rows, cols    int32 per token, 1-based
+     nodes         AstNode per node, 80 bytes:
+
+       0  kind      4  op       8  tok
+      12  kid[4]   28  list    32  next
+      36  aux      40  flags   44  type
+      48  sym      52  (pad)   56  value.kind
+      64  value.i  72  value.f
+
+   Node links are node indices and tok is a
+   token index, AST_NULL (-1) when absent;
+   type, sym and value are unset (-1, -1,
+   CONST_NONE) as the parser leaves them.
+
+   A new layout gets a new AST_BIN_VERSION;
+   readers refuse any other.
+--------------------------------------------- */
+
+#define AST_BIN_MAGIC    "KOMAST\r\n"
+#define AST_BIN_VERSION  1
+
+typedef struct AstBinHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t node_size;         // sizeof(AstNode), a layout check
+    int32_t  root;
+    uint32_t token_count;
+    uint32_t node_count;
+    uint32_t reserved;
+    uint64_t file_size;
+    uint64_t strings;           // section offsets from the start of the file
+    uint64_t strings_size;
+    uint64_t lexemes;
+    uint64_t token_types;
+    uint64_t token_kinds;
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t nodes;
+    uint8_t  pad[128 - 104];
+} AstBinHeader;
+
+//a mapped file, owned by whoever loaded it
+typedef struct AstBinFile {
+    void   *map;
+    size_t  size;
+} AstBinFile;
+
+// writes the parser's tree as a .kast image; returns 0, or 1 if it could not be written
+int  write_ast_bin(const Ast *ast, FILE *out);
+
+/* maps path and points ast at the tree inside it (copy on write, so passes may annotate
+   nodes). Checks only the header; returns 1 after printing to err if the file is unusable */
+int  load_ast_bin(const char *path, Ast *ast, AstBinFile *file, FILE *err);
+void close_ast_bin(AstBinFile *file);
+
+/* checks every link of a loaded tree against the node and token counts, and each node's
+   operator, count and children against its kind, then clears what sema fills in; returns
+   1 if the tree is unusable */
+int  check_ast_bin(Ast *ast, FILE *err);
+
+#endif /* ASTBIN_H */
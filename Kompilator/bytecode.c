@@ -0,0 +1,1180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytecode.h"
+#include "tail.h"
+#include "peephole.h"
+
+/* jump whose target block has not been placed yet */
+typedef struct BcPatch {
+    int pc;
+    int block;
+} BcPatch;
+
+typedef struct BcState {
+    const IrModule *m;
+    const IrFunc   *f;
+    VmProgram      *p;
+
+    int            *reg;            // register of each IR value, -1 if none
+    int             reg_count;
+    int             scratch[2];     // temporaries for widening and copy cycles
+
+    int            *block_pc;
+    BcPatch        *patches;
+    int             patch_count;
+    int             patch_capacity;
+
+    int            *const_table;    // open-addressed constant pool index
+    int             const_table_size;
+
+    int            *global_offset;
+    int            *string_offset;
+
+    int             arg_start;      // first argument pool entry of the function being compiled
+
+    int             tail_calls;     // emit TAILCALL for calls in tail position
+    int             frame_escapes;  // this function's slot addresses leave it, no TAILCALL
+    int             peephole;       // rewrite each function into superinstructions
+
+    int             error;
+} BcState;
+
+static void *grow(void *ptr, int *capacity, int count, size_t elem_size, const char *what)
+{
+    if (count < *capacity)
+        return ptr;
+
+    *capacity = (*capacity == 0) ? 64 : *capacity * 2;
+    ptr = realloc(ptr, (size_t)*capacity * elem_size);
+
+    if (!ptr)
+    {
+        fprintf(stderr, "Fatal: %s realloc failed\n", what);
+        exit(1);
+    }
+
+    return ptr;
+}
+
+const char *vm_op_name(VmOp op)
+{
+#define VM_OP_NAME(name) #name,
+    static const char *names[OP_COUNT] = { VM_OPCODES(VM_OP_NAME) };
+#undef VM_OP_NAME
+
+    if (op >= OP_COUNT)
+        return "?";
+
+    return names[op];
+}
+
+static int emit(BcState *bs, VmOp op, int dst, int a, int b, long long imm)
+{
+    VmProgram *p = bs->p;
+
+    p->code = grow(p->code, &p->code_capacity, p->code_count, sizeof(VmInstr), "bytecode");
+
+    VmInstr *in = &p->code[p->code_count];
+
+    in->op  = (uint16_t)op;
+    in->dst = (uint16_t)dst;
+    in->a   = (uint16_t)a;
+    in->b   = (uint16_t)b;
+    in->imm = (int32_t)imm;
+
+    if (imm != (long long)in->imm)
+    {
+        printf("Bytecode error in %s: immediate %lld does not fit in 32 bits\n", bs->f->name, imm);
+        bs->error = 1;
+    }
+
+    return p->code_count++;
+}
+
+static void emit_jump(BcState *bs, VmOp op, int cond, int block)
+{
+    int pc = emit(bs, op, 0, cond, 0, 0);
+
+    bs->patches = grow(bs->patches, &bs->patch_capacity, bs->patch_count, sizeof(BcPatch), "jump patch");
+    bs->patches[bs->patch_count].pc    = pc;
+    bs->patches[bs->patch_count].block = block;
+    bs->patch_count++;
+}
+
+
+
+/*
+   _____                _              _
+  / ____|              | |            | |
+ | |     ___  _ __  ___| |_ __ _ _ __ | |_ ___
+ | |    / _ \| '_ \/ __| __/ _` | '_ \| __/ __|
+ | |___| (_) | | | \__ \ || (_| | | | | |_\__ \
+  \_____\___/|_| |_|___/\__\__,_|_| |_|\__|___/
+
+*/
+
+static unsigned const_hash(VmConstKind kind, uint64_t bits)
+{
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdULL;
+    bits ^= bits >> 33;
+
+    return (unsigned)bits ^ (unsigned)kind;
+}
+
+static void rebuild_const_table(BcState *bs)
+{
+    VmProgram *p = bs->p;
+
+    free(bs->const_table);
+
+    bs->const_table_size = (bs->const_table_size == 0) ? 256 : bs->const_table_size * 2;
+    bs->const_table = malloc(bs->const_table_size * sizeof(int));
+
+    if (!bs->const_table)
+    {
+        fprintf(stderr, "Fatal: constant table allocation failed\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < bs->const_table_size; i++)
+        bs->const_table[i] = -1;
+
+    for (int c = 0; c < p->const_count; c++)
+    {
+        unsigned mask = bs->const_table_size - 1;
+        unsigned h = const_hash(p->consts[c].kind, p->consts[c].value.u) & mask;
+
+        while (bs->const_table[h] >= 0)
+            h = (h + 1) & mask;
+
+        bs->const_table[h] = c;
+    }
+}
+
+//identical constants share one pool entry
+static int add_const(BcState *bs, VmConstKind kind, VmValue value)
+{
+    VmProgram *p = bs->p;
+
+    if ((p->const_count + 1) * 2 > bs->const_table_size)
+        rebuild_const_table(bs);
+
+    unsigned mask = bs->const_table_size - 1;
+    unsigned h = const_hash(kind, value.u) & mask;
+
+    for (; bs->const_table[h] >= 0; h = (h + 1) & mask)
+    {
+        const VmConst *c = &p->consts[bs->const_table[h]];
+
+        if (c->kind == kind && c->value.u == value.u)
+            return bs->const_table[h];
+    }
+
+    p->consts = grow(p->consts, &p->const_capacity, p->const_count, sizeof(VmConst), "constant pool");
+    p->consts[p->const_count].kind  = kind;
+    p->consts[p->const_count].value = value;
+
+    bs->const_table[h] = p->const_count;
+
+    return p->const_count++;
+}
+
+static int const_int(BcState *bs, long long v)
+{
+    VmValue value;
+
+    value.i = v;
+    return add_const(bs, VM_CONST_VALUE, value);
+}
+
+
+
+/*
+  _____  _     _
+ |  __ \| |   (_)
+ | |__) | |__  _ ___
+ |  ___/| '_ \| / __|
+ | |    | | | | \__ \
+ |_|    |_| |_|_|___/
+
+*/
+
+//emits dst[i] <- src[i] for all i at once, breaking cycles through a scratch register
+static void emit_parallel_copy(BcState *bs, int *dst, int *src, int count)
+{
+    int pending = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (dst[i] != src[i])
+        {
+            dst[pending] = dst[i];
+            src[pending] = src[i];
+            pending++;
+        }
+    }
+
+    while (pending > 0)
+    {
+        int ready = -1;
+
+        //a copy is safe once no other pending copy still reads its destination
+        for (int i = 0; i < pending && ready < 0; i++)
+        {
+            int blocked = 0;
+
+            for (int j = 0; j < pending; j++)
+            {
+                if (j != i && src[j] == dst[i])
+                {
+                    blocked = 1;
+                    break;
+                }
+            }
+
+            if (!blocked)
+                ready = i;
+        }
+
+        if (ready < 0)
+        {
+            //only cycles remain: park one destination's old value in scratch
+            int saved = dst[0];
+
+            emit(bs, OP_MOV, bs->scratch[0], saved, 0, 0);
+
+            for (int j = 0; j < pending; j++)
+            {
+                if (src[j] == saved)
+                    src[j] = bs->scratch[0];
+            }
+            continue;
+        }
+
+        emit(bs, OP_MOV, dst[ready], src[ready], 0, 0);
+
+        pending--;
+        dst[ready] = dst[pending];
+        src[ready] = src[pending];
+    }
+}
+
+static int block_has_phis(const IrFunc *f, int block)
+{
+    int first = f->blocks[block].first;
+
+    return first != IR_NONE && f->instrs[first].op == IR_PHI;
+}
+
+//copies into the phis of to along the occurrence-th edge from -> to
+static void emit_edge_copies(BcState *bs, int from, int to, int occurrence)
+{
+    const IrFunc *f = bs->f;
+    const IrBlock *blk = &f->blocks[to];
+    int k = -1;
+    int count = 0;
+
+    for (int p = 0; p < blk->pred_count; p++)
+    {
+        if (blk->preds[p] == from && occurrence-- == 0)
+        {
+            k = p;
+            break;
+        }
+    }
+
+    if (k < 0)
+        return;
+
+    for (int i = blk->first; i != IR_NONE && f->instrs[i].op == IR_PHI; i = f->instrs[i].next)
+        count++;
+
+    int *dst = malloc((count + 1) * sizeof(int));
+    int *src = malloc((count + 1) * sizeof(int));
+    int n = 0;
+
+    if (!dst || !src)
+    {
+        fprintf(stderr, "Fatal: failed to allocate phi copies\n");
+        exit(1);
+    }
+
+    for (int i = blk->first; i != IR_NONE && f->instrs[i].op == IR_PHI; i = f->instrs[i].next)
+    {
+        dst[n] = bs->reg[i];
+        src[n] = bs->reg[f->operands[f->instrs[i].args + k]];
+        n++;
+    }
+
+    emit_parallel_copy(bs, dst, src, n);
+
+    free(dst);
+    free(src);
+}
+
+
+
+/*
+  _____           _                   _   _
+ |_   _|         | |                 | | (_)
+   | |  _ __  ___| |_ _ __ _   _  ___| |_ _  ___  _ __  ___
+   | | | '_ \/ __| __| '__| | | |/ __| __| |/ _ \| '_ \/ __|
+  _| |_| | | \__ \ |_| |  | |_| | (__| |_| | (_) | | | \__ \
+ |_____|_| |_|___/\__|_|   \__,_|\___|\__|_|\___/|_| |_|___/
+
+*/
+
+static VmOp sext_op(int width)
+{
+    return (width == 1) ? OP_SEXT8 : (width == 2) ? OP_SEXT16 : OP_SEXT32;
+}
+
+static VmOp zext_op(int width)
+{
+    return (width == 1) ? OP_ZEXT8 : (width == 2) ? OP_ZEXT16 : OP_ZEXT32;
+}
+
+//integer ops whose result depends on the width
+static void compile_int_binary(BcState *bs, const IrInstr *in, int dst)
+{
+    int width = ir_type_size(in->type);
+    int a = bs->reg[in->a];
+    int b = bs->reg[in->b];
+    VmOp op32, op64;
+    int needs_zext = 0;
+
+    switch (in->op)
+    {
+        case IR_ADD:  op32 = OP_ADD32;  op64 = OP_ADD64;  break;
+        case IR_SUB:  op32 = OP_SUB32;  op64 = OP_SUB64;  break;
+        case IR_MUL:  op32 = OP_MUL32;  op64 = OP_MUL64;  break;
+        case IR_DIV:  op32 = OP_DIV32;  op64 = OP_DIV64;  break;
+        case IR_MOD:  op32 = OP_MOD32;  op64 = OP_MOD64;  break;
+        case IR_SHL:  op32 = OP_SHL32;  op64 = OP_SHL64;  break;
+        case IR_UDIV: op32 = OP_UDIV32; op64 = OP_UDIV64; needs_zext = 1; break;
+        case IR_UMOD: op32 = OP_UMOD32; op64 = OP_UMOD64; needs_zext = 1; break;
+        case IR_USHR: op32 = OP_USHR32; op64 = OP_USHR64; needs_zext = 1; break;
+
+        //sign-extended operands give sign-extended results
+        case IR_AND: emit(bs, OP_AND, dst, a, b, 0); return;
+        case IR_OR:  emit(bs, OP_OR,  dst, a, b, 0); return;
+        case IR_XOR: emit(bs, OP_XOR, dst, a, b, 0); return;
+        case IR_SHR: emit(bs, OP_SHR, dst, a, b, 0); return;
+
+        default:
+            return;
+    }
+
+    if (width == 4 || width == 8)
+    {
+        emit(bs, (width == 4) ? op32 : op64, dst, a, b, 0);
+        return;
+    }
+
+    //BOK / HALV: unsigned ops see the zero-extended bits, then everything renormalises
+    if (needs_zext)
+    {
+        emit(bs, zext_op(width), bs->scratch[0], a, 0, 0);
+        a = bs->scratch[0];
+
+        if (in->op != IR_USHR)
+        {
+            emit(bs, zext_op(width), bs->scratch[1], b, 0, 0);
+            b = bs->scratch[1];
+        }
+    }
+
+    emit(bs, op64, dst, a, b, 0);
+    emit(bs, sext_op(width), dst, dst, 0, 0);
+}
+
+static void compile_float_binary(BcState *bs, const IrInstr *in, int dst)
+{
+    VmOp op;
+
+    switch (in->op)
+    {
+        case IR_ADD: op = OP_FADD; break;
+        case IR_SUB: op = OP_FSUB; break;
+        case IR_MUL: op = OP_FMUL; break;
+        default:     op = OP_FDIV; break;
+    }
+
+    emit(bs, op, dst, bs->reg[in->a], bs->reg[in->b], 0);
+
+    if (in->type == IRT_F32)
+        emit(bs, OP_FROUND32, dst, dst, 0, 0);
+}
+
+static void compile_compare(BcState *bs, const IrInstr *in, int dst)
+{
+    int is_float = ir_type_is_float(bs->f->instrs[in->a].type);
+    VmOp op;
+
+    switch (in->op)
+    {
+        case IR_EQ:  op = is_float ? OP_FEQ : OP_EQ; break;
+        case IR_NE:  op = is_float ? OP_FNE : OP_NE; break;
+        case IR_LT:  op = is_float ? OP_FLT : OP_LT; break;
+        case IR_LE:  op = is_float ? OP_FLE : OP_LE; break;
+        case IR_GT:  op = is_float ? OP_FGT : OP_GT; break;
+        case IR_GE:  op = is_float ? OP_FGE : OP_GE; break;
+
+        //sign extension keeps the unsigned order of every width
+        case IR_ULT: op = OP_ULT; break;
+        case IR_ULE: op = OP_ULE; break;
+        case IR_UGT: op = OP_UGT; break;
+        default:     op = OP_UGE; break;
+    }
+
+    emit(bs, op, dst, bs->reg[in->a], bs->reg[in->b], 0);
+}
+
+static void compile_conversion(BcState *bs, const IrInstr *in, int dst)
+{
+    int a = bs->reg[in->a];
+    IrType from = bs->f->instrs[in->a].type;
+    int from_width = ir_type_size(from);
+    int to_width = ir_type_size(in->type);
+
+    switch (in->op)
+    {
+        case IR_SEXT:
+        case IR_COPY:
+            emit(bs, OP_MOV, dst, a, 0, 0);
+            break;
+
+        case IR_ZEXT:
+            if (from_width < 8)
+                emit(bs, zext_op(from_width), dst, a, 0, 0);
+            else
+                emit(bs, OP_MOV, dst, a, 0, 0);
+            break;
+
+        case IR_TRUNC:
+            if (to_width < 8)
+                emit(bs, sext_op(to_width), dst, a, 0, 0);
+            else
+                emit(bs, OP_MOV, dst, a, 0, 0);
+            break;
+
+        case IR_ITOF:
+            emit(bs, OP_ITOF, dst, a, 0, 0);
+            if (in->type == IRT_F32)
+                emit(bs, OP_FROUND32, dst, dst, 0, 0);
+            break;
+
+        case IR_UTOF:
+            if (from_width < 8)
+            {
+                emit(bs, zext_op(from_width), bs->scratch[0], a, 0, 0);
+                emit(bs, OP_ITOF, dst, bs->scratch[0], 0, 0);
+            }
+            else
+            {
+                emit(bs, OP_UTOF, dst, a, 0, 0);
+            }
+
+            if (in->type == IRT_F32)
+                emit(bs, OP_FROUND32, dst, dst, 0, 0);
+            break;
+
+        case IR_FTOI:
+            emit(bs, OP_FTOI, dst, a, 0, 0);
+            if (to_width < 8)
+                emit(bs, sext_op(to_width), dst, dst, 0, 0);
+            break;
+
+        case IR_FCONV:
+            if (in->type == IRT_F32)
+                emit(bs, OP_FROUND32, dst, a, 0, 0);
+            else
+                emit(bs, OP_MOV, dst, a, 0, 0);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static VmOp load_op(IrType type)
+{
+    switch (type)
+    {
+        case IRT_I8:  return OP_LOAD8;
+        case IRT_I16: return OP_LOAD16;
+        case IRT_I32: return OP_LOAD32;
+        case IRT_F32: return OP_LOADF32;
+        case IRT_F64: return OP_LOADF64;
+        default:      return OP_LOAD64;
+    }
+}
+
+static VmOp store_op(IrType type)
+{
+    switch (type)
+    {
+        case IRT_I8:  return OP_STORE8;
+        case IRT_I16: return OP_STORE16;
+        case IRT_I32: return OP_STORE32;
+        case IRT_F32: return OP_STOREF32;
+        case IRT_F64: return OP_STOREF64;
+        default:      return OP_STORE64;
+    }
+}
+
+static void compile_instr(BcState *bs, int i, const int *slot_offset)
+{
+    const IrFunc *f = bs->f;
+    const IrInstr *in = &f->instrs[i];
+    int dst = (bs->reg[i] >= 0) ? bs->reg[i] : 0;
+    VmValue value;
+
+    switch (in->op)
+    {
+        case IR_PHI:
+        case IR_PARAM:
+        case IR_NOP:
+            break;
+
+        case IR_CONST:
+            if (ir_type_is_float(in->type))
+                value.f = in->fimm;
+            else
+                value.i = in->imm;
+
+            emit(bs, OP_CONST, dst, 0, 0, add_const(bs, VM_CONST_VALUE, value));
+            break;
+
+        case IR_UNDEF:
+            emit(bs, OP_CONST, dst, 0, 0, const_int(bs, 0));
+            break;
+
+        case IR_SLOT:
+            emit(bs, OP_SLOT, dst, 0, 0, slot_offset[in->aux]);
+            break;
+
+        case IR_GLOBAL:
+            value.i = bs->global_offset[in->aux];
+            emit(bs, OP_CONST, dst, 0, 0, add_const(bs, VM_CONST_DATA, value));
+            break;
+
+        case IR_STRING:
+            value.i = bs->string_offset[in->aux];
+            emit(bs, OP_CONST, dst, 0, 0, add_const(bs, VM_CONST_DATA, value));
+            break;
+
+        case IR_FUNCADDR:
+            //functions cannot be called through pointers in K; the value only has to be distinct
+            value.i = in->aux + 1;
+            emit(bs, OP_CONST, dst, 0, 0, add_const(bs, VM_CONST_FUNC, value));
+            break;
+
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+            if (ir_type_is_float(in->type))
+            {
+                compile_float_binary(bs, in, dst);
+                break;
+            }
+            /* fallthrough */
+
+        case IR_UDIV:
+        case IR_MOD:
+        case IR_UMOD:
+        case IR_AND:
+        case IR_OR:
+        case IR_XOR:
+        case IR_SHL:
+        case IR_SHR:
+        case IR_USHR:
+            compile_int_binary(bs, in, dst);
+            break;
+
+        case IR_NEG:
+        {
+            int width = ir_type_size(in->type);
+
+            if (ir_type_is_float(in->type))
+                emit(bs, OP_FNEG, dst, bs->reg[in->a], 0, 0);
+            else if (width == 8)
+                emit(bs, OP_NEG64, dst, bs->reg[in->a], 0, 0);
+            else if (width == 4)
+                emit(bs, OP_NEG32, dst, bs->reg[in->a], 0, 0);
+            else
+            {
+                emit(bs, OP_NEG64, dst, bs->reg[in->a], 0, 0);
+                emit(bs, sext_op(width), dst, dst, 0, 0);
+            }
+            break;
+        }
+
+        case IR_NOT:
+            emit(bs, OP_NOT, dst, bs->reg[in->a], 0, 0);
+            break;
+
+        case IR_EQ:  case IR_NE:  case IR_LT:  case IR_LE:  case IR_GT:
+        case IR_GE:  case IR_ULT: case IR_ULE: case IR_UGT: case IR_UGE:
+            compile_compare(bs, in, dst);
+            break;
+
+        case IR_SEXT:
+        case IR_ZEXT:
+        case IR_TRUNC:
+        case IR_ITOF:
+        case IR_UTOF:
+        case IR_FTOI:
+        case IR_FCONV:
+        case IR_COPY:
+            compile_conversion(bs, in, dst);
+            break;
+
+        case IR_OFFSET:
+            emit(bs, OP_OFFSET, dst, bs->reg[in->a], 0, in->imm);
+            break;
+
+        case IR_INDEX:
+            emit(bs, OP_INDEX, dst, bs->reg[in->a], bs->reg[in->b], in->imm);
+            break;
+
+        case IR_LOAD:
+            emit(bs, load_op(in->type), dst, bs->reg[in->a], 0, 0);
+            break;
+
+        case IR_STORE:
+            emit(bs, store_op(f->instrs[in->b].type), 0, bs->reg[in->a], bs->reg[in->b], 0);
+            break;
+
+        case IR_MEMCPY:
+            emit(bs, OP_MEMCPY, 0, bs->reg[in->a], bs->reg[in->b], in->imm);
+            break;
+
+        case IR_MEMZERO:
+            emit(bs, OP_MEMZERO, 0, bs->reg[in->a], 0, in->imm);
+            break;
+
+        case IR_CALL:
+        {
+            VmProgram *p = bs->p;
+            int first = p->arg_count - bs->arg_start;
+
+            for (int k = 0; k < in->nargs; k++)
+            {
+                p->args = grow(p->args, &p->arg_capacity, p->arg_count, sizeof(uint16_t), "call arguments");
+                p->args[p->arg_count++] = (uint16_t)bs->reg[f->operands[in->args + k]];
+            }
+
+            //the callee index goes in imm, arguments in a..a+b of the argument pool
+            if (bs->tail_calls && !bs->frame_escapes && tail_position(f, i))
+                emit(bs, OP_TAILCALL, VM_NO_REG, first, in->nargs, in->aux);
+            else
+                emit(bs, OP_CALL, (in->type == IRT_VOID) ? VM_NO_REG : dst, first, in->nargs, in->aux);
+
+            if (first > 0xFFFF)
+            {
+                printf("Bytecode error in %s: too many call arguments in the function\n", f->name);
+                bs->error = 1;
+            }
+            break;
+        }
+
+        case IR_RET:
+            if (in->a == IR_NONE)
+                emit(bs, OP_RETV, 0, 0, 0, 0);
+            else
+                emit(bs, OP_RET, 0, bs->reg[in->a], 0, 0);
+            break;
+
+        default:
+            if (ir_is_vector_op(in->op))
+            {
+                printf("Bytecode error in %s: vector instructions only exist in native code\n", f->name);
+                bs->error = 1;
+            }
+            break;
+    }
+}
+
+//one JMP per table entry and the default; edges with phis go through a stub of copies
+static void compile_switch(BcState *bs, int block, int term)
+{
+    const IrFunc *f = bs->f;
+    const IrInstr *in = &f->instrs[term];
+    const int *succ = &f->cases[in->imm + 1];
+    int succ_count = f->cases[in->imm];
+    const int *table = succ + succ_count;
+    int first;
+
+    emit(bs, OP_SWITCH, 0, bs->reg[in->a], 0, in->aux);
+    first = bs->p->code_count;
+
+    for (int k = 0; k <= in->aux; k++)
+    {
+        int s = (k < in->aux) ? table[k] : 0;
+
+        if (block_has_phis(f, succ[s]))
+            emit(bs, OP_JMP, 0, 0, 0, 0);
+        else
+            emit_jump(bs, OP_JMP, 0, succ[s]);
+    }
+
+    for (int s = 0; s < succ_count; s++)
+    {
+        int stub = bs->p->code_count;
+
+        if (!block_has_phis(f, succ[s]))
+            continue;
+
+        emit_edge_copies(bs, block, succ[s], 0);
+        emit_jump(bs, OP_JMP, 0, succ[s]);
+
+        for (int k = 0; k <= in->aux; k++)
+        {
+            if (((k < in->aux) ? table[k] : 0) == s)
+                bs->p->code[first + k].imm = stub;
+        }
+    }
+}
+
+static void compile_terminator(BcState *bs, int block, int next_block)
+{
+    const IrFunc *f = bs->f;
+    int term = ir_terminator(f, block);
+    const IrInstr *in = &f->instrs[term];
+
+    if (in->op == IR_JMP)
+    {
+        int target = in->target[0];
+
+        emit_edge_copies(bs, block, target, 0);
+
+        if (target != next_block)
+            emit_jump(bs, OP_JMP, 0, target);
+        return;
+    }
+
+    if (in->op == IR_SWITCH)
+    {
+        compile_switch(bs, block, term);
+        return;
+    }
+
+    if (in->op != IR_BR)
+    {
+        compile_instr(bs, term, NULL);
+        return;
+    }
+
+    int on_true = in->target[0];
+    int on_false = in->target[1];
+    int cond = bs->reg[in->a];
+    int false_occurrence = (on_true == on_false) ? 1 : 0;
+
+    if (on_true == next_block && !block_has_phis(f, on_true) && !block_has_phis(f, on_false))
+    {
+        emit_jump(bs, OP_BRZ, cond, on_false);
+        return;
+    }
+
+    if (!block_has_phis(f, on_true))
+    {
+        emit_jump(bs, OP_BRNZ, cond, on_true);
+
+        emit_edge_copies(bs, block, on_false, false_occurrence);
+
+        if (on_false != next_block)
+            emit_jump(bs, OP_JMP, 0, on_false);
+        return;
+    }
+
+    if (!block_has_phis(f, on_false))
+    {
+        emit_jump(bs, OP_BRZ, cond, on_false);
+
+        emit_edge_copies(bs, block, on_true, 0);
+
+        if (on_true != next_block)
+            emit_jump(bs, OP_JMP, 0, on_true);
+        return;
+    }
+
+    //both edges carry copies: the true edge gets its own stub after the false path
+    int branch = emit(bs, OP_BRNZ, 0, cond, 0, 0);
+
+    emit_edge_copies(bs, block, on_false, false_occurrence);
+    emit_jump(bs, OP_JMP, 0, on_false);
+
+    bs->p->code[branch].imm = bs->p->code_count;
+
+    emit_edge_copies(bs, block, on_true, 0);
+    emit_jump(bs, OP_JMP, 0, on_true);
+}
+
+static void compile_function(BcState *bs, int fi)
+{
+    const IrFunc *f = &bs->m->funcs[fi];
+    VmFunc *vf = &bs->p->funcs[fi];
+    int *slot_offset = malloc((f->slot_count + 1) * sizeof(int));
+    int frame = 0;
+
+    bs->f = f;
+    bs->patch_count = 0;
+    bs->frame_escapes = tail_frame_escapes(f);
+
+    vf->name          = f->name;
+    vf->param_count   = f->param_count;
+    vf->returns_value = (f->ret_type != IRT_VOID);
+    vf->is_extern     = f->is_extern;
+    vf->code_start    = bs->p->code_count;
+    vf->arg_start     = bs->p->arg_count;
+
+    bs->arg_start = vf->arg_start;
+
+    bs->reg      = malloc((f->instr_count + 1) * sizeof(int));
+    bs->block_pc = malloc((f->block_count + 1) * sizeof(int));
+
+    if (!slot_offset || !bs->reg || !bs->block_pc)
+    {
+        fprintf(stderr, "Fatal: failed to allocate bytecode scratch\n");
+        exit(1);
+    }
+
+    //frame slots, each at its own alignment
+    for (int s = 0; s < f->slot_count; s++)
+    {
+        frame = (frame + f->slots[s].align - 1) & ~(f->slots[s].align - 1);
+        slot_offset[s] = frame;
+        frame += f->slots[s].size;
+    }
+
+    vf->frame_size = (frame + 15) & ~15;
+
+    //parameters sit in r0..rN-1, every other value gets the next register
+    bs->reg_count = f->param_count;
+
+    for (int i = 0; i < f->instr_count; i++)
+    {
+        const IrInstr *in = &f->instrs[i];
+
+        bs->reg[i] = -1;
+
+        if (in->block == IR_NONE || !ir_defines_value(in))
+            continue;
+
+        if (in->op == IR_PARAM)
+            bs->reg[i] = in->aux;
+        else
+            bs->reg[i] = bs->reg_count++;
+    }
+
+    bs->scratch[0] = bs->reg_count++;
+    bs->scratch[1] = bs->reg_count++;
+    vf->reg_count  = bs->reg_count;
+
+    if (bs->reg_count >= VM_NO_REG)
+    {
+        printf("Bytecode error in %s: %d registers exceed the encoding limit\n", f->name, bs->reg_count);
+        bs->error = 1;
+    }
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        bs->block_pc[b] = bs->p->code_count;
+
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+        {
+            if (ir_is_terminator(f->instrs[i].op))
+                compile_terminator(bs, b, b + 1);
+            else
+                compile_instr(bs, i, slot_offset);
+        }
+    }
+
+    for (int i = 0; i < bs->patch_count; i++)
+        bs->p->code[bs->patches[i].pc].imm = bs->block_pc[bs->patches[i].block];
+
+    if (bs->peephole)
+        peephole_bytecode(bs->p, fi);
+
+    vf->code_length = bs->p->code_count - vf->code_start;
+
+    free(slot_offset);
+    free(bs->reg);
+    free(bs->block_pc);
+
+    bs->reg = NULL;
+    bs->block_pc = NULL;
+}
+
+
+
+/*
+  _____        _
+ |  __ \      | |
+ | |  | | __ _| |_ __ _
+ | |  | |/ _` | __/ _` |
+ | |__| | (_| | || (_| |
+ |_____/ \__,_|\__\__,_|
+
+*/
+
+//globals first, then string literals, each at its alignment and at its own address
+static void layout_data(BcState *bs)
+{
+    const IrModule *m = bs->m;
+    VmProgram *p = bs->p;
+    int size = 0;
+
+    bs->global_offset = malloc((m->global_count + 1) * sizeof(int));
+    bs->string_offset = malloc((m->string_count + 1) * sizeof(int));
+
+    p->global_offsets = bs->global_offset;
+    p->global_count   = m->global_count;
+
+    if (!bs->global_offset || !bs->string_offset)
+    {
+        fprintf(stderr, "Fatal: failed to allocate data layout\n");
+        exit(1);
+    }
+
+    for (int g = 0; g < m->global_count; g++)
+    {
+        int align = m->globals[g].align;
+
+        size = (size + align - 1) & ~(align - 1);
+        bs->global_offset[g] = size;
+        size += (m->globals[g].size > 0) ? m->globals[g].size : 1;
+    }
+
+    for (int s = 0; s < m->string_count; s++)
+    {
+        bs->string_offset[s] = size;
+        size += m->strings[s].length + 1;
+    }
+
+    p->data_size = (size + 15) & ~15;
+    p->data = calloc(p->data_size + 16, 1);
+
+    if (!p->data)
+    {
+        fprintf(stderr, "Fatal: failed to allocate data image\n");
+        exit(1);
+    }
+
+    for (int g = 0; g < m->global_count; g++)
+        memcpy(p->data + bs->global_offset[g], m->globals[g].data, m->globals[g].size);
+
+    for (int s = 0; s < m->string_count; s++)
+        memcpy(p->data + bs->string_offset[s], m->strings[s].data, m->strings[s].length);
+
+    for (int r = 0; r < m->reloc_count; r++)
+    {
+        const IrReloc *rel = &m->relocs[r];
+        int at = bs->global_offset[rel->global] + rel->offset;
+
+        if (rel->kind == IR_RELOC_FUNC)
+        {
+            long long value = rel->target + 1;
+
+            memcpy(p->data + at, &value, 8);
+            continue;
+        }
+
+        p->fixups = grow(p->fixups, &p->fixup_capacity, p->fixup_count, sizeof(VmFixup), "data fixup");
+        p->fixups[p->fixup_count].at = at;
+        p->fixups[p->fixup_count].target = (int)rel->addend +
+            ((rel->kind == IR_RELOC_STRING) ? bs->string_offset[rel->target] : bs->global_offset[rel->target]);
+        p->fixup_count++;
+    }
+}
+
+int compile_bytecode(const IrModule *m, int tail_calls, int peephole, VmProgram *out)
+{
+    BcState bs;
+    int failed = 0;
+
+    memset(out, 0, sizeof(*out));
+    memset(&bs, 0, sizeof(bs));
+
+    bs.m = m;
+    bs.p = out;
+    bs.tail_calls = tail_calls;
+    bs.peephole   = peephole;
+
+    out->entry      = m->entry;
+    out->func_count = m->func_count;
+    out->funcs      = calloc(m->func_count + 1, sizeof(VmFunc));
+
+    if (!out->funcs)
+    {
+        fprintf(stderr, "Fatal: failed to allocate bytecode functions\n");
+        exit(1);
+    }
+
+    layout_data(&bs);
+
+    for (int fi = 0; fi < m->func_count; fi++)
+    {
+        bs.error = 0;
+        compile_function(&bs, fi);
+        failed += bs.error;
+    }
+
+    free(bs.patches);
+    free(bs.const_table);
+    free(bs.string_offset);
+
+    return failed;
+}
+
+void free_bytecode(VmProgram *p)
+{
+    free(p->code);
+    free(p->consts);
+    free(p->args);
+    free(p->funcs);
+    free(p->data);
+    free(p->fixups);
+    free(p->global_offsets);
+
+    memset(p, 0, sizeof(*p));
+}
+
+static const char *displacement(int imm)
+{
+    static char text[24];
+
+    if (imm == 0)
+        return "";
+
+    snprintf(text, sizeof(text), " %c %d", (imm < 0) ? '-' : '+', (imm < 0) ? -imm : imm);
+    return text;
+}
+
+void dump_bytecode(const VmProgram *p)
+{
+    for (int fi = 0; fi < p->func_count; fi++)
+    {
+        const VmFunc *f = &p->funcs[fi];
+
+        printf("%s: %d param(s), %d register(s), frame %d%s\n",
+               f->name, f->param_count, f->reg_count, f->frame_size, f->is_extern ? ", extern" : "");
+
+        for (int pc = f->code_start; pc < f->code_start + f->code_length; pc++)
+        {
+            const VmInstr *in = &p->code[pc];
+
+            printf("  %04d  %-9s", pc, vm_op_name(in->op));
+
+            switch (in->op)
+            {
+                case OP_CONST:
+                {
+                    const VmConst *c = &p->consts[in->imm];
+
+                    if (c->kind == VM_CONST_DATA)
+                        printf("r%d, data+%lld", in->dst, (long long)c->value.i);
+                    else if (c->kind == VM_CONST_FUNC)
+                        printf("r%d, &%s", in->dst, p->funcs[c->value.i - 1].name);
+                    else
+                        printf("r%d, #%d (%lld)", in->dst, in->imm, (long long)c->value.i);
+                    break;
+                }
+
+                case OP_SLOT:
+                    printf("r%d, frame+%d", in->dst, in->imm);
+                    break;
+
+                case OP_JMP:
+                    printf("%04d", in->imm);
+                    break;
+
+                case OP_BRNZ:
+                case OP_BRZ:
+                    printf("r%d, %04d", in->a, in->imm);
+                    break;
+
+                case OP_ADDI32:
+                case OP_ADDI64:
+                    printf("r%d, r%d, %d", in->dst, in->a, in->imm);
+                    break;
+
+                case OP_SWITCH:
+                    printf("r%d, %d", in->a, in->imm);
+                    break;
+
+                case OP_RET:
+                    printf("r%d", in->a);
+                    break;
+
+                case OP_RETV:
+                case OP_NOP:
+                    break;
+
+                case OP_CALL:
+                case OP_TAILCALL:
+                    if (in->dst != VM_NO_REG)
+                        printf("r%d, ", in->dst);
+
+                    printf("%s(", p->funcs[in->imm].name);
+
+                    for (int k = 0; k < in->b; k++)
+                        printf("%sr%d", k ? ", " : "", p->args[f->arg_start + in->a + k]);
+
+                    printf(")");
+                    break;
+
+                case OP_STORE8: case OP_STORE16: case OP_STORE32:
+                case OP_STORE64: case OP_STOREF32: case OP_STOREF64:
+                    printf("[r%d%s], r%d", in->a, displacement(in->imm), in->b);
+                    break;
+
+                case OP_MEMCPY:
+                    printf("[r%d], [r%d], %d", in->a, in->b, in->imm);
+                    break;
+
+                case OP_MEMZERO:
+                    printf("[r%d], %d", in->a, in->imm);
+                    break;
+
+                case OP_OFFSET:
+                    printf("r%d, r%d, %d", in->dst, in->a, in->imm);
+                    break;
+
+                case OP_INDEX:
+                    printf("r%d, r%d, r%d * %d", in->dst, in->a, in->b, in->imm);
+                    break;
+
+                case OP_LOAD8: case OP_LOAD16: case OP_LOAD32:
+                case OP_LOAD64: case OP_LOADF32: case OP_LOADF64:
+                    printf("r%d, [r%d%s]", in->dst, in->a, displacement(in->imm));
+                    break;
+
+                case OP_MOV: case OP_NEG32: case OP_NEG64: case OP_NOT: case OP_FNEG:
+                case OP_SEXT8: case OP_SEXT16: case OP_SEXT32:
+                case OP_ZEXT8: case OP_ZEXT16: case OP_ZEXT32:
+                case OP_FROUND32: case OP_ITOF: case OP_UTOF: case OP_FTOI:
+                    printf("r%d, r%d", in->dst, in->a);
+                    break;
+
+                default:
+                    if (in->op >= OP_BEQK)
+                        printf("r%d, #%d (%lld), %04d", in->a, in->b, (long long)p->consts[in->b].value.i, in->imm);
+                    else if (in->op >= OP_BEQ)
+                        printf("r%d, r%d, %04d", in->a, in->b, in->imm);
+                    else
+                        printf("r%d, r%d, r%d", in->dst, in->a, in->b);
+                    break;
+            }
+
+            printf("\n");
+        }
+
+        printf("\n");
+    }
+}
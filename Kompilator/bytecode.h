@@ -0,0 +1,164 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdint.h>
+
+#include "ir.h"
+
+/* ---------------------------------------------
+   Register bytecode
+
+   Every function owns a window of 64-bit
+   registers; parameters arrive in r0..rN-1.
+   Integers are kept sign-extended from their
+   width (the IR constant convention), so
+   comparisons, AND/OR/XOR and arithmetic right
+   shifts need no width; ops that can overflow
+   the width exist as 32- and 64-bit variants and
+   narrower types are renormalised with SEXT8 /
+   SEXT16. FLYT values are held as doubles rounded
+   to single precision after every operation.
+
+   Instructions are 12 bytes: opcode, three
+   register fields and a 32-bit immediate that
+   holds a constant pool index, a byte offset, an
+   element size, a function index or a jump
+   target (instruction index). Loads and stores
+   address a + imm. CALL arguments are listed in
+   the argument pool from the calling function's
+   arg_start, so a function's code does not
+   depend on where its arguments are pooled.
+
+   The superinstructions after RETV come from the
+   peephole pass (peephole.h): ADDI32 / ADDI64
+   add imm to a; B<cc> a, b jumps to imm when the
+   compare holds, B<cc>K compares a with constant
+   pool entry b instead.
+
+   A call in tail position (tail.h) becomes
+   TAILCALL, which hands the caller's register
+   window and frame to the callee and has it
+   return straight to the caller's caller, unless
+   the caller's frame slots escape.
+
+   SWITCH a with imm = n is followed by n + 1 JMP
+   instructions: the table, then the default.
+   It continues at the target of JMP a, or of the
+   default when a is n or more as an unsigned
+   value.
+--------------------------------------------- */
+#define VM_OPCODES(X)                                                       \
+    X(NOP)      X(MOV)      X(CONST)    X(SLOT)                             \
+    X(ADD32)    X(ADD64)    X(SUB32)    X(SUB64)    X(MUL32)    X(MUL64)    \
+    X(DIV32)    X(DIV64)    X(UDIV32)   X(UDIV64)   X(MOD32)    X(MOD64)    \
+    X(UMOD32)   X(UMOD64)   X(AND)      X(OR)       X(XOR)      X(SHL32)    \
+    X(SHL64)    X(SHR)      X(USHR32)   X(USHR64)   X(NEG32)    X(NEG64)    \
+    X(NOT)      X(SEXT8)    X(SEXT16)   X(SEXT32)   X(ZEXT8)    X(ZEXT16)   \
+    X(ZEXT32)   X(FADD)     X(FSUB)     X(FMUL)     X(FDIV)     X(FNEG)     \
+    X(FROUND32) X(ITOF)     X(UTOF)     X(FTOI)                             \
+    X(EQ)       X(NE)       X(LT)       X(LE)       X(GT)       X(GE)       \
+    X(ULT)      X(ULE)      X(UGT)      X(UGE)                              \
+    X(FEQ)      X(FNE)      X(FLT)      X(FLE)      X(FGT)      X(FGE)      \
+    X(OFFSET)   X(INDEX)                                                    \
+    X(LOAD8)    X(LOAD16)   X(LOAD32)   X(LOAD64)   X(LOADF32)  X(LOADF64)  \
+    X(STORE8)   X(STORE16)  X(STORE32)  X(STORE64)  X(STOREF32) X(STOREF64) \
+    X(MEMCPY)   X(MEMZERO)                                                  \
+    X(CALL)     X(TAILCALL) X(JMP)      X(BRNZ)     X(BRZ)      X(SWITCH)   \
+    X(RET)      X(RETV)                                                     \
+    X(ADDI32)   X(ADDI64)                                                   \
+    X(BEQ)      X(BNE)      X(BLT)      X(BLE)      X(BGT)      X(BGE)      \
+    X(BULT)     X(BULE)     X(BUGT)     X(BUGE)                             \
+    X(BEQK)     X(BNEK)     X(BLTK)     X(BLEK)     X(BGTK)     X(BGEK)     \
+    X(BULTK)    X(BULEK)    X(BUGTK)    X(BUGEK)
+
+#define VM_ENUM_OP(name) OP_##name,
+
+typedef enum VmOp {
+    VM_OPCODES(VM_ENUM_OP)
+    OP_COUNT
+} VmOp;
+
+#define VM_NO_REG 0xFFFF     // CALL of a TOM function has no destination
+
+typedef struct VmInstr {
+    uint16_t op;
+    uint16_t dst;
+    uint16_t a;
+    uint16_t b;
+    int32_t  imm;
+} VmInstr;
+
+typedef union VmValue {
+    int64_t  i;
+    uint64_t u;
+    double   f;
+} VmValue;
+
+/* constant pool entries; addresses are only known once the VM has placed the data segment */
+typedef enum VmConstKind {
+    VM_CONST_VALUE,
+    VM_CONST_DATA,      // value.i is an offset into the data segment
+    VM_CONST_FUNC       // value.i is a function index + 1, the value of its address
+} VmConstKind;
+
+typedef struct VmConst {
+    VmConstKind kind;
+    VmValue     value;
+} VmConst;
+
+/* pointer inside the data segment: data[at] = base + target */
+typedef struct VmFixup {
+    int at;
+    int target;
+} VmFixup;
+
+typedef struct VmFunc {
+    const char *name;
+    int         code_start;
+    int         code_length;
+    int         arg_start;      // CALL.a of this function's code counts from here
+    int         param_count;
+    int         reg_count;
+    int         frame_size;     // bytes of frame slots, 16-byte aligned
+    int         returns_value;
+    int         is_extern;      // declared only; calling it is a run-time error
+} VmFunc;
+
+typedef struct VmProgram {
+    VmInstr       *code;
+    int            code_count;
+    int            code_capacity;
+
+    VmConst       *consts;
+    int            const_count;
+    int            const_capacity;
+
+    uint16_t      *args;        // CALL argument registers, from the caller's arg_start + CALL.a
+    int            arg_count;
+    int            arg_capacity;
+
+    VmFunc        *funcs;       // same order as IrModule.funcs
+    int            func_count;
+
+    unsigned char *data;        // initial image of globals and string literals
+    int            data_size;
+
+    VmFixup       *fixups;
+    int            fixup_count;
+    int            fixup_capacity;
+
+    int           *global_offsets;  // where each IrModule global starts in data, for object files
+    int            global_count;
+
+    int            entry;       // ENTRE, -1 if missing
+} VmProgram;
+
+
+// returns the number of functions that could not be encoded; tail_calls enables TAILCALL, peephole superinstructions
+int  compile_bytecode(const IrModule *m, int tail_calls, int peephole, VmProgram *out);
+void free_bytecode(VmProgram *p);
+
+const char *vm_op_name(VmOp op);
+void dump_bytecode(const VmProgram *p);
+
+#endif /* BYTECODE_H */
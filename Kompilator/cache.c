@@ -0,0 +1,493 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+//tells apart the temporary files of writers in the same process
+static atomic_ulong temp_serial;
+
+typedef struct CacheFile {
+    char    *path;
+    off_t    size;
+    time_t   sec;
+    long     nsec;
+} CacheFile;
+
+
+
+/*
+  _    _           _
+ | |  | |         | |
+ | |__| | __ _ ___| |__
+ |  __  |/ _` / __| '_ \
+ | |  | | (_| \__ \ | | |
+ |_|  |_|\__,_|___/_| |_|
+*/
+
+static uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read64(const unsigned char *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t read32(const unsigned char *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t xxh_round(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc  = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static uint64_t xxh_merge(uint64_t acc, uint64_t value)
+{
+    acc ^= xxh_round(0, value);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+//XXH64 as specified by Yann Collet (little-endian hosts)
+uint64_t xxh64(const void *data, size_t size, uint64_t seed)
+{
+    const unsigned char *p = data;
+    const unsigned char *end = p + size;
+    uint64_t h;
+
+    if (size >= 32)
+    {
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+
+        for (; p + 32 <= end; p += 32)
+        {
+            v1 = xxh_round(v1, read64(p));
+            v2 = xxh_round(v2, read64(p + 8));
+            v3 = xxh_round(v3, read64(p + 16));
+            v4 = xxh_round(v4, read64(p + 24));
+        }
+
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh_merge(h, v1);
+        h = xxh_merge(h, v2);
+        h = xxh_merge(h, v3);
+        h = xxh_merge(h, v4);
+    }
+    else
+    {
+        h = seed + PRIME64_5;
+    }
+
+    h += (uint64_t)size;
+
+    for (; p + 8 <= end; p += 8)
+    {
+        h ^= xxh_round(0, read64(p));
+        h  = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+    }
+
+    if (p + 4 <= end)
+    {
+        h ^= (uint64_t)read32(p) * PRIME64_1;
+        h  = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+
+    for (; p < end; p++)
+    {
+        h ^= (uint64_t)*p * PRIME64_5;
+        h  = rotl64(h, 11) * PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+
+
+/*
+  ______       _        _
+ |  ____|     | |      (_)
+ | |__   _ __ | |_ _ __ _  ___  ___
+ |  __| | '_ \| __| '__| |/ _ \/ __|
+ | |____| | | | |_| |  | |  __/\__ \
+ |______|_| |_|\__|_|  |_|\___||___/
+*/
+
+//creates every missing directory along path
+static int make_dirs(const char *path)
+{
+    char buf[PATH_MAX];
+    size_t len = strlen(path);
+
+    if (len == 0 || len >= sizeof(buf))
+        return 1;
+
+    memcpy(buf, path, len + 1);
+
+    for (char *p = buf + 1; ; p++)
+    {
+        if (*p == '/' || *p == '\0')
+        {
+            char c = *p;
+
+            *p = '\0';
+
+            if (mkdir(buf, 0777) != 0 && errno != EEXIST)
+                return 1;
+
+            if (c == '\0')
+                break;
+
+            *p = c;
+        }
+    }
+
+    return 0;
+}
+
+static void entry_path(const CompileCache *cache, const CacheKey *key, char *path, size_t size)
+{
+    snprintf(path, size, "%s/%02x/%016llx%016llx", cache->dir, (unsigned)(key->hi >> 56),
+             (unsigned long long)key->hi, (unsigned long long)key->lo);
+}
+
+int cache_open(CompileCache *cache, const char *dir, long limit)
+{
+    memset(cache, 0, sizeof(*cache));
+
+    //room for the subdirectory, the entry name and a temporary suffix
+    if (strlen(dir) + 80 >= PATH_MAX || make_dirs(dir) != 0 || access(dir, W_OK) != 0)
+    {
+        fprintf(stderr, "Error: Could not use %s as a cache directory\n", dir);
+        return 1;
+    }
+
+    cache->dir   = strdup(dir);
+    cache->limit = limit;
+
+    if (!cache->dir)
+    {
+        fprintf(stderr, "Fatal: failed to allocate cache path\n");
+        exit(1);
+    }
+
+    return 0;
+}
+
+void cache_close(CompileCache *cache)
+{
+    free(cache->dir);
+    cache->dir = NULL;
+}
+
+int cache_load(CompileCache *cache, const CacheKey *key, CacheEntry *entry)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    int header = 0;
+    FILE *file;
+
+    memset(entry, 0, sizeof(*entry));
+    entry_path(cache, key, path, sizeof(path));
+
+    file = fopen(path, "rb");
+
+    if (!file)
+    {
+        atomic_fetch_add(&cache->misses, 1);
+        return 0;
+    }
+
+    if (fstat(fileno(file), &st) != 0 || st.st_size <= 0)
+    {
+        fclose(file);
+        atomic_fetch_add(&cache->misses, 1);
+        return 0;
+    }
+
+    entry->data = malloc(st.st_size + 1);
+
+    if (!entry->data)
+    {
+        fprintf(stderr, "Fatal: failed to allocate cache entry\n");
+        exit(1);
+    }
+
+    size_t got = fread(entry->data, 1, st.st_size, file);
+    int whole;
+
+    entry->data[got] = '\0';
+
+    whole = got == (size_t)st.st_size &&
+            sscanf(entry->data, "KOMC 1 %d %d %d %d %d %d %d %zu %zu %zu%n", &entry->status,
+                   &entry->counts[0], &entry->counts[1], &entry->counts[2], &entry->counts[3],
+                   &entry->counts[4], &entry->counts[5],
+                   &entry->out_size, &entry->err_size, &entry->artifact_size, &header) == 10 &&
+            header > 0 && entry->data[header++] == '\n' &&
+            (size_t)header + entry->out_size + entry->err_size + entry->artifact_size == got;
+
+    //an entry that does not add up (another format, a damaged disk) is a miss and will be replaced
+    if (!whole)
+    {
+        fclose(file);
+        cache_free_entry(entry);
+        atomic_fetch_add(&cache->misses, 1);
+        return 0;
+    }
+
+    fclose(file);
+
+    entry->out      = entry->data + header;
+    entry->err      = entry->out + entry->out_size;
+    entry->artifact = entry->err + entry->err_size;
+
+    //the mtime is the last use; failing to set it only makes the entry look older
+    utimensat(AT_FDCWD, path, NULL, 0);
+
+    atomic_fetch_add(&cache->hits, 1);
+    return 1;
+}
+
+void cache_store(CompileCache *cache, const CacheKey *key, const CacheEntry *entry)
+{
+    char path[PATH_MAX], temp[PATH_MAX];
+    unsigned long serial = atomic_fetch_add(&temp_serial, 1);
+    long size;
+    FILE *file;
+    int failed;
+
+    snprintf(temp, sizeof(temp), "%s/%02x", cache->dir, (unsigned)(key->hi >> 56));
+
+    if (mkdir(temp, 0777) != 0 && errno != EEXIST)
+        return;
+
+    entry_path(cache, key, path, sizeof(path));
+    snprintf(temp, sizeof(temp), "%s/%02x/.tmp-%ld-%lu", cache->dir, (unsigned)(key->hi >> 56),
+             (long)getpid(), serial);
+
+    file = fopen(temp, "wb");
+
+    if (!file)
+        return;
+
+    fprintf(file, "KOMC 1 %d %d %d %d %d %d %d %zu %zu %zu\n", entry->status,
+            entry->counts[0], entry->counts[1], entry->counts[2], entry->counts[3],
+            entry->counts[4], entry->counts[5],
+            entry->out_size, entry->err_size, entry->artifact_size);
+
+    fwrite(entry->out, 1, entry->out_size, file);
+    fwrite(entry->err, 1, entry->err_size, file);
+    fwrite(entry->artifact, 1, entry->artifact_size, file);
+
+    size = ftell(file);
+    failed = ferror(file);
+    failed |= fclose(file) != 0;
+
+    //rename replaces the name in one step, so a reader never sees half an entry
+    if (failed || rename(temp, path) != 0)
+    {
+        unlink(temp);
+        return;
+    }
+
+    long before = atomic_fetch_add(&cache->stored, size);
+    long every = (cache->limit >= 16) ? cache->limit / 16 : 1;
+
+    if (before / every != (before + size) / every || (key->lo % CACHE_TRIM_EVERY) == 0)
+        cache_trim(cache);
+}
+
+void cache_free_entry(CacheEntry *entry)
+{
+    free(entry->data);
+    memset(entry, 0, sizeof(*entry));
+}
+
+
+
+/*
+  _______   _
+ |__   __| (_)
+    | |_ __ _ _ __ ___
+    | | '__| | '_ ` _ \
+    | | |  | | | | | | |
+    |_|_|  |_|_| |_| |_|
+*/
+
+static int compare_use(const void *a, const void *b)
+{
+    const CacheFile *x = a, *y = b;
+
+    if (x->sec != y->sec)
+        return (x->sec > y->sec) - (x->sec < y->sec);
+
+    return (x->nsec > y->nsec) - (x->nsec < y->nsec);
+}
+
+void cache_trim(CompileCache *cache)
+{
+    CacheFile *files = NULL;
+    int count = 0, capacity = 0;
+    long long total = 0;
+    time_t now = time(NULL);
+    int expected = 0;
+
+    //one trim per process at a time; a second one would only race the first through the same files
+    if (!atomic_compare_exchange_strong(&cache->trimming, &expected, 1))
+        return;
+
+    atomic_store(&cache->stored, 0);
+
+    for (int shard = 0; shard < 256; shard++)
+    {
+        char dir[PATH_MAX];
+        struct dirent *de;
+        DIR *d;
+
+        snprintf(dir, sizeof(dir), "%s/%02x", cache->dir, shard);
+        d = opendir(dir);
+
+        if (!d)
+            continue;
+
+        while ((de = readdir(d)) != NULL)
+        {
+            char path[PATH_MAX];
+            struct stat st;
+
+            if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+                continue;
+
+            if (snprintf(path, sizeof(path), "%s/%s", dir, de->d_name) >= (int)sizeof(path))
+                continue;
+
+            if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+                continue;
+
+            //a writer that died between creating and renaming its file
+            if (strncmp(de->d_name, ".tmp-", 5) == 0)
+            {
+                if (now - st.st_mtime > CACHE_STALE_TEMP)
+                    unlink(path);
+
+                continue;
+            }
+
+            if (count == capacity)
+            {
+                capacity = capacity ? capacity * 2 : 1024;
+                files = realloc(files, capacity * sizeof(CacheFile));
+
+                if (!files)
+                {
+                    fprintf(stderr, "Fatal: failed to allocate cache listing\n");
+                    exit(1);
+                }
+            }
+
+            files[count].path = strdup(path);
+            files[count].size = st.st_size;
+            files[count].sec  = st.st_mtim.tv_sec;
+            files[count].nsec = st.st_mtim.tv_nsec;
+
+            if (!files[count].path)
+            {
+                fprintf(stderr, "Fatal: failed to allocate cache listing\n");
+                exit(1);
+            }
+
+            total += st.st_size;
+            count++;
+        }
+
+        closedir(d);
+    }
+
+    if (total > cache->limit)
+    {
+        long long keep = (long long)cache->limit * CACHE_TRIM_TO / 100;
+
+        qsort(files, count, sizeof(CacheFile), compare_use);
+
+        //another process may have removed it already; either way it is gone
+        for (int i = 0; i < count && total > keep; i++)
+        {
+            unlink(files[i].path);
+            total -= files[i].size;
+        }
+    }
+
+    for (int i = 0; i < count; i++)
+        free(files[i].path);
+
+    free(files);
+
+    atomic_store(&cache->trimming, 0);
+}
+
+char *cache_default_dir(void)
+{
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char *dir;
+
+    if (xdg && *xdg)
+    {
+        dir = malloc(strlen(xdg) + 5);
+
+        if (dir)
+            sprintf(dir, "%s/kom", xdg);
+    }
+    else if (home && *home)
+    {
+        dir = malloc(strlen(home) + 12);
+
+        if (dir)
+            sprintf(dir, "%s/.cache/kom", home);
+    }
+    else
+    {
+        dir = strdup("/tmp/kom-cache");
+    }
+
+    if (!dir)
+    {
+        fprintf(stderr, "Fatal: failed to allocate cache path\n");
+        exit(1);
+    }
+
+    return dir;
+}
@@ -0,0 +1,90 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/* ---------------------------------------------
+   Compilation cache
+
+   A directory of finished compiles, each entry
+   named by a 128-bit key: two XXH64 hashes of
+   the source seeded with a hash of the compiler
+   build and the options that change what a
+   compile prints or produces (driver.c). An
+   entry holds the status, result counts and the
+   out, err and artifact text of the compile, so
+   a hit replays it without decoding, lexing or
+   parsing anything.
+
+   Entries sit in 256 subdirectories by the
+   first byte of the key. A new entry is written
+   to a temporary file in its subdirectory and
+   renamed over the final name, so a reader sees
+   a whole entry or none, and processes and
+   threads can share one directory without
+   locks. A hit touches the entry's mtime, which
+   makes the mtime the recency of use.
+
+   Once the entries exceed the size limit, a
+   trim deletes least recently used entries
+   until the total is under CACHE_TRIM_TO of it.
+   Scanning the directory is not free, so a
+   process trims after each limit / 16 bytes it
+   has stored, and one store in CACHE_TRIM_EVERY
+   trims regardless, so that many short
+   processes still keep the directory in
+   bounds.
+--------------------------------------------- */
+
+#define CACHE_DEFAULT_LIMIT (256L << 20)    // bytes
+#define CACHE_TRIM_TO       90              // percent of the limit left after a trim
+#define CACHE_TRIM_EVERY    64
+#define CACHE_STALE_TEMP    3600            // seconds before a writer's leftover temp file is removed
+
+typedef struct CacheKey {
+    uint64_t hi;
+    uint64_t lo;
+} CacheKey;
+
+//one compile as stored: result counts and the three texts
+typedef struct CacheEntry {
+    int     status;
+    int     counts[6];      // FileResult fields in order, filled by driver.c
+    char   *out;
+    size_t  out_size;
+    char   *err;
+    size_t  err_size;
+    char   *artifact;
+    size_t  artifact_size;
+    char   *data;           // owns the three texts after cache_load
+} CacheEntry;
+
+typedef struct CompileCache {
+    char          *dir;
+    long           limit;
+    atomic_long    stored;          // bytes this process has written since its last trim
+    atomic_int     trimming;
+    atomic_long    hits;
+    atomic_long    misses;
+} CompileCache;
+
+uint64_t xxh64(const void *data, size_t size, uint64_t seed);
+
+// creates dir if needed; returns 1 if it cannot be used
+int  cache_open(CompileCache *cache, const char *dir, long limit);
+void cache_close(CompileCache *cache);
+
+// 1 and a filled entry on a hit (free with cache_free_entry), 0 on a miss
+int  cache_load(CompileCache *cache, const CacheKey *key, CacheEntry *entry);
+void cache_store(CompileCache *cache, const CacheKey *key, const CacheEntry *entry);
+void cache_free_entry(CacheEntry *entry);
+
+// deletes least recently used entries until the total is under CACHE_TRIM_TO percent of the limit
+void cache_trim(CompileCache *cache);
+
+// $XDG_CACHE_HOME/kom, else $HOME/.cache/kom, else /tmp/kom-cache; caller frees
+char *cache_default_dir(void);
+
+#endif /* CACHE_H */
@@ -0,0 +1,1496 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <limits.h>
+
+#include "cgen.h"
+#include "fold.h"
+
+#define CG_DEFINED  0x01    // struct definition written
+#define CG_TYPEDEF  0x02    // typedef written
+
+/* C operator precedence, higher binds tighter */
+enum {
+    PREC_ELLER = 4,
+    PREC_OCH,
+    PREC_BITOR,
+    PREC_BITXOR,
+    PREC_BITAND,
+    PREC_EQUALITY,
+    PREC_RELATION,
+    PREC_SHIFT,
+    PREC_ADD,
+    PREC_MUL,
+    PREC_UNARY,
+    PREC_POSTFIX,
+    PREC_PRIMARY
+};
+
+typedef struct CGenState {
+    const Ast       *ast;
+    const TypeTable *types;
+    const SemState  *sema;
+
+    char            *buf;           // the whole output file
+    size_t           length;
+    size_t           capacity;
+    int              indent;
+
+    unsigned char   *emitted;       // per AST node: CG_DEFINED / CG_TYPEDEF
+    unsigned char   *struct_done;   // per struct index
+    unsigned char   *label_used;    // per AST node: some GÅ TILL jumps here
+    int              function;      // FUNCTION node being written
+} CGenState;
+
+static void cg_expr(CGenState *s, int node);
+static void cg_stmt(CGenState *s, int node);
+static void ensure_struct(CGenState *s, int si);
+static void ensure_typedef(CGenState *s, int node);
+
+static const AstNode *node_at(CGenState *s, int node)
+{
+    return &s->ast->nodes[node];
+}
+
+static const Type *type_at(CGenState *s, int type)
+{
+    return &s->types->types[type];
+}
+
+
+
+/*
+ __          __   _ _
+ \ \        / /  (_) |
+  \ \  /\  / / __ _| |_ ___ _ __
+   \ \/  \/ / '__| | __/ _ \ '__|
+    \  /\  /| |  | | ||  __/ |
+     \/  \/ |_|  |_|\__\___|_|
+
+*/
+
+static void cg_reserve(CGenState *s, size_t extra)
+{
+    if (s->length + extra + 1 <= s->capacity)
+        return;
+
+    while (s->length + extra + 1 > s->capacity)
+        s->capacity = s->capacity ? s->capacity * 2 : 4096;
+
+    s->buf = realloc(s->buf, s->capacity);
+
+    if (!s->buf)
+    {
+        fprintf(stderr, "Fatal: C output realloc failed\n");
+        exit(1);
+    }
+}
+
+static void cg_puts(CGenState *s, const char *text)
+{
+    size_t n = strlen(text);
+
+    cg_reserve(s, n);
+    memcpy(s->buf + s->length, text, n);
+    s->length += n;
+}
+
+static void cg_putc(CGenState *s, char c)
+{
+    cg_reserve(s, 1);
+    s->buf[s->length++] = c;
+}
+
+static void cg_printf(CGenState *s, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+
+    cg_reserve(s, (size_t)n);
+
+    va_start(ap, fmt);
+    vsnprintf(s->buf + s->length, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+
+    s->length += (size_t)n;
+}
+
+static void cg_line_start(CGenState *s)
+{
+    for (int i = 0; i < s->indent; i++)
+        cg_puts(s, "    ");
+}
+
+//C keywords, and main, which the generated wrapper takes
+static int is_reserved(const char *name)
+{
+    static const char *words[] = {
+        "auto", "break", "case", "char", "const", "continue", "default", "do",
+        "double", "else", "enum", "extern", "float", "for", "goto", "if",
+        "inline", "int", "long", "register", "restrict", "return", "short",
+        "signed", "sizeof", "static", "struct", "switch", "typedef", "union",
+        "unsigned", "void", "volatile", "while", "_Bool", "_Complex",
+        "_Imaginary", "main", NULL
+    };
+
+    for (int i = 0; words[i]; i++)
+    {
+        if (strcmp(words[i], name) == 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+/* identifiers: Å / Ä / Ö become _uXX, as in the x86 back end */
+static void cg_name(CGenState *s, const char *name)
+{
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++)
+    {
+        if ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+            (*p >= '0' && *p <= '9') || *p == '_')
+            cg_putc(s, (char)*p);
+        else
+            cg_printf(s, "_u%02X", *p);
+    }
+
+    if (is_reserved(name))
+        cg_putc(s, '_');
+}
+
+static void cg_node_name(CGenState *s, int node)
+{
+    cg_name(s, ast_name(s->ast, node));
+}
+
+
+
+/*
+  _______
+ |__   __|
+    | |_   _ _ __   ___  ___
+    | | | | | '_ \ / _ \/ __|
+    | | |_| | |_) |  __/\__ \
+    |_|\__, | .__/ \___||___/
+        __/ | |
+       |___/|_|
+*/
+
+static const char *int_name(int size, int is_unsigned)
+{
+    switch (size)
+    {
+        case 1:  return is_unsigned ? "unsigned char"  : "char";
+        case 2:  return is_unsigned ? "unsigned short" : "short";
+        case 8:  return is_unsigned ? "unsigned long long" : "long long";
+        default: return is_unsigned ? "unsigned int"   : "int";
+    }
+}
+
+//ENUM types are interned per declaration; the name comes from the declaring symbol
+static int enum_decl_of(CGenState *s, int type)
+{
+    for (int i = 0; i < s->sema->symbol_count; i++)
+    {
+        const Symbol *sym = &s->sema->symbols[i];
+
+        if (sym->kind == SYM_TYPEDEF && sym->type == type && sym->node >= 0 &&
+            node_at(s, sym->node)->kind == AST_ENUM_DECL)
+            return sym->node;
+    }
+
+    return AST_NULL;
+}
+
+static void cg_base_type(CGenState *s, int type)
+{
+    const Type *t = type_at(s, type);
+
+    switch (t->kind)
+    {
+        case TY_VOID:
+            cg_puts(s, "void");
+            break;
+
+        case TY_INT:
+            cg_puts(s, int_name(t->size, t->is_unsigned));
+            break;
+
+        case TY_FLOAT:
+            cg_puts(s, (t->size == 8) ? "double" : "float");
+            break;
+
+        case TY_STRUCT:
+            cg_puts(s, "struct ");
+            cg_name(s, s->types->structs[t->info].name);
+            break;
+
+        case TY_ENUM:
+        {
+            int decl = enum_decl_of(s, type);
+
+            if (decl == AST_NULL)
+            {
+                cg_puts(s, "int");
+                break;
+            }
+
+            cg_puts(s, "enum ");
+            cg_node_name(s, decl);
+            break;
+        }
+
+        default:
+            cg_puts(s, "int");
+            break;
+    }
+}
+
+static void cg_type_prefix(CGenState *s, int type)
+{
+    const Type *t = type_at(s, type);
+
+    if (t->kind == TY_POINTER)
+    {
+        cg_type_prefix(s, t->base);
+
+        if (type_at(s, t->base)->kind == TY_ARRAY)
+            cg_putc(s, '(');
+
+        cg_putc(s, '*');
+    }
+    else if (t->kind == TY_ARRAY)
+    {
+        cg_type_prefix(s, t->base);
+    }
+    else
+    {
+        cg_base_type(s, type);
+        cg_putc(s, ' ');
+    }
+}
+
+static void cg_type_suffix(CGenState *s, int type)
+{
+    const Type *t = type_at(s, type);
+
+    if (t->kind == TY_POINTER)
+    {
+        if (type_at(s, t->base)->kind == TY_ARRAY)
+            cg_putc(s, ')');
+
+        cg_type_suffix(s, t->base);
+    }
+    else if (t->kind == TY_ARRAY)
+    {
+        cg_printf(s, "[%d]", t->count);
+        cg_type_suffix(s, t->base);
+    }
+}
+
+//type name for a cast: "int *", "struct P (*)[4]"
+static void cg_type_name(CGenState *s, int type)
+{
+    size_t mark;
+
+    cg_type_prefix(s, type);
+    mark = s->length;
+    cg_type_suffix(s, type);
+
+    //drop the space cg_base_type leaves for a declarator that never comes
+    if (s->length == mark && s->buf[mark - 1] == ' ')
+        s->length--;
+}
+
+//plain C constant expression: literals, enumerators and the operators on them
+static int is_c_constant(CGenState *s, int node)
+{
+    const AstNode *n = node_at(s, node);
+
+    switch (n->kind)
+    {
+        case AST_INT_LIT:
+        case AST_FLOAT_LIT:
+        case AST_STRING_LIT:
+        case AST_ADDRESS:
+            return 1;
+
+        case AST_IDENT:
+            return n->sym >= 0 && s->sema->symbols[n->sym].kind == SYM_ENUM_CONST;
+
+        case AST_UNARY:
+            return is_c_constant(s, n->kid[0]);
+
+        case AST_CAST:
+            return is_c_constant(s, n->kid[1]);
+
+        case AST_BINARY:
+            return is_c_constant(s, n->kid[0]) && is_c_constant(s, n->kid[1]);
+
+        default:
+            return 0;
+    }
+}
+
+static void cg_folded(CGenState *s, ConstValue value, int type)
+{
+    const Type *t = type_at(s, type);
+
+    if (t->kind == TY_FLOAT)
+    {
+        double f = (value.kind == CONST_FLOAT) ? value.f : (double)value.i;
+        char text[64];
+
+        snprintf(text, sizeof(text), (t->size == 8) ? "%.17g" : "%.9g", f);
+
+        //keep it a floating literal: 3 -> 3.0
+        if (!strpbrk(text, ".eni"))
+            strcat(text, ".0");
+
+        cg_puts(s, text);
+
+        if (t->size != 8)
+            cg_putc(s, 'f');
+        return;
+    }
+
+    long long i = (value.kind == CONST_FLOAT) ? (long long)value.f : value.i;
+    int size = (t->kind == TY_INT) ? t->size : 8;
+    int is_unsigned = (t->kind == TY_INT) && t->is_unsigned;
+
+    if (is_unsigned)
+        cg_printf(s, (size == 8) ? "%lluULL" : "%lluu", (unsigned long long)i);
+    else if (i == LLONG_MIN)
+        cg_puts(s, "(-9223372036854775807LL - 1)");
+    else if (size == 8 && (i > INT_MAX || i < INT_MIN))
+        cg_printf(s, "%lldLL", i);
+    else if (i == INT_MIN)
+        cg_puts(s, "(-2147483647 - 1)");
+    else
+        cg_printf(s, "%lld", i);
+}
+
+//array dimensions, case labels and enumerator values must be C constants
+static void cg_constant(CGenState *s, int node)
+{
+    if (is_c_constant(s, node))
+        cg_expr(s, node);
+    else
+        cg_folded(s, node_at(s, node)->value, node_at(s, node)->type);
+}
+
+/* a declaration written from its TYPE node, keeping typedef and enum names */
+static void cg_decl(CGenState *s, int type_node, const char *name)
+{
+    const AstNode *t = node_at(s, type_node);
+
+    switch (t->op)
+    {
+        case TOK_STRUKTUR:
+            cg_puts(s, "struct ");
+            cg_node_name(s, type_node);
+            break;
+
+        case TOK_IDENTIFIER:
+            if (t->sym >= 0 && node_at(s, s->sema->symbols[t->sym].node)->kind == AST_ENUM_DECL)
+                cg_puts(s, "enum ");
+            else if (t->sym < 0)
+                cg_puts(s, "struct ");
+
+            cg_node_name(s, type_node);
+            break;
+
+        default:
+        {
+            int base = t->type;
+
+            while (type_at(s, base)->kind == TY_ARRAY || type_at(s, base)->kind == TY_POINTER)
+                base = type_at(s, base)->base;
+
+            cg_base_type(s, base);
+            break;
+        }
+    }
+
+    cg_putc(s, ' ');
+
+    for (int i = 0; i < t->aux; i++)
+        cg_putc(s, '*');
+
+    if (name)
+        cg_name(s, name);
+
+    for (int d = t->list; d != AST_NULL; d = node_at(s, d)->next)
+    {
+        cg_putc(s, '[');
+        cg_constant(s, d);
+        cg_putc(s, ']');
+    }
+}
+
+
+
+/*
+  ______
+ |  ____|
+ | |__  __  ___ __  _ __ ___  ___ ___ _ ___  _ __  ___
+ |  __| \ \/ / '_ \| '__/ _ \/ __/ __| |/ _ \| '_ \/ __|
+ | |____ >  <| |_) | | |  __/\__ \__ \ | (_) | | | \__ \
+ |______/_/\_\ .__/|_|  \___||___/___/_|\___/|_| |_|___/
+             | |
+             |_|
+*/
+
+static int binary_prec(TokenType op)
+{
+    switch (op)
+    {
+        case TOK_MUL: case TOK_DIV: case TOK_MOD:   return PREC_MUL;
+        case TOK_PLUS: case TOK_MINUS:              return PREC_ADD;
+        case TOK_VANSTER: case TOK_HOGER:           return PREC_SHIFT;
+        case TOK_LT: case TOK_GT:
+        case TOK_LTE: case TOK_GTE:                 return PREC_RELATION;
+        case TOK_EQ: case TOK_NEQ:                  return PREC_EQUALITY;
+        case TOK_BITAND:                            return PREC_BITAND;
+        case TOK_BITXOR:                            return PREC_BITXOR;
+        case TOK_BITOR:                             return PREC_BITOR;
+        case TOK_OCH:                               return PREC_OCH;
+        default:                                    return PREC_ELLER;
+    }
+}
+
+static const char *binary_text(TokenType op)
+{
+    switch (op)
+    {
+        case TOK_MUL:     return "*";
+        case TOK_DIV:     return "/";
+        case TOK_MOD:     return "%";
+        case TOK_PLUS:    return "+";
+        case TOK_MINUS:   return "-";
+        case TOK_VANSTER: return "<<";
+        case TOK_HOGER:   return ">>";
+        case TOK_LT:      return "<";
+        case TOK_GT:      return ">";
+        case TOK_LTE:     return "<=";
+        case TOK_GTE:     return ">=";
+        case TOK_EQ:      return "==";
+        case TOK_NEQ:     return "!=";
+        case TOK_BITAND:  return "&";
+        case TOK_BITXOR:  return "^";
+        case TOK_BITOR:   return "|";
+        case TOK_OCH:     return "&&";
+        default:          return "||";
+    }
+}
+
+static int expr_prec(CGenState *s, int node)
+{
+    const AstNode *n = node_at(s, node);
+
+    switch (n->kind)
+    {
+        case AST_BINARY:
+            return binary_prec(n->op);
+
+        case AST_UNARY:
+        case AST_DEREF:
+        case AST_ADDRESS:
+        case AST_CAST:
+            return PREC_UNARY;
+
+        case AST_INDEX:
+        case AST_FIELD:
+        case AST_CALL:
+            return PREC_POSTFIX;
+
+        default:
+            return PREC_PRIMARY;
+    }
+}
+
+//only adds parentheses C needs, or that gcc -Wparentheses asks for
+static int needs_parens(CGenState *s, int parent, int child, int is_right)
+{
+    const AstNode *p = node_at(s, parent);
+    const AstNode *c = node_at(s, child);
+    int pp = expr_prec(s, parent);
+    int cp = expr_prec(s, child);
+
+    if (cp < pp || (cp == pp && is_right && p->kind == AST_BINARY))
+        return 1;
+
+    if (p->kind == AST_BINARY && c->kind == AST_BINARY)
+    {
+        if (pp <= PREC_SHIFT && pp >= PREC_BITAND && c->op != p->op && pp != PREC_EQUALITY && pp != PREC_RELATION)
+            return 1;
+
+        if ((pp == PREC_EQUALITY || pp == PREC_RELATION) && (cp == PREC_EQUALITY || cp == PREC_RELATION))
+            return 1;
+
+        if (pp == PREC_ELLER && cp == PREC_OCH)
+            return 1;
+
+        if (pp == PREC_BITOR || pp == PREC_BITXOR)
+            return c->op != p->op;
+    }
+
+    //- -x must not turn into --x
+    if (p->kind == AST_UNARY && c->kind == AST_UNARY)
+        return 1;
+
+    return 0;
+}
+
+static void cg_operand(CGenState *s, int parent, int child, int is_right)
+{
+    if (needs_parens(s, parent, child, is_right))
+    {
+        cg_putc(s, '(');
+        cg_expr(s, child);
+        cg_putc(s, ')');
+    }
+    else
+    {
+        cg_expr(s, child);
+    }
+}
+
+static int is_pointerish(CGenState *s, int type)
+{
+    return type_at(s, type)->kind == TY_POINTER || type_at(s, type)->kind == TY_ARRAY;
+}
+
+static int is_integral(CGenState *s, int type)
+{
+    return type_at(s, type)->kind == TY_INT || type_at(s, type)->kind == TY_ENUM;
+}
+
+static int is_zero_constant(CGenState *s, int node)
+{
+    const AstNode *n = node_at(s, node);
+
+    return n->value.kind == CONST_INT && n->value.i == 0;
+}
+
+/* value of node converted to type where K converts implicitly but C would complain */
+static void cg_converted(CGenState *s, int node, int type)
+{
+    int src = node_at(s, node)->type;
+    int cast = 0;
+    int via_long = 0;
+
+    if (type_at(s, type)->kind == TY_POINTER)
+    {
+        if (is_integral(s, src) && !is_zero_constant(s, node))
+        {
+            cast = 1;
+            via_long = type_at(s, src)->size != 8;
+        }
+        else if (is_pointerish(s, src))
+        {
+            int want = type_at(s, type)->base;
+            int have = type_at(s, src)->base;
+
+            cast = want != have && type_at(s, want)->kind != TY_VOID && type_at(s, have)->kind != TY_VOID;
+        }
+    }
+    else if (is_integral(s, type) && is_pointerish(s, src))
+    {
+        cast = 1;
+        via_long = type_at(s, type)->size != 8;
+    }
+
+    if (!cast)
+    {
+        cg_expr(s, node);
+        return;
+    }
+
+    cg_putc(s, '(');
+    cg_type_name(s, type);
+    cg_puts(s, via_long ? ")(long)" : ")");
+
+    if (expr_prec(s, node) < PREC_UNARY)
+    {
+        cg_putc(s, '(');
+        cg_expr(s, node);
+        cg_putc(s, ')');
+    }
+    else
+    {
+        cg_expr(s, node);
+    }
+}
+
+//the lexeme keeps its quotes and K escapes; written back as a C literal
+static void cg_string(CGenState *s, int node)
+{
+    const char *text = ast_name(s->ast, node);
+    int length = (int)strlen(text);
+
+    cg_putc(s, '"');
+
+    for (int c = (text[0] == '"') ? 1 : 0; c < length; c++)
+    {
+        unsigned char ch = (unsigned char)text[c];
+
+        if (ch == '"' && c == length - 1)
+            break;
+
+        if (ch == '\\' && c + 1 < length)
+        {
+            c++;
+
+            switch (text[c])
+            {
+                case 'n': ch = '\n'; break;
+                case 't': ch = '\t'; break;
+                case '0': ch = '\0'; break;
+                default:  ch = (unsigned char)text[c]; break;
+            }
+        }
+
+        switch (ch)
+        {
+            case '\n': cg_puts(s, "\\n");  break;
+            case '\t': cg_puts(s, "\\t");  break;
+            case '"':  cg_puts(s, "\\\""); break;
+            case '\\': cg_puts(s, "\\\\"); break;
+
+            default:
+                //octal escapes are always three digits so a following digit stays separate
+                if (ch < 0x20 || ch == 0x7f)
+                    cg_printf(s, "\\%03o", ch);
+                else
+                    cg_putc(s, (char)ch);
+                break;
+        }
+    }
+
+    cg_putc(s, '"');
+}
+
+static void cg_call(CGenState *s, int node)
+{
+    const AstNode *n = node_at(s, node);
+    int param = AST_NULL;
+    int first = 1;
+
+    if (n->sym >= 0 && node_at(s, s->sema->symbols[n->sym].node)->kind == AST_FUNCTION)
+        param = node_at(s, s->sema->symbols[n->sym].node)->list;
+
+    cg_node_name(s, node);
+    cg_putc(s, '(');
+
+    for (int a = n->list; a != AST_NULL; a = node_at(s, a)->next)
+    {
+        if (!first)
+            cg_puts(s, ", ");
+
+        if (param != AST_NULL)
+        {
+            cg_converted(s, a, node_at(s, param)->type);
+            param = node_at(s, param)->next;
+        }
+        else
+        {
+            cg_expr(s, a);
+        }
+
+        first = 0;
+    }
+
+    cg_putc(s, ')');
+}
+
+//pointer against integer or an unrelated pointer: the right side takes the left's type
+static void cg_compare(CGenState *s, int node)
+{
+    const AstNode *n = node_at(s, node);
+    int lt = node_at(s, n->kid[0])->type;
+    int rt = node_at(s, n->kid[1])->type;
+
+    cg_operand(s, node, n->kid[0], 0);
+    cg_printf(s, " %s ", binary_text(n->op));
+
+    if (type_at(s, lt)->kind == TY_POINTER && (is_pointerish(s, rt) || is_integral(s, rt)))
+        cg_converted(s, n->kid[1], lt);
+    else if (type_at(s, rt)->kind == TY_POINTER && is_integral(s, lt) && !is_zero_constant(s, n->kid[0]))
+    {
+        //keeps the left side as written; comparing as integers is what K does
+        cg_putc(s, '(');
+        cg_type_name(s, lt);
+        cg_puts(s, ")(long)");
+        cg_operand(s, node, n->kid[1], 1);
+    }
+    else
+        cg_operand(s, node, n->kid[1], 1);
+}
+
+static void cg_expr(CGenState *s, int node)
+{
+    const AstNode *n = node_at(s, node);
+
+    switch (n->kind)
+    {
+        case AST_INT_LIT:
+            cg_folded(s, n->value, n->type);
+            break;
+
+        case AST_FLOAT_LIT:
+            cg_puts(s, ast_name(s->ast, node));
+
+            if (type_at(s, n->type)->size != 8)
+                cg_putc(s, 'f');
+            break;
+
+        case AST_STRING_LIT:
+            cg_string(s, node);
+            break;
+
+        case AST_IDENT:
+            cg_node_name(s, node);
+            break;
+
+        case AST_BINARY:
+            if (binary_prec(n->op) == PREC_EQUALITY || binary_prec(n->op) == PREC_RELATION)
+            {
+                cg_compare(s, node);
+                break;
+            }
+
+            cg_operand(s, node, n->kid[0], 0);
+            cg_printf(s, " %s ", binary_text(n->op));
+            cg_operand(s, node, n->kid[1], 1);
+            break;
+
+        case AST_UNARY:
+            switch (n->op)
+            {
+                case TOK_MINUS:  cg_putc(s, '-'); break;
+                case TOK_PLUS:   cg_putc(s, '+'); break;
+                case TOK_INTE:   cg_putc(s, '!'); break;
+                default:         cg_putc(s, '~'); break;
+            }
+
+            cg_operand(s, node, n->kid[0], 0);
+            break;
+
+        case AST_DEREF:
+            cg_putc(s, '*');
+            cg_operand(s, node, n->kid[0], 0);
+            break;
+
+        case AST_ADDRESS:
+            cg_putc(s, '&');
+            cg_operand(s, node, n->kid[0], 0);
+            break;
+
+        case AST_CAST:
+            cg_putc(s, '(');
+            cg_decl(s, n->kid[0], NULL);
+
+            //cg_decl leaves room for a name; a cast has none
+            if (s->buf[s->length - 1] == ' ')
+                s->length--;
+
+            cg_putc(s, ')');
+            cg_operand(s, node, n->kid[1], 0);
+            break;
+
+        case AST_CALL:
+            cg_call(s, node);
+            break;
+
+        case AST_INDEX:
+            cg_operand(s, node, n->kid[0], 0);
+            cg_putc(s, '[');
+            cg_expr(s, n->kid[1]);
+            cg_putc(s, ']');
+            break;
+
+        case AST_FIELD:
+            cg_operand(s, node, n->kid[0], 0);
+            cg_puts(s, (type_at(s, node_at(s, n->kid[0])->type)->kind == TY_POINTER) ? "->" : ".");
+            cg_node_name(s, node);
+            break;
+
+        default:
+            cg_puts(s, "0");
+            break;
+    }
+}
+
+/* initializer for an object of type; static storage needs C constants */
+static void cg_init(CGenState *s, int init, int type, int is_static)
+{
+    const AstNode *n = node_at(s, init);
+    const Type *t = type_at(s, type);
+
+    if (n->kind == AST_ARRAY_LIT)
+    {
+        int index = 0;
+
+        cg_putc(s, '{');
+
+        for (int e = n->list; e != AST_NULL; e = node_at(s, e)->next, index++)
+        {
+            if (index > 0)
+                cg_puts(s, ", ");
+
+            if (t->kind == TY_ARRAY)
+            {
+                cg_init(s, e, t->base, is_static);
+            }
+            else
+            {
+                //designated, so the struct layout is free to reorder the members
+                const StructField *field = &s->types->fields[s->types->structs[t->info].first_field + index];
+
+                cg_putc(s, '.');
+                cg_name(s, field->name);
+                cg_puts(s, " = ");
+                cg_init(s, e, field->type, is_static);
+            }
+        }
+
+        cg_putc(s, '}');
+        return;
+    }
+
+    if (is_static && n->value.kind != CONST_NONE && !is_c_constant(s, init))
+        cg_folded(s, const_convert(s->types, n->value, type), type);
+    else
+        cg_converted(s, init, type);
+}
+
+
+
+/*
+   _____ _        _                            _
+  / ____| |      | |                          | |
+ | (___ | |_ __ _| |_ ___ _ __ ___   ___ _ __ | |_ ___
+  \___ \| __/ _` | __/ _ \ '_ ` _ \ / _ \ '_ \| __/ __|
+  ____) | || (_| | ||  __/ | | | | |  __/ | | | |_\__ \
+ |_____/ \__\__,_|\__\___|_| |_| |_|\___|_| |_|\__|___/
+
+*/
+
+static void cg_var_decl(CGenState *s, int node, int is_global)
+{
+    const AstNode *n = node_at(s, node);
+    int is_static = is_global || (n->flags & AST_FLAG_STATIC);
+    int kind = type_at(s, n->type)->kind;
+
+    if (n->flags & AST_FLAG_STATIC)
+        cg_puts(s, "static ");
+    else if ((n->flags & AST_FLAG_EXTERN) && n->kid[1] == AST_NULL)
+        cg_puts(s, "extern ");
+
+    //objects with static storage share one section a harness can save and restore
+    if (is_static && !((n->flags & AST_FLAG_EXTERN) && n->kid[1] == AST_NULL))
+        cg_puts(s, "KOM_DATA ");
+
+    cg_decl(s, n->kid[0], ast_name(s->ast, node));
+
+    if (n->kid[1] != AST_NULL)
+    {
+        cg_puts(s, " = ");
+        cg_init(s, n->kid[1], n->type, is_static);
+    }
+    else if (!is_static)
+    {
+        //locals read before their first store see zero rather than stack garbage
+        cg_puts(s, (kind == TY_ARRAY || kind == TY_STRUCT) ? " = {0}" : " = 0");
+    }
+}
+
+//ASSIGN / UPDATE / EXPR_STMT / VAR_DECL without the ';', for statements and FÖR headers
+static void cg_simple(CGenState *s, int node)
+{
+    const AstNode *n = node_at(s, node);
+
+    switch (n->kind)
+    {
+        case AST_VAR_DECL:
+            cg_var_decl(s, node, 0);
+            break;
+
+        case AST_ASSIGN:
+            cg_expr(s, n->kid[0]);
+            cg_puts(s, " = ");
+            cg_converted(s, n->kid[1], node_at(s, n->kid[0])->type);
+            break;
+
+        case AST_UPDATE:
+        {
+            const char *op;
+
+            if (n->kid[1] == AST_NULL)
+            {
+                //postfix ++ binds tighter than *, so VÄRDE VID p ÖKAR is (*p)++
+                if (expr_prec(s, n->kid[0]) < PREC_POSTFIX)
+                {
+                    cg_putc(s, '(');
+                    cg_expr(s, n->kid[0]);
+                    cg_putc(s, ')');
+                }
+                else
+                {
+                    cg_expr(s, n->kid[0]);
+                }
+
+                cg_puts(s, (n->op == TOK_MINSKAR) ? "--" : "++");
+                break;
+            }
+
+            cg_expr(s, n->kid[0]);
+
+            switch (n->op)
+            {
+                case TOK_OKAR:
+                case TOK_PLUS_ASSIGN:  op = "+=";  break;
+                case TOK_MINSKAR:
+                case TOK_MINUS_ASSIGN: op = "-=";  break;
+                case TOK_MUL_ASSIGN:   op = "*=";  break;
+                case TOK_DIV_ASSIGN:   op = "/=";  break;
+                case TOK_SHL_ASSIGN:   op = "<<="; break;
+                default:               op = ">>="; break;
+            }
+
+            cg_printf(s, " %s ", op);
+            cg_expr(s, n->kid[1]);
+            break;
+        }
+
+        case AST_EXPR_STMT:
+            cg_expr(s, n->kid[0]);
+            break;
+
+        default:
+            break;
+    }
+}
+
+//loop and branch bodies always get braces
+static void cg_body(CGenState *s, int node)
+{
+    if (node != AST_NULL && node_at(s, node)->kind == AST_BLOCK)
+    {
+        cg_stmt(s, node);
+        return;
+    }
+
+    cg_line_start(s);
+    cg_puts(s, "{\n");
+    s->indent++;
+    cg_stmt(s, node);
+    s->indent--;
+    cg_line_start(s);
+    cg_puts(s, "}\n");
+}
+
+static void cg_stmt(CGenState *s, int node)
+{
+    const AstNode *n;
+
+    if (node == AST_NULL)
+        return;
+
+    n = node_at(s, node);
+
+    switch (n->kind)
+    {
+        case AST_BLOCK:
+            cg_line_start(s);
+            cg_puts(s, "{\n");
+            s->indent++;
+
+            for (int c = n->list; c != AST_NULL; c = node_at(s, c)->next)
+                cg_stmt(s, c);
+
+            s->indent--;
+            cg_line_start(s);
+            cg_puts(s, "}\n");
+            break;
+
+        case AST_IF:
+            cg_line_start(s);
+            cg_puts(s, "if (");
+            cg_expr(s, n->kid[0]);
+            cg_puts(s, ")\n");
+            cg_body(s, n->kid[1]);
+
+            if (n->kid[2] != AST_NULL)
+            {
+                cg_line_start(s);
+                cg_puts(s, "else\n");
+                cg_body(s, n->kid[2]);
+            }
+            break;
+
+        case AST_WHILE:
+            cg_line_start(s);
+            cg_puts(s, "while (");
+            cg_expr(s, n->kid[0]);
+            cg_puts(s, ")\n");
+            cg_body(s, n->kid[1]);
+            break;
+
+        case AST_DO_WHILE:
+            cg_line_start(s);
+            cg_puts(s, "do\n");
+            cg_body(s, n->kid[1]);
+            cg_line_start(s);
+            cg_puts(s, "while (");
+            cg_expr(s, n->kid[0]);
+            cg_puts(s, ");\n");
+            break;
+
+        case AST_FOR:
+            cg_line_start(s);
+            cg_puts(s, "for (");
+
+            if (n->kid[0] != AST_NULL)
+                cg_simple(s, n->kid[0]);
+
+            cg_puts(s, "; ");
+
+            if (n->kid[1] != AST_NULL)
+                cg_expr(s, n->kid[1]);
+
+            cg_puts(s, "; ");
+
+            if (n->kid[2] != AST_NULL)
+                cg_simple(s, n->kid[2]);
+
+            cg_puts(s, ")\n");
+            cg_body(s, n->kid[3]);
+            break;
+
+        case AST_SWITCH:
+            cg_line_start(s);
+            cg_puts(s, "switch (");
+            cg_expr(s, n->kid[0]);
+            cg_puts(s, ")\n");
+            cg_line_start(s);
+            cg_puts(s, "{\n");
+
+            for (int c = n->list; c != AST_NULL; c = node_at(s, c)->next)
+            {
+                cg_line_start(s);
+
+                if (node_at(s, c)->kid[0] == AST_NULL)
+                {
+                    cg_puts(s, "default:\n");
+                }
+                else
+                {
+                    cg_puts(s, "case ");
+                    cg_constant(s, node_at(s, c)->kid[0]);
+                    cg_puts(s, ":\n");
+                }
+
+                s->indent++;
+
+                //a declaration cannot directly follow a case label in C99
+                if (node_at(s, c)->list != AST_NULL && node_at(s, node_at(s, c)->list)->kind == AST_VAR_DECL)
+                {
+                    cg_line_start(s);
+                    cg_puts(s, ";\n");
+                }
+
+                for (int st = node_at(s, c)->list; st != AST_NULL; st = node_at(s, st)->next)
+                    cg_stmt(s, st);
+
+                s->indent--;
+            }
+
+            cg_line_start(s);
+            cg_puts(s, "}\n");
+            break;
+
+        case AST_BREAK:
+            cg_line_start(s);
+            cg_puts(s, "break;\n");
+            break;
+
+        case AST_CONTINUE:
+            cg_line_start(s);
+            cg_puts(s, "continue;\n");
+            break;
+
+        case AST_GOTO:
+            cg_line_start(s);
+            cg_puts(s, "goto ");
+            cg_node_name(s, node);
+            cg_puts(s, ";\n");
+            break;
+
+        case AST_LABEL:
+            //ETIKETT nobody jumps to would only draw -Wunused-label
+            if (!s->label_used[node])
+                break;
+
+            cg_node_name(s, node);
+            cg_puts(s, ":;\n");
+            break;
+
+        case AST_RETURN:
+            cg_line_start(s);
+
+            if (n->kid[0] == AST_NULL)
+            {
+                cg_puts(s, "return;\n");
+                break;
+            }
+
+            cg_puts(s, "return ");
+            cg_converted(s, n->kid[0], node_at(s, s->function)->type);
+            cg_puts(s, ";\n");
+            break;
+
+        case AST_VAR_DECL:
+        case AST_ASSIGN:
+        case AST_UPDATE:
+        case AST_EXPR_STMT:
+            cg_line_start(s);
+            cg_simple(s, node);
+            cg_puts(s, ";\n");
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void mark_labels(CGenState *s, int node)
+{
+    const AstNode *n;
+
+    if (node == AST_NULL)
+        return;
+
+    n = node_at(s, node);
+
+    if (n->kind == AST_GOTO && n->aux >= 0)
+        s->label_used[n->aux] = 1;
+
+    for (int k = 0; k < 4; k++)
+        mark_labels(s, n->kid[k]);
+
+    for (int c = n->list; c != AST_NULL; c = node_at(s, c)->next)
+        mark_labels(s, c);
+}
+
+
+
+/*
+  _____            _                 _   _
+ |  __ \          | |               | | (_)
+ | |  | | ___  ___| | __ _ _ __ __ _| |_ _  ___  _ __  ___
+ | |  | |/ _ \/ __| |/ _` | '__/ _` | __| |/ _ \| '_ \/ __|
+ | |__| |  __/ (__| | (_| | | | (_| | |_| | (_) | | | \__ \
+ |_____/ \___|\___|_|\__,_|_|  \__,_|\__|_|\___/|_| |_|___/
+
+*/
+
+//a TYPE node naming a TYPDEF alias needs that alias written first
+static void ensure_type_node(CGenState *s, int type_node)
+{
+    const AstNode *t = node_at(s, type_node);
+    int type = t->type;
+
+    if (t->op == TOK_IDENTIFIER && t->sym >= 0 && node_at(s, s->sema->symbols[t->sym].node)->kind == AST_TYPEDEF)
+        ensure_typedef(s, s->sema->symbols[t->sym].node);
+
+    //arrays and by-value members need the complete struct
+    if (t->aux == 0)
+    {
+        while (type >= 0 && type_at(s, type)->kind == TY_ARRAY)
+            type = type_at(s, type)->base;
+
+        if (type >= 0 && type_at(s, type)->kind == TY_STRUCT)
+            ensure_struct(s, type_at(s, type)->info);
+    }
+}
+
+static void ensure_typedef(CGenState *s, int node)
+{
+    if (s->emitted[node] & CG_TYPEDEF)
+        return;
+
+    s->emitted[node] |= CG_TYPEDEF;
+    ensure_type_node(s, node_at(s, node)->kid[0]);
+
+    cg_puts(s, "typedef ");
+    cg_decl(s, node_at(s, node)->kid[0], ast_name(s->ast, node));
+    cg_puts(s, ";\n\n");
+}
+
+//fields go out in offset order, which is declaration order unless --struct-layout=reorder
+static void ensure_struct(CGenState *s, int si)
+{
+    const StructInfo *info = &s->types->structs[si];
+    int *order;
+
+    if (s->struct_done[si] || info->node < 0)
+        return;
+
+    s->struct_done[si] = 1;
+
+    order = malloc((info->field_count + 1) * sizeof(int));
+
+    if (!order)
+    {
+        fprintf(stderr, "Fatal: failed to allocate struct field order\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < info->field_count; i++)
+    {
+        int f = info->first_field + i;
+        int at = i;
+
+        ensure_type_node(s, node_at(s, s->types->fields[f].node)->kid[0]);
+
+        while (at > 0 && s->types->fields[order[at - 1]].offset > s->types->fields[f].offset)
+        {
+            order[at] = order[at - 1];
+            at--;
+        }
+
+        order[at] = f;
+    }
+
+    cg_puts(s, "struct ");
+    cg_name(s, info->name);
+    cg_puts(s, "\n{\n");
+
+    for (int i = 0; i < info->field_count; i++)
+    {
+        const StructField *field = &s->types->fields[order[i]];
+
+        cg_puts(s, "    ");
+        cg_decl(s, node_at(s, field->node)->kid[0], field->name);
+        cg_puts(s, ";\n");
+    }
+
+    cg_puts(s, (s->types->layout == LAYOUT_PACKED) ? "} __attribute__((packed));\n\n" : "};\n\n");
+
+    s->emitted[info->node] |= CG_DEFINED;
+    free(order);
+}
+
+static void cg_enum(CGenState *s, int node)
+{
+    cg_puts(s, "enum ");
+    cg_node_name(s, node);
+    cg_puts(s, "\n{\n");
+
+    for (int e = node_at(s, node)->list; e != AST_NULL; e = node_at(s, e)->next)
+    {
+        cg_puts(s, "    ");
+        cg_node_name(s, e);
+
+        if (node_at(s, e)->kid[0] != AST_NULL)
+        {
+            cg_puts(s, " = ");
+            cg_constant(s, node_at(s, e)->kid[0]);
+        }
+
+        cg_puts(s, (node_at(s, e)->next != AST_NULL) ? ",\n" : "\n");
+    }
+
+    cg_puts(s, "};\n\n");
+}
+
+static void cg_prototype(CGenState *s, int node)
+{
+    const AstNode *n = node_at(s, node);
+
+    if (n->flags & AST_FLAG_STATIC)
+        cg_puts(s, "static ");
+
+    cg_decl(s, n->kid[0], ast_name(s->ast, node));
+    cg_putc(s, '(');
+
+    if (n->list == AST_NULL)
+        cg_puts(s, "void");
+
+    for (int p = n->list; p != AST_NULL; p = node_at(s, p)->next)
+    {
+        cg_decl(s, node_at(s, p)->kid[0], ast_name(s->ast, p));
+
+        if (node_at(s, p)->next != AST_NULL)
+            cg_puts(s, ", ");
+    }
+
+    cg_putc(s, ')');
+}
+
+static void cg_function(CGenState *s, int node)
+{
+    int body = node_at(s, node)->kid[1];
+
+    s->function = node;
+    mark_labels(s, body);
+
+    cg_prototype(s, node);
+    cg_putc(s, '\n');
+    cg_stmt(s, body);
+    cg_putc(s, '\n');
+
+    s->function = AST_NULL;
+}
+
+static int find_entry(CGenState *s)
+{
+    for (int item = node_at(s, s->ast->root)->list; item != AST_NULL; item = node_at(s, item)->next)
+    {
+        const AstNode *n = node_at(s, item);
+
+        if (n->kind == AST_FUNCTION && n->kid[1] != AST_NULL && strcmp(ast_name(s->ast, item), "ENTRE") == 0)
+            return item;
+    }
+
+    return AST_NULL;
+}
+
+int emit_c(const Ast *ast, const TypeTable *types, const SemState *sema, FILE *out)
+{
+    CGenState state;
+    CGenState *s = &state;
+    int root_list = ast->nodes[ast->root].list;
+    int globals = 0;
+    int entry;
+    int failed;
+
+    memset(s, 0, sizeof(*s));
+    s->ast      = ast;
+    s->types    = types;
+    s->sema     = sema;
+    s->function = AST_NULL;
+
+    s->emitted     = calloc(ast->node_count + 1, 1);
+    s->label_used  = calloc(ast->node_count + 1, 1);
+    s->struct_done = calloc(types->struct_count + 1, 1);
+
+    if (!s->emitted || !s->label_used || !s->struct_done)
+    {
+        fprintf(stderr, "Fatal: failed to allocate C back end state\n");
+        exit(1);
+    }
+
+    cg_puts(s, "/* generated from K; K integers wrap, so build with -fwrapv */\n\n"
+               "#ifdef __GNUC__\n"
+               "#define KOM_DATA __attribute__((section(\"kom_data\")))\n"
+               "#define KOM_WEAK __attribute__((weak))\n"
+               "#else\n"
+               "#define KOM_DATA\n"
+               "#define KOM_WEAK\n"
+               "#endif\n\n");
+
+    //every struct is named up front so pointers to it work in any order
+    for (int i = 0; i < types->struct_count; i++)
+    {
+        cg_puts(s, "struct ");
+        cg_name(s, types->structs[i].name);
+        cg_puts(s, ";\n");
+    }
+
+    if (types->struct_count > 0)
+        cg_putc(s, '\n');
+
+    for (int item = root_list; item != AST_NULL; item = node_at(s, item)->next)
+    {
+        const AstNode *n = node_at(s, item);
+
+        if (n->kind == AST_STRUCT_DECL && (n->flags & AST_FLAG_TYPEDEF))
+        {
+            cg_puts(s, "typedef struct ");
+            cg_node_name(s, item);
+            cg_putc(s, ' ');
+            cg_node_name(s, item);
+            cg_puts(s, ";\n\n");
+        }
+        else if (n->kind == AST_ENUM_DECL)
+        {
+            cg_enum(s, item);
+        }
+    }
+
+    for (int item = root_list; item != AST_NULL; item = node_at(s, item)->next)
+    {
+        const AstNode *n = node_at(s, item);
+
+        if (n->kind == AST_STRUCT_DECL && n->aux >= 0)
+            ensure_struct(s, n->aux);
+        else if (n->kind == AST_TYPEDEF)
+            ensure_typedef(s, item);
+    }
+
+    //prototypes first: K functions may call each other in any order
+    for (int item = root_list; item != AST_NULL; item = node_at(s, item)->next)
+    {
+        if (node_at(s, item)->kind == AST_FUNCTION)
+        {
+            cg_prototype(s, item);
+            cg_puts(s, ";\n");
+        }
+    }
+
+    cg_putc(s, '\n');
+
+    for (int item = root_list; item != AST_NULL; item = node_at(s, item)->next)
+    {
+        if (node_at(s, item)->kind == AST_VAR_DECL)
+        {
+            cg_var_decl(s, item, 1);
+            cg_puts(s, ";\n");
+            globals++;
+        }
+    }
+
+    if (globals > 0)
+        cg_putc(s, '\n');
+
+    for (int item = root_list; item != AST_NULL; item = node_at(s, item)->next)
+    {
+        if (node_at(s, item)->kind == AST_FUNCTION && node_at(s, item)->kid[1] != AST_NULL)
+            cg_function(s, item);
+    }
+
+    entry = find_entry(s);
+
+    if (entry != AST_NULL)
+    {
+        int ret = node_at(s, entry)->type;
+
+        cg_puts(s, "KOM_WEAK int main(void)\n{\n");
+
+        if (type_at(s, ret)->kind == TY_VOID)
+            cg_puts(s, "    ENTRE();\n    return 0;\n");
+        else if (is_integral(s, ret) && type_at(s, ret)->size <= 4)
+            cg_puts(s, "    return ENTRE();\n");
+        else
+            cg_puts(s, "    return (int)ENTRE();\n");
+
+        cg_puts(s, "}\n");
+    }
+
+    failed = fwrite(s->buf, 1, s->length, out) != s->length;
+
+    free(s->buf);
+    free(s->emitted);
+    free(s->label_used);
+    free(s->struct_done);
+
+    return failed;
+}
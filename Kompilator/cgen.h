@@ -0,0 +1,41 @@
+#ifndef CGEN_H
+#define CGEN_H
+
+#include <stdio.h>
+
+#include "ast.h"
+#include "types.h"
+#include "sema.h"
+
+/* ---------------------------------------------
+   C back end
+
+   Turns the checked tree into C99 that any C
+   compiler builds: HEL -> int, FLYT -> float,
+   BOK -> char, PEK -> *, STRUKTUR -> struct,
+   ENUM -> enum, VÄXEL -> switch, GÅ TILL ->
+   goto. Conversions C would only warn about
+   (integer <-> pointer, unrelated pointers) get
+   explicit casts, struct literals use designated
+   initializers so the field order of the chosen
+   struct layout does not matter, and names with
+   Å / Ä / Ö are spelled _uXX like the assembler
+   symbols of the x86 back end.
+
+   K integers wrap on overflow; build with
+   -fwrapv to keep that guarantee under -O2.
+   A weak main that calls ENTRE is appended, so
+   the file links into a program on its own;
+   globals and STATISK locals sit in section
+   kom_data, bounded by __start_kom_data and
+   __stop_kom_data, as the data image between
+   __kom_data_begin / _end is in the assembly.
+
+   The whole file is formatted into one memory
+   buffer and written with a single fwrite.
+--------------------------------------------- */
+
+// returns 0, or 1 if the output could not be written
+int emit_c(const Ast *ast, const TypeTable *types, const SemState *sema, FILE *out);
+
+#endif /* CGEN_H */
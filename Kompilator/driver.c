@@ -0,0 +1,1334 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include "helper.h"
+#include "lexer.h"
+#include "parser.h"
+#include "utf_decoder.h"
+#include "tokenkeytab.h"
+#include "ast.h"
+#include "types.h"
+#include "sema.h"
+#include "ir.h"
+#include "lower.h"
+#include "opt.h"
+#include "bytecode.h"
+#include "vm.h"
+#include "x86.h"
+#include "cgen.h"
+#include "cache.h"
+#include "timing.h"
+#include "trace.h"
+#include "astbin.h"
+#include "object.h"
+#include "link.h"
+#include "pool.h"
+#include "driver.h"
+
+double elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+char *replace_extension(const char *filename, const char *ext)
+{
+    size_t len = strlen(filename);
+
+    len -= (len >= 5 && strcmp(filename + len - 5, ".kast") == 0) ? 5 : 2;
+
+    char *path = malloc(len + strlen(ext) + 1);
+
+    if (!path)
+    {
+        fprintf(stderr, "Fatal: failed to allocate output path\n");
+        exit(1);
+    }
+
+    memcpy(path, filename, len);
+    strcpy(path + len, ext);
+
+    return path;
+}
+
+extern char **environ;
+
+//runs $CC (split on blanks, no shell) to assemble and link asm_path into target; 0 if it succeeded
+static int link_native(const char *asm_path, const char *target, FILE *err)
+{
+    const char *cc = getenv("CC") && *getenv("CC") ? getenv("CC") : "cc";
+    char *words = strdup(cc);
+    char **argv = calloc(strlen(cc) / 2 + 5, sizeof(char *));
+    int argc = 0;
+    char *rest;
+    int status;
+    pid_t pid;
+
+    if (!words || !argv)
+    {
+        fprintf(stderr, "Fatal: failed to allocate link command\n");
+        exit(1);
+    }
+
+    //batch workers may link at the same time, so the split keeps its place in rest
+    for (char *word = strtok_r(words, " \t", &rest); word; word = strtok_r(NULL, " \t", &rest))
+        argv[argc++] = word;
+
+    argv[argc++] = "-o";
+    argv[argc++] = (char *)target;
+    argv[argc++] = (char *)asm_path;
+    argv[argc] = NULL;
+
+    status = posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ);
+
+    if (status != 0)
+    {
+        fprintf(err, "Error: Could not run %s: %s\n", argv[0], strerror(status));
+        status = 1;
+    }
+    else if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        fprintf(err, "Error: assembling or linking %s failed\n", target);
+        status = 1;
+    }
+
+    free(words);
+    free(argv);
+
+    return status;
+}
+
+//writes x86-64 assembly, and for exe assembles it from a temporary file and links it with the system C compiler
+static int emit_native(const IrModule *module, const X86Options *options, const char *filename, const char *kind,
+                       const char *output, FILE *out, FILE *err)
+{
+    int is_exe = (strcmp(kind, "exe") == 0);
+    char *target = output ? strdup(output) : replace_extension(filename, is_exe ? "" : ".s");
+    const char *tmp = getenv("TMPDIR") && *getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    size_t asm_size = is_exe ? strlen(tmp) + sizeof("/kom-XXXXXX.s") : 0;
+    char *asm_path = is_exe ? malloc(asm_size) : strdup(target ? target : "");
+    FILE *file = NULL;
+    int failed;
+
+    if (!target || !asm_path)
+    {
+        fprintf(stderr, "Fatal: failed to allocate output path\n");
+        exit(1);
+    }
+
+    if (is_exe)
+    {
+        int fd = -1;
+
+        if (snprintf(asm_path, asm_size, "%s/kom-XXXXXX.s", tmp) == (int)asm_size - 1)
+            fd = mkstemps(asm_path, 2);
+
+        if (fd >= 0)
+            file = fdopen(fd, "w");
+
+        if (fd >= 0 && !file)
+        {
+            close(fd);
+            unlink(asm_path);
+        }
+    }
+    else
+    {
+        file = fopen(asm_path, "w");
+    }
+
+    if (!file)
+    {
+        fprintf(err, "Error: Could not write %s\n", asm_path);
+        free(target);
+        free(asm_path);
+        return 1;
+    }
+
+    failed = emit_x86(module, options, file);
+    failed |= fclose(file) != 0;
+
+    if (!failed && is_exe)
+        failed = link_native(asm_path, target, err);
+
+    //the assembly of an executable is only a step on the way
+    if (is_exe)
+        unlink(asm_path);
+
+    if (!failed)
+        fprintf(out, "Wrote %s\n", target);
+
+    free(target);
+    free(asm_path);
+
+    return failed;
+}
+
+//writes the checked program as C source
+static int emit_c_source(const Ast *ast, const TypeTable *types, const SemState *sema, const char *filename, const char *output,
+                         FILE *out, FILE *err)
+{
+    char *target = output ? strdup(output) : replace_extension(filename, ".c");
+    FILE *file;
+    int failed;
+
+    if (!target)
+    {
+        fprintf(stderr, "Fatal: failed to allocate output path\n");
+        exit(1);
+    }
+
+    file = fopen(target, "w");
+
+    if (!file)
+    {
+        fprintf(err, "Error: Could not write %s\n", target);
+        free(target);
+        return 1;
+    }
+
+    failed = emit_c(ast, types, sema, file);
+    failed |= fclose(file) != 0;
+
+    if (failed)
+        fprintf(err, "Error: Could not write %s\n", target);
+    else
+        fprintf(out, "Wrote %s\n", target);
+
+    free(target);
+
+    return failed;
+}
+
+//runs ENTRE repeat times from a fresh data segment, reports the result and the time per run
+//writes the parser's tree as a .kast file (astbin.h)
+static int emit_ast_file(const Ast *ast, const char *filename, const char *output, FILE *out, FILE *err)
+{
+    char *target = output ? strdup(output) : replace_extension(filename, ".kast");
+    FILE *file;
+    int failed;
+
+    if (!target)
+    {
+        fprintf(stderr, "Fatal: failed to allocate output path\n");
+        exit(1);
+    }
+
+    file = fopen(target, "wb");
+
+    if (!file)
+    {
+        fprintf(err, "Error: Could not write %s\n", target);
+        free(target);
+        return 1;
+    }
+
+    failed = write_ast_bin(ast, file);
+    failed |= fclose(file) != 0;
+
+    if (failed)
+        fprintf(err, "Error: Could not write %s\n", target);
+    else
+        fprintf(out, "Wrote %s\n", target);
+
+    free(target);
+
+    return failed;
+}
+
+//writes a module's bytecode as an object file (object.h)
+static int emit_object_file(const ObjModule *obj, const char *filename, const char *output, FILE *out, FILE *err)
+{
+    char *target = output ? strdup(output) : replace_extension(filename, ".kobj");
+    FILE *file;
+    int failed;
+
+    if (!target)
+    {
+        fprintf(stderr, "Fatal: failed to allocate output path\n");
+        exit(1);
+    }
+
+    file = fopen(target, "wb");
+
+    if (!file)
+    {
+        fprintf(err, "Error: Could not write %s\n", target);
+        free(target);
+        return 1;
+    }
+
+    failed = write_object(obj, file);
+    failed |= fclose(file) != 0;
+
+    if (failed)
+        fprintf(err, "Error: Could not write %s\n", target);
+    else
+        fprintf(out, "Wrote %s\n", target);
+
+    free(target);
+
+    return failed;
+}
+
+static int run_bytecode(const VmProgram *program, long repeat, int use_jit, FILE *out)
+{
+    VmState vm;
+    long long result = 0;
+    double total_ns = 0;
+    int failed = 0;
+
+    vm_init(&vm, program);
+    vm.out = out;
+
+    if (!use_jit)
+        vm.jit_threshold = 0;
+
+    for (long r = 0; r < repeat && !failed; r++)
+    {
+        struct timespec start, end;
+
+        vm_reset(&vm);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        failed = vm_run(&vm, &result);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        total_ns += elapsed_ns(&start, &end);
+    }
+
+    if (!failed)
+    {
+        fprintf(out, "ENTRE returned %lld\n", result);
+
+        if (repeat > 1)
+            fprintf(out, "Run time: %.0f ns per run over %ld runs\n", total_ns / repeat, repeat);
+
+        if (vm.native_count > 0)
+            fprintf(out, "JIT compiled %d function(s)\n", vm.native_count);
+    }
+
+    free_vm(&vm);
+
+    return failed;
+}
+
+void init_compile_options(CompileOptions *opts)
+{
+    memset(opts, 0, sizeof(*opts));
+
+    opts->layout_mode  = LAYOUT_NATURAL;
+    opts->listing      = 1;
+    opts->repeat       = 1;
+    opts->use_jit      = 1;
+    opts->optimise     = 1;
+    opts->tail_calls   = 1;
+    opts->inline_calls = 1;
+    opts->loop_opt     = 1;
+    opts->vectorise    = 1;
+    opts->vector_bytes = 16;
+    opts->regalloc     = 1;
+    opts->peephole     = 1;
+}
+
+//applies one command-line option to opts; 1 if it was one, 0 if not, -1 after an error
+int parse_compile_option(const char *arg, CompileOptions *opts, FILE *err)
+{
+    if (strncmp(arg, "--struct-layout=", 16) == 0)
+    {
+        if (parse_layout_mode(arg + 16, &opts->layout_mode) != 0)
+        {
+            fprintf(err, "Error: --struct-layout must be natural, packed or reorder\n");
+            return -1;
+        }
+    }
+    else if (strcmp(arg, "--dump-layout") == 0)
+    {
+        opts->dump_layout = 1;
+    }
+    else if (strcmp(arg, "--dump-ast") == 0)
+    {
+        opts->dump_tree = 1;
+    }
+    else if (strcmp(arg, "--dump-ir") == 0)
+    {
+        opts->dump_ir = 1;
+    }
+    else if (strcmp(arg, "--dump-bytecode") == 0)
+    {
+        opts->dump_code = 1;
+    }
+    else if (strncmp(arg, "--emit=", 7) == 0)
+    {
+        opts->emit_kind = arg + 7;
+
+        if (strcmp(opts->emit_kind, "asm") != 0 && strcmp(opts->emit_kind, "exe") != 0 && strcmp(opts->emit_kind, "c") != 0 &&
+            strcmp(opts->emit_kind, "ast-bin") != 0 && strcmp(opts->emit_kind, "obj") != 0)
+        {
+            fprintf(err, "Error: --emit must be asm, exe, c, ast-bin or obj\n");
+            return -1;
+        }
+    }
+    else if (strncmp(arg, "--output=", 9) == 0)
+    {
+        opts->output = arg + 9;
+    }
+    else if (strcmp(arg, "--run") == 0)
+    {
+        opts->run_program = 1;
+    }
+    else if (strncmp(arg, "--repeat=", 9) == 0)
+    {
+        char *end;
+
+        opts->repeat = strtol(arg + 9, &end, 10);
+
+        if (*end != '\0' || opts->repeat < 1)
+        {
+            fprintf(err, "Error: --repeat must be a positive number\n");
+            return -1;
+        }
+
+        opts->run_program = 1;
+    }
+    else if (strcmp(arg, "--no-jit") == 0)
+    {
+        opts->use_jit = 0;
+    }
+    else if (strcmp(arg, "--no-opt") == 0)
+    {
+        opts->optimise = 0;
+    }
+    else if (strcmp(arg, "--no-tail-calls") == 0)
+    {
+        opts->tail_calls = 0;
+    }
+    else if (strcmp(arg, "--no-inline") == 0)
+    {
+        opts->inline_calls = 0;
+    }
+    else if (strcmp(arg, "--no-loop-opt") == 0)
+    {
+        opts->loop_opt = 0;
+    }
+    else if (strcmp(arg, "--no-vectorise") == 0)
+    {
+        opts->vectorise = 0;
+    }
+    else if (strcmp(arg, "--avx2") == 0)
+    {
+        opts->vector_bytes = 32;
+    }
+    else if (strcmp(arg, "--opt-report") == 0)
+    {
+        opts->opt_report = 1;
+    }
+    else if (strcmp(arg, "--no-regalloc") == 0)
+    {
+        opts->regalloc = 0;
+    }
+    else if (strcmp(arg, "--ra-report") == 0)
+    {
+        opts->ra_report = 1;
+    }
+    else if (strcmp(arg, "--no-peephole") == 0)
+    {
+        opts->peephole = 0;
+    }
+    else if (strcmp(arg, "--time-report") == 0 || strcmp(arg, "--time-report=text") == 0)
+    {
+        opts->time_report = TIME_REPORT_TEXT;
+    }
+    else if (strcmp(arg, "--time-report=json") == 0)
+    {
+        opts->time_report = TIME_REPORT_JSON;
+    }
+    else if (strncmp(arg, "--time-report=", 14) == 0)
+    {
+        fprintf(err, "Error: --time-report must be text or json\n");
+        return -1;
+    }
+    else if (strcmp(arg, "--trace-events") == 0)
+    {
+        opts->trace_events = "";
+    }
+    else if (strncmp(arg, "--trace-events=", 15) == 0 && arg[15] != '\0')
+    {
+        opts->trace_events = arg + 15;
+    }
+    else
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+int compile_options_print(const CompileOptions *opts)
+{
+    return opts->dump_layout || opts->dump_tree || opts->dump_ir || opts->dump_code ||
+           opts->opt_report || opts->ra_report;
+}
+
+static int compile_text(const char *filename, const char *source, const CompileOptions *opts,
+                        FILE *out, FILE *err, FILE *artifact, FileResult *result, TimeReport *timing);
+
+//a report when --time-report or --trace-events asks for one, with the trace log attached for the latter
+static TimeReport *start_timing(const CompileOptions *opts, TimeReport *report, TraceLog *events)
+{
+    if (!opts->time_report && !opts->trace_events)
+        return NULL;
+
+    time_report_init(report);
+
+    if (opts->trace_events)
+    {
+        trace_log_init(events);
+        report->trace = events;
+    }
+
+    return report;
+}
+
+//writes the trace of a finished compile to the path given, or next to the source
+static int finish_timing(const char *filename, const CompileOptions *opts, TimeReport *timing, FILE *out, FILE *err)
+{
+    char *target;
+    int failed;
+
+    if (!timing || !timing->trace)
+        return 0;
+
+    target = *opts->trace_events ? strdup(opts->trace_events) : replace_extension(filename, ".trace.json");
+
+    if (!target)
+    {
+        fprintf(stderr, "Fatal: failed to allocate output path\n");
+        exit(1);
+    }
+
+    failed = write_trace_log(timing->trace, target, filename, err);
+
+    if (!failed)
+        fprintf(out, "Wrote %s\n", target);
+
+    free(target);
+    trace_log_free(timing->trace);
+
+    return failed;
+}
+
+static int compile_loaded(const char *filename, const CompileOptions *opts, FILE *out, FILE *err,
+                          FileResult *result, TimeReport *timing);
+
+int compile_file(const char *filename, const CompileOptions *opts, FILE *out, FILE *err, FileResult *result)
+{
+    size_t len = strlen(filename);
+
+    //a saved tree skips the front end, and the cache, which is keyed on source text
+    if (len >= 5 && strcmp(filename + len - 5, ".kast") == 0)
+    {
+        TimeReport report;
+        TraceLog events;
+        TimeReport *timing = start_timing(opts, &report, &events);
+        int failed = compile_loaded(filename, opts, out, err, result, timing);
+
+        return failed | finish_timing(filename, opts, timing, out, err);
+    }
+
+    if (len < 2 || filename[len - 2] != '.' || filename[len - 1] != 'k')
+    {
+        fprintf(err, "Error: %s: File must end with .k or .kast extension\n", filename);
+        result->unread = 1;
+        return 1;
+    }
+
+    TimeReport report;
+    TraceLog events;
+    TimeReport *timing = start_timing(opts, &report, &events);
+
+    phase_begin(timing);
+
+    FILE *file = fopen(filename, "r");
+    if (!file)
+    {
+        fprintf(err, "Error: Could not open %s\n", filename);
+        result->unread = 1;
+
+        if (timing && timing->trace)
+            trace_log_free(timing->trace);
+
+        return 1;
+    }
+
+    char *char_buffer = reader(file);
+    fclose(file);
+
+    if (!char_buffer)
+    {
+        fprintf(err, "Error: Failed to read %s\n", filename);
+        result->unread = 1;
+
+        if (timing && timing->trace)
+            trace_log_free(timing->trace);
+
+        return 1;
+    }
+
+    phase_end(timing, PHASE_READ, (long)strlen(char_buffer));
+
+    int failed = compile_text(filename, char_buffer, opts, out, err, NULL, result, timing);
+
+    failed |= finish_timing(filename, opts, timing, out, err);
+
+    free(char_buffer);
+
+    return failed;
+}
+
+int write_artifact(const char *filename, const char *kind, const char *output, const char *text, size_t size,
+                   FILE *out, FILE *err)
+{
+    const char *ext = strcmp(kind, "c") == 0 ? ".c" : strcmp(kind, "ast-bin") == 0 ? ".kast" :
+                      strcmp(kind, "obj") == 0 ? ".kobj" : ".s";
+    char *target = output ? strdup(output) : replace_extension(filename, ext);
+    FILE *file;
+    int failed;
+
+    if (!target)
+    {
+        fprintf(stderr, "Fatal: failed to allocate output path\n");
+        exit(1);
+    }
+
+    file = fopen(target, "wb");
+    failed = !file || fwrite(text, 1, size, file) != size;
+    failed |= file && fclose(file) != 0;
+
+    if (failed)
+        fprintf(err, "Error: Could not write %s\n", target);
+    else
+        fprintf(out, "Wrote %s\n", target);
+
+    free(target);
+
+    return failed;
+}
+
+static FILE *open_capture(char **text, size_t *size)
+{
+    FILE *f = open_memstream(text, size);
+
+    if (!f)
+    {
+        fprintf(stderr, "Fatal: failed to allocate compile output buffer\n");
+        exit(1);
+    }
+
+    return f;
+}
+
+//what a replayed compile cannot reproduce: direct prints, a linked executable, run and phase timings
+static int cacheable(const CompileOptions *opts)
+{
+    return !compile_options_print(opts) && opts->repeat == 1 && !opts->time_report && !opts->trace_events &&
+           !(opts->emit_kind && strcmp(opts->emit_kind, "exe") == 0);
+}
+
+//the build and every option that changes what a compile prints or produces; paths and the cache do not
+static void cache_key_of(const char *source, const CompileOptions *opts, CacheKey *key)
+{
+    char text[256];
+    size_t size = strlen(source);
+    int len = snprintf(text, sizeof(text), "kom %s %s|%d %d %d %d %d %d %d %d %d %d %d|%s",
+                       __DATE__, __TIME__, (int)opts->layout_mode, opts->listing, opts->run_program,
+                       opts->use_jit, opts->optimise, opts->tail_calls, opts->inline_calls, opts->loop_opt,
+                       opts->vectorise ? opts->vector_bytes : 0, opts->regalloc, opts->peephole,
+                       opts->emit_kind ? opts->emit_kind : "-");
+    uint64_t seed = xxh64(text, len, 0);
+
+    key->hi = xxh64(source, size, seed);
+    key->lo = xxh64(source, size, ~seed);
+}
+
+static int compile_uncached(const char *filename, const char *char_buffer, const CompileOptions *opts,
+                            FILE *out, FILE *err, FILE *artifact, FileResult *result, TimeReport *timing);
+
+//replays a cached compile, or compiles into memory and stores it first; artifacts are written out here
+static int compile_cached(const char *filename, const char *source, const CompileOptions *opts,
+                          FILE *out, FILE *err, FILE *artifact, FileResult *result)
+{
+    CacheKey key;
+    CacheEntry entry;
+    int failed;
+
+    cache_key_of(source, opts, &key);
+
+    if (cache_load(opts->cache, &key, &entry))
+    {
+        result->unread       = entry.counts[0];
+        result->token_count  = entry.counts[1];
+        result->parse_errors = entry.counts[2];
+        result->sema_errors  = entry.counts[3];
+        result->ir_errors    = entry.counts[4];
+        result->run_errors   = entry.counts[5];
+    }
+    else
+    {
+        FILE *out_f = open_capture(&entry.out, &entry.out_size);
+        FILE *err_f = open_capture(&entry.err, &entry.err_size);
+        FILE *artifact_f = open_capture(&entry.artifact, &entry.artifact_size);
+
+        entry.status = compile_uncached(filename, source, opts, out_f, err_f,
+                                        opts->emit_kind ? artifact_f : NULL, result, NULL);
+
+        fclose(out_f);
+        fclose(err_f);
+        fclose(artifact_f);
+
+        entry.counts[0] = result->unread;
+        entry.counts[1] = result->token_count;
+        entry.counts[2] = result->parse_errors;
+        entry.counts[3] = result->sema_errors;
+        entry.counts[4] = result->ir_errors;
+        entry.counts[5] = result->run_errors;
+
+        cache_store(opts->cache, &key, &entry);
+    }
+
+    fwrite(entry.out, 1, entry.out_size, out);
+    fwrite(entry.err, 1, entry.err_size, err);
+    failed = entry.status;
+
+    if (artifact)
+        fwrite(entry.artifact, 1, entry.artifact_size, artifact);
+    else if (entry.artifact_size > 0)
+        failed |= write_artifact(filename, opts->emit_kind, opts->output, entry.artifact, entry.artifact_size, out, err);
+
+    //a hit owns one block; a fresh compile owns its three capture buffers
+    if (entry.data)
+    {
+        cache_free_entry(&entry);
+    }
+    else
+    {
+        free(entry.out);
+        free(entry.err);
+        free(entry.artifact);
+    }
+
+    return failed;
+}
+
+//timing is NULL without --time-report or --trace-events, else it already holds the read phase when there was one
+static int compile_text(const char *filename, const char *source, const CompileOptions *opts,
+                        FILE *out, FILE *err, FILE *artifact, FileResult *result, TimeReport *timing)
+{
+    if (opts->cache && cacheable(opts))
+        return compile_cached(filename, source, opts, out, err, artifact, result);
+
+    return compile_uncached(filename, source, opts, out, err, artifact, result, timing);
+}
+
+int compile_source(const char *filename, const char *source, const CompileOptions *opts,
+                   FILE *out, FILE *err, FILE *artifact, FileResult *result)
+{
+    TimeReport report;
+    TraceLog events;
+    TimeReport *timing = start_timing(opts, &report, &events);
+    int failed = compile_text(filename, source, opts, out, err, artifact, result, timing);
+
+    return failed | finish_timing(filename, opts, timing, out, err);
+}
+
+//instructions reachable through the block lists; the arena also holds ones passes have unlinked
+static long ir_instruction_count(const IrModule *module)
+{
+    long count = 0;
+
+    for (int f = 0; f < module->func_count; f++)
+    {
+        const IrFunc *func = &module->funcs[f];
+
+        for (int b = 0; b < func->block_count; b++)
+        {
+            for (int i = func->blocks[b].first; i != IR_NONE; i = func->instrs[i].next)
+                count++;
+        }
+    }
+
+    return count;
+}
+
+//asm and exe go through the x86 back end; c and ast-bin are written earlier, obj with the bytecode
+static int emits_native(const CompileOptions *opts)
+{
+    return opts->emit_kind && (strcmp(opts->emit_kind, "asm") == 0 || strcmp(opts->emit_kind, "exe") == 0);
+}
+
+//semantic analysis onwards, for a tree from the parser or from a .kast file; fills in result's later counts
+static void compile_tree(const char *filename, Ast *ast, const CompileOptions *opts,
+                         FILE *out, FILE *err, FILE *artifact, FileResult *result, TimeReport *timing)
+{
+    TypeTable types;
+    SemState sem_state;
+    int sema_error_count = 0;
+    int ir_error_count = 0;
+    int run_error_count = 0;
+    int tree_error_count = 0;
+
+    init_type_table(&types, opts->layout_mode);
+
+    /* -----------------------------
+       Tree image, as the parser left it
+       ----------------------------- */
+
+    if (opts->emit_kind && strcmp(opts->emit_kind, "ast-bin") == 0)
+    {
+        if (artifact)
+            tree_error_count = write_ast_bin(ast, artifact);
+        else
+            tree_error_count = emit_ast_file(ast, filename, opts->output, out, err);
+    }
+
+    /* -----------------------------
+       Semantic analysis
+       ----------------------------- */
+
+    phase_begin(timing);
+    sema(ast, &types, out, &sem_state, &sema_error_count);
+    phase_end(timing, PHASE_SEMA, ast->node_count);
+
+    if (opts->listing)
+        fprintf(out, "Semantic analysis finished with %d error(s)\n", sema_error_count);
+
+    if (opts->dump_layout)
+        dump_struct_layouts(&types);
+
+    if (opts->dump_tree)
+        dump_ast(ast, ast->root, 0);
+
+    /* -----------------------------
+       C source
+       ----------------------------- */
+
+    if (sema_error_count == 0 && opts->emit_kind && strcmp(opts->emit_kind, "c") == 0)
+    {
+        phase_begin(timing);
+
+        if (artifact)
+            ir_error_count += emit_c(ast, &types, &sem_state, artifact);
+        else
+            ir_error_count += emit_c_source(ast, &types, &sem_state, filename, opts->output, out, err);
+
+        phase_end(timing, PHASE_EMIT_C, ast->node_count);
+    }
+
+    /* -----------------------------
+       Lowering to IR
+       ----------------------------- */
+
+    if (sema_error_count == 0)
+    {
+        IrModule module;
+
+        phase_begin(timing);
+        lower(ast, &types, &sem_state, &module);
+        phase_end(timing, PHASE_LOWER, timing ? ir_instruction_count(&module) : 0);
+
+        phase_begin(timing);
+        ir_error_count = ir_verify_module(&module);
+        phase_end(timing, PHASE_VERIFY, timing ? ir_instruction_count(&module) : 0);
+
+        if (opts->listing)
+            fprintf(out, "IR verification finished with %d error(s)\n", ir_error_count);
+
+        /* -----------------------------
+           IR clean-up
+           ----------------------------- */
+
+        if (ir_error_count == 0 && opts->optimise)
+        {
+            phase_begin(timing);
+
+            OptStats *stats = calloc(module.func_count + 1, sizeof(OptStats));
+
+            if (!stats)
+            {
+                fprintf(stderr, "Fatal: failed to allocate optimisation stats\n");
+                exit(1);
+            }
+
+            OptOptions options;
+
+            options.tail_calls   = opts->tail_calls;
+            options.inline_calls = opts->inline_calls;
+            options.loops        = opts->loop_opt;
+            options.vector_bytes = opts->vector_bytes;
+            options.report       = opts->opt_report;
+
+            //vector instructions only exist natively, so code for the VM stays scalar
+            if (!opts->vectorise || !emits_native(opts) || opts->dump_code || opts->run_program)
+                options.vector_bytes = 0;
+
+            optimise_module(&module, &options, stats);
+
+            if (opts->opt_report)
+                print_opt_report(&module, stats);
+
+            free(stats);
+
+            //a pass that breaks SSA must not reach the back ends
+            ir_error_count = ir_verify_module(&module);
+
+            phase_end(timing, PHASE_OPTIMISE, timing ? ir_instruction_count(&module) : 0);
+        }
+
+        if (opts->dump_ir)
+            dump_ir_module(&module);
+
+        /* -----------------------------
+           Native code
+           ----------------------------- */
+
+        if (ir_error_count == 0 && emits_native(opts))
+        {
+            X86Options native;
+
+            native.allocate = opts->regalloc;
+            native.report   = opts->ra_report;
+            native.peephole = opts->peephole;
+
+            phase_begin(timing);
+
+            if (artifact)
+                ir_error_count += emit_x86(&module, &native, artifact);
+            else
+                ir_error_count += emit_native(&module, &native, filename, opts->emit_kind, opts->output, out, err);
+
+            phase_end(timing, PHASE_EMIT_X86, timing ? ir_instruction_count(&module) : 0);
+        }
+
+        /* -----------------------------
+           Bytecode and execution
+           ----------------------------- */
+
+        int emits_object = opts->emit_kind && strcmp(opts->emit_kind, "obj") == 0;
+
+        if (ir_error_count == 0 && (opts->dump_code || opts->run_program || emits_object))
+        {
+            VmProgram program;
+
+            phase_begin(timing);
+            ir_error_count += compile_bytecode(&module, opts->tail_calls, opts->peephole, &program);
+            phase_end(timing, PHASE_BYTECODE, program.code_count);
+
+            if (opts->dump_code)
+                dump_bytecode(&program);
+
+            if (emits_object && ir_error_count == 0)
+            {
+                ObjModule obj;
+
+                build_object(&module, &program, &obj);
+
+                if (artifact)
+                    ir_error_count += write_object(&obj, artifact);
+                else
+                    ir_error_count += emit_object_file(&obj, filename, opts->output, out, err);
+
+                free_object(&obj);
+            }
+
+            if (opts->run_program && ir_error_count == 0)
+            {
+                phase_begin(timing);
+                run_error_count = run_bytecode(&program, opts->repeat, opts->use_jit, out);
+                phase_end(timing, PHASE_RUN, opts->repeat);
+            }
+
+            free_bytecode(&program);
+        }
+
+        free_ir_module(&module);
+    }
+
+    free_sema(&sem_state);
+
+    free_type_table(&types);
+
+    result->sema_errors = sema_error_count;
+    result->ir_errors   = ir_error_count + tree_error_count;
+    result->run_errors  = run_error_count;
+}
+
+static int compile_uncached(const char *filename, const char *char_buffer, const CompileOptions *opts,
+                            FILE *out, FILE *err, FILE *artifact, FileResult *result, TimeReport *timing)
+{
+    if (opts->listing)
+        fprintf(out, "%s\n", char_buffer);
+
+    int char_count = 0;
+
+    phase_begin(timing);
+    CharacterUnit *decode_buffer = decode_utf8(char_buffer, &char_count);
+    phase_end(timing, PHASE_DECODE, char_count);
+
+    /* -----------------------------
+       Outputs from lexer
+       ----------------------------- */
+
+    TokenBuffer *token_buffer = NULL;
+    int token_count = 0;
+
+    char **lexemes = NULL;
+    int lexeme_count = 0;
+    int *lexeme_row = NULL;
+    int *lexeme_col = NULL;
+
+    /* -----------------------------
+       Run lexer
+       ----------------------------- */
+
+    lexer(
+        decode_buffer,
+        char_count,
+
+        &token_buffer,
+        &token_count,
+
+        &lexemes,
+        &lexeme_count,
+        &lexeme_row,
+        &lexeme_col,
+
+        timing
+    );
+
+
+    for (int i = 0; opts->listing && i < lexeme_count; i++)
+    {
+        //fprintf(out, "This breaks dont it\n");
+        fprintf(out, "Lexeme %d: %s \n", i, lexemes[i]);
+    }
+
+ /*
+    for (int i = 0; i < token_count; i++)
+    {
+        fprintf(out, "Token %d: %s\n", i, tok2name(token_buffer[i].token));
+    }
+
+    */
+
+    int parse_error_count = 0;
+    Ast ast;
+
+    phase_begin(timing);
+    parser(
+        token_buffer,
+        token_count,
+        lexemes,
+        opts->listing,
+        timing ? timing->trace : NULL,
+        out,
+        &ast,
+        &parse_error_count
+    );
+    phase_end(timing, PHASE_PARSE, ast.node_count);
+
+    if (opts->listing)
+        fprintf(out, "\nParser finished with %d error(s)\n", parse_error_count);
+
+    if (parse_error_count == 0)
+        compile_tree(filename, &ast, opts, out, err, artifact, result, timing);
+
+    free_ast(&ast);
+
+
+    /* -----------------------------
+       Cleanup
+       ----------------------------- */
+
+    for (int i = 0; i < lexeme_count; i++)
+    {
+        free(lexemes[i]);
+    }
+
+    free(lexemes);
+    free(lexeme_row);
+    free(lexeme_col);
+
+    free(token_buffer);
+    free(decode_buffer);
+
+    if (timing && opts->time_report)
+        print_time_report(timing, filename, opts->time_report, out);
+
+    result->token_count  = token_count;
+    result->parse_errors = parse_error_count;
+
+    return (parse_error_count + result->sema_errors + result->ir_errors + result->run_errors) > 0;
+}
+
+
+//maps a .kast file and compiles its tree from sema on; the map is the read phase, the node check the parse
+static int compile_loaded(const char *filename, const CompileOptions *opts, FILE *out, FILE *err,
+                          FileResult *result, TimeReport *timing)
+{
+    AstBinFile file;
+    Ast ast;
+
+    //the tree is read from the mapped file as it is compiled, so it cannot be rewritten meanwhile
+    if (opts->emit_kind && strcmp(opts->emit_kind, "ast-bin") == 0 && (!opts->output || strcmp(opts->output, filename) == 0))
+    {
+        fprintf(err, "Error: %s: --emit=ast-bin of a .kast file needs a different --output\n", filename);
+        result->unread = 1;
+        return 1;
+    }
+
+    phase_begin(timing);
+
+    if (load_ast_bin(filename, &ast, &file, err) != 0)
+    {
+        result->unread = 1;
+        return 1;
+    }
+
+    phase_end(timing, PHASE_READ, (long)file.size);
+
+    phase_begin(timing);
+
+    if (check_ast_bin(&ast, err) != 0)
+    {
+        result->parse_errors = 1;
+        close_ast_bin(&file);
+        return 1;
+    }
+
+    phase_end(timing, PHASE_PARSE, ast.node_count);
+
+    if (opts->listing)
+        fprintf(out, "Loaded %d node(s) and %d token(s) from %s\n", ast.node_count, ast.token_count, filename);
+
+    compile_tree(filename, &ast, opts, out, err, NULL, result, timing);
+    result->token_count = ast.token_count;
+
+    free_ast(&ast);
+    close_ast_bin(&file);
+
+    if (timing && opts->time_report)
+        print_time_report(timing, filename, opts->time_report, out);
+
+    return (result->sema_errors + result->ir_errors + result->run_errors) > 0;
+}
+
+
+
+/*
+  _      _       _
+ | |    (_)     | |
+ | |     _ _ __ | | __
+ | |    | | '_ \| |/ /
+ | |____| | | | |   <
+ |______|_|_| |_|_|\_\
+
+*/
+
+//one module of a link: an object file, or a source compiled to one in memory
+typedef struct LinkInput {
+    const char *path;
+    char       *image;          // the object a source compiled to
+    size_t      image_size;
+    char       *out_text;       // what loading or compiling it printed
+    size_t      out_size;
+    char       *err_text;
+    size_t      err_size;
+    int         failed;
+    ObjFile     object;
+} LinkInput;
+
+typedef struct LinkJob {
+    LinkInput            *inputs;
+    const CompileOptions *opts;
+} LinkJob;
+
+//compiles a source as --emit=obj would, with nothing printed beyond diagnostics
+static int compile_link_source(LinkInput *in, const CompileOptions *link_opts, FILE *out, FILE *err)
+{
+    CompileOptions opts = *link_opts;
+    FileResult result;
+    FILE *file = fopen(in->path, "r");
+    FILE *artifact;
+    char *source;
+    int failed;
+
+    if (!file)
+    {
+        fprintf(err, "Error: Could not open %s\n", in->path);
+        return 1;
+    }
+
+    source = reader(file);
+    fclose(file);
+
+    if (!source)
+    {
+        fprintf(err, "Error: Failed to read %s\n", in->path);
+        return 1;
+    }
+
+    opts.emit_kind    = "obj";
+    opts.output       = NULL;
+    opts.listing      = 0;
+    opts.dump_layout  = 0;
+    opts.dump_tree    = 0;
+    opts.dump_ir      = 0;
+    opts.dump_code    = 0;
+    opts.run_program  = 0;
+    opts.opt_report   = 0;
+    opts.ra_report    = 0;
+    opts.time_report  = 0;
+    opts.trace_events = NULL;
+
+    memset(&result, 0, sizeof(result));
+
+    artifact = open_capture(&in->image, &in->image_size);
+    failed = compile_source(in->path, source, &opts, out, err, artifact, &result);
+    fclose(artifact);
+
+    free(source);
+
+    return failed || open_object_image(in->path, in->image, in->image_size, &in->object, err);
+}
+
+static void load_link_input(void *context, int index, int worker)
+{
+    LinkJob *job = context;
+    LinkInput *in = &job->inputs[index];
+    size_t len = strlen(in->path);
+    FILE *out = open_capture(&in->out_text, &in->out_size);
+    FILE *err = open_capture(&in->err_text, &in->err_size);
+
+    (void)worker;
+
+    if (len >= 5 && strcmp(in->path + len - 5, ".kobj") == 0)
+    {
+        in->failed = load_object(in->path, &in->object, err);
+    }
+    else if (len >= 2 && strcmp(in->path + len - 2, ".k") == 0)
+    {
+        in->failed = compile_link_source(in, job->opts, out, err);
+    }
+    else
+    {
+        fprintf(err, "Error: %s: File to link must end with .k or .kobj extension\n", in->path);
+        in->failed = 1;
+    }
+
+    fclose(out);
+    fclose(err);
+}
+
+int link_files(const char **paths, int count, int jobs, const CompileOptions *opts, FILE *out, FILE *err)
+{
+    int emits_object = opts->emit_kind && strcmp(opts->emit_kind, "obj") == 0;
+    LinkInput *inputs;
+    ObjFile *objects;
+    LinkJob job;
+    int failed = 0;
+
+    if (opts->emit_kind && !emits_object)
+    {
+        fprintf(err, "Error: --link only emits obj\n");
+        return 1;
+    }
+
+    if (emits_object && !opts->output)
+    {
+        fprintf(err, "Error: --link --emit=obj needs --output\n");
+        return 1;
+    }
+
+    inputs  = calloc(count + 1, sizeof(LinkInput));
+    objects = calloc(count + 1, sizeof(ObjFile));
+
+    if (!inputs || !objects)
+    {
+        fprintf(stderr, "Fatal: failed to allocate link inputs\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < count; i++)
+        inputs[i].path = paths[i];
+
+    //modules load and compile in parallel; what they print comes out in command-line order
+    job.inputs = inputs;
+    job.opts   = opts;
+
+    pool_run(jobs, count, load_link_input, &job);
+
+    for (int i = 0; i < count; i++)
+    {
+        fwrite(inputs[i].out_text, 1, inputs[i].out_size, out);
+        fwrite(inputs[i].err_text, 1, inputs[i].err_size, err);
+
+        failed |= inputs[i].failed;
+        objects[i] = inputs[i].object;
+    }
+
+    if (!failed)
+    {
+        TimeReport report;
+        TraceLog events;
+        TimeReport *timing = start_timing(opts, &report, &events);
+        VmProgram program;
+        ObjModule module;
+
+        phase_begin(timing);
+        failed = link_objects(objects, count, &program, &module, err) != 0;
+        phase_end(timing, PHASE_LINK, module.symbol_count);
+
+        if (!failed && opts->listing)
+            fprintf(out, "Linked %d module(s): %d function(s), %d symbol(s)\n", count, program.func_count,
+                    module.symbol_count);
+
+        if (!failed && emits_object)
+            failed = emit_object_file(&module, paths[count - 1], opts->output, out, err);
+
+        if (!failed && opts->dump_code)
+            dump_bytecode(&program);
+
+        if (!failed && opts->run_program)
+        {
+            phase_begin(timing);
+            failed = run_bytecode(&program, opts->repeat, opts->use_jit, out);
+            phase_end(timing, PHASE_RUN, opts->repeat);
+        }
+
+        //function names point into the module's strings, so the program goes first
+        free_bytecode(&program);
+        free_object(&module);
+
+        if (timing && opts->time_report)
+            print_time_report(timing, "link", opts->time_report, out);
+
+        failed |= finish_timing(paths[count - 1], opts, timing, out, err);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        close_object(&inputs[i].object);
+        free(inputs[i].image);
+        free(inputs[i].out_text);
+        free(inputs[i].err_text);
+    }
+
+    free(inputs);
+    free(objects);
+
+    return failed;
+}
@@ -0,0 +1,101 @@
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include <stdio.h>
+#include <time.h>
+
+#include "types.h"
+#include "cache.h"
+#include "timing.h"
+
+/* ---------------------------------------------
+   Compiler driver
+
+   Runs the whole pipeline on one source:
+   decode, lex, parse, check, lower, optimise,
+   then whatever the options ask for (C or x86
+   output, bytecode, a run on the VM).
+
+   Everything a compile prints goes to the two
+   streams it is given: listings, diagnostics
+   and results to out, failures to reach or
+   write a file to err. Dumps and reports still
+   print to stdout. Every allocation is freed
+   before it returns, so one process can compile
+   any number of sources (main.c --batch,
+   server.c --serve), from several threads at
+   once.
+
+   With a cache (cache.h), a compile whose
+   output can be replayed is looked up first
+   and stored afterwards.
+--------------------------------------------- */
+
+//settings shared by every file of a run
+typedef struct CompileOptions {
+    LayoutMode  layout_mode;
+    int         listing;            // echo source, lexemes, parser trace and phase totals
+    int         dump_layout;
+    int         dump_tree;
+    int         dump_ir;
+    int         dump_code;
+    int         run_program;
+    long        repeat;
+    int         use_jit;
+    int         optimise;
+    int         tail_calls;
+    int         inline_calls;
+    int         loop_opt;
+    int         vectorise;
+    int         vector_bytes;
+    int         opt_report;
+    int         regalloc;
+    int         peephole;
+    int         ra_report;
+    int         time_report;        // 0, TIME_REPORT_TEXT or TIME_REPORT_JSON (timing.h)
+    const char *trace_events;       // trace-event JSON path, "" for next to the source, NULL when off
+    const char *emit_kind;
+    const char *output;
+    CompileCache *cache;            // NULL: every compile runs in full
+} CompileOptions;
+
+//what compiling one file came to
+typedef struct FileResult {
+    int    unread;                  // missing, unreadable or not a .k or .kast file
+    int    token_count;
+    int    parse_errors;
+    int    sema_errors;
+    int    ir_errors;
+    int    run_errors;
+} FileResult;
+
+void init_compile_options(CompileOptions *opts);
+
+// applies one command-line option to opts; 1 if it was one, 0 if not, -1 after an error
+int  parse_compile_option(const char *arg, CompileOptions *opts, FILE *err);
+
+// 1 if opts print anything straight to stdout (dumps and reports)
+int  compile_options_print(const CompileOptions *opts);
+
+// reads filename and compiles it, or for a .kast file (astbin.h) maps it and starts at sema; returns 1 if anything failed
+int  compile_file(const char *filename, const CompileOptions *opts, FILE *out, FILE *err, FileResult *result);
+
+/* compiles NUL-terminated source; name stands in for the file when output paths are made.
+   With artifact set, --emit output is written there instead of to a file (not for exe) */
+int  compile_source(const char *name, const char *source, const CompileOptions *opts,
+                    FILE *out, FILE *err, FILE *artifact, FileResult *result);
+
+/* links .kobj files, and .k files compiled to objects in memory on jobs workers, into one
+   program (link.h), then runs or dumps it or, with --emit=obj, writes it to --output; returns 1 if anything failed */
+int  link_files(const char **paths, int count, int jobs, const CompileOptions *opts, FILE *out, FILE *err);
+
+// writes an --emit artifact to output, or next to filename, and reports it on out
+int  write_artifact(const char *filename, const char *kind, const char *output, const char *text, size_t size,
+                    FILE *out, FILE *err);
+
+// input path with its .k or .kast swapped for ext ("" drops it)
+char *replace_extension(const char *filename, const char *ext);
+
+double elapsed_ns(const struct timespec *start, const struct timespec *end);
+
+#endif /* DRIVER_H */
@@ -0,0 +1,369 @@
+#include <stdlib.h>
+
+#include "fold.h"
+
+static int is_float_type(const TypeTable *tt, int type)
+{
+    return type >= 0 && tt->types[type].kind == TY_FLOAT;
+}
+
+static int is_integer_type(const TypeTable *tt, int type)
+{
+    return type >= 0 && (tt->types[type].kind == TY_INT || tt->types[type].kind == TY_ENUM);
+}
+
+static int is_unsigned_type(const TypeTable *tt, int type)
+{
+    return type >= 0 && tt->types[type].is_unsigned;
+}
+
+//truncates to the width of type, then sign- or zero-extends back to 64 bits
+static long long wrap(const TypeTable *tt, int type, unsigned long long v)
+{
+    int bits = type_size(tt, type) * 8;
+
+    if (bits <= 0 || bits >= 64)
+        return (long long)v;
+
+    v &= (1ULL << bits) - 1;
+
+    if (!is_unsigned_type(tt, type) && (v >> (bits - 1)) & 1)
+        v |= ~((1ULL << bits) - 1);
+
+    return (long long)v;
+}
+
+ConstValue const_convert(const TypeTable *tt, ConstValue value, int type)
+{
+    ConstValue out = { CONST_NONE, 0, 0.0 };
+
+    if (value.kind == CONST_NONE)
+        return out;
+
+    if (is_float_type(tt, type))
+    {
+        double f = (value.kind == CONST_FLOAT) ? value.f : (double)value.i;
+
+        out.kind = CONST_FLOAT;
+        out.f    = (type_size(tt, type) == 4) ? (double)(float)f : f;
+        return out;
+    }
+
+    if (is_integer_type(tt, type))
+    {
+        if (value.kind == CONST_FLOAT)
+        {
+            int bits = type_size(tt, type) * 8;
+            double limit = (bits >= 64) ? 9223372036854775808.0 : (double)(1ULL << (bits - 1));
+
+            //NaN, infinities and values the type cannot hold are left to the hardware at run time
+            if (!(value.f > -limit - 1.0 && value.f < limit))
+                return out;
+
+            out.kind = CONST_INT;
+            out.i    = wrap(tt, type, (unsigned long long)(long long)value.f);
+            return out;
+        }
+
+        out.kind = CONST_INT;
+        out.i    = wrap(tt, type, (unsigned long long)value.i);
+        return out;
+    }
+
+    //pointers and aggregates are never compile-time values here
+    return out;
+}
+
+int const_is_true(ConstValue value)
+{
+    return (value.kind == CONST_FLOAT) ? (value.f != 0.0) : (value.i != 0);
+}
+
+static ConstValue make_int(const TypeTable *tt, int type, unsigned long long v)
+{
+    ConstValue out = { CONST_INT, wrap(tt, type, v), 0.0 };
+    return out;
+}
+
+static FoldStatus fold_compare(const TypeTable *tt, TokenType op, ConstValue a, ConstValue b, int common, ConstValue *out)
+{
+    int result;
+
+    a = const_convert(tt, a, common);
+    b = const_convert(tt, b, common);
+
+    if (a.kind == CONST_FLOAT)
+    {
+        switch (op)
+        {
+            case TOK_EQ:  result = a.f == b.f; break;
+            case TOK_NEQ: result = a.f != b.f; break;
+            case TOK_LT:  result = a.f <  b.f; break;
+            case TOK_GT:  result = a.f >  b.f; break;
+            case TOK_LTE: result = a.f <= b.f; break;
+            default:      result = a.f >= b.f; break;
+        }
+    }
+    else if (is_unsigned_type(tt, common))
+    {
+        unsigned long long x = (unsigned long long)a.i;
+        unsigned long long y = (unsigned long long)b.i;
+
+        //values are zero-extended, so narrower unsigned types compare correctly too
+        if (type_size(tt, common) < 8)
+        {
+            x &= (1ULL << (type_size(tt, common) * 8)) - 1;
+            y &= (1ULL << (type_size(tt, common) * 8)) - 1;
+        }
+
+        switch (op)
+        {
+            case TOK_EQ:  result = x == y; break;
+            case TOK_NEQ: result = x != y; break;
+            case TOK_LT:  result = x <  y; break;
+            case TOK_GT:  result = x >  y; break;
+            case TOK_LTE: result = x <= y; break;
+            default:      result = x >= y; break;
+        }
+    }
+    else
+    {
+        switch (op)
+        {
+            case TOK_EQ:  result = a.i == b.i; break;
+            case TOK_NEQ: result = a.i != b.i; break;
+            case TOK_LT:  result = a.i <  b.i; break;
+            case TOK_GT:  result = a.i >  b.i; break;
+            case TOK_LTE: result = a.i <= b.i; break;
+            default:      result = a.i >= b.i; break;
+        }
+    }
+
+    out->kind = CONST_INT;
+    out->i    = result;
+    out->f    = 0.0;
+
+    return FOLD_OK;
+}
+
+static FoldStatus fold_binary(Ast *ast, TypeTable *tt, int node)
+{
+    AstNode *n = &ast->nodes[node];
+    const AstNode *lhs = &ast->nodes[n->kid[0]];
+    const AstNode *rhs = &ast->nodes[n->kid[1]];
+    ConstValue a = lhs->value;
+    ConstValue b = rhs->value;
+    int type = n->type;
+
+    //short-circuit operators only need the left side when it decides the result
+    if (n->op == TOK_OCH || n->op == TOK_ELLER)
+    {
+        if (a.kind == CONST_NONE)
+            return FOLD_NOT_CONST;
+
+        if (n->op == TOK_OCH && !const_is_true(a))
+        {
+            n->value = make_int(tt, type, 0);
+            return FOLD_OK;
+        }
+
+        if (n->op == TOK_ELLER && const_is_true(a))
+        {
+            n->value = make_int(tt, type, 1);
+            return FOLD_OK;
+        }
+
+        if (b.kind == CONST_NONE)
+            return FOLD_NOT_CONST;
+
+        n->value = make_int(tt, type, const_is_true(b));
+        return FOLD_OK;
+    }
+
+    if (a.kind == CONST_NONE || b.kind == CONST_NONE)
+        return FOLD_NOT_CONST;
+
+    switch (n->op)
+    {
+        case TOK_EQ:
+        case TOK_NEQ:
+        case TOK_LT:
+        case TOK_GT:
+        case TOK_LTE:
+        case TOK_GTE:
+            if (!type_is_arithmetic(tt, lhs->type) || !type_is_arithmetic(tt, rhs->type))
+                return FOLD_NOT_CONST;
+
+            return fold_compare(tt, n->op, a, b, type_common(tt, lhs->type, rhs->type), &n->value);
+
+        case TOK_VANSTER:
+        case TOK_HOGER:
+        {
+            long long count = b.i;
+            int bits = type_size(tt, type) * 8;
+
+            if (!is_integer_type(tt, type))
+                return FOLD_NOT_CONST;
+
+            if (count < 0 || count >= bits)
+                return FOLD_BAD_SHIFT;
+
+            a = const_convert(tt, a, type);
+
+            if (n->op == TOK_VANSTER)
+                n->value = make_int(tt, type, (unsigned long long)a.i << count);
+            else if (is_unsigned_type(tt, type))
+                n->value = make_int(tt, type, (unsigned long long)a.i >> count);
+            else
+                n->value = make_int(tt, type, (unsigned long long)(a.i >> count));
+
+            return FOLD_OK;
+        }
+
+        default:
+            break;
+    }
+
+    //arithmetic and bitwise operators work in the result type
+    if (!type_is_arithmetic(tt, type))
+        return FOLD_NOT_CONST;
+
+    a = const_convert(tt, a, type);
+    b = const_convert(tt, b, type);
+
+    if (a.kind == CONST_FLOAT)
+    {
+        double f;
+
+        switch (n->op)
+        {
+            case TOK_PLUS:  f = a.f + b.f; break;
+            case TOK_MINUS: f = a.f - b.f; break;
+            case TOK_MUL:   f = a.f * b.f; break;
+            case TOK_DIV:   f = a.f / b.f; break;
+            default:        return FOLD_NOT_CONST;
+        }
+
+        n->value.kind = CONST_FLOAT;
+        n->value.f    = f;
+        n->value      = const_convert(tt, n->value, type);
+        return FOLD_OK;
+    }
+
+    unsigned long long x = (unsigned long long)a.i;
+    unsigned long long y = (unsigned long long)b.i;
+
+    switch (n->op)
+    {
+        case TOK_PLUS:   n->value = make_int(tt, type, x + y); break;
+        case TOK_MINUS:  n->value = make_int(tt, type, x - y); break;
+        case TOK_MUL:    n->value = make_int(tt, type, x * y); break;
+        case TOK_BITAND: n->value = make_int(tt, type, x & y); break;
+        case TOK_BITOR:  n->value = make_int(tt, type, x | y); break;
+        case TOK_BITXOR: n->value = make_int(tt, type, x ^ y); break;
+
+        case TOK_DIV:
+        case TOK_MOD:
+            if (y == 0)
+                return FOLD_DIV_ZERO;
+
+            if (is_unsigned_type(tt, type))
+            {
+                if (type_size(tt, type) < 8)
+                {
+                    x &= (1ULL << (type_size(tt, type) * 8)) - 1;
+                    y &= (1ULL << (type_size(tt, type) * 8)) - 1;
+                }
+
+                n->value = make_int(tt, type, (n->op == TOK_DIV) ? x / y : x % y);
+            }
+            else if (a.i == (-9223372036854775807LL - 1) && b.i == -1)
+            {
+                //the one signed quotient that does not fit wraps, and its remainder is 0, as in the VM,
+                //the JIT and the native code, which all steer around idiv's trap for a divisor of -1
+                n->value = make_int(tt, type, (n->op == TOK_DIV) ? x : 0);
+            }
+            else
+            {
+                n->value = make_int(tt, type, (unsigned long long)((n->op == TOK_DIV) ? a.i / b.i : a.i % b.i));
+            }
+            break;
+
+        default:
+            return FOLD_NOT_CONST;
+    }
+
+    return FOLD_OK;
+}
+
+FoldStatus fold_expr(Ast *ast, TypeTable *tt, int node)
+{
+    AstNode *n = &ast->nodes[node];
+
+    switch (n->kind)
+    {
+        case AST_INT_LIT:
+            n->value.kind = CONST_INT;
+            n->value.i    = wrap(tt, n->type, strtoull(ast_name(ast, node), NULL, 10));
+            return FOLD_OK;
+
+        case AST_FLOAT_LIT:
+            n->value.kind = CONST_FLOAT;
+            n->value.f    = strtod(ast_name(ast, node), NULL);
+            n->value      = const_convert(tt, n->value, n->type);
+            return FOLD_OK;
+
+        case AST_IDENT:
+            //enumerators arrive with their value already attached
+            return (n->value.kind != CONST_NONE) ? FOLD_OK : FOLD_NOT_CONST;
+
+        case AST_UNARY:
+        {
+            ConstValue a = ast->nodes[n->kid[0]].value;
+
+            if (a.kind == CONST_NONE)
+                return FOLD_NOT_CONST;
+
+            if (n->op == TOK_INTE)
+            {
+                n->value = make_int(tt, n->type, !const_is_true(a));
+                return FOLD_OK;
+            }
+
+            a = const_convert(tt, a, n->type);
+
+            if (a.kind == CONST_NONE)
+                return FOLD_NOT_CONST;
+
+            if (n->op == TOK_PLUS)
+                n->value = a;
+            else if (a.kind == CONST_FLOAT && n->op == TOK_MINUS)
+                n->value = const_convert(tt, (ConstValue){ CONST_FLOAT, 0, -a.f }, n->type);
+            else if (a.kind == CONST_INT && n->op == TOK_MINUS)
+                n->value = make_int(tt, n->type, 0ULL - (unsigned long long)a.i);
+            else if (a.kind == CONST_INT && n->op == TOK_BITNOT)
+                n->value = make_int(tt, n->type, ~(unsigned long long)a.i);
+            else
+                return FOLD_NOT_CONST;
+
+            return FOLD_OK;
+        }
+
+        case AST_BINARY:
+            return fold_binary(ast, tt, node);
+
+        case AST_CAST:
+        {
+            ConstValue v = const_convert(tt, ast->nodes[n->kid[1]].value, n->type);
+
+            if (v.kind == CONST_NONE)
+                return FOLD_NOT_CONST;
+
+            n->value = v;
+            return FOLD_OK;
+        }
+
+        default:
+            return FOLD_NOT_CONST;
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "ast.h"
+#include "types.h"
+
+/* ---------------------------------------------
+   Constant folding
+
+   fold_expr() looks at one already-typed
+   expression node whose children have been
+   folded, and stores its compile-time value in
+   AstNode.value. Arithmetic follows what the
+   generated code does at run time: integers wrap
+   at the width of their type, division truncates
+   toward zero, SKIFT HÖGER on a signed value is
+   arithmetic, and FLYT results are rounded to
+   single precision.
+--------------------------------------------- */
+typedef enum FoldStatus {
+    FOLD_OK,            // node has a value
+    FOLD_NOT_CONST,     // depends on something only known at run time
+    FOLD_DIV_ZERO,      // integer DELAT or % by a constant zero
+    FOLD_BAD_SHIFT      // shift count negative or not below the operand width
+} FoldStatus;
+
+FoldStatus fold_expr(Ast *ast, TypeTable *tt, int node);
+
+// brings a value to the representation of type (wrapping or rounding as needed); CONST_NONE for a float an integer type cannot hold
+ConstValue const_convert(const TypeTable *tt, ConstValue value, int type);
+
+int const_is_true(ConstValue value);
+
+#endif /* FOLD_H */
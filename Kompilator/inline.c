@@ -0,0 +1,466 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inline.h"
+
+typedef struct InlineState {
+    IrModule *m;
+
+    int      *size;         // per function: instructions that produce code
+    int      *calls;        // per function: calls it makes
+    int      *sites;        // per function: call sites naming it
+    char     *recursive;    // per function: on a cycle of the call graph
+
+    int      *order;        // callees before callers
+    int       order_count;
+
+    //Tarjan's strongly connected components
+    int      *index;
+    int      *low;
+    char     *on_stack;
+    int      *stack;
+    int       stack_count;
+    int       next_index;
+} InlineState;
+
+static void *inline_alloc(size_t count, size_t size, const char *what)
+{
+    void *ptr = calloc(count + 1, size);
+
+    if (!ptr)
+    {
+        fprintf(stderr, "Fatal: failed to allocate %s\n", what);
+        exit(1);
+    }
+
+    return ptr;
+}
+
+static int body_size(const IrFunc *f)
+{
+    int size = 0;
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+        {
+            IrOp op = f->instrs[i].op;
+
+            if (op != IR_CONST && op != IR_PARAM && op != IR_UNDEF && op != IR_PHI)
+                size++;
+        }
+    }
+
+    return size;
+}
+
+static int has_return(const IrFunc *f)
+{
+    for (int b = 0; b < f->block_count; b++)
+    {
+        int term = ir_terminator(f, b);
+
+        if (term != IR_NONE && f->instrs[term].op == IR_RET)
+            return 1;
+    }
+
+    return 0;
+}
+
+
+
+/*
+   _____      _ _    _____                 _
+  / ____|    | | |  / ____|               | |
+ | |     __ _| | | | |  __ _ __ __ _ _ __ | |__
+ | |    / _` | | | | | |_ | '__/ _` | '_ \| '_ \
+ | |___| (_| | | | | |__| | | | (_| | |_) | | | |
+  \_____\__,_|_|_|  \_____|_|  \__,_| .__/|_| |_|
+                                    | |
+                                    |_|
+*/
+
+static void strong_connect(InlineState *s, int fi)
+{
+    const IrFunc *f = &s->m->funcs[fi];
+    int self_call = 0;
+
+    s->index[fi] = s->low[fi] = ++s->next_index;
+    s->stack[s->stack_count++] = fi;
+    s->on_stack[fi] = 1;
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+        {
+            int callee;
+
+            if (f->instrs[i].op != IR_CALL)
+                continue;
+
+            callee = f->instrs[i].aux;
+
+            if (callee == fi)
+                self_call = 1;
+
+            if (!s->index[callee])
+            {
+                strong_connect(s, callee);
+
+                if (s->low[callee] < s->low[fi])
+                    s->low[fi] = s->low[callee];
+            }
+            else if (s->on_stack[callee] && s->index[callee] < s->low[fi])
+                s->low[fi] = s->index[callee];
+        }
+    }
+
+    if (s->low[fi] != s->index[fi])
+        return;
+
+    //fi roots a component; it is finished, and so is everything it calls
+    int top = s->stack_count;
+    int member;
+
+    do
+    {
+        member = s->stack[--s->stack_count];
+        s->on_stack[member] = 0;
+        s->order[s->order_count++] = member;
+    }
+    while (member != fi);
+
+    for (int k = s->stack_count; k < top; k++)
+        s->recursive[s->stack[k]] = (top - s->stack_count > 1) || self_call;
+}
+
+static void analyse_calls(InlineState *s)
+{
+    IrModule *m = s->m;
+
+    for (int fi = 0; fi < m->func_count; fi++)
+    {
+        const IrFunc *f = &m->funcs[fi];
+
+        s->size[fi] = body_size(f);
+
+        for (int b = 0; b < f->block_count; b++)
+        {
+            for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+            {
+                if (f->instrs[i].op == IR_CALL)
+                {
+                    s->calls[fi]++;
+                    s->sites[f->instrs[i].aux]++;
+                }
+            }
+        }
+    }
+
+    for (int fi = 0; fi < m->func_count; fi++)
+    {
+        if (!s->index[fi])
+            strong_connect(s, fi);
+    }
+}
+
+static int worth_inlining(const InlineState *s, int caller, int callee)
+{
+    const IrFunc *g = &s->m->funcs[callee];
+    int size = s->size[callee];
+
+    if (callee == caller || s->recursive[callee] || callee == s->m->entry)
+        return 0;
+
+    if (g->is_extern || g->block_count == 0 || g->blocks[0].pred_count > 0 || !has_return(g))
+        return 0;
+
+    if (s->size[caller] + size > INLINE_CALLER_LIMIT)
+        return 0;
+
+    return size <= INLINE_SMALL_BODY ||
+           (s->calls[callee] == 0 && size <= INLINE_LEAF_BODY) ||
+           (s->sites[callee] == 1 && size <= INLINE_ONCE_BODY);
+}
+
+
+
+/*
+  ______                            _
+ |  ____|                          | |
+ | |__  __  ___ __   __ _ _ __   __| |
+ |  __| \ \/ / '_ \ / _` | '_ \ / _` |
+ | |____ >  <| |_) | (_| | | | | (_| |
+ |______/_/\_\ .__/ \__,_|_| |_|\__,_|
+             | |
+             |_|
+*/
+
+//moves everything after call into a new block; returns it
+static int split_after(IrFunc *f, int call)
+{
+    int block = f->instrs[call].block;
+    int cont = ir_new_block(f);
+    int after = f->instrs[call].next;
+    const int *succ;
+    int n;
+
+    f->blocks[cont].first = after;
+    f->blocks[cont].last  = f->blocks[block].last;
+    f->blocks[block].last = call;
+    f->instrs[call].next  = IR_NONE;
+    f->instrs[after].prev = IR_NONE;
+
+    for (int i = after; i != IR_NONE; i = f->instrs[i].next)
+        f->instrs[i].block = cont;
+
+    //the terminator moved, so its successors are now reached from cont
+    n = ir_successors(f, cont, &succ);
+
+    for (int k = 0; k < n; k++)
+    {
+        IrBlock *to = &f->blocks[succ[k]];
+
+        for (int p = 0; p < to->pred_count; p++)
+        {
+            if (to->preds[p] == block)
+                to->preds[p] = cont;
+        }
+    }
+
+    return cont;
+}
+
+static void inline_call(IrModule *m, int fi, int call)
+{
+    IrFunc *f = &m->funcs[fi];
+    const IrFunc *g = &m->funcs[f->instrs[call].aux];
+    int block = f->instrs[call].block;
+    int cont = split_after(f, call);
+    int *value_map = inline_alloc(g->instr_count, sizeof(int), "inline value map");
+    int *block_map = inline_alloc(g->block_count, sizeof(int), "inline block map");
+    int *slot_map  = inline_alloc(g->slot_count, sizeof(int), "inline slot map");
+    int *copies    = inline_alloc(g->instr_count, sizeof(int), "inline copies");
+    int *ret_value = inline_alloc(g->block_count, sizeof(int), "inline returns");
+    int *ret_block = inline_alloc(g->block_count, sizeof(int), "inline returns");
+    int  copy_count = 0;
+    int  ret_count = 0;
+    int  jump;
+
+    for (int i = 0; i < g->instr_count; i++)
+        value_map[i] = IR_NONE;
+
+    for (int s = 0; s < g->slot_count; s++)
+        slot_map[s] = ir_new_slot(f, g->slots[s].size, g->slots[s].align, g->slots[s].sym);
+
+    for (int b = 0; b < g->block_count; b++)
+        block_map[b] = ir_new_block(f);
+
+    //copies first; operands may name values of later blocks, so they are mapped afterwards
+    for (int b = 0; b < g->block_count; b++)
+    {
+        for (int i = g->blocks[b].first; i != IR_NONE; i = g->instrs[i].next)
+        {
+            const IrInstr *src = &g->instrs[i];
+            int c;
+
+            if (src->op == IR_PARAM)
+            {
+                value_map[i] = f->operands[f->instrs[call].args + src->aux];
+                continue;
+            }
+
+            if (src->op == IR_RET)
+            {
+                c = ir_new_instr(f, IR_JMP, IRT_VOID, IR_NONE, IR_NONE);
+                f->instrs[c].target[0] = cont;
+                ir_append(f, block_map[b], c);
+
+                ret_block[ret_count] = block_map[b];
+                ret_value[ret_count] = src->a;
+                ret_count++;
+                continue;
+            }
+
+            c = ir_new_instr(f, src->op, src->type, src->a, src->b);
+
+            f->instrs[c].imm       = src->imm;
+            f->instrs[c].fimm      = src->fimm;
+            f->instrs[c].aux       = src->aux;
+            f->instrs[c].args      = src->args;
+            f->instrs[c].nargs     = src->nargs;
+            f->instrs[c].target[0] = src->target[0];
+            f->instrs[c].target[1] = src->target[1];
+
+            if (src->op == IR_SWITCH)
+                f->instrs[c].imm = ir_copy_cases(f, g, i);
+
+            ir_append(f, block_map[b], c);
+
+            value_map[i] = c;
+            copies[copy_count++] = c;
+        }
+    }
+
+    for (int k = 0; k < copy_count; k++)
+    {
+        IrInstr *in = &f->instrs[copies[k]];
+
+        if (in->a != IR_NONE)
+            in->a = value_map[in->a];
+        if (in->b != IR_NONE)
+            in->b = value_map[in->b];
+
+        if (in->op == IR_SLOT)
+            in->aux = slot_map[in->aux];
+
+        if (ir_is_terminator(in->op))
+        {
+            int count;
+            int *targets = ir_targets(f, copies[k], &count);
+
+            for (int t = 0; t < count; t++)
+                targets[t] = block_map[targets[t]];
+        }
+
+        if (in->nargs > 0)
+        {
+            int values[in->nargs];
+            int first;
+
+            for (int a = 0; a < in->nargs; a++)
+                values[a] = value_map[g->operands[in->args + a]];
+
+            first = ir_add_operands(f, values, in->nargs);
+            f->instrs[copies[k]].args = first;
+        }
+    }
+
+    for (int b = 0; b < g->block_count; b++)
+    {
+        for (int p = 0; p < g->blocks[b].pred_count; p++)
+            ir_add_pred(f, block_map[b], block_map[g->blocks[b].preds[p]]);
+    }
+
+    for (int r = 0; r < ret_count; r++)
+        ir_add_pred(f, cont, ret_block[r]);
+
+    //the call's value is the returned one, merged when there are several returns
+    if (f->instrs[call].type != IRT_VOID)
+    {
+        int result;
+
+        if (ret_count == 1)
+            result = value_map[ret_value[0]];
+        else
+        {
+            int values[ret_count];
+
+            for (int r = 0; r < ret_count; r++)
+                values[r] = value_map[ret_value[r]];
+
+            result = ir_new_instr(f, IR_PHI, f->instrs[call].type, IR_NONE, IR_NONE);
+            f->instrs[result].args  = ir_add_operands(f, values, ret_count);
+            f->instrs[result].nargs = ret_count;
+            ir_prepend(f, cont, result);
+        }
+
+        ir_replace_uses(f, call, result);
+    }
+
+    ir_remove(f, call);
+
+    jump = ir_new_instr(f, IR_JMP, IRT_VOID, IR_NONE, IR_NONE);
+    f->instrs[jump].target[0] = block_map[0];
+    ir_append(f, block, jump);
+    ir_add_pred(f, block_map[0], block);
+
+    free(value_map);
+    free(block_map);
+    free(slot_map);
+    free(copies);
+    free(ret_value);
+    free(ret_block);
+}
+
+int inline_module(IrModule *m, int *inlined)
+{
+    InlineState s;
+    int total = 0;
+    int n = m->func_count;
+
+    memset(&s, 0, sizeof(s));
+    s.m         = m;
+    s.size      = inline_alloc(n, sizeof(int), "inline sizes");
+    s.calls     = inline_alloc(n, sizeof(int), "inline sizes");
+    s.sites     = inline_alloc(n, sizeof(int), "inline sizes");
+    s.recursive = inline_alloc(n, 1, "inline marks");
+    s.order     = inline_alloc(n, sizeof(int), "call graph order");
+    s.index     = inline_alloc(n, sizeof(int), "call graph order");
+    s.low       = inline_alloc(n, sizeof(int), "call graph order");
+    s.on_stack  = inline_alloc(n, 1, "call graph order");
+    s.stack     = inline_alloc(n, sizeof(int), "call graph order");
+
+    analyse_calls(&s);
+
+    for (int k = 0; k < s.order_count; k++)
+    {
+        int fi = s.order[k];
+        IrFunc *f = &m->funcs[fi];
+        int count = 0;
+        int *sites;
+        int site_count = 0;
+
+        if (f->is_extern || s.calls[fi] == 0)
+            continue;
+
+        //only the calls written in f; copies of calls made by inlined bodies stay calls
+        sites = inline_alloc((size_t)s.calls[fi], sizeof(int), "call sites");
+
+        for (int b = 0; b < f->block_count; b++)
+        {
+            for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+            {
+                if (f->instrs[i].op == IR_CALL && site_count < s.calls[fi])
+                    sites[site_count++] = i;
+            }
+        }
+
+        for (int c = 0; c < site_count; c++)
+        {
+            int callee = f->instrs[sites[c]].aux;
+
+            if (!worth_inlining(&s, fi, callee))
+                continue;
+
+            inline_call(m, fi, sites[c]);
+
+            s.size[fi] += s.size[callee];
+            s.calls[fi] += s.calls[callee] - 1;
+            count++;
+        }
+
+        free(sites);
+
+        if (count > 0)
+            ir_compact(f);
+
+        if (inlined)
+            inlined[fi] = count;
+
+        total += count;
+    }
+
+    free(s.size);
+    free(s.calls);
+    free(s.sites);
+    free(s.recursive);
+    free(s.order);
+    free(s.index);
+    free(s.low);
+    free(s.on_stack);
+    free(s.stack);
+
+    return total;
+}
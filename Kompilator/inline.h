@@ -0,0 +1,43 @@
+#ifndef INLINE_H
+#define INLINE_H
+
+#include "ir.h"
+
+/* ---------------------------------------------
+   Inliner
+
+   Copies callee bodies into their call sites,
+   callees before callers, so a body is already
+   expanded when it is copied. A call is inlined
+   when the callee is
+
+   - small (INLINE_SMALL_BODY instructions),
+   - a leaf that makes no calls of its own
+     (INLINE_LEAF_BODY), or
+   - called from this one site and nowhere else
+     (INLINE_ONCE_BODY),
+
+   and is never inlined when the callee is part
+   of a recursive cycle (QUICKSORT calling
+   itself), has no body or never returns. Callers
+   stop growing at INLINE_CALLER_LIMIT. Sizes
+   count instructions that produce code, not
+   constants, parameters or phis.
+
+   The callee's frame slots become slots of the
+   caller and its returns jump to the code after
+   the call, merging the results in a phi. The
+   caller is left for the clean-up passes of
+   opt.h, which fold constant arguments through
+   the copied body.
+--------------------------------------------- */
+
+#define INLINE_SMALL_BODY     12
+#define INLINE_LEAF_BODY      40
+#define INLINE_ONCE_BODY      200
+#define INLINE_CALLER_LIMIT   4000
+
+// returns the number of calls inlined; inlined (may be NULL) gets the count per caller
+int inline_module(IrModule *m, int *inlined);
+
+#endif /* INLINE_H */
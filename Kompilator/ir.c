@@ -0,0 +1,1652 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ir.h"
+
+static void *grow(void *ptr, int *capacity, int count, size_t elem_size, const char *what)
+{
+    if (count < *capacity)
+        return ptr;
+
+    *capacity = (*capacity == 0) ? 16 : *capacity * 2;
+    ptr = realloc(ptr, (size_t)*capacity * elem_size);
+
+    if (!ptr)
+    {
+        fprintf(stderr, "Fatal: %s realloc failed\n", what);
+        exit(1);
+    }
+
+    return ptr;
+}
+
+
+
+/*
+  __  __           _       _
+ |  \/  |         | |     | |
+ | \  / | ___   __| |_   _| | ___
+ | |\/| |/ _ \ / _` | | | | |/ _ \
+ | |  | | (_) | (_| | |_| | |  __/
+ |_|  |_|\___/ \__,_|\__,_|_|\___|
+
+*/
+
+void init_ir_module(IrModule *m)
+{
+    memset(m, 0, sizeof(*m));
+    m->entry = -1;
+}
+
+static void free_ir_func(IrFunc *f)
+{
+    for (int b = 0; b < f->block_count; b++)
+        free(f->blocks[b].preds);
+
+    free(f->blocks);
+    free(f->instrs);
+    free(f->operands);
+    free(f->cases);
+    free(f->slots);
+    free(f->param_types);
+}
+
+void free_ir_module(IrModule *m)
+{
+    for (int i = 0; i < m->func_count; i++)
+        free_ir_func(&m->funcs[i]);
+
+    for (int i = 0; i < m->global_count; i++)
+    {
+        free(m->globals[i].name);
+        free(m->globals[i].data);
+    }
+
+    for (int i = 0; i < m->string_count; i++)
+        free(m->strings[i].data);
+
+    free(m->funcs);
+    free(m->globals);
+    free(m->relocs);
+    free(m->strings);
+
+    init_ir_module(m);
+}
+
+int ir_add_func(IrModule *m, const char *name)
+{
+    m->funcs = grow(m->funcs, &m->func_capacity, m->func_count, sizeof(IrFunc), "IR function");
+
+    IrFunc *f = &m->funcs[m->func_count];
+
+    memset(f, 0, sizeof(*f));
+    f->name     = name;
+    f->node     = -1;
+    f->ret_type = IRT_VOID;
+
+    return m->func_count++;
+}
+
+int ir_add_global(IrModule *m, const char *name, int size, int align)
+{
+    m->globals = grow(m->globals, &m->global_capacity, m->global_count, sizeof(IrGlobal), "IR global");
+
+    IrGlobal *g = &m->globals[m->global_count];
+
+    g->name      = malloc(strlen(name) + 1);
+    g->size      = size;
+    g->align     = (align > 0) ? align : 1;
+    g->data      = calloc(size > 0 ? size : 1, 1);
+    g->node      = -1;
+    g->is_extern = 0;
+    g->is_static = 0;
+
+    if (!g->data || !g->name)
+    {
+        fprintf(stderr, "Fatal: failed to allocate global data\n");
+        exit(1);
+    }
+
+    strcpy(g->name, name);
+
+    return m->global_count++;
+}
+
+int ir_add_string(IrModule *m, const char *data, int length)
+{
+    //identical literals share one copy
+    for (int i = 0; i < m->string_count; i++)
+    {
+        if (m->strings[i].length == length && memcmp(m->strings[i].data, data, length) == 0)
+            return i;
+    }
+
+    m->strings = grow(m->strings, &m->string_capacity, m->string_count, sizeof(IrString), "IR string");
+
+    IrString *s = &m->strings[m->string_count];
+
+    s->data = malloc(length + 1);
+
+    if (!s->data)
+    {
+        fprintf(stderr, "Fatal: failed to allocate string literal\n");
+        exit(1);
+    }
+
+    memcpy(s->data, data, length);
+    s->data[length] = '\0';
+    s->length = length;
+
+    return m->string_count++;
+}
+
+void ir_add_reloc(IrModule *m, int global, int offset, IrRelocKind kind, int target, long long addend)
+{
+    m->relocs = grow(m->relocs, &m->reloc_capacity, m->reloc_count, sizeof(IrReloc), "IR reloc");
+
+    IrReloc *r = &m->relocs[m->reloc_count++];
+
+    r->global = global;
+    r->offset = offset;
+    r->kind   = kind;
+    r->target = target;
+    r->addend = addend;
+}
+
+int ir_find_func(const IrModule *m, const char *name)
+{
+    for (int i = 0; i < m->func_count; i++)
+    {
+        if (strcmp(m->funcs[i].name, name) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+
+
+/*
+  ____        _ _     _ _
+ |  _ \      (_) |   | (_)
+ | |_) |_   _ _| | __| |_ _ __   __ _
+ |  _ <| | | | | |/ _` | | '_ \ / _` |
+ | |_) | |_| | | | (_| | | | | | (_| |
+ |____/ \__,_|_|_|\__,_|_|_| |_|\__, |
+                                 __/ |
+                                |___/
+*/
+
+int ir_new_block(IrFunc *f)
+{
+    f->blocks = grow(f->blocks, &f->block_capacity, f->block_count, sizeof(IrBlock), "IR block");
+
+    IrBlock *b = &f->blocks[f->block_count];
+
+    b->first         = IR_NONE;
+    b->last          = IR_NONE;
+    b->preds         = NULL;
+    b->pred_count    = 0;
+    b->pred_capacity = 0;
+    b->sealed        = 0;
+
+    return f->block_count++;
+}
+
+int ir_new_slot(IrFunc *f, int size, int align, int sym)
+{
+    f->slots = grow(f->slots, &f->slot_capacity, f->slot_count, sizeof(IrSlot), "IR slot");
+
+    f->slots[f->slot_count].size  = (size > 0) ? size : 1;
+    f->slots[f->slot_count].align = (align > 0) ? align : 1;
+    f->slots[f->slot_count].sym   = sym;
+
+    return f->slot_count++;
+}
+
+int ir_new_instr(IrFunc *f, IrOp op, IrType type, int a, int b)
+{
+    f->instrs = grow(f->instrs, &f->instr_capacity, f->instr_count, sizeof(IrInstr), "IR instruction");
+
+    IrInstr *in = &f->instrs[f->instr_count];
+
+    in->op        = op;
+    in->type      = type;
+    in->a         = a;
+    in->b         = b;
+    in->args      = 0;
+    in->nargs     = 0;
+    in->imm       = 0;
+    in->fimm      = 0.0;
+    in->aux       = 0;
+    in->target[0] = IR_NONE;
+    in->target[1] = IR_NONE;
+    in->block     = IR_NONE;
+    in->prev      = IR_NONE;
+    in->next      = IR_NONE;
+
+    return f->instr_count++;
+}
+
+void ir_append(IrFunc *f, int block, int instr)
+{
+    IrBlock *b = &f->blocks[block];
+    IrInstr *in = &f->instrs[instr];
+
+    in->block = block;
+    in->prev  = b->last;
+    in->next  = IR_NONE;
+
+    if (b->last != IR_NONE)
+        f->instrs[b->last].next = instr;
+    else
+        b->first = instr;
+
+    b->last = instr;
+}
+
+void ir_prepend(IrFunc *f, int block, int instr)
+{
+    IrBlock *b = &f->blocks[block];
+    IrInstr *in = &f->instrs[instr];
+
+    in->block = block;
+    in->prev  = IR_NONE;
+    in->next  = b->first;
+
+    if (b->first != IR_NONE)
+        f->instrs[b->first].prev = instr;
+    else
+        b->last = instr;
+
+    b->first = instr;
+}
+
+void ir_insert_before(IrFunc *f, int before, int instr)
+{
+    IrInstr *at = &f->instrs[before];
+    IrInstr *in = &f->instrs[instr];
+
+    in->block = at->block;
+    in->prev  = at->prev;
+    in->next  = before;
+
+    if (at->prev != IR_NONE)
+        f->instrs[at->prev].next = instr;
+    else
+        f->blocks[at->block].first = instr;
+
+    at->prev = instr;
+}
+
+//relinks a live instruction in front of before, possibly in another block
+void ir_move_before(IrFunc *f, int before, int instr)
+{
+    IrInstr *in = &f->instrs[instr];
+
+    if (in->prev != IR_NONE)
+        f->instrs[in->prev].next = in->next;
+    else
+        f->blocks[in->block].first = in->next;
+
+    if (in->next != IR_NONE)
+        f->instrs[in->next].prev = in->prev;
+    else
+        f->blocks[in->block].last = in->prev;
+
+    ir_insert_before(f, before, instr);
+}
+
+//unlinks an instruction; its index stays valid but names nothing
+void ir_remove(IrFunc *f, int instr)
+{
+    IrInstr *in = &f->instrs[instr];
+
+    if (in->block == IR_NONE)
+        return;
+
+    if (in->prev != IR_NONE)
+        f->instrs[in->prev].next = in->next;
+    else
+        f->blocks[in->block].first = in->next;
+
+    if (in->next != IR_NONE)
+        f->instrs[in->next].prev = in->prev;
+    else
+        f->blocks[in->block].last = in->prev;
+
+    in->op    = IR_NOP;
+    in->type  = IRT_VOID;
+    in->block = IR_NONE;
+    in->prev  = IR_NONE;
+    in->next  = IR_NONE;
+}
+
+int ir_add_operands(IrFunc *f, const int *values, int count)
+{
+    int first = f->operand_count;
+
+    for (int i = 0; i < count; i++)
+    {
+        f->operands = grow(f->operands, &f->operand_capacity, f->operand_count, sizeof(int), "IR operand");
+        f->operands[f->operand_count++] = values[i];
+    }
+
+    return first;
+}
+
+void ir_add_pred(IrFunc *f, int block, int pred)
+{
+    IrBlock *b = &f->blocks[block];
+
+    b->preds = grow(b->preds, &b->pred_capacity, b->pred_count, sizeof(int), "IR predecessor");
+    b->preds[b->pred_count++] = pred;
+}
+
+int ir_terminator(const IrFunc *f, int block)
+{
+    int last = f->blocks[block].last;
+
+    if (last != IR_NONE && ir_is_terminator(f->instrs[last].op))
+        return last;
+
+    return IR_NONE;
+}
+
+static int add_case(IrFunc *f, int value)
+{
+    f->cases = grow(f->cases, &f->case_capacity, f->case_count, sizeof(int), "IR switch case");
+    f->cases[f->case_count] = value;
+
+    return f->case_count++;
+}
+
+int ir_new_switch(IrFunc *f, int index, int default_block, const int *table, int count)
+{
+    int i = ir_new_instr(f, IR_SWITCH, IRT_VOID, index, IR_NONE);
+    int *succ = malloc((count + 2) * sizeof(int));
+    int succ_count = 0;
+
+    if (!succ)
+    {
+        fprintf(stderr, "Fatal: failed to allocate switch successors\n");
+        exit(1);
+    }
+
+    succ[succ_count++] = default_block;
+
+    for (int k = 0; k < count; k++)
+    {
+        int s = 0;
+
+        while (s < succ_count && succ[s] != table[k])
+            s++;
+
+        if (s == succ_count)
+            succ[succ_count++] = table[k];
+    }
+
+    f->instrs[i].imm = add_case(f, succ_count);
+    f->instrs[i].aux = count;
+
+    for (int s = 0; s < succ_count; s++)
+        add_case(f, succ[s]);
+
+    //entries name successors, so a block shared by many values is one edge
+    for (int k = 0; k < count; k++)
+    {
+        int s = 0;
+
+        while (succ[s] != table[k])
+            s++;
+
+        add_case(f, s);
+    }
+
+    free(succ);
+    return i;
+}
+
+int ir_copy_cases(IrFunc *to, const IrFunc *from, int instr)
+{
+    const IrInstr *in = &from->instrs[instr];
+    int length = 1 + from->cases[in->imm] + in->aux;
+    int first = to->case_count;
+
+    for (int k = 0; k < length; k++)
+        add_case(to, from->cases[in->imm + k]);
+
+    return first;
+}
+
+int ir_switch_successor(const IrFunc *f, int instr, long long index)
+{
+    const IrInstr *in = &f->instrs[instr];
+    unsigned long long k = (unsigned long long)index;
+
+    if (k >= (unsigned long long)in->aux)
+        return 0;
+
+    return f->cases[in->imm + 1 + f->cases[in->imm] + (int)k];
+}
+
+int ir_successors(const IrFunc *f, int block, const int **out)
+{
+    int term = ir_terminator(f, block);
+
+    if (term == IR_NONE)
+        return 0;
+
+    switch (f->instrs[term].op)
+    {
+        case IR_JMP:
+            *out = f->instrs[term].target;
+            return 1;
+
+        case IR_BR:
+            *out = f->instrs[term].target;
+            return 2;
+
+        case IR_SWITCH:
+            *out = &f->cases[f->instrs[term].imm + 1];
+            return f->cases[f->instrs[term].imm];
+
+        default:
+            return 0;
+    }
+}
+
+int *ir_targets(IrFunc *f, int instr, int *count)
+{
+    IrInstr *in = &f->instrs[instr];
+
+    switch (in->op)
+    {
+        case IR_JMP:
+            *count = 1;
+            return in->target;
+
+        case IR_BR:
+            *count = 2;
+            return in->target;
+
+        case IR_SWITCH:
+            *count = f->cases[in->imm];
+            return &f->cases[in->imm + 1];
+
+        default:
+            *count = 0;
+            return in->target;
+    }
+}
+
+void ir_replace_uses(IrFunc *f, int from, int to)
+{
+    for (int b = 0; b < f->block_count; b++)
+    {
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+        {
+            IrInstr *in = &f->instrs[i];
+
+            if (in->a == from)
+                in->a = to;
+            if (in->b == from)
+                in->b = to;
+
+            for (int k = 0; k < in->nargs; k++)
+            {
+                if (f->operands[in->args + k] == from)
+                    f->operands[in->args + k] = to;
+            }
+        }
+    }
+}
+
+
+
+/*
+                      _           _
+     /\               | |         (_)
+    /  \   _ __   __ _| |_   _ ___ _ ___
+   / /\ \ | '_ \ / _` | | | | / __| / __|
+  / ____ \| | | | (_| | | |_| \__ \ \__ \
+ /_/    \_\_| |_|\__,_|_|\__, |___/_|___/
+                          __/ |
+                         |___/
+*/
+
+int ir_is_terminator(IrOp op)
+{
+    return op == IR_JMP || op == IR_BR || op == IR_SWITCH || op == IR_RET;
+}
+
+int ir_has_side_effects(IrOp op)
+{
+    switch (op)
+    {
+        case IR_STORE:
+        case IR_MEMCPY:
+        case IR_MEMZERO:
+        case IR_VSTORE:
+        case IR_CALL:
+        case IR_JMP:
+        case IR_BR:
+        case IR_SWITCH:
+        case IR_RET:
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+int ir_defines_value(const IrInstr *in)
+{
+    return in->op != IR_NOP && in->type != IRT_VOID;
+}
+
+//rebuilds predecessor lists from terminators, keeping phi operands attached to their edges
+void ir_compute_preds(IrFunc *f)
+{
+    int **old_preds = malloc((f->block_count + 1) * sizeof(int *));
+    int  *old_count = malloc((f->block_count + 1) * sizeof(int));
+
+    if (!old_preds || !old_count)
+    {
+        fprintf(stderr, "Fatal: failed to allocate predecessor scratch\n");
+        exit(1);
+    }
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        old_preds[b] = f->blocks[b].preds;
+        old_count[b] = f->blocks[b].pred_count;
+
+        f->blocks[b].preds         = NULL;
+        f->blocks[b].pred_count    = 0;
+        f->blocks[b].pred_capacity = 0;
+    }
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        const int *succ;
+        int n = ir_successors(f, b, &succ);
+
+        for (int s = 0; s < n; s++)
+            ir_add_pred(f, succ[s], b);
+    }
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        IrBlock *blk = &f->blocks[b];
+
+        for (int i = blk->first; i != IR_NONE && f->instrs[i].op == IR_PHI; i = f->instrs[i].next)
+        {
+            IrInstr *phi = &f->instrs[i];
+            int values[blk->pred_count + 1];
+            char used[old_count[b] + 1];
+
+            memset(used, 0, sizeof(used));
+
+            for (int p = 0; p < blk->pred_count; p++)
+            {
+                values[p] = IR_NONE;
+
+                for (int q = 0; q < old_count[b] && q < phi->nargs; q++)
+                {
+                    if (!used[q] && old_preds[b][q] == blk->preds[p])
+                    {
+                        used[q] = 1;
+                        values[p] = f->operands[phi->args + q];
+                        break;
+                    }
+                }
+            }
+
+            phi = &f->instrs[i];
+            phi->args  = ir_add_operands(f, values, blk->pred_count);
+            phi->nargs = blk->pred_count;
+        }
+
+        free(old_preds[b]);
+    }
+
+    free(old_preds);
+    free(old_count);
+}
+
+//fills order[] with reachable blocks in reverse postorder; returns how many
+static int reverse_postorder(const IrFunc *f, int *order)
+{
+    int *stack = malloc((f->block_count + 1) * sizeof(int));
+    int *next_succ = calloc(f->block_count + 1, sizeof(int));
+    char *seen = calloc(f->block_count + 1, 1);
+    int sp = 0;
+    int count = 0;
+
+    if (!stack || !next_succ || !seen)
+    {
+        fprintf(stderr, "Fatal: failed to allocate traversal scratch\n");
+        exit(1);
+    }
+
+    if (f->block_count > 0)
+    {
+        stack[sp++] = 0;
+        seen[0] = 1;
+    }
+
+    while (sp > 0)
+    {
+        int b = stack[sp - 1];
+        const int *succ;
+        int n = ir_successors(f, b, &succ);
+
+        if (next_succ[b] < n)
+        {
+            int s = succ[next_succ[b]++];
+
+            if (!seen[s])
+            {
+                seen[s] = 1;
+                stack[sp++] = s;
+            }
+            continue;
+        }
+
+        //postorder, written from the back
+        order[f->block_count - 1 - count] = b;
+        count++;
+        sp--;
+    }
+
+    //slide the filled tail to the front
+    memmove(order, order + (f->block_count - count), count * sizeof(int));
+
+    free(stack);
+    free(next_succ);
+    free(seen);
+
+    return count;
+}
+
+//drops unreachable blocks and renumbers the rest in reverse postorder
+void ir_compact(IrFunc *f)
+{
+    int  n = f->block_count;
+    int *order = malloc((n + 1) * sizeof(int));
+    int *remap = malloc((n + 1) * sizeof(int));
+    int  kept;
+
+    if (!order || !remap)
+    {
+        fprintf(stderr, "Fatal: failed to allocate compaction scratch\n");
+        exit(1);
+    }
+
+    kept = reverse_postorder(f, order);
+
+    for (int b = 0; b < n; b++)
+        remap[b] = IR_NONE;
+
+    for (int i = 0; i < kept; i++)
+        remap[order[i]] = i;
+
+    //forgets edges from dropped blocks, together with their phi operands
+    for (int i = 0; i < kept; i++)
+    {
+        IrBlock *blk = &f->blocks[order[i]];
+        int keep = 0;
+
+        for (int p = 0; p < blk->pred_count; p++)
+        {
+            if (remap[blk->preds[p]] == IR_NONE)
+                continue;
+
+            for (int ins = blk->first; ins != IR_NONE && f->instrs[ins].op == IR_PHI; ins = f->instrs[ins].next)
+                f->operands[f->instrs[ins].args + keep] = f->operands[f->instrs[ins].args + p];
+
+            blk->preds[keep++] = remap[blk->preds[p]];
+        }
+
+        blk->pred_count = keep;
+
+        for (int ins = blk->first; ins != IR_NONE; ins = f->instrs[ins].next)
+        {
+            IrInstr *in = &f->instrs[ins];
+
+            in->block = i;
+
+            if (in->op == IR_PHI)
+                in->nargs = keep;
+
+            if (ir_is_terminator(in->op))
+            {
+                int count;
+                int *targets = ir_targets(f, ins, &count);
+
+                for (int t = 0; t < count; t++)
+                    targets[t] = remap[targets[t]];
+            }
+        }
+    }
+
+    //unreachable code disappears
+    for (int b = 0; b < n; b++)
+    {
+        if (remap[b] != IR_NONE)
+            continue;
+
+        for (int ins = f->blocks[b].first; ins != IR_NONE; )
+        {
+            int next = f->instrs[ins].next;
+
+            f->instrs[ins].op    = IR_NOP;
+            f->instrs[ins].type  = IRT_VOID;
+            f->instrs[ins].block = IR_NONE;
+            f->instrs[ins].prev  = IR_NONE;
+            f->instrs[ins].next  = IR_NONE;
+
+            ins = next;
+        }
+
+        free(f->blocks[b].preds);
+    }
+
+    IrBlock *blocks = malloc((kept > 0 ? kept : 1) * sizeof(IrBlock));
+
+    if (!blocks)
+    {
+        fprintf(stderr, "Fatal: failed to allocate compacted blocks\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < kept; i++)
+        blocks[i] = f->blocks[order[i]];
+
+    free(f->blocks);
+
+    f->blocks         = blocks;
+    f->block_count    = kept;
+    f->block_capacity = (kept > 0) ? kept : 1;
+
+    free(order);
+    free(remap);
+}
+
+//immediate dominators (Cooper, Harvey & Kennedy); idom[entry] = entry, -1 if unreachable
+int ir_dominators(const IrFunc *f, int *idom)
+{
+    int *order = malloc((f->block_count + 1) * sizeof(int));
+    int *rpo_index = malloc((f->block_count + 1) * sizeof(int));
+    int count;
+    int changed = 1;
+
+    if (!order || !rpo_index)
+    {
+        fprintf(stderr, "Fatal: failed to allocate dominator scratch\n");
+        exit(1);
+    }
+
+    count = reverse_postorder(f, order);
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        idom[b] = -1;
+        rpo_index[b] = -1;
+    }
+
+    for (int i = 0; i < count; i++)
+        rpo_index[order[i]] = i;
+
+    if (count > 0)
+        idom[0] = 0;
+
+    while (changed)
+    {
+        changed = 0;
+
+        for (int i = 1; i < count; i++)
+        {
+            int b = order[i];
+            int new_idom = -1;
+
+            for (int p = 0; p < f->blocks[b].pred_count; p++)
+            {
+                int pred = f->blocks[b].preds[p];
+
+                if (idom[pred] == -1)
+                    continue;
+
+                if (new_idom == -1)
+                {
+                    new_idom = pred;
+                    continue;
+                }
+
+                //walks both fingers up until they meet
+                int x = pred;
+                int y = new_idom;
+
+                while (x != y)
+                {
+                    while (rpo_index[x] > rpo_index[y])
+                        x = idom[x];
+                    while (rpo_index[y] > rpo_index[x])
+                        y = idom[y];
+                }
+
+                new_idom = x;
+            }
+
+            if (new_idom != -1 && idom[b] != new_idom)
+            {
+                idom[b] = new_idom;
+                changed = 1;
+            }
+        }
+    }
+
+    free(order);
+    free(rpo_index);
+
+    return count;
+}
+
+int ir_dominates(const int *idom, int a, int b)
+{
+    if (b < 0 || idom[b] == -1)
+        return 0;
+
+    while (b != a)
+    {
+        if (idom[b] == b)
+            return 0;
+
+        b = idom[b];
+    }
+
+    return 1;
+}
+
+
+
+/*
+   ____        _               _
+  / __ \      | |             | |
+ | |  | |_   _| |_ _ __  _   _| |_
+ | |  | | | | | __| '_ \| | | | __|
+ | |__| | |_| | |_| |_) | |_| | |_
+  \____/ \__,_|\__| .__/ \__,_|\__|
+                  | |
+                  |_|
+*/
+
+const char *ir_op_name(IrOp op)
+{
+    static const char *names[IR_OP_COUNT] = {
+        [IR_NOP]      = "nop",
+        [IR_CONST]    = "const",
+        [IR_UNDEF]    = "undef",
+        [IR_PARAM]    = "param",
+        [IR_SLOT]     = "slot",
+        [IR_GLOBAL]   = "global",
+        [IR_STRING]   = "string",
+        [IR_FUNCADDR] = "funcaddr",
+        [IR_ADD]      = "add",
+        [IR_SUB]      = "sub",
+        [IR_MUL]      = "mul",
+        [IR_DIV]      = "div",
+        [IR_UDIV]     = "udiv",
+        [IR_MOD]      = "mod",
+        [IR_UMOD]     = "umod",
+        [IR_AND]      = "and",
+        [IR_OR]       = "or",
+        [IR_XOR]      = "xor",
+        [IR_SHL]      = "shl",
+        [IR_SHR]      = "shr",
+        [IR_USHR]     = "ushr",
+        [IR_NEG]      = "neg",
+        [IR_NOT]      = "not",
+        [IR_EQ]       = "eq",
+        [IR_NE]       = "ne",
+        [IR_LT]       = "lt",
+        [IR_LE]       = "le",
+        [IR_GT]       = "gt",
+        [IR_GE]       = "ge",
+        [IR_ULT]      = "ult",
+        [IR_ULE]      = "ule",
+        [IR_UGT]      = "ugt",
+        [IR_UGE]      = "uge",
+        [IR_SEXT]     = "sext",
+        [IR_ZEXT]     = "zext",
+        [IR_TRUNC]    = "trunc",
+        [IR_ITOF]     = "itof",
+        [IR_UTOF]     = "utof",
+        [IR_FTOI]     = "ftoi",
+        [IR_FCONV]    = "fconv",
+        [IR_COPY]     = "copy",
+        [IR_OFFSET]   = "offset",
+        [IR_INDEX]    = "index",
+        [IR_LOAD]     = "load",
+        [IR_STORE]    = "store",
+        [IR_MEMCPY]   = "memcpy",
+        [IR_MEMZERO]  = "memzero",
+        [IR_VSPLAT]   = "vsplat",
+        [IR_VLOAD]    = "vload",
+        [IR_VSTORE]   = "vstore",
+        [IR_VADD]     = "vadd",
+        [IR_VSUB]     = "vsub",
+        [IR_VMUL]     = "vmul",
+        [IR_VDIV]     = "vdiv",
+        [IR_VAND]     = "vand",
+        [IR_VOR]      = "vor",
+        [IR_VXOR]     = "vxor",
+        [IR_VSUM]     = "vsum",
+        [IR_CALL]     = "call",
+        [IR_PHI]      = "phi",
+        [IR_JMP]      = "jmp",
+        [IR_BR]       = "br",
+        [IR_SWITCH]   = "switch",
+        [IR_RET]      = "ret",
+    };
+
+    if (op < 0 || op >= IR_OP_COUNT || !names[op])
+        return "?";
+
+    return names[op];
+}
+
+const char *ir_type_name(IrType type)
+{
+    switch (type)
+    {
+        case IRT_VOID: return "void";
+        case IRT_I8:   return "i8";
+        case IRT_I16:  return "i16";
+        case IRT_I32:  return "i32";
+        case IRT_I64:  return "i64";
+        case IRT_F32:  return "f32";
+        case IRT_F64:  return "f64";
+        case IRT_PTR:  return "ptr";
+        case IRT_VEC:  return "vec";
+        default:       return "?";
+    }
+}
+
+int ir_type_size(IrType type)
+{
+    switch (type)
+    {
+        case IRT_I8:   return 1;
+        case IRT_I16:  return 2;
+        case IRT_I32:  return 4;
+        case IRT_F32:  return 4;
+        case IRT_I64:  return 8;
+        case IRT_F64:  return 8;
+        case IRT_PTR:  return 8;
+        default:       return 0;
+    }
+}
+
+int ir_type_is_float(IrType type)
+{
+    return type == IRT_F32 || type == IRT_F64;
+}
+
+int ir_is_vector_op(IrOp op)
+{
+    return op >= IR_VSPLAT && op <= IR_VSUM;
+}
+
+//result of an integer comparison op on two constants of type
+int ir_compare_ints(IrOp op, IrType type, long long x, long long y)
+{
+    int bits = ir_type_size(type) * 8;
+    unsigned long long mask = (bits > 0 && bits < 64) ? (1ULL << bits) - 1 : ~0ULL;
+    unsigned long long ux = (unsigned long long)x & mask;
+    unsigned long long uy = (unsigned long long)y & mask;
+
+    switch (op)
+    {
+        case IR_EQ:  return x == y;
+        case IR_NE:  return x != y;
+        case IR_LT:  return x <  y;
+        case IR_LE:  return x <= y;
+        case IR_GT:  return x >  y;
+        case IR_GE:  return x >= y;
+        case IR_ULT: return ux <  uy;
+        case IR_ULE: return ux <= uy;
+        case IR_UGT: return ux >  uy;
+        default:     return ux >= uy;
+    }
+}
+
+//brings an integer to the canonical constant form: truncated to the type, sign-extended back
+long long ir_wrap_int(IrType type, long long value)
+{
+    int bits = ir_type_size(type) * 8;
+    unsigned long long v = (unsigned long long)value;
+
+    if (bits <= 0 || bits >= 64)
+        return value;
+
+    v &= (1ULL << bits) - 1;
+
+    if ((v >> (bits - 1)) & 1)
+        v |= ~((1ULL << bits) - 1);
+
+    return (long long)v;
+}
+
+static void dump_instr(const IrModule *m, const IrFunc *f, int i)
+{
+    const IrInstr *in = &f->instrs[i];
+
+    printf("  ");
+
+    if (ir_defines_value(in))
+        printf("v%d = %s ", i, ir_type_name(in->type));
+
+    printf("%s", ir_op_name(in->op));
+
+    if (ir_is_vector_op(in->op) && ir_type_size(in->aux) > 0)
+        printf(" <%d x %s>", f->vector_bytes / ir_type_size(in->aux), ir_type_name(in->aux));
+
+    switch (in->op)
+    {
+        case IR_CONST:
+            if (ir_type_is_float(in->type))
+                printf(" %g", in->fimm);
+            else
+                printf(" %lld", in->imm);
+            break;
+
+        case IR_PARAM:
+            printf(" %d", in->aux);
+            break;
+
+        case IR_SLOT:
+            printf(" s%d", in->aux);
+            break;
+
+        case IR_GLOBAL:
+            printf(" @%s", m->globals[in->aux].name);
+            break;
+
+        case IR_STRING:
+            printf(" #%d", in->aux);
+            break;
+
+        case IR_FUNCADDR:
+            printf(" %s", m->funcs[in->aux].name);
+            break;
+
+        case IR_OFFSET:
+            printf(" v%d, %lld", in->a, in->imm);
+            break;
+
+        case IR_INDEX:
+            printf(" v%d, v%d, %lld", in->a, in->b, in->imm);
+            break;
+
+        case IR_MEMCPY:
+            printf(" v%d, v%d, %lld", in->a, in->b, in->imm);
+            break;
+
+        case IR_MEMZERO:
+            printf(" v%d, %lld", in->a, in->imm);
+            break;
+
+        case IR_CALL:
+            printf(" %s(", m->funcs[in->aux].name);
+
+            for (int k = 0; k < in->nargs; k++)
+                printf("%sv%d", k ? ", " : "", f->operands[in->args + k]);
+
+            printf(")");
+            break;
+
+        case IR_PHI:
+            for (int k = 0; k < in->nargs; k++)
+            {
+                printf("%s [v%d, b%d]", k ? "," : "",
+                       f->operands[in->args + k],
+                       (k < f->blocks[in->block].pred_count) ? f->blocks[in->block].preds[k] : -1);
+            }
+            break;
+
+        case IR_JMP:
+            printf(" b%d", in->target[0]);
+            break;
+
+        case IR_BR:
+            printf(" v%d, b%d, b%d", in->a, in->target[0], in->target[1]);
+            break;
+
+        case IR_SWITCH:
+        {
+            const int *succ = &f->cases[in->imm + 1];
+            const int *table = succ + f->cases[in->imm];
+
+            printf(" v%d, default b%d, [", in->a, succ[0]);
+
+            for (int k = 0; k < in->aux; k++)
+                printf("%sb%d", k ? ", " : "", succ[table[k]]);
+
+            printf("]");
+            break;
+        }
+
+        default:
+            if (in->a != IR_NONE)
+                printf(" v%d", in->a);
+            if (in->b != IR_NONE)
+                printf(", v%d", in->b);
+            break;
+    }
+
+    printf("\n");
+}
+
+void dump_ir_func(const IrModule *m, const IrFunc *f)
+{
+    printf("func %s(", f->name);
+
+    for (int p = 0; p < f->param_count; p++)
+        printf("%s%s", p ? ", " : "", ir_type_name(f->param_types[p]));
+
+    printf(") -> %s%s\n", ir_type_name(f->ret_type), f->is_extern ? " extern" : "");
+
+    for (int s = 0; s < f->slot_count; s++)
+        printf("  s%d: %d bytes, align %d\n", s, f->slots[s].size, f->slots[s].align);
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        const IrBlock *blk = &f->blocks[b];
+
+        printf("b%d:", b);
+
+        if (blk->pred_count > 0)
+        {
+            printf("%*s; preds", b < 10 ? 5 : 4, "");
+
+            for (int p = 0; p < blk->pred_count; p++)
+                printf("%s b%d", p ? "," : "", blk->preds[p]);
+        }
+
+        printf("\n");
+
+        for (int i = blk->first; i != IR_NONE; i = f->instrs[i].next)
+            dump_instr(m, f, i);
+    }
+
+    printf("\n");
+}
+
+void dump_ir_module(const IrModule *m)
+{
+    for (int s = 0; s < m->string_count; s++)
+    {
+        printf("string #%d = \"", s);
+
+        for (int c = 0; c < m->strings[s].length; c++)
+        {
+            unsigned char ch = (unsigned char)m->strings[s].data[c];
+
+            if (ch == '"' || ch == '\\')
+                printf("\\%c", ch);
+            else if (ch < 0x20)
+                printf("\\x%02x", ch);
+            else
+                putchar(ch);
+        }
+
+        printf("\"\n");
+    }
+
+    for (int g = 0; g < m->global_count; g++)
+    {
+        const IrGlobal *gl = &m->globals[g];
+        int nonzero = 0;
+
+        for (int b = 0; b < gl->size; b++)
+            nonzero |= gl->data[b];
+
+        printf("global @%s: %d bytes, align %d%s", gl->name, gl->size, gl->align, gl->is_extern ? " extern" : "");
+
+        if (nonzero)
+        {
+            printf(" =");
+
+            for (int b = 0; b < gl->size; b++)
+                printf(" %02x", gl->data[b]);
+        }
+
+        printf("\n");
+
+        for (int r = 0; r < m->reloc_count; r++)
+        {
+            const IrReloc *rel = &m->relocs[r];
+
+            if (rel->global != g)
+                continue;
+
+            switch (rel->kind)
+            {
+                case IR_RELOC_STRING: printf("  +%d: &string #%d", rel->offset, rel->target);                 break;
+                case IR_RELOC_GLOBAL: printf("  +%d: &@%s", rel->offset, m->globals[rel->target].name);       break;
+                case IR_RELOC_FUNC:   printf("  +%d: &%s", rel->offset, m->funcs[rel->target].name);          break;
+            }
+
+            if (rel->addend)
+                printf(" + %lld", rel->addend);
+
+            printf("\n");
+        }
+    }
+
+    if (m->string_count > 0 || m->global_count > 0)
+        printf("\n");
+
+    for (int i = 0; i < m->func_count; i++)
+        dump_ir_func(m, &m->funcs[i]);
+}
+
+
+
+/*
+ __      __       _  __
+ \ \    / /      (_)/ _|
+  \ \  / /__ _ __ _| |_ _   _
+   \ \/ / _ \ '__| |  _| | | |
+    \  /  __/ |  | | | | |_| |
+     \/ \___|_|  |_|_|  \__, |
+                         __/ |
+                        |___/
+*/
+
+typedef struct VerifyState {
+    const IrModule *m;
+    const IrFunc   *f;
+    int            *idom;
+    int            *position;   // index of each instruction inside its block
+    int             errors;
+} VerifyState;
+
+static void verify_error(VerifyState *vs, int block, int instr, const char *msg)
+{
+    vs->errors++;
+
+    //a broken function usually breaks in many places; the first few are enough
+    if (vs->errors > 20)
+        return;
+
+    printf("IR verify error in %s b%d", vs->f->name, block);
+
+    if (instr != IR_NONE)
+        printf(" v%d (%s)", instr, ir_op_name(vs->f->instrs[instr].op));
+
+    printf(": %s\n", msg);
+}
+
+//a value used at (block, pos) must be defined in a dominating position
+static void verify_use(VerifyState *vs, int user, int value, int use_block, int phi_pred)
+{
+    const IrFunc *f = vs->f;
+    const IrInstr *def;
+
+    if (value < 0 || value >= f->instr_count)
+    {
+        verify_error(vs, use_block, user, "operand out of range");
+        return;
+    }
+
+    def = &f->instrs[value];
+
+    if (def->block == IR_NONE || !ir_defines_value(def))
+    {
+        verify_error(vs, use_block, user, "operand does not name a live value");
+        return;
+    }
+
+    if (phi_pred != IR_NONE)
+    {
+        //phi inputs only have to be available at the end of their predecessor
+        if (!ir_dominates(vs->idom, def->block, phi_pred))
+            verify_error(vs, use_block, user, "phi input does not dominate its predecessor");
+        return;
+    }
+
+    if (def->block == use_block)
+    {
+        if (vs->position[value] >= vs->position[user])
+            verify_error(vs, use_block, user, "operand used before its definition");
+        return;
+    }
+
+    if (!ir_dominates(vs->idom, def->block, use_block))
+        verify_error(vs, use_block, user, "definition does not dominate use");
+}
+
+static IrType operand_type(const IrFunc *f, int value)
+{
+    if (value < 0 || value >= f->instr_count)
+        return IRT_VOID;
+
+    return f->instrs[value].type;
+}
+
+static void verify_types(VerifyState *vs, int b, int i)
+{
+    const IrFunc *f = vs->f;
+    const IrInstr *in = &f->instrs[i];
+    IrType ta = operand_type(f, in->a);
+    IrType tb = operand_type(f, in->b);
+
+    if (in->type == IRT_VEC && f->vector_bytes != 16 && f->vector_bytes != 32)
+        verify_error(vs, b, i, "vector value in a function without a vector width");
+
+    switch (in->op)
+    {
+        case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_UDIV:
+        case IR_MOD: case IR_UMOD: case IR_AND: case IR_OR: case IR_XOR:
+        case IR_SHL: case IR_SHR: case IR_USHR:
+            if (ta != in->type || tb != in->type)
+                verify_error(vs, b, i, "operand types differ from the result type");
+            break;
+
+        case IR_NEG:
+        case IR_NOT:
+            if (ta != in->type)
+                verify_error(vs, b, i, "operand type differs from the result type");
+            break;
+
+        case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+        case IR_ULT: case IR_ULE: case IR_UGT: case IR_UGE:
+            if (ta != tb)
+                verify_error(vs, b, i, "compared values have different types");
+            if (in->type != IRT_I32)
+                verify_error(vs, b, i, "comparison must produce i32");
+            break;
+
+        case IR_OFFSET:
+        case IR_LOAD:
+        case IR_MEMZERO:
+            if (ta != IRT_PTR)
+                verify_error(vs, b, i, "address operand is not a pointer");
+            break;
+
+        case IR_INDEX:
+            if (ta != IRT_PTR || tb != IRT_I64)
+                verify_error(vs, b, i, "index needs a pointer and an i64");
+            break;
+
+        case IR_STORE:
+            if (ta != IRT_PTR)
+                verify_error(vs, b, i, "store address is not a pointer");
+            if (tb == IRT_VOID)
+                verify_error(vs, b, i, "store of a value-less operand");
+            break;
+
+        case IR_MEMCPY:
+            if (ta != IRT_PTR || tb != IRT_PTR)
+                verify_error(vs, b, i, "memcpy needs two pointers");
+            break;
+
+        case IR_VSPLAT:
+            if (ta != (IrType)in->aux || in->type != IRT_VEC)
+                verify_error(vs, b, i, "splat operand does not have the lane type");
+            break;
+
+        case IR_VLOAD:
+            if (ta != IRT_PTR || in->type != IRT_VEC)
+                verify_error(vs, b, i, "vector load needs a pointer");
+            break;
+
+        case IR_VSTORE:
+            if (ta != IRT_PTR || tb != IRT_VEC)
+                verify_error(vs, b, i, "vector store needs a pointer and a vector");
+            break;
+
+        case IR_VADD: case IR_VSUB: case IR_VMUL: case IR_VDIV:
+        case IR_VAND: case IR_VOR: case IR_VXOR:
+            if (ta != IRT_VEC || tb != IRT_VEC || in->type != IRT_VEC)
+                verify_error(vs, b, i, "vector operation on a non-vector");
+            if ((in->op == IR_VDIV && !ir_type_is_float(in->aux)) ||
+                (in->op >= IR_VAND && ir_type_is_float(in->aux)))
+                verify_error(vs, b, i, "vector operation does not suit the lane type");
+            break;
+
+        case IR_VSUM:
+            if (ta != IRT_VEC || in->type != (IrType)in->aux || ir_type_is_float(in->aux))
+                verify_error(vs, b, i, "vector sum needs integer lanes of the result type");
+            break;
+
+        case IR_BR:
+            if (ta == IRT_VOID || ta == IRT_VEC || ir_type_is_float(ta))
+                verify_error(vs, b, i, "branch condition must be an integer or pointer");
+            break;
+
+        case IR_SWITCH:
+            if (ta != IRT_I64)
+                verify_error(vs, b, i, "switch index must be i64");
+
+            if (in->aux < 1 || in->imm < 0 || in->imm >= f->case_count ||
+                in->imm + 1 + f->cases[in->imm] + in->aux > f->case_count || f->cases[in->imm] < 1)
+                verify_error(vs, b, i, "switch table outside the case pool");
+            else
+            {
+                for (int k = 0; k < in->aux; k++)
+                {
+                    int s = f->cases[in->imm + 1 + f->cases[in->imm] + k];
+
+                    if (s < 0 || s >= f->cases[in->imm])
+                        verify_error(vs, b, i, "switch entry names no successor");
+                }
+            }
+            break;
+
+        case IR_RET:
+            if ((in->a == IR_NONE) != (f->ret_type == IRT_VOID) ||
+                (in->a != IR_NONE && ta != f->ret_type))
+                verify_error(vs, b, i, "returned value does not match the function type");
+            break;
+
+        case IR_PHI:
+            for (int k = 0; k < in->nargs; k++)
+            {
+                if (operand_type(f, f->operands[in->args + k]) != in->type)
+                {
+                    verify_error(vs, b, i, "phi input has a different type");
+                    break;
+                }
+            }
+            break;
+
+        case IR_CALL:
+        {
+            const IrFunc *callee;
+
+            if (in->aux < 0 || in->aux >= vs->m->func_count)
+            {
+                verify_error(vs, b, i, "call to an unknown function");
+                break;
+            }
+
+            callee = &vs->m->funcs[in->aux];
+
+            if (in->nargs != callee->param_count)
+            {
+                verify_error(vs, b, i, "argument count does not match the callee");
+                break;
+            }
+
+            for (int k = 0; k < in->nargs; k++)
+            {
+                if (operand_type(f, f->operands[in->args + k]) != callee->param_types[k])
+                    verify_error(vs, b, i, "argument type does not match the callee");
+            }
+
+            if (in->type != callee->ret_type)
+                verify_error(vs, b, i, "call result type does not match the callee");
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+int ir_verify_func(const IrModule *m, const IrFunc *f)
+{
+    VerifyState vs;
+
+    vs.m        = m;
+    vs.f        = f;
+    vs.errors   = 0;
+    vs.idom     = malloc((f->block_count + 1) * sizeof(int));
+    vs.position = calloc(f->instr_count + 1, sizeof(int));
+
+    if (!vs.idom || !vs.position)
+    {
+        fprintf(stderr, "Fatal: failed to allocate verifier scratch\n");
+        exit(1);
+    }
+
+    if (f->block_count == 0)
+        verify_error(&vs, 0, IR_NONE, "function has no blocks");
+
+    ir_dominators(f, vs.idom);
+
+    //block structure
+    for (int b = 0; b < f->block_count; b++)
+    {
+        const IrBlock *blk = &f->blocks[b];
+        int pos = 0;
+        int seen_non_phi = 0;
+
+        if (blk->last == IR_NONE || !ir_is_terminator(f->instrs[blk->last].op))
+            verify_error(&vs, b, blk->last, "block does not end in a terminator");
+
+        for (int i = blk->first, prev = IR_NONE; i != IR_NONE; prev = i, i = f->instrs[i].next)
+        {
+            const IrInstr *in = &f->instrs[i];
+
+            vs.position[i] = pos++;
+
+            if (in->block != b || in->prev != prev)
+                verify_error(&vs, b, i, "instruction list is inconsistent");
+
+            if (in->op == IR_NOP)
+                verify_error(&vs, b, i, "deleted instruction still linked");
+
+            if (in->op == IR_PHI && seen_non_phi)
+                verify_error(&vs, b, i, "phi after a non-phi instruction");
+
+            if (in->op != IR_PHI)
+                seen_non_phi = 1;
+
+            if (ir_is_terminator(in->op) && i != blk->last)
+                verify_error(&vs, b, i, "terminator in the middle of a block");
+
+            if (in->op == IR_PHI && in->nargs != blk->pred_count)
+                verify_error(&vs, b, i, "phi input count differs from the predecessor count");
+        }
+
+        //every edge appears once on each side
+        const int *succ;
+        int n = ir_successors(f, b, &succ);
+
+        for (int s = 0; s < n; s++)
+        {
+            int edges = 0;
+            int back = 0;
+
+            if (succ[s] < 0 || succ[s] >= f->block_count)
+            {
+                verify_error(&vs, b, blk->last, "branch to a missing block");
+                continue;
+            }
+
+            for (int k = 0; k < n; k++)
+                edges += (succ[k] == succ[s]);
+
+            for (int p = 0; p < f->blocks[succ[s]].pred_count; p++)
+                back += (f->blocks[succ[s]].preds[p] == b);
+
+            if (edges != back)
+                verify_error(&vs, b, blk->last, "successor does not list this block as a predecessor");
+        }
+
+        for (int p = 0; p < blk->pred_count; p++)
+        {
+            int pred = blk->preds[p];
+            int found = 0;
+
+            if (pred < 0 || pred >= f->block_count)
+            {
+                verify_error(&vs, b, IR_NONE, "predecessor out of range");
+                continue;
+            }
+
+            n = ir_successors(f, pred, &succ);
+
+            for (int s = 0; s < n; s++)
+                found |= (succ[s] == b);
+
+            if (!found)
+                verify_error(&vs, b, IR_NONE, "predecessor does not branch here");
+        }
+
+        if (b == 0 && blk->pred_count > 0)
+            verify_error(&vs, b, IR_NONE, "entry block has predecessors");
+    }
+
+    //operands and types
+    for (int b = 0; b < f->block_count; b++)
+    {
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+        {
+            const IrInstr *in = &f->instrs[i];
+
+            if (in->op == IR_PHI)
+            {
+                for (int k = 0; k < in->nargs && k < f->blocks[b].pred_count; k++)
+                    verify_use(&vs, i, f->operands[in->args + k], b, f->blocks[b].preds[k]);
+            }
+            else
+            {
+                if (in->a != IR_NONE)
+                    verify_use(&vs, i, in->a, b, IR_NONE);
+                if (in->b != IR_NONE)
+                    verify_use(&vs, i, in->b, b, IR_NONE);
+
+                for (int k = 0; k < in->nargs; k++)
+                    verify_use(&vs, i, f->operands[in->args + k], b, IR_NONE);
+            }
+
+            verify_types(&vs, b, i);
+        }
+    }
+
+    free(vs.idom);
+    free(vs.position);
+
+    return vs.errors;
+}
+
+int ir_verify_module(const IrModule *m)
+{
+    int errors = 0;
+
+    //an EXTERN function without a body has nothing to check; its body is in another module
+    for (int i = 0; i < m->func_count; i++)
+    {
+        if (!m->funcs[i].is_extern)
+            errors += ir_verify_func(m, &m->funcs[i]);
+    }
+
+    return errors;
+}
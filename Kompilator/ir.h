@@ -0,0 +1,301 @@
+#ifndef IR_H
+#define IR_H
+
+/* ---------------------------------------------
+   Intermediate representation
+
+   Typed three-address code in SSA form. Every
+   instruction defines at most one value and is
+   named by its index in IrFunc.instrs, so "v12"
+   is both the instruction and its result.
+
+   Instructions of a block form a doubly linked
+   list threaded through the flat instruction
+   array, which lets passes insert and delete
+   without moving anything. Phi nodes sit at the
+   top of their block; operand i of a phi flows in
+   from IrBlock.preds[i].
+
+   A SWITCH keeps its successors in IrFunc.cases,
+   starting at its imm:
+
+       S, succ[0] .. succ[S-1], table[0] .. table[aux-1]
+
+   succ[0] is the default and every block appears
+   once; table[k] is the successor (0 .. S-1) for
+   index k. Indices of aux or more take the
+   default.
+--------------------------------------------- */
+#define IR_NONE (-1)
+
+typedef enum IrType {
+    IRT_VOID,
+    IRT_I8,
+    IRT_I16,
+    IRT_I32,
+    IRT_I64,
+    IRT_F32,
+    IRT_F64,
+    IRT_PTR,
+    IRT_VEC         // SIMD register of IrFunc.vector_bytes, lanes of the instruction's aux type
+} IrType;
+
+typedef enum IrOp {
+    IR_NOP,         // deleted instruction, still linked until compaction
+
+    // leaves
+    IR_CONST,       // imm (integers, sign-extended from their width) or fimm (floats)
+    IR_UNDEF,       // value of a variable read before any write
+    IR_PARAM,       // aux: parameter index
+    IR_SLOT,        // address of frame slot aux
+    IR_GLOBAL,      // address of module global aux
+    IR_STRING,      // address of module string literal aux
+    IR_FUNCADDR,    // address of module function aux
+
+    // arithmetic, operands and result share one type
+    IR_ADD,
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_UDIV,
+    IR_MOD,
+    IR_UMOD,
+    IR_AND,
+    IR_OR,
+    IR_XOR,
+    IR_SHL,
+    IR_SHR,         // arithmetic right shift
+    IR_USHR,        // logical right shift
+    IR_NEG,
+    IR_NOT,         // bitwise complement
+
+    // comparisons produce IRT_I32 0 / 1
+    IR_EQ,
+    IR_NE,
+    IR_LT,
+    IR_LE,
+    IR_GT,
+    IR_GE,
+    IR_ULT,
+    IR_ULE,
+    IR_UGT,
+    IR_UGE,
+
+    // conversions, result type is the target
+    IR_SEXT,
+    IR_ZEXT,
+    IR_TRUNC,
+    IR_ITOF,
+    IR_UTOF,
+    IR_FTOI,
+    IR_FCONV,
+    IR_COPY,        // same bits, possibly retyped between IRT_I64 and IRT_PTR
+
+    // addressing
+    IR_OFFSET,      // a + imm
+    IR_INDEX,       // a + b * imm   (b is IRT_I64)
+
+    // memory
+    IR_LOAD,        // *a
+    IR_STORE,       // *a = b
+    IR_MEMCPY,      // copy imm bytes from b to a
+    IR_MEMZERO,     // clear imm bytes at a
+
+    // vectors, aux: lane type (i32, i64, f32, f64); only the native back end runs them
+    IR_VSPLAT,      // every lane = a
+    IR_VLOAD,       // lanes from *a, unaligned
+    IR_VSTORE,      // *a = b, unaligned
+    IR_VADD,
+    IR_VSUB,
+    IR_VMUL,
+    IR_VDIV,        // float lanes only
+    IR_VAND,        // integer lanes only
+    IR_VOR,
+    IR_VXOR,
+    IR_VSUM,        // integer lanes of a added up, result has the lane type
+
+    IR_CALL,        // aux: callee function, args/nargs: arguments
+    IR_PHI,         // args/nargs: one incoming value per predecessor
+
+    // terminators
+    IR_JMP,         // target[0]
+    IR_BR,          // a != 0 ? target[0] : target[1]
+    IR_SWITCH,      // jump table on unsigned i64 a, see IrFunc.cases
+    IR_RET,         // a, or IR_NONE in a TOM function
+
+    IR_OP_COUNT
+} IrOp;
+
+typedef struct IrInstr {
+    IrOp       op;
+    IrType     type;        // type of the defined value, IRT_VOID if none
+    int        a;
+    int        b;
+    int        args;        // first entry in IrFunc.operands
+    int        nargs;
+    long long  imm;
+    double     fimm;
+    int        aux;
+    int        target[2];   // successor blocks of JMP / BR
+    int        block;
+    int        prev;
+    int        next;
+} IrInstr;
+
+typedef struct IrBlock {
+    int        first;       // first instruction, IR_NONE if empty
+    int        last;
+
+    int       *preds;
+    int        pred_count;
+    int        pred_capacity;
+
+    int        sealed;      // all predecessors known (SSA construction)
+} IrBlock;
+
+typedef struct IrSlot {
+    int        size;
+    int        align;
+    int        sym;         // symbol the slot holds, -1 for temporaries
+} IrSlot;
+
+typedef struct IrFunc {
+    const char *name;
+    int         node;           // FUNCTION node
+    int         is_extern;
+
+    IrType      ret_type;
+    IrType     *param_types;
+    int         param_count;
+
+    IrInstr    *instrs;
+    int         instr_count;
+    int         instr_capacity;
+
+    IrBlock    *blocks;         // blocks[0] is the entry
+    int         block_count;
+    int         block_capacity;
+
+    int        *operands;       // phi incoming values and call arguments
+    int         operand_count;
+    int         operand_capacity;
+
+    int        *cases;          // SWITCH successors and tables
+    int         case_count;
+    int         case_capacity;
+
+    IrSlot     *slots;
+    int         slot_count;
+    int         slot_capacity;
+
+    int         vector_bytes;   // width of IRT_VEC values: 16 or 32, 0 while there are none
+} IrFunc;
+
+typedef struct IrGlobal {
+    char          *name;        // owned copy (static locals get mangled names)
+    int            size;
+    int            align;
+    unsigned char *data;        // initial bytes, size long
+    int            node;        // declaring VAR_DECL
+    int            is_extern;
+    int            is_static;   // STATISK: not visible to other modules
+} IrGlobal;
+
+/* pointer-sized values inside global data that depend on final addresses */
+typedef enum IrRelocKind {
+    IR_RELOC_STRING,
+    IR_RELOC_GLOBAL,
+    IR_RELOC_FUNC
+} IrRelocKind;
+
+typedef struct IrReloc {
+    int          global;        // global whose data holds the pointer
+    int          offset;        // byte offset inside that global
+    IrRelocKind  kind;
+    int          target;        // string, global or function index
+    long long    addend;
+} IrReloc;
+
+typedef struct IrString {
+    char *data;                 // decoded bytes, NUL terminated
+    int   length;               // without the NUL
+} IrString;
+
+typedef struct IrModule {
+    IrFunc   *funcs;
+    int       func_count;
+    int       func_capacity;
+
+    IrGlobal *globals;
+    int       global_count;
+    int       global_capacity;
+
+    IrReloc  *relocs;
+    int       reloc_count;
+    int       reloc_capacity;
+
+    IrString *strings;
+    int       string_count;
+    int       string_capacity;
+
+    int       entry;            // index of ENTRE, -1 if missing
+} IrModule;
+
+
+/* module */
+void init_ir_module(IrModule *m);
+void free_ir_module(IrModule *m);
+int  ir_add_func(IrModule *m, const char *name);
+int  ir_add_global(IrModule *m, const char *name, int size, int align);
+int  ir_add_string(IrModule *m, const char *data, int length);
+void ir_add_reloc(IrModule *m, int global, int offset, IrRelocKind kind, int target, long long addend);
+int  ir_find_func(const IrModule *m, const char *name);
+
+/* building */
+int  ir_new_block(IrFunc *f);
+int  ir_new_slot(IrFunc *f, int size, int align, int sym);
+int  ir_new_instr(IrFunc *f, IrOp op, IrType type, int a, int b);
+void ir_append(IrFunc *f, int block, int instr);
+void ir_prepend(IrFunc *f, int block, int instr);
+void ir_insert_before(IrFunc *f, int before, int instr);
+void ir_move_before(IrFunc *f, int before, int instr);
+void ir_remove(IrFunc *f, int instr);
+int  ir_add_operands(IrFunc *f, const int *values, int count);
+void ir_add_pred(IrFunc *f, int block, int pred);
+int  ir_terminator(const IrFunc *f, int block);
+// SWITCH on index whose table names count blocks; appended nowhere yet
+int  ir_new_switch(IrFunc *f, int index, int default_block, const int *table, int count);
+// copies the cases of a SWITCH in from into to, returns the new imm
+int  ir_copy_cases(IrFunc *to, const IrFunc *from, int instr);
+// successor (0 is the default) a SWITCH takes for index
+int  ir_switch_successor(const IrFunc *f, int instr, long long index);
+// *out points at the successors of block, valid until the function grows
+int  ir_successors(const IrFunc *f, int block, const int **out);
+// editable successors of a terminator, none for anything else
+int *ir_targets(IrFunc *f, int instr, int *count);
+void ir_replace_uses(IrFunc *f, int from, int to);
+
+/* analysis */
+int  ir_is_terminator(IrOp op);
+int  ir_has_side_effects(IrOp op);
+int  ir_defines_value(const IrInstr *in);
+void ir_compute_preds(IrFunc *f);
+void ir_compact(IrFunc *f);
+int  ir_dominators(const IrFunc *f, int *idom);
+int  ir_dominates(const int *idom, int a, int b);
+
+/* output */
+const char *ir_op_name(IrOp op);
+const char *ir_type_name(IrType type);
+int  ir_type_size(IrType type);
+int  ir_type_is_float(IrType type);
+int  ir_is_vector_op(IrOp op);
+long long ir_wrap_int(IrType type, long long value);
+int  ir_compare_ints(IrOp op, IrType type, long long x, long long y);
+void dump_ir_func(const IrModule *m, const IrFunc *f);
+void dump_ir_module(const IrModule *m);
+
+int  ir_verify_func(const IrModule *m, const IrFunc *f);
+int  ir_verify_module(const IrModule *m);
+
+#endif /* IR_H */
@@ -0,0 +1,867 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "jit.h"
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__))
+#define JIT_AVAILABLE 1
+#include <sys/mman.h>
+#else
+#define JIT_AVAILABLE 0
+#endif
+
+#if JIT_AVAILABLE
+
+enum {
+    RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+    R8 = 8, R12 = 12, R13 = 13, R14 = 14
+};
+
+/* jump targets that are not bytecode instructions */
+#define TARGET_DIV_ZERO   (-1)
+#define TARGET_FAIL       (-2)
+#define TARGET_EPILOGUE   (-3)
+
+typedef struct JitPatch {
+    int at;         // offset of a rel32 field
+    int target;     // instruction index inside the function, or TARGET_*
+} JitPatch;
+
+typedef struct JitState {
+    VmState         *vm;
+    const VmFunc    *f;
+    int              fi;
+
+    unsigned char   *code;
+    int              length;
+    int              capacity;
+
+    JitPatch        *patches;
+    int              patch_count;
+    int              patch_capacity;
+
+    int             *offset;    // per instruction of f: start of its machine code
+} JitState;
+
+static void *grow(void *ptr, int *capacity, int count, size_t elem_size, const char *what)
+{
+    if (count < *capacity)
+        return ptr;
+
+    *capacity = *capacity ? *capacity * 2 : 256;
+    ptr = realloc(ptr, (size_t)*capacity * elem_size);
+
+    if (!ptr)
+    {
+        fprintf(stderr, "Fatal: %s realloc failed\n", what);
+        exit(1);
+    }
+
+    return ptr;
+}
+
+
+
+/*
+  _    _      _
+ | |  | |    | |
+ | |__| | ___| |_ __   ___ _ __ ___
+ |  __  |/ _ \ | '_ \ / _ \ '__/ __|
+ | |  | |  __/ | |_) |  __/ |  \__ \
+ |_|  |_|\___|_| .__/ \___|_|   \___/
+               | |
+               |_|
+*/
+
+/* compiled code calls these; their addresses are patched into the templates */
+
+static int jit_call(VmState *vm, int callee, VmValue *regs, unsigned char *frame, int caller)
+{
+    const VmProgram *p = vm->program;
+    const VmFunc *f = &p->funcs[callee];
+
+    if (f->is_extern)
+    {
+        fprintf(vm->out, "Runtime error in %s: call to EXTERN function %s, which has no body\n", p->funcs[caller].name, f->name);
+        return 1;
+    }
+
+    if (vm->depth + 1 >= VM_CALL_DEPTH ||
+        regs + f->reg_count > vm->regs + VM_REGISTER_STACK ||
+        frame + f->frame_size > vm->frames + VM_FRAME_STACK)
+    {
+        fprintf(vm->out, "Runtime error in %s: stack overflow calling %s\n", p->funcs[caller].name, f->name);
+        return 1;
+    }
+
+    return vm_invoke(vm, callee, regs, frame);
+}
+
+static void jit_division_by_zero(VmState *vm, int func)
+{
+    fprintf(vm->out, "Runtime error in %s: division by zero\n", vm->program->funcs[func].name);
+}
+
+
+
+/*
+  ______                     _ _
+ |  ____|                   | (_)
+ | |__   _ __   ___ ___   __| |_ _ __   __ _
+ |  __| | '_ \ / __/ _ \ / _` | | '_ \ / _` |
+ | |____| | | | (_| (_) | (_| | | | | | (_| |
+ |______|_| |_|\___\___/ \__,_|_|_| |_|\__, |
+                                        __/ |
+                                       |___/
+*/
+
+static void put8(JitState *j, int byte)
+{
+    j->code = grow(j->code, &j->capacity, j->length, 1, "JIT code");
+    j->code[j->length++] = (unsigned char)byte;
+}
+
+static void put_bytes(JitState *j, const char *bytes, int count)
+{
+    for (int i = 0; i < count; i++)
+        put8(j, (unsigned char)bytes[i]);
+}
+
+static void put32(JitState *j, int32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        put8(j, (int)(((uint32_t)value >> (8 * i)) & 0xFF));
+}
+
+static void put64(JitState *j, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+        put8(j, (int)((value >> (8 * i)) & 0xFF));
+}
+
+#define BYTES(j, text) put_bytes(j, text, (int)sizeof(text) - 1)
+
+/* one memory-operand template: [legacy] [REX] opcode modrm [sib] disp32, always [base + disp32] */
+static void mem(JitState *j, int legacy, int wide, int op_len, unsigned op, int reg, int base, int32_t disp)
+{
+    int rex = (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((base & 8) ? 1 : 0);
+
+    if (legacy)
+        put8(j, legacy);
+
+    if (rex)
+        put8(j, 0x40 | rex);
+
+    for (int i = op_len - 1; i >= 0; i--)
+        put8(j, (int)((op >> (8 * i)) & 0xFF));
+
+    put8(j, 0x80 | ((reg & 7) << 3) | (base & 7));
+
+    //rsp / r12 as a base need a SIB byte
+    if ((base & 7) == RSP)
+        put8(j, 0x24);
+
+    put32(j, disp);
+}
+
+static int32_t slot(int reg)
+{
+    return (int32_t)(reg * (int)sizeof(VmValue));
+}
+
+static void load(JitState *j, int reg, int vreg)   { mem(j, 0, 1, 1, 0x8B, reg, RBX, slot(vreg)); }
+static void store(JitState *j, int vreg, int reg)  { mem(j, 0, 1, 1, 0x89, reg, RBX, slot(vreg)); }
+static void loadsd(JitState *j, int x, int vreg)   { mem(j, 0xF2, 0, 2, 0x0F10, x, RBX, slot(vreg)); }
+static void storesd(JitState *j, int vreg, int x)  { mem(j, 0xF2, 0, 2, 0x0F11, x, RBX, slot(vreg)); }
+
+//movsxd rax, eax: back to the sign-extended register convention after 32-bit work
+static void sext_eax(JitState *j)
+{
+    BYTES(j, "\x48\x63\xC0");
+}
+
+static void call_abs(JitState *j, const void *fn)
+{
+    put8(j, 0x48);                      // mov rax, imm64
+    put8(j, 0xB8);
+    put64(j, (uint64_t)(uintptr_t)fn);
+    BYTES(j, "\xFF\xD0");               // call rax
+}
+
+//rel32 jump (opcode bytes given) to an instruction or a TARGET_*, fixed up at the end
+static void jump(JitState *j, const char *op, int op_len, int target)
+{
+    put_bytes(j, op, op_len);
+
+    j->patches = grow(j->patches, &j->patch_capacity, j->patch_count, sizeof(JitPatch), "JIT patch");
+    j->patches[j->patch_count].at     = j->length;
+    j->patches[j->patch_count].target = target;
+    j->patch_count++;
+
+    put32(j, 0);
+}
+
+//short forward jump inside one template; returns the rel8 to fill in with land()
+static int skip(JitState *j, int op)
+{
+    put8(j, op);
+    put8(j, 0);
+    return j->length - 1;
+}
+
+static void land(JitState *j, int at)
+{
+    j->code[at] = (unsigned char)(j->length - (at + 1));
+}
+
+
+
+/*
+  _______                   _       _
+ |__   __|                 | |     | |
+    | | ___ _ __ ___  _ __ | | __ _| |_ ___  ___
+    | |/ _ \ '_ ` _ \| '_ \| |/ _` | __/ _ \/ __|
+    | |  __/ | | | | | |_) | | (_| | ||  __/\__ \
+    |_|\___|_| |_| |_| .__/|_|\__,_|\__\___||___/
+                     | |
+                     |_|
+*/
+
+static void emit_divide(JitState *j, const VmInstr *ip, int wide, int is_mod)
+{
+    int not_minus_one, done;
+
+    load(j, RCX, ip->b);
+    BYTES(j, "\x48\x85\xC9");                       // test rcx, rcx
+    jump(j, "\x0F\x84", 2, TARGET_DIV_ZERO);
+    load(j, RAX, ip->a);
+
+    //x / -1 wraps and x % -1 is 0, where idiv would trap on the minimum value
+    BYTES(j, "\x48\x83\xF9\xFF");                   // cmp rcx, -1
+    not_minus_one = skip(j, 0x75);
+
+    if (is_mod)
+        BYTES(j, "\x31\xC0");                       // xor eax, eax
+    else if (wide)
+        BYTES(j, "\x48\xF7\xD8");                   // neg rax
+    else
+        BYTES(j, "\xF7\xD8");                       // neg eax
+
+    done = skip(j, 0xEB);
+    land(j, not_minus_one);
+
+    if (wide)
+        BYTES(j, "\x48\x99\x48\xF7\xF9");           // cqo; idiv rcx
+    else
+        BYTES(j, "\x99\xF7\xF9");                   // cdq; idiv ecx
+
+    if (is_mod)
+        BYTES(j, "\x48\x89\xD0");                   // mov rax, rdx
+
+    land(j, done);
+
+    if (!wide)
+        sext_eax(j);
+
+    store(j, ip->dst, RAX);
+}
+
+static void emit_udivide(JitState *j, const VmInstr *ip, int wide, int is_mod)
+{
+    mem(j, 0, wide, 1, 0x8B, RCX, RBX, slot(ip->b));
+    put_bytes(j, wide ? "\x48\x85\xC9" : "\x85\xC9", wide ? 3 : 2);     // test
+    jump(j, "\x0F\x84", 2, TARGET_DIV_ZERO);
+    mem(j, 0, wide, 1, 0x8B, RAX, RBX, slot(ip->a));
+    BYTES(j, "\x31\xD2");                                               // xor edx, edx
+    put_bytes(j, wide ? "\x48\xF7\xF1" : "\xF7\xF1", wide ? 3 : 2);     // div
+
+    if (is_mod)
+        BYTES(j, "\x48\x89\xD0");                                       // mov rax, rdx
+
+    if (!wide)
+        sext_eax(j);
+
+    store(j, ip->dst, RAX);
+}
+
+//rax op [b] with a 32- or 64-bit register operand
+static void emit_binary(JitState *j, const VmInstr *ip, int wide, int op_len, unsigned op)
+{
+    load(j, RAX, ip->a);
+    mem(j, 0, wide, op_len, op, RAX, RBX, slot(ip->b));
+
+    if (!wide)
+        sext_eax(j);
+
+    store(j, ip->dst, RAX);
+}
+
+static void emit_shift(JitState *j, const VmInstr *ip, int wide, int ext)
+{
+    load(j, RAX, ip->a);
+    load(j, RCX, ip->b);
+
+    if (wide)
+        put8(j, 0x48);
+
+    put8(j, 0xD3);
+    put8(j, 0xC0 | (ext << 3));     // shl / shr / sar rax, cl
+
+    if (!wide)
+        sext_eax(j);
+
+    store(j, ip->dst, RAX);
+}
+
+static void emit_compare(JitState *j, const VmInstr *ip, int setcc)
+{
+    load(j, RAX, ip->a);
+    mem(j, 0, 1, 1, 0x3B, RAX, RBX, slot(ip->b));      // cmp rax, [b]
+    put8(j, 0x0F);
+    put8(j, setcc);
+    put8(j, 0xC0);                                      // setcc al
+    BYTES(j, "\x0F\xB6\xC0");                           // movzx eax, al
+    store(j, ip->dst, RAX);
+}
+
+//ucomisd leaves unordered as ZF=PF=CF=1; a / ae never hold for NaN
+static void emit_fcompare(JitState *j, const VmInstr *ip)
+{
+    int swap = (ip->op == OP_FLT || ip->op == OP_FLE);
+
+    loadsd(j, 0, swap ? ip->b : ip->a);
+    mem(j, 0x66, 0, 2, 0x0F2E, 0, RBX, slot(swap ? ip->a : ip->b));
+
+    switch (ip->op)
+    {
+        case OP_FEQ: BYTES(j, "\x0F\x94\xC0\x0F\x9B\xC1\x20\xC8"); break;  // sete al; setnp cl; and al, cl
+        case OP_FNE: BYTES(j, "\x0F\x95\xC0\x0F\x9A\xC1\x08\xC8"); break;  // setne al; setp cl; or al, cl
+        case OP_FLT:
+        case OP_FGT: BYTES(j, "\x0F\x97\xC0"); break;                      // seta al
+        default:     BYTES(j, "\x0F\x93\xC0"); break;                      // setae al
+    }
+
+    BYTES(j, "\x0F\xB6\xC0");
+    store(j, ip->dst, RAX);
+}
+
+static void emit_fbinary(JitState *j, const VmInstr *ip, unsigned op)
+{
+    loadsd(j, 0, ip->a);
+    mem(j, 0xF2, 0, 2, op, 0, RBX, slot(ip->b));
+    storesd(j, ip->dst, 0);
+}
+
+static void emit_load(JitState *j, const VmInstr *ip)
+{
+    load(j, RCX, ip->a);
+
+    switch (ip->op)
+    {
+        case OP_LOAD8:   mem(j, 0, 1, 2, 0x0FBE, RAX, RCX, ip->imm); break;
+        case OP_LOAD16:  mem(j, 0, 1, 2, 0x0FBF, RAX, RCX, ip->imm); break;
+        case OP_LOAD32:  mem(j, 0, 1, 1, 0x63,   RAX, RCX, ip->imm); break;
+
+        case OP_LOADF32:
+            mem(j, 0xF3, 0, 2, 0x0F5A, 0, RCX, ip->imm);    // cvtss2sd xmm0, [rcx + imm]
+            storesd(j, ip->dst, 0);
+            return;
+
+        default:         mem(j, 0, 1, 1, 0x8B,   RAX, RCX, ip->imm); break;
+    }
+
+    store(j, ip->dst, RAX);
+}
+
+static void emit_store(JitState *j, const VmInstr *ip)
+{
+    load(j, RCX, ip->a);
+
+    if (ip->op == OP_STOREF32)
+    {
+        mem(j, 0xF2, 0, 2, 0x0F5A, 0, RBX, slot(ip->b));   // cvtsd2ss xmm0, [b]
+        mem(j, 0xF3, 0, 2, 0x0F11, 0, RCX, ip->imm);       // movss [rcx + imm], xmm0
+        return;
+    }
+
+    load(j, RAX, ip->b);
+
+    switch (ip->op)
+    {
+        case OP_STORE8:  mem(j, 0,    0, 1, 0x88, RAX, RCX, ip->imm); break;
+        case OP_STORE16: mem(j, 0x66, 0, 1, 0x89, RAX, RCX, ip->imm); break;
+        case OP_STORE32: mem(j, 0,    0, 1, 0x89, RAX, RCX, ip->imm); break;
+        default:         mem(j, 0,    1, 1, 0x89, RAX, RCX, ip->imm); break;
+    }
+}
+
+static void emit_call(JitState *j, const VmInstr *ip)
+{
+    const VmProgram *p = j->vm->program;
+
+    //arguments go straight into the callee's window, as the interpreter does
+    for (int k = 0; k < ip->b; k++)
+    {
+        load(j, RAX, p->args[j->f->arg_start + ip->a + k]);
+        store(j, j->f->reg_count + k, RAX);
+    }
+
+    BYTES(j, "\x4C\x89\xEF");                                   // mov rdi, r13
+    put8(j, 0xBE);                                              // mov esi, callee
+    put32(j, ip->imm);
+    mem(j, 0, 1, 1, 0x8D, RDX, RBX, slot(j->f->reg_count));     // lea rdx, callee registers
+    mem(j, 0, 1, 1, 0x8D, RCX, R12, j->f->frame_size);          // lea rcx, callee frame
+    BYTES(j, "\x41\xB8");                                       // mov r8d, caller
+    put32(j, j->fi);
+    call_abs(j, (const void *)jit_call);
+
+    BYTES(j, "\x85\xC0");                                       // test eax, eax
+    jump(j, "\x0F\x85", 2, TARGET_FAIL);
+
+    if (ip->dst != VM_NO_REG)
+    {
+        mem(j, 0, 1, 1, 0x8B, RAX, R13, (int32_t)offsetof(VmState, ret));
+        store(j, ip->dst, RAX);
+    }
+}
+
+static void emit_tail_call(JitState *j, const VmInstr *ip)
+{
+    const VmProgram *p = j->vm->program;
+
+    //gathered above the window first, since an argument may be read from a register it replaces
+    for (int k = 0; k < ip->b; k++)
+    {
+        load(j, RAX, p->args[j->f->arg_start + ip->a + k]);
+        store(j, j->f->reg_count + k, RAX);
+    }
+
+    for (int k = 0; k < ip->b; k++)
+    {
+        load(j, RAX, j->f->reg_count + k);
+        store(j, k, RAX);
+    }
+
+    if (ip->imm == j->fi)
+    {
+        jump(j, "\xE9", 1, 0);
+        return;
+    }
+
+    BYTES(j, "\x4C\x89\xEF");                                   // mov rdi, r13
+    put8(j, 0xBE);                                              // mov esi, callee
+    put32(j, ip->imm);
+    BYTES(j, "\x48\x89\xDA");                                   // mov rdx, rbx   this window
+    BYTES(j, "\x4C\x89\xE1");                                   // mov rcx, r12   this frame
+    BYTES(j, "\x41\xB8");                                       // mov r8d, caller
+    put32(j, j->fi);
+    call_abs(j, (const void *)jit_call);
+
+    //the callee's result is already in vm->ret; eax holds its failure flag
+    jump(j, "\xE9", 1, TARGET_EPILOGUE);
+}
+
+//fused compare and branch: cmp with a register or a baked-in constant, then jcc
+static void emit_branch(JitState *j, const VmInstr *ip)
+{
+    //condition codes for EQ, NE, LT, LE, GT, GE, ULT, ULE, UGT, UGE
+    static const unsigned char cc[10] = { 0x4, 0x5, 0xC, 0xE, 0xF, 0xD, 0x2, 0x6, 0x7, 0x3 };
+    int with_const = (ip->op >= OP_BEQK);
+    char op[2];
+
+    load(j, RAX, ip->a);
+
+    if (with_const)
+    {
+        put8(j, 0x48);                                  // mov rcx, imm64
+        put8(j, 0xB9);
+        put64(j, j->vm->consts[ip->b].u);
+        BYTES(j, "\x48\x39\xC8");                       // cmp rax, rcx
+    }
+    else
+    {
+        mem(j, 0, 1, 1, 0x3B, RAX, RBX, slot(ip->b));  // cmp rax, [b]
+    }
+
+    op[0] = 0x0F;
+    op[1] = (char)(0x80 | cc[ip->op - (with_const ? OP_BEQK : OP_BEQ)]);
+    jump(j, op, 2, ip->imm - j->f->code_start);
+}
+
+//returns 0, or -1 for an opcode that has no template
+static int emit_instr(JitState *j, const VmInstr *ip)
+{
+    switch ((VmOp)ip->op)
+    {
+        case OP_NOP:
+            return 0;
+
+        case OP_MOV:
+            load(j, RAX, ip->a);
+            store(j, ip->dst, RAX);
+            return 0;
+
+        case OP_CONST:
+            //the resolved pool value is baked into the code
+            put8(j, 0x48);
+            put8(j, 0xB8);
+            put64(j, j->vm->consts[ip->imm].u);
+            store(j, ip->dst, RAX);
+            return 0;
+
+        case OP_SLOT:
+            mem(j, 0, 1, 1, 0x8D, RAX, R12, ip->imm);
+            store(j, ip->dst, RAX);
+            return 0;
+
+        case OP_ADD32: emit_binary(j, ip, 0, 1, 0x03);   return 0;
+        case OP_ADD64: emit_binary(j, ip, 1, 1, 0x03);   return 0;
+        case OP_SUB32: emit_binary(j, ip, 0, 1, 0x2B);   return 0;
+        case OP_SUB64: emit_binary(j, ip, 1, 1, 0x2B);   return 0;
+        case OP_MUL32: emit_binary(j, ip, 0, 2, 0x0FAF); return 0;
+        case OP_MUL64: emit_binary(j, ip, 1, 2, 0x0FAF); return 0;
+        case OP_AND:   emit_binary(j, ip, 1, 1, 0x23);   return 0;
+        case OP_OR:    emit_binary(j, ip, 1, 1, 0x0B);   return 0;
+        case OP_XOR:   emit_binary(j, ip, 1, 1, 0x33);   return 0;
+
+        case OP_DIV32:  emit_divide(j, ip, 0, 0);  return 0;
+        case OP_DIV64:  emit_divide(j, ip, 1, 0);  return 0;
+        case OP_MOD32:  emit_divide(j, ip, 0, 1);  return 0;
+        case OP_MOD64:  emit_divide(j, ip, 1, 1);  return 0;
+        case OP_UDIV32: emit_udivide(j, ip, 0, 0); return 0;
+        case OP_UDIV64: emit_udivide(j, ip, 1, 0); return 0;
+        case OP_UMOD32: emit_udivide(j, ip, 0, 1); return 0;
+        case OP_UMOD64: emit_udivide(j, ip, 1, 1); return 0;
+
+        //the hardware masks the count to 31 / 63 like the interpreter
+        case OP_SHL32:  emit_shift(j, ip, 0, 4); return 0;
+        case OP_SHL64:  emit_shift(j, ip, 1, 4); return 0;
+        case OP_SHR:    emit_shift(j, ip, 1, 7); return 0;
+        case OP_USHR32: emit_shift(j, ip, 0, 5); return 0;
+        case OP_USHR64: emit_shift(j, ip, 1, 5); return 0;
+
+        case OP_NEG32:
+        case OP_NEG64:
+        case OP_NOT:
+            load(j, RAX, ip->a);
+
+            if (ip->op == OP_NEG32)
+            {
+                BYTES(j, "\xF7\xD8");
+                sext_eax(j);
+            }
+            else
+            {
+                BYTES(j, "\x48\xF7");
+                put8(j, (ip->op == OP_NOT) ? 0xD0 : 0xD8);
+            }
+
+            store(j, ip->dst, RAX);
+            return 0;
+
+        case OP_SEXT8:  mem(j, 0, 1, 2, 0x0FBE, RAX, RBX, slot(ip->a)); store(j, ip->dst, RAX); return 0;
+        case OP_SEXT16: mem(j, 0, 1, 2, 0x0FBF, RAX, RBX, slot(ip->a)); store(j, ip->dst, RAX); return 0;
+        case OP_SEXT32: mem(j, 0, 1, 1, 0x63,   RAX, RBX, slot(ip->a)); store(j, ip->dst, RAX); return 0;
+        case OP_ZEXT8:  mem(j, 0, 0, 2, 0x0FB6, RAX, RBX, slot(ip->a)); store(j, ip->dst, RAX); return 0;
+        case OP_ZEXT16: mem(j, 0, 0, 2, 0x0FB7, RAX, RBX, slot(ip->a)); store(j, ip->dst, RAX); return 0;
+        case OP_ZEXT32: mem(j, 0, 0, 1, 0x8B,   RAX, RBX, slot(ip->a)); store(j, ip->dst, RAX); return 0;
+
+        case OP_FADD: emit_fbinary(j, ip, 0x0F58); return 0;
+        case OP_FSUB: emit_fbinary(j, ip, 0x0F5C); return 0;
+        case OP_FMUL: emit_fbinary(j, ip, 0x0F59); return 0;
+        case OP_FDIV: emit_fbinary(j, ip, 0x0F5E); return 0;
+
+        case OP_FNEG:
+            load(j, RAX, ip->a);
+            BYTES(j, "\x48\x0F\xBA\xF8\x3F");                   // btc rax, 63
+            store(j, ip->dst, RAX);
+            return 0;
+
+        case OP_FROUND32:
+            mem(j, 0xF2, 0, 2, 0x0F5A, 0, RBX, slot(ip->a));    // cvtsd2ss xmm0, [a]
+            BYTES(j, "\xF3\x0F\x5A\xC0");                       // cvtss2sd xmm0, xmm0
+            storesd(j, ip->dst, 0);
+            return 0;
+
+        case OP_ITOF:
+            mem(j, 0xF2, 1, 2, 0x0F2A, 0, RBX, slot(ip->a));    // cvtsi2sd xmm0, qword [a]
+            storesd(j, ip->dst, 0);
+            return 0;
+
+        case OP_FTOI:
+            mem(j, 0xF2, 1, 2, 0x0F2C, RAX, RBX, slot(ip->a));  // cvttsd2si rax, [a]
+            store(j, ip->dst, RAX);
+            return 0;
+
+        case OP_EQ:  emit_compare(j, ip, 0x94); return 0;
+        case OP_NE:  emit_compare(j, ip, 0x95); return 0;
+        case OP_LT:  emit_compare(j, ip, 0x9C); return 0;
+        case OP_LE:  emit_compare(j, ip, 0x9E); return 0;
+        case OP_GT:  emit_compare(j, ip, 0x9F); return 0;
+        case OP_GE:  emit_compare(j, ip, 0x9D); return 0;
+        case OP_ULT: emit_compare(j, ip, 0x92); return 0;
+        case OP_ULE: emit_compare(j, ip, 0x96); return 0;
+        case OP_UGT: emit_compare(j, ip, 0x97); return 0;
+        case OP_UGE: emit_compare(j, ip, 0x93); return 0;
+
+        case OP_FEQ:
+        case OP_FNE:
+        case OP_FLT:
+        case OP_FLE:
+        case OP_FGT:
+        case OP_FGE:
+            emit_fcompare(j, ip);
+            return 0;
+
+        case OP_OFFSET:
+            load(j, RAX, ip->a);
+            BYTES(j, "\x48\x05");                               // add rax, imm32
+            put32(j, ip->imm);
+            store(j, ip->dst, RAX);
+            return 0;
+
+        case OP_INDEX:
+            load(j, RAX, ip->b);
+            BYTES(j, "\x48\x69\xC0");                           // imul rax, rax, imm32
+            put32(j, ip->imm);
+            mem(j, 0, 1, 1, 0x03, RAX, RBX, slot(ip->a));
+            store(j, ip->dst, RAX);
+            return 0;
+
+        case OP_LOAD8:
+        case OP_LOAD16:
+        case OP_LOAD32:
+        case OP_LOAD64:
+        case OP_LOADF32:
+        case OP_LOADF64:
+            emit_load(j, ip);
+            return 0;
+
+        case OP_STORE8:
+        case OP_STORE16:
+        case OP_STORE32:
+        case OP_STORE64:
+        case OP_STOREF32:
+        case OP_STOREF64:
+            emit_store(j, ip);
+            return 0;
+
+        case OP_MEMCPY:
+        case OP_MEMZERO:
+            mem(j, 0, 1, 1, 0x8B, RDI, RBX, slot(ip->a));
+
+            if (ip->op == OP_MEMCPY)
+                mem(j, 0, 1, 1, 0x8B, RSI, RBX, slot(ip->b));
+            else
+                BYTES(j, "\x31\xF6");                           // xor esi, esi
+
+            put8(j, 0xBA);                                      // mov edx, size
+            put32(j, ip->imm);
+            call_abs(j, (ip->op == OP_MEMCPY) ? (const void *)memmove : (const void *)memset);
+            return 0;
+
+        case OP_CALL:
+            emit_call(j, ip);
+            return 0;
+
+        case OP_TAILCALL:
+            emit_tail_call(j, ip);
+            return 0;
+
+        case OP_JMP:
+            jump(j, "\xE9", 1, ip->imm - j->f->code_start);
+            return 0;
+
+        case OP_BRNZ:
+        case OP_BRZ:
+            mem(j, 0, 1, 1, 0x83, 7, RBX, slot(ip->a));         // cmp qword [a], 0
+            put8(j, 0);
+            jump(j, (ip->op == OP_BRNZ) ? "\x0F\x85" : "\x0F\x84", 2, ip->imm - j->f->code_start);
+            return 0;
+
+        //the n + 1 JMPs that follow are 5 bytes each, so the entry is an offset from here
+        case OP_SWITCH:
+            load(j, RAX, ip->a);
+            put8(j, 0xB9);                                      // mov ecx, n
+            put32(j, ip->imm);
+            BYTES(j, "\x48\x39\xC8");                           // cmp rax, rcx
+            BYTES(j, "\x48\x0F\x43\xC1");                       // cmovae rax, rcx
+            BYTES(j, "\x48\x8D\x04\x80");                       // lea rax, [rax + rax * 4]
+            BYTES(j, "\x48\x8D\x0D\x05\x00\x00\x00");           // lea rcx, [rip + 5]
+            BYTES(j, "\x48\x01\xC8");                           // add rax, rcx
+            BYTES(j, "\xFF\xE0");                               // jmp rax
+            return 0;
+
+        case OP_RET:
+            load(j, RAX, ip->a);
+            mem(j, 0, 1, 1, 0x89, RAX, R13, (int32_t)offsetof(VmState, ret));
+            BYTES(j, "\x31\xC0");
+            jump(j, "\xE9", 1, TARGET_EPILOGUE);
+            return 0;
+
+        case OP_RETV:
+            BYTES(j, "\x31\xC0");
+            jump(j, "\xE9", 1, TARGET_EPILOGUE);
+            return 0;
+
+        case OP_ADDI32:
+        case OP_ADDI64:
+            load(j, RAX, ip->a);
+            BYTES(j, "\x48\x05");                               // add rax, imm32
+            put32(j, ip->imm);
+
+            if (ip->op == OP_ADDI32)
+                sext_eax(j);
+
+            store(j, ip->dst, RAX);
+            return 0;
+
+        default:
+            if (ip->op >= OP_BEQ && ip->op <= OP_BUGEK)
+            {
+                emit_branch(j, ip);
+                return 0;
+            }
+
+            return -1;
+    }
+}
+
+
+
+/*
+  _____                                      _
+ |  __ \                                    | |
+ | |  | |_ __ _____   _____ _ __   __ _  ___| |_ ___
+ | |  | | '__/ _ \ \ / / _ \ '_ \ / _` |/ __| __/ __|
+ | |__| | | |  __/\ V /  __/ | | | (_| | (__| |_\__ \
+ |_____/|_|  \___| \_/ \___|_| |_|\__, |\___|\__|___/
+                                   __/ |
+                                  |___/
+*/
+
+//maps the finished code read-write, copies it and flips the pages to read-execute
+static void *install(VmState *vm, const unsigned char *code, int length)
+{
+    size_t size = ((size_t)length + 4095) & ~(size_t)4095;
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (base == MAP_FAILED)
+        return NULL;
+
+    memcpy(base, code, (size_t)length);
+
+    if (mprotect(base, size, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(base, size);
+        return NULL;
+    }
+
+    vm->jit_pages = grow(vm->jit_pages, &vm->jit_page_capacity, vm->jit_page_count, sizeof(VmJitPages), "JIT page list");
+    vm->jit_pages[vm->jit_page_count].base = base;
+    vm->jit_pages[vm->jit_page_count].size = size;
+    vm->jit_page_count++;
+
+    return base;
+}
+
+VmNative jit_compile(VmState *vm, int func)
+{
+    const VmFunc *f = &vm->program->funcs[func];
+    JitState state;
+    JitState *j = &state;
+    int stub[3];
+    int failed = 0;
+    void *entry = NULL;
+
+    if (f->is_extern || f->code_length == 0)
+        return NULL;
+
+    memset(j, 0, sizeof(*j));
+    j->vm = vm;
+    j->f  = f;
+    j->fi = func;
+    j->offset = malloc(((size_t)f->code_length + 1) * sizeof(int));
+
+    if (!j->offset)
+    {
+        fprintf(stderr, "Fatal: failed to allocate JIT offsets\n");
+        exit(1);
+    }
+
+    //push rbp, rbx, r12, r13, r14: five pushes keep rsp 16-byte aligned for calls
+    BYTES(j, "\x55\x53\x41\x54\x41\x55\x41\x56");
+    BYTES(j, "\x48\x89\xFB");           // mov rbx, rdi   registers
+    BYTES(j, "\x49\x89\xF4");           // mov r12, rsi   frame
+    BYTES(j, "\x49\x89\xD5");           // mov r13, rdx   VmState
+
+    for (int i = 0; i < f->code_length && !failed; i++)
+    {
+        j->offset[i] = j->length;
+        failed = emit_instr(j, &vm->program->code[f->code_start + i]) != 0;
+    }
+
+    if (!failed)
+    {
+        stub[0] = j->length;            // TARGET_DIV_ZERO
+        BYTES(j, "\x4C\x89\xEF");
+        put8(j, 0xBE);
+        put32(j, func);
+        call_abs(j, (const void *)jit_division_by_zero);
+
+        stub[1] = j->length;            // TARGET_FAIL
+        BYTES(j, "\xB8\x01\x00\x00\x00");
+
+        stub[2] = j->length;            // TARGET_EPILOGUE
+        BYTES(j, "\x41\x5E\x41\x5D\x41\x5C\x5B\x5D\xC3");
+
+        for (int i = 0; i < j->patch_count; i++)
+        {
+            int target = j->patches[i].target;
+            int to = (target >= 0) ? j->offset[target] : stub[-target - 1];
+            int32_t rel = to - (j->patches[i].at + 4);
+
+            memcpy(j->code + j->patches[i].at, &rel, 4);
+        }
+
+        entry = install(vm, j->code, j->length);
+    }
+
+    free(j->code);
+    free(j->patches);
+    free(j->offset);
+
+    return (VmNative)entry;
+}
+
+void jit_release(VmState *vm)
+{
+    for (int i = 0; i < vm->jit_page_count; i++)
+        munmap(vm->jit_pages[i].base, vm->jit_pages[i].size);
+
+    free(vm->jit_pages);
+
+    vm->jit_pages = NULL;
+    vm->jit_page_count = 0;
+    vm->jit_page_capacity = 0;
+}
+
+#else
+
+VmNative jit_compile(VmState *vm, int func)
+{
+    (void)vm;
+    (void)func;
+    return NULL;
+}
+
+void jit_release(VmState *vm)
+{
+    free(vm->jit_pages);
+    vm->jit_pages = NULL;
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "vm.h"
+
+/* ---------------------------------------------
+   JIT tier
+
+   Translates one bytecode function into x86-64
+   machine code by copying a fixed template per
+   opcode and patching in the register window
+   offsets, constants, helper addresses and jump
+   displacements. The code keeps the interpreter's
+   frame layout: rbx points at the function's
+   registers, r12 at its frame slots and r13 at
+   the VmState, so compiled and interpreted
+   functions call each other freely through
+   vm_invoke.
+
+   A TAILCALL to the function itself jumps back
+   to its first instruction; to another function
+   it calls in the same window and returns
+   whatever that call returned. A SWITCH clamps
+   its index and jumps into the 5-byte JMPs that
+   follow it, which makes them its table.
+
+   Code is written into anonymous pages that are
+   switched from writable to executable once the
+   function is complete. Opcodes without a
+   template (UTOF) leave the function to the
+   interpreter. On hosts that are not x86-64 with
+   mmap, jit_compile always declines.
+--------------------------------------------- */
+
+// returns the compiled entry, or NULL if the function stays interpreted
+VmNative jit_compile(VmState *vm, int func);
+
+// unmaps every compiled function of vm
+void jit_release(VmState *vm);
+
+#endif /* JIT_H */
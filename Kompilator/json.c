@@ -0,0 +1,417 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+
+typedef struct JsonReader {
+    const char *at;
+    const char *end;
+    int         depth;
+} JsonReader;
+
+static void *json_alloc(size_t size)
+{
+    void *p = calloc(1, size ? size : 1);
+
+    if (!p)
+    {
+        fprintf(stderr, "Fatal: failed to allocate JSON value\n");
+        exit(1);
+    }
+
+    return p;
+}
+
+static void skip_space(JsonReader *r)
+{
+    while (r->at < r->end && (*r->at == ' ' || *r->at == '\t' || *r->at == '\n' || *r->at == '\r'))
+        r->at++;
+}
+
+static int literal(JsonReader *r, const char *word)
+{
+    size_t len = strlen(word);
+
+    if ((size_t)(r->end - r->at) < len || memcmp(r->at, word, len) != 0)
+        return 0;
+
+    r->at += len;
+    return 1;
+}
+
+static int hex4(JsonReader *r, unsigned *out)
+{
+    unsigned v = 0;
+
+    if (r->end - r->at < 4)
+        return 0;
+
+    for (int i = 0; i < 4; i++)
+    {
+        char c = *r->at++;
+
+        v <<= 4;
+
+        if (c >= '0' && c <= '9')
+            v |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            v |= c - 'A' + 10;
+        else
+            return 0;
+    }
+
+    *out = v;
+    return 1;
+}
+
+static size_t put_utf8(char *out, unsigned cp)
+{
+    if (cp < 0x80)
+    {
+        out[0] = (char)cp;
+        return 1;
+    }
+
+    if (cp < 0x800)
+    {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+
+    if (cp < 0x10000)
+    {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+//decodes the string at r->at (its opening quote); escapes only shrink, so the raw length bounds the result
+static char *read_string(JsonReader *r, size_t *out_length)
+{
+    const char *start = ++r->at;
+    const char *close = start;
+    char *text;
+    size_t len = 0;
+
+    while (close < r->end && *close != '"')
+        close += (*close == '\\' && close + 1 < r->end) ? 2 : 1;
+
+    if (close >= r->end)
+        return NULL;
+
+    text = json_alloc(close - start + 1);
+
+    while (r->at < close)
+    {
+        char c = *r->at++;
+        unsigned cp;
+
+        if (c != '\\')
+        {
+            text[len++] = c;
+            continue;
+        }
+
+        switch (*r->at++)
+        {
+            case '"':  text[len++] = '"';  break;
+            case '\\': text[len++] = '\\'; break;
+            case '/':  text[len++] = '/';  break;
+            case 'b':  text[len++] = '\b'; break;
+            case 'f':  text[len++] = '\f'; break;
+            case 'n':  text[len++] = '\n'; break;
+            case 'r':  text[len++] = '\r'; break;
+            case 't':  text[len++] = '\t'; break;
+
+            case 'u':
+                if (!hex4(r, &cp))
+                {
+                    free(text);
+                    return NULL;
+                }
+
+                //a high surrogate takes the low one after it; a lone half becomes U+FFFD
+                if (cp >= 0xD800 && cp < 0xDC00)
+                {
+                    unsigned low;
+
+                    if (close - r->at >= 6 && r->at[0] == '\\' && r->at[1] == 'u')
+                    {
+                        r->at += 2;
+
+                        if (!hex4(r, &low))
+                        {
+                            free(text);
+                            return NULL;
+                        }
+
+                        cp = (low >= 0xDC00 && low < 0xE000) ? 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00) : 0xFFFD;
+                    }
+                    else
+                    {
+                        cp = 0xFFFD;
+                    }
+                }
+                else if (cp >= 0xDC00 && cp < 0xE000)
+                {
+                    cp = 0xFFFD;
+                }
+
+                len += put_utf8(text + len, cp);
+                break;
+
+            default:
+                free(text);
+                return NULL;
+        }
+    }
+
+    r->at = close + 1;
+    text[len] = '\0';
+    *out_length = len;
+
+    return text;
+}
+
+static JsonValue *read_value(JsonReader *r);
+
+//the elements of an array or members of an object, up to close
+static int read_children(JsonReader *r, JsonValue *parent, char close)
+{
+    JsonValue **tail = &parent->child;
+
+    r->at++;
+    skip_space(r);
+
+    if (r->at < r->end && *r->at == close)
+    {
+        r->at++;
+        return 1;
+    }
+
+    for (;;)
+    {
+        char *key = NULL;
+        JsonValue *item;
+
+        if (close == '}')
+        {
+            size_t key_length;
+
+            if (r->at >= r->end || *r->at != '"' || !(key = read_string(r, &key_length)))
+                return 0;
+
+            skip_space(r);
+
+            if (r->at >= r->end || *r->at != ':')
+            {
+                free(key);
+                return 0;
+            }
+
+            r->at++;
+        }
+
+        item = read_value(r);
+
+        if (!item)
+        {
+            free(key);
+            return 0;
+        }
+
+        item->key = key;
+        *tail = item;
+        tail = &item->next;
+
+        skip_space(r);
+
+        if (r->at < r->end && *r->at == ',')
+        {
+            r->at++;
+            skip_space(r);
+            continue;
+        }
+
+        if (r->at < r->end && *r->at == close)
+        {
+            r->at++;
+            return 1;
+        }
+
+        return 0;
+    }
+}
+
+static JsonValue *read_value(JsonReader *r)
+{
+    JsonValue *v;
+    const char *start;
+
+    skip_space(r);
+
+    if (r->at >= r->end || r->depth >= JSON_MAX_DEPTH)
+        return NULL;
+
+    v = json_alloc(sizeof(*v));
+    start = r->at;
+
+    switch (*r->at)
+    {
+        case '{':
+        case '[':
+            v->type = (*r->at == '{') ? JSON_OBJECT : JSON_ARRAY;
+            r->depth++;
+
+            if (!read_children(r, v, v->type == JSON_OBJECT ? '}' : ']'))
+            {
+                json_free(v);
+                return NULL;
+            }
+
+            r->depth--;
+            break;
+
+        case '"':
+            v->type = JSON_STRING;
+
+            if (!(v->string = read_string(r, &v->length)))
+            {
+                free(v);
+                return NULL;
+            }
+            break;
+
+        case 't':
+        case 'f':
+        case 'n':
+            if (literal(r, "true"))
+                v->type = JSON_TRUE;
+            else if (literal(r, "false"))
+                v->type = JSON_FALSE;
+            else if (literal(r, "null"))
+                v->type = JSON_NULL;
+            else
+            {
+                free(v);
+                return NULL;
+            }
+            break;
+
+        default:
+        {
+            char number[64];
+            size_t len = 0;
+            char *end;
+
+            while (r->at < r->end && len < sizeof(number) - 1 && strchr("+-0123456789.eE", *r->at))
+                number[len++] = *r->at++;
+
+            number[len] = '\0';
+            v->type = JSON_NUMBER;
+            v->number = strtod(number, &end);
+
+            if (len == 0 || *end != '\0')
+            {
+                free(v);
+                return NULL;
+            }
+            break;
+        }
+    }
+
+    v->raw      = start;
+    v->raw_size = r->at - start;
+
+    return v;
+}
+
+JsonValue *json_parse(const char *text, size_t size)
+{
+    JsonReader r = { text, text + size, 0 };
+    JsonValue *v = read_value(&r);
+
+    skip_space(&r);
+
+    if (v && r.at != r.end)
+    {
+        json_free(v);
+        return NULL;
+    }
+
+    return v;
+}
+
+void json_free(JsonValue *value)
+{
+    while (value)
+    {
+        JsonValue *next = value->next;
+
+        json_free(value->child);
+        free(value->string);
+        free(value->key);
+        free(value);
+
+        value = next;
+    }
+}
+
+const JsonValue *json_get(const JsonValue *object, const char *key)
+{
+    if (!object || object->type != JSON_OBJECT)
+        return NULL;
+
+    for (const JsonValue *m = object->child; m; m = m->next)
+    {
+        if (strcmp(m->key, key) == 0)
+            return m;
+    }
+
+    return NULL;
+}
+
+const char *json_string(const JsonValue *value)
+{
+    return (value && value->type == JSON_STRING) ? value->string : NULL;
+}
+
+long json_long(const JsonValue *value, long fallback)
+{
+    return (value && value->type == JSON_NUMBER) ? (long)value->number : fallback;
+}
+
+void json_write_string(FILE *out, const char *text, size_t size)
+{
+    fputc('"', out);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        unsigned char c = (unsigned char)text[i];
+
+        if (c == '"' || c == '\\')
+            fprintf(out, "\\%c", c);
+        else if (c == '\n')
+            fputs("\\n", out);
+        else if (c == '\t')
+            fputs("\\t", out);
+        else if (c < 0x20)
+            fprintf(out, "\\u%04x", c);
+        else
+            fputc(c, out);
+    }
+
+    fputc('"', out);
+}
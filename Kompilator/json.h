@@ -0,0 +1,57 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* ---------------------------------------------
+   JSON values (lsp.h)
+
+   Enough JSON for JSON-RPC: a message is parsed
+   into a tree of values, read through json_get
+   and friends, and freed whole. Strings are
+   decoded to UTF-8 (\u escapes included, with
+   surrogate pairs). Output is written directly
+   with fprintf; json_write_string escapes text
+   for it.
+--------------------------------------------- */
+
+#define JSON_MAX_DEPTH 256
+
+typedef enum JsonType {
+    JSON_NULL,
+    JSON_FALSE,
+    JSON_TRUE,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT
+} JsonType;
+
+typedef struct JsonValue {
+    JsonType          type;
+    double            number;
+    char             *string;       // JSON_STRING, decoded
+    size_t            length;       // of string, which may hold NULs
+    char             *key;          // member name, inside an object
+    struct JsonValue *child;        // first element or member
+    struct JsonValue *next;         // next element or member of the parent
+    const char       *raw;          // the value's text in the parsed buffer, while it lives
+    size_t            raw_size;
+} JsonValue;
+
+// parses size bytes of text; NULL if it is not one JSON value
+JsonValue *json_parse(const char *text, size_t size);
+void       json_free(JsonValue *value);
+
+// the member key of object, NULL if there is none or object is not an object
+const JsonValue *json_get(const JsonValue *object, const char *key);
+
+// typed reads of a value that may be NULL: the string or NULL, the number or fallback
+const char *json_string(const JsonValue *value);
+long        json_long(const JsonValue *value, long fallback);
+
+// writes size bytes of text as a JSON string, quotes included
+void json_write_string(FILE *out, const char *text, size_t size);
+
+#endif /* JSON_H */
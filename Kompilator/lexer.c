@@ -69,16 +69,30 @@ void lexer(
     char ***out_lexemes,
     int *out_lexeme_count,
     int **out_lexeme_cols,
-    int **out_lexeme_rows
+    int **out_lexeme_rows,
+
+    TimeReport *report
 )
 {
     LexState state = {0};
 
+    phase_begin(report);
     init_lex_state(&state, char_count, decode_buffer);
     lex_scan(&state);
+    phase_end(report, PHASE_LEX_SCAN, state.lexeme_count);
 
+    phase_begin(report);
     init_lex_resolve(&state);
     lex_resolve(&state);
+    phase_end(report, PHASE_LEX_RESOLVE, state.token_count);
+
+    //the resolved stream holds copies, so the scanned lexemes go here
+    for (int i = 0; i < state.lexeme_count; i++)
+        free(state.lexemes[i]);
+
+    free(state.lexemes);
+    free(state.lexeme_row);
+    free(state.lexeme_col);
 
     *out_tokens       = state.tokens;
     *out_token_count  = state.token_count;
@@ -97,6 +111,8 @@ void init_lex_state(LexState * state, int char_count, CharacterUnit * decode_buf
     state -> char_count = char_count;
     state -> char_stream = decode_buffer;
     state -> lexeme_capacity = 16;
+    state -> row = 1;
+    state -> col = 1;
 }
 
 
@@ -111,6 +127,8 @@ void lex_scan(LexState * state){
     {
         //printf("Current codepoint: %d\n", state -> current.codepoint);
 
+        int token_start = state -> lex_index;
+
         if (state -> current.codepoint == HORIZONTAL_TAB ||
             state -> current.codepoint == NEWLINE        ||
             state -> current.codepoint == SPACE          ||
@@ -208,6 +226,9 @@ void lex_scan(LexState * state){
             //printd("Resolving scan error!");
             advance(state);
         }
+
+        //the lexeme was recorded at its first column; the next one starts after it
+        state -> col += state -> lex_index - token_start;
         //printd("Loop iteration complete, starting next iteration!\n");
     }
     //printd("Lex Scanning Complete!");
@@ -434,6 +455,7 @@ void identify_string(LexState * state){
         advance(state);
     }
 
+    buf[len] = '\0';
     append_lexeme(state, buf);
 }
 
@@ -668,14 +690,14 @@ void lex_resolve(LexState *state)
     }
 
     // -----------------------------------------
-    // EOF sentinel
+    // EOF sentinel (an empty file has no last lexeme)
     // -----------------------------------------
     append_token(
         state,
         TOK_EOF,
         "EOF",
-        state->lexeme_row[state->lexeme_count - 1],
-        state->lexeme_col[state->lexeme_count - 1]
+        state->lexeme_count > 0 ? state->lexeme_row[state->lexeme_count - 1] : state->row,
+        state->lexeme_count > 0 ? state->lexeme_col[state->lexeme_count - 1] : state->col
     );
 }
 
@@ -1,8 +1,11 @@
+#ifndef LEXER_H
+#define LEXER_H
 
 #include <string.h>
 #include <stdlib.h>
 #include "utf_decoder.h"
 #include "tokenkeytab.h"
+#include "timing.h"
 
 typedef enum LexemeKind {
     LEX_KEYWORD,
@@ -62,7 +65,9 @@ void lexer(
     char ***out_lexemes,
     int *out_lexeme_count,
     int **out_lexeme_cols,
-    int **out_lexeme_rows
+    int **out_lexeme_rows,
+
+    TimeReport *report
 );
 
 void init_lex_state(LexState * state, int char_count, CharacterUnit * decode_buffer);
@@ -90,7 +95,4 @@ void append_character(char *buf, int *len, CharacterUnit cu);
 void init_lex_resolve(LexState *state);
 void lex_resolve(LexState *state);
 
-
-
-
-
+#endif /* LEXER_H */
@@ -0,0 +1,634 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "link.h"
+
+//an exported definition: symbol of objects[module]
+typedef struct LinkSlot {
+    uint64_t hash;
+    int      module;            // -1: empty
+    int      symbol;
+} LinkSlot;
+
+typedef struct LinkState {
+    const ObjFile *objects;
+    int            count;
+    VmProgram     *p;
+    ObjModule     *out;
+    FILE          *err;
+    int            errors;
+
+    LinkSlot      *names;           // exported definitions by name hash
+    unsigned       name_mask;
+
+    int           *const_table;     // linked pool index by kind and value, -1 when empty
+    unsigned       const_mask;
+
+    //per module: where its symbols, constants, code, arguments and data start in the tables below or the program
+    int           *symbol_base;
+    int           *const_base;
+    int           *code_base;
+    int           *arg_base;
+    int           *data_base;
+
+    int           *symbol_map;      // module symbol -> linked symbol, -1 when it did not resolve
+    int           *const_map;       // module constant -> linked constant, -1 until placed
+    int           *const_reloc;     // module constant -> its CONST relocation, -1 when it has none
+} LinkState;
+
+static void *link_alloc(size_t count, size_t size)
+{
+    void *p = calloc(count + 1, size);
+
+    if (!p)
+    {
+        fprintf(stderr, "Fatal: failed to allocate link tables\n");
+        exit(1);
+    }
+
+    return p;
+}
+
+static int *link_indexes(size_t count)
+{
+    int *p = link_alloc(count, sizeof(int));
+
+    memset(p, 0xFF, (count + 1) * sizeof(int));
+    return p;
+}
+
+static unsigned table_size(size_t count)
+{
+    unsigned size = 16;
+
+    while (size < count * 2)
+        size *= 2;
+
+    return size;
+}
+
+static const char *symbol_name(const ObjFile *file, int symbol)
+{
+    return file->strings + file->symbols[symbol].name;
+}
+
+static int is_jump(int op)
+{
+    return op == OP_JMP || op == OP_BRNZ || op == OP_BRZ || (op >= OP_BEQ && op <= OP_BUGEK);
+}
+
+static int is_compare_const(int op)
+{
+    return op >= OP_BEQK && op <= OP_BUGEK;
+}
+
+
+
+/*
+   _____                 _           _
+  / ____|               | |         | |
+ | (___  _   _ _ __ ___ | |__   ___ | |___
+  \___ \| | | | '_ ` _ \| '_ \ / _ \| / __|
+  ____) | |_| | | | | | | |_) | (_) | \__ \
+ |_____/ \__, |_| |_| |_|_.__/ \___/|_|___/
+          __/ |
+         |___/
+*/
+
+//the slot holding name, or the empty slot where it would go; names are read only when hashes meet
+static LinkSlot *find_name(LinkState *ls, const char *name, uint64_t hash)
+{
+    unsigned h = (unsigned)(hash ^ (hash >> 32)) & ls->name_mask;
+
+    for (;; h = (h + 1) & ls->name_mask)
+    {
+        LinkSlot *slot = &ls->names[h];
+
+        if (slot->module < 0)
+            return slot;
+
+        if (slot->hash == hash && strcmp(symbol_name(&ls->objects[slot->module], slot->symbol), name) == 0)
+            return slot;
+    }
+}
+
+static void define_name(LinkState *ls, int m, int s)
+{
+    const ObjFile *file = &ls->objects[m];
+    const char *name = symbol_name(file, s);
+    LinkSlot *slot = find_name(ls, name, file->symbols[s].hash);
+
+    if (slot->module >= 0)
+    {
+        fprintf(ls->err, "Link error: %s is defined in both %s and %s\n", name, ls->objects[slot->module].name, file->name);
+        ls->errors++;
+        return;
+    }
+
+    slot->hash   = file->symbols[s].hash;
+    slot->module = m;
+    slot->symbol = s;
+}
+
+//gives every definition its linked index: functions first, in module order, then globals
+static void define_symbols(LinkState *ls, int func_count)
+{
+    int next_func = 0;
+    int next_global = func_count;
+    size_t at = 0;
+
+    for (int m = 0; m < ls->count; m++)
+    {
+        const ObjFile *file = &ls->objects[m];
+
+        for (uint32_t s = 0; s < file->header->symbol_count; s++)
+        {
+            const ObjSymbol *sym = &file->symbols[s];
+            int is_func = (sym->flags & OBJ_SYM_FUNC) != 0;
+            const char *name = symbol_name(file, s);
+            int index;
+            ObjSymbol *linked;
+
+            if (sym->flags & OBJ_SYM_EXTERN)
+                continue;
+
+            index = is_func ? next_func++ : next_global++;
+            linked = &ls->out->symbols[index];
+
+            *linked = *sym;
+            linked->name = (uint32_t)at;
+            strcpy(ls->out->strings + at, name);
+            at += strlen(name) + 1;
+
+            if (is_func)
+            {
+                const ObjFunc *f = &file->funcs[s];
+                VmFunc *vf = &ls->p->funcs[index];
+
+                vf->name          = ls->out->strings + linked->name;
+                vf->code_start    = f->code_start + ls->code_base[m];
+                vf->code_length   = f->code_length;
+                vf->arg_start     = f->arg_start + ls->arg_base[m];
+                vf->param_count   = f->param_count;
+                vf->reg_count     = f->reg_count;
+                vf->frame_size    = f->frame_size;
+                vf->returns_value = f->returns_value;
+            }
+            else
+            {
+                linked->offset += ls->data_base[m];
+            }
+
+            ls->symbol_map[ls->symbol_base[m] + s] = index;
+
+            if (!(sym->flags & OBJ_SYM_LOCAL))
+                define_name(ls, m, (int)s);
+        }
+    }
+}
+
+//points every EXTERN symbol at its definition, which must agree with the declaration
+static void resolve_symbols(LinkState *ls)
+{
+    for (int m = 0; m < ls->count; m++)
+    {
+        const ObjFile *file = &ls->objects[m];
+
+        for (uint32_t s = 0; s < file->header->symbol_count; s++)
+        {
+            const ObjSymbol *sym = &file->symbols[s];
+            const char *name = symbol_name(file, s);
+            const ObjSymbol *def;
+            const char *where;
+            LinkSlot *slot;
+
+            if (!(sym->flags & OBJ_SYM_EXTERN))
+                continue;
+
+            slot = find_name(ls, name, sym->hash);
+
+            if (slot->module < 0)
+            {
+                if (sym->flags & OBJ_SYM_USED)
+                {
+                    fprintf(ls->err, "Link error: undefined symbol %s, used in %s\n", name, file->name);
+                    ls->errors++;
+                }
+
+                continue;
+            }
+
+            def = &ls->objects[slot->module].symbols[slot->symbol];
+            where = ls->objects[slot->module].name;
+
+            if ((def->flags ^ sym->flags) & OBJ_SYM_FUNC)
+            {
+                fprintf(ls->err, "Link error: %s is a %s in %s but a %s in %s\n", name,
+                        (sym->flags & OBJ_SYM_FUNC) ? "function" : "global", file->name,
+                        (def->flags & OBJ_SYM_FUNC) ? "function" : "global", where);
+                ls->errors++;
+            }
+            else if ((sym->flags & OBJ_SYM_FUNC) && def->signature != sym->signature)
+            {
+                fprintf(ls->err, "Link error: %s is declared in %s with other parameter or result types than it is defined with in %s\n",
+                        name, file->name, where);
+                ls->errors++;
+            }
+            else if (!(sym->flags & OBJ_SYM_FUNC) && def->size != sym->size)
+            {
+                fprintf(ls->err, "Link error: %s is declared in %s with %d byte(s) but defined in %s with %d\n",
+                        name, file->name, sym->size, where, def->size);
+                ls->errors++;
+            }
+            else
+            {
+                ls->symbol_map[ls->symbol_base[m] + s] = ls->symbol_map[ls->symbol_base[slot->module] + slot->symbol];
+            }
+        }
+    }
+}
+
+//the linked symbol for a module's symbol; one that did not resolve is reported where it is used
+static int linked_symbol(LinkState *ls, int m, int s)
+{
+    int index = ls->symbol_map[ls->symbol_base[m] + s];
+
+    if (index < 0)
+    {
+        fprintf(ls->err, "Link error: %s refers to %s, which is not defined\n",
+                ls->objects[m].name, symbol_name(&ls->objects[m], s));
+        ls->errors++;
+        return 0;
+    }
+
+    return index;
+}
+
+//the linked data offset of symbol + addend, and the same address in linked symbol terms
+static int resolve_address(LinkState *ls, int m, int symbol, int addend, int *out_symbol, int *out_addend)
+{
+    int index;
+
+    if (symbol < 0)
+    {
+        *out_symbol = -1;
+        *out_addend = ls->data_base[m] + addend;
+        return *out_addend;
+    }
+
+    index = linked_symbol(ls, m, symbol);
+
+    *out_symbol = index;
+    *out_addend = addend;
+
+    return ls->out->symbols[index].offset + addend;
+}
+
+static void add_reloc(LinkState *ls, ObjRelocKind kind, int at, int symbol, int addend)
+{
+    ObjModule *out = ls->out;
+
+    out->relocs[out->reloc_count].kind   = kind;
+    out->relocs[out->reloc_count].at     = at;
+    out->relocs[out->reloc_count].symbol = symbol;
+    out->relocs[out->reloc_count].addend = addend;
+    out->reloc_count++;
+}
+
+
+
+/*
+   _____                _              _
+  / ____|              | |            | |
+ | |     ___  _ __  ___| |_ __ _ _ __ | |_ ___
+ | |    / _ \| '_ \/ __| __/ _` | '_ \| __/ __|
+ | |___| (_) | | | \__ \ || (_| | | | | |_\__ \
+  \_____\___/|_| |_|___/\__\__,_|_| |_|\__|___/
+
+*/
+
+static unsigned const_hash(int kind, uint64_t bits)
+{
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdULL;
+    bits ^= bits >> 33;
+
+    return (unsigned)bits ^ (unsigned)kind;
+}
+
+//the pool index of a linked constant, added the first time it is seen
+static int intern_const(LinkState *ls, VmConstKind kind, VmValue value, int symbol, int addend)
+{
+    VmProgram *p = ls->p;
+    unsigned h = const_hash(kind, value.u) & ls->const_mask;
+
+    for (; ls->const_table[h] >= 0; h = (h + 1) & ls->const_mask)
+    {
+        const VmConst *c = &p->consts[ls->const_table[h]];
+
+        if (c->kind == kind && c->value.u == value.u)
+            return ls->const_table[h];
+    }
+
+    p->consts[p->const_count].kind  = kind;
+    p->consts[p->const_count].value = value;
+    ls->const_table[h] = p->const_count;
+
+    if (kind == VM_CONST_DATA)
+        add_reloc(ls, OBJ_RELOC_CONST, p->const_count, symbol, addend);
+
+    return p->const_count++;
+}
+
+static int place_const(LinkState *ls, int m, int c)
+{
+    const ObjFile *file = &ls->objects[m];
+    const ObjConst *k = &file->consts[c];
+    int *slot = &ls->const_map[ls->const_base[m] + c];
+    int reloc = ls->const_reloc[ls->const_base[m] + c];
+    int symbol = -1;
+    int addend = 0;
+    VmValue value;
+
+    if (*slot >= 0)
+        return *slot;
+
+    value.u = k->value;
+
+    if (k->kind == VM_CONST_FUNC)
+        value.i = linked_symbol(ls, m, (int)k->value - 1) + 1;
+    else if (k->kind == VM_CONST_DATA && reloc >= 0)
+        value.i = resolve_address(ls, m, file->relocs[reloc].symbol, file->relocs[reloc].addend, &symbol, &addend);
+    else if (k->kind == VM_CONST_DATA)
+        value.i = resolve_address(ls, m, -1, (int)k->value, &symbol, &addend);
+
+    *slot = intern_const(ls, (VmConstKind)k->kind, value, symbol, addend);
+
+    return *slot;
+}
+
+//B..K constants first, as only 16 bits hold their index, then the rest of every pool
+static void merge_consts(LinkState *ls)
+{
+    for (int m = 0; m < ls->count; m++)
+    {
+        const ObjFile *file = &ls->objects[m];
+
+        for (uint32_t r = 0; r < file->header->reloc_count; r++)
+        {
+            if (file->relocs[r].kind == OBJ_RELOC_CONST)
+                ls->const_reloc[ls->const_base[m] + file->relocs[r].at] = (int)r;
+        }
+    }
+
+    for (int m = 0; m < ls->count; m++)
+    {
+        const ObjFile *file = &ls->objects[m];
+
+        for (uint32_t fi = 0; fi < file->header->func_count; fi++)
+        {
+            const ObjFunc *f = &file->funcs[fi];
+
+            for (int pc = f->code_start; pc < f->code_start + f->code_length; pc++)
+            {
+                if (is_compare_const(file->code[pc].op) && place_const(ls, m, file->code[pc].b) > 0xFFFF)
+                {
+                    fprintf(ls->err, "Link error: more than 65536 constants are compared with in branches\n");
+                    ls->errors++;
+                    return;
+                }
+            }
+        }
+    }
+
+    for (int m = 0; m < ls->count; m++)
+    {
+        for (uint32_t c = 0; c < ls->objects[m].header->const_count; c++)
+            place_const(ls, m, (int)c);
+    }
+}
+
+
+
+/*
+   _____          _                         _       _       _
+  / ____|        | |                       | |     | |     | |
+ | |     ___   __| | ___    __ _ _ __   __| |   __| | __ _| |_ __ _
+ | |    / _ \ / _` |/ _ \  / _` | '_ \ / _` |  / _` |/ _` | __/ _` |
+ | |___| (_) | (_| |  __/ | (_| | | | | (_| | | (_| | (_| | || (_| |
+  \_____\___/ \__,_|\___|  \__,_|_| |_|\__,_|  \__,_|\__,_|\__\__,_|
+
+*/
+
+//copies each function's code and renumbers what it refers to; code outside functions is never run
+static void place_code(LinkState *ls)
+{
+    for (int m = 0; m < ls->count; m++)
+    {
+        const ObjFile *file = &ls->objects[m];
+        VmInstr *code = ls->p->code + ls->code_base[m];
+        const int *const_map = ls->const_map + ls->const_base[m];
+
+        memcpy(code, file->code, (size_t)file->header->code_count * sizeof(VmInstr));
+
+        for (uint32_t fi = 0; fi < file->header->func_count; fi++)
+        {
+            const ObjFunc *f = &file->funcs[fi];
+
+            for (int pc = f->code_start; pc < f->code_start + f->code_length; pc++)
+            {
+                VmInstr *in = &code[pc];
+
+                if (is_jump(in->op))
+                    in->imm += ls->code_base[m];
+
+                if (is_compare_const(in->op))
+                    in->b = (uint16_t)const_map[in->b];
+                else if (in->op == OP_CONST)
+                    in->imm = const_map[in->imm];
+                else if (in->op == OP_CALL || in->op == OP_TAILCALL)
+                    in->imm = linked_symbol(ls, m, in->imm);
+            }
+        }
+
+        memcpy(ls->p->args + ls->arg_base[m], file->args, (size_t)file->header->arg_count * sizeof(uint16_t));
+    }
+}
+
+//each module's image at its base, then every address and function word it holds set for the linked program
+static void place_data(LinkState *ls)
+{
+    VmProgram *p = ls->p;
+
+    for (int m = 0; m < ls->count; m++)
+    {
+        const ObjFile *file = &ls->objects[m];
+
+        memcpy(p->data + ls->data_base[m], file->data, file->header->data_size);
+
+        for (uint32_t r = 0; r < file->header->reloc_count; r++)
+        {
+            const ObjReloc *rel = &file->relocs[r];
+            int at = ls->data_base[m] + rel->at;
+            int symbol, addend;
+
+            if (rel->kind == OBJ_RELOC_DATA)
+            {
+                p->fixups[p->fixup_count].at     = at;
+                p->fixups[p->fixup_count].target = resolve_address(ls, m, rel->symbol, rel->addend, &symbol, &addend);
+                p->fixup_count++;
+
+                add_reloc(ls, OBJ_RELOC_DATA, at, symbol, addend);
+            }
+            else if (rel->kind == OBJ_RELOC_DATA_FUNC)
+            {
+                long long value;
+
+                symbol = linked_symbol(ls, m, rel->symbol);
+                value = symbol + 1;
+                memcpy(p->data + at, &value, 8);
+
+                add_reloc(ls, OBJ_RELOC_DATA_FUNC, at, symbol, 0);
+            }
+        }
+    }
+}
+
+int link_objects(const ObjFile *objects, int count, VmProgram *program, ObjModule *module, FILE *err)
+{
+    LinkState ls;
+    long symbols = 0, consts = 0, code = 0, args = 0, relocs = 0, data = 0;
+    int func_count = 0, global_count = 0, exported = 0;
+    size_t strings = 0;
+    LinkSlot *entry;
+
+    memset(&ls, 0, sizeof(ls));
+    memset(program, 0, sizeof(*program));
+    memset(module, 0, sizeof(*module));
+
+    ls.objects = objects;
+    ls.count   = count;
+    ls.p       = program;
+    ls.out     = module;
+    ls.err     = err;
+
+    ls.symbol_base = link_alloc(count, sizeof(int));
+    ls.const_base  = link_alloc(count, sizeof(int));
+    ls.code_base   = link_alloc(count, sizeof(int));
+    ls.arg_base    = link_alloc(count, sizeof(int));
+    ls.data_base   = link_alloc(count, sizeof(int));
+
+    for (int m = 0; m < count; m++)
+    {
+        const ObjHeader *h = objects[m].header;
+
+        ls.symbol_base[m] = (int)symbols;
+        ls.const_base[m]  = (int)consts;
+        ls.code_base[m]   = (int)code;
+        ls.arg_base[m]    = (int)args;
+        ls.data_base[m]   = (int)data;
+
+        symbols += h->symbol_count;
+        consts  += h->const_count;
+        code    += h->code_count;
+        args    += h->arg_count;
+        relocs  += h->reloc_count;
+        data     = (data + h->data_size + 15) & ~15L;
+
+        for (uint32_t s = 0; s < h->symbol_count; s++)
+        {
+            uint32_t flags = objects[m].symbols[s].flags;
+
+            if (flags & OBJ_SYM_EXTERN)
+                continue;
+
+            func_count   += (flags & OBJ_SYM_FUNC) != 0;
+            global_count += (flags & OBJ_SYM_FUNC) == 0;
+            exported     += (flags & OBJ_SYM_LOCAL) == 0;
+            strings      += strlen(symbol_name(&objects[m], (int)s)) + 1;
+        }
+
+        //every table below is indexed with int
+        if (symbols > INT32_MAX || consts > INT32_MAX || code > INT32_MAX || args > INT32_MAX ||
+            relocs > INT32_MAX || data > INT32_MAX)
+        {
+            fprintf(err, "Link error: the linked program would be larger than 2 GB\n");
+            free(ls.symbol_base);
+            free(ls.const_base);
+            free(ls.code_base);
+            free(ls.arg_base);
+            free(ls.data_base);
+            return 1;
+        }
+    }
+
+    ls.names = link_alloc(table_size(exported), sizeof(LinkSlot));
+    ls.name_mask = table_size(exported) - 1;
+
+    for (unsigned i = 0; i <= ls.name_mask; i++)
+        ls.names[i].module = -1;
+
+    ls.const_table = link_indexes(table_size(consts));
+    ls.const_mask  = table_size(consts) - 1;
+    ls.symbol_map  = link_indexes(symbols);
+    ls.const_map   = link_indexes(consts);
+    ls.const_reloc = link_indexes(consts);
+
+    program->func_count     = func_count;
+    program->funcs          = link_alloc(func_count, sizeof(VmFunc));
+    program->code_count     = (int)code;
+    program->code_capacity  = (int)code;
+    program->code           = link_alloc(code, sizeof(VmInstr));
+    program->const_capacity = (int)consts;
+    program->consts         = link_alloc(consts, sizeof(VmConst));
+    program->arg_count      = (int)args;
+    program->arg_capacity   = (int)args;
+    program->args           = link_alloc(args, sizeof(uint16_t));
+    program->data_size      = (int)data;
+    program->data           = link_alloc(data + 16, 1);
+    program->fixup_capacity = (int)relocs;
+    program->fixups         = link_alloc(relocs, sizeof(VmFixup));
+    program->entry          = -1;
+
+    module->program      = program;
+    module->symbol_count = func_count + global_count;
+    module->symbols      = link_alloc(module->symbol_count, sizeof(ObjSymbol));
+    module->reloc_capacity = (int)(relocs + consts);
+    module->relocs       = link_alloc(relocs + consts, sizeof(ObjReloc));
+    module->strings      = link_alloc(strings, 1);
+    module->strings_size = strings;
+
+    define_symbols(&ls, func_count);
+
+    if (ls.errors == 0)
+        resolve_symbols(&ls);
+
+    if (ls.errors == 0)
+        merge_consts(&ls);
+
+    if (ls.errors == 0)
+    {
+        place_code(&ls);
+        place_data(&ls);
+
+        entry = find_name(&ls, "ENTRE", object_name_hash("ENTRE"));
+
+        if (entry->module >= 0 && (objects[entry->module].symbols[entry->symbol].flags & OBJ_SYM_FUNC))
+            program->entry = ls.symbol_map[ls.symbol_base[entry->module] + entry->symbol];
+    }
+
+    free(ls.names);
+    free(ls.const_table);
+    free(ls.symbol_base);
+    free(ls.const_base);
+    free(ls.code_base);
+    free(ls.arg_base);
+    free(ls.data_base);
+    free(ls.symbol_map);
+    free(ls.const_map);
+    free(ls.const_reloc);
+
+    return ls.errors;
+}
@@ -0,0 +1,56 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include <stdio.h>
+
+#include "bytecode.h"
+#include "object.h"
+
+/* ---------------------------------------------
+   Linker
+
+   Joins object files (object.h) into one
+   program for the VM, in one pass over each
+   section of each module:
+
+     symbols   every definition that is not
+               local goes into one open-addressed
+               table keyed on the name hashes the
+               objects carry; a name defined
+               twice is an error. Each EXTERN
+               symbol is then looked up there;
+               one a module uses must be found,
+               with the same signature or size.
+     code      appended module by module; jump
+               targets move by the module's first
+               instruction, CALL / TAILCALL take
+               the linked function index.
+     consts    merged through a hash table, so
+               the pool holds each value once.
+               Constants B..K instructions compare
+               with go in first, as their index
+               must fit in 16 bits.
+     args      appended; CALL.a is relative to
+               the function's arg_start already.
+     data      appended at 16-byte alignment;
+               each relocation is applied against
+               the symbol it names, so an EXTERN
+               global reads and writes the
+               defining module's storage.
+
+   Every step is linear in what the modules
+   hold, so linking time grows with the size of
+   the program, not with the number of modules
+   times anything. The linked program keeps its
+   symbols and relocations (module), so it can
+   be written as an object and linked again.
+
+   ENTRE, if some module defines it, is the
+   entry. Unused EXTERN declarations need not
+   resolve and do not survive linking.
+--------------------------------------------- */
+
+// links count objects into program and module; returns the number of errors printed to err
+int link_objects(const ObjFile *objects, int count, VmProgram *program, ObjModule *module, FILE *err);
+
+#endif /* LINK_H */
@@ -0,0 +1,1006 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "loop.h"
+#include "vector.h"
+
+typedef struct LoopInfo {
+    Loop *loops;        // smallest first, so inner loops come before outer ones
+    int   count;
+    int  *idom;
+} LoopInfo;
+
+static void *loop_alloc(size_t count, size_t size, const char *what)
+{
+    void *ptr = calloc(count + 1, size);
+
+    if (!ptr)
+    {
+        fprintf(stderr, "Fatal: failed to allocate %s\n", what);
+        exit(1);
+    }
+
+    return ptr;
+}
+
+static int pred_index(const IrFunc *f, int block, int pred)
+{
+    for (int p = 0; p < f->blocks[block].pred_count; p++)
+    {
+        if (f->blocks[block].preds[p] == pred)
+            return p;
+    }
+
+    return IR_NONE;
+}
+
+//blocks added later (other loops' copies) are never part of the loop
+int loop_contains(const Loop *loop, int block)
+{
+    return block >= 0 && block < loop->blocks && loop->member[block];
+}
+
+static int defined_inside(const IrFunc *f, const Loop *loop, int value)
+{
+    return value != IR_NONE && loop_contains(loop, f->instrs[value].block);
+}
+
+static void retarget(IrFunc *f, int block, int from, int to)
+{
+    int count;
+    int *targets = ir_targets(f, ir_terminator(f, block), &count);
+
+    for (int t = 0; t < count; t++)
+    {
+        if (targets[t] == from)
+            targets[t] = to;
+    }
+}
+
+
+
+/*
+                      _           _
+     /\               | |         (_)
+    /  \   _ __   __ _| |_   _ ___ _ ___
+   / /\ \ | '_ \ / _` | | | | / __| / __|
+  / ____ \| | | | (_| | | |_| \__ \ \__ \
+ /_/    \_\_| |_|\__,_|_|\__, |___/_|___/
+                          __/ |
+                         |___/
+*/
+
+static void free_loops(LoopInfo *li)
+{
+    for (int l = 0; l < li->count; l++)
+        free(li->loops[l].member);
+
+    free(li->loops);
+    free(li->idom);
+
+    memset(li, 0, sizeof(*li));
+}
+
+static void find_loops(const IrFunc *f, LoopInfo *li)
+{
+    int  n = f->block_count;
+    int *stack = loop_alloc((size_t)n, sizeof(int), "loop scratch");
+
+    memset(li, 0, sizeof(*li));
+    li->idom  = loop_alloc((size_t)n, sizeof(int), "dominators");
+    li->loops = loop_alloc((size_t)n, sizeof(Loop), "loops");
+
+    ir_dominators(f, li->idom);
+
+    for (int h = 0; h < n; h++)
+    {
+        const IrBlock *blk = &f->blocks[h];
+        Loop *loop = NULL;
+        int latches = 0;
+
+        for (int p = 0; p < blk->pred_count; p++)
+        {
+            int tail = blk->preds[p];
+            int sp = 0;
+
+            if (!ir_dominates(li->idom, h, tail))
+                continue;
+
+            if (!loop)
+            {
+                loop = &li->loops[li->count++];
+                loop->header    = h;
+                loop->preheader = IR_NONE;
+                loop->member    = loop_alloc((size_t)n, 1, "loop blocks");
+                loop->member[h] = 1;
+                loop->blocks    = n;
+                loop->size      = 1;
+            }
+
+            loop->latch = tail;
+            latches++;
+
+            //everything that reaches the back edge without passing the header
+            if (!loop->member[tail])
+            {
+                loop->member[tail] = 1;
+                loop->size++;
+                stack[sp++] = tail;
+            }
+
+            while (sp > 0)
+            {
+                const IrBlock *x = &f->blocks[stack[--sp]];
+
+                for (int q = 0; q < x->pred_count; q++)
+                {
+                    int y = x->preds[q];
+
+                    if (!loop->member[y] && li->idom[y] != -1)
+                    {
+                        loop->member[y] = 1;
+                        loop->size++;
+                        stack[sp++] = y;
+                    }
+                }
+            }
+        }
+
+        if (loop && latches > 1)
+            loop->latch = IR_NONE;
+    }
+
+    for (int l = 0; l < li->count; l++)
+    {
+        Loop *loop = &li->loops[l];
+        int outside = IR_NONE;
+        int outside_count = 0;
+        const int *succ;
+
+        loop->innermost = 1;
+
+        for (int k = 0; k < li->count; k++)
+        {
+            if (k != l && loop->member[li->loops[k].header])
+                loop->innermost = 0;
+        }
+
+        for (int p = 0; p < f->blocks[loop->header].pred_count; p++)
+        {
+            if (!loop->member[f->blocks[loop->header].preds[p]])
+            {
+                outside = f->blocks[loop->header].preds[p];
+                outside_count++;
+            }
+        }
+
+        if (outside_count == 1 && ir_successors(f, outside, &succ) == 1)
+            loop->preheader = outside;
+    }
+
+    //smallest first: a loop nested in another has fewer blocks
+    for (int l = 1; l < li->count; l++)
+    {
+        Loop key = li->loops[l];
+        int k = l - 1;
+
+        while (k >= 0 && li->loops[k].size > key.size)
+        {
+            li->loops[k + 1] = li->loops[k];
+            k--;
+        }
+
+        li->loops[k + 1] = key;
+    }
+
+    free(stack);
+}
+
+void loop_depths(const IrFunc *f, int *depth)
+{
+    LoopInfo li;
+
+    find_loops(f, &li);
+
+    for (int b = 0; b < f->block_count; b++)
+        depth[b] = 0;
+
+    for (int l = 0; l < li.count; l++)
+    {
+        for (int b = 0; b < f->block_count; b++)
+            depth[b] += li.loops[l].member[b];
+    }
+
+    free_loops(&li);
+}
+
+//sends every edge from outside the loop through one new block that jumps to the header
+static int create_preheader(IrFunc *f, const Loop *loop)
+{
+    int h = loop->header;
+    int n = f->blocks[h].pred_count;
+    int inside[n + 1];
+    int outside[n + 1];
+    int in_count = 0;
+    int out_count = 0;
+    int ph, jump;
+
+    for (int p = 0; p < n; p++)
+    {
+        if (loop_contains(loop, f->blocks[h].preds[p]))
+            inside[in_count++] = p;
+        else
+            outside[out_count++] = p;
+    }
+
+    if (out_count == 0)
+        return 0;
+
+    ph = ir_new_block(f);
+
+    for (int k = 0; k < out_count; k++)
+    {
+        int pred = f->blocks[h].preds[outside[k]];
+
+        retarget(f, pred, h, ph);
+        ir_add_pred(f, ph, pred);
+    }
+
+    for (int i = f->blocks[h].first; i != IR_NONE && f->instrs[i].op == IR_PHI; i = f->instrs[i].next)
+    {
+        int values[in_count + 1];
+        int entry;
+
+        if (out_count == 1)
+            entry = f->operands[f->instrs[i].args + outside[0]];
+        else
+        {
+            int merged[out_count];
+
+            for (int k = 0; k < out_count; k++)
+                merged[k] = f->operands[f->instrs[i].args + outside[k]];
+
+            entry = ir_new_instr(f, IR_PHI, f->instrs[i].type, IR_NONE, IR_NONE);
+            f->instrs[entry].args  = ir_add_operands(f, merged, out_count);
+            f->instrs[entry].nargs = out_count;
+            ir_append(f, ph, entry);
+        }
+
+        values[0] = entry;
+
+        for (int k = 0; k < in_count; k++)
+            values[k + 1] = f->operands[f->instrs[i].args + inside[k]];
+
+        f->instrs[i].args  = ir_add_operands(f, values, in_count + 1);
+        f->instrs[i].nargs = in_count + 1;
+    }
+
+    //the preheader takes the place of all outside predecessors
+    {
+        IrBlock *blk = &f->blocks[h];
+        int preds[in_count + 1];
+
+        preds[0] = ph;
+
+        for (int k = 0; k < in_count; k++)
+            preds[k + 1] = blk->preds[inside[k]];
+
+        memcpy(blk->preds, preds, (size_t)(in_count + 1) * sizeof(int));
+        blk->pred_count = in_count + 1;
+    }
+
+    jump = ir_new_instr(f, IR_JMP, IRT_VOID, IR_NONE, IR_NONE);
+    f->instrs[jump].target[0] = h;
+    ir_append(f, ph, jump);
+
+    return 1;
+}
+
+
+
+/*
+  _      _____ _____ __  __
+ | |    |_   _/ ____|  \/  |
+ | |      | || |    | \  / |
+ | |      | || |    | |\/| |
+ | |____ _| || |____| |  | |
+ |______|_____\_____|_|  |_|
+*/
+
+//pure and unable to stop the program, so running it before the loop changes nothing
+static int hoistable(const IrFunc *f, const IrInstr *in)
+{
+    switch (in->op)
+    {
+        case IR_DIV:
+        case IR_UDIV:
+        case IR_MOD:
+        case IR_UMOD:
+            return f->instrs[in->b].op == IR_CONST && f->instrs[in->b].imm != 0 && f->instrs[in->b].imm != -1;
+
+        case IR_CONST:
+        case IR_UNDEF:
+        case IR_GLOBAL:
+        case IR_STRING:
+        case IR_FUNCADDR:
+        case IR_SLOT:
+        case IR_OFFSET:
+        case IR_INDEX:
+            return 1;
+
+        default:
+            return in->op >= IR_ADD && in->op <= IR_COPY;
+    }
+}
+
+static int hoist_invariants(IrFunc *f, const Loop *loop)
+{
+    int term = ir_terminator(f, loop->preheader);
+    int hoisted = 0;
+    int changed = 1;
+
+    //an operand hoisted in one sweep makes its users hoistable in the next
+    while (changed)
+    {
+        changed = 0;
+
+        for (int b = 0; b < loop->blocks; b++)
+        {
+            if (!loop->member[b])
+                continue;
+
+            for (int i = f->blocks[b].first; i != IR_NONE; )
+            {
+                const IrInstr *in = &f->instrs[i];
+                int next = in->next;
+
+                if (hoistable(f, in) && !defined_inside(f, loop, in->a) && !defined_inside(f, loop, in->b))
+                {
+                    ir_move_before(f, term, i);
+                    hoisted++;
+                    changed = 1;
+                }
+
+                i = next;
+            }
+        }
+    }
+
+    return hoisted;
+}
+
+
+
+/*
+  _____           _                 _   _
+ |_   _|         | |               | | (_)
+   | |  _ __   __| |_   _  ___| |_ _  ___  _ __
+   | | | '_ \ / _` | | | |/ __| __| |/ _ \| '_ \
+  _| |_| | | | (_| | |_| | (__| |_| | (_) | | | |
+ |_____|_| |_|\__,_|\__,_|\___|\__|_|\___/|_| |_|
+*/
+
+typedef struct Induction {
+    int       phi;
+    int       init;         // value from the preheader
+    int       next;         // phi + step, the value from the latch
+    long long step;
+} Induction;
+
+typedef struct PointerStep {
+    int       base;
+    int       phi;          // induction variable it follows
+    long long scale;
+    int       pointer;      // new ptr phi: base + phi * scale
+} PointerStep;
+
+static long long constant_of(const IrFunc *f, int value, int *ok)
+{
+    *ok = (value != IR_NONE && f->instrs[value].op == IR_CONST);
+    return *ok ? f->instrs[value].imm : 0;
+}
+
+//v == phi + c (or phi - c) for a constant c; returns 1 and the offset
+static int offset_from(const IrFunc *f, int value, int phi, long long *offset)
+{
+    const IrInstr *in = &f->instrs[value];
+    int ok;
+    long long c;
+
+    if (value == phi)
+    {
+        *offset = 0;
+        return 1;
+    }
+
+    if (in->op == IR_ADD && in->a == phi)
+        c = constant_of(f, in->b, &ok);
+    else if (in->op == IR_ADD && in->b == phi)
+        c = constant_of(f, in->a, &ok);
+    else if (in->op == IR_SUB && in->a == phi)
+        c = -constant_of(f, in->b, &ok);
+    else
+        return 0;
+
+    *offset = c;
+    return ok;
+}
+
+//header phis stepped by a constant on the single back edge
+static int header_phis(const IrFunc *f, int header)
+{
+    int count = 0;
+
+    for (int i = f->blocks[header].first; i != IR_NONE && f->instrs[i].op == IR_PHI; i = f->instrs[i].next)
+        count++;
+
+    return count;
+}
+
+//out has room for every header phi
+static int find_inductions(const IrFunc *f, const Loop *loop, Induction *out)
+{
+    int h = loop->header;
+    int pre = pred_index(f, h, loop->preheader);
+    int back = pred_index(f, h, loop->latch);
+    int count = 0;
+
+    if (f->blocks[h].pred_count != 2 || pre == IR_NONE || back == IR_NONE)
+        return 0;
+
+    for (int i = f->blocks[h].first; i != IR_NONE && f->instrs[i].op == IR_PHI; i = f->instrs[i].next)
+    {
+        const IrInstr *phi = &f->instrs[i];
+        int next = f->operands[phi->args + back];
+        long long step;
+
+        if (phi->type != IRT_I32 && phi->type != IRT_I64)
+            continue;
+
+        if (next == i || !offset_from(f, next, i, &step) || step == 0)
+            continue;
+
+        out[count].phi  = i;
+        out[count].init = f->operands[phi->args + pre];
+        out[count].next = next;
+        out[count].step = step;
+        count++;
+    }
+
+    return count;
+}
+
+//a new pointer that starts at base + init * scale and moves with the induction variable
+static int pointer_step(IrFunc *f, const Loop *loop, const Induction *iv, int base, long long scale)
+{
+    int h = loop->header;
+    int term = ir_terminator(f, loop->preheader);
+    int start_index = iv->init;
+    int start, pointer, stepped;
+    int values[2];
+
+    if (f->instrs[iv->phi].type == IRT_I32)
+    {
+        start_index = ir_new_instr(f, IR_SEXT, IRT_I64, iv->init, IR_NONE);
+        ir_insert_before(f, term, start_index);
+    }
+
+    start = ir_new_instr(f, IR_INDEX, IRT_PTR, base, start_index);
+    f->instrs[start].imm = scale;
+    ir_insert_before(f, term, start);
+
+    stepped = ir_new_instr(f, IR_OFFSET, IRT_PTR, IR_NONE, IR_NONE);
+    f->instrs[stepped].imm = iv->step * scale;
+    ir_insert_before(f, f->instrs[iv->next].next, stepped);
+
+    pointer = ir_new_instr(f, IR_PHI, IRT_PTR, IR_NONE, IR_NONE);
+    values[pred_index(f, h, loop->preheader)] = start;
+    values[pred_index(f, h, loop->latch)] = stepped;
+    f->instrs[pointer].args  = ir_add_operands(f, values, 2);
+    f->instrs[pointer].nargs = 2;
+    ir_prepend(f, h, pointer);
+
+    f->instrs[stepped].a = pointer;
+
+    return pointer;
+}
+
+static int reduce_indexes(IrFunc *f, const Loop *loop)
+{
+    Induction *ivs;
+    int iv_count;
+    PointerStep *steps;
+    int step_count = 0;
+    int *indexes;
+    int index_count = 0;
+    int reduced = 0;
+
+    if (loop->preheader == IR_NONE || loop->latch == IR_NONE)
+        return 0;
+
+    ivs = loop_alloc((size_t)header_phis(f, loop->header), sizeof(Induction), "induction variables");
+    iv_count = find_inductions(f, loop, ivs);
+
+    if (iv_count == 0)
+    {
+        free(ivs);
+        return 0;
+    }
+
+    indexes = loop_alloc((size_t)f->instr_count, sizeof(int), "index list");
+    steps   = loop_alloc((size_t)f->instr_count, sizeof(PointerStep), "pointer steps");
+
+    for (int b = 0; b < loop->blocks; b++)
+    {
+        if (!loop->member[b])
+            continue;
+
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+        {
+            if (f->instrs[i].op == IR_INDEX && !defined_inside(f, loop, f->instrs[i].a))
+                indexes[index_count++] = i;
+        }
+    }
+
+    for (int k = 0; k < index_count; k++)
+    {
+        int x = indexes[k];
+        int index = f->instrs[x].b;
+        int widened = 0;
+        const Induction *iv = NULL;
+        long long offset = 0;
+        int pointer = IR_NONE;
+
+        //i32 induction variables reach the index through a sign extension
+        if (f->instrs[index].op == IR_SEXT && f->instrs[f->instrs[index].a].type == IRT_I32)
+        {
+            index = f->instrs[index].a;
+            widened = 1;
+        }
+
+        for (int v = 0; v < iv_count && !iv; v++)
+        {
+            if ((f->instrs[ivs[v].phi].type == IRT_I32) == widened &&
+                offset_from(f, index, ivs[v].phi, &offset))
+                iv = &ivs[v];
+        }
+
+        if (!iv)
+            continue;
+
+        for (int s = 0; s < step_count; s++)
+        {
+            if (steps[s].base == f->instrs[x].a && steps[s].phi == iv->phi && steps[s].scale == f->instrs[x].imm)
+                pointer = steps[s].pointer;
+        }
+
+        if (pointer == IR_NONE)
+        {
+            pointer = pointer_step(f, loop, iv, f->instrs[x].a, f->instrs[x].imm);
+
+            steps[step_count].base    = f->instrs[x].a;
+            steps[step_count].phi     = iv->phi;
+            steps[step_count].scale   = f->instrs[x].imm;
+            steps[step_count].pointer = pointer;
+            step_count++;
+        }
+
+        if (offset == 0)
+        {
+            ir_replace_uses(f, x, pointer);
+            ir_remove(f, x);
+        }
+        else
+        {
+            IrInstr *in = &f->instrs[x];
+
+            in->imm = offset * in->imm;
+            in->op  = IR_OFFSET;
+            in->a   = pointer;
+            in->b   = IR_NONE;
+        }
+
+        reduced++;
+    }
+
+    free(ivs);
+    free(indexes);
+    free(steps);
+
+    return reduced;
+}
+
+
+
+/*
+  _    _                 _ _ _
+ | |  | |               | | (_)
+ | |  | |_ __  _ __ ___ | | |_ _ __   __ _
+ | |  | | '_ \| '__/ _ \| | | | '_ \ / _` |
+ | |__| | | | | | | (_) | | | | | | | (_| |
+  \____/|_| |_|_|  \___/|_|_|_|_| |_|\__, |
+                                      __/ |
+                                     |___/
+*/
+
+//how often the body runs when the header compares an induction variable with a constant; -1 if unknown
+static long long trip_count(const IrFunc *f, const Loop *loop, const Induction *ivs, int iv_count, int stay_if_true)
+{
+    const IrInstr *br = &f->instrs[ir_terminator(f, loop->header)];
+    const IrInstr *cmp = &f->instrs[br->a];
+    int ok;
+
+    if (cmp->op < IR_EQ || cmp->op > IR_UGE)
+        return -1;
+
+    for (int v = 0; v < iv_count; v++)
+    {
+        int left = (cmp->a == ivs[v].phi);
+        IrType type = f->instrs[ivs[v].phi].type;
+        long long limit, value;
+
+        if (!left && cmp->b != ivs[v].phi)
+            continue;
+
+        limit = constant_of(f, left ? cmp->b : cmp->a, &ok);
+
+        if (!ok)
+            continue;
+
+        value = constant_of(f, ivs[v].init, &ok);
+
+        if (!ok)
+            continue;
+
+        for (long long n = 0; n <= LOOP_TRIP_LIMIT; n++)
+        {
+            int taken = left ? ir_compare_ints(cmp->op, type, value, limit)
+                             : ir_compare_ints(cmp->op, type, limit, value);
+
+            if (taken != stay_if_true)
+                return n;
+
+            value = ir_wrap_int(type, (long long)((unsigned long long)value + (unsigned long long)ivs[v].step));
+        }
+
+        return -1;
+    }
+
+    return -1;
+}
+
+/*
+   copies the header (without its phis and test) and the body once. Header
+   phis read in_values; out_values receive what the copy hands to the next
+   iteration. The copied latch still jumps to the original header.
+*/
+static int copy_iteration(IrFunc *f, const Loop *loop, int body_entry, const int *phis, int phi_count,
+                          const int *in_values, int *out_values, int *entry)
+{
+    int n = f->instr_count;
+    int blocks = loop->blocks;
+    int h = loop->header;
+    int back = pred_index(f, h, loop->latch);
+    int *value_map = loop_alloc((size_t)n, sizeof(int), "unroll value map");
+    int *block_map = loop_alloc((size_t)blocks, sizeof(int), "unroll block map");
+    int *origin    = loop_alloc((size_t)n, sizeof(int), "unroll copies");
+    int *copies    = loop_alloc((size_t)n, sizeof(int), "unroll copies");
+    int  copy_count = 0;
+    int  latch;
+
+    for (int i = 0; i < n; i++)
+        value_map[i] = i;
+
+    for (int k = 0; k < phi_count; k++)
+        value_map[phis[k]] = in_values[k];
+
+    for (int b = 0; b < blocks; b++)
+        block_map[b] = loop->member[b] ? ir_new_block(f) : IR_NONE;
+
+    for (int b = 0; b < blocks; b++)
+    {
+        if (!loop->member[b])
+            continue;
+
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+        {
+            const IrInstr *src = &f->instrs[i];
+            int c;
+
+            if (b == h && src->op == IR_PHI)
+                continue;
+
+            //inside a group the test is known to pass
+            if (b == h && src->op == IR_BR)
+            {
+                c = ir_new_instr(f, IR_JMP, IRT_VOID, IR_NONE, IR_NONE);
+                f->instrs[c].target[0] = block_map[body_entry];
+                ir_append(f, block_map[b], c);
+                continue;
+            }
+
+            c = ir_new_instr(f, src->op, src->type, src->a, src->b);
+            src = &f->instrs[i];
+
+            f->instrs[c].imm       = src->imm;
+            f->instrs[c].fimm      = src->fimm;
+            f->instrs[c].aux       = src->aux;
+            f->instrs[c].args      = src->args;
+            f->instrs[c].nargs     = src->nargs;
+            f->instrs[c].target[0] = src->target[0];
+            f->instrs[c].target[1] = src->target[1];
+
+            if (src->op == IR_SWITCH)
+                f->instrs[c].imm = ir_copy_cases(f, f, i);
+
+            ir_append(f, block_map[b], c);
+
+            value_map[i] = c;
+            origin[copy_count] = i;
+            copies[copy_count++] = c;
+        }
+    }
+
+    for (int k = 0; k < copy_count; k++)
+    {
+        IrInstr *in = &f->instrs[copies[k]];
+
+        if (in->a != IR_NONE)
+            in->a = value_map[in->a];
+        if (in->b != IR_NONE)
+            in->b = value_map[in->b];
+
+        if (ir_is_terminator(in->op))
+        {
+            int count;
+            int *targets = ir_targets(f, copies[k], &count);
+
+            for (int t = 0; t < count; t++)
+            {
+                if (targets[t] != h)
+                    targets[t] = block_map[targets[t]];
+            }
+        }
+
+        if (in->nargs > 0)
+        {
+            int values[in->nargs];
+            const IrInstr *src = &f->instrs[origin[k]];
+
+            for (int a = 0; a < src->nargs; a++)
+                values[a] = value_map[f->operands[src->args + a]];
+
+            f->instrs[copies[k]].args = ir_add_operands(f, values, src->nargs);
+        }
+    }
+
+    for (int b = 0; b < blocks; b++)
+    {
+        if (!loop->member[b] || b == h)
+            continue;
+
+        for (int p = 0; p < f->blocks[b].pred_count; p++)
+            ir_add_pred(f, block_map[b], block_map[f->blocks[b].preds[p]]);
+    }
+
+    for (int k = 0; k < phi_count; k++)
+        out_values[k] = value_map[f->operands[f->instrs[phis[k]].args + back]];
+
+    *entry = block_map[h];
+    latch  = block_map[loop->latch];
+
+    free(value_map);
+    free(block_map);
+    free(origin);
+    free(copies);
+
+    return latch;
+}
+
+static int unroll_loop(IrFunc *f, const Loop *loop)
+{
+    int h = loop->header;
+    int term, body_entry, stay_if_true;
+    int size = 0;
+    int copies, from_pred, from_block;
+    long long trips;
+    Induction *ivs;
+    int iv_count;
+    int phi_count;
+
+    if (!loop->innermost || loop->preheader == IR_NONE || loop->latch == IR_NONE ||
+        loop->latch == h || f->blocks[h].pred_count != 2)
+        return 0;
+
+    term = ir_terminator(f, h);
+
+    if (f->instrs[term].op != IR_BR || loop_contains(loop, f->instrs[term].target[0]) == loop_contains(loop, f->instrs[term].target[1]))
+        return 0;
+
+    stay_if_true = loop_contains(loop, f->instrs[term].target[0]);
+    body_entry = f->instrs[term].target[stay_if_true ? 0 : 1];
+
+    //the header test has to be the only way out
+    for (int b = 0; b < loop->blocks; b++)
+    {
+        const int *succ;
+        int n;
+
+        if (!loop->member[b])
+            continue;
+
+        n = ir_successors(f, b, &succ);
+
+        for (int s = 0; s < n && b != h; s++)
+        {
+            if (!loop_contains(loop, succ[s]))
+                return 0;
+        }
+
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+            size += (f->instrs[i].op != IR_PHI);
+    }
+
+    phi_count = header_phis(f, h);
+    ivs = loop_alloc((size_t)phi_count, sizeof(Induction), "induction variables");
+    iv_count = find_inductions(f, loop, ivs);
+    trips = trip_count(f, loop, ivs, iv_count, stay_if_true);
+
+    free(ivs);
+
+    if (trips <= 0)
+        return 0;
+
+    if (trips <= LOOP_UNROLL_FULL && trips * size <= LOOP_UNROLL_BUDGET)
+    {
+        //all iterations in a row in front of the header, whose test then fails
+        copies = (int)trips;
+        from_block = loop->preheader;
+    }
+    else if (size <= LOOP_UNROLL_BODY && trips % 4 == 0 && 4 * size <= LOOP_UNROLL_BUDGET)
+    {
+        copies = 3;
+        from_block = loop->latch;
+    }
+    else if (size <= LOOP_UNROLL_BODY && trips % 2 == 0 && 2 * size <= LOOP_UNROLL_BUDGET)
+    {
+        copies = 1;
+        from_block = loop->latch;
+    }
+    else
+        return 0;
+
+    int phis[phi_count + 1];
+    int p = 0;
+
+    for (int i = f->blocks[h].first; i != IR_NONE && f->instrs[i].op == IR_PHI; i = f->instrs[i].next)
+        phis[p++] = i;
+
+    int values[phi_count + 1];
+    int next_values[phi_count + 1];
+
+    from_pred = pred_index(f, h, from_block);
+
+    for (int k = 0; k < phi_count; k++)
+        values[k] = f->operands[f->instrs[phis[k]].args + from_pred];
+
+    int entries[copies];
+    int latches[copies];
+
+    //every copy is taken from the untouched loop before the chain is linked up
+    for (int c = 0; c < copies; c++)
+    {
+        latches[c] = copy_iteration(f, loop, body_entry, phis, phi_count, values, next_values, &entries[c]);
+        memcpy(values, next_values, (size_t)phi_count * sizeof(int));
+    }
+
+    for (int c = 0; c < copies; c++)
+    {
+        retarget(f, from_block, h, entries[c]);
+        ir_add_pred(f, entries[c], from_block);
+        from_block = latches[c];
+    }
+
+    //the last copy feeds the header on the edge the chain replaced
+    f->blocks[h].preds[from_pred] = from_block;
+
+    for (int k = 0; k < phi_count; k++)
+        f->operands[f->instrs[phis[k]].args + from_pred] = values[k];
+
+    return 1;
+}
+
+
+
+/*
+  _____
+ |  __ \
+ | |  | |_ __ ___   _____ _ __
+ | |  | | '__| \ \ / / _ \ '__|
+ | |__| | |  | |\ V /  __/ |
+ |_____/|_|  |_| \_/ \___|_|
+*/
+
+void optimise_loops(IrFunc *f, const LoopOptions *options, LoopStats *stats)
+{
+    LoopInfo li;
+    int created = 0;
+    LoopStats local;
+    char *vectorised;
+
+    memset(&local, 0, sizeof(local));
+
+    if (f->is_extern || f->block_count == 0)
+        return;
+
+    find_loops(f, &li);
+
+    for (int l = 0; l < li.count; l++)
+    {
+        if (li.loops[l].preheader == IR_NONE)
+            created += create_preheader(f, &li.loops[l]);
+    }
+
+    //new blocks sit inside enclosing loops, so membership is found again
+    if (created > 0)
+    {
+        free_loops(&li);
+        find_loops(f, &li);
+    }
+
+    local.loops = li.count;
+
+    for (int l = 0; l < li.count; l++)
+    {
+        if (li.loops[l].preheader != IR_NONE)
+            local.hoisted += hoist_invariants(f, &li.loops[l]);
+    }
+
+    for (int l = 0; l < li.count; l++)
+        local.reduced += reduce_indexes(f, &li.loops[l]);
+
+    //innermost loops share no blocks, so each keeps its membership while others grow
+    vectorised = loop_alloc((size_t)li.count, 1, "vectorised loops");
+
+    for (int l = 0; l < li.count && options->vector_bytes > 0; l++)
+    {
+        const Loop *loop = &li.loops[l];
+        char why[96];
+        int lanes;
+
+        if (!loop->innermost)
+            continue;
+
+        lanes = vectorise_loop(f, loop, options->vector_bytes, why, (int)sizeof(why));
+        vectorised[l] = (lanes > 0);
+        local.vectorised += vectorised[l];
+
+        if (options->report && lanes > 0)
+            printf("%s: loop at b%d vectorised, %d lanes of %d bytes\n", f->name, loop->header,
+                   lanes, options->vector_bytes / lanes);
+        else if (options->report)
+            printf("%s: loop at b%d not vectorised: it %s\n", f->name, loop->header, why);
+    }
+
+    for (int l = 0; l < li.count; l++)
+    {
+        if (!vectorised[l])
+            local.unrolled += unroll_loop(f, &li.loops[l]);
+    }
+
+    free(vectorised);
+    free_loops(&li);
+
+    if (created > 0 || local.unrolled > 0 || local.vectorised > 0)
+        ir_compact(f);
+
+    if (stats)
+    {
+        stats->loops      += local.loops;
+        stats->hoisted    += local.hoisted;
+        stats->reduced    += local.reduced;
+        stats->unrolled   += local.unrolled;
+        stats->vectorised += local.vectorised;
+    }
+}
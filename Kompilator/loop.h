@@ -0,0 +1,78 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include "ir.h"
+
+/* ---------------------------------------------
+   Loop passes
+
+   Natural loops are found from back edges whose
+   target dominates their source; loops sharing a
+   header are one loop. Each loop gets a
+   preheader, a block outside it that jumps to
+   the header and nowhere else, and is then
+   worked on innermost first:
+
+   - loop-invariant code motion moves pure
+     instructions whose operands are all defined
+     outside the loop into the preheader. Loads
+     stay, nothing tells them apart from stores;
+   - a basic induction variable i (a header phi
+     stepped by a constant) turns every
+     arr<i + c> over an invariant base into an
+     offset from a pointer that is stepped along
+     with i, instead of an index multiplied on
+     every iteration. As in C, array indexes are
+     taken not to wrap around 32 bits;
+   - an innermost loop whose only exit is its
+     header test, on an induction variable
+     against a constant, has a known trip count.
+     It is unrolled completely when trip count
+     times body stays within LOOP_UNROLL_BUDGET
+     and the count is at most LOOP_UNROLL_FULL,
+     otherwise by 4 or 2 when that divides the
+     count, testing once per group;
+   - with a vector width set, innermost loops
+     over arrays are vectorised first (vector.h);
+     a vectorised loop stays as the scalar
+     epilogue and is not unrolled.
+
+   The clean-up passes of opt.h run afterwards
+   and fold the copies of the test away.
+--------------------------------------------- */
+
+#define LOOP_UNROLL_FULL      16        // most iterations a loop is fully unrolled for
+#define LOOP_UNROLL_BUDGET    256       // instructions an unrolled loop may grow to
+#define LOOP_UNROLL_BODY      64        // largest body considered for partial unrolling
+#define LOOP_TRIP_LIMIT       (1 << 20) // trip counts are simulated up to here
+
+typedef struct Loop {
+    int   header;
+    int   preheader;    // IR_NONE until there is one
+    int   latch;        // the only back-edge source, IR_NONE if there are several
+    char *member;       // per block that existed when the loop was found
+    int   blocks;       // length of member
+    int   size;         // blocks in the loop
+    int   innermost;
+} Loop;
+
+typedef struct LoopOptions {
+    int vector_bytes;   // 16 (SSE2) or 32 (AVX2) to vectorise, 0 not to
+    int report;         // print what became of each innermost loop
+} LoopOptions;
+
+typedef struct LoopStats {
+    int loops;
+    int hoisted;        // invariant instructions moved to a preheader
+    int reduced;        // array indexes turned into pointer steps
+    int unrolled;       // loops unrolled fully or partially
+    int vectorised;
+} LoopStats;
+
+int  loop_contains(const Loop *loop, int block);
+void optimise_loops(IrFunc *f, const LoopOptions *options, LoopStats *stats);
+
+// depth[b]: number of loops block b is in
+void loop_depths(const IrFunc *f, int *depth);
+
+#endif /* LOOP_H */
@@ -0,0 +1,2340 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lower.h"
+#include "fold.h"
+
+/* how a variable symbol is stored */
+typedef enum VarKind {
+    VAR_NONE,
+    VAR_SSA,        // never address-taken scalar: lives in SSA values
+    VAR_SLOT,       // frame slot, index = slot
+    VAR_GLOBAL,     // module global (also STATISK locals), index = global
+    VAR_INDIRECT    // struct parameter, index = PARAM instruction holding its address
+} VarKind;
+
+typedef struct VarInfo {
+    VarKind kind;
+    IrType  type;
+    int     index;
+} VarInfo;
+
+/* current SSA value of a variable at the end of a block */
+typedef struct DefEntry {
+    int sym;
+    int block;
+    int value;
+} DefEntry;
+
+/* phi created in a block whose predecessors are not all known yet */
+typedef struct PendingPhi {
+    int block;
+    int sym;
+    int phi;
+} PendingPhi;
+
+typedef struct LabelBlock {
+    int node;
+    int block;
+} LabelBlock;
+
+/* one FALL value of a VÄXEL, ordered by key */
+typedef struct SwitchCase {
+    unsigned long long key;         // value in the selector's order, as an unsigned distance
+    long long          value;
+    int                block;
+} SwitchCase;
+
+typedef enum ClusterKind {
+    CLUSTER_SINGLE,                 // one compare
+    CLUSTER_TABLE,                  // jump table over the range
+    CLUSTER_BITS                    // mask tests on 1 << (selector - first)
+} ClusterKind;
+
+typedef struct SwitchCluster {
+    ClusterKind kind;
+    int         first;              // cases first .. last
+    int         last;
+} SwitchCluster;
+
+typedef struct SwitchLowering {
+    int            selector;
+    IrType         type;
+    int            is_unsigned;
+    int            default_block;
+    SwitchCase    *cases;
+    SwitchCluster *clusters;
+} SwitchLowering;
+
+typedef struct LowerState {
+    Ast            *ast;
+    TypeTable      *types;
+    const SemState *sem;
+    IrModule       *m;
+
+    VarInfo        *vars;           // per symbol
+    char           *addr_taken;     // per symbol
+    int             ty_long;        // LANG, the type of index arithmetic
+
+    // current function
+    IrFunc         *f;
+    int             func_node;
+    int             cur;            // block receiving code, IR_NONE after a terminator
+
+    DefEntry       *defs;           // open-addressed (sym, block) -> value
+    int             def_count;
+    int             def_capacity;
+
+    PendingPhi     *pending;
+    int             pending_count;
+    int             pending_capacity;
+
+    int            *forward;        // removed trivial phi -> value that replaces it
+    int             forward_capacity;
+
+    int             undef[IRT_PTR + 1];
+
+    LabelBlock     *labels;
+    int             label_count;
+    int             label_capacity;
+
+    int             break_targets[64];
+    int             break_count;
+    int             continue_targets[64];
+    int             continue_count;
+} LowerState;
+
+static int  lower_expr(LowerState *ls, int node);
+static int  lower_addr(LowerState *ls, int node);
+static void lower_stmt(LowerState *ls, int node);
+static void lower_cond(LowerState *ls, int node, int on_true, int on_false);
+
+static AstNode *node_at(LowerState *ls, int node)
+{
+    return &ls->ast->nodes[node];
+}
+
+static const Type *type_at(LowerState *ls, int type)
+{
+    return &ls->types->types[type];
+}
+
+static int is_kind(LowerState *ls, int type, TypeKind kind)
+{
+    return type >= 0 && ls->types->types[type].kind == kind;
+}
+
+static int is_aggregate(LowerState *ls, int type)
+{
+    return is_kind(ls, type, TY_ARRAY) || is_kind(ls, type, TY_STRUCT);
+}
+
+static int is_unsigned(LowerState *ls, int type)
+{
+    return type >= 0 && ls->types->types[type].is_unsigned;
+}
+
+//arrays used as values become pointers to their first element
+static int decay(LowerState *ls, int type)
+{
+    if (is_kind(ls, type, TY_ARRAY))
+        return type_pointer(ls->types, type_at(ls, type)->base);
+
+    return type;
+}
+
+static IrType ir_type_of(LowerState *ls, int type)
+{
+    if (type < 0)
+        return IRT_VOID;
+
+    switch (type_at(ls, type)->kind)
+    {
+        case TY_INT:
+        case TY_ENUM:
+            switch (type_size(ls->types, type))
+            {
+                case 1:  return IRT_I8;
+                case 2:  return IRT_I16;
+                case 8:  return IRT_I64;
+                default: return IRT_I32;
+            }
+
+        case TY_FLOAT:
+            return (type_size(ls->types, type) == 4) ? IRT_F32 : IRT_F64;
+
+        case TY_POINTER:
+        case TY_ARRAY:
+        case TY_STRUCT:
+            return IRT_PTR;
+
+        default:
+            return IRT_VOID;
+    }
+}
+
+static void *grow(void *ptr, int *capacity, int count, size_t elem_size, const char *what)
+{
+    if (count < *capacity)
+        return ptr;
+
+    *capacity = (*capacity == 0) ? 16 : *capacity * 2;
+    ptr = realloc(ptr, (size_t)*capacity * elem_size);
+
+    if (!ptr)
+    {
+        fprintf(stderr, "Fatal: %s realloc failed\n", what);
+        exit(1);
+    }
+
+    return ptr;
+}
+
+
+
+/*
+   _____ _____
+  / ____/ ____|  /\
+ | (___| (___   /  \
+  \___ \\___ \ / /\ \
+  ____) |___) / ____ \
+ |_____/_____/_/    \_\
+
+*/
+
+static int new_block(LowerState *ls)
+{
+    return ir_new_block(ls->f);
+}
+
+static int emit(LowerState *ls, IrOp op, IrType type, int a, int b)
+{
+    //code after ÅTERVÄND, BRYT or GÅ TILL gets a block nobody jumps to
+    if (ls->cur == IR_NONE)
+    {
+        ls->cur = new_block(ls);
+        ls->f->blocks[ls->cur].sealed = 1;
+    }
+
+    int i = ir_new_instr(ls->f, op, type, a, b);
+    ir_append(ls->f, ls->cur, i);
+
+    return i;
+}
+
+static int emit_int(LowerState *ls, IrType type, long long value)
+{
+    int i = emit(ls, IR_CONST, type, IR_NONE, IR_NONE);
+
+    ls->f->instrs[i].imm = ir_wrap_int(type, value);
+    return i;
+}
+
+static int emit_const(LowerState *ls, ConstValue value, int type)
+{
+    IrType t = ir_type_of(ls, type);
+
+    if (ir_type_is_float(t))
+    {
+        int i = emit(ls, IR_CONST, t, IR_NONE, IR_NONE);
+
+        ls->f->instrs[i].fimm = (value.kind == CONST_FLOAT) ? value.f : (double)value.i;
+        return i;
+    }
+
+    return emit_int(ls, t, (value.kind == CONST_FLOAT) ? (long long)value.f : value.i);
+}
+
+static int emit_zero(LowerState *ls, IrType type)
+{
+    if (ir_type_is_float(type))
+    {
+        int i = emit(ls, IR_CONST, type, IR_NONE, IR_NONE);
+
+        ls->f->instrs[i].fimm = 0.0;
+        return i;
+    }
+
+    return emit_int(ls, type, 0);
+}
+
+static void emit_jmp(LowerState *ls, int target)
+{
+    //nothing falls out of a dead region
+    if (ls->cur == IR_NONE)
+        return;
+
+    int i = emit(ls, IR_JMP, IRT_VOID, IR_NONE, IR_NONE);
+
+    ls->f->instrs[i].target[0] = target;
+    ir_add_pred(ls->f, target, ls->cur);
+
+    ls->cur = IR_NONE;
+}
+
+static void emit_br(LowerState *ls, int cond, int on_true, int on_false)
+{
+    int i = emit(ls, IR_BR, IRT_VOID, cond, IR_NONE);
+
+    ls->f->instrs[i].target[0] = on_true;
+    ls->f->instrs[i].target[1] = on_false;
+
+    ir_add_pred(ls->f, on_true, ls->cur);
+    ir_add_pred(ls->f, on_false, ls->cur);
+
+    ls->cur = IR_NONE;
+}
+
+static int resolve(LowerState *ls, int value)
+{
+    while (value >= 0 && value < ls->forward_capacity && ls->forward[value] != IR_NONE)
+        value = ls->forward[value];
+
+    return value;
+}
+
+static void set_forward(LowerState *ls, int from, int to)
+{
+    while (from >= ls->forward_capacity)
+    {
+        int old = ls->forward_capacity;
+
+        ls->forward_capacity = (old == 0) ? 256 : old * 2;
+        ls->forward = realloc(ls->forward, ls->forward_capacity * sizeof(int));
+
+        if (!ls->forward)
+        {
+            fprintf(stderr, "Fatal: phi forwarding realloc failed\n");
+            exit(1);
+        }
+
+        for (int i = old; i < ls->forward_capacity; i++)
+            ls->forward[i] = IR_NONE;
+    }
+
+    ls->forward[from] = to;
+}
+
+//reads of variables that were never written see one shared undef per type
+static int undef_value(LowerState *ls, IrType type)
+{
+    if (ls->undef[type] == IR_NONE)
+    {
+        int i = ir_new_instr(ls->f, IR_UNDEF, type, IR_NONE, IR_NONE);
+
+        ir_prepend(ls->f, 0, i);
+        ls->undef[type] = i;
+    }
+
+    return ls->undef[type];
+}
+
+static unsigned def_hash(int sym, int block)
+{
+    return ((unsigned)sym * 2654435761u) ^ ((unsigned)block * 40503u);
+}
+
+static void write_var(LowerState *ls, int sym, int block, int value);
+
+static void grow_defs(LowerState *ls)
+{
+    DefEntry *old = ls->defs;
+    int old_capacity = ls->def_capacity;
+
+    ls->def_capacity = (old_capacity == 0) ? 256 : old_capacity * 2;
+    ls->defs = malloc(ls->def_capacity * sizeof(DefEntry));
+
+    if (!ls->defs)
+    {
+        fprintf(stderr, "Fatal: SSA definition table realloc failed\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < ls->def_capacity; i++)
+        ls->defs[i].sym = -1;
+
+    ls->def_count = 0;
+
+    for (int i = 0; i < old_capacity; i++)
+    {
+        if (old[i].sym >= 0)
+            write_var(ls, old[i].sym, old[i].block, old[i].value);
+    }
+
+    free(old);
+}
+
+static void write_var(LowerState *ls, int sym, int block, int value)
+{
+    if ((ls->def_count + 1) * 2 > ls->def_capacity)
+        grow_defs(ls);
+
+    unsigned mask = ls->def_capacity - 1;
+
+    for (unsigned h = def_hash(sym, block) & mask; ; h = (h + 1) & mask)
+    {
+        DefEntry *e = &ls->defs[h];
+
+        if (e->sym < 0)
+        {
+            e->sym   = sym;
+            e->block = block;
+            e->value = value;
+            ls->def_count++;
+            return;
+        }
+
+        if (e->sym == sym && e->block == block)
+        {
+            e->value = value;
+            return;
+        }
+    }
+}
+
+static int lookup_var(LowerState *ls, int sym, int block)
+{
+    if (ls->def_capacity == 0)
+        return IR_NONE;
+
+    unsigned mask = ls->def_capacity - 1;
+
+    for (unsigned h = def_hash(sym, block) & mask; ; h = (h + 1) & mask)
+    {
+        DefEntry *e = &ls->defs[h];
+
+        if (e->sym < 0)
+            return IR_NONE;
+
+        if (e->sym == sym && e->block == block)
+            return e->value;
+    }
+}
+
+static int new_phi(LowerState *ls, int block, IrType type)
+{
+    int phi = ir_new_instr(ls->f, IR_PHI, type, IR_NONE, IR_NONE);
+
+    ir_prepend(ls->f, block, phi);
+    return phi;
+}
+
+//a phi whose inputs are all one value (or itself) is replaced by that value
+static int try_remove_trivial_phi(LowerState *ls, int phi)
+{
+    IrFunc *f = ls->f;
+    int same = IR_NONE;
+
+    for (int k = 0; k < f->instrs[phi].nargs; k++)
+    {
+        int v = resolve(ls, f->operands[f->instrs[phi].args + k]);
+
+        if (v == same || v == phi)
+            continue;
+
+        if (same != IR_NONE)
+            return phi;
+
+        same = v;
+    }
+
+    if (same == IR_NONE)
+        same = undef_value(ls, f->instrs[phi].type);
+
+    ir_remove(f, phi);
+    set_forward(ls, phi, same);
+
+    return same;
+}
+
+static int read_var(LowerState *ls, int sym, int block);
+
+static int add_phi_operands(LowerState *ls, int sym, int phi)
+{
+    int block = ls->f->instrs[phi].block;
+    int count = ls->f->blocks[block].pred_count;
+    int *values = malloc((count + 1) * sizeof(int));
+
+    if (!values)
+    {
+        fprintf(stderr, "Fatal: failed to allocate phi operands\n");
+        exit(1);
+    }
+
+    for (int p = 0; p < count; p++)
+        values[p] = read_var(ls, sym, ls->f->blocks[block].preds[p]);
+
+    ls->f->instrs[phi].args  = ir_add_operands(ls->f, values, count);
+    ls->f->instrs[phi].nargs = count;
+
+    free(values);
+
+    return try_remove_trivial_phi(ls, phi);
+}
+
+static int read_var(LowerState *ls, int sym, int block)
+{
+    IrFunc *f = ls->f;
+    IrType type = ls->vars[sym].type;
+    int value = lookup_var(ls, sym, block);
+
+    if (value != IR_NONE)
+        return resolve(ls, value);
+
+    if (!f->blocks[block].sealed)
+    {
+        //predecessors may still appear; fill the phi in when the block is sealed
+        value = new_phi(ls, block, type);
+
+        ls->pending = grow(ls->pending, &ls->pending_capacity, ls->pending_count, sizeof(PendingPhi), "pending phi");
+        ls->pending[ls->pending_count].block = block;
+        ls->pending[ls->pending_count].sym   = sym;
+        ls->pending[ls->pending_count].phi   = value;
+        ls->pending_count++;
+    }
+    else if (f->blocks[block].pred_count == 0)
+    {
+        value = undef_value(ls, type);
+    }
+    else if (f->blocks[block].pred_count == 1)
+    {
+        value = read_var(ls, sym, f->blocks[block].preds[0]);
+    }
+    else
+    {
+        //the phi is recorded first so loops reading the variable find it
+        value = new_phi(ls, block, type);
+        write_var(ls, sym, block, value);
+        value = add_phi_operands(ls, sym, value);
+    }
+
+    write_var(ls, sym, block, value);
+
+    return value;
+}
+
+static void seal_block(LowerState *ls, int block)
+{
+    if (ls->f->blocks[block].sealed)
+        return;
+
+    for (int i = 0; i < ls->pending_count; i++)
+    {
+        if (ls->pending[i].block != block)
+            continue;
+
+        add_phi_operands(ls, ls->pending[i].sym, ls->pending[i].phi);
+
+        ls->pending[i] = ls->pending[--ls->pending_count];
+        i--;
+    }
+
+    ls->f->blocks[block].sealed = 1;
+}
+
+static int current_block(LowerState *ls)
+{
+    if (ls->cur == IR_NONE)
+    {
+        ls->cur = new_block(ls);
+        ls->f->blocks[ls->cur].sealed = 1;
+    }
+
+    return ls->cur;
+}
+
+
+
+/*
+   _____                              _
+  / ____|                            (_)
+ | |     ___  _ ____   _____ _ __ ___ _  ___  _ __  ___
+ | |    / _ \| '_ \ \ / / _ \ '__/ __| |/ _ \| '_ \/ __|
+ | |___| (_) | | | \ V /  __/ |  \__ \ | (_) | | | \__ \
+  \_____\___/|_| |_|\_/ \___|_|  |___/_|\___/|_| |_|___/
+
+*/
+
+//converts value of K type from to K type to
+static int convert(LowerState *ls, int value, int from, int to)
+{
+    IrType ft = ir_type_of(ls, decay(ls, from));
+    IrType tt = ir_type_of(ls, to);
+
+    if (tt == IRT_VOID || ft == tt)
+        return value;
+
+    if (ir_type_is_float(ft) && ir_type_is_float(tt))
+        return emit(ls, IR_FCONV, tt, value, IR_NONE);
+
+    if (ir_type_is_float(ft))
+    {
+        if (tt == IRT_PTR)
+            return emit(ls, IR_COPY, IRT_PTR, emit(ls, IR_FTOI, IRT_I64, value, IR_NONE), IR_NONE);
+
+        return emit(ls, IR_FTOI, tt, value, IR_NONE);
+    }
+
+    if (ft == IRT_PTR)
+    {
+        value = emit(ls, IR_COPY, IRT_I64, value, IR_NONE);
+        ft = IRT_I64;
+
+        if (tt == IRT_I64)
+            return value;
+    }
+
+    if (ir_type_is_float(tt))
+        return emit(ls, is_unsigned(ls, from) ? IR_UTOF : IR_ITOF, tt, value, IR_NONE);
+
+    if (tt == IRT_PTR)
+    {
+        if (ft != IRT_I64)
+            value = emit(ls, is_unsigned(ls, from) ? IR_ZEXT : IR_SEXT, IRT_I64, value, IR_NONE);
+
+        return emit(ls, IR_COPY, IRT_PTR, value, IR_NONE);
+    }
+
+    if (ir_type_size(tt) < ir_type_size(ft))
+        return emit(ls, IR_TRUNC, tt, value, IR_NONE);
+
+    //a pointer turned integer has no sign of its own
+    if (is_unsigned(ls, from) || is_kind(ls, decay(ls, from), TY_POINTER))
+        return emit(ls, IR_ZEXT, tt, value, IR_NONE);
+
+    return emit(ls, IR_SEXT, tt, value, IR_NONE);
+}
+
+//lowers an expression already converted to type; folded constants are emitted in the target type directly
+static int lower_as(LowerState *ls, int node, int type)
+{
+    AstNode *n = node_at(ls, node);
+
+    if (n->value.kind != CONST_NONE && type_is_arithmetic(ls->types, type))
+    {
+        ConstValue value = const_convert(ls->types, n->value, type);
+
+        //a float the type cannot hold is converted at run time, as the hardware does it
+        if (value.kind != CONST_NONE)
+            return emit_const(ls, value, type);
+    }
+
+    return convert(ls, lower_expr(ls, node), n->type, type);
+}
+
+
+
+/*
+  ______
+ |  ____|
+ | |__  __  ___ __  _ __ ___  ___ ___ _ ___  _ __  ___
+ |  __| \ \/ / '_ \| '__/ _ \/ __/ __| |/ _ \| '_ \/ __|
+ | |____ >  <| |_) | | |  __/\__ \__ \ | (_) | | | \__ \
+ |______/_/\_\ .__/|_|  \___||___/___/_|\___/|_| |_|___/
+             | |
+             |_|
+*/
+
+//the lexeme keeps its quotes; escapes are decoded here
+static int add_string_literal(LowerState *ls, int node)
+{
+    const char *text = ast_name(ls->ast, node);
+    int length = (int)strlen(text);
+    char *buf = malloc(length + 1);
+    int out = 0;
+    int index;
+
+    if (!buf)
+    {
+        fprintf(stderr, "Fatal: failed to allocate string literal\n");
+        exit(1);
+    }
+
+    for (int c = (text[0] == '"') ? 1 : 0; c < length; c++)
+    {
+        if (text[c] == '"' && c == length - 1)
+            break;
+
+        if (text[c] == '\\' && c + 1 < length)
+        {
+            c++;
+
+            switch (text[c])
+            {
+                case 'n': buf[out++] = '\n'; break;
+                case 't': buf[out++] = '\t'; break;
+                case '0': buf[out++] = '\0'; break;
+                default:  buf[out++] = text[c]; break;
+            }
+            continue;
+        }
+
+        buf[out++] = text[c];
+    }
+
+    index = ir_add_string(ls->m, buf, out);
+    free(buf);
+
+    return index;
+}
+
+//address of element index inside base, whose elements are elem bytes wide
+static int index_address(LowerState *ls, int base, int index_node, int elem)
+{
+    AstNode *index = node_at(ls, index_node);
+
+    if (index->value.kind == CONST_INT)
+    {
+        long long offset = index->value.i * elem;
+
+        if (offset == 0)
+            return base;
+
+        int i = emit(ls, IR_OFFSET, IRT_PTR, base, IR_NONE);
+        ls->f->instrs[i].imm = offset;
+        return i;
+    }
+
+    int i = emit(ls, IR_INDEX, IRT_PTR, base, lower_as(ls, index_node, ls->ty_long));
+    ls->f->instrs[i].imm = elem;
+
+    return i;
+}
+
+static int lower_addr(LowerState *ls, int node)
+{
+    AstNode *n = node_at(ls, node);
+
+    switch (n->kind)
+    {
+        case AST_IDENT:
+        {
+            VarInfo *v = &ls->vars[n->sym];
+            int i;
+
+            switch (v->kind)
+            {
+                case VAR_SLOT:
+                    i = emit(ls, IR_SLOT, IRT_PTR, IR_NONE, IR_NONE);
+                    ls->f->instrs[i].aux = v->index;
+                    return i;
+
+                case VAR_GLOBAL:
+                    i = emit(ls, IR_GLOBAL, IRT_PTR, IR_NONE, IR_NONE);
+                    ls->f->instrs[i].aux = v->index;
+                    return i;
+
+                case VAR_INDIRECT:
+                    return v->index;
+
+                default:
+                    fprintf(stderr, "Fatal: address of register variable '%s'\n", ast_name(ls->ast, node));
+                    exit(1);
+            }
+        }
+
+        case AST_DEREF:
+            return lower_expr(ls, n->kid[0]);
+
+        case AST_INDEX:
+        {
+            int base_type = node_at(ls, n->kid[0])->type;
+            int base = is_kind(ls, base_type, TY_ARRAY) ? lower_addr(ls, n->kid[0]) : lower_expr(ls, n->kid[0]);
+
+            return index_address(ls, base, node_at(ls, node)->kid[1], type_size(ls->types, node_at(ls, node)->type));
+        }
+
+        case AST_FIELD:
+        {
+            int base_type = node_at(ls, n->kid[0])->type;
+            int base = is_kind(ls, base_type, TY_POINTER) ? lower_expr(ls, n->kid[0]) : lower_addr(ls, n->kid[0]);
+            int offset = node_at(ls, node)->aux;
+
+            if (offset == 0)
+                return base;
+
+            int i = emit(ls, IR_OFFSET, IRT_PTR, base, IR_NONE);
+            ls->f->instrs[i].imm = offset;
+            return i;
+        }
+
+        default:
+            //struct-typed values are already addresses
+            return lower_expr(ls, node);
+    }
+}
+
+//reads a value of K type from memory; aggregates stay as their address
+static int load(LowerState *ls, int addr, int type)
+{
+    if (is_aggregate(ls, type))
+        return addr;
+
+    return emit(ls, IR_LOAD, ir_type_of(ls, type), addr, IR_NONE);
+}
+
+static IrOp compare_op(TokenType op, int is_unsigned_or_ptr)
+{
+    switch (op)
+    {
+        case TOK_EQ:  return IR_EQ;
+        case TOK_NEQ: return IR_NE;
+        case TOK_LT:  return is_unsigned_or_ptr ? IR_ULT : IR_LT;
+        case TOK_GT:  return is_unsigned_or_ptr ? IR_UGT : IR_GT;
+        case TOK_LTE: return is_unsigned_or_ptr ? IR_ULE : IR_LE;
+        default:      return is_unsigned_or_ptr ? IR_UGE : IR_GE;
+    }
+}
+
+static int lower_compare(LowerState *ls, int node)
+{
+    AstNode *n = node_at(ls, node);
+    int lhs_type = decay(ls, node_at(ls, n->kid[0])->type);
+    int rhs_type = decay(ls, node_at(ls, n->kid[1])->type);
+    TokenType op = n->op;
+    int lhs_node = n->kid[0];
+    int rhs_node = n->kid[1];
+    int common;
+
+    if (type_is_arithmetic(ls->types, lhs_type) && type_is_arithmetic(ls->types, rhs_type))
+        common = type_common(ls->types, lhs_type, rhs_type);
+    else if (is_kind(ls, lhs_type, TY_POINTER))
+        common = lhs_type;
+    else
+        common = rhs_type;
+
+    int a = lower_as(ls, lhs_node, common);
+    int b = lower_as(ls, rhs_node, common);
+    int unsigned_cmp = is_unsigned(ls, common) || is_kind(ls, common, TY_POINTER);
+
+    return emit(ls, compare_op(op, unsigned_cmp), IRT_I32, a, b);
+}
+
+//OCH / ELLER used as a value: jumping code joined by a phi of 1 and 0
+static int lower_logical_value(LowerState *ls, int node)
+{
+    IrType type = ir_type_of(ls, node_at(ls, node)->type);
+    int on_true  = new_block(ls);
+    int on_false = new_block(ls);
+    int join     = new_block(ls);
+    int values[2];
+
+    lower_cond(ls, node, on_true, on_false);
+
+    seal_block(ls, on_true);
+    seal_block(ls, on_false);
+
+    ls->cur = on_true;
+    values[0] = emit_int(ls, type, 1);
+    emit_jmp(ls, join);
+
+    ls->cur = on_false;
+    values[1] = emit_int(ls, type, 0);
+    emit_jmp(ls, join);
+
+    seal_block(ls, join);
+
+    int phi = new_phi(ls, join, type);
+
+    ls->f->instrs[phi].args  = ir_add_operands(ls->f, values, 2);
+    ls->f->instrs[phi].nargs = 2;
+    ls->cur = join;
+
+    return phi;
+}
+
+static int lower_binary(LowerState *ls, int node)
+{
+    AstNode *n = node_at(ls, node);
+    int type = n->type;
+    int lhs_type = decay(ls, node_at(ls, n->kid[0])->type);
+    int rhs_type = decay(ls, node_at(ls, n->kid[1])->type);
+    int lhs_node = n->kid[0];
+    int rhs_node = n->kid[1];
+    TokenType op = n->op;
+    IrType t = ir_type_of(ls, type);
+    IrOp irop;
+
+    switch (op)
+    {
+        case TOK_OCH:
+        case TOK_ELLER:
+            return lower_logical_value(ls, node);
+
+        case TOK_EQ:
+        case TOK_NEQ:
+        case TOK_LT:
+        case TOK_GT:
+        case TOK_LTE:
+        case TOK_GTE:
+            return convert(ls, lower_compare(ls, node), ls->types->ty_int, type);
+
+        case TOK_PLUS:
+        case TOK_MINUS:
+            if (is_kind(ls, lhs_type, TY_POINTER) && is_kind(ls, rhs_type, TY_POINTER))
+            {
+                //p - q counts elements between the pointers
+                int elem = type_size(ls->types, type_at(ls, lhs_type)->base);
+                int a = emit(ls, IR_COPY, IRT_I64, lower_expr(ls, lhs_node), IR_NONE);
+                int b = emit(ls, IR_COPY, IRT_I64, lower_expr(ls, rhs_node), IR_NONE);
+                int diff = emit(ls, IR_SUB, IRT_I64, a, b);
+
+                if (elem > 1)
+                    diff = emit(ls, IR_DIV, IRT_I64, diff, emit_int(ls, IRT_I64, elem));
+
+                return convert(ls, diff, ls->ty_long, type);
+            }
+
+            if (is_kind(ls, lhs_type, TY_POINTER) || is_kind(ls, rhs_type, TY_POINTER))
+            {
+                int ptr_node = is_kind(ls, lhs_type, TY_POINTER) ? lhs_node : rhs_node;
+                int int_node = (ptr_node == lhs_node) ? rhs_node : lhs_node;
+                int elem = type_size(ls->types, type_at(ls, type)->base);
+                int base = lower_expr(ls, ptr_node);
+                int index = lower_as(ls, int_node, ls->ty_long);
+
+                if (op == TOK_MINUS)
+                    index = emit(ls, IR_NEG, IRT_I64, index, IR_NONE);
+
+                int i = emit(ls, IR_INDEX, IRT_PTR, base, index);
+                ls->f->instrs[i].imm = (elem > 0) ? elem : 1;
+                return i;
+            }
+
+            irop = (op == TOK_PLUS) ? IR_ADD : IR_SUB;
+            break;
+
+        case TOK_MUL:    irop = IR_MUL; break;
+        case TOK_DIV:    irop = is_unsigned(ls, type) ? IR_UDIV : IR_DIV; break;
+        case TOK_MOD:    irop = is_unsigned(ls, type) ? IR_UMOD : IR_MOD; break;
+        case TOK_BITAND: irop = IR_AND; break;
+        case TOK_BITOR:  irop = IR_OR;  break;
+        case TOK_BITXOR: irop = IR_XOR; break;
+        case TOK_VANSTER: irop = IR_SHL; break;
+        case TOK_HOGER:  irop = is_unsigned(ls, type) ? IR_USHR : IR_SHR; break;
+
+        default:
+            fprintf(stderr, "Fatal: cannot lower binary operator %s\n", tok2lexeme(op));
+            exit(1);
+    }
+
+    //both operands in the result type (shift counts included)
+    int a = lower_as(ls, lhs_node, type);
+    int b = lower_as(ls, rhs_node, type);
+
+    return emit(ls, irop, t, a, b);
+}
+
+static int lower_call(LowerState *ls, int node)
+{
+    const Symbol *sym = &ls->sem->symbols[node_at(ls, node)->sym];
+    int callee = ls->vars[node_at(ls, node)->sym].index;
+    int param = node_at(ls, sym->node)->list;
+    int count = ast_list_length(ls->ast, node_at(ls, node)->list);
+    int *args = malloc((count + 1) * sizeof(int));
+    int k = 0;
+
+    if (!args)
+    {
+        fprintf(stderr, "Fatal: failed to allocate call arguments\n");
+        exit(1);
+    }
+
+    for (int a = node_at(ls, node)->list; a != AST_NULL; a = node_at(ls, a)->next, k++)
+    {
+        int want = node_at(ls, param)->type;
+
+        if (is_kind(ls, want, TY_STRUCT))
+        {
+            //struct arguments are copied by the caller, the callee gets the copy's address
+            int size = type_size(ls->types, want);
+            int slot = ir_new_slot(ls->f, size, type_align(ls->types, want), -1);
+            int addr = emit(ls, IR_SLOT, IRT_PTR, IR_NONE, IR_NONE);
+            int copy;
+
+            ls->f->instrs[addr].aux = slot;
+            copy = emit(ls, IR_MEMCPY, IRT_VOID, addr, lower_addr(ls, a));
+            ls->f->instrs[copy].imm = size;
+            args[k] = addr;
+        }
+        else
+        {
+            args[k] = lower_as(ls, a, want);
+        }
+
+        param = node_at(ls, param)->next;
+    }
+
+    int i = emit(ls, IR_CALL, ir_type_of(ls, sym->type), IR_NONE, IR_NONE);
+
+    ls->f->instrs[i].aux   = callee;
+    ls->f->instrs[i].args  = ir_add_operands(ls->f, args, count);
+    ls->f->instrs[i].nargs = count;
+
+    free(args);
+
+    return i;
+}
+
+static int lower_expr(LowerState *ls, int node)
+{
+    AstNode *n = node_at(ls, node);
+    int type = n->type;
+
+    if (n->value.kind != CONST_NONE && type_is_arithmetic(ls->types, type))
+        return emit_const(ls, n->value, type);
+
+    switch (n->kind)
+    {
+        case AST_STRING_LIT:
+        {
+            int i = emit(ls, IR_STRING, IRT_PTR, IR_NONE, IR_NONE);
+
+            ls->f->instrs[i].aux = add_string_literal(ls, node);
+            return i;
+        }
+
+        case AST_IDENT:
+        {
+            const Symbol *sym = &ls->sem->symbols[n->sym];
+
+            if (sym->kind == SYM_FUNC)
+            {
+                int i = emit(ls, IR_FUNCADDR, IRT_PTR, IR_NONE, IR_NONE);
+                ls->f->instrs[i].aux = ls->vars[n->sym].index;
+                return i;
+            }
+
+            if (ls->vars[n->sym].kind == VAR_SSA)
+                return read_var(ls, n->sym, current_block(ls));
+
+            return load(ls, lower_addr(ls, node), type);
+        }
+
+        case AST_BINARY:
+            return lower_binary(ls, node);
+
+        case AST_UNARY:
+        {
+            int operand_type = decay(ls, node_at(ls, n->kid[0])->type);
+            TokenType op = n->op;
+            int kid = n->kid[0];
+
+            if (op == TOK_INTE)
+            {
+                int v = lower_expr(ls, kid);
+                int zero = emit_zero(ls, ir_type_of(ls, operand_type));
+
+                return convert(ls, emit(ls, IR_EQ, IRT_I32, v, zero), ls->types->ty_int, type);
+            }
+
+            int v = lower_as(ls, kid, type);
+
+            if (op == TOK_MINUS)
+                return emit(ls, IR_NEG, ir_type_of(ls, type), v, IR_NONE);
+            if (op == TOK_BITNOT)
+                return emit(ls, IR_NOT, ir_type_of(ls, type), v, IR_NONE);
+
+            return v;
+        }
+
+        case AST_DEREF:
+            return load(ls, lower_expr(ls, n->kid[0]), type);
+
+        case AST_ADDRESS:
+            return lower_addr(ls, n->kid[0]);
+
+        case AST_CAST:
+        {
+            int operand = n->kid[1];
+
+            if (type == ls->types->ty_void)
+            {
+                lower_expr(ls, operand);
+                return IR_NONE;
+            }
+
+            return lower_as(ls, operand, type);
+        }
+
+        case AST_CALL:
+            return lower_call(ls, node);
+
+        case AST_INDEX:
+        case AST_FIELD:
+            return load(ls, lower_addr(ls, node), type);
+
+        default:
+            fprintf(stderr, "Fatal: cannot lower %s as an expression\n", ast_kind_name(n->kind));
+            exit(1);
+    }
+}
+
+//jumping code: branches to on_true or on_false without materialising a 0 / 1
+static void lower_cond(LowerState *ls, int node, int on_true, int on_false)
+{
+    AstNode *n = node_at(ls, node);
+
+    if (n->value.kind != CONST_NONE)
+    {
+        emit_jmp(ls, const_is_true(n->value) ? on_true : on_false);
+        return;
+    }
+
+    if (n->kind == AST_BINARY && (n->op == TOK_OCH || n->op == TOK_ELLER))
+    {
+        int rhs = n->kid[1];
+        int mid = new_block(ls);
+
+        if (n->op == TOK_OCH)
+            lower_cond(ls, n->kid[0], mid, on_false);
+        else
+            lower_cond(ls, n->kid[0], on_true, mid);
+
+        seal_block(ls, mid);
+        ls->cur = mid;
+
+        lower_cond(ls, rhs, on_true, on_false);
+        return;
+    }
+
+    if (n->kind == AST_UNARY && n->op == TOK_INTE)
+    {
+        lower_cond(ls, n->kid[0], on_false, on_true);
+        return;
+    }
+
+    if (n->kind == AST_BINARY &&
+        (n->op == TOK_EQ || n->op == TOK_NEQ || n->op == TOK_LT ||
+         n->op == TOK_GT || n->op == TOK_LTE || n->op == TOK_GTE))
+    {
+        emit_br(ls, lower_compare(ls, node), on_true, on_false);
+        return;
+    }
+
+    int type = decay(ls, n->type);
+    int v = lower_expr(ls, node);
+
+    //floats are tested against 0.0 explicitly; integers and pointers branch directly
+    if (ir_type_is_float(ir_type_of(ls, type)))
+        v = emit(ls, IR_NE, IRT_I32, v, emit_zero(ls, ir_type_of(ls, type)));
+
+    emit_br(ls, v, on_true, on_false);
+}
+
+
+
+/*
+  _                 _
+ | |               | |
+ | |    __   ____ _| |_   _  ___  ___
+ | |    \ \ / / _` | | | | |/ _ \/ __|
+ | |____ \ V / (_| | | |_| |  __/\__ \
+ |______| \_/ \__,_|_|\__,_|\___||___/
+
+*/
+
+typedef struct LValue {
+    int is_var;     // SSA variable (sym) or memory (addr)
+    int sym;
+    int addr;
+    int type;
+} LValue;
+
+static LValue lvalue_of(LowerState *ls, int node)
+{
+    AstNode *n = node_at(ls, node);
+    LValue lv;
+
+    lv.type = n->type;
+    lv.sym  = -1;
+    lv.addr = IR_NONE;
+
+    if (n->kind == AST_IDENT && ls->vars[n->sym].kind == VAR_SSA)
+    {
+        lv.is_var = 1;
+        lv.sym    = n->sym;
+        return lv;
+    }
+
+    lv.is_var = 0;
+    lv.addr   = lower_addr(ls, node);
+
+    return lv;
+}
+
+static int lv_load(LowerState *ls, LValue *lv)
+{
+    if (lv->is_var)
+        return read_var(ls, lv->sym, current_block(ls));
+
+    return load(ls, lv->addr, lv->type);
+}
+
+static void lv_store(LowerState *ls, LValue *lv, int value)
+{
+    if (lv->is_var)
+    {
+        write_var(ls, lv->sym, current_block(ls), value);
+        return;
+    }
+
+    emit(ls, IR_STORE, IRT_VOID, lv->addr, value);
+}
+
+static void lower_assign(LowerState *ls, int node)
+{
+    int target = node_at(ls, node)->kid[0];
+    int source = node_at(ls, node)->kid[1];
+    LValue lv = lvalue_of(ls, target);
+
+    if (is_kind(ls, lv.type, TY_STRUCT))
+    {
+        int copy = emit(ls, IR_MEMCPY, IRT_VOID, lv.addr, lower_addr(ls, source));
+
+        ls->f->instrs[copy].imm = type_size(ls->types, lv.type);
+        return;
+    }
+
+    lv_store(ls, &lv, lower_as(ls, source, lv.type));
+}
+
+static void lower_update(LowerState *ls, int node)
+{
+    AstNode *n = node_at(ls, node);
+    TokenType op = n->op;
+    int amount_node = n->kid[1];
+    LValue lv = lvalue_of(ls, n->kid[0]);
+    int amount_type = (amount_node != AST_NULL) ? decay(ls, node_at(ls, amount_node)->type) : ls->types->ty_int;
+    int current = lv_load(ls, &lv);
+    int subtract = (op == TOK_MINSKAR || op == TOK_MINUS_ASSIGN);
+    int amount;
+
+    if (is_kind(ls, lv.type, TY_POINTER) &&
+        (op == TOK_OKAR || op == TOK_MINSKAR || op == TOK_PLUS_ASSIGN || op == TOK_MINUS_ASSIGN))
+    {
+        int elem = type_size(ls->types, type_at(ls, lv.type)->base);
+
+        amount = (amount_node != AST_NULL) ? lower_as(ls, amount_node, ls->ty_long) : emit_int(ls, IRT_I64, 1);
+
+        if (subtract)
+            amount = emit(ls, IR_NEG, IRT_I64, amount, IR_NONE);
+
+        int i = emit(ls, IR_INDEX, IRT_PTR, current, amount);
+        ls->f->instrs[i].imm = (elem > 0) ? elem : 1;
+
+        lv_store(ls, &lv, i);
+        return;
+    }
+
+    //the operation happens in the common type, the result converts back
+    int common = (op == TOK_SHL_ASSIGN || op == TOK_SHR_ASSIGN)
+               ? type_promote(ls->types, lv.type)
+               : type_common(ls->types, lv.type, amount_type);
+    IrType t = ir_type_of(ls, common);
+    IrOp irop;
+
+    switch (op)
+    {
+        case TOK_OKAR:
+        case TOK_PLUS_ASSIGN:  irop = IR_ADD; break;
+        case TOK_MINSKAR:
+        case TOK_MINUS_ASSIGN: irop = IR_SUB; break;
+        case TOK_MUL_ASSIGN:   irop = IR_MUL; break;
+        case TOK_DIV_ASSIGN:   irop = ir_type_is_float(t) ? IR_DIV : (is_unsigned(ls, common) ? IR_UDIV : IR_DIV); break;
+        case TOK_SHL_ASSIGN:   irop = IR_SHL; break;
+        default:               irop = is_unsigned(ls, common) ? IR_USHR : IR_SHR; break;
+    }
+
+    current = convert(ls, current, lv.type, common);
+
+    if (amount_node != AST_NULL)
+        amount = lower_as(ls, amount_node, common);
+    else if (ir_type_is_float(t))
+    {
+        amount = emit(ls, IR_CONST, t, IR_NONE, IR_NONE);
+        ls->f->instrs[amount].fimm = 1.0;
+    }
+    else
+        amount = emit_int(ls, t, 1);
+
+    lv_store(ls, &lv, convert(ls, emit(ls, irop, t, current, amount), common, lv.type));
+}
+
+//stores an initializer into memory at addr; < ... > lists only name the leading elements
+static void init_memory(LowerState *ls, int addr, int init, int type)
+{
+    AstNode *n = node_at(ls, init);
+
+    if (n->kind != AST_ARRAY_LIT)
+    {
+        if (is_kind(ls, type, TY_STRUCT))
+        {
+            int copy = emit(ls, IR_MEMCPY, IRT_VOID, addr, lower_addr(ls, init));
+            ls->f->instrs[copy].imm = type_size(ls->types, type);
+        }
+        else
+        {
+            emit(ls, IR_STORE, IRT_VOID, addr, lower_as(ls, init, type));
+        }
+        return;
+    }
+
+    int index = 0;
+
+    for (int e = n->list; e != AST_NULL; e = node_at(ls, e)->next, index++)
+    {
+        int elem_type;
+        int offset;
+
+        if (is_kind(ls, type, TY_ARRAY))
+        {
+            elem_type = type_at(ls, type)->base;
+            offset = index * type_size(ls->types, elem_type);
+        }
+        else
+        {
+            const StructInfo *info = &ls->types->structs[type_at(ls, type)->info];
+            const StructField *field = &ls->types->fields[info->first_field + index];
+
+            elem_type = field->type;
+            offset = field->offset;
+        }
+
+        int at = addr;
+
+        if (offset != 0)
+        {
+            at = emit(ls, IR_OFFSET, IRT_PTR, addr, IR_NONE);
+            ls->f->instrs[at].imm = offset;
+        }
+
+        init_memory(ls, at, e, elem_type);
+    }
+}
+
+
+
+/*
+  _____       _ _   _       _ _
+ |_   _|     (_) | (_)     | (_)
+   | |  _ __  _| |_ _  __ _| |_ _______ _ __ ___
+   | | | '_ \| | __| |/ _` | | |_  / _ \ '__/ __|
+  _| |_| | | | | |_| | (_| | | |/ /  __/ |  \__ \
+ |_____|_| |_|_|\__|_|\__,_|_|_/___\___|_|  |___/
+
+*/
+
+static void write_bytes(unsigned char *dst, unsigned long long value, int size)
+{
+    for (int b = 0; b < size; b++)
+        dst[b] = (unsigned char)(value >> (8 * b));
+}
+
+//writes a constant initializer into global data (little endian)
+static void init_global_data(LowerState *ls, int g, int offset, int init, int type)
+{
+    AstNode *n = node_at(ls, init);
+
+    if (n->kind == AST_ARRAY_LIT)
+    {
+        int index = 0;
+
+        for (int e = n->list; e != AST_NULL; e = node_at(ls, e)->next, index++)
+        {
+            if (is_kind(ls, type, TY_ARRAY))
+            {
+                int elem = type_at(ls, type)->base;
+
+                init_global_data(ls, g, offset + index * type_size(ls->types, elem), e, elem);
+            }
+            else
+            {
+                const StructInfo *info = &ls->types->structs[type_at(ls, type)->info];
+                const StructField *field = &ls->types->fields[info->first_field + index];
+
+                init_global_data(ls, g, offset + field->offset, e, field->type);
+            }
+        }
+        return;
+    }
+
+    if (n->kind == AST_STRING_LIT)
+    {
+        ir_add_reloc(ls->m, g, offset, IR_RELOC_STRING, add_string_literal(ls, init), 0);
+        return;
+    }
+
+    if (n->kind == AST_ADDRESS && node_at(ls, n->kid[0])->kind == AST_IDENT)
+    {
+        VarInfo *v = &ls->vars[node_at(ls, n->kid[0])->sym];
+
+        if (v->kind == VAR_GLOBAL)
+            ir_add_reloc(ls->m, g, offset, IR_RELOC_GLOBAL, v->index, 0);
+        return;
+    }
+
+    ConstValue value = const_convert(ls->types, n->value, type);
+    unsigned char *dst = ls->m->globals[g].data + offset;
+    int size = type_size(ls->types, type);
+
+    if (value.kind == CONST_FLOAT)
+    {
+        if (size == 4)
+        {
+            float f = (float)value.f;
+            memcpy(dst, &f, 4);
+        }
+        else
+        {
+            memcpy(dst, &value.f, 8);
+        }
+    }
+    else if (value.kind == CONST_INT)
+    {
+        write_bytes(dst, (unsigned long long)value.i, size);
+    }
+}
+
+static int declare_global(LowerState *ls, int node, const char *name)
+{
+    int type = node_at(ls, node)->type;
+    int g = ir_add_global(ls->m, name, type_size(ls->types, type), type_align(ls->types, type));
+
+    ls->m->globals[g].node = node;
+    ls->m->globals[g].is_extern = (node_at(ls, node)->flags & AST_FLAG_EXTERN) && node_at(ls, node)->kid[1] == AST_NULL;
+    ls->m->globals[g].is_static = (node_at(ls, node)->flags & AST_FLAG_STATIC) != 0;
+
+    ls->vars[node_at(ls, node)->sym].kind  = VAR_GLOBAL;
+    ls->vars[node_at(ls, node)->sym].type  = ir_type_of(ls, type);
+    ls->vars[node_at(ls, node)->sym].index = g;
+
+    if (node_at(ls, node)->kid[1] != AST_NULL)
+        init_global_data(ls, g, 0, node_at(ls, node)->kid[1], type);
+
+    return g;
+}
+
+
+
+/*
+   _____ _        _                            _
+  / ____| |      | |                          | |
+ | (___ | |_ __ _| |_ ___ _ __ ___   ___ _ __ | |_ ___
+  \___ \| __/ _` | __/ _ \ '_ ` _ \ / _ \ '_ \| __/ __|
+  ____) | || (_| | ||  __/ | | | | |  __/ | | | |_\__ \
+ |_____/ \__\__,_|\__\___|_| |_| |_|\___|_| |_|\__|___/
+
+*/
+
+static int label_block(LowerState *ls, int label)
+{
+    for (int i = 0; i < ls->label_count; i++)
+    {
+        if (ls->labels[i].node == label)
+            return ls->labels[i].block;
+    }
+
+    ls->labels = grow(ls->labels, &ls->label_capacity, ls->label_count, sizeof(LabelBlock), "label");
+    ls->labels[ls->label_count].node  = label;
+    ls->labels[ls->label_count].block = new_block(ls);
+
+    return ls->labels[ls->label_count++].block;
+}
+
+static void push_target(int *stack, int *count, int block)
+{
+    if (*count >= 64)
+    {
+        fprintf(stderr, "Fatal: loops nested too deeply\n");
+        exit(1);
+    }
+
+    stack[(*count)++] = block;
+}
+
+static void lower_local_decl(LowerState *ls, int node)
+{
+    AstNode *n = node_at(ls, node);
+    VarInfo *v = &ls->vars[n->sym];
+    int init = n->kid[1];
+
+    //STATISK locals were turned into globals up front
+    if (v->kind == VAR_GLOBAL || init == AST_NULL)
+        return;
+
+    if (v->kind == VAR_SSA)
+    {
+        int value = lower_as(ls, init, n->type);
+
+        write_var(ls, n->sym, current_block(ls), value);
+        return;
+    }
+
+    int addr = emit(ls, IR_SLOT, IRT_PTR, IR_NONE, IR_NONE);
+
+    ls->f->instrs[addr].aux = v->index;
+
+    //a < ... > list clears the whole object first, like C aggregate initialization
+    if (node_at(ls, init)->kind == AST_ARRAY_LIT)
+    {
+        int clear = emit(ls, IR_MEMZERO, IRT_VOID, addr, IR_NONE);
+        ls->f->instrs[clear].imm = type_size(ls->types, n->type);
+    }
+
+    init_memory(ls, addr, init, n->type);
+}
+
+static int compare_switch_cases(const void *a, const void *b)
+{
+    const SwitchCase *x = a;
+    const SwitchCase *y = b;
+
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+//fewest cases a bit test with 1, 2 or 3 destinations must cover to beat plain compares
+static const int bit_test_min_cases[SWITCH_BIT_TEST_DESTS + 1] = { 0, 3, 5, 6 };
+
+//splits the sorted cases into runs lowered one way each; returns how many
+static int cluster_cases(const SwitchCase *cases, int count, SwitchCluster *out)
+{
+    int n = 0;
+
+    for (int i = 0; i < count; )
+    {
+        int table_last = -1;
+        int bits_last = -1;
+        int dests[SWITCH_BIT_TEST_DESTS];
+        int dest_count = 0;
+
+        //the longest run dense enough for a table
+        for (int j = i + SWITCH_TABLE_MIN_CASES - 1; j < count; j++)
+        {
+            unsigned long long range = cases[j].key - cases[i].key + 1;
+
+            if (range > SWITCH_TABLE_MAX)
+                break;
+
+            if ((unsigned long long)(j - i + 1) * 100 >= SWITCH_TABLE_DENSITY * range)
+                table_last = j;
+        }
+
+        //the longest run inside one word that reaches few blocks
+        for (int j = i; j < count && cases[j].key - cases[i].key < 64; j++)
+        {
+            int d = 0;
+
+            while (d < dest_count && dests[d] != cases[j].block)
+                d++;
+
+            if (d == dest_count)
+            {
+                if (dest_count == SWITCH_BIT_TEST_DESTS)
+                    break;
+
+                dests[dest_count++] = cases[j].block;
+            }
+
+            if (j - i + 1 >= bit_test_min_cases[dest_count])
+                bits_last = j;
+        }
+
+        //whichever covers more, a table on a tie
+        if (table_last >= 0 && table_last >= bits_last)
+            out[n].kind = CLUSTER_TABLE;
+        else if (bits_last >= 0)
+            out[n].kind = CLUSTER_BITS;
+        else
+            out[n].kind = CLUSTER_SINGLE;
+
+        out[n].first = i;
+        out[n].last  = (out[n].kind == CLUSTER_TABLE) ? table_last : (out[n].kind == CLUSTER_BITS) ? bits_last : i;
+        i = out[n].last + 1;
+        n++;
+    }
+
+    return n;
+}
+
+//selector - base as an unsigned i64, so one compare bounds it from both sides
+static int switch_index(LowerState *ls, const SwitchLowering *sw, long long base)
+{
+    int index = emit(ls, IR_SUB, sw->type, sw->selector, emit_int(ls, sw->type, base));
+
+    if (sw->type != IRT_I64)
+        index = emit(ls, IR_ZEXT, IRT_I64, index, IR_NONE);
+
+    return index;
+}
+
+static void lower_table_cluster(LowerState *ls, const SwitchLowering *sw, const SwitchCluster *c, int fail)
+{
+    const SwitchCase *cases = sw->cases;
+    int length = (int)(cases[c->last].key - cases[c->first].key + 1);
+    int *table = malloc(length * sizeof(int));
+    int index = switch_index(ls, sw, cases[c->first].value);
+    int instr, count;
+    const int *succ;
+
+    if (!table)
+    {
+        fprintf(stderr, "Fatal: failed to allocate jump table\n");
+        exit(1);
+    }
+
+    for (int k = 0; k < length; k++)
+        table[k] = fail;
+
+    for (int k = c->first; k <= c->last; k++)
+        table[cases[k].key - cases[c->first].key] = cases[k].block;
+
+    instr = ir_new_switch(ls->f, index, fail, table, length);
+    ir_append(ls->f, ls->cur, instr);
+
+    count = ir_successors(ls->f, ls->cur, &succ);
+
+    for (int s = 0; s < count; s++)
+        ir_add_pred(ls->f, succ[s], ls->cur);
+
+    ls->cur = IR_NONE;
+    free(table);
+}
+
+static void lower_bit_cluster(LowerState *ls, const SwitchLowering *sw, const SwitchCluster *c, int fail)
+{
+    const SwitchCase *cases = sw->cases;
+    unsigned long long base = cases[c->first].key;
+    int index = switch_index(ls, sw, cases[c->first].value);
+    int inside = new_block(ls);
+    int bit;
+
+    emit_br(ls, emit(ls, IR_UGT, IRT_I32, index, emit_int(ls, IRT_I64, (long long)(cases[c->last].key - base))), fail, inside);
+    seal_block(ls, inside);
+    ls->cur = inside;
+
+    bit = emit(ls, IR_SHL, IRT_I64, emit_int(ls, IRT_I64, 1), index);
+
+    //one mask per destination, in order of first appearance
+    for (int k = c->first; k <= c->last; k++)
+    {
+        unsigned long long mask = 0;
+        int done = 0;
+        int next;
+
+        for (int j = c->first; j < k && !done; j++)
+            done = (cases[j].block == cases[k].block);
+
+        if (done)
+            continue;
+
+        for (int j = k; j <= c->last; j++)
+        {
+            if (cases[j].block == cases[k].block)
+                mask |= 1ull << (cases[j].key - base);
+        }
+
+        //the last destination falls back to fail; a later one is still to come otherwise
+        next = fail;
+
+        for (int j = k + 1; j <= c->last && next == fail; j++)
+        {
+            int seen = 0;
+
+            for (int q = c->first; q < j && !seen; q++)
+                seen = (cases[q].block == cases[j].block);
+
+            if (!seen)
+                next = new_block(ls);
+        }
+
+        int hit = emit(ls, IR_AND, IRT_I64, bit, emit_int(ls, IRT_I64, (long long)mask));
+
+        emit_br(ls, emit(ls, IR_NE, IRT_I32, hit, emit_int(ls, IRT_I64, 0)), cases[k].block, next);
+
+        if (next != fail)
+        {
+            seal_block(ls, next);
+            ls->cur = next;
+        }
+    }
+}
+
+static void lower_cluster(LowerState *ls, const SwitchLowering *sw, const SwitchCluster *c, int fail)
+{
+    switch (c->kind)
+    {
+        case CLUSTER_TABLE:
+            lower_table_cluster(ls, sw, c, fail);
+            break;
+
+        case CLUSTER_BITS:
+            lower_bit_cluster(ls, sw, c, fail);
+            break;
+
+        default:
+        {
+            int value = emit_int(ls, sw->type, sw->cases[c->first].value);
+
+            emit_br(ls, emit(ls, IR_EQ, IRT_I32, sw->selector, value), sw->cases[c->first].block, fail);
+            break;
+        }
+    }
+}
+
+//binary search over clusters lo .. hi, a short run is tested in order
+static void lower_clusters(LowerState *ls, const SwitchLowering *sw, int lo, int hi)
+{
+    if (hi - lo < SWITCH_LINEAR)
+    {
+        for (int c = lo; c <= hi; c++)
+        {
+            int fail = (c == hi) ? sw->default_block : new_block(ls);
+
+            lower_cluster(ls, sw, &sw->clusters[c], fail);
+
+            if (c < hi)
+            {
+                seal_block(ls, fail);
+                ls->cur = fail;
+            }
+        }
+        return;
+    }
+
+    int mid = (lo + hi + 1) / 2;
+    int below = new_block(ls);
+    int above = new_block(ls);
+    int pivot = emit_int(ls, sw->type, sw->cases[sw->clusters[mid].first].value);
+
+    emit_br(ls, emit(ls, sw->is_unsigned ? IR_ULT : IR_LT, IRT_I32, sw->selector, pivot), below, above);
+    seal_block(ls, below);
+    seal_block(ls, above);
+
+    ls->cur = below;
+    lower_clusters(ls, sw, lo, mid - 1);
+
+    ls->cur = above;
+    lower_clusters(ls, sw, mid, hi);
+}
+
+static void lower_switch(LowerState *ls, int node)
+{
+    int selector_node = node_at(ls, node)->kid[0];
+    int selector_type = type_promote(ls->types, node_at(ls, selector_node)->type);
+    IrType t = ir_type_of(ls, selector_type);
+    int selector = lower_as(ls, selector_node, selector_type);
+    int exit_block = new_block(ls);
+    int default_block = exit_block;
+    int case_count = ast_list_length(ls->ast, node_at(ls, node)->list);
+    int *blocks = malloc((case_count + 1) * sizeof(int));
+    int *dests = malloc((case_count + 1) * sizeof(int));
+    int *labels = malloc((case_count + 1) * sizeof(int));
+    SwitchCase *cases = malloc((case_count + 1) * sizeof(SwitchCase));
+    SwitchCluster *clusters = malloc((case_count + 1) * sizeof(SwitchCluster));
+    SwitchLowering sw;
+    int value_count = 0;
+    int k = 0;
+
+    if (!blocks || !dests || !labels || !cases || !clusters)
+    {
+        fprintf(stderr, "Fatal: failed to allocate switch blocks\n");
+        exit(1);
+    }
+
+    for (int c = node_at(ls, node)->list; c != AST_NULL; c = node_at(ls, c)->next, k++)
+    {
+        blocks[k] = new_block(ls);
+        labels[k] = c;
+    }
+
+    //an empty FALL only falls through, so its value can go where the next one goes
+    for (k = case_count - 1; k >= 0; k--)
+    {
+        if (node_at(ls, labels[k])->list != AST_NULL)
+            dests[k] = blocks[k];
+        else
+            dests[k] = (k + 1 < case_count) ? dests[k + 1] : exit_block;
+    }
+
+    for (k = 0; k < case_count; k++)
+    {
+        const AstNode *label = node_at(ls, labels[k]);
+
+        if (label->kid[0] == AST_NULL)
+        {
+            default_block = dests[k];
+            continue;
+        }
+
+        //keys keep the selector's order and make differences plain distances
+        long long value = ir_wrap_int(t, label->value.i);
+        unsigned long long key = (unsigned long long)value;
+
+        if (is_unsigned(ls, selector_type))
+            key = (t == IRT_I64) ? key : (key & 0xffffffffull);
+        else
+            key ^= 1ull << 63;
+
+        cases[value_count].key   = key;
+        cases[value_count].value = value;
+        cases[value_count].block = dests[k];
+        value_count++;
+    }
+
+    //sema has rejected repeated FALL values
+    qsort(cases, value_count, sizeof(SwitchCase), compare_switch_cases);
+
+    sw.selector      = selector;
+    sw.type          = t;
+    sw.is_unsigned   = is_unsigned(ls, selector_type);
+    sw.default_block = default_block;
+    sw.cases         = cases;
+    sw.clusters      = clusters;
+
+    if (value_count == 0)
+        emit_jmp(ls, default_block);
+    else
+        lower_clusters(ls, &sw, 0, cluster_cases(cases, value_count, clusters) - 1);
+
+    //bodies fall through into the next FALL, as in C
+    push_target(ls->break_targets, &ls->break_count, exit_block);
+    k = 0;
+
+    for (int c = node_at(ls, node)->list; c != AST_NULL; c = node_at(ls, c)->next, k++)
+    {
+        if (k > 0)
+            emit_jmp(ls, blocks[k]);
+
+        seal_block(ls, blocks[k]);
+        ls->cur = blocks[k];
+
+        for (int s = node_at(ls, c)->list; s != AST_NULL; s = node_at(ls, s)->next)
+            lower_stmt(ls, s);
+    }
+
+    emit_jmp(ls, exit_block);
+    ls->break_count--;
+
+    seal_block(ls, exit_block);
+    ls->cur = exit_block;
+
+    free(blocks);
+    free(dests);
+    free(labels);
+    free(cases);
+    free(clusters);
+}
+
+static void lower_loop(LowerState *ls, int node)
+{
+    AstNode *n = node_at(ls, node);
+    AstKind kind = n->kind;
+    int cond = (kind == AST_FOR) ? n->kid[1] : n->kid[0];
+    int body_node = (kind == AST_FOR) ? n->kid[3] : n->kid[1];
+    int update = (kind == AST_FOR) ? n->kid[2] : AST_NULL;
+    int header = new_block(ls);
+    int body = new_block(ls);
+    int exit_block = new_block(ls);
+    int next = (kind == AST_FOR) ? new_block(ls) : header;
+
+    if (kind == AST_FOR)
+        lower_stmt(ls, n->kid[0]);
+
+    if (kind == AST_DO_WHILE)
+    {
+        //GÖR ... MEDAN: body first, the condition block is the FORTSÄTT target
+        emit_jmp(ls, body);
+
+        push_target(ls->break_targets, &ls->break_count, exit_block);
+        push_target(ls->continue_targets, &ls->continue_count, header);
+
+        ls->cur = body;
+        lower_stmt(ls, body_node);
+        emit_jmp(ls, header);
+
+        ls->break_count--;
+        ls->continue_count--;
+
+        seal_block(ls, header);
+        ls->cur = header;
+        lower_cond(ls, cond, body, exit_block);
+
+        seal_block(ls, body);
+        seal_block(ls, exit_block);
+        ls->cur = exit_block;
+        return;
+    }
+
+    emit_jmp(ls, header);
+    ls->cur = header;
+
+    if (cond != AST_NULL)
+        lower_cond(ls, cond, body, exit_block);
+    else
+        emit_jmp(ls, body);
+
+    seal_block(ls, body);
+
+    push_target(ls->break_targets, &ls->break_count, exit_block);
+    push_target(ls->continue_targets, &ls->continue_count, next);
+
+    ls->cur = body;
+    lower_stmt(ls, body_node);
+    emit_jmp(ls, next);
+
+    ls->break_count--;
+    ls->continue_count--;
+
+    if (kind == AST_FOR)
+    {
+        seal_block(ls, next);
+        ls->cur = next;
+        lower_stmt(ls, update);
+        emit_jmp(ls, header);
+    }
+
+    seal_block(ls, header);
+    seal_block(ls, exit_block);
+    ls->cur = exit_block;
+}
+
+static void lower_return(LowerState *ls, int node)
+{
+    int value = node_at(ls, node)->kid[0];
+    int ret_type = node_at(ls, ls->func_node)->type;
+    int v = IR_NONE;
+
+    if (value != AST_NULL)
+        v = lower_as(ls, value, ret_type);
+
+    emit(ls, IR_RET, IRT_VOID, v, IR_NONE);
+    ls->cur = IR_NONE;
+}
+
+static void lower_stmt(LowerState *ls, int node)
+{
+    AstNode *n;
+
+    if (node == AST_NULL)
+        return;
+
+    n = node_at(ls, node);
+
+    switch (n->kind)
+    {
+        case AST_VAR_DECL:
+            lower_local_decl(ls, node);
+            break;
+
+        case AST_BLOCK:
+            for (int s = n->list; s != AST_NULL; s = node_at(ls, s)->next)
+                lower_stmt(ls, s);
+            break;
+
+        case AST_IF:
+        {
+            int then_block = new_block(ls);
+            int join = new_block(ls);
+            int else_block = (n->kid[2] != AST_NULL) ? new_block(ls) : join;
+            int then_node = n->kid[1];
+            int else_node = n->kid[2];
+
+            lower_cond(ls, n->kid[0], then_block, else_block);
+
+            seal_block(ls, then_block);
+            ls->cur = then_block;
+            lower_stmt(ls, then_node);
+            emit_jmp(ls, join);
+
+            if (else_node != AST_NULL)
+            {
+                seal_block(ls, else_block);
+                ls->cur = else_block;
+                lower_stmt(ls, else_node);
+                emit_jmp(ls, join);
+            }
+
+            seal_block(ls, join);
+            ls->cur = join;
+            break;
+        }
+
+        case AST_WHILE:
+        case AST_DO_WHILE:
+        case AST_FOR:
+            lower_loop(ls, node);
+            break;
+
+        case AST_SWITCH:
+            lower_switch(ls, node);
+            break;
+
+        case AST_BREAK:
+            emit_jmp(ls, ls->break_targets[ls->break_count - 1]);
+            break;
+
+        case AST_CONTINUE:
+            emit_jmp(ls, ls->continue_targets[ls->continue_count - 1]);
+            break;
+
+        case AST_GOTO:
+            emit_jmp(ls, label_block(ls, n->aux));
+            break;
+
+        case AST_LABEL:
+        {
+            //labels are sealed at the end of the function, once every GÅ TILL is known
+            int block = label_block(ls, node);
+
+            emit_jmp(ls, block);
+            ls->cur = block;
+            break;
+        }
+
+        case AST_RETURN:
+            lower_return(ls, node);
+            break;
+
+        case AST_EXPR_STMT:
+            lower_expr(ls, n->kid[0]);
+            break;
+
+        case AST_ASSIGN:
+            lower_assign(ls, node);
+            break;
+
+        case AST_UPDATE:
+            lower_update(ls, node);
+            break;
+
+        default:
+            fprintf(stderr, "Fatal: cannot lower %s as a statement\n", ast_kind_name(n->kind));
+            exit(1);
+    }
+}
+
+
+
+/*
+  ______                _   _
+ |  ____|              | | (_)
+ | |__ _   _ _ __   ___| |_ _  ___  _ __  ___
+ |  __| | | | '_ \ / __| __| |/ _ \| '_ \/ __|
+ | |  | |_| | | | | (__| |_| | (_) | | | \__ \
+ |_|   \__,_|_| |_|\___|\__|_|\___/|_| |_|___/
+
+*/
+
+static void mark_address_taken(LowerState *ls, int node)
+{
+    AstNode *n;
+
+    if (node == AST_NULL)
+        return;
+
+    n = node_at(ls, node);
+
+    if (n->kind == AST_ADDRESS && node_at(ls, n->kid[0])->kind == AST_IDENT && node_at(ls, n->kid[0])->sym >= 0)
+        ls->addr_taken[node_at(ls, n->kid[0])->sym] = 1;
+
+    for (int k = 0; k < 4; k++)
+        mark_address_taken(ls, node_at(ls, node)->kid[k]);
+
+    for (int c = node_at(ls, node)->list; c != AST_NULL; c = node_at(ls, c)->next)
+        mark_address_taken(ls, c);
+}
+
+//decides where each local lives before any code is emitted
+static void classify_locals(LowerState *ls, int node)
+{
+    AstNode *n;
+
+    if (node == AST_NULL)
+        return;
+
+    n = node_at(ls, node);
+
+    if (n->kind == AST_VAR_DECL && n->sym >= 0)
+    {
+        int sym = n->sym;
+        int type = n->type;
+        VarInfo *v = &ls->vars[sym];
+
+        v->type = ir_type_of(ls, type);
+
+        if (n->flags & AST_FLAG_STATIC)
+        {
+            char name[256];
+
+            snprintf(name, sizeof(name), "%s.%s", ls->f->name, ast_name(ls->ast, node));
+            declare_global(ls, node, name);
+        }
+        else if (is_aggregate(ls, type) || ls->addr_taken[sym])
+        {
+            v->kind  = VAR_SLOT;
+            v->index = ir_new_slot(ls->f, type_size(ls->types, type), type_align(ls->types, type), sym);
+        }
+        else
+        {
+            v->kind = VAR_SSA;
+        }
+    }
+
+    for (int k = 0; k < 4; k++)
+        classify_locals(ls, node_at(ls, node)->kid[k]);
+
+    for (int c = node_at(ls, node)->list; c != AST_NULL; c = node_at(ls, c)->next)
+        classify_locals(ls, c);
+}
+
+static void resolve_operands(LowerState *ls)
+{
+    IrFunc *f = ls->f;
+
+    for (int i = 0; i < f->instr_count; i++)
+    {
+        IrInstr *in = &f->instrs[i];
+
+        if (in->block == IR_NONE)
+            continue;
+
+        if (in->a != IR_NONE)
+            in->a = resolve(ls, in->a);
+        if (in->b != IR_NONE)
+            in->b = resolve(ls, in->b);
+
+        for (int k = 0; k < in->nargs; k++)
+            f->operands[in->args + k] = resolve(ls, f->operands[in->args + k]);
+    }
+}
+
+//removes phis made trivial by dropped edges, then unused undefs
+static void cleanup_function(LowerState *ls)
+{
+    IrFunc *f = ls->f;
+    int changed = 1;
+
+    resolve_operands(ls);
+    ir_compact(f);
+
+    while (changed)
+    {
+        changed = 0;
+
+        for (int i = 0; i < f->instr_count; i++)
+        {
+            if (f->instrs[i].op != IR_PHI || f->instrs[i].block == IR_NONE)
+                continue;
+
+            if (try_remove_trivial_phi(ls, i) != i)
+                changed = 1;
+        }
+
+        resolve_operands(ls);
+    }
+
+    char *used = calloc(f->instr_count + 1, 1);
+
+    if (!used)
+    {
+        fprintf(stderr, "Fatal: failed to allocate use marks\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < f->instr_count; i++)
+    {
+        IrInstr *in = &f->instrs[i];
+
+        if (in->block == IR_NONE)
+            continue;
+
+        if (in->a != IR_NONE)
+            used[in->a] = 1;
+        if (in->b != IR_NONE)
+            used[in->b] = 1;
+
+        for (int k = 0; k < in->nargs; k++)
+            used[f->operands[in->args + k]] = 1;
+    }
+
+    for (int t = 0; t <= IRT_PTR; t++)
+    {
+        if (ls->undef[t] != IR_NONE && !used[ls->undef[t]] && f->instrs[ls->undef[t]].block != IR_NONE)
+            ir_remove(f, ls->undef[t]);
+    }
+
+    free(used);
+}
+
+static void lower_function(LowerState *ls, int fi)
+{
+    IrFunc *f = &ls->m->funcs[fi];
+    int node = f->node;
+    int body = node_at(ls, node)->kid[1];
+    int p = 0;
+
+    ls->f = f;
+    ls->func_node = node;
+    ls->def_count = 0;
+    ls->pending_count = 0;
+    ls->label_count = 0;
+    ls->break_count = 0;
+    ls->continue_count = 0;
+
+    for (int i = 0; i < ls->def_capacity; i++)
+        ls->defs[i].sym = -1;
+
+    for (int i = 0; i < ls->forward_capacity; i++)
+        ls->forward[i] = IR_NONE;
+
+    for (int t = 0; t <= IRT_PTR; t++)
+        ls->undef[t] = IR_NONE;
+
+    if (body == AST_NULL)
+        return;
+
+    mark_address_taken(ls, body);
+    classify_locals(ls, body);
+
+    ls->cur = new_block(ls);
+    f->blocks[ls->cur].sealed = 1;
+
+    //parameters arrive as values; address-taken ones are spilled to a slot
+    for (int param = node_at(ls, node)->list; param != AST_NULL; param = node_at(ls, param)->next, p++)
+    {
+        int sym = node_at(ls, param)->sym;
+        int type = node_at(ls, param)->type;
+        VarInfo *v = &ls->vars[sym];
+        int value = emit(ls, IR_PARAM, f->param_types[p], IR_NONE, IR_NONE);
+
+        ls->f->instrs[value].aux = p;
+        v->type = f->param_types[p];
+
+        if (is_kind(ls, type, TY_STRUCT))
+        {
+            v->kind  = VAR_INDIRECT;
+            v->index = value;
+        }
+        else if (ls->addr_taken[sym])
+        {
+            int addr;
+
+            v->kind  = VAR_SLOT;
+            v->index = ir_new_slot(f, type_size(ls->types, type), type_align(ls->types, type), sym);
+
+            addr = emit(ls, IR_SLOT, IRT_PTR, IR_NONE, IR_NONE);
+            ls->f->instrs[addr].aux = v->index;
+            emit(ls, IR_STORE, IRT_VOID, addr, value);
+        }
+        else
+        {
+            v->kind = VAR_SSA;
+            write_var(ls, sym, ls->cur, value);
+        }
+    }
+
+    for (int s = node_at(ls, body)->list; s != AST_NULL; s = node_at(ls, s)->next)
+        lower_stmt(ls, s);
+
+    //falling off the end returns 0 (or nothing from a TOM function)
+    if (ls->cur != IR_NONE)
+    {
+        int v = (f->ret_type == IRT_VOID) ? IR_NONE : emit_zero(ls, f->ret_type);
+
+        emit(ls, IR_RET, IRT_VOID, v, IR_NONE);
+        ls->cur = IR_NONE;
+    }
+
+    for (int b = 0; b < f->block_count; b++)
+        seal_block(ls, b);
+
+    cleanup_function(ls);
+}
+
+void lower(Ast *ast, TypeTable *types, const SemState *sem, IrModule *out_module)
+{
+    LowerState ls;
+    int program = ast->root;
+
+    memset(&ls, 0, sizeof(ls));
+
+    ls.ast     = ast;
+    ls.types   = types;
+    ls.sem     = sem;
+    ls.m       = out_module;
+    ls.ty_long = type_builtin(types, TOK_LANG, 0);
+
+    init_ir_module(out_module);
+
+    if (program == AST_NULL)
+        return;
+
+    ls.vars       = calloc(sem->symbol_count + 1, sizeof(VarInfo));
+    ls.addr_taken = calloc(sem->symbol_count + 1, 1);
+
+    if (!ls.vars || !ls.addr_taken)
+    {
+        fprintf(stderr, "Fatal: failed to allocate lowering tables\n");
+        exit(1);
+    }
+
+    //functions are registered first so calls and FUNCADDR can name any of them
+    for (int g = node_at(&ls, program)->list; g != AST_NULL; g = node_at(&ls, g)->next)
+    {
+        AstNode *n = node_at(&ls, g);
+
+        if (n->kind != AST_FUNCTION || n->sym < 0)
+            continue;
+
+        int fi = ir_add_func(out_module, ast_name(ast, g));
+
+        ls.vars[n->sym].index = fi;
+    }
+
+    for (int g = node_at(&ls, program)->list; g != AST_NULL; g = node_at(&ls, g)->next)
+    {
+        AstNode *n = node_at(&ls, g);
+
+        if (n->kind == AST_VAR_DECL && n->sym >= 0)
+        {
+            declare_global(&ls, g, ast_name(ast, g));
+            continue;
+        }
+
+        if (n->kind != AST_FUNCTION || n->sym < 0)
+            continue;
+
+        IrFunc *f = &out_module->funcs[ls.vars[n->sym].index];
+        int count = ast_list_length(ast, n->list);
+        int p = 0;
+
+        f->node        = g;
+        f->is_extern   = (n->kid[1] == AST_NULL);
+        f->ret_type    = ir_type_of(&ls, n->type);
+        f->param_count = count;
+        f->param_types = malloc((count + 1) * sizeof(IrType));
+
+        if (!f->param_types)
+        {
+            fprintf(stderr, "Fatal: failed to allocate parameter types\n");
+            exit(1);
+        }
+
+        for (int param = n->list; param != AST_NULL; param = node_at(&ls, param)->next)
+            f->param_types[p++] = ir_type_of(&ls, node_at(&ls, param)->type);
+    }
+
+    for (int fi = 0; fi < out_module->func_count; fi++)
+        lower_function(&ls, fi);
+
+    out_module->entry = ir_find_func(out_module, "ENTRE");
+
+    free(ls.vars);
+    free(ls.addr_taken);
+    free(ls.defs);
+    free(ls.pending);
+    free(ls.forward);
+    free(ls.labels);
+}
@@ -0,0 +1,43 @@
+#ifndef LOWER_H
+#define LOWER_H
+
+#include "ast.h"
+#include "types.h"
+#include "sema.h"
+#include "ir.h"
+
+/* ---------------------------------------------
+   AST to IR lowering
+
+   Runs on a tree that passed semantic analysis
+   and builds SSA directly while walking it
+   (Braun et al., "Simple and Efficient
+   Construction of Static Single Assignment
+   Form"): scalar locals whose address is never
+   taken live only in SSA values, everything else
+   gets a frame slot or a module global.
+
+   Struct values are handled through their
+   address. A struct parameter is passed as a
+   pointer to a copy the caller makes.
+
+   VÄXEL sorts its FALL values and splits them
+   into clusters: dense runs become a jump table
+   (IR SWITCH), runs within 64 values that reach
+   at most three bodies become bit tests on
+   1 << (selector - first), and the rest single
+   compares. A binary search over the clusters
+   picks one, so a sparse switch costs log2 of
+   its cases. The bodies keep their source order
+   and fall through as before.
+--------------------------------------------- */
+
+#define SWITCH_TABLE_MIN_CASES  4       // values a jump table must cover
+#define SWITCH_TABLE_DENSITY    40      // percent of table entries that must be cases
+#define SWITCH_TABLE_MAX        4096    // entries in one table
+#define SWITCH_BIT_TEST_DESTS   3       // bodies one bit-test cluster may reach
+#define SWITCH_LINEAR           3       // clusters tested in a row instead of split
+
+void lower(Ast *ast, TypeTable *types, const SemState *sem, IrModule *out_module);
+
+#endif /* LOWER_H */
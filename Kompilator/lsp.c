@@ -0,0 +1,764 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "lsp.h"
+#include "lspdoc.h"
+#include "json.h"
+
+//semantic token types, indexed by LspRole; LSP_ROLE_NONE is not sent
+static const char *const role_names[LSP_ROLE_COUNT] = {
+    NULL, "keyword", "number", "string", "function", "variable",
+    "parameter", "type", "struct", "property", "enumMember"
+};
+
+typedef struct LspOpen {
+    LspDocument doc;
+    int         published;          // diagnostics sent for the current text
+} LspOpen;
+
+typedef struct LspMessage {
+    char      *text;
+    JsonValue *json;                // raw pointers point into text
+    int        cancelled;
+} LspMessage;
+
+typedef struct LspState {
+    int          in;
+    FILE        *out;
+    LayoutMode   layout;
+
+    char        *buffer;            // bytes read from in, [start, end) not taken yet
+    size_t       start;
+    size_t       end;
+    size_t       capacity;
+    int          eof;
+
+    LspMessage  *queue;
+    int          queue_count;
+    int          queue_capacity;
+
+    LspOpen    **open;
+    int          open_count;
+    int          open_capacity;
+
+    int          shutdown;
+    int          exited;
+} LspState;
+
+static void *lsp_alloc(void *p, size_t size)
+{
+    p = realloc(p, size ? size : 1);
+
+    if (!p)
+    {
+        fprintf(stderr, "Fatal: failed to allocate language server state\n");
+        exit(1);
+    }
+
+    return p;
+}
+
+/*
+   Reading messages
+*/
+
+//reads what in has; without block only if that cannot wait. Returns the bytes read
+static size_t fill(LspState *state, int block)
+{
+    struct pollfd p = { state->in, POLLIN, 0 };
+    ssize_t got;
+
+    if (state->eof || (!block && poll(&p, 1, 0) <= 0))
+        return 0;
+
+    if (state->start > 0)
+    {
+        memmove(state->buffer, state->buffer + state->start, state->end - state->start);
+        state->end -= state->start;
+        state->start = 0;
+    }
+
+    if (state->capacity - state->end < 65536)
+    {
+        state->capacity = state->capacity ? state->capacity * 2 : 1 << 20;
+        state->buffer = lsp_alloc(state->buffer, state->capacity);
+    }
+
+    do
+        got = read(state->in, state->buffer + state->end, state->capacity - state->end);
+    while (got < 0 && errno == EINTR);
+
+    if (got <= 0)
+    {
+        state->eof = 1;
+        return 0;
+    }
+
+    state->end += got;
+    return got;
+}
+
+//a whole message at the front of the buffer: 1 and its body, 0 if it has not all arrived, -1 if it is not framed
+static int take_message(LspState *state, char **out_text, size_t *out_size)
+{
+    const char *at = state->buffer + state->start;
+    size_t available = state->end - state->start;
+    const char *header_end = NULL;
+    long length = -1;
+
+    for (size_t i = 0; i + 4 <= available; i++)
+    {
+        if (memcmp(at + i, "\r\n\r\n", 4) == 0)
+        {
+            header_end = at + i + 4;
+            break;
+        }
+    }
+
+    if (!header_end)
+        return available > 8192 ? -1 : 0;
+
+    for (const char *line = at; line < header_end - 2; )
+    {
+        const char *eol = memchr(line, '\n', header_end - line);
+
+        if (strncasecmp(line, "Content-Length:", 15) == 0)
+            length = strtol(line + 15, NULL, 10);
+
+        line = eol + 1;
+    }
+
+    if (length < 0 || length > LSP_MAX_MESSAGE)
+        return -1;
+
+    if ((size_t)(header_end - at) + length > available)
+        return 0;
+
+    *out_text = lsp_alloc(NULL, length + 1);
+    memcpy(*out_text, header_end, length);
+    (*out_text)[length] = '\0';
+    *out_size = length;
+
+    state->start += (header_end - at) + length;
+    return 1;
+}
+
+//queues the next message; without block only one already sent. Returns 1, 0 if none, -1 if input is broken
+static int next_message(LspState *state, int block)
+{
+    for (;;)
+    {
+        char *text;
+        size_t size;
+        int taken = take_message(state, &text, &size);
+
+        if (taken < 0)
+            return -1;
+
+        if (taken > 0)
+        {
+            LspMessage *m;
+
+            if (state->queue_count == state->queue_capacity)
+            {
+                state->queue_capacity = state->queue_capacity ? state->queue_capacity * 2 : 16;
+                state->queue = lsp_alloc(state->queue, state->queue_capacity * sizeof(LspMessage));
+            }
+
+            m = &state->queue[state->queue_count++];
+            m->text = text;
+            m->json = json_parse(text, size);
+            m->cancelled = 0;
+
+            return 1;
+        }
+
+        if (fill(state, block) == 0)
+            return 0;
+    }
+}
+
+//asked between parts by lsp_document_analyse: anything waiting means newer work
+static int input_pending(void *arg)
+{
+    LspState *state = arg;
+    struct pollfd p = { state->in, POLLIN, 0 };
+
+    return state->end > state->start || (!state->eof && poll(&p, 1, 0) > 0);
+}
+
+/*
+   Writing messages
+*/
+
+static FILE *begin_message(char **text, size_t *size)
+{
+    FILE *f = open_memstream(text, size);
+
+    if (!f)
+    {
+        fprintf(stderr, "Fatal: failed to allocate message buffer\n");
+        exit(1);
+    }
+
+    fputs("{\"jsonrpc\":\"2.0\",", f);
+    return f;
+}
+
+static void send_message(LspState *state, FILE *f, char **text, size_t *size)
+{
+    fputc('}', f);
+    fclose(f);
+
+    fprintf(state->out, "Content-Length: %zu\r\n\r\n", *size);
+    fwrite(*text, 1, *size, state->out);
+    fflush(state->out);
+
+    free(*text);
+}
+
+static void write_raw(FILE *f, const JsonValue *v)
+{
+    if (v)
+        fwrite(v->raw, 1, v->raw_size, f);
+    else
+        fputs("null", f);
+}
+
+static void send_error(LspState *state, const JsonValue *id, int code, const char *message)
+{
+    char *text;
+    size_t size;
+    FILE *f = begin_message(&text, &size);
+
+    fputs("\"id\":", f);
+    write_raw(f, id);
+    fprintf(f, ",\"error\":{\"code\":%d,\"message\":", code);
+    json_write_string(f, message, strlen(message));
+    fputc('}', f);
+
+    send_message(state, f, &text, &size);
+}
+
+static void write_range(FILE *f, int line, int start, int end)
+{
+    fprintf(f, "{\"start\":{\"line\":%d,\"character\":%d},\"end\":{\"line\":%d,\"character\":%d}}",
+            line, start, line, end);
+}
+
+//the range of token tok of part p, or of one column at (row, col) of it
+static void write_token_range(FILE *f, const LspDocument *doc, const LspPart *part, int row, int col, int tok)
+{
+    int line = part->line + row - 1;
+    int width = tok >= 0 ? lsp_token_width(part, tok) : 1;
+
+    if (line >= doc->line_count)
+        line = doc->line_count - 1;
+
+    if (line < part->line)
+        line = part->line;
+
+    write_range(f, line, lsp_character_of(doc, line, col), lsp_character_of(doc, line, col + (width ? width : 1)));
+}
+
+static void write_diagnostics(FILE *f, const LspDocument *doc, const LspPart *part, const LspDiagnostic *list, int count, int *first)
+{
+    char message[1024];
+
+    for (int i = 0; i < count; i++)
+    {
+        lsp_diagnostic_message(part, &list[i], message, sizeof(message));
+
+        fputs(*first ? "" : ",", f);
+        fputs("{\"range\":", f);
+        write_token_range(f, doc, part, list[i].row, list[i].col, lsp_token_at(part, list[i].row, list[i].col));
+        fputs(",\"severity\":1,\"source\":\"kom\",\"message\":", f);
+        json_write_string(f, message, strlen(message));
+        fputc('}', f);
+
+        *first = 0;
+    }
+}
+
+static void publish(LspState *state, const LspDocument *doc, int clear)
+{
+    char *text;
+    size_t size;
+    FILE *f = begin_message(&text, &size);
+    int first = 1;
+
+    fputs("\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":", f);
+    json_write_string(f, doc->uri, strlen(doc->uri));
+
+    if (!clear)
+        fprintf(f, ",\"version\":%ld", doc->version);
+
+    fputs(",\"diagnostics\":[", f);
+
+    for (int p = 0; !clear && p < doc->part_count; p++)
+    {
+        const LspPart *part = doc->parts[p];
+
+        write_diagnostics(f, doc, part, part->syntax, part->syntax_count, &first);
+        write_diagnostics(f, doc, part, part->semantic, part->semantic_count, &first);
+    }
+
+    fputs("]}", f);
+    send_message(state, f, &text, &size);
+}
+
+/*
+   Documents
+*/
+
+static LspOpen *find_open(LspState *state, const char *uri, int *out_index)
+{
+    for (int i = 0; uri && i < state->open_count; i++)
+    {
+        if (strcmp(state->open[i]->doc.uri, uri) == 0)
+        {
+            if (out_index)
+                *out_index = i;
+
+            return state->open[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void did_open(LspState *state, const JsonValue *params)
+{
+    const JsonValue *item = json_get(params, "textDocument");
+    const char *uri = json_string(json_get(item, "uri"));
+    const JsonValue *text = json_get(item, "text");
+    LspOpen *open;
+
+    if (!uri || !text || text->type != JSON_STRING)
+        return;
+
+    open = find_open(state, uri, NULL);
+
+    if (open)
+    {
+        lsp_document_free(&open->doc);
+    }
+    else
+    {
+        if (state->open_count == state->open_capacity)
+        {
+            state->open_capacity = state->open_capacity ? state->open_capacity * 2 : 8;
+            state->open = lsp_alloc(state->open, state->open_capacity * sizeof(LspOpen *));
+        }
+
+        open = lsp_alloc(NULL, sizeof(LspOpen));
+        state->open[state->open_count++] = open;
+    }
+
+    lsp_document_init(&open->doc, uri, text->string, text->length, json_long(json_get(item, "version"), 0), state->layout);
+    open->published = 0;
+}
+
+static void did_change(LspState *state, const JsonValue *params)
+{
+    const JsonValue *item = json_get(params, "textDocument");
+    const JsonValue *changes = json_get(params, "contentChanges");
+    LspOpen *open = find_open(state, json_string(json_get(item, "uri")), NULL);
+
+    if (!open || !changes || changes->type != JSON_ARRAY)
+        return;
+
+    for (const JsonValue *c = changes->child; c; c = c->next)
+    {
+        const JsonValue *text = json_get(c, "text");
+        const JsonValue *range = json_get(c, "range");
+        size_t start = 0, end = open->doc.size;
+
+        if (!text || text->type != JSON_STRING)
+            continue;
+
+        //without a range the change is the whole text
+        if (range)
+        {
+            const JsonValue *from = json_get(range, "start");
+            const JsonValue *to = json_get(range, "end");
+
+            start = lsp_offset(&open->doc, json_long(json_get(from, "line"), 0), json_long(json_get(from, "character"), 0));
+            end = lsp_offset(&open->doc, json_long(json_get(to, "line"), 0), json_long(json_get(to, "character"), 0));
+
+            if (end < start)
+                end = start;
+        }
+
+        lsp_document_edit(&open->doc, start, end, text->string, text->length);
+    }
+
+    open->doc.version = json_long(json_get(item, "version"), open->doc.version);
+    open->published = 0;
+}
+
+static void did_close(LspState *state, const JsonValue *params)
+{
+    int index;
+    LspOpen *open = find_open(state, json_string(json_get(json_get(params, "textDocument"), "uri")), &index);
+
+    if (!open)
+        return;
+
+    publish(state, &open->doc, 1);
+    lsp_document_free(&open->doc);
+    free(open);
+
+    state->open[index] = state->open[--state->open_count];
+}
+
+/*
+   Requests
+*/
+
+//the document of a request, analysed, and the part and token at its position
+static LspOpen *token_at(LspState *state, const JsonValue *params, int *out_part, int *out_tok)
+{
+    LspOpen *open = find_open(state, json_string(json_get(json_get(params, "textDocument"), "uri")), NULL);
+    const JsonValue *position = json_get(params, "position");
+    int line, character, p;
+
+    if (!open)
+        return NULL;
+
+    lsp_document_analyse(&open->doc, NULL, NULL);
+
+    *out_tok = -1;
+    line = (int)json_long(json_get(position, "line"), -1);
+    character = (int)json_long(json_get(position, "character"), 0);
+    p = lsp_part_at(&open->doc, line);
+
+    if (p >= 0)
+    {
+        const LspPart *part = open->doc.parts[p];
+        int row = line - part->line + 1;
+        int col = lsp_col_of(&open->doc, line, character);
+
+        *out_tok = lsp_token_at(part, row, col);
+
+        //just after a name is still on it
+        if (*out_tok < 0 && col > 1)
+            *out_tok = lsp_token_at(part, row, col - 1);
+    }
+
+    *out_part = p;
+    return open;
+}
+
+static void begin_result(FILE *f, const JsonValue *id)
+{
+    fputs("\"id\":", f);
+    write_raw(f, id);
+    fputs(",\"result\":", f);
+}
+
+static void hover(LspState *state, const JsonValue *id, const JsonValue *params)
+{
+    char *text;
+    size_t size;
+    FILE *f = begin_message(&text, &size);
+    int p, tok, def_part, def_tok;
+    LspOpen *open = token_at(state, params, &p, &tok);
+    const char *shown = NULL;
+
+    begin_result(f, id);
+
+    if (open && tok >= 0)
+    {
+        const LspPart *part = open->doc.parts[p];
+
+        if (part->hovers)
+            shown = part->hovers[tok];
+
+        //a part with syntax errors is not checked, but what it names may be
+        if (!shown && lsp_definition(&open->doc, p, tok, &def_part, &def_tok) && open->doc.parts[def_part]->hovers)
+            shown = open->doc.parts[def_part]->hovers[def_tok];
+    }
+
+    if (shown)
+    {
+        const LspPart *part = open->doc.parts[p];
+
+        fputs("{\"contents\":{\"kind\":\"plaintext\",\"value\":", f);
+        json_write_string(f, shown, strlen(shown));
+        fputs("},\"range\":", f);
+        write_token_range(f, &open->doc, part, part->tokens[tok].row, part->tokens[tok].col, tok);
+        fputc('}', f);
+    }
+    else
+    {
+        fputs("null", f);
+    }
+
+    send_message(state, f, &text, &size);
+}
+
+static void definition(LspState *state, const JsonValue *id, const JsonValue *params)
+{
+    char *text;
+    size_t size;
+    FILE *f = begin_message(&text, &size);
+    int p, tok, def_part, def_tok;
+    LspOpen *open = token_at(state, params, &p, &tok);
+
+    begin_result(f, id);
+
+    if (open && tok >= 0 && lsp_definition(&open->doc, p, tok, &def_part, &def_tok))
+    {
+        const LspPart *part = open->doc.parts[def_part];
+
+        fputs("{\"uri\":", f);
+        json_write_string(f, open->doc.uri, strlen(open->doc.uri));
+        fputs(",\"range\":", f);
+        write_token_range(f, &open->doc, part, part->tokens[def_tok].row, part->tokens[def_tok].col, def_tok);
+        fputc('}', f);
+    }
+    else
+    {
+        fputs("null", f);
+    }
+
+    send_message(state, f, &text, &size);
+}
+
+static int utf16_length(const char *s)
+{
+    int units = 0;
+
+    for (const unsigned char *c = (const unsigned char *)s; *c; c++)
+    {
+        if ((*c & 0xC0) != 0x80)
+            units += (*c >= 0xF0) ? 2 : 1;
+    }
+
+    return units;
+}
+
+//five numbers per token, each position relative to the token before
+static void semantic_tokens(LspState *state, const JsonValue *id, const JsonValue *params)
+{
+    char *text;
+    size_t size;
+    FILE *f = begin_message(&text, &size);
+    LspOpen *open = find_open(state, json_string(json_get(json_get(params, "textDocument"), "uri")), NULL);
+    int last_line = 0, last_character = 0;
+    int first = 1;
+
+    begin_result(f, id);
+
+    if (!open)
+    {
+        fputs("null", f);
+        send_message(state, f, &text, &size);
+        return;
+    }
+
+    lsp_document_analyse(&open->doc, NULL, NULL);
+    fputs("{\"data\":[", f);
+
+    for (int p = 0; p < open->doc.part_count; p++)
+    {
+        const LspPart *part = open->doc.parts[p];
+
+        for (int t = 0; t + 1 < part->token_count; t++)
+        {
+            int line, character;
+
+            if (part->roles[t] == LSP_ROLE_NONE)
+                continue;
+
+            line = part->line + part->tokens[t].row - 1;
+            character = lsp_character_of(&open->doc, line, part->tokens[t].col);
+
+            fprintf(f, "%s%d,%d,%d,%d,0", first ? "" : ",", line - last_line,
+                    line == last_line ? character - last_character : character,
+                    utf16_length(part->lexemes[t]), part->roles[t] - 1);
+
+            last_line = line;
+            last_character = character;
+            first = 0;
+        }
+    }
+
+    fputs("]}", f);
+    send_message(state, f, &text, &size);
+}
+
+static void initialize(LspState *state, const JsonValue *id)
+{
+    char *text;
+    size_t size;
+    FILE *f = begin_message(&text, &size);
+
+    begin_result(f, id);
+    fputs("{\"capabilities\":{\"positionEncoding\":\"utf-16\","
+          "\"textDocumentSync\":{\"openClose\":true,\"change\":2},"
+          "\"hoverProvider\":true,\"definitionProvider\":true,"
+          "\"semanticTokensProvider\":{\"legend\":{\"tokenTypes\":[", f);
+
+    for (int r = 1; r < LSP_ROLE_COUNT; r++)
+        fprintf(f, "%s\"%s\"", r > 1 ? "," : "", role_names[r]);
+
+    fputs("],\"tokenModifiers\":[]},\"full\":true}},\"serverInfo\":{\"name\":\"kom\"}}", f);
+    send_message(state, f, &text, &size);
+}
+
+static void handle(LspState *state, const LspMessage *m)
+{
+    const char *method = json_string(json_get(m->json, "method"));
+    const JsonValue *id = json_get(m->json, "id");
+    const JsonValue *params = json_get(m->json, "params");
+
+    if (!m->json)
+    {
+        send_error(state, NULL, -32700, "Parse error");
+        return;
+    }
+
+    //replies to requests of ours: there are none
+    if (!method)
+        return;
+
+    if (m->cancelled)
+    {
+        if (id)
+            send_error(state, id, -32800, "Request cancelled");
+    }
+    else if (strcmp(method, "initialize") == 0)
+        initialize(state, id);
+    else if (strcmp(method, "shutdown") == 0)
+    {
+        char *text;
+        size_t size;
+        FILE *f = begin_message(&text, &size);
+
+        state->shutdown = 1;
+        begin_result(f, id);
+        fputs("null", f);
+        send_message(state, f, &text, &size);
+    }
+    else if (strcmp(method, "exit") == 0)
+        state->exited = 1;
+    else if (strcmp(method, "textDocument/didOpen") == 0)
+        did_open(state, params);
+    else if (strcmp(method, "textDocument/didChange") == 0)
+        did_change(state, params);
+    else if (strcmp(method, "textDocument/didClose") == 0)
+        did_close(state, params);
+    else if (id && strcmp(method, "textDocument/hover") == 0)
+        hover(state, id, params);
+    else if (id && strcmp(method, "textDocument/definition") == 0)
+        definition(state, id, params);
+    else if (id && strcmp(method, "textDocument/semanticTokens/full") == 0)
+        semantic_tokens(state, id, params);
+    else if (id)
+        send_error(state, id, -32601, "Method not found");
+
+    //other notifications ($/cancelRequest was seen before, initialized, ...) need nothing
+}
+
+//cancels the requests waiting in the queue that a $/cancelRequest in it names
+static void cancel_queued(LspState *state)
+{
+    for (int i = 0; i < state->queue_count; i++)
+    {
+        const char *method = json_string(json_get(state->queue[i].json, "method"));
+        const JsonValue *target;
+
+        if (!method || strcmp(method, "$/cancelRequest") != 0)
+            continue;
+
+        target = json_get(json_get(state->queue[i].json, "params"), "id");
+
+        for (int j = 0; target && j < state->queue_count; j++)
+        {
+            const JsonValue *id = json_get(state->queue[j].json, "id");
+
+            if (id && id->raw_size == target->raw_size && memcmp(id->raw, target->raw, id->raw_size) == 0)
+                state->queue[j].cancelled = 1;
+        }
+    }
+}
+
+int serve_lsp(const CompileOptions *defaults)
+{
+    LspState state;
+    int broken = 0;
+
+    memset(&state, 0, sizeof(state));
+    state.in     = 0;
+    state.out    = stdout;
+    state.layout = defaults->layout_mode;
+
+    while (!state.exited)
+    {
+        int got = next_message(&state, 1);
+
+        if (got <= 0)
+        {
+            broken = got < 0;
+            break;
+        }
+
+        //everything already sent is handled before any analysis: a burst of edits is analysed once
+        while ((got = next_message(&state, 0)) > 0)
+            ;
+
+        broken = got < 0;
+        cancel_queued(&state);
+
+        for (int i = 0; i < state.queue_count && !state.exited; i++)
+            handle(&state, &state.queue[i]);
+
+        for (int i = 0; i < state.queue_count; i++)
+        {
+            json_free(state.queue[i].json);
+            free(state.queue[i].text);
+        }
+
+        state.queue_count = 0;
+
+        if (broken)
+            break;
+
+        //analysis gives way to any newer message, and picks up where it stopped
+        for (int i = 0; i < state.open_count && !state.exited; i++)
+        {
+            LspOpen *open = state.open[i];
+
+            if (open->published)
+                continue;
+
+            if (lsp_document_analyse(&open->doc, input_pending, &state) != 0)
+                break;
+
+            publish(&state, &open->doc, 0);
+            open->published = 1;
+        }
+    }
+
+    if (broken)
+        fprintf(stderr, "Error: malformed message header on stdin\n");
+
+    for (int i = 0; i < state.open_count; i++)
+    {
+        lsp_document_free(&state.open[i]->doc);
+        free(state.open[i]);
+    }
+
+    free(state.open);
+    free(state.queue);
+    free(state.buffer);
+
+    return (state.exited && state.shutdown) ? 0 : 1;
+}
@@ -0,0 +1,42 @@
+#ifndef LSP_H
+#define LSP_H
+
+#include "driver.h"
+
+/* ---------------------------------------------
+   Language server
+
+   kom --lsp speaks the Language Server Protocol
+   (JSON-RPC with Content-Length headers) on
+   stdin and stdout, for editors. It keeps the
+   open files and supports:
+
+     textDocument/didOpen, didChange (whole or
+       ranged edits), didClose
+     textDocument/publishDiagnostics: syntax
+       and semantic errors, as kom reports them
+     textDocument/definition
+     textDocument/hover: the type of a name
+     textDocument/semanticTokens/full: K's
+       keywords, literals and names
+
+   Positions are UTF-16, as the protocol's
+   default. Analysis is incremental
+   (lspdoc.h): an edit lexes, parses and checks
+   again only the items it touches. Every
+   message waiting on stdin is read before any
+   work, and analysis stops as soon as another
+   arrives, so a burst of keystrokes is
+   analysed once, for the last. Diagnostics are
+   published when an analysis completes.
+
+   Bench/lsp.sh measures the latency of a
+   keystroke in a large file.
+--------------------------------------------- */
+
+#define LSP_MAX_MESSAGE     (64 << 20)      // bytes in one message
+
+// serves on stdin / stdout until exit; returns 0 if shutdown came first, as the protocol asks
+int serve_lsp(const CompileOptions *defaults);
+
+#endif /* LSP_H */
@@ -0,0 +1,1846 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lspdoc.h"
+#include "utf_decoder.h"
+#include "parser.h"
+#include "sema.h"
+#include "cache.h"
+
+static void *doc_alloc(size_t size)
+{
+    void *p = calloc(1, size ? size : 1);
+
+    if (!p)
+    {
+        fprintf(stderr, "Fatal: failed to allocate language server state\n");
+        exit(1);
+    }
+
+    return p;
+}
+
+static void *doc_realloc(void *p, size_t size)
+{
+    p = realloc(p, size ? size : 1);
+
+    if (!p)
+    {
+        fprintf(stderr, "Fatal: failed to allocate language server state\n");
+        exit(1);
+    }
+
+    return p;
+}
+
+static char *doc_strdup(const char *s)
+{
+    size_t len = strlen(s);
+    char *copy = doc_alloc(len + 1);
+
+    memcpy(copy, s, len + 1);
+    return copy;
+}
+
+/*
+   Text and positions
+*/
+
+static void index_lines(LspDocument *doc)
+{
+    doc->line_count = 0;
+
+    for (size_t i = 0; i <= doc->size; i++)
+    {
+        if (i > 0 && doc->text[i - 1] != '\n')
+            continue;
+
+        if (doc->line_count == doc->line_capacity)
+        {
+            doc->line_capacity = doc->line_capacity ? doc->line_capacity * 2 : 256;
+            doc->line_starts = doc_realloc(doc->line_starts, doc->line_capacity * sizeof(size_t));
+        }
+
+        doc->line_starts[doc->line_count++] = i;
+
+        //the rest of the line up to the next newline
+        const char *nl = memchr(doc->text + i, '\n', doc->size - i);
+
+        if (!nl)
+            break;
+
+        i = nl - doc->text;
+    }
+}
+
+void lsp_document_init(LspDocument *doc, const char *uri, const char *text, size_t size, long version, LayoutMode layout)
+{
+    memset(doc, 0, sizeof(*doc));
+
+    doc->uri      = doc_strdup(uri);
+    doc->version  = version;
+    doc->layout   = layout;
+    doc->capacity = size + 1;
+    doc->text     = doc_alloc(doc->capacity);
+    doc->size     = size;
+
+    memcpy(doc->text, text, size);
+    index_lines(doc);
+}
+
+void lsp_document_edit(LspDocument *doc, size_t start, size_t end, const char *text, size_t size)
+{
+    size_t new_size = doc->size - (end - start) + size;
+    long moved = (long)size - (long)(end - start);
+
+    if (new_size + 1 > doc->capacity)
+    {
+        doc->capacity = (new_size + 1) * 2;
+        doc->text = doc_realloc(doc->text, doc->capacity);
+    }
+
+    memmove(doc->text + start + size, doc->text + end, doc->size - end);
+    memcpy(doc->text + start, text, size);
+
+    //the changed range grows to cover this edit; what follows it moves with the edit
+    if (!doc->dirty)
+    {
+        doc->dirty       = 1;
+        doc->dirty_start = start;
+        doc->dirty_end   = start + size;
+        doc->shift       = moved;
+    }
+    else
+    {
+        size_t dirty_end = (doc->dirty_end >= end) ? doc->dirty_end + moved : doc->dirty_end;
+
+        doc->dirty_start = (start < doc->dirty_start) ? start : doc->dirty_start;
+        doc->dirty_end   = (dirty_end > start + size) ? dirty_end : start + size;
+        doc->shift      += moved;
+    }
+
+    doc->size = new_size;
+    doc->text[new_size] = '\0';
+    doc->analysed = 0;
+
+    index_lines(doc);
+}
+
+static int utf8_length(unsigned char c)
+{
+    return c < 0xC0 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+}
+
+static size_t line_end(const LspDocument *doc, int line)
+{
+    return line + 1 < doc->line_count ? doc->line_starts[line + 1] - 1 : doc->size;
+}
+
+size_t lsp_offset(const LspDocument *doc, int line, int character)
+{
+    size_t at, end;
+
+    if (line < 0)
+        return 0;
+
+    if (line >= doc->line_count)
+        return doc->size;
+
+    at = doc->line_starts[line];
+    end = line_end(doc, line);
+
+    for (int units = 0; at < end && units < character; )
+    {
+        int len = utf8_length((unsigned char)doc->text[at]);
+
+        units += (len == 4) ? 2 : 1;
+        at += len;
+    }
+
+    return at < end ? at : end;
+}
+
+//the lexer counts a tab as 4 columns and anything else as 1
+int lsp_character_of(const LspDocument *doc, int line, int col)
+{
+    size_t at, end;
+    int units = 0;
+
+    if (line < 0 || line >= doc->line_count)
+        return 0;
+
+    at = doc->line_starts[line];
+    end = line_end(doc, line);
+
+    for (int c = 1; at < end && c < col; )
+    {
+        int len = utf8_length((unsigned char)doc->text[at]);
+
+        c += (doc->text[at] == '\t') ? 4 : 1;
+        units += (len == 4) ? 2 : 1;
+        at += len;
+    }
+
+    return units;
+}
+
+int lsp_col_of(const LspDocument *doc, int line, int character)
+{
+    size_t at, end;
+    int col = 1;
+
+    if (line < 0 || line >= doc->line_count)
+        return 1;
+
+    at = doc->line_starts[line];
+    end = line_end(doc, line);
+
+    for (int units = 0; at < end && units < character; )
+    {
+        int len = utf8_length((unsigned char)doc->text[at]);
+
+        col += (doc->text[at] == '\t') ? 4 : 1;
+        units += (len == 4) ? 2 : 1;
+        at += len;
+    }
+
+    return col;
+}
+
+static int line_of(const LspDocument *doc, size_t offset)
+{
+    int lo = 0, hi = doc->line_count - 1;
+
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+
+        if (doc->line_starts[mid] <= offset)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    return lo;
+}
+
+int lsp_part_at(const LspDocument *doc, int line)
+{
+    int lo = 0, hi = doc->part_count - 1;
+
+    if (doc->part_count == 0 || line < doc->parts[0]->line)
+        return -1;
+
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+
+        if (doc->parts[mid]->line <= line)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    return line < doc->parts[lo]->line + doc->parts[lo]->line_count ? lo : -1;
+}
+
+int lsp_token_width(const LspPart *part, int tok)
+{
+    int width = 0;
+
+    for (const unsigned char *s = (const unsigned char *)part->lexemes[tok]; *s; s++)
+        width += (*s & 0xC0) != 0x80;
+
+    return width;
+}
+
+int lsp_token_at(const LspPart *part, int row, int col)
+{
+    int lo = 0, hi = part->token_count - 2;     // the last token is EOF
+
+    if (!part->parsed || hi < 0)
+        return -1;
+
+    //the last token starting at or before (row, col)
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        const TokenBuffer *t = &part->tokens[mid];
+
+        if (t->row < row || (t->row == row && t->col <= col))
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    const TokenBuffer *t = &part->tokens[lo];
+
+    if (t->row != row || t->col > col || col >= t->col + lsp_token_width(part, lo))
+        return -1;
+
+    return lo;
+}
+
+/*
+   Parts
+*/
+
+static void add_diagnostic(LspDiagnostic **list, int *count, int row, int col, const char *message, size_t len)
+{
+    LspDiagnostic *d;
+
+    *list = doc_realloc(*list, (*count + 1) * sizeof(LspDiagnostic));
+    d = &(*list)[(*count)++];
+
+    d->row = row;
+    d->col = col;
+    d->ref_row = 0;
+    d->ref_at = 0;
+    d->message = doc_alloc(len + 1);
+    memcpy(d->message, message, len);
+}
+
+static void free_diagnostics(LspDiagnostic **list, int *count)
+{
+    for (int i = 0; i < *count; i++)
+        free((*list)[i].message);
+
+    free(*list);
+    *list = NULL;
+    *count = 0;
+}
+
+//reads "... at R:C: message" lines of parser or sema output, calling add for each
+static void read_diagnostics(const char *text, size_t size, void (*add)(void *, int, int, const char *, size_t), void *arg)
+{
+    const char *at = text;
+    const char *end = text + size;
+
+    while (at < end)
+    {
+        const char *nl = memchr(at, '\n', end - at);
+        const char *stop = nl ? nl : end;
+        const char *pos = at;
+        int row, col, skip = 0;
+
+        while (pos + 4 <= stop && memcmp(pos, " at ", 4) != 0)
+            pos++;
+
+        if (pos + 4 <= stop && sscanf(pos + 4, "%d:%d: %n", &row, &col, &skip) == 2 && skip > 0 && pos + 4 + skip <= stop)
+            add(arg, row, col, pos + 4 + skip, stop - (pos + 4 + skip));
+
+        at = stop + 1;
+    }
+}
+
+static void free_check(LspPart *part)
+{
+    free_diagnostics(&part->semantic, &part->semantic_count);
+
+    for (int i = 0; part->targets && i < part->token_count; i++)
+        free(part->targets[i]);
+
+    for (int i = 0; part->hovers && i < part->token_count; i++)
+        free(part->hovers[i]);
+
+    free(part->defs);
+    free(part->targets);
+    free(part->hovers);
+
+    part->defs    = NULL;
+    part->targets = NULL;
+    part->hovers  = NULL;
+    part->checked = 0;
+}
+
+static void free_parse(LspPart *part)
+{
+    free_check(part);
+    free_diagnostics(&part->syntax, &part->syntax_count);
+
+    if (part->parsed)
+        free_ast(&part->ast);
+
+    free(part->declared);
+    free(part->items);
+    free(part->names);
+    free(part->idents);
+
+    part->declared       = NULL;
+    part->declared_count = 0;
+    part->items          = NULL;
+    part->item_count     = 0;
+    part->names          = NULL;
+    part->idents         = NULL;
+    part->ident_count    = 0;
+    part->parsed         = 0;
+}
+
+static void free_part(LspPart *part)
+{
+    free_parse(part);
+
+    for (int i = 0; i < part->token_count; i++)
+        free(part->lexemes[i]);
+
+    for (int i = 0; i < part->stand_in_count; i++)
+        free_part(part->stand_ins[i]);
+
+    free(part->lexemes);
+    free(part->tokens);
+    free(part->roles);
+    free(part->stand_ins);
+    free(part);
+}
+
+static unsigned char lexical_role(const TokenBuffer *t, const char *lexeme)
+{
+    unsigned char c = (unsigned char)lexeme[0];
+
+    if (t->token == TOK_EOF)
+        return LSP_ROLE_NONE;
+
+    if (c >= '0' && c <= '9')
+        return LSP_ROLE_NUMBER;
+
+    if (c == '"')
+        return LSP_ROLE_STRING;
+
+    if (t->token == TOK_IDENTIFIER)
+        return LSP_ROLE_VARIABLE;
+
+    if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c >= 0x80)
+        return LSP_ROLE_KEYWORD;
+
+    return LSP_ROLE_NONE;
+}
+
+static void lex_text(LspPart *part, const char *text, size_t size)
+{
+    char *copy = doc_alloc(size + 1);
+    CharacterUnit *chars;
+    int char_count = 0;
+    int lexeme_count;
+    int *rows, *cols;
+    size_t len = 0;
+
+    //the lexer counts a CR as a line of its own
+    for (size_t i = 0; i < size; i++)
+    {
+        if (text[i] != '\r' || i + 1 >= size || text[i + 1] != '\n')
+            copy[len++] = text[i];
+    }
+
+    chars = decode_utf8(copy, &char_count);
+
+    if (!chars)
+    {
+        fprintf(stderr, "Fatal: failed to allocate decode buffer\n");
+        exit(1);
+    }
+
+    lexer(chars, char_count, &part->tokens, &part->token_count, &part->lexemes, &lexeme_count, &cols, &rows, NULL);
+
+    free(chars);
+    free(copy);
+
+    part->roles = doc_alloc(part->token_count);
+}
+
+static uint64_t hash_node(const LspPart *part, int node, int skip_body, uint64_t h)
+{
+    const AstNode *n = &part->ast.nodes[node];
+    int fields[4] = { n->kind, n->op, n->flags, n->aux };
+
+    h = xxh64(fields, sizeof(fields), h);
+
+    if (n->tok >= 0)
+        h = xxh64(part->lexemes[n->tok], strlen(part->lexemes[n->tok]) + 1, h);
+
+    for (int k = 0; k < 4; k++)
+    {
+        if (n->kid[k] != AST_NULL && !(skip_body && k == 1))
+            h = hash_node(part, n->kid[k], 0, h);
+        else
+            h = xxh64(&k, sizeof(k), h);
+    }
+
+    for (int c = n->list; c != AST_NULL; c = part->ast.nodes[c].next)
+        h = hash_node(part, c, 0, h);
+
+    return xxh64("}", 1, h);
+}
+
+static uint64_t name_hash(const char *name)
+{
+    uint64_t h = xxh64(name, strlen(name), 0);
+
+    return h ? h : 1;       // 0 marks an empty slot
+}
+
+static void push_name(LspPart *part, int *capacity, int *count, const char *name)
+{
+    if (*count == *capacity)
+    {
+        *capacity = *capacity ? *capacity * 2 : 16;
+        part->names = doc_realloc(part->names, *capacity * sizeof(uint64_t));
+    }
+
+    part->names[(*count)++] = name_hash(name);
+}
+
+//the identifiers of a subtree other than the item's own name; a function's body is not its signature
+static void push_uses(LspPart *part, int *capacity, int *count, int node, int item)
+{
+    const AstNode *n = &part->ast.nodes[node];
+
+    if (node != item && n->tok >= 0 && part->tokens[n->tok].token == TOK_IDENTIFIER)
+        push_name(part, capacity, count, part->lexemes[n->tok]);
+
+    for (int k = 0; k < 4; k++)
+    {
+        if (n->kid[k] != AST_NULL && !(node == item && n->kind == AST_FUNCTION && k == 1))
+            push_uses(part, capacity, count, n->kid[k], item);
+    }
+
+    for (int c = n->list; c != AST_NULL; c = part->ast.nodes[c].next)
+        push_uses(part, capacity, count, c, item);
+}
+
+static int compare_hash(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+//what other parts see of the items, and every name the part mentions
+static void describe_items(LspPart *part)
+{
+    int capacity = 0, count = 0, items = 0, kept = 0;
+
+    for (int g = part->ast.root != AST_NULL ? part->ast.nodes[part->ast.root].list : AST_NULL; g != AST_NULL;
+         g = part->ast.nodes[g].next)
+        items++;
+
+    part->items = doc_alloc(items * sizeof(LspItem));
+
+    for (int g = part->ast.root != AST_NULL ? part->ast.nodes[part->ast.root].list : AST_NULL; g != AST_NULL;
+         g = part->ast.nodes[g].next)
+    {
+        const AstNode *n = &part->ast.nodes[g];
+        LspItem *item = &part->items[part->item_count++];
+        int is_function = n->kind == AST_FUNCTION;
+
+        part->has_globals |= !is_function;
+
+        item->hash = hash_node(part, g, is_function, 0);
+        item->row = n->tok >= 0 ? part->tokens[n->tok].row : 1;
+        item->first_name = count;
+
+        if (n->tok >= 0)
+            push_name(part, &capacity, &count, part->lexemes[n->tok]);
+
+        for (int e = n->kind == AST_ENUM_DECL ? n->list : AST_NULL; e != AST_NULL; e = part->ast.nodes[e].next)
+        {
+            if (part->ast.nodes[e].tok >= 0)
+                push_name(part, &capacity, &count, part->lexemes[part->ast.nodes[e].tok]);
+        }
+
+        item->name_count = count - item->first_name;
+        item->first_use = count;
+        push_uses(part, &capacity, &count, g, g);
+        item->use_count = count - item->first_use;
+    }
+
+    for (int i = 0; i < part->token_count; i++)
+        part->ident_count += part->tokens[i].token == TOK_IDENTIFIER;
+
+    part->idents = doc_alloc(part->ident_count * sizeof(uint64_t));
+    part->ident_count = 0;
+
+    for (int i = 0; i < part->token_count; i++)
+    {
+        if (part->tokens[i].token == TOK_IDENTIFIER)
+            part->idents[part->ident_count++] = name_hash(part->lexemes[i]);
+    }
+
+    qsort(part->idents, part->ident_count, sizeof(uint64_t), compare_hash);
+
+    for (int i = 0; i < part->ident_count; i++)
+    {
+        if (kept == 0 || part->idents[i] != part->idents[kept - 1])
+            part->idents[kept++] = part->idents[i];
+    }
+
+    part->ident_count = kept;
+}
+
+static void add_syntax(void *arg, int row, int col, const char *message, size_t len)
+{
+    LspPart *part = arg;
+
+    add_diagnostic(&part->syntax, &part->syntax_count, row, col, message, len);
+}
+
+//type names declared so far in the file, for parse_part
+typedef struct NameSet {
+    const char **names;
+    uint64_t    *hashes;
+    int         *stamps;
+    int          count;
+    int          capacity;
+    int         *slots;             // open addressing over names, -1 when empty
+    int          slot_count;
+    int          stamp;
+    uint64_t     sequence;          // every name added, in order
+} NameSet;
+
+static int find_name(const NameSet *set, const char *name, uint64_t h)
+{
+    if (set->slot_count == 0)
+        return -1;
+
+    for (int s = (int)(h & (set->slot_count - 1)); set->slots[s] >= 0; s = (s + 1) & (set->slot_count - 1))
+    {
+        if (set->hashes[set->slots[s]] == h && strcmp(set->names[set->slots[s]], name) == 0)
+            return set->slots[s];
+    }
+
+    return -1;
+}
+
+static void add_name(NameSet *set, const char *name)
+{
+    uint64_t h = xxh64(name, strlen(name), 0);
+
+    set->sequence = xxh64(&h, sizeof(h), set->sequence);
+
+    if (find_name(set, name, h) >= 0)
+        return;
+
+    if (set->count == set->capacity)
+    {
+        set->capacity = set->capacity ? set->capacity * 2 : 32;
+        set->names  = doc_realloc(set->names, set->capacity * sizeof(*set->names));
+        set->hashes = doc_realloc(set->hashes, set->capacity * sizeof(*set->hashes));
+        set->stamps = doc_realloc(set->stamps, set->capacity * sizeof(*set->stamps));
+    }
+
+    set->names[set->count]  = name;
+    set->hashes[set->count] = h;
+    set->stamps[set->count] = 0;
+    set->count++;
+
+    if (set->count * 2 > set->slot_count)
+    {
+        set->slot_count = set->slot_count ? set->slot_count * 2 : 64;
+        set->slots = doc_realloc(set->slots, set->slot_count * sizeof(int));
+        memset(set->slots, -1, set->slot_count * sizeof(int));
+
+        for (int i = 0; i < set->count; i++)
+        {
+            int s = (int)(set->hashes[i] & (set->slot_count - 1));
+
+            while (set->slots[s] >= 0)
+                s = (s + 1) & (set->slot_count - 1);
+
+            set->slots[s] = i;
+        }
+    }
+    else
+    {
+        int s = (int)(h & (set->slot_count - 1));
+
+        while (set->slots[s] >= 0)
+            s = (s + 1) & (set->slot_count - 1);
+
+        set->slots[s] = set->count - 1;
+    }
+}
+
+//the declared type names a part's identifiers use, in any order
+static uint64_t context_of(const LspPart *part, NameSet *set)
+{
+    uint64_t context = 0;
+
+    set->stamp++;
+
+    for (int i = 0; i < part->token_count; i++)
+    {
+        if (part->tokens[i].token != TOK_IDENTIFIER)
+            continue;
+
+        int n = find_name(set, part->lexemes[i], xxh64(part->lexemes[i], strlen(part->lexemes[i]), 0));
+
+        if (n >= 0 && set->stamps[n] != set->stamp)
+        {
+            set->stamps[n] = set->stamp;
+            context += set->hashes[n];
+        }
+    }
+
+    return context;
+}
+
+static void parse_tokens(LspPart *part, NameSet *set)
+{
+    char *out_text = NULL;
+    size_t out_size = 0;
+    FILE *out = open_memstream(&out_text, &out_size);
+    int errors = 0;
+
+    if (!out)
+    {
+        fprintf(stderr, "Fatal: failed to allocate parser output buffer\n");
+        exit(1);
+    }
+
+    free_parse(part);
+
+    parse_part(part->tokens, part->token_count, part->lexemes, set->names, set->count, out,
+               &part->ast, &errors, &part->declared, &part->declared_count);
+
+    fclose(out);
+    read_diagnostics(out_text, out_size, add_syntax, part);
+    free(out_text);
+
+    //every error is reported with a position, but a part with errors must never look clean
+    if (errors > 0 && part->syntax_count == 0)
+        add_diagnostic(&part->syntax, &part->syntax_count, 1, 1, "syntax error", 12);
+
+    part->parsed       = 1;
+    part->names_before = set->sequence;
+    part->context      = context_of(part, set);
+    part->has_globals  = 0;
+
+    for (int i = 0; i < part->token_count; i++)
+        part->roles[i] = lexical_role(&part->tokens[i], part->lexemes[i]);
+
+    describe_items(part);
+
+    //what the tree alone tells about a name; checking says more
+    for (int i = 0; i < part->ast.node_count; i++)
+    {
+        const AstNode *n = &part->ast.nodes[i];
+        unsigned char role = LSP_ROLE_NONE;
+
+        if (n->tok < 0 || part->tokens[n->tok].token != TOK_IDENTIFIER)
+            continue;
+
+        switch (n->kind)
+        {
+            case AST_FUNCTION:
+            case AST_CALL:        role = LSP_ROLE_FUNCTION;    break;
+            case AST_PARAM:       role = LSP_ROLE_PARAMETER;   break;
+            case AST_STRUCT_DECL: role = LSP_ROLE_STRUCT;      break;
+            case AST_FIELD_DECL:
+            case AST_FIELD:       role = LSP_ROLE_PROPERTY;    break;
+            case AST_TYPEDEF:
+            case AST_ENUM_DECL:
+            case AST_TYPE:        role = LSP_ROLE_TYPE;        break;
+            case AST_ENUMERATOR:  role = LSP_ROLE_ENUM_MEMBER; break;
+            default:              break;
+        }
+
+        if (role != LSP_ROLE_NONE)
+            part->roles[n->tok] = role;
+    }
+}
+
+/*
+   Cutting the text into parts
+*/
+
+//first bytes of parts, the first at 0. A part boundary resets the scan, so the boundaries before the
+//changed range stay, and once a boundary after it lands on an old one (moved) the rest are the old ones
+static int split_parts(const LspDocument *doc, size_t **out_starts, int *out_head, int *out_tail)
+{
+    const char *s = doc->text;
+    int capacity = 16 + doc->part_count;
+    size_t *starts = doc_alloc(capacity * sizeof(size_t));
+    int count = 0, depth = 0, comment = 0, string = 0;
+    int old = 0, head = 0;
+    char last = 0;
+    size_t i = 0;
+
+    if (doc->starts && doc->dirty)
+    {
+        //the last part starting before the change; its first byte may be what changed
+        while (head + 1 < doc->part_count && doc->starts[head + 1] < doc->dirty_start)
+            head++;
+
+        memcpy(starts, doc->starts, head * sizeof(size_t));
+        count = head;
+        i = doc->starts[head];
+        old = head + 1;
+    }
+
+    starts[count++] = i;
+
+    for (; i < doc->size; i++)
+    {
+        char c = s[i];
+
+        if (i > 0 && s[i - 1] == '\n' && comment != 2 && depth == 0 && (last == ';' || last == '>') &&
+            c != ' ' && c != '\t' && c != '\r' && c != '\n')
+        {
+            if (count + 1 >= capacity)
+            {
+                capacity *= 2;
+                starts = doc_realloc(starts, capacity * sizeof(size_t));
+            }
+
+            starts[count++] = i;
+            last = 0;
+
+            if (doc->starts && doc->dirty && i >= doc->dirty_end)
+            {
+                size_t before = i - doc->shift;
+
+                while (old < doc->part_count && doc->starts[old] < before)
+                    old++;
+
+                if (old < doc->part_count && doc->starts[old] == before)
+                {
+                    int tail = doc->part_count - old;
+
+                    if (count + tail > capacity)
+                        starts = doc_realloc(starts, (count + tail) * sizeof(size_t));
+
+                    for (int k = 1; k < tail; k++)
+                        starts[count++] = doc->starts[old + k] + doc->shift;
+
+                    *out_starts = starts;
+                    *out_head = head;
+                    *out_tail = tail;
+                    return count;
+                }
+            }
+        }
+
+        if (comment == 1)
+        {
+            comment = (c != '\n');
+            continue;
+        }
+
+        if (comment == 2)
+        {
+            if (c == '%' && i + 1 < doc->size && s[i + 1] == '/')
+            {
+                comment = 0;
+                i++;
+            }
+
+            continue;
+        }
+
+        if (string)
+        {
+            string = (c != '"' && c != '\n');
+            continue;
+        }
+
+        switch (c)
+        {
+            case '/':
+                if (i + 1 < doc->size && (s[i + 1] == '/' || s[i + 1] == '%'))
+                {
+                    comment = (s[i + 1] == '/') ? 1 : 2;
+                    i++;
+                }
+                else
+                {
+                    last = c;
+                }
+                break;
+
+            case '"':
+                string = 1;
+                last = c;
+                break;
+
+            case '<':
+            case '(':
+                depth++;
+                last = c;
+                break;
+
+            case '>':
+            case ')':
+                depth = depth > 0 ? depth - 1 : 0;
+                last = c;
+                break;
+
+            case ' ':
+            case '\t':
+            case '\r':
+            case '\n':
+                break;
+
+            default:
+                last = c;
+                break;
+        }
+    }
+
+    *out_starts = starts;
+    *out_head = head;
+    *out_tail = 0;
+    return count;
+}
+
+//a new list of parts for the current text, reusing every old part whose text is unchanged
+static void resplit(LspDocument *doc)
+{
+    size_t *starts;
+    int head, tail;
+    int count = split_parts(doc, &starts, &head, &tail);
+    uint64_t *hashes = doc_alloc(count * sizeof(uint64_t));
+    LspPart **parts = doc_alloc(count * sizeof(LspPart *));
+    LspPart **old = doc->parts;
+    int old_count = doc->part_count;
+    char *taken = doc_alloc(old_count + 1);
+    int slot_count = 64;
+    int *slots;
+    int prefix = 0, suffix = 0;
+    LspPart *holder = NULL;
+
+    //parts the cut kept are known unchanged; only the ones between are hashed
+    for (int i = 0; i < count; i++)
+    {
+        size_t end = (i + 1 < count) ? starts[i + 1] : doc->size;
+
+        if (i < head)
+            hashes[i] = old[i]->hash;
+        else if (i >= count - tail)
+            hashes[i] = old[old_count - (count - i)]->hash;
+        else
+            hashes[i] = xxh64(doc->text + starts[i], end - starts[i], 0);
+    }
+
+    //unchanged parts at both ends keep their places; the ones between are found by hash
+    while (prefix < count && prefix < old_count && old[prefix]->hash == hashes[prefix])
+    {
+        parts[prefix] = old[prefix];
+        taken[prefix++] = 1;
+    }
+
+    while (suffix < count - prefix && suffix < old_count - prefix &&
+           old[old_count - 1 - suffix]->hash == hashes[count - 1 - suffix])
+    {
+        parts[count - 1 - suffix] = old[old_count - 1 - suffix];
+        taken[old_count - 1 - suffix] = 1;
+        suffix++;
+    }
+
+    while (slot_count < 2 * (old_count - prefix - suffix))
+        slot_count *= 2;
+
+    slots = doc_alloc(slot_count * sizeof(int));
+    memset(slots, -1, slot_count * sizeof(int));
+
+    for (int i = prefix; i < old_count - suffix; i++)
+    {
+        int s = (int)(old[i]->hash & (slot_count - 1));
+
+        while (slots[s] >= 0)
+            s = (s + 1) & (slot_count - 1);
+
+        slots[s] = i;
+    }
+
+    for (int i = prefix; i < count - suffix; i++)
+    {
+        parts[i] = NULL;
+
+        for (int s = (int)(hashes[i] & (slot_count - 1)); slots[s] >= 0; s = (s + 1) & (slot_count - 1))
+        {
+            if (!taken[slots[s]] && old[slots[s]]->hash == hashes[i])
+            {
+                parts[i] = old[slots[s]];
+                taken[slots[s]] = 1;
+                break;
+            }
+        }
+
+        if (!parts[i])
+        {
+            parts[i] = doc_alloc(sizeof(LspPart));
+            parts[i]->hash = hashes[i];
+
+            if (!holder)
+            {
+                holder = parts[i];
+                holder->region = count - suffix - i;
+            }
+        }
+    }
+
+    //what the changed region replaced: clean parts stand in for it while it has syntax errors
+    for (int i = prefix; i < old_count - suffix; i++)
+    {
+        LspPart *o = old[i];
+
+        if (taken[i])
+            continue;
+
+        if (holder && o->parsed && o->syntax_count == 0)
+        {
+            holder->stand_ins = doc_realloc(holder->stand_ins, (holder->stand_in_count + 1) * sizeof(LspPart *));
+            holder->stand_ins[holder->stand_in_count++] = o;
+            continue;
+        }
+
+        if (holder && o->stand_in_count > 0)
+        {
+            holder->stand_ins = doc_realloc(holder->stand_ins,
+                                            (holder->stand_in_count + o->stand_in_count) * sizeof(LspPart *));
+            memcpy(holder->stand_ins + holder->stand_in_count, o->stand_ins, o->stand_in_count * sizeof(LspPart *));
+            holder->stand_in_count += o->stand_in_count;
+            o->stand_in_count = 0;
+        }
+
+        free_part(o);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        int next = (i + 1 < count) ? line_of(doc, starts[i + 1]) : doc->line_count;
+
+        parts[i]->line = line_of(doc, starts[i]);
+        parts[i]->line_count = next - parts[i]->line;
+
+        //lexing needs the text, which only this pass has at hand
+        if (!parts[i]->tokens)
+        {
+            size_t end = (i + 1 < count) ? starts[i + 1] : doc->size;
+            lex_text(parts[i], doc->text + starts[i], end - starts[i]);
+        }
+    }
+
+    free(doc->parts);
+    free(doc->starts);
+
+    doc->parts      = parts;
+    doc->part_count = count;
+    doc->starts     = starts;
+    doc->dirty      = 0;
+
+    free(slots);
+    free(taken);
+    free(hashes);
+}
+
+/*
+   Checking
+*/
+
+//the tree sema sees: items copied from the parts, with the part and node each node came from
+typedef struct LspTree {
+    Ast        ast;
+    LspPart  **origin_part;
+    int       *origin_node;
+    char     **lexemes;
+    int32_t   *rows;
+    int32_t   *cols;
+    int        token_capacity;
+} LspTree;
+
+static int tree_node(LspTree *t)
+{
+    if (t->ast.node_count == t->ast.node_capacity)
+    {
+        t->ast.node_capacity = t->ast.node_capacity ? t->ast.node_capacity * 2 : 1024;
+        t->ast.nodes = doc_realloc(t->ast.nodes, t->ast.node_capacity * sizeof(AstNode));
+        t->origin_part = doc_realloc(t->origin_part, t->ast.node_capacity * sizeof(LspPart *));
+        t->origin_node = doc_realloc(t->origin_node, t->ast.node_capacity * sizeof(int));
+    }
+
+    return t->ast.node_count++;
+}
+
+static int tree_token(LspTree *t, char *lexeme, int row, int col)
+{
+    if (t->ast.token_count == t->token_capacity)
+    {
+        t->token_capacity = t->token_capacity ? t->token_capacity * 2 : 1024;
+        t->lexemes = doc_realloc(t->lexemes, t->token_capacity * sizeof(char *));
+        t->rows = doc_realloc(t->rows, t->token_capacity * sizeof(int32_t));
+        t->cols = doc_realloc(t->cols, t->token_capacity * sizeof(int32_t));
+    }
+
+    t->lexemes[t->ast.token_count] = lexeme;
+    t->rows[t->ast.token_count] = row;
+    t->cols[t->ast.token_count] = col;
+
+    return t->ast.token_count++;
+}
+
+//a stand-in is placed on the first line of the part it stands in for
+static int copy_node(LspTree *t, LspPart *part, int node, int prototype, int fixed_row)
+{
+    const AstNode *src = &part->ast.nodes[node];
+    int id = tree_node(t);
+    int head = AST_NULL, tail = AST_NULL;
+
+    t->ast.nodes[id] = *src;
+    t->origin_part[id] = part;
+    t->origin_node[id] = node;
+
+    if (src->tok >= 0)
+    {
+        const TokenBuffer *tok = &part->tokens[src->tok];
+        t->ast.nodes[id].tok = tree_token(t, part->lexemes[src->tok], fixed_row ? fixed_row : part->line + tok->row, tok->col);
+    }
+
+    for (int k = 0; k < 4; k++)
+    {
+        int kid = (src->kid[k] == AST_NULL || (prototype && k == 1)) ? AST_NULL : copy_node(t, part, src->kid[k], 0, fixed_row);
+        t->ast.nodes[id].kid[k] = kid;
+    }
+
+    for (int c = src->list; c != AST_NULL; c = part->ast.nodes[c].next)
+    {
+        int copy = copy_node(t, part, c, 0, fixed_row);
+
+        if (head == AST_NULL)
+            head = copy;
+        else
+            t->ast.nodes[tail].next = copy;
+
+        tail = copy;
+    }
+
+    t->ast.nodes[id].list = head;
+    t->ast.nodes[id].next = AST_NULL;
+
+    return id;
+}
+
+static void copy_items(LspTree *t, LspPart *part, int prototypes, int fixed_row, int *tail)
+{
+    for (int g = part->ast.nodes[part->ast.root].list; g != AST_NULL; g = part->ast.nodes[g].next)
+    {
+        int copy = copy_node(t, part, g, prototypes && part->ast.nodes[g].kind == AST_FUNCTION, fixed_row);
+
+        if (*tail == AST_NULL)
+            t->ast.nodes[t->ast.root].list = copy;
+        else
+            t->ast.nodes[*tail].next = copy;
+
+        *tail = copy;
+    }
+}
+
+static char *type_text(const TypeTable *tt, int type)
+{
+    char buf[256];
+
+    return doc_strdup(type_to_string(tt, type, buf, sizeof(buf)));
+}
+
+static char *function_hover(const LspTree *t, const TypeTable *tt, int fn)
+{
+    const AstNode *f = &t->ast.nodes[fn];
+    char buf[1024], type[256];
+    int len = snprintf(buf, sizeof(buf), "%s(", t->lexemes[f->tok]);
+
+    for (int p = f->list; p != AST_NULL && len < (int)sizeof(buf); p = t->ast.nodes[p].next)
+    {
+        len += snprintf(buf + len, sizeof(buf) - len, "%s%s %s", p == f->list ? "" : ", ",
+                        type_to_string(tt, t->ast.nodes[p].type, type, sizeof(type)),
+                        t->ast.nodes[p].tok >= 0 ? t->lexemes[t->ast.nodes[p].tok] : "");
+    }
+
+    if (len < (int)sizeof(buf))
+        snprintf(buf + len, sizeof(buf) - len, "): %s", type_to_string(tt, f->type, type, sizeof(type)));
+
+    return doc_strdup(buf);
+}
+
+static char *named_hover(const char *format, const char *name, const char *detail)
+{
+    char buf[512];
+
+    snprintf(buf, sizeof(buf), format, name, detail);
+    return doc_strdup(buf);
+}
+
+//points tok at the declaration: a token of its own part, or a name to look up in the others
+static void set_target(LspPart *part, int tok, const LspTree *t, int decl, const char *key)
+{
+    if (t->origin_part[decl] == part && t->origin_node[decl] >= 0)
+        part->defs[tok] = part->ast.nodes[t->origin_node[decl]].tok;
+    else
+        part->targets[tok] = doc_strdup(key);
+}
+
+static unsigned char symbol_role(SymKind kind)
+{
+    switch (kind)
+    {
+        case SYM_PARAM:      return LSP_ROLE_PARAMETER;
+        case SYM_FUNC:       return LSP_ROLE_FUNCTION;
+        case SYM_TYPEDEF:    return LSP_ROLE_TYPE;
+        case SYM_ENUM_CONST: return LSP_ROLE_ENUM_MEMBER;
+        default:             return LSP_ROLE_VARIABLE;
+    }
+}
+
+//what sema found about one node of a part being checked
+static void record_node(const LspTree *t, const TypeTable *tt, const SemState *sem, int i)
+{
+    LspPart *part = t->origin_part[i];
+    const AstNode *n = &t->ast.nodes[i];
+    int tok = part->ast.nodes[t->origin_node[i]].tok;
+    const char *name;
+    char value[32];
+    char *type;
+
+    if (tok < 0 || part->tokens[tok].token != TOK_IDENTIFIER)
+        return;
+
+    name = part->lexemes[tok];
+
+    switch (n->kind)
+    {
+        case AST_FUNCTION:
+            part->defs[tok] = tok;
+            part->hovers[tok] = function_hover(t, tt, i);
+            break;
+
+        case AST_PARAM:
+        case AST_VAR_DECL:
+        case AST_FIELD_DECL:
+            type = type_text(tt, n->type);
+            part->defs[tok] = tok;
+            part->hovers[tok] = named_hover("%s: %s", name, type);
+            free(type);
+            break;
+
+        case AST_TYPEDEF:
+            type = type_text(tt, n->type);
+            part->defs[tok] = tok;
+            part->hovers[tok] = named_hover("TYPDEF %s: %s", name, type);
+            free(type);
+            break;
+
+        case AST_STRUCT_DECL:
+        case AST_ENUM_DECL:
+            part->defs[tok] = tok;
+            part->hovers[tok] = named_hover(n->kind == AST_STRUCT_DECL ? "STRUKTUR %s%s" : "ENUM %s%s", name, "");
+            break;
+
+        case AST_ENUMERATOR:
+            snprintf(value, sizeof(value), "%lld", (long long)n->value.i);
+            part->defs[tok] = tok;
+            part->hovers[tok] = named_hover("%s = %s", name, value);
+            break;
+
+        case AST_IDENT:
+        case AST_CALL:
+        {
+            const Symbol *s;
+
+            if (n->sym < 0)
+                break;
+
+            s = &sem->symbols[n->sym];
+            part->roles[tok] = symbol_role(s->kind);
+            set_target(part, tok, t, s->node, name);
+
+            if (s->kind == SYM_FUNC)
+            {
+                part->hovers[tok] = function_hover(t, tt, s->node);
+            }
+            else if (s->kind == SYM_ENUM_CONST)
+            {
+                snprintf(value, sizeof(value), "%d", s->value);
+                part->hovers[tok] = named_hover("%s = %s", name, value);
+            }
+            else
+            {
+                type = type_text(tt, s->type);
+                part->hovers[tok] = named_hover("%s: %s", name, type);
+                free(type);
+            }
+            break;
+        }
+
+        case AST_FIELD:
+        {
+            int base = n->kid[0] != AST_NULL ? t->ast.nodes[n->kid[0]].type : -1;
+            int f;
+            char key[512];
+
+            if (base >= 0 && tt->types[base].kind == TY_POINTER)
+                base = tt->types[base].base;
+
+            if (base < 0 || tt->types[base].kind != TY_STRUCT)
+                break;
+
+            f = struct_find_field(tt, tt->types[base].info, name);
+
+            if (f < 0)
+                break;
+
+            snprintf(key, sizeof(key), "%s.%s", tt->structs[tt->types[base].info].name, name);
+            set_target(part, tok, t, tt->fields[f].node, key);
+
+            type = type_text(tt, tt->fields[f].type);
+            part->hovers[tok] = named_hover("%s: %s", name, type);
+            free(type);
+            break;
+        }
+
+        case AST_TYPE:
+            part->targets[tok] = doc_strdup(name);
+
+            if (n->type >= 0)
+            {
+                type = type_text(tt, n->type);
+                part->hovers[tok] = named_hover("%s: %s", name, type);
+                free(type);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+typedef struct CheckOutput {
+    LspDocument *doc;
+} CheckOutput;
+
+static void add_semantic(void *arg, int row, int col, const char *message, size_t len)
+{
+    CheckOutput *c = arg;
+    int p = lsp_part_at(c->doc, row - 1);
+
+    if (p < 0 || !c->doc->parts[p]->checking)
+        return;
+
+    LspPart *part = c->doc->parts[p];
+    const char *ref = NULL;
+    int ref_row = 0, digits = 0;
+
+    //"... at R:C" naming a row of this part moves with it, so the row is kept relative
+    for (const char *at = message; at + 4 < message + len; at++)
+    {
+        if (memcmp(at, " at ", 4) == 0 && sscanf(at + 4, "%d%n", &ref_row, &digits) == 1)
+            ref = at + 4;
+    }
+
+    add_diagnostic(&part->semantic, &part->semantic_count, row - part->line, col, message, len);
+
+    if (ref && ref_row > part->line && ref_row <= part->line + part->line_count)
+    {
+        LspDiagnostic *d = &part->semantic[part->semantic_count - 1];
+
+        sscanf(ref, "%d%n", &ref_row, &digits);
+        d->ref_row = ref_row - part->line;
+        d->ref_at = (int)(ref - message);
+        memmove(d->message + d->ref_at, d->message + d->ref_at + digits, len - d->ref_at - digits + 1);
+    }
+}
+
+//the parts from p that the stand-ins of p replace, if they are all still broken
+static int uses_stand_ins(const LspDocument *doc, int p)
+{
+    const LspPart *holder = doc->parts[p];
+
+    if (holder->stand_in_count == 0)
+        return 0;
+
+    for (int i = p; i < p + holder->region && i < doc->part_count; i++)
+    {
+        if (doc->parts[i]->syntax_count == 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+//open addressing over name hashes, 0 marking an empty slot; a table of pairs holds a value after each key
+static uint64_t *hash_slot(uint64_t *table, int slot_count, int width, uint64_t key)
+{
+    int s = (int)(key & (slot_count - 1));
+
+    while (table[s * width] != 0 && table[s * width] != key)
+        s = (s + 1) & (slot_count - 1);
+
+    return &table[s * width];
+}
+
+static int hash_has(uint64_t *table, int slot_count, int width, uint64_t key)
+{
+    return slot_count > 0 && *hash_slot(table, slot_count, width, key) == key;
+}
+
+typedef struct ExportSource {
+    const LspPart *part;
+    int            line;            // where its items count as declared
+} ExportSource;
+
+/* unchecks the parts whose results what other parts declare may have changed: those mentioning a
+   name declared otherwise than at the last check, or by an item whose signature mentions one */
+static void invalidate(LspDocument *doc, const char *excluded)
+{
+    ExportSource *sources = doc_alloc((doc->part_count + 1) * sizeof(ExportSource));
+    int source_count = 0, name_count = 0, slot_count = 64, changed_slots = 64, changed_count = 0;
+    uint64_t *entries, *changed;
+    int grew = 1;
+
+    for (int i = 0; i < doc->part_count; i++)
+    {
+        LspPart *part = doc->parts[i];
+
+        if (uses_stand_ins(doc, i))
+        {
+            sources = doc_realloc(sources, (source_count + part->stand_in_count + doc->part_count - i) * sizeof(ExportSource));
+
+            for (int s = 0; s < part->stand_in_count; s++)
+                sources[source_count++] = (ExportSource){ part->stand_ins[s], part->line };
+        }
+
+        if (!excluded[i])
+            sources[source_count++] = (ExportSource){ part, -1 };
+    }
+
+    for (int i = 0; i < source_count; i++)
+    {
+        for (int t = 0; t < sources[i].part->item_count; t++)
+            name_count += sources[i].part->items[t].name_count;
+    }
+
+    while (slot_count < 2 * name_count)
+        slot_count *= 2;
+
+    //per name: key, sum of the declaring items' hashes, sum of their lines, count
+    entries = doc_alloc(slot_count * 4 * sizeof(uint64_t));
+
+    for (int i = 0; i < source_count; i++)
+    {
+        const LspPart *part = sources[i].part;
+
+        for (int t = 0; t < part->item_count; t++)
+        {
+            const LspItem *item = &part->items[t];
+            uint64_t line = sources[i].line >= 0 ? sources[i].line : part->line + item->row - 1;
+
+            for (int n = item->first_name; n < item->first_name + item->name_count; n++)
+            {
+                uint64_t *e = hash_slot(entries, slot_count, 4, part->names[n]);
+
+                e[0] = part->names[n];
+                e[1] += item->hash;
+                e[2] += line;
+                e[3]++;
+            }
+        }
+    }
+
+    //a name declared twice is reported with the other's line, so then its lines count too
+    for (int s = 0; s < slot_count; s++)
+    {
+        uint64_t *e = &entries[s * 4];
+
+        if (e[0] != 0)
+            e[1] = xxh64(&e[1], (e[3] > 1 ? 3 : 1) * sizeof(uint64_t), 0);
+    }
+
+    while (changed_slots < 2 * (name_count + doc->export_slots))
+        changed_slots *= 2;
+
+    changed = doc_alloc(changed_slots * sizeof(uint64_t));
+
+    for (int s = 0; s < slot_count; s++)
+    {
+        uint64_t *e = &entries[s * 4];
+
+        if (e[0] != 0 && (!hash_has(doc->exports, doc->export_slots, 2, e[0]) ||
+                          hash_slot(doc->exports, doc->export_slots, 2, e[0])[1] != e[1]))
+        {
+            *hash_slot(changed, changed_slots, 1, e[0]) = e[0];
+            changed_count++;
+        }
+    }
+
+    for (int s = 0; s < doc->export_slots; s++)
+    {
+        uint64_t key = doc->exports[s * 2];
+
+        if (key != 0 && !hash_has(entries, slot_count, 4, key))
+        {
+            *hash_slot(changed, changed_slots, 1, key) = key;
+            changed_count++;
+        }
+    }
+
+    //what an item declares changes with what its signature mentions
+    while (grew && changed_count > 0)
+    {
+        grew = 0;
+
+        for (int i = 0; i < source_count; i++)
+        {
+            const LspPart *part = sources[i].part;
+
+            for (int t = 0; t < part->item_count; t++)
+            {
+                const LspItem *item = &part->items[t];
+                int uses_changed = 0;
+
+                for (int u = item->first_use; u < item->first_use + item->use_count && !uses_changed; u++)
+                    uses_changed = hash_has(changed, changed_slots, 1, part->names[u]);
+
+                for (int n = item->first_name; uses_changed && n < item->first_name + item->name_count; n++)
+                {
+                    uint64_t *slot = hash_slot(changed, changed_slots, 1, part->names[n]);
+
+                    if (*slot == 0)
+                    {
+                        //the table was sized for every name there is, so it never fills
+                        *slot = part->names[n];
+                        changed_count++;
+                        grew = 1;
+                    }
+                }
+            }
+        }
+    }
+
+    for (int i = 0; changed_count > 0 && i < doc->part_count; i++)
+    {
+        LspPart *part = doc->parts[i];
+
+        for (int n = 0; part->checked && n < part->ident_count; n++)
+        {
+            if (hash_has(changed, changed_slots, 1, part->idents[n]))
+                part->checked = 0;
+        }
+    }
+
+    //kept as name, value pairs
+    free(doc->exports);
+    doc->exports = doc_alloc(slot_count * 2 * sizeof(uint64_t));
+    doc->export_slots = slot_count;
+
+    for (int s = 0; s < slot_count; s++)
+    {
+        doc->exports[s * 2]     = entries[s * 4];
+        doc->exports[s * 2 + 1] = entries[s * 4 + 1];
+    }
+
+    free(changed);
+    free(entries);
+    free(sources);
+}
+
+static void check(LspDocument *doc)
+{
+    char *excluded = doc_alloc(doc->part_count);
+    int pending = 0;
+    int tail = AST_NULL;
+    LspTree tree;
+    TypeTable types;
+    SemState sem;
+    CheckOutput output = { doc };
+    char *out_text = NULL;
+    size_t out_size = 0;
+    FILE *out;
+    int errors;
+
+    //broken parts are left out, and show what their stand-ins did
+    for (int i = 0; i < doc->part_count; i++)
+    {
+        LspPart *part = doc->parts[i];
+
+        if (uses_stand_ins(doc, i))
+            memset(excluded + i, 1, part->region < doc->part_count - i ? part->region : doc->part_count - i);
+
+        excluded[i] |= part->syntax_count > 0;
+    }
+
+    invalidate(doc, excluded);
+
+    for (int i = 0; i < doc->part_count; i++)
+        pending |= !excluded[i] && !doc->parts[i]->checked;
+
+    if (!pending)
+    {
+        free(excluded);
+        return;
+    }
+
+    memset(&tree, 0, sizeof(tree));
+    tree.ast.root = tree_node(&tree);
+    tree.ast.nodes[0] = (AstNode){ .kind = AST_PROGRAM, .op = TOK_ERROR, .tok = -1,
+                                   .kid = { AST_NULL, AST_NULL, AST_NULL, AST_NULL },
+                                   .list = AST_NULL, .next = AST_NULL, .type = -1, .sym = -1 };
+    tree.origin_part[0] = NULL;
+    tree.origin_node[0] = -1;
+
+    for (int i = 0; i < doc->part_count; i++)
+    {
+        LspPart *part = doc->parts[i];
+
+        if (uses_stand_ins(doc, i))
+        {
+            for (int s = 0; s < part->stand_in_count; s++)
+                copy_items(&tree, part->stand_ins[s], 1, part->line + 1, &tail);
+        }
+
+        part->checking = !excluded[i] && (!part->checked || part->has_globals);
+
+        if (!excluded[i] && part->ast.root != AST_NULL)
+            copy_items(&tree, part, !part->checking, 0, &tail);
+
+        if (part->checking)
+        {
+            free_check(part);
+
+            part->defs    = doc_alloc(part->token_count * sizeof(int));
+            part->targets = doc_alloc(part->token_count * sizeof(char *));
+            part->hovers  = doc_alloc(part->token_count * sizeof(char *));
+
+            memset(part->defs, -1, part->token_count * sizeof(int));
+        }
+    }
+
+    tree.ast.lexemes = tree.lexemes;
+    tree.ast.rows    = tree.rows;
+    tree.ast.cols    = tree.cols;
+
+    out = open_memstream(&out_text, &out_size);
+
+    if (!out)
+    {
+        fprintf(stderr, "Fatal: failed to allocate sema output buffer\n");
+        exit(1);
+    }
+
+    init_type_table(&types, doc->layout);
+    sema(&tree.ast, &types, out, &sem, &errors);
+    fclose(out);
+
+    read_diagnostics(out_text, out_size, add_semantic, &output);
+
+    for (int i = 1; i < tree.ast.node_count; i++)
+    {
+        if (tree.origin_part[i]->checking)
+            record_node(&tree, &types, &sem, i);
+    }
+
+    for (int i = 0; i < doc->part_count; i++)
+    {
+        if (doc->parts[i]->checking)
+            doc->parts[i]->checked = 1;
+
+        doc->parts[i]->checking = 0;
+    }
+
+    free_sema(&sem);
+    free_type_table(&types);
+    free(out_text);
+    free(tree.ast.nodes);
+    free(tree.origin_part);
+    free(tree.origin_node);
+    free(tree.lexemes);
+    free(tree.rows);
+    free(tree.cols);
+    free(excluded);
+}
+
+int lsp_document_analyse(LspDocument *doc, int (*cancelled)(void *), void *arg)
+{
+    NameSet names;
+
+    if (doc->analysed)
+        return 0;
+
+    //a cancelled analysis already cut the text it resumes on
+    if (doc->dirty || !doc->starts)
+        resplit(doc);
+    memset(&names, 0, sizeof(names));
+
+    for (int i = 0; i < doc->part_count; i++)
+    {
+        LspPart *part = doc->parts[i];
+
+        if (part->parsed && part->names_before != names.sequence)
+        {
+            //the type names before it changed; it parses the same if it uses the same ones
+            if (context_of(part, &names) == part->context)
+                part->names_before = names.sequence;
+            else
+                free_parse(part);
+        }
+
+        if (!part->parsed)
+        {
+            if (cancelled && cancelled(arg))
+            {
+                free(names.names);
+                free(names.hashes);
+                free(names.stamps);
+                free(names.slots);
+                return 1;
+            }
+
+            parse_tokens(part, &names);
+        }
+
+        for (int n = 0; n < part->declared_count; n++)
+            add_name(&names, part->declared[n]);
+    }
+
+    free(names.names);
+    free(names.hashes);
+    free(names.stamps);
+    free(names.slots);
+
+    //a region that parses cleanly again needs no stand-ins
+    for (int i = 0; i < doc->part_count; i++)
+    {
+        LspPart *part = doc->parts[i];
+
+        if (part->stand_in_count > 0 && !uses_stand_ins(doc, i))
+        {
+            for (int s = 0; s < part->stand_in_count; s++)
+                free_part(part->stand_ins[s]);
+
+            free(part->stand_ins);
+            part->stand_ins = NULL;
+            part->stand_in_count = 0;
+        }
+    }
+
+    check(doc);
+    doc->analysed = 1;
+
+    return 0;
+}
+
+/*
+   Queries
+*/
+
+void lsp_diagnostic_message(const LspPart *part, const LspDiagnostic *d, char *buf, size_t size)
+{
+    if (d->ref_row == 0)
+        snprintf(buf, size, "%s", d->message);
+    else
+        snprintf(buf, size, "%.*s%d%s", d->ref_at, d->message, part->line + d->ref_row, d->message + d->ref_at);
+}
+
+static int find_global(const LspDocument *doc, const char *key, int *out_part, int *out_tok)
+{
+    const char *dot = strchr(key, '.');
+    size_t len = dot ? (size_t)(dot - key) : strlen(key);
+
+    for (int p = 0; p < doc->part_count; p++)
+    {
+        const LspPart *part = doc->parts[p];
+
+        if (!part->parsed || part->ast.root == AST_NULL)
+            continue;
+
+        for (int g = part->ast.nodes[part->ast.root].list; g != AST_NULL; g = part->ast.nodes[g].next)
+        {
+            const AstNode *n = &part->ast.nodes[g];
+            int match = n->tok >= 0 && strncmp(part->lexemes[n->tok], key, len) == 0 && part->lexemes[n->tok][len] == '\0';
+
+            if (dot)
+            {
+                if (n->kind != AST_STRUCT_DECL || !match)
+                    continue;
+
+                for (int f = n->list; f != AST_NULL; f = part->ast.nodes[f].next)
+                {
+                    int tok = part->ast.nodes[f].tok;
+
+                    if (tok >= 0 && strcmp(part->lexemes[tok], dot + 1) == 0)
+                    {
+                        *out_part = p;
+                        *out_tok = tok;
+                        return 1;
+                    }
+                }
+
+                continue;
+            }
+
+            if (match && n->kind != AST_ENUM_DECL)
+            {
+                *out_part = p;
+                *out_tok = n->tok;
+                return 1;
+            }
+
+            for (int e = n->kind == AST_ENUM_DECL ? n->list : AST_NULL; e != AST_NULL; e = part->ast.nodes[e].next)
+            {
+                int tok = part->ast.nodes[e].tok;
+
+                if (tok >= 0 && strcmp(part->lexemes[tok], key) == 0)
+                {
+                    *out_part = p;
+                    *out_tok = tok;
+                    return 1;
+                }
+            }
+
+            if (match)
+            {
+                *out_part = p;
+                *out_tok = n->tok;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int lsp_definition(const LspDocument *doc, int p, int tok, int *out_part, int *out_tok)
+{
+    const LspPart *part = doc->parts[p];
+
+    if (!part->parsed || tok < 0 || tok >= part->token_count)
+        return 0;
+
+    if (part->defs && part->defs[tok] >= 0)
+    {
+        *out_part = p;
+        *out_tok = part->defs[tok];
+        return 1;
+    }
+
+    if (part->targets && part->targets[tok])
+        return find_global(doc, part->targets[tok], out_part, out_tok);
+
+    //a part not checked (it has syntax errors) can still find what the file declares at the top
+    if (!part->checked && part->tokens[tok].token == TOK_IDENTIFIER)
+        return find_global(doc, part->lexemes[tok], out_part, out_tok);
+
+    return 0;
+}
+
+void lsp_document_free(LspDocument *doc)
+{
+    for (int i = 0; i < doc->part_count; i++)
+        free_part(doc->parts[i]);
+
+    free(doc->parts);
+    free(doc->starts);
+    free(doc->exports);
+    free(doc->uri);
+    free(doc->text);
+    free(doc->line_starts);
+
+    memset(doc, 0, sizeof(*doc));
+}
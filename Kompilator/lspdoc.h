@@ -0,0 +1,186 @@
+#ifndef LSPDOC_H
+#define LSPDOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lexer.h"
+#include "ast.h"
+#include "types.h"
+
+/* ---------------------------------------------
+   Incremental analysis of an open file (lsp.h)
+
+   The text is cut into parts: runs of whole
+   lines holding one or more top-level items.
+   A part starts at a line that begins in
+   column 1 outside brackets, comments and
+   strings, after a ';' or '>' at depth 0,
+   which is how K files are laid out. Parts are
+   lexed and parsed on their own and kept under
+   the hash of their text, with rows relative
+   to their first line, so an edit lexes and
+   parses only the parts it touches and moving
+   a part costs nothing.
+
+   Parsing depends on the type names declared
+   earlier in the file (parse_part), so a part
+   also remembers which of those it used and
+   is parsed again only when they change.
+   Cutting is incremental as well: only the
+   text between the part boundaries around
+   the edits is scanned again.
+
+   Semantic analysis runs on a reduced tree
+   copied from the parts: parts not checked
+   yet, or holding globals, in full; every
+   other function as a prototype (its
+   signature). Diagnostics, types and
+   definitions are kept per part. Each item
+   tells the names it declares and the ones
+   its signature uses; when what a name
+   declares changes (or what it depends on
+   does), the parts mentioning that name are
+   checked again, and only those.
+
+   A part with syntax errors is not checked.
+   The last clean parts of the region it
+   replaced stand in for its declarations, so
+   the rest of the file keeps its results
+   while an item is half typed.
+
+   Positions here are the lexer's: rows from 1,
+   columns in code points from 1, a tab
+   counting 4. lsp.c converts them to LSP's.
+--------------------------------------------- */
+
+// what a token is shown as; lsp.c maps these to LSP semantic token types
+typedef enum LspRole {
+    LSP_ROLE_NONE,
+    LSP_ROLE_KEYWORD,
+    LSP_ROLE_NUMBER,
+    LSP_ROLE_STRING,
+    LSP_ROLE_FUNCTION,
+    LSP_ROLE_VARIABLE,
+    LSP_ROLE_PARAMETER,
+    LSP_ROLE_TYPE,
+    LSP_ROLE_STRUCT,
+    LSP_ROLE_PROPERTY,
+    LSP_ROLE_ENUM_MEMBER,
+    LSP_ROLE_COUNT
+} LspRole;
+
+typedef struct LspDiagnostic {
+    int   row;                      // relative to the part
+    int   col;
+    char *message;
+    int   ref_row;                  // a row of the same part the message names, relative; 0 if none
+    int   ref_at;                   // where in message it goes
+} LspDiagnostic;
+
+// what other parts see of a top-level item: its text, less a function's body
+typedef struct LspItem {
+    uint64_t         hash;
+    int              row;           // of its name, relative to the part
+    int              first_name;    // declared names (the item's, its enumerators') in LspPart.names
+    int              name_count;
+    int              first_use;     // names its signature mentions, in LspPart.names
+    int              use_count;
+} LspItem;
+
+typedef struct LspPart {
+    uint64_t         hash;          // of the text
+    int              line;          // first line, from 0, in the current text
+    int              line_count;
+
+    //lexing and parsing: depend on the text and, for parsing, the type names in context
+    int              parsed;
+    TokenBuffer     *tokens;
+    char           **lexemes;
+    int              token_count;
+    unsigned char   *roles;         // LspRole per token
+    Ast              ast;
+    const char     **declared;      // type names it declares, pointing into lexemes
+    int              declared_count;
+    uint64_t         names_before;  // every type name declared before it, hashed, when it was parsed
+    uint64_t         context;       // the ones its identifiers use
+    LspDiagnostic   *syntax;
+    int              syntax_count;
+    int              has_globals;   // an item that is not a function: always checked in full
+    LspItem         *items;         // its top-level items
+    int              item_count;
+    uint64_t        *names;         // name hashes the items index
+    uint64_t        *idents;        // every identifier it mentions, hashed, sorted, once each
+    int              ident_count;
+
+    //checking: valid while nothing it mentions declares something else
+    int              checked;
+    int              checking;      // in full in the check under way
+    LspDiagnostic   *semantic;
+    int              semantic_count;
+    int             *defs;          // per token: its declaring token in this part, or -1
+    char           **targets;       // per token declared in another part: "name" or "struct.field"
+    char           **hovers;        // per token
+
+    struct LspPart **stand_ins;     // clean parts replaced by this region
+    int              stand_in_count;
+    int              region;        // parts, from this one, that replaced them
+} LspPart;
+
+typedef struct LspDocument {
+    char       *uri;
+    long        version;
+    char       *text;
+    size_t      size;
+    size_t      capacity;
+    size_t     *line_starts;
+    int         line_count;
+    int         line_capacity;
+    LayoutMode  layout;
+
+    LspPart   **parts;
+    int         part_count;
+    size_t     *starts;             // byte offset of each part when they were cut
+
+    //edits since then changed only [dirty_start, dirty_end); the text after moved by shift bytes
+    int         dirty;
+    size_t      dirty_start;
+    size_t      dirty_end;
+    long        shift;
+    uint64_t   *exports;            // at the last check: name hash, what it declares, in pairs, open addressing
+    int         export_slots;
+    int         analysed;           // parts and checks are up to date with the text
+} LspDocument;
+
+void lsp_document_init(LspDocument *doc, const char *uri, const char *text, size_t size, long version, LayoutMode layout);
+void lsp_document_free(LspDocument *doc);
+
+// replaces bytes [start, end) of the text
+void lsp_document_edit(LspDocument *doc, size_t start, size_t end, const char *text, size_t size);
+
+/* brings the parts and their checks up to date with the text. Before each part it parses it
+   asks cancelled(arg), when given, and returns 1 at once if a newer edit is waiting; the parts
+   done so far are kept */
+int  lsp_document_analyse(LspDocument *doc, int (*cancelled)(void *), void *arg);
+
+// byte offset of a UTF-16 position, clamped to the text
+size_t lsp_offset(const LspDocument *doc, int line, int character);
+
+// UTF-16 offset in line of a lexer column, and the lexer column of a UTF-16 offset
+int  lsp_character_of(const LspDocument *doc, int line, int col);
+int  lsp_col_of(const LspDocument *doc, int line, int character);
+
+// the part holding line, -1 if none; the token of a part at a lexer position, -1 if none
+int  lsp_part_at(const LspDocument *doc, int line);
+int  lsp_token_at(const LspPart *part, int row, int col);
+
+// columns a token covers
+int  lsp_token_width(const LspPart *part, int tok);
+
+// the message of a diagnostic of part, naming rows where they are now
+void lsp_diagnostic_message(const LspPart *part, const LspDiagnostic *d, char *buf, size_t size);
+
+// where token tok of part p is declared; 0 if it is not known
+int  lsp_definition(const LspDocument *doc, int p, int tok, int *out_part, int *out_tok);
+
+#endif /* LSPDOC_H */
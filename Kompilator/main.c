@@ -1,129 +1,448 @@
 #include <stdio.h>
+#include <limits.h>
 #include <locale.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "helper.h"
-#include "lexer.h"
-#include "parser.h"
-#include "utf_decoder.h"
-#include "tokenkeytab.h"
+#include "driver.h"
+#include "pool.h"
+#include "server.h"
+#include "lsp.h"
 
-char *reader(FILE *file);
-
-int main(int argc, char *argv[])
+//one path per line of the list file; blank lines and lines starting with # are skipped
+static int read_batch_list(const char *path, char **text, const char ***files, int *count, int *capacity)
 {
-    setlocale(LC_ALL, "");
+    FILE *file = fopen(path, "r");
 
-    if (argc < 2)
+    if (!file)
     {
-        fprintf(stderr, "Error: No file specified\n");
+        fprintf(stderr, "Error: Could not open %s\n", path);
         return 1;
     }
 
-    const char *filename = argv[1];
-    size_t len = strlen(filename);
-    if (len < 2 || filename[len - 2] != '.' || filename[len - 1] != 'k')
+    *text = reader(file);
+    fclose(file);
+
+    if (!*text)
     {
-        fprintf(stderr, "Error: File must end with .k extension\n");
+        fprintf(stderr, "Error: Failed to read %s\n", path);
         return 1;
     }
 
-    FILE *file = fopen(filename, "r");
-    if (!file)
+    for (char *line = strtok(*text, "\r\n"); line; line = strtok(NULL, "\r\n"))
     {
-        fprintf(stderr, "Error: Could not open file\n");
-        return 1;
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+
+        if (*count == *capacity)
+        {
+            *capacity = *capacity ? *capacity * 2 : 64;
+            *files = realloc(*files, *capacity * sizeof(**files));
+
+            if (!*files)
+            {
+                fprintf(stderr, "Fatal: failed to allocate batch list\n");
+                exit(1);
+            }
+        }
+
+        (*files)[(*count)++] = line;
     }
 
-    char *char_buffer = reader(file);
-    fclose(file);
+    return 0;
+}
+
+//one file of a batch: its result and, with several jobs, what it printed while compiling
+typedef struct BatchFile {
+    const char *path;
+    FileResult  result;
+    int         failed;
+    int         done;
+    char       *out_text;
+    size_t      out_size;
+    char       *err_text;
+    size_t      err_size;
+} BatchFile;
+
+typedef struct BatchState {
+    const CompileOptions *opts;
+    BatchFile            *files;
+    int                   count;
+    int                   jobs;
+    int                   printed;      // files before this index have been written out
+    int                   failed_count;
+    pthread_mutex_t       print_lock;   // held only to write finished files in input order
+} BatchState;
 
-    if (!char_buffer)
+static void print_file_result(BatchState *bs, BatchFile *bf)
+{
+    if (bf->out_text)
+        fwrite(bf->out_text, 1, bf->out_size, stdout);
+
+    if (bf->err_text)
     {
-        fprintf(stderr, "Error: Failed to read file\n");
-        return 1;
+        fwrite(bf->err_text, 1, bf->err_size, stderr);
+        fflush(stderr);
+    }
+
+    if (bf->failed && bf->result.unread)
+    {
+        printf("%s: failed (not read)\n", bf->path);
+    }
+    else if (bf->failed)
+    {
+        printf("%s: failed (%d parse, %d semantic, %d IR, %d run error(s))\n", bf->path,
+               bf->result.parse_errors, bf->result.sema_errors, bf->result.ir_errors, bf->result.run_errors);
+    }
+    else
+    {
+        printf("%s: ok, %d tokens\n", bf->path, bf->result.token_count);
     }
 
-    printf("%s\n", char_buffer);
+    //results reach the grader as they come, not when the batch ends
+    fflush(stdout);
 
-    int char_count = 0;
-    CharacterUnit *decode_buffer = decode_utf8(char_buffer, &char_count);
+    bs->failed_count += bf->failed;
 
-    /* -----------------------------
-       Outputs from lexer
-       ----------------------------- */
+    free(bf->out_text);
+    free(bf->err_text);
+    bf->out_text = NULL;
+    bf->err_text = NULL;
+}
 
-    TokenBuffer *token_buffer = NULL;
-    int token_count = 0;
+//pool task: compiles one file, then writes out every finished file the output is waiting for
+static void compile_batch_file(void *context, int index, int worker)
+{
+    BatchState *bs = context;
+    BatchFile *bf = &bs->files[index];
+    FILE *out = stdout;
+    FILE *err = stderr;
 
-    char **lexemes = NULL;
-    int lexeme_count = 0;
-    int *lexeme_row = NULL;
-    int *lexeme_col = NULL;
+    (void)worker;
 
-    /* -----------------------------
-       Run lexer
-       ----------------------------- */
+    //with one job the file is written as it compiles; otherwise it is kept until its turn
+    if (bs->jobs > 1)
+    {
+        out = open_memstream(&bf->out_text, &bf->out_size);
+        err = open_memstream(&bf->err_text, &bf->err_size);
 
-    lexer(
-        decode_buffer,
-        char_count,
+        if (!out || !err)
+        {
+            fprintf(stderr, "Fatal: failed to allocate batch output\n");
+            exit(1);
+        }
+    }
 
-        &token_buffer,
-        &token_count,
+    bf->failed = compile_file(bf->path, bs->opts, out, err, &bf->result);
 
-        &lexemes,
-        &lexeme_count,
-        &lexeme_row,
-        &lexeme_col
-    );
-    
-   
+    if (bs->jobs > 1)
+    {
+        fclose(out);
+        fclose(err);
+    }
 
+    pthread_mutex_lock(&bs->print_lock);
+
+    bf->done = 1;
+
+    while (bs->printed < bs->count && bs->files[bs->printed].done)
+        print_file_result(bs, &bs->files[bs->printed++]);
+
+    pthread_mutex_unlock(&bs->print_lock);
+}
+
+//compiles every file in this process on jobs threads and prints one result line per file, in input order
+static int compile_batch(const char **paths, int count, int jobs, const CompileOptions *opts)
+{
+    struct timespec start, end;
+    BatchState bs;
 
-    for (int i = 0; i < lexeme_count; i++)
+    memset(&bs, 0, sizeof(bs));
+
+    bs.opts  = opts;
+    bs.count = count;
+    bs.jobs  = jobs;
+    bs.files = calloc(count, sizeof(BatchFile));
+
+    if (!bs.files)
     {
-        //printf("This breaks dont it\n");
-        printf("Lexeme %d: %s \n", i, lexemes[i]);
+        fprintf(stderr, "Fatal: failed to allocate batch\n");
+        exit(1);
     }
 
- /*
-    for (int i = 0; i < token_count; i++)
+    for (int i = 0; i < count; i++)
+        bs.files[i].path = paths[i];
+
+    pthread_mutex_init(&bs.print_lock, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pool_run(jobs, count, compile_batch_file, &bs);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    pthread_mutex_destroy(&bs.print_lock);
+
+    //timing goes to stderr so the result listing is the same from run to run
+    printf("Batch: %d file(s), %d failed\n", count, bs.failed_count);
+    fprintf(stderr, "Batch time: %.1f ms with %d job(s)\n", elapsed_ns(&start, &end) / 1e6, jobs);
+
+    free(bs.files);
+
+    return bs.failed_count > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    setlocale(LC_ALL, "");
+
+    CompileOptions opts;
+    const char **files = NULL;
+    int file_count = 0;
+    int file_capacity = 0;
+    char *list_text = NULL;
+    int batch = 0;
+    int linking = 0;
+    int jobs = 1;
+    const char *serve_path = NULL;
+    int lsp = 0;
+    const char *client_path = NULL;
+    long requests = 1;
+    const char *cache_dir = NULL;
+    char *default_cache_dir = NULL;
+    long cache_limit = CACHE_DEFAULT_LIMIT;
+    CompileCache cache;
+    const char **forward = malloc(argc * sizeof(*forward));    // compile options a client sends on
+    int forward_count = 0;
+    int failed;
+
+    if (!forward)
     {
-        printf("Token %d: %s\n", i, tok2name(token_buffer[i].token));
+        fprintf(stderr, "Fatal: failed to allocate option list\n");
+        exit(1);
     }
 
-    */
+    init_compile_options(&opts);
+
+    for (int i = 1; i < argc; i++)
+    {
+        int known = parse_compile_option(argv[i], &opts, stderr);
+
+        if (known < 0)
+            return 1;
+
+        if (known)
+        {
+            if (strncmp(argv[i], "--output=", 9) != 0)
+                forward[forward_count++] = argv[i];
+
+            continue;
+        }
+
+        if (strcmp(argv[i], "--serve") == 0 || strncmp(argv[i], "--serve=", 8) == 0)
+        {
+            serve_path = argv[i][7] == '=' ? argv[i] + 8 : SERVE_SOCKET;
+        }
+        else if (strcmp(argv[i], "--lsp") == 0)
+        {
+            lsp = 1;
+        }
+        else if (strcmp(argv[i], "--client") == 0 || strncmp(argv[i], "--client=", 9) == 0)
+        {
+            client_path = argv[i][8] == '=' ? argv[i] + 9 : SERVE_SOCKET;
+        }
+        else if (strncmp(argv[i], "--requests=", 11) == 0)
+        {
+            char *end;
+
+            requests = strtol(argv[i] + 11, &end, 10);
+
+            if (*end != '\0' || requests < 1)
+            {
+                fprintf(stderr, "Error: --requests must be a positive number\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--cache") == 0 || strncmp(argv[i], "--cache=", 8) == 0)
+        {
+            cache_dir = argv[i][7] == '=' ? argv[i] + 8 : "";
+        }
+        else if (strncmp(argv[i], "--cache-size=", 13) == 0)
+        {
+            char *end;
+            long mb = strtol(argv[i] + 13, &end, 10);
+
+            if (*end != '\0' || mb < 1 || mb > (LONG_MAX >> 20))
+            {
+                fprintf(stderr, "Error: --cache-size must be a positive number of MB\n");
+                return 1;
+            }
+
+            cache_limit = mb << 20;
+        }
+        else if (strncmp(argv[i], "--jobs=", 7) == 0)
+        {
+            char *end;
 
-    int parse_error_count = 0;
+            jobs = (int)strtol(argv[i] + 7, &end, 10);
 
-    parser(
-        token_buffer,
-        token_count,
-        lexemes,
-        &parse_error_count
-    );
+            if (*end != '\0' || jobs < 0 || jobs > POOL_MAX_WORKERS)
+            {
+                fprintf(stderr, "Error: --jobs must be between 0 and %d\n", POOL_MAX_WORKERS);
+                return 1;
+            }
 
-    printf("\nParser finished with %d error(s)\n", parse_error_count);
+            //0: one job per processor
+            if (jobs == 0)
+                jobs = pool_processors();
+        }
+        else if (strcmp(argv[i], "--batch") == 0)
+        {
+            batch = 1;
+        }
+        else if (strcmp(argv[i], "--link") == 0)
+        {
+            linking = 1;
+        }
+        else if (strncmp(argv[i], "--batch-list", 12) == 0 && (argv[i][12] == '=' || argv[i][12] == '\0'))
+        {
+            const char *path = argv[i][12] == '=' ? argv[i] + 13 : (i + 1 < argc ? argv[++i] : NULL);
 
+            if (!path || list_text)
+            {
+                fprintf(stderr, "Error: --batch-list takes one list file\n");
+                return 1;
+            }
 
-    /* -----------------------------
-       Cleanup
-       ----------------------------- */
+            if (read_batch_list(path, &list_text, &files, &file_count, &file_capacity) != 0)
+                return 1;
 
-    for (int i = 0; i < lexeme_count; i++)
+            batch = 1;
+        }
+        else if (argv[i][0] == '-' && argv[i][1] == '-' && strncmp(argv[i], "--load-ast=", 11) != 0)
+        {
+            fprintf(stderr, "Error: Unknown option %s\n", argv[i]);
+            return 1;
+        }
+        else
+        {
+            //--load-ast=file.kast names a saved tree (astbin.h) as a plain argument would
+            const char *path = strncmp(argv[i], "--load-ast=", 11) == 0 ? argv[i] + 11 : argv[i];
+            size_t len = strlen(path);
+
+            if (path != argv[i] && (len < 5 || strcmp(path + len - 5, ".kast") != 0))
+            {
+                fprintf(stderr, "Error: --load-ast takes a .kast file\n");
+                return 1;
+            }
+
+            if (file_count == file_capacity)
+            {
+                file_capacity = file_capacity ? file_capacity * 2 : 64;
+                files = realloc(files, file_capacity * sizeof(*files));
+
+                if (!files)
+                {
+                    fprintf(stderr, "Fatal: failed to allocate batch list\n");
+                    exit(1);
+                }
+            }
+
+            files[file_count++] = path;
+        }
+    }
+
+    //the cache is the compiling process's own: a client leaves it to the server
+    if (cache_dir && !client_path)
     {
-        free(lexemes[i]);
+        if (*cache_dir == '\0')
+            cache_dir = default_cache_dir = cache_default_dir();
+
+        if (cache_open(&cache, cache_dir, cache_limit) != 0)
+        {
+            free(default_cache_dir);
+            free(forward);
+            free(files);
+            free(list_text);
+            return 1;
+        }
+
+        opts.cache = &cache;
     }
 
-    free(lexemes);
-    free(lexeme_row);
-    free(lexeme_col);
+    //every path below ends in the clean-up after it, which also closes the cache
+    if (lsp)
+    {
+        //stdout carries the protocol, so nothing else may be printed there
+        failed = serve_lsp(&opts);
+    }
+    else if (serve_path)
+    {
+        failed = serve(serve_path, &opts);
+    }
+    else if (file_count == 0)
+    {
+        fprintf(stderr, batch ? "Error: No files in batch\n" : "Error: No file specified\n");
+        failed = 1;
+    }
+    else if (file_count > 1 && !batch && !linking)
+    {
+        //a single compile takes one file; several need --batch, or --link to make one program of them
+        fprintf(stderr, "Error: %d files given; compile one at a time, or use --batch or --link\n", file_count);
+        failed = 1;
+    }
+    else if (linking && (batch || client_path))
+    {
+        fprintf(stderr, "Error: --link cannot be used with --batch or --client\n");
+        failed = 1;
+    }
+    else if (client_path)
+    {
+        failed = serve_client(client_path, files[0], forward, forward_count, opts.output, requests);
+    }
+    else if (linking)
+    {
+        //every file named is a module of one program
+        failed = link_files(files, file_count, jobs, &opts, stdout, stderr);
+    }
+    else if (batch && (opts.output || (opts.trace_events && *opts.trace_events)))
+    {
+        //one output path cannot hold every file's artifact
+        fprintf(stderr, "Error: --output and --trace-events=path cannot be used with --batch\n");
+        failed = 1;
+    }
+    else if (batch && jobs > 1 && compile_options_print(&opts))
+    {
+        //dumps and reports print straight to stdout, which only one file at a time may do
+        fprintf(stderr, "Error: dumps and reports need --jobs=1\n");
+        failed = 1;
+    }
+    else if (batch)
+    {
+        opts.listing = 0;
+        failed = compile_batch(files, file_count, jobs, &opts);
+    }
+    else
+    {
+        FileResult result;
+
+        memset(&result, 0, sizeof(result));
+        failed = compile_file(files[0], &opts, stdout, stderr, &result);
+    }
 
-    free(token_buffer);
-    free(char_buffer);
-    free(decode_buffer);
+    if (opts.cache)
+    {
+        if (batch)
+            fprintf(stderr, "Cache: %ld hit(s), %ld miss(es)\n", atomic_load(&cache.hits), atomic_load(&cache.misses));
 
-    return 0;
+        cache_close(&cache);
+    }
+
+    free(default_cache_dir);
+    free(forward);
+    free(files);
+    free(list_text);
+
+    return failed;
 }
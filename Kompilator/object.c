@@ -0,0 +1,583 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "object.h"
+
+_Static_assert(sizeof(ObjHeader) == 128, "ObjHeader must stay 128 bytes");
+_Static_assert(sizeof(ObjSymbol) == 32 && sizeof(ObjReloc) == 16 && sizeof(ObjFunc) == 32 && sizeof(ObjConst) == 16,
+               "object record layout changed: bump OBJ_VERSION and object.h");
+_Static_assert(sizeof(VmInstr) == 12, "VmInstr layout changed: bump OBJ_VERSION and object.h");
+
+static void *obj_alloc(size_t size)
+{
+    void *p = calloc(1, size ? size : 1);
+
+    if (!p)
+    {
+        fprintf(stderr, "Fatal: failed to allocate object image\n");
+        exit(1);
+    }
+
+    return p;
+}
+
+uint64_t object_name_hash(const char *name)
+{
+    return xxh64(name, strlen(name), 0);
+}
+
+
+
+/*
+  ____        _ _     _ _
+ |  _ \      (_) |   | (_)
+ | |_) |_   _ _| | __| |_ _ __   __ _
+ |  _ <| | | | | |/ _` | | '_ \ / _` |
+ | |_) | |_| | | | (_| | | | | | (_| |
+ |____/ \__,_|_|_|\__,_|_|_| |_|\__, |
+                                 __/ |
+                                |___/
+*/
+
+//the IR types of the result and the parameters, folded to 32 bits
+static uint32_t function_signature(const IrFunc *f)
+{
+    int32_t ret = (int32_t)f->ret_type;
+    uint64_t h = xxh64(&ret, sizeof(ret), (uint64_t)f->param_count);
+
+    for (int i = 0; i < f->param_count; i++)
+    {
+        int32_t type = (int32_t)f->param_types[i];
+
+        h = xxh64(&type, sizeof(type), h);
+    }
+
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+static void add_reloc(ObjModule *obj, ObjRelocKind kind, int at, int symbol, int addend)
+{
+    if (obj->reloc_count == obj->reloc_capacity)
+    {
+        obj->reloc_capacity = obj->reloc_capacity ? obj->reloc_capacity * 2 : 64;
+        obj->relocs = realloc(obj->relocs, obj->reloc_capacity * sizeof(ObjReloc));
+
+        if (!obj->relocs)
+        {
+            fprintf(stderr, "Fatal: failed to allocate object relocations\n");
+            exit(1);
+        }
+    }
+
+    obj->relocs[obj->reloc_count].kind   = kind;
+    obj->relocs[obj->reloc_count].at     = at;
+    obj->relocs[obj->reloc_count].symbol = symbol;
+    obj->relocs[obj->reloc_count].addend = addend;
+    obj->reloc_count++;
+}
+
+//the global whose storage holds data offset at, by bisection: globals are laid out in order, each at its own address
+static int global_at(const IrModule *m, const VmProgram *p, int at)
+{
+    int lo = 0;
+    int hi = m->global_count - 1;
+
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        int size = m->globals[mid].size > 0 ? m->globals[mid].size : 1;
+
+        if (at < p->global_offsets[mid])
+            hi = mid - 1;
+        else if (at >= p->global_offsets[mid] + size)
+            lo = mid + 1;
+        else
+            return mid;
+    }
+
+    return -1;
+}
+
+//a data address as symbol + addend; string literals are relative to the module's data
+static void address_of(const IrModule *m, const VmProgram *p, ObjModule *obj, int at, int *symbol, int *addend)
+{
+    int g = global_at(m, p, at);
+
+    if (g < 0)
+    {
+        *symbol = -1;
+        *addend = at;
+        return;
+    }
+
+    *symbol = m->func_count + g;
+    *addend = at - p->global_offsets[g];
+
+    if (obj->symbols[*symbol].flags & OBJ_SYM_EXTERN)
+        obj->symbols[*symbol].flags |= OBJ_SYM_USED;
+}
+
+void build_object(const IrModule *m, const VmProgram *p, ObjModule *out)
+{
+    size_t strings_size = 0;
+    size_t at = 0;
+
+    memset(out, 0, sizeof(*out));
+
+    out->program      = p;
+    out->symbol_count = m->func_count + m->global_count;
+    out->symbols      = obj_alloc(out->symbol_count * sizeof(ObjSymbol));
+
+    for (int f = 0; f < m->func_count; f++)
+        strings_size += strlen(m->funcs[f].name) + 1;
+
+    for (int g = 0; g < m->global_count; g++)
+        strings_size += strlen(m->globals[g].name) + 1;
+
+    out->strings      = obj_alloc(strings_size);
+    out->strings_size = strings_size;
+
+    for (int s = 0; s < out->symbol_count; s++)
+    {
+        ObjSymbol *sym = &out->symbols[s];
+        const char *name = (s < m->func_count) ? m->funcs[s].name : m->globals[s - m->func_count].name;
+
+        sym->name = (uint32_t)at;
+        sym->hash = object_name_hash(name);
+        strcpy(out->strings + at, name);
+        at += strlen(name) + 1;
+
+        if (s < m->func_count)
+        {
+            sym->flags     = OBJ_SYM_FUNC | (m->funcs[s].is_extern ? OBJ_SYM_EXTERN : 0);
+            sym->offset    = -1;
+            sym->signature = function_signature(&m->funcs[s]);
+        }
+        else
+        {
+            const IrGlobal *g = &m->globals[s - m->func_count];
+
+            sym->flags  = g->is_extern ? OBJ_SYM_EXTERN : (g->is_static ? OBJ_SYM_LOCAL : 0);
+            sym->offset = g->is_extern ? -1 : p->global_offsets[s - m->func_count];
+            sym->size   = g->size;
+        }
+    }
+
+    //calls and function addresses name functions by index, so only their use is recorded
+    for (int pc = 0; pc < p->code_count; pc++)
+    {
+        if (p->code[pc].op == OP_CALL || p->code[pc].op == OP_TAILCALL)
+            out->symbols[p->code[pc].imm].flags |= m->funcs[p->code[pc].imm].is_extern ? OBJ_SYM_USED : 0;
+    }
+
+    for (int c = 0; c < p->const_count; c++)
+    {
+        int symbol, addend;
+
+        if (p->consts[c].kind == VM_CONST_FUNC)
+        {
+            symbol = (int)p->consts[c].value.i - 1;
+            out->symbols[symbol].flags |= m->funcs[symbol].is_extern ? OBJ_SYM_USED : 0;
+        }
+        else if (p->consts[c].kind == VM_CONST_DATA)
+        {
+            address_of(m, p, out, (int)p->consts[c].value.i, &symbol, &addend);
+            add_reloc(out, OBJ_RELOC_CONST, c, symbol, addend);
+        }
+    }
+
+    for (int i = 0; i < p->fixup_count; i++)
+    {
+        int symbol, addend;
+
+        address_of(m, p, out, p->fixups[i].target, &symbol, &addend);
+        add_reloc(out, OBJ_RELOC_DATA, p->fixups[i].at, symbol, addend);
+    }
+
+    for (int r = 0; r < m->reloc_count; r++)
+    {
+        const IrReloc *rel = &m->relocs[r];
+
+        if (rel->kind != IR_RELOC_FUNC)
+            continue;
+
+        add_reloc(out, OBJ_RELOC_DATA_FUNC, p->global_offsets[rel->global] + rel->offset, rel->target, 0);
+        out->symbols[rel->target].flags |= m->funcs[rel->target].is_extern ? OBJ_SYM_USED : 0;
+    }
+}
+
+void free_object(ObjModule *obj)
+{
+    free(obj->symbols);
+    free(obj->relocs);
+    free(obj->strings);
+
+    memset(obj, 0, sizeof(*obj));
+}
+
+
+
+/*
+ __          __   _ _   _
+ \ \        / /  (_) | (_)
+  \ \  /\  / / __ _| |_ _ _ __   __ _
+   \ \/  \/ / '__| | __| | '_ \ / _` |
+    \  /\  /| |  | | |_| | | | | (_| |
+     \/  \/ |_|  |_|\__|_|_| |_|\__, |
+                                 __/ |
+                                |___/
+*/
+
+static uint64_t align8(uint64_t n)
+{
+    return (n + 7) & ~(uint64_t)7;
+}
+
+static int write_padding(FILE *out, uint64_t *at, uint64_t to)
+{
+    static const char zeros[8];
+
+    if (to > *at && fwrite(zeros, 1, to - *at, out) != to - *at)
+        return 1;
+
+    *at = to;
+    return 0;
+}
+
+static int write_section(FILE *out, uint64_t *at, uint64_t offset, const void *data, size_t size)
+{
+    if (write_padding(out, at, offset) != 0 || (size > 0 && fwrite(data, 1, size, out) != size))
+        return 1;
+
+    *at += size;
+    return 0;
+}
+
+int write_object(const ObjModule *obj, FILE *out)
+{
+    const VmProgram *p = obj->program;
+    ObjHeader h;
+    ObjFunc *funcs = obj_alloc(p->func_count * sizeof(ObjFunc));
+    ObjConst *consts = obj_alloc(p->const_count * sizeof(ObjConst));
+    uint64_t at = 0;
+    int failed;
+
+    //records are copied field by field, so padding in memory never reaches the file
+    for (int f = 0; f < p->func_count; f++)
+    {
+        funcs[f].code_start    = p->funcs[f].code_start;
+        funcs[f].code_length   = p->funcs[f].code_length;
+        funcs[f].arg_start     = p->funcs[f].arg_start;
+        funcs[f].param_count   = p->funcs[f].param_count;
+        funcs[f].reg_count     = p->funcs[f].reg_count;
+        funcs[f].frame_size    = p->funcs[f].frame_size;
+        funcs[f].returns_value = p->funcs[f].returns_value;
+    }
+
+    for (int c = 0; c < p->const_count; c++)
+    {
+        consts[c].kind  = (int32_t)p->consts[c].kind;
+        consts[c].value = p->consts[c].value.u;
+    }
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, OBJ_MAGIC, sizeof(h.magic));
+    h.version      = OBJ_VERSION;
+    h.symbol_count = (uint32_t)obj->symbol_count;
+    h.reloc_count  = (uint32_t)obj->reloc_count;
+    h.func_count   = (uint32_t)p->func_count;
+    h.code_count   = (uint32_t)p->code_count;
+    h.const_count  = (uint32_t)p->const_count;
+    h.arg_count    = (uint32_t)p->arg_count;
+    h.data_size    = (uint32_t)p->data_size;
+    h.strings      = sizeof(h);
+    h.strings_size = obj->strings_size;
+    h.symbols      = align8(h.strings + h.strings_size);
+    h.relocs       = align8(h.symbols + (uint64_t)obj->symbol_count * sizeof(ObjSymbol));
+    h.funcs        = align8(h.relocs + (uint64_t)obj->reloc_count * sizeof(ObjReloc));
+    h.code         = align8(h.funcs + (uint64_t)p->func_count * sizeof(ObjFunc));
+    h.consts       = align8(h.code + (uint64_t)p->code_count * sizeof(VmInstr));
+    h.args         = align8(h.consts + (uint64_t)p->const_count * sizeof(ObjConst));
+    h.data         = align8(h.args + (uint64_t)p->arg_count * sizeof(uint16_t));
+    h.file_size    = h.data + (uint64_t)p->data_size;
+
+    failed = write_section(out, &at, 0, &h, sizeof(h)) ||
+             write_section(out, &at, h.strings, obj->strings, obj->strings_size) ||
+             write_section(out, &at, h.symbols, obj->symbols, (size_t)obj->symbol_count * sizeof(ObjSymbol)) ||
+             write_section(out, &at, h.relocs, obj->relocs, (size_t)obj->reloc_count * sizeof(ObjReloc)) ||
+             write_section(out, &at, h.funcs, funcs, (size_t)p->func_count * sizeof(ObjFunc)) ||
+             write_section(out, &at, h.code, p->code, (size_t)p->code_count * sizeof(VmInstr)) ||
+             write_section(out, &at, h.consts, consts, (size_t)p->const_count * sizeof(ObjConst)) ||
+             write_section(out, &at, h.args, p->args, (size_t)p->arg_count * sizeof(uint16_t)) ||
+             write_section(out, &at, h.data, p->data, (size_t)p->data_size);
+
+    free(funcs);
+    free(consts);
+
+    return failed;
+}
+
+
+
+/*
+  _                     _ _
+ | |                   | (_)
+ | |     ___   __ _  __| |_ _ __   __ _
+ | |    / _ \ / _` |/ _` | | '_ \ / _` |
+ | |___| (_) | (_| | (_| | | | | | (_| |
+ |______\___/ \__,_|\__,_|_|_| |_|\__, |
+                                   __/ |
+                                  |___/
+*/
+
+//a section of count items of size bytes lies inside the file, aligned for its type
+static int section_fits(const ObjHeader *h, uint64_t offset, uint64_t count, uint64_t size, uint64_t align)
+{
+    return offset >= sizeof(*h) && offset % align == 0 && offset <= h->file_size &&
+           count <= (h->file_size - offset) / size;
+}
+
+static int is_jump(int op)
+{
+    return op == OP_JMP || op == OP_BRNZ || op == OP_BRZ || (op >= OP_BEQ && op <= OP_BUGEK);
+}
+
+//every index an instruction of function f holds is inside the function or the module
+static int instr_ok(const ObjFile *file, const ObjFunc *f, int pc)
+{
+    const ObjHeader *h = file->header;
+    const VmInstr *in = &file->code[pc];
+    int end = f->code_start + f->code_length;
+    int is_call = (in->op == OP_CALL || in->op == OP_TAILCALL);
+
+    if (in->op >= OP_COUNT)
+        return 0;
+
+    //register fields: unused ones are 0, which every function has
+    if ((in->dst >= f->reg_count && !(is_call && in->dst == VM_NO_REG)) ||
+        (in->a >= f->reg_count && !is_call) ||
+        (in->b >= f->reg_count && !is_call && !(in->op >= OP_BEQK && in->op <= OP_BUGEK)))
+        return 0;
+
+    if (is_jump(in->op) && (in->imm < f->code_start || in->imm >= end))
+        return 0;
+
+    if (in->op >= OP_BEQK && in->op <= OP_BUGEK && in->b >= h->const_count)
+        return 0;
+
+    if (in->op == OP_CONST && (in->imm < 0 || (uint32_t)in->imm >= h->const_count))
+        return 0;
+
+    if (in->op == OP_SWITCH && (in->imm < 0 || in->imm >= end - pc - 1))
+        return 0;
+
+    if (is_call)
+    {
+        if (in->imm < 0 || (uint32_t)in->imm >= h->func_count ||
+            (uint64_t)f->arg_start + in->a + in->b > h->arg_count)
+            return 0;
+
+        for (int k = 0; k < in->b; k++)
+        {
+            if (file->args[f->arg_start + in->a + k] >= f->reg_count)
+                return 0;
+        }
+    }
+
+    return 1;
+}
+
+//every index in the file is in range, so the linker and the VM can trust them
+static int check_object(const ObjFile *file, FILE *err)
+{
+    const ObjHeader *h = file->header;
+
+    for (uint32_t s = 0; s < h->symbol_count; s++)
+    {
+        const ObjSymbol *sym = &file->symbols[s];
+        int is_func = (sym->flags & OBJ_SYM_FUNC) != 0;
+
+        if (sym->name >= h->strings_size || is_func != (s < h->func_count) ||
+            (!is_func && !(sym->flags & OBJ_SYM_EXTERN) &&
+             (sym->offset < 0 || sym->size < 0 || (uint64_t)sym->offset + sym->size > h->data_size)))
+        {
+            fprintf(err, "Error: %s: symbol %u is out of range\n", file->name, s);
+            return 1;
+        }
+    }
+
+    for (uint32_t fi = 0; fi < h->func_count; fi++)
+    {
+        const ObjFunc *f = &file->funcs[fi];
+
+        if (f->code_start < 0 || f->code_length < 0 || (uint64_t)f->code_start + f->code_length > h->code_count ||
+            f->arg_start < 0 || (uint32_t)f->arg_start > h->arg_count || f->reg_count < 1 ||
+            f->reg_count >= VM_NO_REG || f->param_count < 0 || f->param_count > f->reg_count || f->frame_size < 0 ||
+            ((file->symbols[fi].flags & OBJ_SYM_EXTERN) && f->code_length != 0))
+        {
+            fprintf(err, "Error: %s: function %s is out of range\n", file->name, file->strings + file->symbols[fi].name);
+            return 1;
+        }
+
+        for (int pc = f->code_start; pc < f->code_start + f->code_length; pc++)
+        {
+            if (!instr_ok(file, f, pc))
+            {
+                fprintf(err, "Error: %s: instruction %d of %s is out of range\n", file->name, pc,
+                        file->strings + file->symbols[fi].name);
+                return 1;
+            }
+        }
+    }
+
+    for (uint32_t c = 0; c < h->const_count; c++)
+    {
+        const ObjConst *k = &file->consts[c];
+
+        if (k->kind < VM_CONST_VALUE || k->kind > VM_CONST_FUNC ||
+            (k->kind == VM_CONST_DATA && k->value > h->data_size) ||
+            (k->kind == VM_CONST_FUNC && (k->value < 1 || k->value > h->func_count)))
+        {
+            fprintf(err, "Error: %s: constant %u is out of range\n", file->name, c);
+            return 1;
+        }
+    }
+
+    for (uint32_t r = 0; r < h->reloc_count; r++)
+    {
+        const ObjReloc *rel = &file->relocs[r];
+        const ObjSymbol *sym = (rel->symbol >= 0 && (uint32_t)rel->symbol < h->symbol_count) ? &file->symbols[rel->symbol] : NULL;
+        int ok = (rel->symbol == -1 || sym);
+
+        switch (rel->kind)
+        {
+            case OBJ_RELOC_CONST:
+                ok = ok && rel->at >= 0 && (uint32_t)rel->at < h->const_count && file->consts[rel->at].kind == VM_CONST_DATA;
+                break;
+
+            case OBJ_RELOC_DATA:
+            case OBJ_RELOC_DATA_FUNC:
+                ok = ok && rel->at >= 0 && (uint64_t)rel->at + 8 <= h->data_size;
+                break;
+
+            default:
+                ok = 0;
+                break;
+        }
+
+        //a function word names a function; an address is in the module's data or inside a global
+        if (rel->kind == OBJ_RELOC_DATA_FUNC)
+            ok = ok && sym && (sym->flags & OBJ_SYM_FUNC);
+        else if (sym)
+            ok = ok && !(sym->flags & OBJ_SYM_FUNC) && rel->addend >= 0 && rel->addend <= sym->size;
+        else
+            ok = ok && rel->addend >= 0 && (uint32_t)rel->addend <= h->data_size;
+
+        if (!ok)
+        {
+            fprintf(err, "Error: %s: relocation %u is out of range\n", file->name, r);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int open_object_image(const char *name, const void *image, size_t size, ObjFile *file, FILE *err)
+{
+    const char *base = image;
+    const ObjHeader *h = image;
+
+    memset(file, 0, sizeof(*file));
+    file->name = name;
+    file->size = size;
+
+    if (size < sizeof(ObjHeader) || memcmp(h->magic, OBJ_MAGIC, sizeof(h->magic)) != 0 || h->version != OBJ_VERSION ||
+        h->file_size != size || h->symbol_count > INT32_MAX || h->reloc_count > INT32_MAX ||
+        h->func_count > h->symbol_count || h->code_count > INT32_MAX || h->const_count > INT32_MAX ||
+        h->arg_count > INT32_MAX || h->data_size > INT32_MAX ||
+        !section_fits(h, h->strings, h->strings_size, 1, 1) ||
+        !section_fits(h, h->symbols, h->symbol_count, sizeof(ObjSymbol), 8) ||
+        !section_fits(h, h->relocs, h->reloc_count, sizeof(ObjReloc), 4) ||
+        !section_fits(h, h->funcs, h->func_count, sizeof(ObjFunc), 4) ||
+        !section_fits(h, h->code, h->code_count, sizeof(VmInstr), 4) ||
+        !section_fits(h, h->consts, h->const_count, sizeof(ObjConst), 8) ||
+        !section_fits(h, h->args, h->arg_count, sizeof(uint16_t), 2) ||
+        !section_fits(h, h->data, h->data_size, 1, 1) ||
+        (h->strings_size > 0 && base[h->strings + h->strings_size - 1] != '\0'))
+    {
+        fprintf(err, "Error: %s is not a version %d .kobj file\n", name, OBJ_VERSION);
+        return 1;
+    }
+
+    file->header  = h;
+    file->strings = base + h->strings;
+    file->symbols = (const ObjSymbol *)(base + h->symbols);
+    file->relocs  = (const ObjReloc *)(base + h->relocs);
+    file->funcs   = (const ObjFunc *)(base + h->funcs);
+    file->code    = (const VmInstr *)(base + h->code);
+    file->consts  = (const ObjConst *)(base + h->consts);
+    file->args    = (const uint16_t *)(base + h->args);
+    file->data    = (const unsigned char *)(base + h->data);
+
+    return check_object(file, err);
+}
+
+int load_object(const char *path, ObjFile *file, FILE *err)
+{
+    struct stat st;
+    void *map;
+    int fd = open(path, O_RDONLY);
+
+    memset(file, 0, sizeof(*file));
+
+    if (fd < 0)
+    {
+        fprintf(err, "Error: Could not open %s\n", path);
+        return 1;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ObjHeader))
+    {
+        fprintf(err, "Error: %s is not a .kobj file\n", path);
+        close(fd);
+        return 1;
+    }
+
+    //read-only: the linker copies what it rewrites
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+    {
+        fprintf(err, "Error: Could not map %s\n", path);
+        return 1;
+    }
+
+    if (open_object_image(path, map, st.st_size, file, err) != 0)
+    {
+        munmap(map, st.st_size);
+        memset(file, 0, sizeof(*file));
+        return 1;
+    }
+
+    file->map = map;
+
+    return 0;
+}
+
+void close_object(ObjFile *file)
+{
+    if (file->map)
+        munmap(file->map, file->size);
+
+    memset(file, 0, sizeof(*file));
+}
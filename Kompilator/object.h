@@ -0,0 +1,189 @@
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ir.h"
+#include "bytecode.h"
+
+/* ---------------------------------------------
+   Object files (.kobj)
+
+   kom --emit=obj writes one module's bytecode
+   with what the linker (link.h) needs to join
+   it to others: a symbol for every function
+   and global, and a relocation for every
+   constant and data word that holds an
+   address. Like a .kast file it is mapped and
+   read in place: every section starts on an
+   8-byte boundary and refers to others by
+   index or offset. Little-endian throughout.
+
+     header     ObjHeader, 128 bytes
+     strings    symbol names, NUL-terminated
+     symbols    ObjSymbol per symbol, 32 bytes
+     relocs     ObjReloc per relocation, 16 bytes
+     funcs      ObjFunc per function, 32 bytes
+     code       VmInstr per instruction, 12 bytes
+     consts     ObjConst per pool entry, 16 bytes
+     args       uint16 per CALL argument
+     data       the initial data image
+
+   Symbol i below func_count is function i; the
+   globals follow. A symbol is defined here,
+   EXTERN (declared here, defined by another
+   module) or local (STATISK, and static
+   locals: only this module's relocations name
+   it). Each carries the xxh64 of its name, so
+   names are compared only when hashes meet,
+   and a function carries a signature, a hash
+   of the IR types of its result and
+   parameters, that must agree between a
+   declaration and its definition, as a
+   global's size must.
+
+   Function indices need no relocations: CALL
+   and TAILCALL imm and VM_CONST_FUNC constants
+   name the module's own functions, which are
+   its first symbols. Jump targets count from
+   the module's first instruction, CALL.a from
+   its function's arg_start.
+
+   A relocation says which address a constant
+   or a data word holds:
+
+     CONST      consts[at] is symbol + addend
+     DATA       the 8 bytes at data + at hold
+                symbol + addend
+     DATA_FUNC  the 8 bytes at data + at hold
+                function symbol's index + 1
+
+   Symbol -1 is the module's own data (string
+   literals), the addend then being the offset.
+   A linked program is written the same way,
+   its definitions still exported, so it can
+   be linked again as one module.
+
+   A new layout gets a new OBJ_VERSION;
+   readers refuse any other.
+--------------------------------------------- */
+
+#define OBJ_MAGIC    "KOMOBJ\r\n"
+#define OBJ_VERSION  1
+
+#define OBJ_SYM_FUNC    1u      // a function; otherwise a global
+#define OBJ_SYM_EXTERN  2u      // declared only; another module defines it
+#define OBJ_SYM_LOCAL   4u      // defined, but not visible to other modules
+#define OBJ_SYM_USED    8u      // an EXTERN symbol this module's code or data refers to
+
+typedef enum ObjRelocKind {
+    OBJ_RELOC_CONST,
+    OBJ_RELOC_DATA,
+    OBJ_RELOC_DATA_FUNC
+} ObjRelocKind;
+
+typedef struct ObjHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t symbol_count;
+    uint32_t reloc_count;
+    uint32_t func_count;
+    uint32_t code_count;
+    uint32_t const_count;
+    uint32_t arg_count;
+    uint32_t data_size;
+    uint32_t reserved[2];
+    uint64_t file_size;
+    uint64_t strings;           // section offsets from the start of the file
+    uint64_t strings_size;
+    uint64_t symbols;
+    uint64_t relocs;
+    uint64_t funcs;
+    uint64_t code;
+    uint64_t consts;
+    uint64_t args;
+    uint64_t data;
+} ObjHeader;
+
+typedef struct ObjSymbol {
+    uint64_t hash;              // xxh64 of the name
+    uint32_t name;              // offset into strings
+    uint32_t flags;             // OBJ_SYM_*
+    int32_t  offset;            // a global's place in data, -1 for functions and EXTERN globals
+    int32_t  size;              // a global's size in bytes
+    uint32_t signature;         // a function's result and parameter types
+    uint32_t reserved;
+} ObjSymbol;
+
+typedef struct ObjReloc {
+    int32_t  kind;              // ObjRelocKind
+    int32_t  at;                // constant index or data offset
+    int32_t  symbol;            // -1: this module's data
+    int32_t  addend;
+} ObjReloc;
+
+typedef struct ObjFunc {
+    int32_t  code_start;
+    int32_t  code_length;
+    int32_t  arg_start;
+    int32_t  param_count;
+    int32_t  reg_count;
+    int32_t  frame_size;
+    int32_t  returns_value;
+    int32_t  reserved;
+} ObjFunc;
+
+typedef struct ObjConst {
+    int32_t  kind;              // VmConstKind
+    int32_t  reserved;
+    uint64_t value;
+} ObjConst;
+
+//a module to write: a program and the symbols and relocations that go with it
+typedef struct ObjModule {
+    const VmProgram *program;   // function names are the symbol names
+    ObjSymbol       *symbols;
+    int              symbol_count;
+    ObjReloc        *relocs;
+    int              reloc_count;
+    int              reloc_capacity;
+    char            *strings;
+    size_t           strings_size;
+} ObjModule;
+
+//an object read from a file, or from memory; the sections point into it
+typedef struct ObjFile {
+    const char      *name;
+    void            *map;       // NULL when the image is not a mapping
+    size_t           size;
+    const ObjHeader *header;
+    const char      *strings;
+    const ObjSymbol *symbols;
+    const ObjReloc  *relocs;
+    const ObjFunc   *funcs;
+    const VmInstr   *code;
+    const ObjConst  *consts;
+    const uint16_t  *args;
+    const unsigned char *data;
+} ObjFile;
+
+// the symbols and relocations of a module compiled to p; free with free_object
+void build_object(const IrModule *m, const VmProgram *p, ObjModule *out);
+void free_object(ObjModule *obj);
+
+// writes obj as a .kobj image; returns 0, or 1 if it could not be written
+int  write_object(const ObjModule *obj, FILE *out);
+
+/* maps path as a .kobj file, or reads one from memory (which must stay alive and
+   8-byte aligned), and checks every index in it; returns 1 after printing to err
+   if it is unusable */
+int  load_object(const char *path, ObjFile *file, FILE *err);
+int  open_object_image(const char *name, const void *image, size_t size, ObjFile *file, FILE *err);
+void close_object(ObjFile *file);
+
+// xxh64 of a symbol name
+uint64_t object_name_hash(const char *name);
+
+#endif /* OBJECT_H */
@@ -0,0 +1,1295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opt.h"
+#include "inline.h"
+#include "tail.h"
+#include "loop.h"
+
+static void *opt_alloc(size_t count, size_t size, const char *what)
+{
+    void *ptr = calloc(count + 1, size);
+
+    if (!ptr)
+    {
+        fprintf(stderr, "Fatal: failed to allocate %s\n", what);
+        exit(1);
+    }
+
+    return ptr;
+}
+
+//operands of an instruction as one sequence: a, b, then args; IR_NONE where absent
+static int operand_count(const IrInstr *in)
+{
+    return 2 + in->nargs;
+}
+
+static int operand_at(const IrFunc *f, const IrInstr *in, int k)
+{
+    if (k == 0)
+        return in->a;
+    if (k == 1)
+        return in->b;
+
+    return f->operands[in->args + k - 2];
+}
+
+static int count_instrs(const IrFunc *f)
+{
+    int count = 0;
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+            count++;
+    }
+
+    return count;
+}
+
+
+
+/*
+   _____  _____ _____ _____
+  / ____|/ ____/ ____|  __ \
+ | (___ | |   | |    | |__) |
+  \___ \| |   | |    |  ___/
+  ____) | |___| |____| |
+ |_____/ \_____\_____|_|
+*/
+
+typedef enum LatticeKind {
+    LAT_UNKNOWN,        // no executable definition seen yet
+    LAT_CONST,
+    LAT_VARYING
+} LatticeKind;
+
+typedef struct Lattice {
+    LatticeKind kind;
+    long long   imm;
+    double      fimm;
+} Lattice;
+
+typedef struct SccpState {
+    IrFunc   *f;
+    Lattice  *value;        // per instruction
+
+    char     *live_block;
+    char     *live_edge;    // per successor of each terminator
+    int      *edge_start;   // edges of block b start at live_edge[edge_start[b]]
+
+    int      *use_start;    // users of v are uses[use_start[v] .. use_start[v + 1])
+    int      *uses;
+
+    int      *block_work;
+    int       block_work_count;
+    int      *value_work;
+    int       value_work_count;
+} SccpState;
+
+static Lattice lattice(LatticeKind kind)
+{
+    Lattice l;
+
+    l.kind = kind;
+    l.imm  = 0;
+    l.fimm = 0.0;
+
+    return l;
+}
+
+static Lattice int_constant(IrType type, long long value)
+{
+    Lattice l = lattice(LAT_CONST);
+
+    l.imm = ir_wrap_int(type, value);
+    return l;
+}
+
+static Lattice float_constant(IrType type, double value)
+{
+    Lattice l = lattice(LAT_CONST);
+
+    l.fimm = (type == IRT_F32) ? (double)(float)value : value;
+    return l;
+}
+
+static int same_constant(const Lattice *x, const Lattice *y)
+{
+    return x->imm == y->imm && memcmp(&x->fimm, &y->fimm, sizeof(double)) == 0;
+}
+
+static Lattice meet(Lattice x, Lattice y)
+{
+    if (x.kind == LAT_UNKNOWN)
+        return y;
+    if (y.kind == LAT_UNKNOWN)
+        return x;
+    if (x.kind == LAT_VARYING || y.kind == LAT_VARYING || !same_constant(&x, &y))
+        return lattice(LAT_VARYING);
+
+    return x;
+}
+
+//the value as an unsigned number of its width
+static unsigned long long unsigned_of(IrType type, long long value)
+{
+    int bits = ir_type_size(type) * 8;
+
+    if (bits <= 0 || bits >= 64)
+        return (unsigned long long)value;
+
+    return (unsigned long long)value & ((1ULL << bits) - 1);
+}
+
+static int compare(IrOp op, IrType type, const Lattice *x, const Lattice *y)
+{
+    if (ir_type_is_float(type))
+    {
+        switch (op)
+        {
+            case IR_EQ: return x->fimm == y->fimm;
+            case IR_NE: return x->fimm != y->fimm;
+            case IR_LT: return x->fimm <  y->fimm;
+            case IR_LE: return x->fimm <= y->fimm;
+            case IR_GT: return x->fimm >  y->fimm;
+            default:    return x->fimm >= y->fimm;
+        }
+    }
+
+    return ir_compare_ints(op, type, x->imm, y->imm);
+}
+
+//folds one operation on constant operands; VARYING where the result is only known at run time
+static Lattice fold(const IrFunc *f, const IrInstr *in, const Lattice *x, const Lattice *y)
+{
+    IrType t = in->type;
+    IrType from = (in->a != IR_NONE) ? f->instrs[in->a].type : IRT_VOID;
+    int bits = ir_type_size(t) * 8;
+    unsigned long long ux = (unsigned long long)x->imm;
+    unsigned long long uy = y ? (unsigned long long)y->imm : 0;
+
+    if (ir_type_is_float(t))
+    {
+        switch (in->op)
+        {
+            case IR_ADD:   return float_constant(t, x->fimm + y->fimm);
+            case IR_SUB:   return float_constant(t, x->fimm - y->fimm);
+            case IR_MUL:   return float_constant(t, x->fimm * y->fimm);
+            case IR_DIV:   return float_constant(t, x->fimm / y->fimm);
+            case IR_NEG:   return float_constant(t, -x->fimm);
+            case IR_ITOF:  return float_constant(t, (double)x->imm);
+            case IR_UTOF:  return float_constant(t, (double)unsigned_of(from, x->imm));
+            case IR_FCONV: return float_constant(t, x->fimm);
+            case IR_COPY:  return float_constant(t, x->fimm);
+            default:       return lattice(LAT_VARYING);
+        }
+    }
+
+    switch (in->op)
+    {
+        case IR_ADD: return int_constant(t, (long long)(ux + uy));
+        case IR_SUB: return int_constant(t, (long long)(ux - uy));
+        case IR_MUL: return int_constant(t, (long long)(ux * uy));
+        case IR_AND: return int_constant(t, x->imm & y->imm);
+        case IR_OR:  return int_constant(t, x->imm | y->imm);
+        case IR_XOR: return int_constant(t, x->imm ^ y->imm);
+        case IR_NEG: return int_constant(t, (long long)(0 - ux));
+        case IR_NOT: return int_constant(t, ~x->imm);
+
+        //a zero divisor stays for the run-time error; -1 wraps instead of trapping
+        case IR_DIV:
+        case IR_MOD:
+            if (y->imm == 0)
+                return lattice(LAT_VARYING);
+            if (y->imm == -1)
+                return int_constant(t, (in->op == IR_DIV) ? (long long)(0 - ux) : 0);
+            return int_constant(t, (in->op == IR_DIV) ? x->imm / y->imm : x->imm % y->imm);
+
+        case IR_UDIV:
+        case IR_UMOD:
+            if (unsigned_of(t, y->imm) == 0)
+                return lattice(LAT_VARYING);
+            ux = unsigned_of(t, x->imm);
+            uy = unsigned_of(t, y->imm);
+            return int_constant(t, (long long)((in->op == IR_UDIV) ? ux / uy : ux % uy));
+
+        //counts outside the width behave differently per back end
+        case IR_SHL:
+        case IR_SHR:
+        case IR_USHR:
+            if (y->imm < 0 || y->imm >= bits)
+                return lattice(LAT_VARYING);
+            if (in->op == IR_SHL)
+                return int_constant(t, (long long)(ux << y->imm));
+            if (in->op == IR_SHR)
+                return int_constant(t, x->imm >> y->imm);
+            return int_constant(t, (long long)(unsigned_of(t, x->imm) >> y->imm));
+
+        case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+        case IR_ULT: case IR_ULE: case IR_UGT: case IR_UGE:
+            return int_constant(t, compare(in->op, from, x, y));
+
+        case IR_SEXT:
+        case IR_COPY:
+            return int_constant(t, x->imm);
+
+        case IR_ZEXT:
+            return int_constant(t, (long long)unsigned_of(from, x->imm));
+
+        case IR_TRUNC:
+            return int_constant(t, x->imm);
+
+        //only values the target type can hold; the rest is up to the hardware
+        case IR_FTOI:
+        {
+            double limit = (bits >= 64) ? 9223372036854775808.0 : (double)(1ULL << (bits - 1));
+
+            if (!(x->fimm > -limit - 1.0 && x->fimm < limit))
+                return lattice(LAT_VARYING);
+
+            return int_constant(t, (long long)x->fimm);
+        }
+
+        default:
+            return lattice(LAT_VARYING);
+    }
+}
+
+static int edge_is_live(const SccpState *s, int from, int to)
+{
+    const int *succ;
+    int n = ir_successors(s->f, from, &succ);
+
+    for (int t = 0; t < n; t++)
+    {
+        if (succ[t] == to && s->live_edge[s->edge_start[from] + t])
+            return 1;
+    }
+
+    return 0;
+}
+
+static Lattice evaluate(const SccpState *s, int i)
+{
+    const IrFunc *f = s->f;
+    const IrInstr *in = &f->instrs[i];
+
+    switch (in->op)
+    {
+        case IR_CONST:
+            return ir_type_is_float(in->type) ? float_constant(in->type, in->fimm) : int_constant(in->type, in->imm);
+
+        case IR_UNDEF:
+            return ir_type_is_float(in->type) ? float_constant(in->type, 0.0) : int_constant(in->type, 0);
+
+        case IR_PHI:
+        {
+            const IrBlock *blk = &f->blocks[in->block];
+            Lattice result = lattice(LAT_UNKNOWN);
+
+            for (int k = 0; k < in->nargs && k < blk->pred_count; k++)
+            {
+                if (edge_is_live(s, blk->preds[k], in->block))
+                    result = meet(result, s->value[f->operands[in->args + k]]);
+            }
+
+            return result;
+        }
+
+        case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_UDIV:
+        case IR_MOD: case IR_UMOD: case IR_AND: case IR_OR: case IR_XOR:
+        case IR_SHL: case IR_SHR: case IR_USHR:
+        case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+        case IR_ULT: case IR_ULE: case IR_UGT: case IR_UGE:
+        {
+            Lattice x = s->value[in->a];
+            Lattice y = s->value[in->b];
+
+            if (x.kind == LAT_UNKNOWN || y.kind == LAT_UNKNOWN)
+                return lattice(LAT_UNKNOWN);
+            if (x.kind == LAT_VARYING || y.kind == LAT_VARYING)
+                return lattice(LAT_VARYING);
+
+            return fold(f, in, &x, &y);
+        }
+
+        case IR_NEG: case IR_NOT:
+        case IR_SEXT: case IR_ZEXT: case IR_TRUNC: case IR_ITOF: case IR_UTOF:
+        case IR_FTOI: case IR_FCONV: case IR_COPY:
+        {
+            Lattice x = s->value[in->a];
+
+            if (x.kind != LAT_CONST)
+                return x;
+
+            return fold(f, in, &x, NULL);
+        }
+
+        default:
+            return lattice(LAT_VARYING);
+    }
+}
+
+//values only ever move down: UNKNOWN -> CONST -> VARYING
+static void lower_value(SccpState *s, int i, Lattice value)
+{
+    Lattice *old = &s->value[i];
+
+    if (old->kind == LAT_VARYING || value.kind == LAT_UNKNOWN)
+        return;
+
+    if (old->kind == LAT_CONST)
+    {
+        if (value.kind == LAT_CONST && same_constant(old, &value))
+            return;
+
+        value = lattice(LAT_VARYING);
+    }
+
+    *old = value;
+    s->value_work[s->value_work_count++] = i;
+}
+
+static void visit(SccpState *s, int i);
+
+static void mark_edge(SccpState *s, int block, int t)
+{
+    const int *targets;
+    int succ;
+
+    ir_successors(s->f, block, &targets);
+    succ = targets[t];
+
+    if (s->live_edge[s->edge_start[block] + t])
+        return;
+
+    s->live_edge[s->edge_start[block] + t] = 1;
+
+    if (!s->live_block[succ])
+    {
+        s->live_block[succ] = 1;
+        s->block_work[s->block_work_count++] = succ;
+        return;
+    }
+
+    //a new way into a visited block only changes its phis
+    for (int i = s->f->blocks[succ].first; i != IR_NONE && s->f->instrs[i].op == IR_PHI; i = s->f->instrs[i].next)
+        visit(s, i);
+}
+
+static void visit(SccpState *s, int i)
+{
+    const IrInstr *in = &s->f->instrs[i];
+
+    if (in->block == IR_NONE || !s->live_block[in->block])
+        return;
+
+    if (in->op == IR_JMP)
+    {
+        mark_edge(s, in->block, 0);
+        return;
+    }
+
+    if (in->op == IR_BR)
+    {
+        Lattice cond = s->value[in->a];
+
+        if (cond.kind == LAT_VARYING || (cond.kind == LAT_CONST && cond.imm != 0))
+            mark_edge(s, in->block, 0);
+        if (cond.kind == LAT_VARYING || (cond.kind == LAT_CONST && cond.imm == 0))
+            mark_edge(s, in->block, 1);
+        return;
+    }
+
+    if (in->op == IR_SWITCH)
+    {
+        Lattice index = s->value[in->a];
+        int count = s->f->cases[in->imm];
+
+        if (index.kind == LAT_CONST)
+            mark_edge(s, in->block, ir_switch_successor(s->f, i, index.imm));
+        else if (index.kind == LAT_VARYING)
+        {
+            for (int t = 0; t < count; t++)
+                mark_edge(s, in->block, t);
+        }
+        return;
+    }
+
+    if (ir_defines_value(in))
+        lower_value(s, i, evaluate(s, i));
+}
+
+static void build_uses(SccpState *s)
+{
+    IrFunc *f = s->f;
+    int n = f->instr_count;
+
+    s->use_start = opt_alloc((size_t)n + 1, sizeof(int), "use lists");
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+        {
+            for (int k = 0; k < operand_count(&f->instrs[i]); k++)
+            {
+                int v = operand_at(f, &f->instrs[i], k);
+
+                if (v != IR_NONE)
+                    s->use_start[v + 1]++;
+            }
+        }
+    }
+
+    for (int v = 0; v < n; v++)
+        s->use_start[v + 1] += s->use_start[v];
+
+    int *fill = opt_alloc((size_t)n, sizeof(int), "use lists");
+
+    s->uses = opt_alloc((size_t)s->use_start[n], sizeof(int), "use lists");
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+        {
+            for (int k = 0; k < operand_count(&f->instrs[i]); k++)
+            {
+                int v = operand_at(f, &f->instrs[i], k);
+
+                if (v != IR_NONE)
+                    s->uses[s->use_start[v] + fill[v]++] = i;
+            }
+        }
+    }
+
+    free(fill);
+}
+
+//rewrites what the lattice proved; returns the number of changes
+static int apply_constants(SccpState *s, OptStats *stats)
+{
+    IrFunc *f = s->f;
+    int n = f->instr_count;
+    int *replace = NULL;
+    int changes = 0;
+    int folded_branches = 0;
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        if (!s->live_block[b])
+            continue;
+
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+        {
+            IrInstr *in = &f->instrs[i];
+            Lattice v;
+
+            if (i >= n)
+                continue;
+
+            if (in->op == IR_BR && s->value[in->a].kind == LAT_CONST)
+            {
+                in->target[0] = in->target[s->value[in->a].imm != 0 ? 0 : 1];
+                in->target[1] = IR_NONE;
+                in->op = IR_JMP;
+                in->a  = IR_NONE;
+                folded_branches++;
+                continue;
+            }
+
+            if (in->op == IR_SWITCH && s->value[in->a].kind == LAT_CONST)
+            {
+                int t = ir_switch_successor(f, i, s->value[in->a].imm);
+
+                in->target[0] = f->cases[in->imm + 1 + t];
+                in->op  = IR_JMP;
+                in->a   = IR_NONE;
+                in->imm = 0;
+                in->aux = 0;
+                folded_branches++;
+                continue;
+            }
+
+            if (!ir_defines_value(in) || in->op == IR_CONST || s->value[i].kind != LAT_CONST)
+                continue;
+
+            v = s->value[i];
+            changes++;
+
+            //a phi's constant goes below the phis of its block
+            if (in->op == IR_PHI)
+            {
+                int first = in->next;
+                int c = ir_new_instr(f, IR_CONST, f->instrs[i].type, IR_NONE, IR_NONE);
+
+                while (f->instrs[first].op == IR_PHI)
+                    first = f->instrs[first].next;
+
+                f->instrs[c].imm  = v.imm;
+                f->instrs[c].fimm = v.fimm;
+                ir_insert_before(f, first, c);
+
+                if (!replace)
+                {
+                    replace = opt_alloc((size_t)n, sizeof(int), "phi replacements");
+
+                    for (int k = 0; k < n; k++)
+                        replace[k] = IR_NONE;
+                }
+
+                replace[i] = c;
+                continue;
+            }
+
+            in->op    = IR_CONST;
+            in->a     = IR_NONE;
+            in->b     = IR_NONE;
+            in->args  = 0;
+            in->nargs = 0;
+            in->aux   = 0;
+            in->imm   = v.imm;
+            in->fimm  = v.fimm;
+        }
+    }
+
+    if (replace)
+    {
+        for (int b = 0; b < f->block_count; b++)
+        {
+            for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+            {
+                IrInstr *in = &f->instrs[i];
+
+                if (in->a != IR_NONE && in->a < n && replace[in->a] != IR_NONE)
+                    in->a = replace[in->a];
+                if (in->b != IR_NONE && in->b < n && replace[in->b] != IR_NONE)
+                    in->b = replace[in->b];
+
+                for (int k = 0; k < in->nargs; k++)
+                {
+                    int *op = &f->operands[in->args + k];
+
+                    if (*op < n && replace[*op] != IR_NONE)
+                        *op = replace[*op];
+                }
+            }
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            if (replace[i] != IR_NONE)
+                ir_remove(f, i);
+        }
+
+        free(replace);
+    }
+
+    //edges of folded branches go away together with what only they reached
+    if (folded_branches > 0)
+    {
+        ir_compute_preds(f);
+        ir_compact(f);
+    }
+
+    if (stats)
+    {
+        stats->values_folded   += changes;
+        stats->branches_folded += folded_branches;
+    }
+
+    return changes + folded_branches;
+}
+
+static int propagate_constants(IrFunc *f, OptStats *stats)
+{
+    SccpState s;
+    int changes;
+
+    if (f->block_count == 0)
+        return 0;
+
+    memset(&s, 0, sizeof(s));
+    s.f          = f;
+    s.value      = opt_alloc((size_t)f->instr_count, sizeof(Lattice), "lattice");
+    s.live_block = opt_alloc((size_t)f->block_count, 1, "block marks");
+    s.edge_start = opt_alloc((size_t)f->block_count + 1, sizeof(int), "edge marks");
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        const int *succ;
+
+        s.edge_start[b + 1] = s.edge_start[b] + ir_successors(f, b, &succ);
+    }
+
+    s.live_edge  = opt_alloc((size_t)s.edge_start[f->block_count], 1, "edge marks");
+    s.block_work = opt_alloc((size_t)f->block_count, sizeof(int), "block worklist");
+    s.value_work = opt_alloc((size_t)f->instr_count * 2, sizeof(int), "value worklist");
+
+    build_uses(&s);
+
+    s.live_block[0] = 1;
+    s.block_work[s.block_work_count++] = 0;
+
+    while (s.block_work_count > 0 || s.value_work_count > 0)
+    {
+        while (s.value_work_count > 0)
+        {
+            int v = s.value_work[--s.value_work_count];
+
+            for (int u = s.use_start[v]; u < s.use_start[v + 1]; u++)
+                visit(&s, s.uses[u]);
+        }
+
+        if (s.block_work_count > 0)
+        {
+            int b = s.block_work[--s.block_work_count];
+
+            for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+                visit(&s, i);
+        }
+    }
+
+    changes = apply_constants(&s, stats);
+
+    free(s.value);
+    free(s.live_block);
+    free(s.live_edge);
+    free(s.edge_start);
+    free(s.block_work);
+    free(s.value_work);
+    free(s.use_start);
+    free(s.uses);
+
+    return changes;
+}
+
+
+
+/*
+   _____ ______ _____
+  / ____|  ____/ ____|
+ | |    | |__ | |  __
+ | |    |  __|| | |_ |
+ | |____| |   | |__| |
+  \_____|_|    \_____|
+*/
+
+//phis whose inputs are all one value (or the phi itself) are that value
+static int remove_trivial_phis(IrFunc *f)
+{
+    int removed = 0;
+    int changed = 1;
+
+    while (changed)
+    {
+        changed = 0;
+
+        for (int b = 0; b < f->block_count; b++)
+        {
+            for (int i = f->blocks[b].first; i != IR_NONE && f->instrs[i].op == IR_PHI; )
+            {
+                const IrInstr *phi = &f->instrs[i];
+                int next = phi->next;
+                int same = IR_NONE;
+                int trivial = 1;
+
+                for (int k = 0; k < phi->nargs && trivial; k++)
+                {
+                    int v = f->operands[phi->args + k];
+
+                    if (v == i || v == same)
+                        continue;
+
+                    if (same != IR_NONE)
+                        trivial = 0;
+
+                    same = v;
+                }
+
+                if (trivial && same != IR_NONE)
+                {
+                    ir_replace_uses(f, i, same);
+                    ir_remove(f, i);
+                    removed++;
+                    changed = 1;
+                }
+
+                i = next;
+            }
+        }
+    }
+
+    return removed;
+}
+
+//a block ending in a jump to a block with no other predecessor takes over its code
+static int merge_blocks(IrFunc *f)
+{
+    int merged = 0;
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        for (;;)
+        {
+            int term = ir_terminator(f, b);
+            const int *succ;
+            int s, n;
+
+            if (term == IR_NONE || f->instrs[term].op != IR_JMP)
+                break;
+
+            s = f->instrs[term].target[0];
+
+            if (s == b || s == 0 || f->blocks[s].pred_count != 1)
+                break;
+
+            //single predecessor: every phi has exactly one input
+            while (f->instrs[f->blocks[s].first].op == IR_PHI)
+            {
+                int phi = f->blocks[s].first;
+
+                ir_replace_uses(f, phi, f->operands[f->instrs[phi].args]);
+                ir_remove(f, phi);
+            }
+
+            ir_remove(f, term);
+
+            IrBlock *into = &f->blocks[b];
+            IrBlock *from = &f->blocks[s];
+
+            for (int i = from->first; i != IR_NONE; i = f->instrs[i].next)
+                f->instrs[i].block = b;
+
+            if (into->last == IR_NONE)
+                into->first = from->first;
+            else
+            {
+                f->instrs[into->last].next = from->first;
+                f->instrs[from->first].prev = into->last;
+            }
+
+            into->last  = from->last;
+            from->first = IR_NONE;
+            from->last  = IR_NONE;
+            from->pred_count = 0;
+
+            n = ir_successors(f, b, &succ);
+
+            for (int k = 0; k < n; k++)
+            {
+                for (int p = 0; p < f->blocks[succ[k]].pred_count; p++)
+                {
+                    if (f->blocks[succ[k]].preds[p] == s)
+                        f->blocks[succ[k]].preds[p] = b;
+                }
+            }
+
+            merged++;
+        }
+    }
+
+    //absorbed blocks are empty and unreachable now
+    if (merged > 0)
+        ir_compact(f);
+
+    return merged;
+}
+
+
+
+/*
+  _____          _                 _
+ |  __ \        | |               | |
+ | |__) |___  __| |_   _ _ __   __| | __ _ _ __   ___ _   _
+ |  _  // _ \/ _` | | | | '_ \ / _` |/ _` | '_ \ / __| | | |
+ | | \ \  __/ (_| | |_| | | | | (_| | (_| | | | | (__| |_| |
+ |_|  \_\___|\__,_|\__,_|_| |_|\__,_|\__,_|_| |_|\___|\__, |
+                                                      __/ |
+                                                     |___/
+*/
+
+//instructions whose result depends on nothing but their own fields
+static int is_pure(IrOp op)
+{
+    return op == IR_CONST || op == IR_UNDEF || op == IR_GLOBAL || op == IR_STRING ||
+           op == IR_FUNCADDR || op == IR_SLOT ||
+           (op >= IR_ADD && op <= IR_COPY) || op == IR_OFFSET || op == IR_INDEX;
+}
+
+static unsigned hash_instr(const IrInstr *in)
+{
+    unsigned long long bits;
+    unsigned h = 2166136261u;
+
+    memcpy(&bits, &in->fimm, sizeof(bits));
+
+    h = (h ^ (unsigned)in->op) * 16777619u;
+    h = (h ^ (unsigned)in->type) * 16777619u;
+    h = (h ^ (unsigned)in->a) * 16777619u;
+    h = (h ^ (unsigned)in->b) * 16777619u;
+    h = (h ^ (unsigned)in->aux) * 16777619u;
+    h = (h ^ (unsigned)in->imm ^ (unsigned)((unsigned long long)in->imm >> 32)) * 16777619u;
+    h = (h ^ (unsigned)bits ^ (unsigned)(bits >> 32)) * 16777619u;
+
+    return h;
+}
+
+static int same_instr(const IrInstr *x, const IrInstr *y)
+{
+    return x->op == y->op && x->type == y->type && x->a == y->a && x->b == y->b &&
+           x->aux == y->aux && x->imm == y->imm && memcmp(&x->fimm, &y->fimm, sizeof(double)) == 0;
+}
+
+//a pure instruction repeated where an identical one dominates it reuses the earlier result
+static int remove_redundant_values(IrFunc *f)
+{
+    int  *idom = opt_alloc((size_t)f->block_count, sizeof(int), "dominators");
+    int  *replace = opt_alloc((size_t)f->instr_count, sizeof(int), "value replacements");
+    int   size = 16;
+    int  *table;
+    int   merged = 0;
+
+    while (size < f->instr_count * 2)
+        size *= 2;
+
+    table = opt_alloc((size_t)size, sizeof(int), "value table");
+
+    for (int k = 0; k < size; k++)
+        table[k] = IR_NONE;
+
+    for (int i = 0; i < f->instr_count; i++)
+        replace[i] = i;
+
+    ir_dominators(f, idom);
+
+    //dominators come first in block order, so operands are resolved before their users
+    for (int b = 0; b < f->block_count; b++)
+    {
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+        {
+            IrInstr *in = &f->instrs[i];
+
+            if (in->a != IR_NONE)
+                in->a = replace[in->a];
+            if (in->b != IR_NONE)
+                in->b = replace[in->b];
+
+            if (!is_pure(in->op))
+                continue;
+
+            for (unsigned h = hash_instr(in) & (unsigned)(size - 1); ; h = (h + 1) & (unsigned)(size - 1))
+            {
+                int c = table[h];
+
+                if (c == IR_NONE)
+                {
+                    table[h] = i;
+                    break;
+                }
+
+                if (same_instr(&f->instrs[c], in) && ir_dominates(idom, f->instrs[c].block, b))
+                {
+                    replace[i] = c;
+                    merged++;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (merged > 0)
+    {
+        for (int b = 0; b < f->block_count; b++)
+        {
+            for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+            {
+                IrInstr *in = &f->instrs[i];
+
+                if (in->a != IR_NONE)
+                    in->a = replace[in->a];
+                if (in->b != IR_NONE)
+                    in->b = replace[in->b];
+
+                for (int k = 0; k < in->nargs; k++)
+                    f->operands[in->args + k] = replace[f->operands[in->args + k]];
+            }
+        }
+
+        for (int i = 0; i < f->instr_count; i++)
+        {
+            if (replace[i] != i)
+                ir_remove(f, i);
+        }
+    }
+
+    free(idom);
+    free(replace);
+    free(table);
+
+    return merged;
+}
+
+
+
+/*
+  _____                 _    _____          _
+ |  __ \               | |  / ____|        | |
+ | |  | | ___  __ _  __| | | |     ___   __| | ___
+ | |  | |/ _ \/ _` |/ _` | | |    / _ \ / _` |/ _ \
+ | |__| |  __/ (_| | (_| | | |___| (_) | (_| |  __/
+ |_____/ \___|\__,_|\__,_|  \_____\___/ \__,_|\___|
+*/
+
+//division by a value that may be zero still has to stop the program
+static int may_trap(const IrFunc *f, const IrInstr *in)
+{
+    if (in->op != IR_DIV && in->op != IR_UDIV && in->op != IR_MOD && in->op != IR_UMOD)
+        return 0;
+
+    return f->instrs[in->b].op != IR_CONST || f->instrs[in->b].imm == 0;
+}
+
+static int remove_dead_values(IrFunc *f)
+{
+    char *live = opt_alloc((size_t)f->instr_count, 1, "live marks");
+    int  *work = opt_alloc((size_t)f->instr_count, sizeof(int), "live worklist");
+    int   count = 0;
+    int   removed = 0;
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+        {
+            if (ir_has_side_effects(f->instrs[i].op) || may_trap(f, &f->instrs[i]))
+            {
+                live[i] = 1;
+                work[count++] = i;
+            }
+        }
+    }
+
+    while (count > 0)
+    {
+        const IrInstr *in = &f->instrs[work[--count]];
+
+        for (int k = 0; k < operand_count(in); k++)
+        {
+            int v = operand_at(f, in, k);
+
+            if (v != IR_NONE && !live[v])
+            {
+                live[v] = 1;
+                work[count++] = v;
+            }
+        }
+    }
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        for (int i = f->blocks[b].first; i != IR_NONE; )
+        {
+            int next = f->instrs[i].next;
+
+            if (!live[i])
+            {
+                ir_remove(f, i);
+                removed++;
+            }
+
+            i = next;
+        }
+    }
+
+    free(live);
+    free(work);
+
+    return removed;
+}
+
+//stores into a slot whose address only ever reaches store / clear / copy destinations
+static int remove_dead_stores(IrFunc *f)
+{
+    int  *slot_of = opt_alloc((size_t)f->instr_count, sizeof(int), "slot addresses");
+    char *read    = opt_alloc((size_t)f->slot_count, 1, "slot marks");
+    int   removed = 0;
+    int   changed = 1;
+
+    for (int i = 0; i < f->instr_count; i++)
+        slot_of[i] = (f->instrs[i].op == IR_SLOT && f->instrs[i].block != IR_NONE) ? f->instrs[i].aux : -1;
+
+    //addresses derived from a slot, until no new ones appear
+    while (changed)
+    {
+        changed = 0;
+
+        for (int i = 0; i < f->instr_count; i++)
+        {
+            const IrInstr *in = &f->instrs[i];
+
+            if ((in->op == IR_OFFSET || in->op == IR_INDEX) && in->block != IR_NONE &&
+                slot_of[i] == -1 && slot_of[in->a] != -1)
+            {
+                slot_of[i] = slot_of[in->a];
+                changed = 1;
+            }
+        }
+    }
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+        {
+            const IrInstr *in = &f->instrs[i];
+
+            for (int k = 0; k < operand_count(in); k++)
+            {
+                int v = operand_at(f, in, k);
+
+                if (v == IR_NONE || slot_of[v] == -1)
+                    continue;
+
+                //the address is written through; anything else may read or leak it
+                if (k == 0 && (in->op == IR_OFFSET || in->op == IR_INDEX || in->op == IR_STORE ||
+                               in->op == IR_MEMZERO || in->op == IR_MEMCPY))
+                    continue;
+
+                read[slot_of[v]] = 1;
+            }
+        }
+    }
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        for (int i = f->blocks[b].first; i != IR_NONE; )
+        {
+            const IrInstr *in = &f->instrs[i];
+            int next = in->next;
+
+            if ((in->op == IR_STORE || in->op == IR_MEMZERO || in->op == IR_MEMCPY) &&
+                slot_of[in->a] != -1 && !read[slot_of[in->a]])
+            {
+                ir_remove(f, i);
+                removed++;
+            }
+
+            i = next;
+        }
+    }
+
+    free(slot_of);
+    free(read);
+
+    return removed;
+}
+
+//drops frame slots no instruction addresses any more and renumbers the rest
+static int remove_unused_slots(IrFunc *f)
+{
+    int *remap = opt_alloc((size_t)f->slot_count, sizeof(int), "slot map");
+    int  kept = 0;
+    int  removed;
+
+    for (int i = 0; i < f->instr_count; i++)
+    {
+        if (f->instrs[i].op == IR_SLOT && f->instrs[i].block != IR_NONE)
+            remap[f->instrs[i].aux] = 1;
+    }
+
+    for (int s = 0; s < f->slot_count; s++)
+    {
+        if (!remap[s])
+        {
+            remap[s] = -1;
+            continue;
+        }
+
+        f->slots[kept] = f->slots[s];
+        remap[s] = kept++;
+    }
+
+    for (int i = 0; i < f->instr_count; i++)
+    {
+        if (f->instrs[i].op == IR_SLOT && f->instrs[i].block != IR_NONE)
+            f->instrs[i].aux = remap[f->instrs[i].aux];
+    }
+
+    removed = f->slot_count - kept;
+    f->slot_count = kept;
+
+    free(remap);
+
+    return removed;
+}
+
+
+
+/*
+  _____
+ |  __ \
+ | |  | |_ __ ___   _____ _ __
+ | |  | | '__| \ \ / / _ \ '__|
+ | |__| | |  | |\ V /  __/ |
+ |_____/|_|  |_| \_/ \___|_|
+*/
+
+//runs the clean-up passes until a round changes nothing
+static void clean_up(IrFunc *f, OptStats *stats)
+{
+    int changed = 1;
+
+    while (changed)
+    {
+        int stores, shared;
+
+        stats->rounds++;
+
+        changed  = propagate_constants(f, stats);
+        changed += remove_trivial_phis(f);
+        changed += merge_blocks(f);
+
+        shared = remove_redundant_values(f);
+        stats->values_shared += shared;
+
+        stores = remove_dead_stores(f);
+        stats->stores_removed += stores;
+
+        changed += shared + stores;
+        changed += remove_dead_values(f);
+    }
+}
+
+void optimise_func(IrFunc *f, const OptOptions *options, OptStats *stats)
+{
+    OptStats local;
+
+    memset(&local, 0, sizeof(local));
+
+    local.instrs_before = count_instrs(f);
+    local.blocks_before = f->block_count;
+
+    if (!f->is_extern && f->block_count > 0)
+    {
+        clean_up(f, &local);
+
+        //loops are looked at once the constants are known, and cleaned up after
+        if (options->loops)
+        {
+            LoopOptions loop_options;
+            LoopStats loops;
+
+            loop_options.vector_bytes = options->vector_bytes;
+            loop_options.report       = options->report;
+
+            memset(&loops, 0, sizeof(loops));
+            optimise_loops(f, &loop_options, &loops);
+
+            local.loops            = loops.loops;
+            local.values_hoisted   = loops.hoisted;
+            local.indexes_reduced  = loops.reduced;
+            local.loops_unrolled   = loops.unrolled;
+            local.loops_vectorised = loops.vectorised;
+
+            if (loops.hoisted + loops.reduced + loops.unrolled + loops.vectorised > 0)
+                clean_up(f, &local);
+        }
+
+        local.slots_removed = remove_unused_slots(f);
+    }
+
+    local.instrs_after = count_instrs(f);
+    local.blocks_after = f->block_count;
+
+    if (stats)
+        *stats = local;
+}
+
+void optimise_module(IrModule *m, const OptOptions *options, OptStats *stats)
+{
+    int *tails   = opt_alloc((size_t)m->func_count, sizeof(int), "tail call counts");
+    int *inlined = opt_alloc((size_t)m->func_count, sizeof(int), "inline counts");
+    int *instrs  = opt_alloc((size_t)m->func_count, sizeof(int), "function sizes");
+    int *blocks  = opt_alloc((size_t)m->func_count, sizeof(int), "function sizes");
+
+    //sizes before inlining, so the report covers the whole pipeline
+    for (int i = 0; i < m->func_count; i++)
+    {
+        instrs[i] = count_instrs(&m->funcs[i]);
+        blocks[i] = m->funcs[i].block_count;
+    }
+
+    //before inlining: a function left without recursion can then be inlined
+    if (options->tail_calls)
+        eliminate_tail_calls(m, tails);
+
+    if (options->inline_calls)
+        inline_module(m, inlined);
+
+    for (int i = 0; i < m->func_count; i++)
+    {
+        optimise_func(&m->funcs[i], options, stats ? &stats[i] : NULL);
+
+        if (stats)
+        {
+            stats[i].tail_calls    = tails[i];
+            stats[i].calls_inlined = inlined[i];
+            stats[i].instrs_before = instrs[i];
+            stats[i].blocks_before = blocks[i];
+        }
+    }
+
+    free(tails);
+    free(inlined);
+    free(instrs);
+    free(blocks);
+}
+
+void print_opt_report(const IrModule *m, const OptStats *stats)
+{
+    OptStats total;
+
+    memset(&total, 0, sizeof(total));
+
+    printf("\n%-20s %4s %7s %14s %12s %7s %9s %7s %6s %6s %5s %7s %7s %8s %10s\n",
+           "function", "tail", "inlined", "instructions", "blocks", "folded", "branches", "stores", "slots",
+           "shared", "loops", "hoisted", "reduced", "unrolled", "vectorised");
+
+    for (int i = 0; i < m->func_count; i++)
+    {
+        const OptStats *s = &stats[i];
+
+        if (m->funcs[i].is_extern)
+            continue;
+
+        printf("%-20s %4d %7d %6d -> %-4d %4d -> %-4d %7d %9d %7d %6d %6d %5d %7d %7d %8d %10d\n", m->funcs[i].name,
+               s->tail_calls, s->calls_inlined, s->instrs_before, s->instrs_after, s->blocks_before, s->blocks_after,
+               s->values_folded, s->branches_folded, s->stores_removed, s->slots_removed,
+               s->values_shared, s->loops, s->values_hoisted, s->indexes_reduced, s->loops_unrolled,
+               s->loops_vectorised);
+
+        total.tail_calls      += s->tail_calls;
+        total.calls_inlined   += s->calls_inlined;
+        total.instrs_before   += s->instrs_before;
+        total.instrs_after    += s->instrs_after;
+        total.blocks_before   += s->blocks_before;
+        total.blocks_after    += s->blocks_after;
+        total.values_folded   += s->values_folded;
+        total.branches_folded += s->branches_folded;
+        total.stores_removed  += s->stores_removed;
+        total.slots_removed   += s->slots_removed;
+        total.values_shared   += s->values_shared;
+        total.loops           += s->loops;
+        total.values_hoisted  += s->values_hoisted;
+        total.indexes_reduced += s->indexes_reduced;
+        total.loops_unrolled  += s->loops_unrolled;
+        total.loops_vectorised += s->loops_vectorised;
+    }
+
+    printf("%-20s %4d %7d %6d -> %-4d %4d -> %-4d %7d %9d %7d %6d %6d %5d %7d %7d %8d %10d\n\n", "total",
+           total.tail_calls, total.calls_inlined, total.instrs_before, total.instrs_after, total.blocks_before, total.blocks_after,
+           total.values_folded, total.branches_folded, total.stores_removed, total.slots_removed,
+           total.values_shared, total.loops, total.values_hoisted, total.indexes_reduced, total.loops_unrolled,
+           total.loops_vectorised);
+}
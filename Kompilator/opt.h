@@ -0,0 +1,78 @@
+#ifndef OPT_H
+#define OPT_H
+
+#include "ir.h"
+
+/* ---------------------------------------------
+   IR clean-up
+
+   Runs on verified SSA between lowering and the
+   back ends, repeating until a round changes
+   nothing:
+
+   - sparse conditional constant propagation
+     (Wegman & Zadeck): values that are constant
+     on every executable path become constants,
+     branches and switches on them become jumps;
+   - unreachable blocks are dropped, phis left
+     with one input disappear and a block that is
+     its successor's only predecessor absorbs it;
+   - an instruction that recomputes a pure value
+     already available in a dominating block is
+     replaced by it;
+   - stores into frame slots that are never read
+     back are removed;
+   - values nothing uses are deleted, except
+     divisions that may still stop the program.
+
+   optimise_module() first turns self-recursive
+   tail calls into loops (tail.h), then runs the
+   inliner of inline.h, so constants passed as
+   arguments are folded through the copied
+   bodies. Once the
+   first clean-up settles, the loop passes of
+   loop.h run and the clean-up repeats.
+
+   Slots left without an address at the end are
+   removed from the frame. Folding follows the
+   run-time rules of fold.h; UNDEF counts as 0,
+   the value every back end gives it.
+--------------------------------------------- */
+
+typedef struct OptOptions {
+    int tail_calls;
+    int inline_calls;
+    int loops;
+    int vector_bytes;       // vectorise loops for this register width, 0 not to (loop.h)
+    int report;             // print what became of each innermost loop
+} OptOptions;
+
+typedef struct OptStats {
+    int tail_calls;         // self-recursive calls turned into jumps
+    int calls_inlined;
+    int instrs_before;
+    int instrs_after;
+    int blocks_before;
+    int blocks_after;
+    int values_folded;      // instructions turned into constants
+    int branches_folded;    // conditional branches and switches turned into jumps
+    int stores_removed;     // stores into slots that are never read
+    int slots_removed;
+    int values_shared;      // instructions replaced by an equal dominating one
+    int loops;
+    int values_hoisted;     // loop-invariant instructions moved out
+    int indexes_reduced;    // array indexes turned into pointer steps
+    int loops_unrolled;
+    int loops_vectorised;
+    int rounds;
+} OptStats;
+
+// stats may be NULL
+void optimise_func(IrFunc *f, const OptOptions *options, OptStats *stats);
+
+// stats may be NULL, otherwise it holds one entry per function
+void optimise_module(IrModule *m, const OptOptions *options, OptStats *stats);
+
+void print_opt_report(const IrModule *m, const OptStats *stats);
+
+#endif /* OPT_H */
@@ -2,6 +2,8 @@
 #include "lexer.h"
 #include "tokenkeytab.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 
 /*
@@ -13,17 +15,17 @@
  |_____/ \___|\___|_|\__,_|_|  \__,_|\__|_|\___/|_| |_|___/
                                                            
 */
-void enum_declaration(ParState *state);
+int enum_declaration(ParState *state);
 static int is_function_declaration_start(ParState *state);
 static int is_declaration_statement_start(ParState *state);
-static void goto_statement(ParState *state);
-static void label_statement(ParState *state);
-void bitwise_or_expression(ParState *state);
-void bitwise_xor_expression(ParState *state);
-void bitwise_and_expression(ParState *state);
-void equality_expression(ParState *state);
-void shift_expression(ParState *state);
-static void shift_operator(ParState *state);
+static int goto_statement(ParState *state);
+static int label_statement(ParState *state);
+int bitwise_or_expression(ParState *state);
+int bitwise_xor_expression(ParState *state);
+int bitwise_and_expression(ParState *state);
+int equality_expression(ParState *state);
+int shift_expression(ParState *state);
+static TokenType shift_operator(ParState *state);
 
 ///////////////////////////////////////////
 
@@ -308,33 +310,90 @@ static const TokenType FOLLOW_unary_expression[] = {
 
 
 
-void parser(TokenBuffer *token_stream, 
-            int token_count, 
+void parser(TokenBuffer *token_stream,
+            int token_count,
             char **lexeme_stream,
+            int trace,
+            TraceLog *events,
+            FILE *out,
+            Ast *out_ast,
             int * out_error_count
 )
 {
 
     ParState state = {0};
 
+    init_ast(out_ast, token_stream, lexeme_stream, token_count);
+
     init_parser(&state, token_stream, token_count);
-    program(&state);
+    state.lexemes = lexeme_stream;
+    state.ast     = out_ast;
+    state.trace   = trace;
+    state.events  = events;
+    state.out     = out;
+
+    out_ast->root = program(&state);
     *out_error_count = state.error_count;
+
+    free(state.type_names);
     return;
 
 }
 
+void parse_part(TokenBuffer *token_stream,
+                int token_count,
+                char **lexeme_stream,
+                const char *const *known,
+                int known_count,
+                FILE *out,
+                Ast *out_ast,
+                int *out_error_count,
+                const char ***out_declared,
+                int *out_declared_count)
+{
+    ParState state = {0};
+    const char **declared;
+
+    init_ast(out_ast, token_stream, lexeme_stream, token_count);
+
+    init_parser(&state, token_stream, token_count);
+    state.lexemes          = lexeme_stream;
+    state.ast              = out_ast;
+    state.out              = out;
+    state.known_types      = known;
+    state.known_type_count = known_count;
+
+    out_ast->root = program(&state);
+    *out_error_count = state.error_count;
+
+    declared = malloc((state.type_name_count + 1) * sizeof(*declared));
+
+    if (!declared)
+    {
+        fprintf(stderr, "Fatal: failed to allocate type name table\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < state.type_name_count; i++)
+        declared[i] = lexeme_stream[state.type_names[i]];
+
+    *out_declared       = declared;
+    *out_declared_count = state.type_name_count;
+
+    free(state.type_names);
+}
+
 
 
 /*
-  _    _      _                     
- | |  | |    | |                    
- | |__| | ___| |_ __   ___ _ __ ___ 
+  _    _      _
+ | |  | |    | |
+ | |__| | ___| |_ __   ___ _ __ ___
  |  __  |/ _ \ | '_ \ / _ \ '__/ __|
  | |  | |  __/ | |_) |  __/ |  \__ \
  |_|  |_|\___|_| .__/ \___|_|  |___/
-               | |                  
-               |_|                  
+               | |
+               |_|
 */
 
 // ---------------------------------------------------
@@ -362,6 +421,25 @@ void init_parser(ParState *state,
     state->sync_set = FOLLOW_program;
 }
 
+//prints the non-terminal being entered / left when tracing is on, and records it as a trace event
+static void trace_enter(const ParState *state, const char *rule)
+{
+    if (state->trace)
+        fprintf(state->out, "[ENTER] %s\n", rule);
+
+    if (state->events)
+        trace_begin(state->events, rule);
+}
+
+static void trace_exit(const ParState *state, const char *rule)
+{
+    if (state->trace)
+        fprintf(state->out, "[EXIT ] %s\n", rule);
+
+    if (state->events)
+        trace_end(state->events, rule);
+}
+
 void next_token(ParState *state)
 {
     state->current = state->next;
@@ -389,6 +467,12 @@ TokenType peek_token(ParState *state, int offset)
     return state->tokens[idx].token;
 }
 
+//the token about to be consumed, where errors are reported; the EOF token once the stream is used up
+static const TokenBuffer *error_token(const ParState *state)
+{
+    return &state->tokens[state->index < state->token_count ? state->index : state->token_count - 1];
+}
+
 void match(ParState *state, TokenType expected)
 {
     if (state->next == expected)
@@ -400,7 +484,9 @@ void match(ParState *state, TokenType expected)
     /* missing symbol */
     state -> error_count++;
 
-    printf("Error: missing %s before %s\n",
+    fprintf(state->out, "Syntax error at %d:%d: missing %s before %s\n",
+           error_token(state)->row,
+           error_token(state)->col,
            tok2name(expected),
            tok2name(state -> next));
 
@@ -429,28 +515,116 @@ static void syntax_error_at(ParState *state, const char *msg)
     state->error_count++;
     state->panic_mode = 1;
 
-    printf(
+    fprintf(
+        state->out,
         "Syntax error at %d:%d: %s (got %s)\n",
-        state->tokens[state->index].row,
-        state->tokens[state->index].col,
+        error_token(state)->row,
+        error_token(state)->col,
         msg,
         tok2name(state->next)
     );
 }
 
-static int is_function_declaration_start(ParState *state)
+//creates a node anchored at the token about to be consumed
+static int new_node(ParState *state, AstKind kind)
+{
+    return ast_new(state->ast, kind, state->index);
+}
+
+static AstNode *node_at(ParState *state, int node)
+{
+    return &state->ast->nodes[node];
+}
+
+//the child is parsed before the parent is looked up, since parsing it may move the node pool
+static void set_kid(ParState *state, int node, int slot, int child)
+{
+    node_at(state, node)->kid[slot] = child;
+}
+
+static void set_list(ParState *state, int node, int first)
+{
+    node_at(state, node)->list = first;
+}
+
+//remembers a user-declared type name so later statements can tell declarations from assignments
+static void declare_type_name(ParState *state, int tok)
+{
+    if (state->type_name_count >= state->type_name_capacity)
+    {
+        state->type_name_capacity = (state->type_name_capacity == 0) ? 16 : state->type_name_capacity * 2;
+        state->type_names = realloc(state->type_names, state->type_name_capacity * sizeof(int));
+
+        if (!state->type_names)
+        {
+            fprintf(stderr, "Fatal: failed to allocate type name table\n");
+            exit(1);
+        }
+    }
+
+    state->type_names[state->type_name_count++] = tok;
+}
+
+static int is_type_name(ParState *state, int tok)
+{
+    if (tok >= state->token_count || state->tokens[tok].token != TOK_IDENTIFIER)
+        return 0;
+
+    for (int i = 0; i < state->type_name_count; i++)
+    {
+        if (strcmp(state->lexemes[state->type_names[i]], state->lexemes[tok]) == 0)
+            return 1;
+    }
+
+    for (int i = 0; i < state->known_type_count; i++)
+    {
+        if (strcmp(state->known_types[i], state->lexemes[tok]) == 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+static int is_type_qualifier(TokenType t)
+{
+    switch (t)
+    {
+        case TOK_KONSTANT:
+        case TOK_STATISK:
+        case TOK_VOLATIL:
+        case TOK_BEGRANSA:
+        case TOK_AUTO:
+        case TOK_REGISTER:
+        case TOK_OSIGNERAD:
+        case TOK_SIGNERAD:
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+//walks over [EXTERN] qualifiers base PEK* (<...>)* starting at token i
+//returns the index after the type, or -1 if no type starts at i
+static int skip_type_specifier(ParState *state, int i)
 {
-    int i;
     int depth;
+    int saw_qualifier = 0;
 
     //handles optional EXTERN
-    i = state->index;
     if (i < state->token_count && state->tokens[i].token == TOK_EXTERN)
         i++;
 
+    //handles qualifiers and signedness modifiers
+    while (i < state->token_count && is_type_qualifier(state->tokens[i].token))
+    {
+        saw_qualifier = 1;
+        i++;
+    }
+
     //rejects if there is no token left
     if (i >= state->token_count)
-        return 0;
+        return -1;
 
     //consumes base type of the type_specifier
     switch (state->tokens[i].token)
@@ -464,6 +638,10 @@ static int is_function_declaration_start(ParState *state)
         case TOK_ORD:
         case TOK_VAL:
         case TOK_TOM:
+        case TOK_KORT:
+        case TOK_LANG:
+        case TOK_DUBBEL:
+        case TOK_LANG_DUBBEL:
         case TOK_IDENTIFIER:
             i++;
             break;
@@ -472,12 +650,15 @@ static int is_function_declaration_start(ParState *state)
             //requires: STRUKTUR <identifier>
             i++;
             if (i >= state->token_count || state->tokens[i].token != TOK_IDENTIFIER)
-                return 0;
+                return -1;
             i++;
             break;
 
         default:
-            return 0;
+            //a bare OSIGNERAD / SIGNERAD means HEL
+            if (!saw_qualifier)
+                return -1;
+            break;
     }
 
     //consumes pointer suffixes: PEK*
@@ -500,11 +681,22 @@ static int is_function_declaration_start(ParState *state)
 
             //unterminated dimension
             if (i >= state->token_count && depth > 0)
-                return 0;
+                return -1;
         }
         while (depth > 0);
     }
 
+    return i;
+}
+
+static int is_function_declaration_start(ParState *state)
+{
+    int i;
+
+    i = skip_type_specifier(state, state->index);
+    if (i < 0)
+        return 0;
+
     //expects ':' after the type
     if (i >= state->token_count || state->tokens[i].token != TOK_ASSIGN)
         return 0;
@@ -525,70 +717,11 @@ static int is_function_declaration_start(ParState *state)
 static int is_declaration_statement_start(ParState *state)
 {
     int i;
-    int depth;
 
-    //handles optional EXTERN
-    i = state->index;
-    if (i < state->token_count && state->tokens[i].token == TOK_EXTERN)
-        i++;
-
-    //rejects if there is no token left
-    if (i >= state->token_count)
+    i = skip_type_specifier(state, state->index);
+    if (i < 0)
         return 0;
 
-    //consumes base type of the type_specifier
-    switch (state->tokens[i].token)
-    {
-        case TOK_HEL:
-        case TOK_FLYT:
-        case TOK_BOK:
-        case TOK_BIT:
-        case TOK_HALV:
-        case TOK_BYTE:
-        case TOK_ORD:
-        case TOK_VAL:
-        case TOK_TOM:
-        case TOK_IDENTIFIER:
-            i++;
-            break;
-
-        case TOK_STRUKTUR:
-            //requires: STRUKTUR <identifier>
-            i++;
-            if (i >= state->token_count || state->tokens[i].token != TOK_IDENTIFIER)
-                return 0;
-            i++;
-            break;
-
-        default:
-            return 0;
-    }
-
-    //consumes pointer suffixes: PEK*
-    while (i < state->token_count && state->tokens[i].token == TOK_PEK)
-        i++;
-
-    //consumes array suffixes on the type: < ... > (balanced)
-    while (i < state->token_count && state->tokens[i].token == TOK_LBLOCK)
-    {
-        //tracks nested < > in the dimension expression
-        depth = 0;
-        do
-        {
-            if (state->tokens[i].token == TOK_LBLOCK)
-                depth++;
-            else if (state->tokens[i].token == TOK_RBLOCK)
-                depth--;
-
-            i++;
-
-            //unterminated dimension
-            if (i >= state->token_count && depth > 0)
-                return 0;
-        }
-        while (depth > 0);
-    }
-
     //expects ':' after the type
     if (i >= state->token_count || state->tokens[i].token != TOK_ASSIGN)
         return 0;
@@ -615,62 +748,80 @@ static int is_declaration_statement_start(ParState *state)
 
 
 /*
-  _   _               _______                  _             _     
- | \ | |             |__   __|                (_)           | |    
- |  \| | ___  _ __      | | ___ _ __ _ __ ___  _ _ __   __ _| |___ 
+  _   _               _______                  _             _
+ | \ | |             |__   __|                (_)           | |
+ |  \| | ___  _ __      | | ___ _ __ _ __ ___  _ _ __   __ _| |___
  | . ` |/ _ \| '_ \     | |/ _ \ '__| '_ ` _ \| | '_ \ / _` | / __|
  | |\  | (_) | | | |    | |  __/ |  | | | | | | | | | | (_| | \__ \
  |_| \_|\___/|_| |_|    |_|\___|_|  |_| |_| |_|_|_| |_|\__,_|_|___/
-                                                                   
+
 */
 
 //Program structure
-void program(ParState *state)
+int program(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
 
-    printf("[ENTER] program\n");
+    trace_enter(state, "program");
 
     /* enter non-terminal */
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_program;
 
+    node = ast_new(state->ast, AST_PROGRAM, -1);
+
     /* FIRST(program) */
     switch (state -> next)
     {
         default:
-            global_statement_list(state);
+            set_list(state, node, global_statement_list(state));
             break;
     }
 
     /* exit non-terminal */
     state -> sync_set = saved_sync;
 
-    printf("[EXIT] program\n");
+    trace_exit(state, "program");
+
+    return node;
 }
 
-void global_statement_list(ParState *state)
+int global_statement_list(ParState *state)
 {
     const TokenType *saved_sync;
+    int head = AST_NULL;
+    int tail = AST_NULL;
 
-    printf("[ENTER] global_statement_list\n");
+    trace_enter(state, "global_statement_list");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_program;
 
     while (state->next != TOK_EOF)
-        global_statement(state);
+    {
+        int start_index = state->index;
+
+        ast_append(state->ast, &head, &tail, global_statement(state));
+
+        //guarantees progress when recovery stopped on the offending token
+        if (state->index == start_index)
+            next_token(state);
+    }
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] global_statement_list\n");
+    trace_exit(state, "global_statement_list");
+
+    return head;
 }
 
-void global_statement(ParState *state)
+int global_statement(ParState *state)
 {
     const TokenType *saved_sync;
+    int node = AST_NULL;
 
-    printf("[ENTER] global_statement\n");
+    trace_enter(state, "global_statement");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_global_statement;
@@ -681,18 +832,26 @@ void global_statement(ParState *state)
         case TOK_TYPDEF:
         case TOK_STRUKTUR:
         case TOK_ENUM:
+            //STRUKTUR NAME: x; is a declaration, STRUKTUR NAME < is a struct type
+            if (state->next == TOK_STRUKTUR && state->next_next == TOK_IDENTIFIER &&
+                peek_token(state, 2) != TOK_LBLOCK)
+            {
+                node = declaration_statement(state);
+                break;
+            }
+
             //type declarations at global scope
-            type_declaration(state);
+            node = type_declaration(state);
             break;
 
         default:
             if (is_function_declaration_start(state))
             {
-                function_declaration(state);
+                node = function_declaration(state);
             }
             else if (is_declaration_statement_start(state))
             {
-                declaration_statement(state);
+                node = declaration_statement(state);
             }
             else
             {
@@ -705,24 +864,34 @@ void global_statement(ParState *state)
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] global_statement\n");
+    trace_exit(state, "global_statement");
+
+    return node;
 }
 
-void function_declaration(ParState *state)
+int function_declaration(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
+    int flags = 0;
 
-    printf("[ENTER] function_declaration\n");
+    trace_enter(state, "function_declaration");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_global_statement;
 
     //consumes optional EXTERN storage specifier
     if (state->next == TOK_EXTERN)
+    {
         match(state, TOK_EXTERN);
+        flags |= AST_FLAG_EXTERN;
+    }
+
+    node = new_node(state, AST_FUNCTION);
+    node_at(state, node)->flags = flags;
 
     //parses return type
-    type_specifier(state);
+    set_kid(state, node, 0, type_specifier(state));
 
     //enforces ':' between type and identifier
     if (state->next == TOK_ASSIGN)
@@ -738,6 +907,7 @@ void function_declaration(ParState *state)
     //parses function name
     if (state->next == TOK_IDENTIFIER)
     {
+        node_at(state, node)->tok = state->index;
         match(state, TOK_IDENTIFIER);
     }
     else
@@ -748,37 +918,59 @@ void function_declaration(ParState *state)
         sync_to_follow(state);
         state->sync_set = saved_sync;
 
-        printf("[EXIT ] function_declaration\n");
-        return;
+        trace_exit(state, "function_declaration");
+        return node;
     }
 
     //parses '('
     match(state, TOK_LPAREN);
 
     //parses optional parameter list
-    parameter_list(state);
+    set_list(state, node, parameter_list(state));
 
     //parses ')'
     match(state, TOK_RPAREN);
 
-    //parses function body
-    block(state);
+    //an EXTERN function may leave its body to another module: EXTERN HEL: f(HEL: x);
+    if ((flags & AST_FLAG_EXTERN) && state->next == TOK_SEMI)
+        match(state, TOK_SEMI);
+    else
+        set_kid(state, node, 1, block(state));
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] function_declaration\n");
+    trace_exit(state, "function_declaration");
+
+    return node;
 }
 
-void declaration_statement(ParState *state)
+int declaration_statement(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
+    int type;
+    int flags = 0;
 
-    printf("[ENTER] declaration_statement\n");
+    trace_enter(state, "declaration_statement");
 
     saved_sync = state->sync_set;
 
+    //consumes optional EXTERN storage specifier
+    if (state->next == TOK_EXTERN)
+    {
+        match(state, TOK_EXTERN);
+        flags |= AST_FLAG_EXTERN;
+    }
+
+    if (state->next == TOK_STATISK)
+        flags |= AST_FLAG_STATIC;
+
+    node = new_node(state, AST_VAR_DECL);
+    node_at(state, node)->flags = flags;
+
     //parses the type part
-    type_specifier(state);
+    type = type_specifier(state);
+    node_at(state, node)->kid[0] = type;
 
     //expects ':'
     if (state->next != TOK_ASSIGN)
@@ -794,15 +986,32 @@ void declaration_statement(ParState *state)
         syntax_error_at(state, "expected identifier in declaration");
         goto recover;
     }
+    node_at(state, node)->tok = state->index;
     next_token(state);
 
+    //optional array suffix on the name: HEL: xs<4>;
+    while (state->next == TOK_LBLOCK)
+    {
+        int head = node_at(state, type)->list;
+        int tail = head;
+
+        while (tail != AST_NULL && node_at(state, tail)->next != AST_NULL)
+            tail = node_at(state, tail)->next;
+
+        match(state, TOK_LBLOCK);
+        ast_append(state->ast, &head, &tail, expression(state));
+        match(state, TOK_RBLOCK);
+
+        node_at(state, type)->list = head;
+    }
+
     //allows either ';' or ', <expr> ;'
     if (state->next == TOK_SEMI)
     {
         next_token(state);
         state->sync_set = saved_sync;
-        printf("[EXIT ] declaration_statement\n");
-        return;
+        trace_exit(state, "declaration_statement");
+        return node;
     }
 
     //initializer branch
@@ -814,7 +1023,7 @@ void declaration_statement(ParState *state)
     next_token(state);
 
     //parses initializer expression
-    expression(state);
+    set_kid(state, node, 1, expression(state));
 
     //expects ';' at end
     if (state->next != TOK_SEMI)
@@ -825,8 +1034,8 @@ void declaration_statement(ParState *state)
     next_token(state);
 
     state->sync_set = saved_sync;
-    printf("[EXIT ] declaration_statement\n");
-    return;
+    trace_exit(state, "declaration_statement");
+    return node;
 
 recover:
     //skips to a safe boundary for declarations
@@ -842,23 +1051,85 @@ recover:
         next_token(state);
 
     state->sync_set = saved_sync;
-    printf("[EXIT ] declaration_statement\n");
+    trace_exit(state, "declaration_statement");
+    return node;
 }
 
-static void optional_type_array_suffix(ParState *state)
+static int optional_type_array_suffix(ParState *state)
 {
+    int dim = AST_NULL;
+
     // consumes '<expr>' when used as a suffix on a type
     if (state->next == TOK_LBLOCK)
     {
         match(state, TOK_LBLOCK);
-        expression(state);
+        dim = expression(state);
         match(state, TOK_RBLOCK);
     }
+
+    return dim;
+}
+
+// -------------------------------------------
+// struct field list shared by STRUKTUR and TYPDEF STRUKTUR:
+//   type_specifier ':' ID [ '<' expr '>' ] ';'
+// -------------------------------------------
+static int struct_field_list(ParState *state)
+{
+    int head = AST_NULL;
+    int tail = AST_NULL;
+
+    while (state->next != TOK_RBLOCK && state->next != TOK_EOF)
+    {
+        int field = new_node(state, AST_FIELD_DECL);
+        int type;
+
+        // field type, including any type-array suffix: person<2>: föräldrar;
+        type = type_specifier(state);
+        node_at(state, field)->kid[0] = type;
+
+        // ':'
+        match(state, TOK_ASSIGN);
+
+        // field name
+        if (state->next == TOK_IDENTIFIER)
+        {
+            node_at(state, field)->tok = state->index;
+            match(state, TOK_IDENTIFIER);
+        }
+        else
+        {
+            syntax_error_at(state, "expected field name");
+            sync_to_follow(state);
+            break;
+        }
+
+        // optional array suffix on the field name
+        if (state->next == TOK_LBLOCK)
+        {
+            int dims = node_at(state, type)->list;
+            int last = dims;
+
+            while (last != AST_NULL && node_at(state, last)->next != AST_NULL)
+                last = node_at(state, last)->next;
+
+            ast_append(state->ast, &dims, &last, optional_type_array_suffix(state));
+            node_at(state, type)->list = dims;
+        }
+
+        match(state, TOK_SEMI);
+
+        ast_append(state->ast, &head, &tail, field);
+    }
+
+    return head;
 }
 
-void typedef_declaration(ParState *state)
+int typedef_declaration(ParState *state)
 {
-    printf("[ENTER] typedef_declaration\n");
+    int node;
+
+    trace_enter(state, "typedef_declaration");
 
     match(state, TOK_TYPDEF);
 
@@ -866,159 +1137,113 @@ void typedef_declaration(ParState *state)
     {
         match(state, TOK_STRUKTUR);
 
+        node = new_node(state, AST_STRUCT_DECL);
+        node_at(state, node)->flags = AST_FLAG_TYPEDEF;
+
         // struct name
         if (state->next == TOK_IDENTIFIER)
+        {
+            declare_type_name(state, state->index);
             match(state, TOK_IDENTIFIER);
+        }
         else
         {
             state->error_count++;
-            printf("Syntax error: expected struct name in typedef\n");
+            fprintf(state->out, "Syntax error at %d:%d: expected struct name in typedef\n",
+                    error_token(state)->row, error_token(state)->col);
             sync_to_follow(state);
-            printf("[EXIT ] typedef_declaration\n");
-            return;
+            trace_exit(state, "typedef_declaration");
+            return node;
         }
 
         match(state, TOK_LBLOCK);
 
-        // -------------------------------------------
-        // struct field list:
-        //   type_specifier [ '<' expr '>' ] ':' ID [ '<' expr '>' ] ';'
-        // -------------------------------------------
-        while (state->next != TOK_RBLOCK && state->next != TOK_EOF)
-        {
-            // field type
-            type_specifier(state);
-
-            // optional array suffix on the type: person<2>: föräldrar;
-            if (state->next == TOK_LBLOCK)
-            {
-                match(state, TOK_LBLOCK);
-                expression(state);
-                match(state, TOK_RBLOCK);
-            }
-
-            // ':'
-            match(state, TOK_ASSIGN);
+        set_list(state, node, struct_field_list(state));
 
-            // field name
-            if (state->next == TOK_IDENTIFIER)
-                match(state, TOK_IDENTIFIER);
-            else
-            {
-                state->error_count++;
-                printf("Syntax error: expected field name in struct\n");
-                sync_to_follow(state);
-                break;
-            }
-
-            // optional array suffix on the field name (keep if you want both forms)
-            if (state->next == TOK_LBLOCK)
-            {
-                match(state, TOK_LBLOCK);
-                expression(state);
-                match(state, TOK_RBLOCK);
-            }
+        match(state, TOK_RBLOCK);
 
+        // optional trailing ';'
+        if (state->next == TOK_SEMI)
             match(state, TOK_SEMI);
-        }
-
-        match(state, TOK_RBLOCK);
     }
     else
     {
         // TYPDEF <type> ID ;
-        type_specifier(state);
+        int type = type_specifier(state);
+
+        node = new_node(state, AST_TYPEDEF);
+        node_at(state, node)->kid[0] = type;
 
         if (state->next == TOK_IDENTIFIER)
+        {
+            declare_type_name(state, state->index);
             match(state, TOK_IDENTIFIER);
+        }
         else
         {
             state->error_count++;
-            printf("Syntax error: expected typedef name\n");
+            fprintf(state->out, "Syntax error at %d:%d: expected typedef name\n",
+                    error_token(state)->row, error_token(state)->col);
             sync_to_follow(state);
         }
 
         match(state, TOK_SEMI);
     }
 
-    printf("[EXIT ] typedef_declaration\n");
+    trace_exit(state, "typedef_declaration");
+
+    return node;
 }
 
-void struct_declaration(ParState *state)
+int struct_declaration(ParState *state)
 {
-    printf("[ENTER] struct_declaration\n");
+    int node;
+
+    trace_enter(state, "struct_declaration");
 
     // consumes STRUKTUR
     match(state, TOK_STRUKTUR);
 
+    node = new_node(state, AST_STRUCT_DECL);
+
     // consumes struct name
     if (state->next == TOK_IDENTIFIER)
     {
+        declare_type_name(state, state->index);
         match(state, TOK_IDENTIFIER);
     }
     else
     {
         syntax_error_at(state, "expected struct name");
         sync_to_follow(state);
-        printf("[EXIT ] struct_declaration\n");
-        return;
+        trace_exit(state, "struct_declaration");
+        return node;
     }
 
     // consumes '<'
     match(state, TOK_LBLOCK);
 
     // parses zero or more fields until '>' or EOF
-    while (state->next != TOK_RBLOCK && state->next != TOK_EOF)
-    {
-        // parses the field type
-        type_specifier(state);
-
-        // optional type-array suffix: person<2>: föräldrar;
-        if (state->next == TOK_LBLOCK)
-        {
-            match(state, TOK_LBLOCK);
-            expression(state);
-            match(state, TOK_RBLOCK);
-        }
-
-        // consumes ':'
-        match(state, TOK_ASSIGN);
-
-        // parses field name
-        if (state->next == TOK_IDENTIFIER)
-        {
-            match(state, TOK_IDENTIFIER);
-        }
-        else
-        {
-            syntax_error_at(state, "expected field name");
-            sync_to_follow(state);
-            break;
-        }
+    set_list(state, node, struct_field_list(state));
 
-        // optional field-array suffix (keep it if you want arrays after field names too)
-        if (state->next == TOK_LBLOCK)
-        {
-            match(state, TOK_LBLOCK);
-            expression(state);
-            match(state, TOK_RBLOCK);
-        }
+    // consumes '>'
+    match(state, TOK_RBLOCK);
 
-        // consumes ';'
+    // optional trailing ';'
+    if (state->next == TOK_SEMI)
         match(state, TOK_SEMI);
-    }
 
-    // consumes '>'
-    match(state, TOK_RBLOCK);
+    trace_exit(state, "struct_declaration");
 
-    printf("[EXIT ] struct_declaration\n");
+    return node;
 }
 
-void initializer(ParState *state)
+int initializer(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
 
-    printf("[ENTER] initializer\n");
+    trace_enter(state, "initializer");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_expression;
@@ -1026,40 +1251,50 @@ void initializer(ParState *state)
     /* aggregate literal starts with '<' */
     if (state->next == TOK_LBLOCK)
     {
+        int head = AST_NULL;
+        int tail = AST_NULL;
+
+        node = new_node(state, AST_ARRAY_LIT);
+
         /* '<' */
         match(state, TOK_LBLOCK);
 
         /* optional aggregate_value_list */
         if (state->next != TOK_RBLOCK)
         {
-            expression(state);
+            ast_append(state->ast, &head, &tail, expression(state));
 
             while (state->next == TOK_COMMA)
             {
                 match(state, TOK_COMMA);
-                expression(state);
+                ast_append(state->ast, &head, &tail, expression(state));
             }
         }
 
         /* '>' */
         match(state, TOK_RBLOCK);
+
+        node_at(state, node)->list = head;
     }
     else
     {
         /* otherwise, normal expression */
-        expression(state);
+        node = expression(state);
     }
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] initializer\n");
+    trace_exit(state, "initializer");
+
+    return node;
 }
 
-void type_declaration(ParState *state)
+int type_declaration(ParState *state)
 {
     const TokenType *saved_sync;
+    int node = AST_NULL;
 
-    printf("[ENTER] type_declaration\n");
+    trace_enter(state, "type_declaration");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_global_statement;
@@ -1067,15 +1302,15 @@ void type_declaration(ParState *state)
     switch (state->next)
     {
         case TOK_TYPDEF:
-            typedef_declaration(state);
+            node = typedef_declaration(state);
             break;
 
         case TOK_STRUKTUR:
-            struct_declaration(state);
+            node = struct_declaration(state);
             break;
 
         case TOK_ENUM:
-            enum_declaration(state);
+            node = enum_declaration(state);
             break;
 
         default:
@@ -1090,23 +1325,32 @@ void type_declaration(ParState *state)
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] type_declaration\n");
+    trace_exit(state, "type_declaration");
+
+    return node;
 }
 
-void enum_declaration(ParState *state)
+int enum_declaration(ParState *state)
 {
-    printf("[ENTER] enum_declaration\n");
+    int node;
+    int head = AST_NULL;
+    int tail = AST_NULL;
+
+    trace_enter(state, "enum_declaration");
 
     match(state, TOK_ENUM);
 
+    node = new_node(state, AST_ENUM_DECL);
+
     if (state->next != TOK_IDENTIFIER)
     {
         syntax_error_at(state, "expected enum name after ENUM");
         sync_to_follow(state);
-        printf("[EXIT ] enum_declaration\n");
-        return;
+        trace_exit(state, "enum_declaration");
+        return node;
     }
 
+    declare_type_name(state, state->index);
     match(state, TOK_IDENTIFIER);
 
     match(state, TOK_LBLOCK);
@@ -1115,21 +1359,25 @@ void enum_declaration(ParState *state)
     {
         syntax_error_at(state, "expected enumerator inside ENUM < ... >");
         sync_to_follow(state);
-        printf("[EXIT ] enum_declaration\n");
-        return;
+        trace_exit(state, "enum_declaration");
+        return node;
     }
 
     while (state->next == TOK_IDENTIFIER)
     {
+        int item = new_node(state, AST_ENUMERATOR);
+
         match(state, TOK_IDENTIFIER);
 
         // optional explicit value: NAME : <expr>
         if (state->next == TOK_ASSIGN)
         {
             match(state, TOK_ASSIGN);
-            expression(state);
+            set_kid(state, item, 0, expression(state));
         }
 
+        ast_append(state->ast, &head, &tail, item);
+
         if (state->next == TOK_COMMA)
         {
             match(state, TOK_COMMA);
@@ -1141,11 +1389,15 @@ void enum_declaration(ParState *state)
 
     match(state, TOK_RBLOCK);
 
+    node_at(state, node)->list = head;
+
     // optional trailing ';' if you want it
     if (state->next == TOK_SEMI)
         match(state, TOK_SEMI);
 
-    printf("[EXIT ] enum_declaration\n");
+    trace_exit(state, "enum_declaration");
+
+    return node;
 }
 
 int scan_after_type_specifier(const ParState *state, int start_index)
@@ -1188,9 +1440,31 @@ int scan_after_type_specifier(const ParState *state, int start_index)
     return i;
 }
 
-void type_specifier(ParState *state)
+int type_specifier(ParState *state)
 {
-    printf("[ENTER] type_specifier\n");
+    int node;
+    int head = AST_NULL;
+    int tail = AST_NULL;
+    int flags = 0;
+    int saw_qualifier = 0;
+
+    trace_enter(state, "type_specifier");
+
+    //consumes qualifiers and signedness modifiers ahead of the base type
+    while (is_type_qualifier(state->next))
+    {
+        if (state->next == TOK_OSIGNERAD)
+            flags |= AST_FLAG_UNSIGNED;
+        else if (state->next == TOK_KONSTANT)
+            flags |= AST_FLAG_CONST;
+
+        saw_qualifier = 1;
+        match(state, state->next);
+    }
+
+    node = new_node(state, AST_TYPE);
+    node_at(state, node)->flags = flags;
+    node_at(state, node)->op    = state->next;
 
     switch (state->next)
     {
@@ -1203,6 +1477,10 @@ void type_specifier(ParState *state)
         case TOK_ORD:
         case TOK_VAL:
         case TOK_TOM:
+        case TOK_KORT:
+        case TOK_LANG:
+        case TOK_DUBBEL:
+        case TOK_LANG_DUBBEL:
             //consumes built-in types
             match(state, state->next);
             break;
@@ -1218,68 +1496,93 @@ void type_specifier(ParState *state)
 
             //expects the struct type name
             if (state->next == TOK_IDENTIFIER)
+            {
+                node_at(state, node)->tok = state->index;
                 match(state, TOK_IDENTIFIER);
+            }
             else
             {
                 syntax_error_at(state, "expected struct type name after STRUKTUR");
                 sync_to_follow(state);
-                printf("[EXIT ] type_specifier\n");
-                return;
+                trace_exit(state, "type_specifier");
+                return node;
             }
             break;
 
         default:
+            //a bare OSIGNERAD / SIGNERAD means HEL
+            if (saw_qualifier)
+            {
+                node_at(state, node)->op  = TOK_HEL;
+                node_at(state, node)->tok = -1;
+                break;
+            }
+
             syntax_error_at(state, "expected type specifier");
             sync_to_follow(state);
-            printf("[EXIT ] type_specifier\n");
-            return;
+            trace_exit(state, "type_specifier");
+            return node;
     }
 
     //consume pointers: PEK*
     while (state->next == TOK_PEK)
+    {
         match(state, TOK_PEK);
+        node_at(state, node)->aux++;
+    }
 
     //consume array dimensions: < expr > (repeatable)
     while (state->next == TOK_LBLOCK)
     {
         match(state, TOK_LBLOCK);
-        expression(state);
+        ast_append(state->ast, &head, &tail, expression(state));
         match(state, TOK_RBLOCK);
     }
 
-    printf("[EXIT ] type_specifier\n");
+    node_at(state, node)->list = head;
+
+    trace_exit(state, "type_specifier");
+
+    return node;
 }
 
-void parameter_list(ParState *state)
+int parameter_list(ParState *state)
 {
     const TokenType *saved_sync;
+    int head = AST_NULL;
+    int tail = AST_NULL;
 
-    printf("[ENTER] parameter_list\n");
+    trace_enter(state, "parameter_list");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_parameter_list;
 
     if (state->next != TOK_RPAREN)
     {
-        parameter(state);
+        ast_append(state->ast, &head, &tail, parameter(state));
 
         while (state->next == TOK_COMMA)
         {
             match(state, TOK_COMMA);
-            parameter(state);
+            ast_append(state->ast, &head, &tail, parameter(state));
         }
     }
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] parameter_list\n");
+    trace_exit(state, "parameter_list");
+
+    return head;
 }
 
-void parameter(ParState *state)
+int parameter(ParState *state)
 {
-    printf("[ENTER] parameter\n");
+    int node;
+
+    trace_enter(state, "parameter");
 
-    type_specifier(state);
+    node = new_node(state, AST_PARAM);
+    set_kid(state, node, 0, type_specifier(state));
 
     //enforces ':' between type and identifier
     if (state->next == TOK_ASSIGN)
@@ -1294,6 +1597,7 @@ void parameter(ParState *state)
 
     if (state->next == TOK_IDENTIFIER)
     {
+        node_at(state, node)->tok = state->index;
         match(state, TOK_IDENTIFIER);
     }
     else
@@ -1302,14 +1606,17 @@ void parameter(ParState *state)
         //recovery: let caller sync
     }
 
-    printf("[EXIT ] parameter\n");
+    trace_exit(state, "parameter");
+
+    return node;
 }
 
-void block(ParState *state)
+int block(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
 
-    printf("[ENTER] block\n");
+    trace_enter(state, "block");
 
     // save outer sync set
     saved_sync = state->sync_set;
@@ -1317,11 +1624,13 @@ void block(ParState *state)
     // block-specific recovery
     state->sync_set = FOLLOW_block;
 
+    node = new_node(state, AST_BLOCK);
+
     // opening delimiter
     match(state, TOK_LBLOCK);
 
     // zero or more statements
-    statement_list(state);
+    set_list(state, node, statement_list(state));
 
     // closing delimiter
     match(state, TOK_RBLOCK);
@@ -1329,14 +1638,18 @@ void block(ParState *state)
     // restore outer sync set
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] block\n");
+    trace_exit(state, "block");
+
+    return node;
 }
 
-void statement_list(ParState *state)
+int statement_list(ParState *state)
 {
     const TokenType *saved_sync;
+    int head = AST_NULL;
+    int tail = AST_NULL;
 
-    printf("[ENTER] statement_list\n");
+    trace_enter(state, "statement_list");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_statement_list;
@@ -1345,15 +1658,40 @@ void statement_list(ParState *state)
            state->next != TOK_ANNARS &&
            state->next != TOK_EOF)
     {
-        statement(state);
+        int start_index = state->index;
+
+        ast_append(state->ast, &head, &tail, statement(state));
+
+        //guarantees progress when recovery stopped on the offending token
+        if (state->index == start_index)
+            next_token(state);
     }
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] statement_list\n");
+    trace_exit(state, "statement_list");
+
+    return head;
 }
 
+static int lookahead_scan(ParState *state, const TokenType *targets, int target_count, int max_ahead);
+
+//a trace event of its own, so statements that make the parser scan far ahead show up; not in the text trace
 static int lookahead_contains_any_until_boundary(ParState *state, const TokenType *targets, int target_count, int max_ahead)
+{
+    int found;
+
+    if (!state->events)
+        return lookahead_scan(state, targets, target_count, max_ahead);
+
+    trace_begin(state->events, "lookahead_contains_any_until_boundary");
+    found = lookahead_scan(state, targets, target_count, max_ahead);
+    trace_end(state->events, "lookahead_contains_any_until_boundary");
+
+    return found;
+}
+
+static int lookahead_scan(ParState *state, const TokenType *targets, int target_count, int max_ahead)
 {
     int i;
     int k;
@@ -1395,35 +1733,14 @@ static int lookahead_contains_any_until_boundary(ParState *state, const TokenTyp
         }
     }
 
-    return 0;
-}
-
-static void update_statement(ParState *state)
-{
-    int lvalue_start_index;
-
-    //tracks progress so we can bail out cleanly on lvalue failure
-    lvalue_start_index = state->index;
-
-    //parses the lvalue portion (supports VÄRDE VID, FÄLT, arrays, identifiers)
-    if (state->next == TOK_DEREF || state->next == TOK_FALT || state->next == TOK_IDENTIFIER)
-    {
-        lvalue(state);
-    }
-    else
-    {
-        syntax_error_at(state, "expected lvalue before update operator");
-        sync_to_follow(state);
-        return;
-    }
-
-    //if lvalue() failed and did not advance, abort to avoid cascading errors
-    if (state->index == lvalue_start_index)
-    {
-        syntax_error_at(state, "expected lvalue before update operator");
-        sync_to_follow(state);
-        return;
-    }
+    return 0;
+}
+
+//parses the operator part of an update statement once the lvalue is known
+//returns the UPDATE node, or AST_NULL if no update operator follows
+static int update_operator(ParState *state, int target)
+{
+    int node;
 
     //handles compound shift-updates
     //x SKIFT VÄNSTER MED 3;
@@ -1437,84 +1754,103 @@ static void update_statement(ParState *state)
         {
             syntax_error_at(state, "expected VÄNSTER MED or HÖGER MED after SKIFT");
             sync_to_follow(state);
-            return;
+            return AST_NULL;
         }
 
+        node = new_node(state, AST_UPDATE);
+        node_at(state, node)->op     = state->next;
+        node_at(state, node)->kid[0] = target;
+
         //consumes TOK_SHL_ASSIGN or TOK_SHR_ASSIGN
         next_token(state);
 
         //parses shift amount
-        expression(state);
-
-        //ends the statement
-        match(state, TOK_SEMI);
-        return;
+        set_kid(state, node, 1, expression(state));
+        return node;
     }
 
-    //handles postfix increment (ÖKAR)
-    if (state->next == TOK_OKAR)
+    switch (state->next)
     {
-        match(state, TOK_OKAR);
-        match(state, TOK_SEMI);
-        return;
-    }
+        //handles postfix increment/decrement (ÖKAR / MINSKAR)
+        case TOK_OKAR:
+        case TOK_MINSKAR:
+            node = new_node(state, AST_UPDATE);
+            node_at(state, node)->op     = state->next;
+            node_at(state, node)->kid[0] = target;
+            match(state, state->next);
+            return node;
 
-    //handles postfix decrement (MINSKAR)
-    if (state->next == TOK_MINSKAR)
-    {
-        match(state, TOK_MINSKAR);
-        match(state, TOK_SEMI);
-        return;
+        //handles ÖKAR MED / MINSKAR MED / MULT MED / DELAS MED
+        case TOK_PLUS_ASSIGN:
+        case TOK_MINUS_ASSIGN:
+        case TOK_MUL_ASSIGN:
+        case TOK_DIV_ASSIGN:
+            node = new_node(state, AST_UPDATE);
+            node_at(state, node)->op     = state->next;
+            node_at(state, node)->kid[0] = target;
+            match(state, state->next);
+            set_kid(state, node, 1, expression(state));
+            return node;
+
+        default:
+            return AST_NULL;
     }
+}
 
-    //handles plus-assign (ÖKAR MED)
-    if (state->next == TOK_PLUS_ASSIGN)
+static int update_statement(ParState *state)
+{
+    int lvalue_start_index;
+    int target;
+    int node;
+
+    //tracks progress so we can bail out cleanly on lvalue failure
+    lvalue_start_index = state->index;
+
+    //parses the lvalue portion (supports VÄRDE VID, FÄLT, arrays, identifiers)
+    if (state->next == TOK_DEREF || state->next == TOK_FALT || state->next == TOK_IDENTIFIER)
     {
-        match(state, TOK_PLUS_ASSIGN);
-        expression(state);
-        match(state, TOK_SEMI);
-        return;
+        target = lvalue(state);
     }
-
-    //handles minus-assign (MINSKAR MED)
-    if (state->next == TOK_MINUS_ASSIGN)
+    else
     {
-        match(state, TOK_MINUS_ASSIGN);
-        expression(state);
-        match(state, TOK_SEMI);
-        return;
+        syntax_error_at(state, "expected lvalue before update operator");
+        sync_to_follow(state);
+        return AST_NULL;
     }
 
-    //handles mul-assign (MULT MED)
-    if (state->next == TOK_MUL_ASSIGN)
+    //if lvalue() failed and did not advance, abort to avoid cascading errors
+    if (state->index == lvalue_start_index)
     {
-        match(state, TOK_MUL_ASSIGN);
-        expression(state);
-        match(state, TOK_SEMI);
-        return;
+        syntax_error_at(state, "expected lvalue before update operator");
+        sync_to_follow(state);
+        return AST_NULL;
     }
 
-    //handles div-assign (DELAS MED)
-    if (state->next == TOK_DIV_ASSIGN)
+    node = update_operator(state, target);
+
+    if (node == AST_NULL)
     {
-        match(state, TOK_DIV_ASSIGN);
-        expression(state);
-        match(state, TOK_SEMI);
-        return;
+        if (!state->panic_mode)
+            syntax_error_at(state, "expected update operator after lvalue");
+        sync_to_follow(state);
+        return AST_NULL;
     }
 
-    syntax_error_at(state, "expected update operator after lvalue");
-    sync_to_follow(state);
+    //ends the statement
+    match(state, TOK_SEMI);
+    return node;
 }
 
-void statement(ParState *state)
+int statement(ParState *state)
 {
     const TokenType *saved_sync;
+    int node = AST_NULL;
 
-    printf("[ENTER] statement\n");
+    trace_enter(state, "statement");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_statement;
+    state->panic_mode = 0;
 
     //dispatch based on the first token
     switch (state->next)
@@ -1522,6 +1858,11 @@ void statement(ParState *state)
         case TOK_HEL:
         case TOK_FLYT:
         case TOK_BOK:
+        case TOK_BIT:
+        case TOK_HALV:
+        case TOK_BYTE:
+        case TOK_ORD:
+        case TOK_VAL:
         case TOK_STRUKTUR:
         case TOK_TOM:
         case TOK_OSIGNERAD:
@@ -1530,54 +1871,59 @@ void statement(ParState *state)
         case TOK_LANG:
         case TOK_DUBBEL:
         case TOK_LANG_DUBBEL:
+        case TOK_KONSTANT:
+        case TOK_STATISK:
         case TOK_VOLATIL:
         case TOK_BEGRANSA:
         case TOK_EXTERN:
         case TOK_AUTO:
         case TOK_REGISTER:
             //declaration statements (including EXTERN)
-            declaration_statement(state);
+            node = declaration_statement(state);
             break;
 
         case TOK_ATERVAND:
-            return_statement(state);
+            node = return_statement(state);
             break;
 
         case TOK_OM:
-            if_statement(state);
+            node = if_statement(state);
             break;
 
         case TOK_FOR:
-            for_statement(state);
+            node = for_statement(state);
             break;
 
         case TOK_MEDAN:
+            node = while_statement(state);
+            break;
+
         case TOK_GOR:
-            do_while_statement(state);
+            node = do_while_statement(state);
             break;
 
         case TOK_VAXEL:
-            switch_statement(state);
+            node = switch_statement(state);
             break;
 
         case TOK_BRYT:
-            break_statement(state);
+            node = break_statement(state);
             break;
 
         case TOK_FORTSATT:
-            continue_statement(state);
+            node = continue_statement(state);
             break;
 
         case TOK_GOTO:
-            goto_statement(state);
+            node = goto_statement(state);
             break;
 
         case TOK_ETIKETT:
-            label_statement(state);
+            node = label_statement(state);
             break;
 
         case TOK_LBLOCK:
-            block(state);
+            node = block(state);
             break;
 
         case TOK_IDENTIFIER:
@@ -1597,7 +1943,18 @@ void statement(ParState *state)
 
             const TokenType assign_ops[] = { TOK_ASSIGN };
 
-            //routes user-defined type declarations (heuristic)
+            //routes user-defined type declarations
+            //TYPE: name; TYPE PEK: name; TYPE<3>: name; for declared TYPDEF/STRUKTUR/ENUM names
+            if (is_type_name(state, state->index) &&
+                (peek_token(state, 1) == TOK_ASSIGN ||
+                 peek_token(state, 1) == TOK_PEK ||
+                 peek_token(state, 1) == TOK_LBLOCK) &&
+                is_declaration_statement_start(state))
+            {
+                node = declaration_statement(state);
+                break;
+            }
+
             //TYPE: name, init;
             //Without a symbol table, distinguish from assignment by requiring a comma after the declared name.
             if (state->next == TOK_IDENTIFIER &&
@@ -1605,26 +1962,26 @@ void statement(ParState *state)
                 peek_token(state, 2) == TOK_IDENTIFIER &&
                 peek_token(state, 3) == TOK_COMMA)
             {
-                declaration_statement(state);
+                node = declaration_statement(state);
                 break;
             }
 
             //routes update-style statements (ÖKAR/MINSKAR/… and SKIFT … MED …)
             if (lookahead_contains_any_until_boundary(state, update_ops, 7, 32))
             {
-                update_statement(state);
+                node = update_statement(state);
                 break;
             }
 
             //routes assignment-style statements (lvalue ':' expr ';')
             if (lookahead_contains_any_until_boundary(state, assign_ops, 1, 16))
             {
-                assignment_statement(state);
+                node = assignment_statement(state);
                 break;
             }
 
             //fallback: expression statement
-            expression_statement(state);
+            node = expression_statement(state);
             break;
         }
 
@@ -1632,163 +1989,220 @@ void statement(ParState *state)
             syntax_error_at(state, "unexpected token in statement");
             //recovery
             sync_to_follow(state);
+
+            //drops the terminator of the broken statement
+            if (state->next == TOK_SEMI)
+                next_token(state);
             break;
     }
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] statement\n");
+    trace_exit(state, "statement");
+
+    return node;
 }
 
-static void goto_statement(ParState *state)
+static int goto_statement(ParState *state)
 {
-    printf("[ENTER] goto_statement\n");
+    int node;
+
+    trace_enter(state, "goto_statement");
 
     match(state, TOK_GOTO);
 
+    node = new_node(state, AST_GOTO);
+
     if (state->next != TOK_IDENTIFIER)
     {
         syntax_error_at(state, "expected label identifier after GÅ TILL");
         sync_to_follow(state);
-        printf("[EXIT ] goto_statement\n");
-        return;
+        trace_exit(state, "goto_statement");
+        return node;
     }
 
     match(state, TOK_IDENTIFIER);
     match(state, TOK_SEMI);
 
-    printf("[EXIT ] goto_statement\n");
+    trace_exit(state, "goto_statement");
+
+    return node;
 }
 
-static void label_statement(ParState *state)
+static int label_statement(ParState *state)
 {
-    printf("[ENTER] label_statement\n");
+    int node;
+
+    trace_enter(state, "label_statement");
 
     match(state, TOK_ETIKETT);
 
+    node = new_node(state, AST_LABEL);
+
     if (state->next != TOK_IDENTIFIER)
     {
         syntax_error_at(state, "expected label identifier after ETIKETT");
         sync_to_follow(state);
-        printf("[EXIT ] label_statement\n");
-        return;
+        trace_exit(state, "label_statement");
+        return node;
     }
 
     match(state, TOK_IDENTIFIER);
     match(state, TOK_SEMI);
 
-    printf("[EXIT ] label_statement\n");
+    trace_exit(state, "label_statement");
+
+    return node;
 }
 
-void break_statement(ParState *state)
+int break_statement(ParState *state)
 {
-    printf("[ENTER] break_statement\n");
+    int node;
+
+    trace_enter(state, "break_statement");
+
+    node = new_node(state, AST_BREAK);
 
     match(state, TOK_BRYT);
     match(state, TOK_SEMI);
 
-    printf("[EXIT ] break_statement\n");
+    trace_exit(state, "break_statement");
+
+    return node;
+}
+
+//wraps base in an INDEX node when an array suffix '<expr>' follows
+static int optional_index_suffix(ParState *state, int base)
+{
+    while (state->next == TOK_LBLOCK)
+    {
+        int node = new_node(state, AST_INDEX);
+
+        match(state, TOK_LBLOCK);
+
+        node_at(state, node)->kid[0] = base;
+        set_kid(state, node, 1, expression(state));
+
+        match(state, TOK_RBLOCK);
+
+        base = node;
+    }
+
+    return base;
 }
 
-void lvalue(ParState *state)
+int lvalue(ParState *state)
 {
-    printf("[ENTER] lvalue\n");
+    int node;
+
+    trace_enter(state, "lvalue");
 
     // deref lvalue: VÄRDE VID <lvalue> | VÄRDE VID (<expression>)
     if (state->next == TOK_DEREF)
     {
+        node = new_node(state, AST_DEREF);
+
         match(state, TOK_DEREF);
 
         if (state->next == TOK_LPAREN)
         {
             match(state, TOK_LPAREN);
-            expression(state);
+            set_kid(state, node, 0, expression(state));
             match(state, TOK_RPAREN);
-            printf("[EXIT ] lvalue\n");
-            return;
+            trace_exit(state, "lvalue");
+            return node;
         }
 
         // allow chained deref/field/identifier targets
         if (state->next == TOK_DEREF)
         {
-            lvalue(state);
-            printf("[EXIT ] lvalue\n");
-            return;
+            set_kid(state, node, 0, lvalue(state));
+            trace_exit(state, "lvalue");
+            return node;
         }
 
         if (state->next == TOK_FALT)
         {
-            field_access(state);
-            printf("[EXIT ] lvalue\n");
-            return;
+            set_kid(state, node, 0, field_access(state));
+            trace_exit(state, "lvalue");
+            return node;
         }
 
         if (state->next == TOK_IDENTIFIER)
         {
+            int ident = new_node(state, AST_IDENT);
+
             match(state, TOK_IDENTIFIER);
 
             // optional array suffix: p<1>
-            if (state->next == TOK_LBLOCK)
-            {
-                match(state, TOK_LBLOCK);
-                expression(state);
-                match(state, TOK_RBLOCK);
-            }
+            set_kid(state, node, 0, optional_index_suffix(state, ident));
 
-            printf("[EXIT ] lvalue\n");
-            return;
+            trace_exit(state, "lvalue");
+            return node;
         }
 
         syntax_error_at(state, "expected lvalue after VÄRDE VID");
         sync_to_follow(state);
-        printf("[EXIT ] lvalue\n");
-        return;
+        trace_exit(state, "lvalue");
+        return node;
     }
 
     // field lvalue
     if (state->next == TOK_FALT)
     {
-        field_access(state);
-        printf("[EXIT ] lvalue\n");
-        return;
+        node = field_access(state);
+        trace_exit(state, "lvalue");
+        return node;
     }
 
     // identifier (optionally array)
     if (state->next == TOK_IDENTIFIER)
     {
+        node = new_node(state, AST_IDENT);
+
         match(state, TOK_IDENTIFIER);
 
-        if (state->next == TOK_LBLOCK)
-        {
-            match(state, TOK_LBLOCK);
-            expression(state);
-            match(state, TOK_RBLOCK);
-        }
+        node = optional_index_suffix(state, node);
 
-        printf("[EXIT ] lvalue\n");
-        return;
+        trace_exit(state, "lvalue");
+        return node;
     }
 
     syntax_error_at(state, "expected lvalue");
     sync_to_follow(state);
-    printf("[EXIT ] lvalue\n");
+    trace_exit(state, "lvalue");
+    return AST_NULL;
 }
 
-void array_access(ParState *state)
+int array_access(ParState *state)
 {
-    printf("[ENTER] array_access\n");
+    int base;
+    int node;
 
+    trace_enter(state, "array_access");
+
+    base = new_node(state, AST_IDENT);
     match(state, TOK_IDENTIFIER);
+
+    node = new_node(state, AST_INDEX);
     match(state, TOK_LBLOCK);
-    expression(state);
+    node_at(state, node)->kid[0] = base;
+    set_kid(state, node, 1, expression(state));
     match(state, TOK_RBLOCK);
 
-    printf("[EXIT ] array_access\n");
+    //a[i]<j> style multi-dimensional access
+    node = optional_index_suffix(state, node);
+
+    trace_exit(state, "array_access");
+
+    return node;
 }
 
-void field_access(ParState *state)
+int field_access(ParState *state)
 {
-    printf("[ENTER] field_access\n");
+    int node;
+
+    trace_enter(state, "field_access");
 
     match(state, TOK_FALT);
 
@@ -1797,86 +2211,82 @@ void field_access(ParState *state)
     {
         syntax_error_at(state, "expected identifier after FÄLT");
         sync_to_follow(state);
-        printf("[EXIT ] field_access\n");
-        return;
+        trace_exit(state, "field_access");
+        return AST_NULL;
     }
 
     //consumes the base identifier
+    node = new_node(state, AST_IDENT);
     match(state, TOK_IDENTIFIER);
 
     //allows array suffix on the base: ps<0>
-    if (state->next == TOK_LBLOCK)
-    {
-        match(state, TOK_LBLOCK);
-
-        //parses the index expression inside <>
-        expression(state);
-
-        match(state, TOK_RBLOCK);
-    }
+    node = optional_index_suffix(state, node);
 
     //requires at least one field identifier after the base
     if (state->next != TOK_IDENTIFIER)
     {
         syntax_error_at(state, "expected field name after FÄLT base");
         sync_to_follow(state);
-        printf("[EXIT ] field_access\n");
-        return;
+        trace_exit(state, "field_access");
+        return node;
     }
 
     //consumes one or more field identifiers, each optionally with an array suffix
     while (state->next == TOK_IDENTIFIER)
     {
+        int field = new_node(state, AST_FIELD);
+
+        node_at(state, field)->kid[0] = node;
         match(state, TOK_IDENTIFIER);
 
         //allows array suffix on a field node: FÄLT p ARR<2>
-        if (state->next == TOK_LBLOCK)
-        {
-            match(state, TOK_LBLOCK);
-
-            //parses the index expression inside <>
-            expression(state);
-
-            match(state, TOK_RBLOCK);
-        }
+        node = optional_index_suffix(state, field);
     }
 
-    printf("[EXIT ] field_access\n");
+    trace_exit(state, "field_access");
+
+    return node;
 }
 
-void assignment_statement(ParState *state)
+int assignment_statement(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
 
-    printf("[ENTER] assignment_statement\n");
+    trace_enter(state, "assignment_statement");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_statement;
 
-    assignment_core(state);
+    node = assignment_core(state);
     match(state, TOK_SEMI);
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] assignment_statement\n");
+    trace_exit(state, "assignment_statement");
+
+    return node;
 }
 
-void return_statement(ParState *state)
+int return_statement(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
 
-    printf("[ENTER] return_statement\n");
+    trace_enter(state, "return_statement");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_statement;
 
+    node = new_node(state, AST_RETURN);
+
     /* 'ÅTERVÄND' */
     match(state, TOK_ATERVAND);
 
     /* optional return expression */
     if (state->next != TOK_SEMI)
     {
-        expression(state);
+        set_kid(state, node, 0, expression(state));
     }
 
     /* ';' */
@@ -1884,58 +2294,61 @@ void return_statement(ParState *state)
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] return_statement\n");
+    trace_exit(state, "return_statement");
+
+    return node;
 }
 
-void expression_statement(ParState *state)
+int expression_statement(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
 
-    printf("[ENTER] expression_statement\n");
+    trace_enter(state, "expression_statement");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_statement;
 
+    node = new_node(state, AST_EXPR_STMT);
+
     /* expression */
-    expression(state);
+    set_kid(state, node, 0, expression(state));
 
     /* ';' */
     match(state, TOK_SEMI);
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] expression_statement\n");
+    trace_exit(state, "expression_statement");
+
+    return node;
 }
 
-void field_statement(ParState *state)
+int field_statement(ParState *state)
 {
     const TokenType *saved_sync;
+    int target;
+    int node;
 
-    printf("[ENTER] field_statement\n");
+    trace_enter(state, "field_statement");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_statement;
 
     /* field access (starts with FÄLT) */
-    field_access(state);
+    target = field_access(state);
 
     /* direct assignment: ':' expression */
     if (state->next == TOK_ASSIGN)   /* ':' */
     {
+        node = new_node(state, AST_ASSIGN);
         match(state, TOK_ASSIGN);
-        expression(state);
+        node_at(state, node)->kid[0] = target;
+        set_kid(state, node, 1, expression(state));
     }
-    /* unary update: ÖKAR / MINSKAR */
-    else if (state->next == TOK_OKAR || state->next == TOK_MINSKAR)
+    /* unary update: ÖKAR / MINSKAR, compound update: ÖKAR MED / MINSKAR MED */
+    else if ((node = update_operator(state, target)) != AST_NULL)
     {
-        match(state, state->next);
-    }
-    /* compound update: ÖKAR MED / MINSKAR MED */
-    else if (state->next == TOK_PLUS_ASSIGN ||
-             state->next == TOK_MINUS_ASSIGN)
-    {
-        match(state, state->next);
-        expression(state);
     }
     else
     {
@@ -1946,8 +2359,8 @@ void field_statement(ParState *state)
 
         sync_to_follow(state);
         state->sync_set = saved_sync;
-        printf("[EXIT ] field_statement\n");
-        return;
+        trace_exit(state, "field_statement");
+        return AST_NULL;
     }
 
     /* ';' */
@@ -1955,14 +2368,17 @@ void field_statement(ParState *state)
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] field_statement\n");
+    trace_exit(state, "field_statement");
+
+    return node;
 }
 
-void if_statement(ParState *state)
+int if_statement(ParState *state)
 {
     const TokenType *saved_sync;
+    int node = AST_NULL;
 
-    printf("[ENTER] if_statement\n");
+    trace_enter(state, "if_statement");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_statement;
@@ -1970,17 +2386,23 @@ void if_statement(ParState *state)
     /* FIRST(if_statement) */
     if (state->next == TOK_OM)
     {
+        node = new_node(state, AST_IF);
+
         match(state, TOK_OM);
         match(state, TOK_LPAREN);
-        expression(state);
+        set_kid(state, node, 0, expression(state));
         match(state, TOK_RPAREN);
-        block(state);
+        set_kid(state, node, 1, block(state));
 
-        /* optional else_clause */
+        /* optional else_clause, ANNARS OM chains into another if */
         if (state->next == TOK_ANNARS)
         {
             match(state, TOK_ANNARS);
-            block(state);
+
+            if (state->next == TOK_OM)
+                set_kid(state, node, 2, if_statement(state));
+            else
+                set_kid(state, node, 2, block(state));
         }
     }
     else
@@ -1992,14 +2414,42 @@ void if_statement(ParState *state)
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] if_statement\n");
+    trace_exit(state, "if_statement");
+
+    return node;
+}
+
+//parses the statements of one FALL / ANNARS arm
+static int case_body(ParState *state)
+{
+    int head = AST_NULL;
+    int tail = AST_NULL;
+
+    //parses statements until next label or end of switch
+    while (state->next != TOK_FALL &&
+           state->next != TOK_ANNARS &&
+           state->next != TOK_RBLOCK &&
+           state->next != TOK_EOF)
+    {
+        int start_index = state->index;
+
+        ast_append(state->ast, &head, &tail, statement(state));
+
+        if (state->index == start_index)
+            next_token(state);
+    }
+
+    return head;
 }
 
-void switch_statement(ParState *state)
+int switch_statement(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
+    int head = AST_NULL;
+    int tail = AST_NULL;
 
-    printf("[ENTER] switch_statement\n");
+    trace_enter(state, "switch_statement");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_statement;
@@ -2009,13 +2459,15 @@ void switch_statement(ParState *state)
         syntax_error_at(state, "expected VÄXEL");
         sync_to_follow(state);
         state->sync_set = saved_sync;
-        printf("[EXIT ] switch_statement\n");
-        return;
+        trace_exit(state, "switch_statement");
+        return AST_NULL;
     }
 
+    node = new_node(state, AST_SWITCH);
+
     match(state, TOK_VAXEL);
     match(state, TOK_LPAREN);
-    expression(state);
+    set_kid(state, node, 0, expression(state));
     match(state, TOK_RPAREN);
 
     match(state, TOK_LBLOCK);
@@ -2023,46 +2475,46 @@ void switch_statement(ParState *state)
     //parses zero or more FALL clauses
     while (state->next == TOK_FALL)
     {
+        int arm = new_node(state, AST_CASE);
+
         match(state, TOK_FALL);
-        expression(state);
+        set_kid(state, arm, 0, expression(state));
         match(state, TOK_ASSIGN);
 
-        //parses statements until next label or end of switch
-        while (state->next != TOK_FALL &&
-               state->next != TOK_ANNARS &&
-               state->next != TOK_RBLOCK &&
-               state->next != TOK_EOF)
-        {
-            statement(state);
-        }
+        set_list(state, arm, case_body(state));
+        ast_append(state->ast, &head, &tail, arm);
     }
 
     //parses optional ANNARS clause
     if (state->next == TOK_ANNARS)
     {
+        int arm = new_node(state, AST_CASE);
+
         match(state, TOK_ANNARS);
         match(state, TOK_ASSIGN);
 
         //parses statements until end of switch
-        while (state->next != TOK_RBLOCK &&
-               state->next != TOK_EOF)
-        {
-            statement(state);
-        }
+        set_list(state, arm, case_body(state));
+        ast_append(state->ast, &head, &tail, arm);
     }
 
     match(state, TOK_RBLOCK);
 
+    node_at(state, node)->list = head;
+
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] switch_statement\n");
+    trace_exit(state, "switch_statement");
+
+    return node;
 }
 
-void loop_statement(ParState *state)
+int loop_statement(ParState *state)
 {
     const TokenType *saved_sync;
+    int node = AST_NULL;
 
-    printf("[ENTER] loop_statement\n");
+    trace_enter(state, "loop_statement");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_statement;
@@ -2071,15 +2523,15 @@ void loop_statement(ParState *state)
     switch (state->next)
     {
         case TOK_FOR:
-            for_statement(state);
+            node = for_statement(state);
             break;
 
         case TOK_MEDAN:
-            while_statement(state);
+            node = while_statement(state);
             break;
 
         case TOK_GOR:
-            do_while_statement(state);
+            node = do_while_statement(state);
             break;
 
         default:
@@ -2091,25 +2543,30 @@ void loop_statement(ParState *state)
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] loop_statement\n");
+    trace_exit(state, "loop_statement");
+
+    return node;
 }
 
-void while_statement(ParState *state)
+int while_statement(ParState *state)
 {
     const TokenType *saved_sync;
+    int node = AST_NULL;
 
-    printf("[ENTER] while_statement\n");
+    trace_enter(state, "while_statement");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_statement;
 
     if (state->next == TOK_MEDAN)
     {
+        node = new_node(state, AST_WHILE);
+
         match(state, TOK_MEDAN);
         match(state, TOK_LPAREN);
-        expression(state);
+        set_kid(state, node, 0, expression(state));
         match(state, TOK_RPAREN);
-        block(state);
+        set_kid(state, node, 1, block(state));
     }
     else
     {
@@ -2120,25 +2577,30 @@ void while_statement(ParState *state)
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] while_statement\n");
+    trace_exit(state, "while_statement");
+
+    return node;
 }
 
-void do_while_statement(ParState *state)
+int do_while_statement(ParState *state)
 {
     const TokenType *saved_sync;
+    int node = AST_NULL;
 
-    printf("[ENTER] do_while_statement\n");
+    trace_enter(state, "do_while_statement");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_statement;
 
     if (state->next == TOK_GOR)
     {
+        node = new_node(state, AST_DO_WHILE);
+
         match(state, TOK_GOR);
-        block(state);
+        set_kid(state, node, 1, block(state));
         match(state, TOK_MEDAN);
         match(state, TOK_LPAREN);
-        expression(state);
+        set_kid(state, node, 0, expression(state));
         match(state, TOK_RPAREN);
         match(state, TOK_SEMI);
     }
@@ -2151,20 +2613,25 @@ void do_while_statement(ParState *state)
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] do_while_statement\n");
+    trace_exit(state, "do_while_statement");
+
+    return node;
 }
 
-void for_statement(ParState *state)
+int for_statement(ParState *state)
 {
     const TokenType *saved_sync;
+    int node = AST_NULL;
 
-    printf("[ENTER] for_statement\n");
+    trace_enter(state, "for_statement");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_statement;
 
     if (state->next == TOK_FOR)
     {
+        node = new_node(state, AST_FOR);
+
         match(state, TOK_FOR);
         match(state, TOK_LPAREN);
 
@@ -2178,15 +2645,18 @@ void for_statement(ParState *state)
                 state->next == TOK_HALV ||
                 state->next == TOK_BYTE ||
                 state->next == TOK_ORD  ||
-                state->next == TOK_STATISK)
+                state->next == TOK_VAL  ||
+                state->next == TOK_STATISK ||
+                is_type_qualifier(state->next) ||
+                is_declaration_statement_start(state))
             {
                 //declaration-style init consumes its own ';'
-                declaration_statement(state);
+                set_kid(state, node, 0, declaration_statement(state));
             }
             else
             {
                 //assignment-style init does not consume ';'
-                assignment_core(state);
+                set_kid(state, node, 0, assignment_core(state));
                 match(state, TOK_SEMI);
             }
         }
@@ -2196,25 +2666,28 @@ void for_statement(ParState *state)
             match(state, TOK_SEMI);
         }
 
-        //parses condition (must end with ';')
-        expression(state);
+        //parses condition (must end with ';', empty means forever)
+        if (state->next != TOK_SEMI)
+            set_kid(state, node, 1, expression(state));
         match(state, TOK_SEMI);
 
         //parses update (optional)
         if (state->next != TOK_RPAREN)
         {
-            assignment_core(state);
+            set_kid(state, node, 2, assignment_core(state));
         }
 
         match(state, TOK_RPAREN);
-        block(state);
+        set_kid(state, node, 3, block(state));
     }
     else
     {
         state->error_count++;
         state->panic_mode = 1;
 
-        printf("Syntax error: expected FÖR, got %s\n",
+        fprintf(state->out, "Syntax error at %d:%d: expected FÖR, got %s\n",
+               error_token(state)->row,
+               error_token(state)->col,
                tok2name(state->next));
 
         sync_to_follow(state);
@@ -2222,316 +2695,395 @@ void for_statement(ParState *state)
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] for_statement\n");
+    trace_exit(state, "for_statement");
+
+    return node;
 }
 
-void assignment_core(ParState *state)
+int assignment_core(ParState *state)
 {
     const TokenType *saved_sync;
+    int target;
+    int node;
 
-    printf("[ENTER] assignment_core\n");
+    trace_enter(state, "assignment_core");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_assignment_core;
 
-    lvalue(state);
+    target = lvalue(state);
 
     switch (state->next)
     {
         case TOK_ASSIGN:
+            node = new_node(state, AST_ASSIGN);
             match(state, TOK_ASSIGN);
-            expression(state);
-            break;
-
-        case TOK_OKAR:
-            match(state, TOK_OKAR);
-            break;
-
-        case TOK_MINSKAR:
-            match(state, TOK_MINSKAR);
-            break;
-
-        case TOK_PLUS_ASSIGN:
-            match(state, TOK_PLUS_ASSIGN);
-            expression(state);
-            break;
-
-        case TOK_MINUS_ASSIGN:
-            match(state, TOK_MINUS_ASSIGN);
-            expression(state);
+            node_at(state, node)->kid[0] = target;
+            set_kid(state, node, 1, expression(state));
             break;
 
         default:
-            syntax_error_at(
-                state,
-                "expected assignment operator after lvalue"
-            );
+            //ÖKAR, MINSKAR, ÖKAR MED, ..., SKIFT VÄNSTER MED
+            node = update_operator(state, target);
 
-            sync_to_follow(state);
+            if (node == AST_NULL && !state->panic_mode)
+            {
+                syntax_error_at(
+                    state,
+                    "expected assignment operator after lvalue"
+                );
+
+                sync_to_follow(state);
+            }
             break;
     }
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] assignment_core\n");
+    trace_exit(state, "assignment_core");
+
+    return node;
 }
 
-void expression(ParState *state)
+int expression(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
 
-    printf("[ENTER] expression\n");
+    trace_enter(state, "expression");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_expression;
 
-    logical_expression(state);
+    node = logical_expression(state);
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] expression\n");
+    trace_exit(state, "expression");
+
+    return node;
+}
+
+static int logical_and_expression(ParState *state)
+{
+    int node;
+
+    //OCH binds tighter than ELLER, as && over || in C
+    node = bitwise_or_expression(state);
+
+    while (state->next == TOK_OCH)
+    {
+        int op_tok = state->index;
+
+        //consumes OCH
+        next_token(state);
+
+        //parses next operand
+        node = ast_binary(state->ast, TOK_OCH, op_tok, node, bitwise_or_expression(state));
+    }
+
+    return node;
 }
 
-void logical_expression(ParState *state)
+int logical_expression(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
 
-    printf("[ENTER] logical_expression\n");
+    trace_enter(state, "logical_expression");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_expression;
 
     //parses the lower-precedence base (this chain should include == != < > etc inside it)
-    bitwise_or_expression(state);
+    node = logical_and_expression(state);
 
     //parses logical chaining
-    while (state->next == TOK_OCH || state->next == TOK_ELLER)
+    while (state->next == TOK_ELLER)
     {
-        //consumes OCH/ELLER
+        int op_tok = state->index;
+
+        //consumes ELLER
         next_token(state);
 
         //parses next operand
-        bitwise_or_expression(state);
+        node = ast_binary(state->ast, TOK_ELLER, op_tok, node, logical_and_expression(state));
     }
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] logical_expression\n");
+    trace_exit(state, "logical_expression");
+
+    return node;
 }
 
-void relational_expression(ParState *state)
+int relational_expression(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
 
-    printf("[ENTER] relational_expression\n");
+    trace_enter(state, "relational_expression");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_expression;
 
     /* IMPORTANT: base operand must be shift_expression, not additive_expression
        so expressions like: a SKIFT VÄNSTER 2 parse correctly */
-    shift_expression(state);
+    node = shift_expression(state);
 
     while (state->next == TOK_LT  ||
            state->next == TOK_GT  ||
            state->next == TOK_LTE ||
            state->next == TOK_GTE)
     {
+        TokenType op = state->next;
+        int op_tok = state->index;
+
         next_token(state);
-        shift_expression(state);
+        node = ast_binary(state->ast, op, op_tok, node, shift_expression(state));
     }
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] relational_expression\n");
+    trace_exit(state, "relational_expression");
+
+    return node;
 }
 
-void additive_expression(ParState *state)
+int additive_expression(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
 
-    printf("[ENTER] additive_expression\n");
+    trace_enter(state, "additive_expression");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_expression;
 
-    multiplicative_expression(state);
+    node = multiplicative_expression(state);
 
     while (state->next == TOK_PLUS ||
            state->next == TOK_MINUS)
     {
+        TokenType op = state->next;
+        int op_tok = state->index;
+
         next_token(state);
-        multiplicative_expression(state);
+        node = ast_binary(state->ast, op, op_tok, node, multiplicative_expression(state));
     }
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] additive_expression\n");
+    trace_exit(state, "additive_expression");
+
+    return node;
 }
 
-void multiplicative_expression(ParState *state)
+int multiplicative_expression(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
 
-    printf("[ENTER] multiplicative_expression\n");
+    trace_enter(state, "multiplicative_expression");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_unary_expression;
 
-    unary_expression(state);
+    node = unary_expression(state);
 
     while (state->next == TOK_MUL ||
            state->next == TOK_DIV ||
            state->next == TOK_MOD)
     {
+        TokenType op = state->next;
+        int op_tok = state->index;
+
         next_token(state);
-        unary_expression(state);
+        node = ast_binary(state->ast, op, op_tok, node, unary_expression(state));
     }
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] multiplicative_expression\n");
+    trace_exit(state, "multiplicative_expression");
+
+    return node;
 }
 
-static void shift_operator(ParState *state)
+static TokenType shift_operator(ParState *state)
 {
+    TokenType direction;
+
     match(state, TOK_SHIFT);
 
     if (state->next != TOK_VANSTER && state->next != TOK_HOGER)
     {
         syntax_error_at(state, "expected VÄNSTER or HÖGER after SKIFT");
         sync_to_follow(state);
-        return;
+        return TOK_ERROR;
     }
 
+    direction = state->next;
     next_token(state);
+
+    return direction;
 }
 
-void shift_expression(ParState *state)
+int shift_expression(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
 
-    printf("[ENTER] shift_expression\n");
+    trace_enter(state, "shift_expression");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_additive_expression;
 
-    additive_expression(state);
+    node = additive_expression(state);
 
     while (state->next == TOK_SHIFT)
     {
-        shift_operator(state);
-        additive_expression(state);
+        int op_tok = state->index;
+        TokenType direction = shift_operator(state);
+
+        node = ast_binary(state->ast, direction, op_tok, node, additive_expression(state));
     }
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] shift_expression\n");
+    trace_exit(state, "shift_expression");
+
+    return node;
 }
 
-void equality_expression(ParState *state)
+int equality_expression(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
 
-    printf("[ENTER] equality_expression\n");
+    trace_enter(state, "equality_expression");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_relational_expression;
 
-    relational_expression(state);
+    node = relational_expression(state);
 
     while (state->next == TOK_EQ || state->next == TOK_NEQ)
     {
+        TokenType op = state->next;
+        int op_tok = state->index;
+
         next_token(state);
-        relational_expression(state);
+        node = ast_binary(state->ast, op, op_tok, node, relational_expression(state));
     }
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] equality_expression\n");
+    trace_exit(state, "equality_expression");
+
+    return node;
 }
 
-void bitwise_and_expression(ParState *state)
+int bitwise_and_expression(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
 
-    printf("[ENTER] bitwise_and_expression\n");
+    trace_enter(state, "bitwise_and_expression");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_equality_expression;
 
-    equality_expression(state);
+    node = equality_expression(state);
 
     while (state->next == TOK_BITAND)
     {
+        int op_tok = state->index;
+
         match(state, TOK_BITAND);
-        equality_expression(state);
+        node = ast_binary(state->ast, TOK_BITAND, op_tok, node, equality_expression(state));
     }
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] bitwise_and_expression\n");
+    trace_exit(state, "bitwise_and_expression");
+
+    return node;
 }
 
-void bitwise_xor_expression(ParState *state)
+int bitwise_xor_expression(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
 
-    printf("[ENTER] bitwise_xor_expression\n");
+    trace_enter(state, "bitwise_xor_expression");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_bitwise_and_expression;
 
-    bitwise_and_expression(state);
+    node = bitwise_and_expression(state);
 
     while (state->next == TOK_BITXOR)
     {
+        int op_tok = state->index;
+
         match(state, TOK_BITXOR);
-        bitwise_and_expression(state);
+        node = ast_binary(state->ast, TOK_BITXOR, op_tok, node, bitwise_and_expression(state));
     }
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] bitwise_xor_expression\n");
+    trace_exit(state, "bitwise_xor_expression");
+
+    return node;
 }
 
-void bitwise_or_expression(ParState *state)
+int bitwise_or_expression(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
 
-    printf("[ENTER] bitwise_or_expression\n");
+    trace_enter(state, "bitwise_or_expression");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_bitwise_xor_expression;
 
-    bitwise_xor_expression(state);
+    node = bitwise_xor_expression(state);
 
     while (state->next == TOK_BITOR)
     {
+        int op_tok = state->index;
+
         match(state, TOK_BITOR);
-        bitwise_xor_expression(state);
+        node = ast_binary(state->ast, TOK_BITOR, op_tok, node, bitwise_xor_expression(state));
     }
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] bitwise_or_expression\n");
+    trace_exit(state, "bitwise_or_expression");
+
+    return node;
 }
 
-void continue_statement(ParState *state)
+int continue_statement(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
 
-    printf("[ENTER] continue_statement\n");
+    trace_enter(state, "continue_statement");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_statement;
 
+    node = new_node(state, AST_CONTINUE);
+
     match(state, TOK_FORTSATT);
     match(state, TOK_SEMI);
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] continue_statement\n");
+    trace_exit(state, "continue_statement");
+
+    return node;
 }
 
 int is_type_starter(TokenType t)
@@ -2574,7 +3126,7 @@ int is_cast_start(ParState *state)
     return (i < state->token_count && state->tokens[i].token == TOK_RPAREN);
 }
 
-int is_type_token(TokenType t)
+static int is_type_token(TokenType t)
 {
     //builtin type keywords only (prevents ambiguity with grouped identifiers)
     if (t == TOK_HEL  ||
@@ -2585,68 +3137,67 @@ int is_type_token(TokenType t)
         t == TOK_BYTE ||
         t == TOK_ORD  ||
         t == TOK_VAL  ||
-        t == TOK_TOM)
+        t == TOK_TOM  ||
+        t == TOK_KORT ||
+        t == TOK_LANG ||
+        t == TOK_DUBBEL ||
+        t == TOK_LANG_DUBBEL ||
+        t == TOK_OSIGNERAD ||
+        t == TOK_SIGNERAD)
         return 1;
 
     return 0;
 }
 
-void unary_expression(ParState *state)
+int unary_expression(ParState *state)
 {
     const TokenType *saved_sync;
     int start_index;
+    int node;
 
-    printf("[ENTER] unary_expression\n");
+    trace_enter(state, "unary_expression");
 
     start_index = state->index;
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_unary_expression;
 
-    //handles casts like: (HEL) x
-    if (state->next == TOK_LPAREN && is_type_token(peek_token(state, 1)))
+    //handles casts like: (HEL) x, (person PEK) p
+    if (state->next == TOK_LPAREN &&
+        (is_type_token(peek_token(state, 1)) ||
+         (is_type_name(state, state->index + 1) &&
+          (peek_token(state, 2) == TOK_RPAREN || peek_token(state, 2) == TOK_PEK))))
     {
+        node = new_node(state, AST_CAST);
+
         match(state, TOK_LPAREN);
-        type_specifier(state);
+        set_kid(state, node, 0, type_specifier(state));
         match(state, TOK_RPAREN);
 
         //parses the operand after the cast
-        unary_expression(state);
+        set_kid(state, node, 1, unary_expression(state));
 
         state->sync_set = saved_sync;
-        printf("[EXIT ] unary_expression\n");
-        return;
+        trace_exit(state, "unary_expression");
+        return node;
     }
 
     switch (state->next)
     {
         case TOK_INTE:
-            //parses logical NOT
-            match(state, TOK_INTE);
-            unary_expression(state);
-            break;
-
         case TOK_MINUS:
-            //parses unary negation, e.g. -1, -(a + b)
-            match(state, TOK_MINUS);
-            unary_expression(state);
-            break;
-
         case TOK_PLUS:
-            //parses unary plus, e.g. +1, +(a)
-            match(state, TOK_PLUS);
-            unary_expression(state);
-            break;
-
         case TOK_BITNOT:
-            //parses bitwise NOT
-            match(state, TOK_BITNOT);
-            unary_expression(state);
+            //parses logical NOT, unary negation/plus (-1, -(a + b)) and bitwise NOT
+            node = new_node(state, AST_UNARY);
+            node_at(state, node)->op = state->next;
+            match(state, state->next);
+            set_kid(state, node, 0, unary_expression(state));
             break;
 
-
         case TOK_ADDRESS:
             //parses address-of on an lvalue, optionally parenthesized: ADRESS AV (FÄLT p SCORE)
+            node = new_node(state, AST_ADDRESS);
             match(state, TOK_ADDRESS);
 
             //supports optional parentheses around lvalue
@@ -2655,65 +3206,81 @@ void unary_expression(ParState *state)
                 match(state, TOK_LPAREN);
 
                 //parses the lvalue inside parentheses
-                lvalue(state);
+                set_kid(state, node, 0, lvalue(state));
 
                 match(state, TOK_RPAREN);
             }
             else
             {
                 //parses direct lvalue after ADRESS AV
-                lvalue(state);
+                set_kid(state, node, 0, lvalue(state));
             }
             break;
 
         case TOK_DEREF:
             //parses dereference in expressions
+            node = new_node(state, AST_DEREF);
             match(state, TOK_DEREF);
 
-            //parses the operand of dereference
-            expression(state);
+            //parses the operand of dereference; binds like unary * in C
+            set_kid(state, node, 0, unary_expression(state));
             break;
 
         default:
             //falls back to primary expressions (literals, identifiers, calls, grouping, etc.)
-            primary_expression(state);
+            node = primary_expression(state);
             break;
     }
 
+    (void)start_index;
+
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] unary_expression\n");
+    trace_exit(state, "unary_expression");
+
+    return node;
 }
 
-void array_literal(ParState *state)
+int array_literal(ParState *state)
 {
-    printf("[ENTER] array_literal\n");
+    int node;
+    int head = AST_NULL;
+    int tail = AST_NULL;
+
+    trace_enter(state, "array_literal");
+
+    node = new_node(state, AST_ARRAY_LIT);
 
     match(state, TOK_LBLOCK);
 
     //empty literal: <>
     if (state->next != TOK_RBLOCK)
     {
-        expression(state);
+        ast_append(state->ast, &head, &tail, expression(state));
 
         while (state->next == TOK_COMMA)
         {
             match(state, TOK_COMMA);
-            expression(state);
+            ast_append(state->ast, &head, &tail, expression(state));
         }
     }
 
     match(state, TOK_RBLOCK);
 
-    printf("[EXIT ] array_literal\n");
+    node_at(state, node)->list = head;
+
+    trace_exit(state, "array_literal");
+
+    return node;
 }
 
-void primary_expression(ParState *state)
+int primary_expression(ParState *state)
 {
     const TokenType *saved_sync;
     int start_index;
+    int node = AST_NULL;
 
-    printf("[ENTER] primary_expression\n");
+    trace_enter(state, "primary_expression");
 
     start_index = state->index;
 
@@ -2723,39 +3290,45 @@ void primary_expression(ParState *state)
     switch (state->next)
     {
         case TOK_INT_LIT:
+            node = new_node(state, AST_INT_LIT);
             match(state, TOK_INT_LIT);
             break;
 
         case TOK_FLOAT_LIT:
+            node = new_node(state, AST_FLOAT_LIT);
             match(state, TOK_FLOAT_LIT);
             break;
 
         case TOK_STRING_LIT:
+            node = new_node(state, AST_STRING_LIT);
             match(state, TOK_STRING_LIT);
             break;
 
         case TOK_LPAREN:
             match(state, TOK_LPAREN);
-            expression(state);
+            node = expression(state);
             match(state, TOK_RPAREN);
             break;
 
         case TOK_LBLOCK:
             /* array literal: < ... > */
-            array_literal(state);
+            node = array_literal(state);
             break;
 
         case TOK_IDENTIFIER:
             if (state->next_next == TOK_LPAREN)
-                function_call(state);
+                node = function_call(state);
             else if (state->next_next == TOK_LBLOCK)
-                array_access(state);
+                node = array_access(state);
             else
+            {
+                node = new_node(state, AST_IDENT);
                 match(state, TOK_IDENTIFIER);
+            }
             break;
 
         case TOK_FALT:
-            field_access(state);
+            node = field_access(state);
             break;
 
         default:
@@ -2770,19 +3343,23 @@ void primary_expression(ParState *state)
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] primary_expression\n");
+    trace_exit(state, "primary_expression");
+
+    return node;
 }
 
-void function_call_statement(ParState *state)
+int function_call_statement(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
 
-    printf("[ENTER] function_call_statement\n");
+    trace_enter(state, "function_call_statement");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_statement;
 
-    function_call(state);
+    node = new_node(state, AST_EXPR_STMT);
+    set_kid(state, node, 0, function_call(state));
 
     /* optional ';' */
     if (state->next == TOK_SEMI)
@@ -2790,18 +3367,23 @@ void function_call_statement(ParState *state)
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] function_call_statement\n");
+    trace_exit(state, "function_call_statement");
+
+    return node;
 }
 
-void function_call(ParState *state)
+int function_call(ParState *state)
 {
     const TokenType *saved_sync;
+    int node;
 
-    printf("[ENTER] function_call\n");
+    trace_enter(state, "function_call");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_expression;
 
+    node = new_node(state, AST_CALL);
+
     /* function name */
     match(state, TOK_IDENTIFIER);
 
@@ -2811,13 +3393,7 @@ void function_call(ParState *state)
     /* optional argument list */
     if (state->next != TOK_RPAREN)
     {
-        expression(state);
-
-        while (state->next == TOK_COMMA)
-        {
-            match(state, TOK_COMMA);
-            expression(state);
-        }
+        set_list(state, node, argument_list(state));
     }
 
     /* ')' */
@@ -2825,32 +3401,35 @@ void function_call(ParState *state)
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] function_call\n");
+    trace_exit(state, "function_call");
+
+    return node;
 }
 
-void argument_list(ParState *state)
+int argument_list(ParState *state)
 {
     const TokenType *saved_sync;
+    int head = AST_NULL;
+    int tail = AST_NULL;
 
-    printf("[ENTER] argument_list\n");
+    trace_enter(state, "argument_list");
 
     saved_sync = state->sync_set;
     state->sync_set = FOLLOW_expression;
 
     /* first argument */
-    expression(state);
+    ast_append(state->ast, &head, &tail, expression(state));
 
     /* additional arguments */
     while (state->next == TOK_COMMA)
     {
         match(state, TOK_COMMA);
-        expression(state);
+        ast_append(state->ast, &head, &tail, expression(state));
     }
 
     state->sync_set = saved_sync;
 
-    printf("[EXIT ] argument_list\n");
-}
-
-
+    trace_exit(state, "argument_list");
 
+    return head;
+}
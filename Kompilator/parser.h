@@ -1,8 +1,12 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <stdio.h>
+
 #include "lexer.h"
 #include "tokenkeytab.h"
+#include "ast.h"
+#include "trace.h"
 
 
 /* ---------------------------------------------
@@ -13,7 +17,7 @@ typedef struct ParState
     TokenBuffer *tokens;
     int          token_count;
 
-    char       **lexemes;      
+    char       **lexemes;
 
     int          index;
 
@@ -26,8 +30,19 @@ typedef struct ParState
 
     int          error_count;
     int          panic_mode;
+    int          trace;             // print [ENTER]/[EXIT] per non-terminal
+    FILE        *out;               // diagnostics and trace
+    TraceLog    *events;            // trace events per non-terminal, NULL when off
 
     const TokenType *sync_set;
+
+    Ast         *ast;               // tree being built
+
+    int         *type_names;        // token indices of declared type names (TYPDEF/STRUKTUR/ENUM)
+    int          type_name_count;
+    int          type_name_capacity;
+    const char *const *known_types; // type names declared before these tokens (parse_part)
+    int          known_type_count;
 } ParState;
 
 
@@ -38,8 +53,26 @@ typedef struct ParState
 void parser(TokenBuffer *token_stream,
             int token_count,
             char **lexeme_stream,
+            int trace,
+            TraceLog *events,
+            FILE *out,
+            Ast *out_ast,
             int *out_error_count);
 
+/* parses one top-level part of a larger file (lsp.h). known holds the type names the
+   parts before it declare; the names this part declares are returned in *out_declared,
+   pointing into lexeme_stream (free the array, not the names) */
+void parse_part(TokenBuffer *token_stream,
+                int token_count,
+                char **lexeme_stream,
+                const char *const *known,
+                int known_count,
+                FILE *out,
+                Ast *out_ast,
+                int *out_error_count,
+                const char ***out_declared,
+                int *out_declared_count);
+
 void init_parser(ParState *state,
                  TokenBuffer *token_stream,
                  int token_count);
@@ -48,86 +81,86 @@ void init_parser(ParState *state,
 /* ---------------------------------------------
    Program structure
 --------------------------------------------- */
-void program(ParState *state);
-void global_statement_list(ParState *state);
-void global_statement(ParState *state);
+int program(ParState *state);
+int global_statement_list(ParState *state);
+int global_statement(ParState *state);
 
 
 /* ---------------------------------------------
    Declarations
 --------------------------------------------- */
-void function_declaration(ParState *state);
-void declaration_statement(ParState *state);
-void type_declaration(ParState *state);
+int function_declaration(ParState *state);
+int declaration_statement(ParState *state);
+int type_declaration(ParState *state);
 
-void typedef_declaration(ParState *state);
-void struct_declaration(ParState *state);
+int typedef_declaration(ParState *state);
+int struct_declaration(ParState *state);
 
-void type_specifier(ParState *state);
+int type_specifier(ParState *state);
 
-void parameter_list(ParState *state);
-void parameter(ParState *state);
+int parameter_list(ParState *state);
+int parameter(ParState *state);
 
 
 /* ---------------------------------------------
    Blocks and statements
 --------------------------------------------- */
-void block(ParState *state);
-void statement_list(ParState *state);
-void statement(ParState *state);
+int block(ParState *state);
+int statement_list(ParState *state);
+int statement(ParState *state);
 
 
 /* ---------------------------------------------
    Statement variants
 --------------------------------------------- */
-void assignment_statement(ParState *state);
-void assignment_core(ParState *state);
+int assignment_statement(ParState *state);
+int assignment_core(ParState *state);
 
-void return_statement(ParState *state);
-void break_statement(ParState *state);
+int return_statement(ParState *state);
+int break_statement(ParState *state);
 
-void expression_statement(ParState *state);
-void field_statement(ParState *state);
+int expression_statement(ParState *state);
+int field_statement(ParState *state);
 
-void if_statement(ParState *state);
-void switch_statement(ParState *state);
-void loop_statement(ParState *state);
+int if_statement(ParState *state);
+int switch_statement(ParState *state);
+int loop_statement(ParState *state);
 
 
 /* ---------------------------------------------
    Loop variants
 --------------------------------------------- */
-void while_statement(ParState *state);
-void do_while_statement(ParState *state);
-void for_statement(ParState *state);
+int while_statement(ParState *state);
+int do_while_statement(ParState *state);
+int for_statement(ParState *state);
 
 
 /* ---------------------------------------------
    Expressions
 --------------------------------------------- */
-void expression(ParState *state);
-void logical_expression(ParState *state);
-void relational_expression(ParState *state);
-void additive_expression(ParState *state);
-void multiplicative_expression(ParState *state);
-void unary_expression(ParState *state);
-void primary_expression(ParState *state);
+int expression(ParState *state);
+int logical_expression(ParState *state);
+int relational_expression(ParState *state);
+int additive_expression(ParState *state);
+int multiplicative_expression(ParState *state);
+int unary_expression(ParState *state);
+int primary_expression(ParState *state);
 
 
 /* ---------------------------------------------
    Lvalues and access
 --------------------------------------------- */
-void lvalue(ParState *state);
-void array_access(ParState *state);
-void field_access(ParState *state);
+int lvalue(ParState *state);
+int array_access(ParState *state);
+int field_access(ParState *state);
 
 
 /* ---------------------------------------------
    Function calls
 --------------------------------------------- */
-void function_call(ParState *state);
-void argument_list(ParState *state);
-void function_call_statement(ParState * state);
+int function_call(ParState *state);
+int argument_list(ParState *state);
+int function_call_statement(ParState * state);
 
 /* ---------------------------------------------
    Parser utilities
@@ -136,10 +169,10 @@ void match(ParState *state, TokenType expected);
 void next_token(ParState *state);
 TokenType peek_token(ParState *state, int offset);
 void sync_to_follow(ParState *state);
-void initializer(ParState *state);
+int initializer(ParState *state);
 int scan_after_type_specifier(const ParState *state, int start_index);
 /* Add this prototype near your other static prototypes (above unary_expression use) */
 static int is_type_token(TokenType t);
-void continue_statement(ParState *state);
+int continue_statement(ParState *state);
 
 #endif /* PARSER_H */
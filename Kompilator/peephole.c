@@ -0,0 +1,801 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#include "peephole.h"
+
+static void *peep_alloc(size_t count, size_t size, const char *what)
+{
+    void *ptr = calloc(count + 1, size);
+
+    if (!ptr)
+    {
+        fprintf(stderr, "Fatal: failed to allocate %s\n", what);
+        exit(1);
+    }
+
+    return ptr;
+}
+
+
+
+/*
+  ____        _                      _
+ |  _ \      | |                    | |
+ | |_) |_   _| |_ ___  ___ ___   __| | ___
+ |  _ <| | | | __/ _ \/ __/ _ \ / _` |/ _ \
+ | |_) | |_| | ||  __/ (_| (_) | (_| |  __/
+ |____/ \__, |\__\___|\___\___/ \__,_|\___|
+         __/ |
+        |___/
+*/
+
+static int is_int_compare(int op)
+{
+    return op >= OP_EQ && op <= OP_UGE;
+}
+
+static int is_branch(int op)
+{
+    return op == OP_JMP || op == OP_BRNZ || op == OP_BRZ || (op >= OP_BEQ && op <= OP_BUGEK);
+}
+
+static int is_load(int op)
+{
+    return op >= OP_LOAD8 && op <= OP_LOADF64;
+}
+
+static int is_store(int op)
+{
+    return op >= OP_STORE8 && op <= OP_STOREF64;
+}
+
+//the compare that holds exactly when op does not; integers have no unordered case
+static int invert_compare(int op)
+{
+    switch (op)
+    {
+        case OP_EQ:  return OP_NE;
+        case OP_NE:  return OP_EQ;
+        case OP_LT:  return OP_GE;
+        case OP_LE:  return OP_GT;
+        case OP_GT:  return OP_LE;
+        case OP_GE:  return OP_LT;
+        case OP_ULT: return OP_UGE;
+        case OP_ULE: return OP_UGT;
+        case OP_UGT: return OP_ULE;
+        default:     return OP_ULT;
+    }
+}
+
+//the compare with its operands swapped
+static int mirror_compare(int op)
+{
+    switch (op)
+    {
+        case OP_LT:  return OP_GT;
+        case OP_LE:  return OP_GE;
+        case OP_GT:  return OP_LT;
+        case OP_GE:  return OP_LE;
+        case OP_ULT: return OP_UGT;
+        case OP_ULE: return OP_UGE;
+        case OP_UGT: return OP_ULT;
+        case OP_UGE: return OP_ULE;
+        default:     return op;
+    }
+}
+
+//which of a and b an instruction reads as registers; CALL arguments are in the pool
+static void operand_reads(const VmInstr *in, int *reads_a, int *reads_b)
+{
+    *reads_a = 1;
+    *reads_b = 0;
+
+    switch (in->op)
+    {
+        case OP_NOP: case OP_CONST: case OP_SLOT: case OP_JMP: case OP_RETV:
+        case OP_CALL: case OP_TAILCALL:
+            *reads_a = 0;
+            return;
+
+        case OP_MOV: case OP_NEG32: case OP_NEG64: case OP_NOT: case OP_FNEG:
+        case OP_SEXT8: case OP_SEXT16: case OP_SEXT32: case OP_ZEXT8: case OP_ZEXT16: case OP_ZEXT32:
+        case OP_FROUND32: case OP_ITOF: case OP_UTOF: case OP_FTOI:
+        case OP_OFFSET: case OP_MEMZERO: case OP_BRNZ: case OP_BRZ: case OP_SWITCH: case OP_RET:
+        case OP_ADDI32: case OP_ADDI64:
+            return;
+
+        default:
+            if (is_load(in->op) || (in->op >= OP_BEQK && in->op <= OP_BUGEK))
+                return;
+
+            *reads_b = 1;
+            return;
+    }
+}
+
+static int writes_dst(const VmInstr *in)
+{
+    if (is_store(in->op) || is_branch(in->op))
+        return 0;
+
+    switch (in->op)
+    {
+        case OP_MEMCPY: case OP_MEMZERO: case OP_SWITCH: case OP_RET: case OP_RETV:
+        case OP_NOP: case OP_TAILCALL:
+            return 0;
+
+        case OP_CALL:
+            return in->dst != VM_NO_REG;
+
+        default:
+            return 1;
+    }
+}
+
+//the constant a register holds everywhere it is read: written once, by a CONST of a plain value
+static int constant_of(const VmProgram *p, const int *def, int reg)
+{
+    if (def[reg] < 0 || p->code[def[reg]].op != OP_CONST)
+        return -1;
+
+    if (p->consts[p->code[def[reg]].imm].kind != VM_CONST_VALUE)
+        return -1;
+
+    return p->code[def[reg]].imm;
+}
+
+int peephole_bytecode(VmProgram *p, int fi)
+{
+    VmFunc *f = &p->funcs[fi];
+    int start = f->code_start;
+    int end = p->code_count;
+    int count = end - start;
+    int regs = f->reg_count;
+    int *reads = peep_alloc((size_t)regs, sizeof(int), "register reads");
+    int *def = peep_alloc((size_t)regs, sizeof(int), "register definitions");
+    char *target = peep_alloc((size_t)count, 1, "jump targets");
+    char *table = peep_alloc((size_t)count, 1, "switch tables");
+    char *gone = peep_alloc((size_t)count, 1, "removed instructions");
+    int *new_pc = peep_alloc((size_t)count, sizeof(int), "new positions");
+    int removed = 0;
+
+    //def[r] is the single writer of r, -2 once there is more than one; parameters have none
+    for (int r = 0; r < regs; r++)
+        def[r] = (r < f->param_count) ? -2 : -1;
+
+    for (int pc = start; pc < end; pc++)
+    {
+        const VmInstr *in = &p->code[pc];
+        int reads_a, reads_b;
+
+        operand_reads(in, &reads_a, &reads_b);
+
+        if (reads_a)
+            reads[in->a]++;
+        if (reads_b)
+            reads[in->b]++;
+
+        if (in->op == OP_CALL || in->op == OP_TAILCALL)
+        {
+            for (int k = 0; k < in->b; k++)
+                reads[p->args[f->arg_start + in->a + k]]++;
+        }
+
+        if (writes_dst(in))
+            def[in->dst] = (def[in->dst] == -1) ? pc : -2;
+
+        if (is_branch(in->op))
+            target[in->imm - start] = 1;
+
+        if (in->op == OP_SWITCH)
+        {
+            for (int k = 1; k <= in->imm + 1; k++)
+                table[pc - start + k] = 1;
+        }
+    }
+
+    for (int pc = start; pc < end; pc++)
+    {
+        VmInstr *in = &p->code[pc];
+        VmInstr *next = (pc + 1 < end) ? &p->code[pc + 1] : NULL;
+        int k;
+
+        //x ÖKAR and friends: an add or subtract of a constant that fits the immediate
+        if (in->op == OP_ADD32 || in->op == OP_ADD64 || in->op == OP_SUB32 || in->op == OP_SUB64)
+        {
+            int wide = (in->op == OP_ADD64 || in->op == OP_SUB64);
+            int is_sub = (in->op == OP_SUB32 || in->op == OP_SUB64);
+            int reg = in->b;
+
+            k = constant_of(p, def, in->b);
+
+            //a constant on the left only commutes for addition
+            if (k < 0 && !is_sub)
+            {
+                k = constant_of(p, def, in->a);
+                reg = in->a;
+            }
+
+            if (k >= 0)
+            {
+                int64_t value = p->consts[k].value.i;
+
+                if (is_sub)
+                    value = wide ? (int64_t)(0 - (uint64_t)value) : (int32_t)(0 - (uint32_t)value);
+
+                if (value == (int32_t)value || !wide)
+                {
+                    in->op  = wide ? OP_ADDI64 : OP_ADDI32;
+                    in->a   = (reg == in->a) ? in->b : in->a;
+                    in->b   = 0;
+                    in->imm = (int32_t)value;
+                    reads[reg]--;
+                }
+            }
+            continue;
+        }
+
+        //OFFSET feeding only the access right after it
+        if (in->op == OP_OFFSET && next && !target[pc + 1 - start] && reads[in->dst] == 1 &&
+            (is_load(next->op) || is_store(next->op)) && next->a == in->dst && next->imm == 0 &&
+            !(is_store(next->op) && next->b == in->dst))
+        {
+            next->a   = in->a;
+            next->imm = in->imm;
+            gone[pc - start] = 1;
+            continue;
+        }
+
+        //a compare read by nothing but the branch after it
+        if (is_int_compare(in->op) && next && !target[pc + 1 - start] &&
+            (next->op == OP_BRNZ || next->op == OP_BRZ) && next->a == in->dst &&
+            reads[in->dst] == 1 && def[in->dst] == pc)
+        {
+            int cc = (next->op == OP_BRZ) ? invert_compare(in->op) : in->op;
+            int a = in->a;
+            int b = in->b;
+
+            k = constant_of(p, def, b);
+
+            if (k < 0 && constant_of(p, def, a) >= 0)
+            {
+                k = constant_of(p, def, a);
+                cc = mirror_compare(cc);
+                b = a;
+                a = in->b;
+            }
+
+            if (k >= 0 && k <= 0xFFFF)
+            {
+                reads[b]--;
+                b = k;
+                in->op = (uint16_t)(OP_BEQK + (cc - OP_EQ));
+            }
+            else
+            {
+                in->op = (uint16_t)(OP_BEQ + (cc - OP_EQ));
+            }
+
+            in->dst = 0;
+            in->a   = (uint16_t)a;
+            in->b   = (uint16_t)b;
+            in->imm = next->imm;
+
+            gone[pc + 1 - start] = 1;
+            pc++;
+        }
+    }
+
+    //constants whose readers all took them in
+    for (int pc = start; pc < end; pc++)
+    {
+        const VmInstr *in = &p->code[pc];
+
+        if (in->op == OP_CONST && def[in->dst] == pc && reads[in->dst] == 0)
+            gone[pc - start] = 1;
+    }
+
+    //a JMP that would land where falling through does; table entries are read, not run
+    for (int i = count - 1, after = count; i >= 0; i--)
+    {
+        const VmInstr *in = &p->code[start + i];
+        int to = in->imm - start;
+
+        if (!gone[i] && !table[i] && in->op == OP_JMP && to > i && after >= to)
+            gone[i] = 1;
+
+        if (!gone[i])
+            after = i;
+    }
+
+    //where each instruction lands, a removed one at whatever follows it
+    for (int i = 0, kept = 0; i <= count; i++)
+    {
+        new_pc[i] = kept;
+        kept += (i < count && !gone[i]);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        VmInstr in = p->code[start + i];
+
+        if (gone[i])
+        {
+            removed++;
+            continue;
+        }
+
+        if (is_branch(in.op))
+            in.imm = start + new_pc[in.imm - start];
+
+        p->code[start + new_pc[i]] = in;
+    }
+
+    p->code_count = end - removed;
+
+    free(reads);
+    free(def);
+    free(target);
+    free(table);
+    free(gone);
+    free(new_pc);
+
+    return removed;
+}
+
+
+
+/*
+                                     _     _
+     /\                             | |   | |
+    /  \   ___ ___  ___ _ __ ___   | |__ | |_   _
+   / /\ \ / __/ __|/ _ \ '_ ` _ \  | '_ \| | | | |
+  / ____ \\__ \__ \  __/ | | | | | | |_) | | |_| |
+ /_/    \_\___/___/\___|_| |_| |_| |_.__/|_|\__, |
+                                             __/ |
+                                            |___/
+*/
+
+#define ASM_TEXT 96
+
+typedef enum AsmKind {
+    ASM_INSTR,
+    ASM_LABEL,
+    ASM_OTHER           // directives and blank lines, which nothing moves across
+} AsmKind;
+
+typedef struct AsmLine {
+    char   *text;       // NULL once removed
+    int     owned;      // text was rewritten and is ours to free
+    AsmKind kind;
+    char    mnemonic[16];
+    char    op[2][ASM_TEXT];
+    int     op_count;   // -1 for instructions the rules do not look into
+} AsmLine;
+
+typedef struct AsmState {
+    AsmLine *lines;
+    int      count;
+    int      removed;
+} AsmState;
+
+static const char *const reg_names[16][4] = {
+    { "rax", "eax", "ax", "al" },    { "rcx", "ecx", "cx", "cl" },
+    { "rdx", "edx", "dx", "dl" },    { "rbx", "ebx", "bx", "bl" },
+    { "rsp", "esp", "sp", "spl" },   { "rbp", "ebp", "bp", "bpl" },
+    { "rsi", "esi", "si", "sil" },   { "rdi", "edi", "di", "dil" },
+    { "r8", "r8d", "r8w", "r8b" },   { "r9", "r9d", "r9w", "r9b" },
+    { "r10", "r10d", "r10w", "r10b" }, { "r11", "r11d", "r11w", "r11b" },
+    { "r12", "r12d", "r12w", "r12b" }, { "r13", "r13d", "r13w", "r13b" },
+    { "r14", "r14d", "r14w", "r14b" }, { "r15", "r15d", "r15w", "r15b" }
+};
+
+#define SCRATCH_FAMILY 11   // r11, which x86.c never keeps live across its own instructions
+
+//general purpose register family of a %name, -1 for anything else
+static int reg_family(const char *name, int length)
+{
+    for (int r = 0; r < 16; r++)
+    {
+        for (int w = 0; w < 4; w++)
+        {
+            if ((int)strlen(reg_names[r][w]) == length && strncmp(reg_names[r][w], name, length) == 0)
+                return r;
+        }
+    }
+
+    return -1;
+}
+
+static int mentions_family(const char *text, int family)
+{
+    for (const char *c = strchr(text, '%'); c; c = strchr(c + 1, '%'))
+    {
+        int length = 0;
+
+        while (isalnum((unsigned char)c[1 + length]))
+            length++;
+
+        if (reg_family(c + 1, length) == family)
+            return 1;
+    }
+
+    return 0;
+}
+
+static int operand_family(const char *op)
+{
+    return (op[0] == '%') ? reg_family(op + 1, (int)strlen(op + 1)) : -1;
+}
+
+static void parse_line(AsmLine *line)
+{
+    const char *text = line->text;
+    int depth = 0;
+    int n = 0;
+    int length = 0;
+
+    line->op_count = -1;
+
+    if (text[0] != '\t')
+    {
+        size_t size = strlen(text);
+
+        line->kind = (size > 0 && text[size - 1] == ':') ? ASM_LABEL : ASM_OTHER;
+        return;
+    }
+
+    if (text[1] == '.' || text[1] == '\0')
+    {
+        line->kind = ASM_OTHER;
+        return;
+    }
+
+    line->kind = ASM_INSTR;
+    text++;
+
+    while (*text && *text != ' ')
+    {
+        if (length + 1 >= (int)sizeof(line->mnemonic))
+            return;
+
+        line->mnemonic[length++] = *text++;
+    }
+
+    line->mnemonic[length] = '\0';
+    line->op[0][0] = '\0';
+    line->op[1][0] = '\0';
+    length = 0;
+
+    while (*text == ' ')
+        text++;
+
+    //operands split at commas outside parentheses
+    for (; *text; text++)
+    {
+        if (*text == '(')
+            depth++;
+        else if (*text == ')')
+            depth--;
+
+        if (*text == ',' && depth == 0)
+        {
+            line->op[n][length] = '\0';
+
+            if (++n == 2)
+                return;
+
+            length = 0;
+
+            while (text[1] == ' ')
+                text++;
+            continue;
+        }
+
+        if (length + 1 >= ASM_TEXT)
+            return;
+
+        line->op[n][length++] = *text;
+    }
+
+    line->op[n][length] = '\0';
+    line->op_count = (length > 0 || n > 0) ? n + 1 : 0;
+}
+
+static void remove_line(AsmState *as, int i)
+{
+    if (as->lines[i].owned)
+        free(as->lines[i].text);
+
+    as->lines[i].text  = NULL;
+    as->lines[i].owned = 0;
+    as->removed++;
+}
+
+static void rewrite_line(AsmState *as, int i, const char *mnemonic, const char *op0, const char *op1)
+{
+    AsmLine *line = &as->lines[i];
+    char *text = peep_alloc(strlen(mnemonic) + strlen(op0) + strlen(op1) + 8, 1, "assembly line");
+
+    if (op1[0])
+        sprintf(text, "\t%s %s, %s", mnemonic, op0, op1);
+    else
+        sprintf(text, "\t%s %s", mnemonic, op0);
+
+    if (line->owned)
+        free(line->text);
+
+    line->text  = text;
+    line->owned = 1;
+    parse_line(line);
+}
+
+//the next line still standing after i, -1 at the end
+static int next_line(const AsmState *as, int i)
+{
+    for (i++; i < as->count; i++)
+    {
+        if (as->lines[i].text)
+            return i;
+    }
+
+    return -1;
+}
+
+//the instruction right after i, -1 if a label or directive comes first
+static int next_instr(const AsmState *as, int i)
+{
+    i = next_line(as, i);
+
+    return (i >= 0 && as->lines[i].kind == ASM_INSTR && as->lines[i].op_count >= 0) ? i : -1;
+}
+
+static int mnemonic_is(const AsmLine *line, const char *stem)
+{
+    size_t n = strlen(stem);
+
+    return strncmp(line->mnemonic, stem, n) == 0 && line->mnemonic[n] && strchr("bwlq", line->mnemonic[n]) &&
+           line->mnemonic[n + 1] == '\0';
+}
+
+//whether nothing reads the flags left by instruction i before they are set again
+static int flags_dead(const AsmState *as, int i)
+{
+    static const char *const setters[] = { "cmp", "test", "add", "sub", "and", "or", "xor", "neg" };
+
+    for (i = next_line(as, i); i >= 0; i = next_line(as, i))
+    {
+        const AsmLine *line = &as->lines[i];
+        const char *m = line->mnemonic;
+
+        if (line->kind == ASM_LABEL)
+            return 1;
+
+        if (line->kind != ASM_INSTR)
+            return 0;
+
+        if (strcmp(m, "jmp") == 0 || strcmp(m, "call") == 0 || strcmp(m, "ret") == 0)
+            return 1;
+
+        if (m[0] == 'j' || strncmp(m, "set", 3) == 0 || strncmp(m, "cmov", 4) == 0 ||
+            strncmp(m, "adc", 3) == 0 || strncmp(m, "sbb", 3) == 0 || strncmp(m, "rc", 2) == 0)
+            return 0;
+
+        if (strstr(m, "comis"))
+            return 1;
+
+        for (int k = 0; k < (int)(sizeof(setters) / sizeof(setters[0])); k++)
+        {
+            if (mnemonic_is(line, setters[k]))
+                return 1;
+        }
+    }
+
+    return 1;
+}
+
+//whether the scratch register is written before anything reads it again
+static int scratch_dead(const AsmState *as, int i)
+{
+    for (i = next_line(as, i); i >= 0; i = next_line(as, i))
+    {
+        const AsmLine *line = &as->lines[i];
+        const char *m = line->mnemonic;
+
+        if (line->kind == ASM_LABEL)
+            return 1;
+
+        if (line->kind != ASM_INSTR || line->op_count < 0)
+            return 0;
+
+        if (strcmp(m, "jmp") == 0 || strcmp(m, "call") == 0 || strcmp(m, "ret") == 0)
+            return 1;
+
+        if (!mentions_family(line->text, SCRATCH_FAMILY))
+            continue;
+
+        return line->op_count == 2 && (strncmp(m, "mov", 3) == 0 || strncmp(m, "lea", 3) == 0) &&
+               operand_family(line->op[1]) == SCRATCH_FAMILY && !mentions_family(line->op[0], SCRATCH_FAMILY);
+    }
+
+    return 1;
+}
+
+static int is_memory(const char *op)
+{
+    return op[0] && op[0] != '%' && op[0] != '$';
+}
+
+static void rewrite_instr(AsmState *as, int i)
+{
+    AsmLine *line = &as->lines[i];
+    char label[ASM_TEXT + 2];
+    int next;
+
+    //jmp to the label that follows anyway
+    if (strcmp(line->mnemonic, "jmp") == 0 && line->op_count == 1)
+    {
+        snprintf(label, sizeof(label), "%s:", line->op[0]);
+
+        for (next = next_line(as, i); next >= 0 && as->lines[next].kind == ASM_LABEL; next = next_line(as, next))
+        {
+            if (strcmp(as->lines[next].text, label) == 0)
+            {
+                remove_line(as, i);
+                return;
+            }
+        }
+        return;
+    }
+
+    if (line->op_count != 2)
+        return;
+
+    //leaq 0(%x), %y is a move, or nothing
+    if (strcmp(line->mnemonic, "leaq") == 0 && strncmp(line->op[0], "0(%", 3) == 0 && !strchr(line->op[0], ','))
+    {
+        char source[ASM_TEXT];
+
+        snprintf(source, sizeof(source), "%.*s", (int)strlen(line->op[0]) - 3, line->op[0] + 2);
+
+        if (strcmp(source, line->op[1]) == 0)
+            remove_line(as, i);
+        else
+            rewrite_line(as, i, "movq", source, line->op[1]);
+        return;
+    }
+
+    if (strcmp(line->mnemonic, "movq") == 0 && strcmp(line->op[0], line->op[1]) == 0 && line->op[0][0] == '%')
+    {
+        remove_line(as, i);
+        return;
+    }
+
+    //an address built in the scratch register only to be copied out is built in place
+    if (strcmp(line->mnemonic, "leaq") == 0 && operand_family(line->op[1]) == SCRATCH_FAMILY &&
+        !mentions_family(line->op[0], SCRATCH_FAMILY) && (next = next_instr(as, i)) >= 0 &&
+        strcmp(as->lines[next].mnemonic, "movq") == 0 && strcmp(as->lines[next].op[0], line->op[1]) == 0 &&
+        as->lines[next].op[1][0] == '%' && scratch_dead(as, next))
+    {
+        char dest[ASM_TEXT];
+
+        strcpy(dest, as->lines[next].op[1]);
+        remove_line(as, next);
+        rewrite_line(as, i, "leaq", line->op[0], dest);
+        return;
+    }
+
+    //a store, then a load of the same place
+    if ((strcmp(line->mnemonic, "movl") == 0 || strcmp(line->mnemonic, "movq") == 0) &&
+        line->op[0][0] == '%' && is_memory(line->op[1]) && (next = next_instr(as, i)) >= 0 &&
+        strcmp(as->lines[next].mnemonic, line->mnemonic) == 0 && strcmp(as->lines[next].op[0], line->op[1]) == 0 &&
+        as->lines[next].op[1][0] == '%')
+    {
+        if (strcmp(as->lines[next].op[1], line->op[0]) == 0)
+            remove_line(as, next);
+        else
+        {
+            char source[ASM_TEXT];
+
+            strcpy(source, line->op[0]);
+            rewrite_line(as, next, line->mnemonic, source, as->lines[next].op[1]);
+        }
+        return;
+    }
+
+    //a load, then a store of the same value back
+    if ((strcmp(line->mnemonic, "movl") == 0 || strcmp(line->mnemonic, "movq") == 0) &&
+        is_memory(line->op[0]) && line->op[1][0] == '%' && (next = next_instr(as, i)) >= 0 &&
+        strcmp(as->lines[next].mnemonic, line->mnemonic) == 0 && strcmp(as->lines[next].op[0], line->op[1]) == 0 &&
+        strcmp(as->lines[next].op[1], line->op[0]) == 0 && !mentions_family(line->op[0], operand_family(line->op[1])))
+    {
+        remove_line(as, next);
+        return;
+    }
+
+    //the rest change the flags
+    if (!flags_dead(as, i))
+        return;
+
+    if ((strcmp(line->mnemonic, "addq") == 0 || strcmp(line->mnemonic, "subq") == 0) && strcmp(line->op[0], "$0") == 0)
+    {
+        remove_line(as, i);
+        return;
+    }
+
+    if ((mnemonic_is(line, "add") || mnemonic_is(line, "sub")) && strcmp(line->op[0], "$1") == 0)
+    {
+        char mnemonic[8];
+
+        snprintf(mnemonic, sizeof(mnemonic), "%s%c", (line->mnemonic[0] == 'a') ? "inc" : "dec", line->mnemonic[3]);
+        rewrite_line(as, i, mnemonic, line->op[1], "");
+        return;
+    }
+
+    if (strcmp(line->mnemonic, "movl") == 0 && strcmp(line->op[0], "$0") == 0 && line->op[1][0] == '%')
+    {
+        char reg[ASM_TEXT];
+
+        strcpy(reg, line->op[1]);
+        rewrite_line(as, i, "xorl", reg, reg);
+    }
+}
+
+int peephole_x86(char *text, FILE *out)
+{
+    AsmState as;
+    int capacity = 1;
+
+    for (const char *c = text; *c; c++)
+        capacity += (*c == '\n');
+
+    as.lines   = peep_alloc((size_t)capacity, sizeof(AsmLine), "assembly lines");
+    as.count   = 0;
+    as.removed = 0;
+
+    for (char *line = text; *line; )
+    {
+        char *end = strchr(line, '\n');
+
+        if (end)
+            *end = '\0';
+
+        as.lines[as.count].text = line;
+        parse_line(&as.lines[as.count]);
+        as.count++;
+
+        if (!end)
+            break;
+
+        line = end + 1;
+    }
+
+    //a second round sees the moves the first one made out of leaq
+    for (int round = 0; round < 2; round++)
+    {
+        for (int i = 0; i < as.count; i++)
+        {
+            if (as.lines[i].text && as.lines[i].kind == ASM_INSTR && as.lines[i].op_count >= 0)
+                rewrite_instr(&as, i);
+        }
+    }
+
+    for (int i = 0; i < as.count; i++)
+    {
+        if (!as.lines[i].text)
+            continue;
+
+        fputs(as.lines[i].text, out);
+        fputc('\n', out);
+
+        if (as.lines[i].owned)
+            free(as.lines[i].text);
+    }
+
+    free(as.lines);
+
+    return as.removed;
+}
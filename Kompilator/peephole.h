@@ -0,0 +1,59 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <stdio.h>
+
+#include "bytecode.h"
+
+/* ---------------------------------------------
+   Peephole passes
+
+   Run over what the back ends emitted, after
+   instruction selection, on windows of one or
+   two instructions.
+
+   peephole_bytecode() rewrites one function's
+   bytecode into the superinstructions of
+   bytecode.h, picked from the opcode pairs the
+   interpreter runs most often on Programs/ and
+   Bench/ (vm.h, VM_PAIR_PROFILE):
+
+     EQ/LT/... + BRNZ/BRZ    fused compare and
+                             branch, the compare
+                             kept only if its
+                             result has other uses
+     CONST + compare-branch  B..K against the
+                             constant pool
+     CONST + ADD/SUB         ADDI32 / ADDI64, so
+                             x ÖKAR is one op
+     OFFSET + LOAD/STORE     the offset moves
+                             into the access
+
+   A CONST whose register is then read by
+   nothing goes, as does a JMP to the next
+   instruction; jump targets are renumbered.
+   The JMPs that make up a SWITCH table stay.
+
+   peephole_x86() does the same for one
+   function's assembly text: a store followed
+   by a load of the same slot becomes a move,
+   a load followed by a store back is dropped,
+   add/sub of 1 become inc/dec, adding 0 and
+   leaq 0(%r), %r go, an address built in a
+   scratch register and copied out is built
+   in place, movl $0 becomes xorl, and a jmp
+   to the label right after it is removed.
+   Rewrites that change the flags are only made
+   where the next flag reader is behind a new
+   compare; the back end never keeps flags
+   across a label, jump or call. Compares are
+   already fused into branches by x86.c.
+--------------------------------------------- */
+
+// returns the number of instructions removed from function fi, the last one compiled into p
+int peephole_bytecode(VmProgram *p, int fi);
+
+// copies the text to out with the rewrites made; returns the number of instructions removed
+int peephole_x86(char *text, FILE *out);
+
+#endif /* PEEPHOLE_H */
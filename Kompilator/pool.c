@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+//a range [lo, hi) of task indices: lo in the high half, hi in the low half
+#define RANGE(lo, hi)  (((uint64_t)(uint32_t)(lo) << 32) | (uint32_t)(hi))
+#define RANGE_LO(r)    ((int)((r) >> 32))
+#define RANGE_HI(r)    ((int)((r) & 0xFFFFFFFFu))
+
+typedef struct PoolDeque {
+    _Atomic uint64_t range;
+    char             pad[64 - sizeof(uint64_t)];   // one deque per cache line
+} PoolDeque;
+
+typedef struct PoolState {
+    PoolDeque *deques;
+    int        workers;
+    PoolTask   task;
+    void      *context;
+} PoolState;
+
+typedef struct PoolWorker {
+    PoolState *pool;
+    int        id;
+} PoolWorker;
+
+//takes the task at the front of the worker's own range, -1 when it is empty
+static int pop_front(PoolDeque *d)
+{
+    uint64_t r = atomic_load(&d->range);
+
+    while (RANGE_LO(r) < RANGE_HI(r))
+    {
+        if (atomic_compare_exchange_weak(&d->range, &r, RANGE(RANGE_LO(r) + 1, RANGE_HI(r))))
+            return RANGE_LO(r);
+    }
+
+    return -1;
+}
+
+//moves the back half of another worker's range (at least one task) into the thief's empty deque
+static int steal_half(PoolState *pool, int thief)
+{
+    for (int k = 1; k < pool->workers; k++)
+    {
+        PoolDeque *victim = &pool->deques[(thief + k) % pool->workers];
+        uint64_t r = atomic_load(&victim->range);
+
+        while (RANGE_LO(r) < RANGE_HI(r))
+        {
+            int lo = RANGE_LO(r), hi = RANGE_HI(r);
+            int mid = lo + (hi - lo) / 2;
+
+            if (atomic_compare_exchange_weak(&victim->range, &r, RANGE(lo, mid)))
+            {
+                //an empty deque is never written by a thief, so a plain store is safe
+                atomic_store(&pool->deques[thief].range, RANGE(mid, hi));
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void *worker_main(void *arg)
+{
+    PoolWorker *w = arg;
+    PoolState *pool = w->pool;
+
+    for (;;)
+    {
+        int index = pop_front(&pool->deques[w->id]);
+
+        if (index >= 0)
+        {
+            pool->task(pool->context, index, w->id);
+            continue;
+        }
+
+        //tasks only ever move between deques, so once none is left to steal the worker is done
+        if (!steal_half(pool, w->id))
+            break;
+    }
+
+    return NULL;
+}
+
+void pool_run(int workers, int count, PoolTask task, void *context)
+{
+    if (workers > count)
+        workers = count;
+
+    if (workers > POOL_MAX_WORKERS)
+        workers = POOL_MAX_WORKERS;
+
+    if (workers <= 1)
+    {
+        for (int i = 0; i < count; i++)
+            task(context, i, 0);
+
+        return;
+    }
+
+    PoolState pool;
+    PoolWorker *w = malloc(workers * sizeof(PoolWorker));
+    pthread_t *threads = malloc(workers * sizeof(pthread_t));
+
+    pool.deques  = aligned_alloc(64, workers * sizeof(PoolDeque));
+    pool.workers = workers;
+    pool.task    = task;
+    pool.context = context;
+
+    if (!w || !threads || !pool.deques)
+    {
+        fprintf(stderr, "Fatal: failed to allocate thread pool\n");
+        exit(1);
+    }
+
+    //contiguous shares keep each worker near the front of the input, which the ordered output drains first
+    for (int i = 0; i < workers; i++)
+    {
+        long lo = (long)count * i / workers;
+        long hi = (long)count * (i + 1) / workers;
+
+        atomic_init(&pool.deques[i].range, RANGE(lo, hi));
+
+        w[i].pool = &pool;
+        w[i].id   = i;
+    }
+
+    for (int i = 1; i < workers; i++)
+    {
+        if (pthread_create(&threads[i], NULL, worker_main, &w[i]) != 0)
+        {
+            fprintf(stderr, "Fatal: failed to start worker thread\n");
+            exit(1);
+        }
+    }
+
+    worker_main(&w[0]);
+
+    for (int i = 1; i < workers; i++)
+        pthread_join(threads[i], NULL);
+
+    free(pool.deques);
+    free(threads);
+    free(w);
+}
+
+int pool_processors(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (int)n : 1;
+}
@@ -0,0 +1,36 @@
+#ifndef POOL_H
+#define POOL_H
+
+/* ---------------------------------------------
+   Work-stealing thread pool
+
+   Runs task(context, i, worker) once for every
+   i in [0, count) on a fixed set of worker
+   threads and returns when all have finished.
+
+   Each worker owns a deque holding a range of
+   task indices, packed into one atomic word.
+   The range starts as an even share of the
+   count in input order. A worker takes tasks
+   from the front of its own range; when that is
+   empty it steals the back half of another
+   worker's range with a compare-and-swap. No
+   lock is shared between workers, so a task
+   that runs long (a large submission) only
+   holds up its own worker while the others
+   take its remaining share.
+
+   With one worker the tasks run in order on the
+   calling thread.
+--------------------------------------------- */
+
+#define POOL_MAX_WORKERS 256
+
+typedef void (*PoolTask)(void *context, int index, int worker);
+
+void pool_run(int workers, int count, PoolTask task, void *context);
+
+// number of processors online, at least 1
+int  pool_processors(void);
+
+#endif /* POOL_H */
@@ -0,0 +1,665 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "regalloc.h"
+#include "loop.h"
+
+typedef struct RaInterval {
+    int    value;           // the phi group's leader
+    int    start;
+    int    end;
+    int    is_float;
+    int    crosses_call;
+    double weight;
+} RaInterval;
+
+typedef struct RaState {
+    const IrFunc   *f;
+    int             words;          // 64-bit words per live set
+
+    int            *pos;            // position of each instruction
+    int            *block_start;
+    int            *block_end;      // position of the terminator
+
+    uint64_t       *live_in;
+    uint64_t       *live_out;
+
+    int            *start;
+    int            *end;
+    int            *uses;
+    int            *copy_start;     // per phi: first and last copy into it, at predecessor ends
+    int            *copy_end;
+    double         *weight;
+    double         *frequency;      // per block: RA_LOOP_WEIGHT to the power of its loop depth
+
+    int            *leader;         // phi group of each value, itself if alone
+    int            *next_member;    // rest of the group after this value, -1 at the end
+
+    int            *calls;          // positions of CALL instructions, ascending
+    int             call_count;
+} RaState;
+
+static void *ra_alloc(size_t count, size_t size)
+{
+    void *ptr = calloc(count ? count : 1, size);
+
+    if (!ptr)
+    {
+        fprintf(stderr, "Fatal: register allocator allocation failed\n");
+        exit(1);
+    }
+
+    return ptr;
+}
+
+static void set_bit(uint64_t *set, int v)
+{
+    set[v >> 6] |= 1ULL << (v & 63);
+}
+
+static int test_bit(const uint64_t *set, int v)
+{
+    return (set[v >> 6] >> (v & 63)) & 1;
+}
+
+static void extend(RaState *rs, int v, int position)
+{
+    if (position < rs->start[v])
+        rs->start[v] = position;
+    if (position > rs->end[v])
+        rs->end[v] = position;
+}
+
+//a use or definition in block b
+static void use_in(RaState *rs, int v, int b)
+{
+    rs->uses[v]++;
+    rs->weight[v] += rs->frequency[b];
+}
+
+
+
+/*
+  _      _
+ | |    (_)
+ | |     ___   _____ _ __   ___  ___ ___
+ | |    | \ \ / / _ \ '_ \ / _ \/ __/ __|
+ | |____| |\ V /  __/ | | |  __/\__ \__ \
+ |______|_| \_/ \___|_| |_|\___||___/___/
+
+*/
+
+static void number_instructions(RaState *rs)
+{
+    const IrFunc *f = rs->f;
+    int next = 0;
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        rs->block_start[b] = next;
+        next += 2;
+
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+        {
+            //phis take effect at the block boundary
+            if (f->instrs[i].op == IR_PHI)
+            {
+                rs->pos[i] = rs->block_start[b];
+                continue;
+            }
+
+            rs->pos[i] = next;
+            next += 2;
+
+            if (f->instrs[i].op == IR_CALL)
+                rs->calls[rs->call_count++] = rs->pos[i];
+        }
+
+        rs->block_end[b] = next - 2;
+    }
+}
+
+//phi operands that flow along the edges from b
+static void add_phi_uses(const IrFunc *f, int b, int succ, uint64_t *set)
+{
+    const IrBlock *blk = &f->blocks[succ];
+
+    for (int k = 0; k < blk->pred_count; k++)
+    {
+        if (blk->preds[k] != b)
+            continue;
+
+        for (int i = blk->first; i != IR_NONE && f->instrs[i].op == IR_PHI; i = f->instrs[i].next)
+            set_bit(set, f->operands[f->instrs[i].args + k]);
+    }
+}
+
+static void compute_liveness(RaState *rs)
+{
+    const IrFunc *f = rs->f;
+    int words = rs->words;
+    uint64_t *uses = ra_alloc((size_t)f->block_count * words, sizeof(uint64_t));
+    uint64_t *defs = ra_alloc((size_t)f->block_count * words, sizeof(uint64_t));
+    uint64_t *out  = ra_alloc(words, sizeof(uint64_t));
+    int changed = 1;
+
+    //upward-exposed uses and definitions of every block
+    for (int b = 0; b < f->block_count; b++)
+    {
+        uint64_t *use = uses + (size_t)b * words;
+        uint64_t *def = defs + (size_t)b * words;
+
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+        {
+            const IrInstr *in = &f->instrs[i];
+
+            if (in->op != IR_PHI)
+            {
+                if (in->a >= 0 && !test_bit(def, in->a))
+                    set_bit(use, in->a);
+                if (in->b >= 0 && !test_bit(def, in->b))
+                    set_bit(use, in->b);
+
+                for (int k = 0; k < in->nargs; k++)
+                {
+                    int v = f->operands[in->args + k];
+
+                    if (!test_bit(def, v))
+                        set_bit(use, v);
+                }
+            }
+
+            if (ir_defines_value(in))
+                set_bit(def, i);
+        }
+    }
+
+    while (changed)
+    {
+        changed = 0;
+
+        for (int b = f->block_count - 1; b >= 0; b--)
+        {
+            uint64_t *use = uses + (size_t)b * words;
+            uint64_t *def = defs + (size_t)b * words;
+            uint64_t *in  = rs->live_in + (size_t)b * words;
+            const int *succ;
+            int n = ir_successors(f, b, &succ);
+
+            memset(out, 0, words * sizeof(uint64_t));
+
+            for (int s = 0; s < n; s++)
+            {
+                const uint64_t *succ_in = rs->live_in + (size_t)succ[s] * words;
+
+                for (int w = 0; w < words; w++)
+                    out[w] |= succ_in[w];
+
+                add_phi_uses(f, b, succ[s], out);
+            }
+
+            memcpy(rs->live_out + (size_t)b * words, out, words * sizeof(uint64_t));
+
+            for (int w = 0; w < words; w++)
+            {
+                uint64_t next = use[w] | (out[w] & ~def[w]);
+
+                if (next != in[w])
+                {
+                    in[w] = next;
+                    changed = 1;
+                }
+            }
+        }
+    }
+
+    free(uses);
+    free(defs);
+    free(out);
+}
+
+static void build_intervals(RaState *rs)
+{
+    const IrFunc *f = rs->f;
+    int words = rs->words;
+
+    for (int v = 0; v < f->instr_count; v++)
+    {
+        rs->start[v]      = 0x7FFFFFFF;
+        rs->end[v]        = -1;
+        rs->copy_start[v] = 0x7FFFFFFF;
+        rs->copy_end[v]   = -1;
+    }
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        const uint64_t *in  = rs->live_in  + (size_t)b * words;
+        const uint64_t *out = rs->live_out + (size_t)b * words;
+
+        for (int w = 0; w < words; w++)
+        {
+            for (uint64_t bits = in[w]; bits; bits &= bits - 1)
+                extend(rs, w * 64 + __builtin_ctzll(bits), rs->block_start[b]);
+
+            for (uint64_t bits = out[w]; bits; bits &= bits - 1)
+                extend(rs, w * 64 + __builtin_ctzll(bits), rs->block_end[b]);
+        }
+
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+        {
+            const IrInstr *in_ = &f->instrs[i];
+
+            if (ir_defines_value(in_))
+            {
+                extend(rs, i, rs->pos[i]);
+                rs->weight[i] += rs->frequency[b];
+            }
+
+            if (in_->op == IR_PHI)
+            {
+                //the copy into the phi is made at the end of each predecessor
+                for (int k = 0; k < in_->nargs; k++)
+                {
+                    int pred = f->blocks[b].preds[k];
+                    int v = f->operands[in_->args + k];
+
+                    extend(rs, v, rs->block_end[pred]);
+                    use_in(rs, v, pred);
+
+                    if (rs->block_end[pred] < rs->copy_start[i])
+                        rs->copy_start[i] = rs->block_end[pred];
+                    if (rs->block_end[pred] > rs->copy_end[i])
+                        rs->copy_end[i] = rs->block_end[pred];
+                }
+                continue;
+            }
+
+            if (in_->a >= 0)
+            {
+                extend(rs, in_->a, rs->pos[i]);
+                use_in(rs, in_->a, b);
+            }
+            if (in_->b >= 0)
+            {
+                extend(rs, in_->b, rs->pos[i]);
+                use_in(rs, in_->b, b);
+            }
+
+            for (int k = 0; k < in_->nargs; k++)
+            {
+                extend(rs, f->operands[in_->args + k], rs->pos[i]);
+                use_in(rs, f->operands[in_->args + k], b);
+            }
+        }
+    }
+}
+
+static int crosses_call(const RaState *rs, int start, int end)
+{
+    //first call after start
+    int lo = 0, hi = rs->call_count;
+
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+
+        if (rs->calls[mid] <= start)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo < rs->call_count && rs->calls[lo] < end;
+}
+
+
+
+//whether two values are live at the same time, leaving out the copies into a phi
+static int overlap(const RaState *rs, int x, int y)
+{
+    return rs->start[x] < rs->end[y] && rs->start[y] < rs->end[x];
+}
+
+static int groups_overlap(const RaState *rs, int x, int y)
+{
+    for (int a = x; a >= 0; a = rs->next_member[a])
+    {
+        for (int b = y; b >= 0; b = rs->next_member[b])
+        {
+            if (overlap(rs, a, b))
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+//puts each phi in one group with the operands it never lives alongside; returns the merges
+static int coalesce_phis(RaState *rs, const char *candidate)
+{
+    const IrFunc *f = rs->f;
+    int merged = 0;
+
+    for (int v = 0; v < f->instr_count; v++)
+    {
+        rs->leader[v]      = v;
+        rs->next_member[v] = -1;
+    }
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        for (int p = f->blocks[b].first; p != IR_NONE && f->instrs[p].op == IR_PHI; p = f->instrs[p].next)
+        {
+            if (!candidate[p])
+                continue;
+
+            for (int k = 0; k < f->instrs[p].nargs; k++)
+            {
+                int v = f->operands[f->instrs[p].args + k];
+                int into = rs->leader[p];
+                int from;
+                int last;
+
+                if (v < 0 || !candidate[v] || rs->leader[v] == into)
+                    continue;
+
+                from = rs->leader[v];
+
+                if (groups_overlap(rs, into, from))
+                    continue;
+
+                for (last = into; rs->next_member[last] >= 0; last = rs->next_member[last])
+                    ;
+
+                rs->next_member[last] = from;
+
+                for (int m = from; m >= 0; m = rs->next_member[m])
+                    rs->leader[m] = into;
+
+                merged++;
+            }
+        }
+    }
+
+    return merged;
+}
+
+
+
+/*
+  _      _                         _____
+ | |    (_)                       / ____|
+ | |     _ _ __   ___  __ _ _ __ | (___   ___ __ _ _ __
+ | |    | | '_ \ / _ \/ _` | '__| \___ \ / __/ _` | '_ \
+ | |____| | | | |  __/ (_| | |    ____) | (_| (_| | | | |
+ |______|_|_| |_|\___|\__,_|_|   |_____/ \___\__,_|_| |_|
+
+*/
+
+static int compare_start(const void *x, const void *y)
+{
+    const RaInterval *a = x;
+    const RaInterval *b = y;
+
+    if (a->start != b->start)
+        return (a->start < b->start) ? -1 : 1;
+
+    return a->value - b->value;
+}
+
+static void spill(RaResult *out, const RaInterval *interval)
+{
+    out->reg[interval->value]   = -1;
+    out->spill[interval->value] = out->spill_count++;
+    out->spill_weight += interval->weight;
+}
+
+//spill weight per instruction the interval covers
+static double density(const RaInterval *interval)
+{
+    return interval->weight / ((interval->end - interval->start) / 2 + 1);
+}
+
+static void linear_scan(const RaTarget *target, RaInterval *list, int count, int is_float, RaResult *out)
+{
+    const int *regs = is_float ? target->float_regs : target->int_regs;
+    int reg_count = is_float ? target->float_count : target->int_count;
+    RaInterval **active = ra_alloc(count + 1, sizeof(RaInterval *));
+    int active_count = 0;
+    unsigned free_mask = 0;
+
+    for (int r = 0; r < reg_count; r++)
+        free_mask |= 1u << regs[r];
+
+    for (int i = 0; i < count; i++)
+    {
+        RaInterval *cur = &list[i];
+
+        if (cur->is_float != is_float)
+            continue;
+
+        //expire intervals that ended before this one starts; active stays sorted by end
+        int kept = 0;
+
+        for (int k = 0; k < active_count; k++)
+        {
+            if (active[k]->end <= cur->start)
+                free_mask |= 1u << out->reg[active[k]->value];
+            else
+                active[kept++] = active[k];
+        }
+
+        active_count = kept;
+
+        unsigned allowed = cur->crosses_call ? target->preserved : ~0u;
+        //nothing has to save a register that no call needs preserved
+        unsigned prefer = cur->crosses_call ? allowed : ~target->preserved;
+        int reg = -1;
+
+        for (int pass = 0; pass < 2 && reg < 0; pass++)
+        {
+            for (int r = 0; r < reg_count; r++)
+            {
+                if ((free_mask & allowed & (pass ? ~0u : prefer)) & (1u << regs[r]))
+                {
+                    reg = regs[r];
+                    break;
+                }
+            }
+        }
+
+        if (reg < 0)
+        {
+            //the cheapest of this interval and the active ones it could take a register from goes
+            int victim = -1;
+            double lowest = density(cur);
+
+            for (int k = 0; k < active_count; k++)
+            {
+                if ((allowed & (1u << out->reg[active[k]->value])) && density(active[k]) < lowest)
+                {
+                    victim = k;
+                    lowest = density(active[k]);
+                }
+            }
+
+            if (victim < 0)
+            {
+                spill(out, cur);
+                continue;
+            }
+
+            reg = out->reg[active[victim]->value];
+            spill(out, active[victim]);
+
+            memmove(&active[victim], &active[victim + 1], (active_count - victim - 1) * sizeof(RaInterval *));
+            active_count--;
+        }
+
+        free_mask &= ~(1u << reg);
+        out->reg[cur->value] = reg;
+        out->used |= 1u << reg;
+
+        int at = active_count;
+
+        while (at > 0 && active[at - 1]->end > cur->end)
+        {
+            active[at] = active[at - 1];
+            at--;
+        }
+
+        active[at] = cur;
+        active_count++;
+    }
+
+    free(active);
+}
+
+void ra_allocate(const IrFunc *f, const RaTarget *target, const unsigned char *skip, RaResult *out)
+{
+    RaState rs;
+    int n = f->instr_count;
+    int *depth = ra_alloc(f->block_count, sizeof(int));
+    char *candidate = ra_alloc(n, 1);
+
+    memset(&rs, 0, sizeof(rs));
+
+    rs.f           = f;
+    rs.words       = (n + 63) / 64;
+    rs.pos         = ra_alloc(n, sizeof(int));
+    rs.block_start = ra_alloc(f->block_count, sizeof(int));
+    rs.block_end   = ra_alloc(f->block_count, sizeof(int));
+    rs.live_in     = ra_alloc((size_t)f->block_count * rs.words, sizeof(uint64_t));
+    rs.live_out    = ra_alloc((size_t)f->block_count * rs.words, sizeof(uint64_t));
+    rs.start       = ra_alloc(n, sizeof(int));
+    rs.end         = ra_alloc(n, sizeof(int));
+    rs.uses        = ra_alloc(n, sizeof(int));
+    rs.copy_start  = ra_alloc(n, sizeof(int));
+    rs.copy_end    = ra_alloc(n, sizeof(int));
+    rs.weight      = ra_alloc(n, sizeof(double));
+    rs.frequency   = ra_alloc(f->block_count, sizeof(double));
+    rs.leader      = ra_alloc(n, sizeof(int));
+    rs.next_member = ra_alloc(n, sizeof(int));
+    rs.calls       = ra_alloc(n, sizeof(int));
+
+    memset(out, 0, sizeof(*out));
+    out->reg   = ra_alloc(n, sizeof(int));
+    out->spill = ra_alloc(n, sizeof(int));
+
+    loop_depths(f, depth);
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        rs.frequency[b] = 1.0;
+
+        for (int d = 0; d < depth[b] && d < RA_MAX_DEPTH; d++)
+            rs.frequency[b] *= RA_LOOP_WEIGHT;
+    }
+
+    number_instructions(&rs);
+    compute_liveness(&rs);
+    build_intervals(&rs);
+
+    for (int v = 0; v < n; v++)
+    {
+        const IrInstr *in = &f->instrs[v];
+
+        out->reg[v]   = -1;
+        out->spill[v] = -1;
+
+        //unused results and values the target rebuilds on demand need no home
+        candidate[v] = !(in->block == IR_NONE || !ir_defines_value(in) || rs.uses[v] == 0 || (skip && skip[v]));
+        out->values += candidate[v];
+    }
+
+    //with no registers there is nothing to share: every value keeps a slot of its own
+    if (target->int_count + target->float_count > 0)
+        out->coalesced = coalesce_phis(&rs, candidate);
+    else
+    {
+        for (int v = 0; v < n; v++)
+        {
+            rs.leader[v]      = v;
+            rs.next_member[v] = -1;
+        }
+    }
+
+    RaInterval *list = ra_alloc(n, sizeof(RaInterval));
+    int count = 0;
+
+    for (int v = 0; v < n; v++)
+    {
+        RaInterval *group = &list[count];
+
+        if (!candidate[v] || rs.leader[v] != v)
+            continue;
+
+        group->value    = v;
+        group->start    = 0x7FFFFFFF;
+        group->end      = -1;
+        group->is_float = ir_type_is_float(f->instrs[v].type) || f->instrs[v].type == IRT_VEC;
+        group->weight   = 0.0;
+
+        //the group also holds each phi from its first copy to its last
+        for (int m = v; m >= 0; m = rs.next_member[m])
+        {
+            int lo = (rs.copy_start[m] < rs.start[m]) ? rs.copy_start[m] : rs.start[m];
+            int hi = (rs.copy_end[m] > rs.end[m]) ? rs.copy_end[m] : rs.end[m];
+
+            if (lo < group->start)
+                group->start = lo;
+            if (hi > group->end)
+                group->end = hi;
+
+            group->weight += rs.weight[m];
+        }
+
+        group->crosses_call = crosses_call(&rs, group->start, group->end);
+        count++;
+    }
+
+    qsort(list, count, sizeof(RaInterval), compare_start);
+
+    linear_scan(target, list, count, 0, out);
+    linear_scan(target, list, count, 1, out);
+
+    for (int v = 0; v < n; v++)
+    {
+        if (!candidate[v])
+            continue;
+
+        out->reg[v]   = out->reg[rs.leader[v]];
+        out->spill[v] = out->spill[rs.leader[v]];
+        out->spilled += (out->spill[v] >= 0);
+    }
+
+    free(list);
+    free(depth);
+    free(candidate);
+    free(rs.pos);
+    free(rs.block_start);
+    free(rs.block_end);
+    free(rs.live_in);
+    free(rs.live_out);
+    free(rs.start);
+    free(rs.end);
+    free(rs.uses);
+    free(rs.copy_start);
+    free(rs.copy_end);
+    free(rs.weight);
+    free(rs.frequency);
+    free(rs.leader);
+    free(rs.next_member);
+    free(rs.calls);
+}
+
+void free_ra_result(RaResult *r)
+{
+    free(r->reg);
+    free(r->spill);
+
+    r->reg = NULL;
+    r->spill = NULL;
+}
@@ -0,0 +1,65 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include "ir.h"
+
+/* ---------------------------------------------
+   Register allocation
+
+   Linear scan (Poletto & Sarkar) over the SSA
+   IR. Blocks are laid out in IR order and every
+   value gets one interval from its first to its
+   last live position, computed from block
+   liveness; a phi is live from the end of each
+   predecessor, where its copy is made, to its
+   last use.
+
+   A phi and the operands flowing into it share
+   one interval, register and spill slot when
+   none of them is live while another is, which
+   turns their edge copies into nothing.
+
+   Values live across a CALL only go into
+   registers the target preserves across calls;
+   the others try the rest first, so a function
+   without calls saves no callee-saved registers
+   it does not need. When a class runs out, the
+   interval with the lowest spill weight per
+   position it covers goes to memory: each use
+   and definition counts RA_LOOP_WEIGHT times
+   more for every loop it sits in. Vector values
+   share the float registers.
+
+   A target without registers puts every value
+   in a slot of its own, the naive allocation.
+--------------------------------------------- */
+
+#define RA_MAX_REGS     32
+#define RA_LOOP_WEIGHT  10          // how much more a use one loop deeper costs to spill
+#define RA_MAX_DEPTH    6           // deeper loops weigh as much as this
+
+typedef struct RaTarget {
+    int      int_regs[RA_MAX_REGS];     // allocation order
+    int      int_count;
+    int      float_regs[RA_MAX_REGS];
+    int      float_count;
+    unsigned preserved;                 // mask of registers that survive a call
+} RaTarget;
+
+typedef struct RaResult {
+    int     *reg;           // per value: assigned register, -1 if none
+    int     *spill;         // per value: spill slot, -1 if none
+    int      spill_count;
+    unsigned used;          // mask of every register handed out
+
+    int      values;        // values that needed a home
+    int      spilled;       // of those, values in a spill slot
+    int      coalesced;     // phi operands sharing the phi's interval
+    double   spill_weight;  // summed weight of the spilled intervals
+} RaResult;
+
+// skip marks values the caller materialises itself (constants, addresses); may be NULL
+void ra_allocate(const IrFunc *f, const RaTarget *target, const unsigned char *skip, RaResult *out);
+void free_ra_result(RaResult *r);
+
+#endif /* REGALLOC_H */
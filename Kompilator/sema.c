@@ -0,0 +1,1462 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <limits.h>
+
+#include "sema.h"
+#include "fold.h"
+
+/*
+   Semantic analysis runs over the finished tree in four passes:
+
+     1. struct names        (so fields and types may refer to structs declared later)
+     2. type declarations, struct fields and function signatures
+     3. struct layout       (sizes, alignment, field offsets)
+     4. global variables and function bodies, in source order
+
+   Results are written back into the tree: AstNode.type on types, declarations
+   and expressions, AstNode.sym on names, the byte offset of every FÄLT
+   access in AstNode.aux, and the folded value of every constant expression
+   in AstNode.value (see fold.h).
+*/
+
+static int  check_expr(SemState *state, int node);
+static void check_stmt(SemState *state, int node);
+
+static AstNode *node_at(SemState *state, int node)
+{
+    return &state->ast->nodes[node];
+}
+
+static void sem_error(SemState *state, int node, const char *fmt, ...)
+{
+    va_list args;
+
+    state->error_count++;
+
+    fprintf(state->out, "Semantic error at %d:%d: ",
+           ast_row(state->ast, node),
+           ast_col(state->ast, node));
+
+    va_start(args, fmt);
+    vfprintf(state->out, fmt, args);
+    va_end(args);
+
+    fputc('\n', state->out);
+}
+
+
+
+/*
+   _____                 _           _
+  / ____|               | |         | |
+ | (___  _   _ _ __ ___ | |__   ___ | |___
+  \___ \| | | | '_ ` _ \| '_ \ / _ \| / __|
+  ____) | |_| | | | | | | |_) | (_) | \__ \
+ |_____/ \__, |_| |_| |_|_.__/ \___/|_|___/
+          __/ |
+         |___/
+*/
+
+static unsigned hash_name(const char *name)
+{
+    unsigned h = 5381;
+
+    while (*name)
+        h = h * 33 + (unsigned char)*name++;
+
+    return h % SEM_BUCKETS;
+}
+
+static int find_symbol(SemState *state, const char *name)
+{
+    for (int s = state->buckets[hash_name(name)]; s >= 0; s = state->symbols[s].hash_next)
+    {
+        if (strcmp(state->symbols[s].name, name) == 0)
+            return s;
+    }
+
+    return -1;
+}
+
+static int declare_symbol(SemState *state, int node, SymKind kind, int type)
+{
+    const char *name = ast_name(state->ast, node);
+    int existing = find_symbol(state, name);
+    unsigned h = hash_name(name);
+
+    if (existing >= 0 && state->symbols[existing].depth == state->depth)
+    {
+        sem_error(state, node, "redeclaration of '%s' (previous declaration at %d:%d)",
+                  name,
+                  ast_row(state->ast, state->symbols[existing].node),
+                  ast_col(state->ast, state->symbols[existing].node));
+    }
+
+    if (state->symbol_count >= state->symbol_capacity)
+    {
+        state->symbol_capacity = (state->symbol_capacity == 0) ? 64 : state->symbol_capacity * 2;
+        state->symbols = realloc(state->symbols, state->symbol_capacity * sizeof(Symbol));
+
+        if (!state->symbols)
+        {
+            fprintf(stderr, "Fatal: symbol table realloc failed\n");
+            exit(1);
+        }
+    }
+
+    if (state->scope_count >= state->scope_capacity)
+    {
+        state->scope_capacity = (state->scope_capacity == 0) ? 64 : state->scope_capacity * 2;
+        state->scope_stack = realloc(state->scope_stack, state->scope_capacity * sizeof(int));
+
+        if (!state->scope_stack)
+        {
+            fprintf(stderr, "Fatal: scope stack realloc failed\n");
+            exit(1);
+        }
+    }
+
+    int id = state->symbol_count++;
+    Symbol *sym = &state->symbols[id];
+
+    sym->name      = name;
+    sym->kind      = kind;
+    sym->type      = type;
+    sym->node      = node;
+    sym->depth     = state->depth;
+    sym->hash_next = state->buckets[h];
+    sym->value     = 0;
+
+    state->buckets[h] = id;
+    state->scope_stack[state->scope_count++] = id;
+
+    node_at(state, node)->sym = id;
+
+    return id;
+}
+
+static void push_scope(SemState *state)
+{
+    state->depth++;
+}
+
+//unhooks every symbol of the innermost scope; older shadowed ones become visible again
+static void pop_scope(SemState *state)
+{
+    while (state->scope_count > 0)
+    {
+        Symbol *sym = &state->symbols[state->scope_stack[state->scope_count - 1]];
+
+        if (sym->depth != state->depth)
+            break;
+
+        state->buckets[hash_name(sym->name)] = sym->hash_next;
+        state->scope_count--;
+    }
+
+    state->depth--;
+}
+
+
+
+/*
+  _______
+ |__   __|
+    | |_   _ _ __   ___  ___
+    | | | | | '_ \ / _ \/ __|
+    | | |_| | |_) |  __/\__ \
+    |_|\__, | .__/ \___||___/
+        __/ | |
+       |___/|_|
+*/
+
+//where a constant is required, says why a checked expression did not fold if folding failed rather than met a run-time value
+static int report_fold_failure(SemState *state, int node)
+{
+    AstNode *n = node_at(state, node);
+
+    if (n->value.kind != CONST_NONE || n->type == state->types->ty_error ||
+        (n->kind != AST_UNARY && n->kind != AST_BINARY && n->kind != AST_CAST))
+        return 0;
+
+    for (int k = 0; k < 4; k++)
+    {
+        if (node_at(state, node)->kid[k] != AST_NULL && report_fold_failure(state, node_at(state, node)->kid[k]))
+            return 1;
+    }
+
+    switch (fold_expr(state->ast, state->types, node))
+    {
+        case FOLD_DIV_ZERO:
+            sem_error(state, node, "division by zero in constant expression");
+            return 1;
+
+        case FOLD_BAD_SHIFT:
+            sem_error(state, node, "shift count out of range in constant expression");
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+//checks node and returns its folded integer value
+static int const_int(SemState *state, int node, long long *out)
+{
+    if (node == AST_NULL)
+        return 0;
+
+    check_expr(state, node);
+
+    if (node_at(state, node)->value.kind != CONST_INT)
+    {
+        report_fold_failure(state, node);
+        return 0;
+    }
+
+    *out = node_at(state, node)->value.i;
+    return 1;
+}
+
+static int strip_arrays(SemState *state, int type)
+{
+    while (type >= 0 && state->types->types[type].kind == TY_ARRAY)
+        type = state->types->types[type].base;
+
+    return type;
+}
+
+//rejects by-value use of a struct that was only ever named, never defined
+static void require_complete(SemState *state, int type, int node)
+{
+    int elem = strip_arrays(state, type);
+    const TypeTable *tt = state->types;
+
+    if (elem >= 0 && tt->types[elem].kind == TY_STRUCT &&
+        tt->structs[tt->types[elem].info].node < 0)
+    {
+        sem_error(state, node, "struct '%s' is used by value but never defined",
+                  tt->structs[tt->types[elem].info].name);
+    }
+}
+
+static int resolve_type(SemState *state, int node)
+{
+    TypeTable *tt = state->types;
+    AstNode *n = node_at(state, node);
+    int dims[16];
+    int dim_count = 0;
+    int type;
+
+    switch (n->op)
+    {
+        case TOK_STRUKTUR:
+        {
+            const char *name = ast_name(state->ast, node);
+            int s = struct_lookup(tt, name);
+
+            //STRUKTUR X PEK may name a struct that is defined later or not at all
+            if (s < 0)
+                s = struct_declare(tt, name);
+
+            type = tt->structs[s].type;
+            break;
+        }
+
+        case TOK_IDENTIFIER:
+        {
+            const char *name = ast_name(state->ast, node);
+            int sym = find_symbol(state, name);
+            int s;
+
+            if (sym >= 0 && state->symbols[sym].kind == SYM_TYPEDEF)
+            {
+                type = state->symbols[sym].type;
+                n->sym = sym;
+            }
+            else if ((s = struct_lookup(tt, name)) >= 0)
+            {
+                type = tt->structs[s].type;
+            }
+            else
+            {
+                sem_error(state, node, "unknown type '%s'", name);
+                type = tt->ty_error;
+            }
+            break;
+        }
+
+        default:
+            type = type_builtin(tt, n->op, (n->flags & AST_FLAG_UNSIGNED) != 0);
+
+            if (type == tt->ty_error)
+                sem_error(state, node, "invalid type specifier");
+            break;
+    }
+
+    for (int i = 0; i < n->aux; i++)
+        type = type_pointer(tt, type);
+
+    //collects <dim> suffixes; the first one written is the outermost
+    for (int d = n->list; d != AST_NULL; d = node_at(state, d)->next)
+    {
+        long long value;
+
+        if (dim_count >= 16)
+        {
+            sem_error(state, d, "too many array dimensions");
+            break;
+        }
+
+        if (!const_int(state, d, &value))
+        {
+            sem_error(state, d, "array dimension must be an integer constant");
+            value = -1;
+        }
+        else if (value <= 0)
+        {
+            sem_error(state, d, "array dimension must be positive");
+            value = -1;
+        }
+
+        dims[dim_count++] = (int)value;
+    }
+
+    for (int i = dim_count - 1; i >= 0; i--)
+        type = type_array(tt, type, dims[i]);
+
+    n->type = type;
+
+    return type;
+}
+
+
+
+/*
+  ______
+ |  ____|
+ | |__  __  ___ __  _ __ ___  ___ ___ _ ___  _ __  ___
+ |  __| \ \/ / '_ \| '__/ _ \/ __/ __| |/ _ \| '_ \/ __|
+ | |____ >  <| |_) | | |  __/\__ \__ \ | (_) | | | \__ \
+ |______/_/\_\ .__/|_|  \___||___/___/_|\___/|_| |_|___/
+             | |
+             |_|
+*/
+
+static int is_kind(SemState *state, int type, TypeKind kind)
+{
+    return type >= 0 && state->types->types[type].kind == kind;
+}
+
+//arrays used as values become pointers to their first element
+static int decay(SemState *state, int type)
+{
+    if (is_kind(state, type, TY_ARRAY))
+        return type_pointer(state->types, state->types->types[type].base);
+
+    return type;
+}
+
+static int compatible(SemState *state, int dst, int src)
+{
+    TypeTable *tt = state->types;
+
+    if (dst == src || dst == tt->ty_error || src == tt->ty_error)
+        return 1;
+
+    src = decay(state, src);
+
+    if (type_is_arithmetic(tt, dst) && type_is_arithmetic(tt, src))
+        return 1;
+
+    //pointers convert freely between each other and from integers, as C compilers accept with a warning
+    if (is_kind(state, dst, TY_POINTER) && (is_kind(state, src, TY_POINTER) || type_is_integer(tt, src)))
+        return 1;
+
+    if (type_is_integer(tt, dst) && is_kind(state, src, TY_POINTER))
+        return 1;
+
+    return 0;
+}
+
+static int is_lvalue(SemState *state, int node)
+{
+    AstNode *n;
+
+    if (node == AST_NULL)
+        return 0;
+
+    n = node_at(state, node);
+
+    switch (n->kind)
+    {
+        case AST_IDENT:
+            return n->sym >= 0 &&
+                   (state->symbols[n->sym].kind == SYM_VAR || state->symbols[n->sym].kind == SYM_PARAM);
+
+        case AST_INDEX:
+        case AST_FIELD:
+        case AST_DEREF:
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+static int check_binary(SemState *state, int node)
+{
+    TypeTable *tt = state->types;
+    AstNode *n = node_at(state, node);
+    int lhs = decay(state, check_expr(state, n->kid[0]));
+    int rhs = decay(state, check_expr(state, n->kid[1]));
+
+    if (lhs == tt->ty_error || rhs == tt->ty_error)
+        return tt->ty_error;
+
+    switch (n->op)
+    {
+        case TOK_EQ:
+        case TOK_NEQ:
+        case TOK_LT:
+        case TOK_GT:
+        case TOK_LTE:
+        case TOK_GTE:
+        case TOK_OCH:
+        case TOK_ELLER:
+            if (!type_is_scalar(tt, lhs) || !type_is_scalar(tt, rhs))
+            {
+                sem_error(state, node, "operands of %s must be scalars", tok2lexeme(n->op));
+                return tt->ty_error;
+            }
+            return tt->ty_int;
+
+        case TOK_PLUS:
+        case TOK_MINUS:
+            //pointer arithmetic: p + i, i + p, p - i, p - q
+            if (is_kind(state, lhs, TY_POINTER) && type_is_integer(tt, rhs))
+                return lhs;
+            if (n->op == TOK_PLUS && type_is_integer(tt, lhs) && is_kind(state, rhs, TY_POINTER))
+                return rhs;
+            if (n->op == TOK_MINUS && is_kind(state, lhs, TY_POINTER) && is_kind(state, rhs, TY_POINTER))
+                return type_builtin(tt, TOK_LANG, 0);
+            /* fallthrough */
+
+        case TOK_MUL:
+        case TOK_DIV:
+            if (!type_is_arithmetic(tt, lhs) || !type_is_arithmetic(tt, rhs))
+            {
+                sem_error(state, node, "invalid operands to %s", tok2lexeme(n->op));
+                return tt->ty_error;
+            }
+            return type_common(tt, lhs, rhs);
+
+        case TOK_MOD:
+        case TOK_BITAND:
+        case TOK_BITOR:
+        case TOK_BITXOR:
+            if (!type_is_integer(tt, lhs) || !type_is_integer(tt, rhs))
+            {
+                sem_error(state, node, "operands of %s must be integers", tok2lexeme(n->op));
+                return tt->ty_error;
+            }
+            return type_common(tt, lhs, rhs);
+
+        case TOK_VANSTER:
+        case TOK_HOGER:
+            if (!type_is_integer(tt, lhs) || !type_is_integer(tt, rhs))
+            {
+                sem_error(state, node, "operands of SKIFT must be integers");
+                return tt->ty_error;
+            }
+            return type_promote(tt, lhs);
+
+        default:
+            sem_error(state, node, "unknown binary operator");
+            return tt->ty_error;
+    }
+}
+
+static int check_field(SemState *state, int node)
+{
+    TypeTable *tt = state->types;
+    AstNode *n = node_at(state, node);
+    int base = check_expr(state, n->kid[0]);
+    int f;
+
+    if (base == tt->ty_error)
+        return tt->ty_error;
+
+    //FÄLT p X on a struct pointer reads through the pointer
+    if (is_kind(state, base, TY_POINTER))
+        base = tt->types[base].base;
+
+    if (!is_kind(state, base, TY_STRUCT))
+    {
+        sem_error(state, node, "FÄLT on a value that is not a struct");
+        return tt->ty_error;
+    }
+
+    f = struct_find_field(tt, tt->types[base].info, ast_name(state->ast, node));
+
+    if (f < 0)
+    {
+        sem_error(state, node, "struct '%s' has no field '%s'",
+                  tt->structs[tt->types[base].info].name,
+                  ast_name(state->ast, node));
+        return tt->ty_error;
+    }
+
+    //constant offset; later stages address the field as base + aux
+    n = node_at(state, node);
+    n->aux = tt->fields[f].offset;
+
+    return tt->fields[f].type;
+}
+
+static int check_call(SemState *state, int node)
+{
+    TypeTable *tt = state->types;
+    AstNode *n = node_at(state, node);
+    const char *name = ast_name(state->ast, node);
+    int sym = find_symbol(state, name);
+    int param = AST_NULL;
+    int expected;
+    int given;
+
+    if (sym < 0 || state->symbols[sym].kind != SYM_FUNC)
+    {
+        sem_error(state, node, "call to undeclared function '%s'", name);
+
+        for (int a = n->list; a != AST_NULL; a = node_at(state, a)->next)
+            check_expr(state, a);
+
+        return tt->ty_error;
+    }
+
+    n->sym = sym;
+    param = node_at(state, state->symbols[sym].node)->list;
+    expected = ast_list_length(state->ast, param);
+    given = ast_list_length(state->ast, n->list);
+
+    if (expected != given)
+        sem_error(state, node, "'%s' expects %d argument(s), got %d", name, expected, given);
+
+    for (int a = n->list; a != AST_NULL; a = node_at(state, a)->next)
+    {
+        int arg = check_expr(state, a);
+
+        if (param != AST_NULL)
+        {
+            int want = node_at(state, param)->type;
+
+            if (!compatible(state, want, arg))
+                sem_error(state, a, "incompatible argument to '%s'", name);
+
+            param = node_at(state, param)->next;
+        }
+    }
+
+    return state->symbols[sym].type;
+}
+
+static int check_expr(SemState *state, int node)
+{
+    TypeTable *tt = state->types;
+    AstNode *n;
+    int type = tt->ty_error;
+
+    if (node == AST_NULL)
+        return tt->ty_error;
+
+    n = node_at(state, node);
+
+    switch (n->kind)
+    {
+        case AST_INT_LIT:
+        {
+            long long v = strtoll(ast_name(state->ast, node), NULL, 10);
+            type = (v > INT_MAX) ? type_builtin(tt, TOK_LANG, 0) : tt->ty_int;
+            break;
+        }
+
+        case AST_FLOAT_LIT:
+            type = tt->ty_float;
+            break;
+
+        case AST_STRING_LIT:
+            type = type_pointer(tt, tt->ty_char);
+            break;
+
+        case AST_IDENT:
+        {
+            const char *name = ast_name(state->ast, node);
+            int sym = find_symbol(state, name);
+
+            if (sym < 0)
+            {
+                sem_error(state, node, "undeclared identifier '%s'", name);
+                break;
+            }
+
+            n->sym = sym;
+
+            switch (state->symbols[sym].kind)
+            {
+                case SYM_TYPEDEF:
+                    sem_error(state, node, "'%s' is a type, not a value", name);
+                    break;
+
+                case SYM_FUNC:
+                    type = type_pointer(tt, tt->ty_void);
+                    break;
+
+                case SYM_ENUM_CONST:
+                    type = state->symbols[sym].type;
+                    n->value.kind = CONST_INT;
+                    n->value.i    = state->symbols[sym].value;
+                    break;
+
+                default:
+                    type = state->symbols[sym].type;
+                    break;
+            }
+            break;
+        }
+
+        case AST_BINARY:
+            type = check_binary(state, node);
+            break;
+
+        case AST_UNARY:
+        {
+            int operand = decay(state, check_expr(state, n->kid[0]));
+
+            if (operand == tt->ty_error)
+                break;
+
+            n = node_at(state, node);
+
+            if (n->op == TOK_INTE)
+            {
+                if (!type_is_scalar(tt, operand))
+                    sem_error(state, node, "operand of INTE must be a scalar");
+                type = tt->ty_int;
+            }
+            else if (n->op == TOK_BITNOT)
+            {
+                if (!type_is_integer(tt, operand))
+                    sem_error(state, node, "operand of ~ must be an integer");
+                type = type_promote(tt, operand);
+            }
+            else
+            {
+                if (!type_is_arithmetic(tt, operand))
+                    sem_error(state, node, "operand of unary %s must be arithmetic", tok2lexeme(n->op));
+                type = type_promote(tt, operand);
+            }
+            break;
+        }
+
+        case AST_DEREF:
+        {
+            int operand = check_expr(state, n->kid[0]);
+
+            if (operand == tt->ty_error)
+                break;
+
+            if (is_kind(state, operand, TY_POINTER) || is_kind(state, operand, TY_ARRAY))
+                type = tt->types[operand].base;
+            else
+                sem_error(state, node, "VÄRDE VID on a value that is not a pointer");
+
+            if (type == tt->ty_void)
+            {
+                sem_error(state, node, "VÄRDE VID on a TOM PEK");
+                type = tt->ty_error;
+            }
+            break;
+        }
+
+        case AST_ADDRESS:
+        {
+            int operand = check_expr(state, n->kid[0]);
+
+            if (operand == tt->ty_error)
+                break;
+
+            if (!is_lvalue(state, n->kid[0]))
+                sem_error(state, node, "ADRESS AV needs an addressable value");
+
+            type = type_pointer(tt, operand);
+            break;
+        }
+
+        case AST_CAST:
+        {
+            int target  = resolve_type(state, n->kid[0]);
+            int operand = decay(state, check_expr(state, node_at(state, node)->kid[1]));
+
+            if (operand != tt->ty_error && target != tt->ty_void &&
+                (!type_is_scalar(tt, target) || !type_is_scalar(tt, operand)))
+            {
+                sem_error(state, node, "casts need scalar operand and target types");
+            }
+
+            type = target;
+            break;
+        }
+
+        case AST_CALL:
+            type = check_call(state, node);
+            break;
+
+        case AST_INDEX:
+        {
+            int base  = check_expr(state, n->kid[0]);
+            int index = check_expr(state, node_at(state, node)->kid[1]);
+
+            if (base == tt->ty_error)
+                break;
+
+            if (is_kind(state, base, TY_ARRAY) || is_kind(state, base, TY_POINTER))
+                type = tt->types[base].base;
+            else
+                sem_error(state, node, "indexing a value that is not an array or pointer");
+
+            if (index != tt->ty_error && !type_is_integer(tt, index))
+                sem_error(state, node, "array index must be an integer");
+
+            //constant indexes into arrays of known length are checked here
+            n = node_at(state, node);
+
+            if (is_kind(state, base, TY_ARRAY) && tt->types[base].count >= 0 &&
+                node_at(state, n->kid[1])->value.kind == CONST_INT)
+            {
+                long long i = node_at(state, n->kid[1])->value.i;
+
+                if (i < 0 || i >= tt->types[base].count)
+                    sem_error(state, node, "index %lld is out of bounds for an array of %d",
+                              i, tt->types[base].count);
+            }
+            break;
+        }
+
+        case AST_FIELD:
+            type = check_field(state, node);
+            break;
+
+        case AST_ARRAY_LIT:
+        {
+            int count = 0;
+            int elem  = tt->ty_void;
+
+            for (int e = n->list; e != AST_NULL; e = node_at(state, e)->next)
+            {
+                int t = check_expr(state, e);
+
+                if (count++ == 0)
+                    elem = t;
+            }
+
+            type = type_array(tt, elem, count);
+            break;
+        }
+
+        default:
+            sem_error(state, node, "unexpected %s in expression", ast_kind_name(n->kind));
+            break;
+    }
+
+    node_at(state, node)->type = type;
+
+    //a division by zero or a bad shift stays unfolded and does what it does at run time;
+    //it is only an error where a constant is required (report_fold_failure)
+    if (type != tt->ty_error)
+        fold_expr(state->ast, tt, node);
+
+    return type;
+}
+
+//checks an initializer against the declared type, descending into < ... > aggregates
+static void check_initializer(SemState *state, int init, int type)
+{
+    TypeTable *tt = state->types;
+    AstNode *n = node_at(state, init);
+
+    if (n->kind != AST_ARRAY_LIT)
+    {
+        int value = check_expr(state, init);
+
+        if (!compatible(state, type, value) || is_kind(state, type, TY_ARRAY))
+            sem_error(state, init, "initializer does not match the declared type");
+        return;
+    }
+
+    n->type = type;
+
+    if (is_kind(state, type, TY_ARRAY))
+    {
+        int count = 0;
+
+        for (int e = n->list; e != AST_NULL; e = node_at(state, e)->next)
+        {
+            check_initializer(state, e, tt->types[type].base);
+            count++;
+        }
+
+        if (tt->types[type].count >= 0 && count > tt->types[type].count)
+            sem_error(state, init, "too many initializers (%d for %d elements)", count, tt->types[type].count);
+    }
+    else if (is_kind(state, type, TY_STRUCT))
+    {
+        const StructInfo *info = &tt->structs[tt->types[type].info];
+        int i = 0;
+
+        for (int e = n->list; e != AST_NULL; e = node_at(state, e)->next, i++)
+        {
+            if (i >= info->field_count)
+            {
+                sem_error(state, e, "too many initializers for struct '%s'", info->name);
+                break;
+            }
+
+            check_initializer(state, e, tt->fields[info->first_field + i].type);
+        }
+    }
+    else if (type != tt->ty_error)
+    {
+        sem_error(state, init, "< ... > initializer for a scalar");
+    }
+}
+
+
+
+/*
+   _____ _        _                            _
+  / ____| |      | |                          | |
+ | (___ | |_ __ _| |_ ___ _ __ ___   ___ _ __ | |_ ___
+  \___ \| __/ _` | __/ _ \ '_ ` _ \ / _ \ '_ \| __/ __|
+  ____) | || (_| | ||  __/ | | | | |  __/ | | | |_\__ \
+ |_____/ \__\__,_|\__\___|_| |_| |_|\___|_| |_|\__|___/
+
+*/
+
+//globals are set up before ENTRE runs, so their initializers cannot depend on run-time values
+static void require_constant_initializer(SemState *state, int init)
+{
+    AstNode *n = node_at(state, init);
+
+    switch (n->kind)
+    {
+        case AST_ARRAY_LIT:
+            for (int e = n->list; e != AST_NULL; e = node_at(state, e)->next)
+                require_constant_initializer(state, e);
+            return;
+
+        case AST_STRING_LIT:
+            return;
+
+        case AST_ADDRESS:
+            if (node_at(state, n->kid[0])->kind == AST_IDENT)
+                return;
+            break;
+
+        default:
+            if (n->value.kind != CONST_NONE || n->type == state->types->ty_error)
+                return;
+
+            report_fold_failure(state, init);
+            break;
+    }
+
+    sem_error(state, init, "global initializer must be a constant expression");
+}
+
+static void check_var_decl(SemState *state, int node)
+{
+    TypeTable *tt = state->types;
+    int type = resolve_type(state, node_at(state, node)->kid[0]);
+
+    if (type == tt->ty_void)
+    {
+        sem_error(state, node, "variable '%s' declared TOM", ast_name(state->ast, node));
+        type = tt->ty_error;
+    }
+
+    require_complete(state, type, node);
+
+    node_at(state, node)->type = type;
+    declare_symbol(state, node, SYM_VAR, type);
+
+    if (node_at(state, node)->kid[1] != AST_NULL)
+    {
+        int init = node_at(state, node)->kid[1];
+
+        check_initializer(state, init, type);
+
+        //scalar initializers that fold are kept in the declared type
+        node_at(state, node)->value = const_convert(tt, node_at(state, init)->value, type);
+
+        //STATISK locals are initialised once, like globals
+        if (state->depth == 0 || (node_at(state, node)->flags & AST_FLAG_STATIC))
+        {
+            require_constant_initializer(state, init);
+
+            if (node_at(state, init)->value.kind == CONST_FLOAT && node_at(state, node)->value.kind == CONST_NONE &&
+                type_is_integer(tt, type))
+                sem_error(state, init, "initializer is out of range for '%s'", ast_name(state->ast, node));
+        }
+    }
+}
+
+static void check_assign(SemState *state, int node)
+{
+    TypeTable *tt = state->types;
+    AstNode *n = node_at(state, node);
+    int target = check_expr(state, n->kid[0]);
+    int value  = check_expr(state, node_at(state, node)->kid[1]);
+
+    n = node_at(state, node);
+
+    if (!is_lvalue(state, n->kid[0]))
+    {
+        sem_error(state, node, "left side of ':' is not assignable");
+        return;
+    }
+
+    if (is_kind(state, target, TY_ARRAY))
+    {
+        sem_error(state, node, "cannot assign to an array");
+        return;
+    }
+
+    if (is_kind(state, target, TY_STRUCT) || is_kind(state, value, TY_STRUCT))
+    {
+        if (target != value && target != tt->ty_error && value != tt->ty_error)
+            sem_error(state, node, "struct assignment between different types");
+        return;
+    }
+
+    if (!compatible(state, target, value))
+        sem_error(state, node, "incompatible types in assignment");
+}
+
+static void check_update(SemState *state, int node)
+{
+    TypeTable *tt = state->types;
+    AstNode *n = node_at(state, node);
+    int target = check_expr(state, n->kid[0]);
+    int amount = tt->ty_int;
+
+    if (node_at(state, node)->kid[1] != AST_NULL)
+        amount = decay(state, check_expr(state, node_at(state, node)->kid[1]));
+
+    n = node_at(state, node);
+
+    if (!is_lvalue(state, n->kid[0]))
+    {
+        sem_error(state, node, "operand of %s is not assignable", tok2lexeme(n->op));
+        return;
+    }
+
+    if (target == tt->ty_error || amount == tt->ty_error)
+        return;
+
+    switch (n->op)
+    {
+        case TOK_OKAR:
+        case TOK_MINSKAR:
+        case TOK_PLUS_ASSIGN:
+        case TOK_MINUS_ASSIGN:
+            if (is_kind(state, target, TY_POINTER) && type_is_integer(tt, amount))
+                return;
+            /* fallthrough */
+
+        case TOK_MUL_ASSIGN:
+        case TOK_DIV_ASSIGN:
+            if (!type_is_arithmetic(tt, target) || !type_is_arithmetic(tt, amount))
+                sem_error(state, node, "invalid operands to %s", tok2lexeme(n->op));
+            return;
+
+        default:
+            if (!type_is_integer(tt, target) || !type_is_integer(tt, amount))
+                sem_error(state, node, "operands of SKIFT ... MED must be integers");
+            return;
+    }
+}
+
+static void check_condition(SemState *state, int node)
+{
+    int type = decay(state, check_expr(state, node));
+
+    if (type != state->types->ty_error && !type_is_scalar(state->types, type))
+        sem_error(state, node, "condition must be a scalar");
+}
+
+//FALL labels must fold to distinct integers; the value, converted to the
+//promoted selector type, is kept on the CASE node for switch lowering
+static void check_case_label(SemState *state, int switch_node, int case_node, int selector)
+{
+    TypeTable *tt = state->types;
+    int label = node_at(state, case_node)->kid[0];
+    long long value;
+
+    if (!const_int(state, label, &value))
+    {
+        if (node_at(state, label)->type != tt->ty_error)
+            sem_error(state, label, "FALL label must be an integer constant");
+        return;
+    }
+
+    if (type_is_integer(tt, selector))
+        node_at(state, case_node)->value = const_convert(tt, node_at(state, label)->value, type_promote(tt, selector));
+    else
+        node_at(state, case_node)->value = node_at(state, label)->value;
+
+    for (int c = node_at(state, switch_node)->list; c != case_node; c = node_at(state, c)->next)
+    {
+        if (node_at(state, c)->value.kind == CONST_INT &&
+            node_at(state, c)->value.i == node_at(state, case_node)->value.i)
+        {
+            sem_error(state, label, "duplicate FALL label %lld", node_at(state, case_node)->value.i);
+            break;
+        }
+    }
+}
+
+//looks for ETIKETT name anywhere in a function body
+static int find_label(SemState *state, int node, const char *name)
+{
+    AstNode *n;
+
+    if (node == AST_NULL)
+        return AST_NULL;
+
+    n = node_at(state, node);
+
+    if (n->kind == AST_LABEL && strcmp(ast_name(state->ast, node), name) == 0)
+        return node;
+
+    for (int k = 0; k < 4; k++)
+    {
+        int found = find_label(state, n->kid[k], name);
+
+        if (found != AST_NULL)
+            return found;
+    }
+
+    for (int c = n->list; c != AST_NULL; c = node_at(state, c)->next)
+    {
+        int found = find_label(state, c, name);
+
+        if (found != AST_NULL)
+            return found;
+    }
+
+    return AST_NULL;
+}
+
+static void check_stmt(SemState *state, int node)
+{
+    TypeTable *tt = state->types;
+    AstNode *n;
+
+    if (node == AST_NULL)
+        return;
+
+    n = node_at(state, node);
+
+    switch (n->kind)
+    {
+        case AST_VAR_DECL:
+            check_var_decl(state, node);
+            break;
+
+        case AST_BLOCK:
+            push_scope(state);
+
+            for (int s = n->list; s != AST_NULL; s = node_at(state, s)->next)
+                check_stmt(state, s);
+
+            pop_scope(state);
+            break;
+
+        case AST_IF:
+            check_condition(state, n->kid[0]);
+            check_stmt(state, node_at(state, node)->kid[1]);
+            check_stmt(state, node_at(state, node)->kid[2]);
+            break;
+
+        case AST_WHILE:
+        case AST_DO_WHILE:
+            check_condition(state, n->kid[0]);
+
+            state->loop_depth++;
+            state->break_depth++;
+            check_stmt(state, node_at(state, node)->kid[1]);
+            state->loop_depth--;
+            state->break_depth--;
+            break;
+
+        case AST_FOR:
+            //the init declaration is only visible inside the loop
+            push_scope(state);
+
+            check_stmt(state, n->kid[0]);
+
+            if (node_at(state, node)->kid[1] != AST_NULL)
+                check_condition(state, node_at(state, node)->kid[1]);
+
+            check_stmt(state, node_at(state, node)->kid[2]);
+
+            state->loop_depth++;
+            state->break_depth++;
+            check_stmt(state, node_at(state, node)->kid[3]);
+            state->loop_depth--;
+            state->break_depth--;
+
+            pop_scope(state);
+            break;
+
+        case AST_SWITCH:
+        {
+            int selector = check_expr(state, n->kid[0]);
+
+            if (selector != tt->ty_error && !type_is_integer(tt, selector))
+                sem_error(state, node, "VÄXEL selector must be an integer");
+
+            push_scope(state);
+            state->break_depth++;
+
+            for (int c = node_at(state, node)->list; c != AST_NULL; c = node_at(state, c)->next)
+            {
+                if (node_at(state, c)->kid[0] != AST_NULL)
+                    check_case_label(state, node, c, selector);
+
+                for (int s = node_at(state, c)->list; s != AST_NULL; s = node_at(state, s)->next)
+                    check_stmt(state, s);
+            }
+
+            state->break_depth--;
+            pop_scope(state);
+            break;
+        }
+
+        case AST_BREAK:
+            if (state->break_depth == 0)
+                sem_error(state, node, "BRYT outside of a loop or VÄXEL");
+            break;
+
+        case AST_CONTINUE:
+            if (state->loop_depth == 0)
+                sem_error(state, node, "FORTSÄTT outside of a loop");
+            break;
+
+        case AST_GOTO:
+        {
+            int body = node_at(state, state->function)->kid[1];
+            int label = find_label(state, body, ast_name(state->ast, node));
+
+            if (label == AST_NULL)
+                sem_error(state, node, "GÅ TILL to unknown label '%s'", ast_name(state->ast, node));
+
+            node_at(state, node)->aux = label;
+            break;
+        }
+
+        case AST_LABEL:
+        {
+            int body = node_at(state, state->function)->kid[1];
+
+            if (find_label(state, body, ast_name(state->ast, node)) != node)
+                sem_error(state, node, "duplicate label '%s'", ast_name(state->ast, node));
+            break;
+        }
+
+        case AST_RETURN:
+        {
+            int want = node_at(state, state->function)->type;
+
+            if (n->kid[0] == AST_NULL)
+            {
+                if (want != tt->ty_void && want != tt->ty_error)
+                    sem_error(state, node, "ÅTERVÄND without a value in a function that returns a value");
+                break;
+            }
+
+            int got = check_expr(state, n->kid[0]);
+
+            if (want == tt->ty_void)
+                sem_error(state, node, "ÅTERVÄND with a value in a TOM function");
+            else if (!compatible(state, want, got))
+                sem_error(state, node, "returned value does not match the return type");
+            break;
+        }
+
+        case AST_EXPR_STMT:
+            check_expr(state, n->kid[0]);
+            break;
+
+        case AST_ASSIGN:
+            check_assign(state, node);
+            break;
+
+        case AST_UPDATE:
+            check_update(state, node);
+            break;
+
+        default:
+            sem_error(state, node, "unexpected %s in statement position", ast_kind_name(n->kind));
+            break;
+    }
+}
+
+
+
+/*
+   _____ _       _           _
+  / ____| |     | |         | |
+ | |  __| | ___ | |__   __ _| |___
+ | | |_ | |/ _ \| '_ \ / _` | / __|
+ | |__| | | (_) | |_) | (_| | \__ \
+  \_____|_|\___/|_.__/ \__,_|_|___/
+
+*/
+
+static void declare_struct(SemState *state, int node)
+{
+    TypeTable *tt = state->types;
+    const char *name = ast_name(state->ast, node);
+    int s = struct_declare(tt, name);
+
+    if (tt->structs[s].node >= 0)
+    {
+        sem_error(state, node, "redefinition of struct '%s'", name);
+        return;
+    }
+
+    tt->structs[s].node = node;
+    node_at(state, node)->type = tt->structs[s].type;
+    node_at(state, node)->aux  = s;
+
+    //TYPDEF STRUKTUR also makes the bare name usable as a type
+    if (node_at(state, node)->flags & AST_FLAG_TYPEDEF)
+        declare_symbol(state, node, SYM_TYPEDEF, tt->structs[s].type);
+}
+
+static void define_struct_fields(SemState *state, int node)
+{
+    TypeTable *tt = state->types;
+    int s = node_at(state, node)->aux;
+
+    //a redefinition never got its own struct index
+    if (tt->structs[s].node != node)
+        return;
+
+    for (int f = node_at(state, node)->list; f != AST_NULL; f = node_at(state, f)->next)
+    {
+        const char *name = ast_name(state->ast, f);
+        int type = resolve_type(state, node_at(state, f)->kid[0]);
+
+        if (struct_find_field(tt, s, name) >= 0)
+            sem_error(state, f, "duplicate field '%s' in struct '%s'", name, tt->structs[s].name);
+
+        if (type == tt->ty_void)
+            sem_error(state, f, "field '%s' declared TOM", name);
+
+        require_complete(state, type, f);
+
+        node_at(state, f)->type = type;
+        struct_add_field(tt, s, name, type, f);
+    }
+}
+
+static void declare_enum(SemState *state, int node)
+{
+    TypeTable *tt = state->types;
+    int type = type_enum(tt);
+    long long value = 0;
+
+    node_at(state, node)->type = type;
+    declare_symbol(state, node, SYM_TYPEDEF, type);
+
+    for (int e = node_at(state, node)->list; e != AST_NULL; e = node_at(state, e)->next)
+    {
+        int explicit_value = node_at(state, e)->kid[0];
+
+        if (explicit_value != AST_NULL && !const_int(state, explicit_value, &value))
+            sem_error(state, e, "enumerator value must be an integer constant");
+
+        int sym = declare_symbol(state, e, SYM_ENUM_CONST, type);
+
+        state->symbols[sym].value = (int)value;
+        node_at(state, e)->type = type;
+        node_at(state, e)->aux  = (int)value;
+        node_at(state, e)->value.kind = CONST_INT;
+        node_at(state, e)->value.i    = (int)value;
+
+        value++;
+    }
+}
+
+static void declare_function(SemState *state, int node)
+{
+    TypeTable *tt = state->types;
+    int ret = resolve_type(state, node_at(state, node)->kid[0]);
+
+    if (is_kind(state, ret, TY_ARRAY))
+    {
+        sem_error(state, node, "function '%s' cannot return an array", ast_name(state->ast, node));
+        ret = tt->ty_error;
+    }
+
+    //struct results would need a hidden return slot; a PEK does the same job
+    if (is_kind(state, ret, TY_STRUCT))
+    {
+        sem_error(state, node, "function '%s' cannot return a struct by value (return a PEK instead)", ast_name(state->ast, node));
+        ret = tt->ty_error;
+    }
+
+    node_at(state, node)->type = ret;
+
+    //parameter types are part of the signature so calls can be checked before the body
+    for (int p = node_at(state, node)->list; p != AST_NULL; p = node_at(state, p)->next)
+    {
+        int type = decay(state, resolve_type(state, node_at(state, p)->kid[0]));
+
+        if (type == tt->ty_void)
+            sem_error(state, p, "parameter '%s' declared TOM", ast_name(state->ast, p));
+
+        require_complete(state, type, p);
+        node_at(state, p)->type = type;
+    }
+
+    declare_symbol(state, node, SYM_FUNC, ret);
+}
+
+static void check_function(SemState *state, int node)
+{
+    int body = node_at(state, node)->kid[1];
+
+    state->function = node;
+
+    //parameters and the outermost block of the body share one scope, as in C
+    push_scope(state);
+
+    for (int p = node_at(state, node)->list; p != AST_NULL; p = node_at(state, p)->next)
+        declare_symbol(state, p, SYM_PARAM, node_at(state, p)->type);
+
+    if (body != AST_NULL)
+    {
+        for (int s = node_at(state, body)->list; s != AST_NULL; s = node_at(state, s)->next)
+            check_stmt(state, s);
+    }
+
+    pop_scope(state);
+
+    state->function = -1;
+}
+
+void sema(Ast *ast, TypeTable *types, FILE *out, SemState *out_state, int *out_error_count)
+{
+    SemState *state = out_state;
+    int program = ast->root;
+
+    memset(state, 0, sizeof(*state));
+
+    state->ast      = ast;
+    state->types    = types;
+    state->out      = out;
+    state->function = -1;
+
+    for (int i = 0; i < SEM_BUCKETS; i++)
+        state->buckets[i] = -1;
+
+    if (program == AST_NULL)
+    {
+        *out_error_count = 0;
+        return;
+    }
+
+    //pass 1: struct names
+    for (int g = node_at(state, program)->list; g != AST_NULL; g = node_at(state, g)->next)
+    {
+        if (node_at(state, g)->kind == AST_STRUCT_DECL)
+            declare_struct(state, g);
+    }
+
+    //pass 2: typedefs, enums, struct fields, function signatures
+    for (int g = node_at(state, program)->list; g != AST_NULL; g = node_at(state, g)->next)
+    {
+        switch (node_at(state, g)->kind)
+        {
+            case AST_STRUCT_DECL:
+                define_struct_fields(state, g);
+                break;
+
+            case AST_TYPEDEF:
+                node_at(state, g)->type = resolve_type(state, node_at(state, g)->kid[0]);
+                declare_symbol(state, g, SYM_TYPEDEF, node_at(state, g)->type);
+                break;
+
+            case AST_ENUM_DECL:
+                declare_enum(state, g);
+                break;
+
+            case AST_FUNCTION:
+                declare_function(state, g);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    //pass 3: struct layout
+    for (int s = 0; s < types->struct_count; s++)
+    {
+        if (types->structs[s].node < 0)
+            continue;
+
+        if (layout_struct(types, s) < 0)
+        {
+            sem_error(state, types->structs[s].node,
+                      "struct '%s' contains itself by value (use a PEK field instead)",
+                      types->structs[s].name);
+        }
+    }
+
+    //pass 4: globals and bodies
+    for (int g = node_at(state, program)->list; g != AST_NULL; g = node_at(state, g)->next)
+    {
+        switch (node_at(state, g)->kind)
+        {
+            case AST_VAR_DECL:
+                check_var_decl(state, g);
+                break;
+
+            case AST_FUNCTION:
+                check_function(state, g);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    *out_error_count = state->error_count;
+}
+
+void free_sema(SemState *state)
+{
+    free(state->symbols);
+    free(state->scope_stack);
+
+    state->symbols      = NULL;
+    state->scope_stack  = NULL;
+    state->symbol_count = 0;
+    state->scope_count  = 0;
+}
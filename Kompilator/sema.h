@@ -0,0 +1,59 @@
+#ifndef SEMA_H
+#define SEMA_H
+
+#include <stdio.h>
+
+#include "ast.h"
+#include "types.h"
+
+/* ---------------------------------------------
+   Symbols
+--------------------------------------------- */
+typedef enum SymKind {
+    SYM_VAR,
+    SYM_PARAM,
+    SYM_FUNC,
+    SYM_TYPEDEF,
+    SYM_ENUM_CONST
+} SymKind;
+
+typedef struct Symbol {
+    const char *name;
+    SymKind     kind;
+    int         type;       // value type, or return type for SYM_FUNC
+    int         node;       // declaring node
+    int         depth;      // scope depth, 0 = global
+    int         hash_next;  // older symbol in the same bucket, -1 at the end
+    int         value;      // SYM_ENUM_CONST value
+} Symbol;
+
+#define SEM_BUCKETS 256
+
+typedef struct SemState {
+    Ast        *ast;
+    TypeTable  *types;
+
+    Symbol     *symbols;        // every symbol ever declared; AstNode.sym indexes this
+    int         symbol_count;
+    int         symbol_capacity;
+
+    int         buckets[SEM_BUCKETS];  // newest visible symbol per hash, -1 if none
+
+    int        *scope_stack;    // visible symbols, innermost last
+    int         scope_count;
+    int         scope_capacity;
+    int         depth;
+
+    int         function;       // FUNCTION node being checked, -1 at global scope
+    int         loop_depth;     // enclosing loops, for FORTSÄTT
+    int         break_depth;    // enclosing loops and switches, for BRYT
+    int         error_count;
+    FILE       *out;            // diagnostics
+} SemState;
+
+
+// resolves names and types, lays out structs and annotates the tree in place
+void sema(Ast *ast, TypeTable *types, FILE *out, SemState *out_state, int *out_error_count);
+void free_sema(SemState *state);
+
+#endif /* SEMA_H */
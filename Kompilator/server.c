@@ -0,0 +1,545 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "helper.h"
+#include "driver.h"
+#include "server.h"
+
+//socket to remove when a signal stops the server
+static char serve_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+typedef struct ServeConnection {
+    int                   fd;
+    const CompileOptions *defaults;
+} ServeConnection;
+
+//one reply or request body read whole
+typedef struct ServeBlock {
+    char   *text;
+    size_t  size;
+} ServeBlock;
+
+static void *serve_alloc(size_t size, const char *what)
+{
+    void *p = malloc(size ? size : 1);
+
+    if (!p)
+    {
+        fprintf(stderr, "Fatal: failed to allocate %s\n", what);
+        exit(1);
+    }
+
+    return p;
+}
+
+static int read_block(FILE *in, size_t size, ServeBlock *block)
+{
+    block->text = serve_alloc(size + 1, "socket buffer");
+    block->size = size;
+
+    if (fread(block->text, 1, size, in) != size)
+    {
+        free(block->text);
+        block->text = NULL;
+        return 1;
+    }
+
+    block->text[size] = '\0';
+    return 0;
+}
+
+static FILE *open_block(ServeBlock *block)
+{
+    FILE *f;
+
+    block->text = NULL;
+    block->size = 0;
+
+    f = open_memstream(&block->text, &block->size);
+
+    if (!f)
+    {
+        fprintf(stderr, "Fatal: failed to allocate reply buffer\n");
+        exit(1);
+    }
+
+    return f;
+}
+
+static int connect_to(const char *path, int quiet)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        if (!quiet)
+            fprintf(stderr, "Error: socket path %s is too long\n", path);
+
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0)
+        return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        if (!quiet)
+            fprintf(stderr, "Error: Could not connect to %s: %s\n", path, strerror(errno));
+
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+
+/*
+   _____
+  / ____|
+ | (___   ___ _ ____   _____ _ __
+  \___ \ / _ \ '__\ \ / / _ \ '__|
+  ____) |  __/ |   \ V /  __/ |
+ |_____/ \___|_|    \_/ \___|_|
+*/
+
+static int send_reply(FILE *reply, int status, const ServeBlock *out, const ServeBlock *err, const ServeBlock *artifact)
+{
+    fprintf(reply, "KOM %d %zu %zu %zu\n", status, out->size, err->size, artifact->size);
+    fwrite(out->text, 1, out->size, reply);
+    fwrite(err->text, 1, err->size, reply);
+    fwrite(artifact->text, 1, artifact->size, reply);
+
+    return fflush(reply) != 0;
+}
+
+//handles one request; returns 1 when the connection should close
+static int serve_request(FILE *in, FILE *reply, const CompileOptions *defaults)
+{
+    char header[128];
+    size_t source_size;
+    int option_count;
+    int status = 0;
+    int closing = 0;
+
+    if (!fgets(header, sizeof(header), in))
+        return 1;
+
+    ServeBlock out, err, artifact, source = { NULL, 0 };
+    FILE *out_f = open_block(&out);
+    FILE *err_f = open_block(&err);
+    FILE *artifact_f = open_block(&artifact);
+    char *options[SERVE_MAX_OPTIONS];
+    int read_options = 0;
+    CompileOptions opts = *defaults;
+
+    if (sscanf(header, "KOM %zu %d", &source_size, &option_count) != 2 ||
+        source_size > SERVE_MAX_SOURCE || option_count < 0 || option_count > SERVE_MAX_OPTIONS)
+    {
+        fprintf(err_f, "Error: malformed request\n");
+        status = 2;
+        closing = 1;
+    }
+
+    //options stay allocated until the compile is done: opts points into them
+    for (; status == 0 && read_options < option_count; read_options++)
+    {
+        char line[SERVE_MAX_OPTION];
+
+        if (!fgets(line, sizeof(line), in) || !strchr(line, '\n'))
+        {
+            fprintf(err_f, "Error: malformed request\n");
+            status = 2;
+            closing = 1;
+            break;
+        }
+
+        line[strcspn(line, "\n")] = '\0';
+        options[read_options] = strdup(line);
+
+        if (!options[read_options])
+        {
+            fprintf(stderr, "Fatal: failed to allocate request options\n");
+            exit(1);
+        }
+    }
+
+    if (status == 0 && read_block(in, source_size, &source) != 0)
+    {
+        fprintf(err_f, "Error: malformed request\n");
+        status = 2;
+        closing = 1;
+    }
+
+    for (int i = 0; status == 0 && i < read_options; i++)
+    {
+        int known = parse_compile_option(options[i], &opts, err_f);
+
+        if (known == 0)
+            fprintf(err_f, "Error: Unknown option %s\n", options[i]);
+
+        if (known <= 0)
+            status = 2;
+    }
+
+    if (status == 0 && (opts.output || opts.trace_events || compile_options_print(&opts) ||
+                        (opts.emit_kind && strcmp(opts.emit_kind, "exe") == 0)))
+    {
+        fprintf(err_f, "Error: output paths, traces, dumps, reports and --emit=exe are not available from the server\n");
+        status = 2;
+    }
+
+    //a client's program runs in the server's own process: a crash would take it down, an endless loop would hold its thread
+    if (status == 0 && opts.run_program)
+    {
+        fprintf(err_f, "Error: --run and --repeat are not available from the server\n");
+        status = 2;
+    }
+
+    if (status == 0)
+    {
+        FileResult result;
+
+        memset(&result, 0, sizeof(result));
+        status = compile_source("request.k", source.text, &opts, out_f, err_f,
+                                opts.emit_kind ? artifact_f : NULL, &result);
+    }
+
+    fclose(out_f);
+    fclose(err_f);
+    fclose(artifact_f);
+
+    if (send_reply(reply, status, &out, &err, &artifact) != 0)
+        closing = 1;
+
+    for (int i = 0; i < read_options; i++)
+        free(options[i]);
+
+    free(source.text);
+    free(out.text);
+    free(err.text);
+    free(artifact.text);
+
+    return closing;
+}
+
+static void *serve_connection(void *arg)
+{
+    ServeConnection *c = arg;
+    int reply_fd = dup(c->fd);
+    FILE *in = fdopen(c->fd, "r");
+    FILE *reply = (reply_fd >= 0) ? fdopen(reply_fd, "w") : NULL;
+
+    if (in && reply)
+    {
+        while (serve_request(in, reply, c->defaults) == 0)
+            ;
+    }
+
+    if (in)
+        fclose(in);
+    else
+        close(c->fd);
+
+    if (reply)
+        fclose(reply);
+    else if (reply_fd >= 0)
+        close(reply_fd);
+
+    free(c);
+    return NULL;
+}
+
+static void stop_serving(int sig)
+{
+    (void)sig;
+
+    unlink(serve_path);
+    _exit(0);
+}
+
+int serve(const char *path, const CompileOptions *defaults)
+{
+    struct sockaddr_un addr;
+    struct sigaction stop;
+    struct stat st;
+    CompileOptions opts = *defaults;
+    int listener;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Error: socket path %s is too long\n", path);
+        return 1;
+    }
+
+    //a socket left behind by a server that is gone is replaced; anything else at path is left alone
+    if (lstat(path, &st) == 0)
+    {
+        int fd;
+
+        if (!S_ISSOCK(st.st_mode))
+        {
+            fprintf(stderr, "Error: %s exists and is not a socket\n", path);
+            return 1;
+        }
+
+        fd = connect_to(path, 1);
+
+        if (fd >= 0)
+        {
+            close(fd);
+            fprintf(stderr, "Error: a server is already listening on %s\n", path);
+            return 1;
+        }
+
+        unlink(path);
+    }
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if (listener < 0 || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 64) != 0)
+    {
+        fprintf(stderr, "Error: Could not listen on %s: %s\n", path, strerror(errno));
+
+        if (listener >= 0)
+            close(listener);
+
+        return 1;
+    }
+
+    strcpy(serve_path, path);
+
+    memset(&stop, 0, sizeof(stop));
+    stop.sa_handler = stop_serving;
+    sigaction(SIGINT, &stop, NULL);
+    sigaction(SIGTERM, &stop, NULL);
+
+    //a client that hangs up early must not take the server with it
+    signal(SIGPIPE, SIG_IGN);
+
+    opts.listing     = 0;
+    opts.run_program = 0;
+    opts.repeat      = 1;
+
+    printf("Serving on %s\n", path);
+    fflush(stdout);
+
+    for (;;)
+    {
+        pthread_t thread;
+        ServeConnection *c;
+        int fd = accept(listener, NULL, NULL);
+
+        if (fd < 0)
+        {
+            if (errno != EINTR)
+                fprintf(stderr, "Error: accept failed: %s\n", strerror(errno));
+
+            continue;
+        }
+
+        c = serve_alloc(sizeof(*c), "connection");
+        c->fd       = fd;
+        c->defaults = &opts;
+
+        if (pthread_create(&thread, NULL, serve_connection, c) != 0)
+        {
+            fprintf(stderr, "Error: Could not start a thread for a client\n");
+            close(fd);
+            free(c);
+            continue;
+        }
+
+        pthread_detach(thread);
+    }
+}
+
+
+
+/*
+   _____ _ _            _
+  / ____| (_)          | |
+ | |    | |_  ___ _ __ | |_
+ | |    | | |/ _ \ '_ \| __|
+ | |____| | |  __/ | | | |_
+  \_____|_|_|\___|_| |_|\__|
+*/
+
+static int compare_ns(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+//nearest-rank percentile of sorted samples
+static double percentile(const double *sorted, long count, int p)
+{
+    long rank = (count * p + 99) / 100;
+
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+//the artifact of an --emit request goes where a local compile would have put it
+static int save_artifact(const char *filename, const char **options, int option_count, const char *output,
+                         const ServeBlock *artifact)
+{
+    const char *kind = NULL;
+
+    for (int i = 0; i < option_count; i++)
+    {
+        if (strncmp(options[i], "--emit=", 7) == 0)
+            kind = options[i] + 7;
+    }
+
+    if (!kind)
+        return 0;
+
+    return write_artifact(filename, kind, output, artifact->text, artifact->size, stdout, stderr);
+}
+
+int serve_client(const char *path, const char *filename, const char **options, int option_count,
+                 const char *output, long requests)
+{
+    size_t len = strlen(filename);
+    FILE *file;
+    char *source;
+    int fd, status = 2;
+    FILE *in = NULL, *request = NULL;
+    ServeBlock out = { NULL, 0 }, err = { NULL, 0 }, artifact = { NULL, 0 };
+    double *latency;
+    long sent = 0;
+
+    if (len < 2 || filename[len - 2] != '.' || filename[len - 1] != 'k')
+    {
+        fprintf(stderr, "Error: %s: File must end with .k extension\n", filename);
+        return 1;
+    }
+
+    //one latency sample per request is kept for the report
+    if ((unsigned long)requests > SIZE_MAX / sizeof(double))
+    {
+        fprintf(stderr, "Error: --requests=%ld is more than can be timed\n", requests);
+        return 1;
+    }
+
+    file = fopen(filename, "r");
+
+    if (!file)
+    {
+        fprintf(stderr, "Error: Could not open %s\n", filename);
+        return 1;
+    }
+
+    source = reader(file);
+    fclose(file);
+
+    if (!source)
+    {
+        fprintf(stderr, "Error: Failed to read %s\n", filename);
+        return 1;
+    }
+
+    fd = connect_to(path, 0);
+
+    if (fd < 0)
+    {
+        free(source);
+        return 1;
+    }
+
+    in = fdopen(fd, "r");
+    request = fdopen(dup(fd), "w");
+    latency = serve_alloc(requests * sizeof(double), "latency samples");
+
+    for (; in && request && sent < requests; sent++)
+    {
+        struct timespec start, end;
+        char header[128];
+        size_t out_size, err_size, artifact_size;
+
+        free(out.text);
+        free(err.text);
+        free(artifact.text);
+        out.text = err.text = artifact.text = NULL;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        fprintf(request, "KOM %zu %d\n", strlen(source), option_count);
+
+        for (int i = 0; i < option_count; i++)
+            fprintf(request, "%s\n", options[i]);
+
+        fputs(source, request);
+        fflush(request);
+
+        if (!fgets(header, sizeof(header), in) ||
+            sscanf(header, "KOM %d %zu %zu %zu", &status, &out_size, &err_size, &artifact_size) != 4 ||
+            read_block(in, out_size, &out) != 0 || read_block(in, err_size, &err) != 0 ||
+            read_block(in, artifact_size, &artifact) != 0)
+        {
+            fprintf(stderr, "Error: the server at %s closed the connection\n", path);
+            status = 2;
+            break;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        latency[sent] = elapsed_ns(&start, &end);
+    }
+
+    if (sent == requests)
+    {
+        fwrite(out.text, 1, out.size, stdout);
+        fwrite(err.text, 1, err.size, stderr);
+
+        if (status == 0)
+            status = save_artifact(filename, options, option_count, output, &artifact);
+    }
+
+    if (sent == requests && requests > 1)
+    {
+        qsort(latency, requests, sizeof(double), compare_ns);
+
+        printf("Requests: %ld, p50 %.0f us, p99 %.0f us, max %.0f us\n", requests,
+               percentile(latency, requests, 50) / 1000, percentile(latency, requests, 99) / 1000,
+               latency[requests - 1] / 1000);
+    }
+
+    if (in)
+        fclose(in);
+    else
+        close(fd);
+
+    if (request)
+        fclose(request);
+
+    free(latency);
+    free(source);
+    free(out.text);
+    free(err.text);
+    free(artifact.text);
+
+    return status != 0;
+}
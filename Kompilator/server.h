@@ -0,0 +1,65 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "driver.h"
+
+/* ---------------------------------------------
+   Compile server
+
+   kom --serve[=path] listens on a Unix domain
+   socket and compiles sources sent to it, one
+   thread per connected client, each connection
+   carrying any number of requests in turn. The
+   process stays up between requests, so a
+   compile costs no process start, no dynamic
+   loading and no cold page faults: the code,
+   malloc's per-thread arenas and the static
+   tables are already warm.
+
+   A request is a text header, the options and
+   the source:
+
+     KOM <source bytes> <option count>\n
+     <option>\n                  once per option
+     <source>
+
+   Options are spelled as on the command line
+   (--emit=asm, --no-opt, ...). Output paths,
+   trace events, dumps, reports and --emit=exe
+   are refused, since nothing is written on the
+   server's side: --emit output comes back as
+   the artifact. --run and --repeat are refused
+   too, since the program would run inside the
+   server, where a crash or an endless loop
+   takes down the daemon or a thread. The reply
+   is
+
+     KOM <status> <out bytes> <err bytes> <artifact bytes>\n
+     <out><err><artifact>
+
+   with status 0 if the compile succeeded, 1 if
+   it failed and 2 for a malformed request; out
+   and err are what a command-line compile would
+   have printed to stdout and stderr.
+
+   kom --client[=path] file.k [options] sends
+   one file and prints the reply as if it had
+   compiled locally; --requests=N sends it N
+   times over one connection and reports p50 /
+   p99 latency.
+--------------------------------------------- */
+
+#define SERVE_SOCKET        "/tmp/kom.sock"
+#define SERVE_MAX_SOURCE    (64 << 20)      // bytes of source in one request
+#define SERVE_MAX_OPTIONS   64
+#define SERVE_MAX_OPTION    4096            // bytes in one option line
+
+// runs until SIGINT / SIGTERM; returns 1 if the socket could not be set up
+int serve(const char *path, const CompileOptions *defaults);
+
+/* sends filename with the given options to the server at path and prints the reply;
+   artifacts go to output, or next to filename. Returns 1 if the compile failed */
+int serve_client(const char *path, const char *filename, const char **options, int option_count,
+                 const char *output, long requests);
+
+#endif /* SERVER_H */
@@ -0,0 +1,372 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tail.h"
+
+static void *tail_alloc(size_t count, size_t size, const char *what)
+{
+    void *ptr = calloc(count + 1, size);
+
+    if (!ptr)
+    {
+        fprintf(stderr, "Fatal: failed to allocate %s\n", what);
+        exit(1);
+    }
+
+    return ptr;
+}
+
+static int skip_nops(const IrFunc *f, int i)
+{
+    while (i != IR_NONE && f->instrs[i].op == IR_NOP)
+        i = f->instrs[i].next;
+
+    return i;
+}
+
+//operand of phi that flows in from pred, IR_NONE if pred is not a predecessor
+static int phi_input(const IrFunc *f, int phi, int pred)
+{
+    const IrBlock *blk = &f->blocks[f->instrs[phi].block];
+
+    for (int p = 0; p < blk->pred_count && p < f->instrs[phi].nargs; p++)
+    {
+        if (blk->preds[p] == pred)
+            return f->operands[f->instrs[phi].args + p];
+    }
+
+    return IR_NONE;
+}
+
+
+
+/*
+                      _           _
+     /\               | |         (_)
+    /  \   _ __   __ _| |_   _ ___ _ ___
+   / /\ \ | '_ \ / _` | | | | / __| / __|
+  / ____ \| | | | (_| | | |_| \__ \ \__ \
+ /_/    \_\_| |_|\__,_|_|\__, |___/_|___/
+                          __/ |
+                         |___/
+*/
+
+int tail_position(const IrFunc *f, int call)
+{
+    int from = f->instrs[call].block;
+    int carried = call;     // value holding the result in the current block
+    int i = skip_nops(f, f->instrs[call].next);
+    int jumps = 0;
+
+    while (i != IR_NONE)
+    {
+        const IrInstr *in = &f->instrs[i];
+
+        switch (in->op)
+        {
+            //a block the call dominates may still return it by name
+            case IR_RET:
+                return in->a == IR_NONE || in->a == call || in->a == carried;
+
+            //constants left in a return block by lowering compute nothing
+            case IR_CONST:
+            case IR_UNDEF:
+                i = skip_nops(f, in->next);
+                break;
+
+            case IR_JMP:
+            {
+                int to = in->target[0];
+                int next = carried;
+
+                if (++jumps > TAIL_JUMP_LIMIT)
+                    return 0;
+
+                carried = IR_NONE;
+                i = skip_nops(f, f->blocks[to].first);
+
+                //a phi fed the result from this edge carries it on; the others do not matter
+                for (; i != IR_NONE && f->instrs[i].op == IR_PHI; i = skip_nops(f, f->instrs[i].next))
+                {
+                    if (next != IR_NONE && phi_input(f, i, from) == next)
+                        carried = i;
+                }
+
+                from = to;
+                break;
+            }
+
+            default:
+                return 0;
+        }
+    }
+
+    return 0;
+}
+
+int tail_frame_escapes(const IrFunc *f)
+{
+    char *derived;
+    int changed = 1;
+    int escapes = 0;
+
+    if (f->slot_count == 0)
+        return 0;
+
+    //values that hold a slot address, or an address computed from one
+    derived = tail_alloc((size_t)f->instr_count, 1, "escape marks");
+
+    while (changed)
+    {
+        changed = 0;
+
+        for (int b = 0; b < f->block_count; b++)
+        {
+            for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+            {
+                const IrInstr *in = &f->instrs[i];
+                int mark = 0;
+
+                if (derived[i])
+                    continue;
+
+                switch (in->op)
+                {
+                    case IR_SLOT:
+                        mark = 1;
+                        break;
+
+                    case IR_OFFSET:
+                    case IR_INDEX:
+                    case IR_COPY:
+                        mark = derived[in->a];
+                        break;
+
+                    case IR_PHI:
+                        for (int k = 0; k < in->nargs && !mark; k++)
+                        {
+                            int v = f->operands[in->args + k];
+
+                            mark = (v != IR_NONE) && derived[v];
+                        }
+                        break;
+
+                    default:
+                        break;
+                }
+
+                if (mark)
+                {
+                    derived[i] = 1;
+                    changed = 1;
+                }
+            }
+        }
+    }
+
+    //anything but addressing through the value lets it out
+    for (int b = 0; b < f->block_count && !escapes; b++)
+    {
+        for (int i = f->blocks[b].first; i != IR_NONE && !escapes; i = f->instrs[i].next)
+        {
+            const IrInstr *in = &f->instrs[i];
+
+            switch (in->op)
+            {
+                case IR_OFFSET:
+                case IR_COPY:
+                case IR_PHI:
+                case IR_LOAD:
+                case IR_MEMZERO:
+                case IR_MEMCPY:
+                    break;
+
+                case IR_INDEX:
+                case IR_STORE:
+                    escapes = (in->b != IR_NONE) && derived[in->b];
+                    break;
+
+                default:
+                    escapes = (in->a != IR_NONE && derived[in->a]) || (in->b != IR_NONE && derived[in->b]);
+
+                    for (int k = 0; k < in->nargs && !escapes; k++)
+                    {
+                        int v = f->operands[in->args + k];
+
+                        escapes = (v != IR_NONE) && derived[v];
+                    }
+                    break;
+            }
+        }
+    }
+
+    free(derived);
+    return escapes;
+}
+
+
+
+/*
+  _
+ | |
+ | |     ___   ___  _ __  ___
+ | |    / _ \ / _ \| '_ \/ __|
+ | |___| (_) | (_) | |_) \__ \
+ |______\___/ \___/| .__/|___/
+                   | |
+                   |_|
+*/
+
+static int eliminate_in_func(IrFunc *f, int fi)
+{
+    int *sites = tail_alloc((size_t)f->block_count, sizeof(int), "tail call sites");
+    int site_count = 0;
+    int head, jump;
+
+    //at most one call per block can be followed by its terminator
+    for (int b = 0; b < f->block_count; b++)
+    {
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+        {
+            const IrInstr *in = &f->instrs[i];
+
+            if (in->op == IR_CALL && in->aux == fi && in->nargs == f->param_count && tail_position(f, i))
+            {
+                sites[site_count++] = i;
+                break;
+            }
+        }
+    }
+
+    if (site_count == 0 || tail_frame_escapes(f))
+    {
+        free(sites);
+        return 0;
+    }
+
+    //the entry keeps the parameters, everything else moves to the loop header
+    {
+        int count = 0;
+        int *order = tail_alloc((size_t)f->instr_count, sizeof(int), "entry block");
+        int *params = tail_alloc((size_t)f->param_count, sizeof(int), "parameters");
+
+        for (int k = 0; k < f->param_count; k++)
+            params[k] = IR_NONE;
+
+        for (int i = f->blocks[0].first; i != IR_NONE; i = f->instrs[i].next)
+            order[count++] = i;
+
+        head = ir_new_block(f);
+        f->blocks[0].first = IR_NONE;
+        f->blocks[0].last  = IR_NONE;
+
+        for (int k = 0; k < count; k++)
+        {
+            if (f->instrs[order[k]].op == IR_PARAM)
+            {
+                params[f->instrs[order[k]].aux] = order[k];
+                ir_append(f, 0, order[k]);
+            }
+            else
+                ir_append(f, head, order[k]);
+        }
+
+        //the former entry's successors now come from the header
+        {
+            const int *succ;
+            int n = ir_successors(f, head, &succ);
+
+            for (int s = 0; s < n; s++)
+            {
+                IrBlock *blk = &f->blocks[succ[s]];
+
+                for (int p = 0; p < blk->pred_count; p++)
+                {
+                    if (blk->preds[p] == 0)
+                        blk->preds[p] = head;
+                }
+            }
+        }
+
+        for (int k = f->param_count - 1; k >= 0; k--)
+        {
+            int values[site_count + 1];
+            int phi;
+
+            if (params[k] == IR_NONE)
+            {
+                params[k] = ir_new_instr(f, IR_PARAM, f->param_types[k], IR_NONE, IR_NONE);
+                f->instrs[params[k]].aux = k;
+                ir_prepend(f, 0, params[k]);
+            }
+
+            phi = ir_new_instr(f, IR_PHI, f->param_types[k], IR_NONE, IR_NONE);
+            ir_replace_uses(f, params[k], phi);
+
+            //arguments read after the replacement, so they name this iteration's values
+            values[0] = params[k];
+
+            for (int s = 0; s < site_count; s++)
+                values[s + 1] = f->operands[f->instrs[sites[s]].args + k];
+
+            f->instrs[phi].args  = ir_add_operands(f, values, site_count + 1);
+            f->instrs[phi].nargs = site_count + 1;
+            ir_prepend(f, head, phi);
+        }
+
+        free(order);
+        free(params);
+    }
+
+    jump = ir_new_instr(f, IR_JMP, IRT_VOID, IR_NONE, IR_NONE);
+    f->instrs[jump].target[0] = head;
+    ir_append(f, 0, jump);
+    ir_add_pred(f, head, 0);
+
+    //each call becomes a jump back to the header, whatever followed it goes
+    for (int s = 0; s < site_count; s++)
+    {
+        int block = f->instrs[sites[s]].block;
+        int term = ir_terminator(f, block);
+        IrInstr *in = &f->instrs[term];
+
+        in->op        = IR_JMP;
+        in->type      = IRT_VOID;
+        in->a         = IR_NONE;
+        in->target[0] = head;
+
+        ir_remove(f, sites[s]);
+        ir_add_pred(f, head, block);
+    }
+
+    //edges from the call blocks to their old successors are gone, phis there lose an input
+    ir_compute_preds(f);
+
+    free(sites);
+    return site_count;
+}
+
+int eliminate_tail_calls(IrModule *m, int *removed)
+{
+    int total = 0;
+
+    for (int fi = 0; fi < m->func_count; fi++)
+    {
+        IrFunc *f = &m->funcs[fi];
+        int count = 0;
+
+        if (!f->is_extern && f->block_count > 0)
+            count = eliminate_in_func(f, fi);
+
+        if (count > 0)
+            ir_compact(f);
+
+        if (removed)
+            removed[fi] = count;
+
+        total += count;
+    }
+
+    return total;
+}
@@ -0,0 +1,42 @@
+#ifndef TAIL_H
+#define TAIL_H
+
+#include "ir.h"
+
+/* ---------------------------------------------
+   Tail calls
+
+   A call is in tail position when its result is
+   returned as it is, either by the RET right
+   after it or by one reached through jumps and
+   phis that only pass the result along. In a TOM
+   function any call followed by the return is.
+
+   eliminate_tail_calls() turns self-recursive
+   tail calls into loops: the entry block keeps
+   the parameters and jumps to a new header whose
+   phis take the parameters on the first
+   iteration and the call's arguments on every
+   later one. QUICKSORT's second call becomes a
+   jump back to the top, and a function whose
+   only recursion is in tail position is no
+   longer recursive, so the inliner may take it.
+
+   A frame slot whose address escapes (is stored,
+   passed or returned) may still be in use by the
+   callee, so such functions keep their calls;
+   the bytecode's TAILCALL (vm.h) asks the same
+   question before reusing a frame.
+--------------------------------------------- */
+
+#define TAIL_JUMP_LIMIT       8         // jumps followed from a call to its return
+
+int tail_position(const IrFunc *f, int call);
+
+// whether the address of a frame slot can reach anything but loads and stores through it
+int tail_frame_escapes(const IrFunc *f);
+
+// returns the number of calls turned into jumps; removed (may be NULL) gets the count per function
+int eliminate_tail_calls(IrModule *m, int *removed);
+
+#endif /* TAIL_H */
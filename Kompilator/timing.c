@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <malloc.h>
+#include <sys/resource.h>
+
+#include "timing.h"
+
+//name and item unit of each phase, in TimePhase order
+static const char *phase_names[PHASE_COUNT][2] = {
+    { "read",         "bytes"        },
+    { "decode_utf8",  "characters"   },
+    { "lex_scan",     "lexemes"      },
+    { "lex_resolve",  "tokens"       },
+    { "parse",        "nodes"        },
+    { "sema",         "nodes"        },
+    { "emit_c",       "nodes"        },
+    { "lower",        "instructions" },
+    { "verify",       "instructions" },
+    { "optimise",     "instructions" },
+    { "emit_x86",     "instructions" },
+    { "bytecode",     "instructions" },
+    { "link",         "symbols"      },
+    { "run",          "runs"         },
+};
+
+static double diff_ns(const struct timespec *start, const struct timespec *end)
+{
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+void time_report_init(TimeReport *report)
+{
+    memset(report, 0, sizeof(*report));
+}
+
+void phase_begin(TimeReport *report)
+{
+    if (!report)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &report->wall_start);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &report->cpu_start);
+}
+
+void phase_end(TimeReport *report, TimePhase phase, long items)
+{
+    struct timespec wall, cpu;
+    struct mallinfo2 heap;
+    struct rusage usage;
+    PhaseTime *p;
+
+    if (!report)
+        return;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+
+    p = &report->phases[phase];
+
+    p->wall_ns += diff_ns(&report->wall_start, &wall);
+    p->cpu_ns  += diff_ns(&report->cpu_start, &cpu);
+    p->items   += items;
+    p->runs++;
+
+    if (report->trace)
+        trace_span(report->trace, phase_names[phase][0], "phase", &report->wall_start, &wall);
+
+    //read after the clocks stop: walking malloc's arenas is not part of the phase
+    heap = mallinfo2();
+    p->heap_kb = (long)((heap.uordblks + heap.hblkhd) >> 10);
+
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        p->peak_kb = usage.ru_maxrss;
+}
+
+static void print_json_string(const char *s, FILE *out)
+{
+    fputc('"', out);
+
+    for (; *s; s++)
+    {
+        unsigned char c = (unsigned char)*s;
+
+        if (c == '"' || c == '\\')
+            fprintf(out, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(out, "\\u%04x", c);
+        else
+            fputc(c, out);
+    }
+
+    fputc('"', out);
+}
+
+void print_time_report(const TimeReport *report, const char *name, int format, FILE *out)
+{
+    double wall_ns = 0, cpu_ns = 0;
+    long peak_kb = 0;
+    int first = 1;
+
+    for (int i = 0; i < PHASE_COUNT; i++)
+    {
+        wall_ns += report->phases[i].wall_ns;
+        cpu_ns  += report->phases[i].cpu_ns;
+
+        if (report->phases[i].peak_kb > peak_kb)
+            peak_kb = report->phases[i].peak_kb;
+    }
+
+    if (format == TIME_REPORT_JSON)
+    {
+        fprintf(out, "{\"file\":");
+        print_json_string(name, out);
+        fprintf(out, ",\"phases\":[");
+
+        for (int i = 0; i < PHASE_COUNT; i++)
+        {
+            const PhaseTime *p = &report->phases[i];
+
+            if (p->runs == 0)
+                continue;
+
+            fprintf(out, "%s{\"phase\":\"%s\",\"wall_ms\":%.6f,\"cpu_ms\":%.6f,\"heap_kb\":%ld,\"peak_rss_kb\":%ld,"
+                         "\"items\":%ld,\"unit\":\"%s\"}",
+                    first ? "" : ",", phase_names[i][0], p->wall_ns / 1e6, p->cpu_ns / 1e6, p->heap_kb, p->peak_kb,
+                    p->items, phase_names[i][1]);
+            first = 0;
+        }
+
+        fprintf(out, "],\"total\":{\"wall_ms\":%.6f,\"cpu_ms\":%.6f,\"peak_rss_kb\":%ld}}\n",
+                wall_ns / 1e6, cpu_ns / 1e6, peak_kb);
+        return;
+    }
+
+    fprintf(out, "\nTime report for %s\n", name);
+    fprintf(out, "  %-12s %10s %10s %10s %10s %12s\n", "phase", "wall ms", "cpu ms", "heap KB", "peak KB", "items");
+
+    for (int i = 0; i < PHASE_COUNT; i++)
+    {
+        const PhaseTime *p = &report->phases[i];
+
+        if (p->runs == 0)
+            continue;
+
+        fprintf(out, "  %-12s %10.3f %10.3f %10ld %10ld %12ld %s\n", phase_names[i][0], p->wall_ns / 1e6,
+                p->cpu_ns / 1e6, p->heap_kb, p->peak_kb, p->items, phase_names[i][1]);
+    }
+
+    fprintf(out, "  %-12s %10.3f %10.3f %10s %10ld\n", "total", wall_ns / 1e6, cpu_ns / 1e6, "", peak_kb);
+}
@@ -0,0 +1,80 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdio.h>
+#include <time.h>
+
+#include "trace.h"
+
+/* ---------------------------------------------
+   Phase timing (--time-report)
+
+   Records, for each phase of one compile, the
+   wall time (CLOCK_MONOTONIC), the CPU time of
+   the compiling thread (CLOCK_THREAD_CPUTIME_ID),
+   the heap in use when the phase ended, the
+   process's peak resident set so far and how
+   many items the phase produced (characters,
+   lexemes, tokens, nodes, instructions).
+
+   Heap and peak are process-wide, so with
+   several jobs they include the other files
+   being compiled at the same time; the times
+   are the file's own.
+
+   With a trace log attached, each phase is also
+   recorded as a trace event (trace.h).
+
+   A compile without --time-report or
+   --trace-events passes a NULL report and every
+   call returns at once, so the instrumentation
+   costs one test per phase.
+--------------------------------------------- */
+
+#define TIME_REPORT_TEXT 1
+#define TIME_REPORT_JSON 2      // one JSON object per compile, on one line
+
+typedef enum TimePhase {
+    PHASE_READ,
+    PHASE_DECODE,
+    PHASE_LEX_SCAN,
+    PHASE_LEX_RESOLVE,
+    PHASE_PARSE,
+    PHASE_SEMA,
+    PHASE_EMIT_C,
+    PHASE_LOWER,
+    PHASE_VERIFY,
+    PHASE_OPTIMISE,
+    PHASE_EMIT_X86,
+    PHASE_BYTECODE,
+    PHASE_LINK,
+    PHASE_RUN,
+    PHASE_COUNT
+} TimePhase;
+
+typedef struct PhaseTime {
+    double  wall_ns;
+    double  cpu_ns;
+    long    heap_kb;        // heap in use at the end of the phase
+    long    peak_kb;        // peak resident set of the process at the end of the phase
+    long    items;
+    int     runs;           // 0: the phase did not run
+} PhaseTime;
+
+typedef struct TimeReport {
+    PhaseTime        phases[PHASE_COUNT];
+    struct timespec  wall_start;
+    struct timespec  cpu_start;
+    TraceLog        *trace;         // NULL: no trace events
+} TimeReport;
+
+void time_report_init(TimeReport *report);
+
+// starts timing a phase; phases do not nest
+void phase_begin(TimeReport *report);
+void phase_end(TimeReport *report, TimePhase phase, long items);
+
+// format is TIME_REPORT_TEXT or TIME_REPORT_JSON
+void print_time_report(const TimeReport *report, const char *name, int format, FILE *out);
+
+#endif /* TIMING_H */
@@ -1,5 +1,6 @@
 #include <stddef.h>
 #include "tokenkeytab.h"
+#include <stdio.h>
 #include <string.h>
 
 #include <string.h>
@@ -143,10 +144,9 @@ TokenType lookup_pair(char *lexeme, char *lextwo)
 {
     char composite[64];
 
-    // build "LEXEME LEXTWO"
-    strcpy(composite, lexeme);
-    strcat(composite, " ");
-    strcat(composite, lextwo);
+    // build "LEXEME LEXTWO"; a pair too long for the buffer is no keyword
+    if (snprintf(composite, sizeof(composite), "%s %s", lexeme, lextwo) >= (int)sizeof(composite))
+        return TOK_ERROR;
 
     for (int i = 0; keywords[i].lexeme != NULL; i++)
     {
@@ -168,7 +168,7 @@ TokenType lookup(char *lexeme)
         return TOK_STRING_LIT;
 
     if (is_number_literal(lexeme))
-        return TOK_INT_LIT;
+        return (strchr(lexeme, '.') != NULL) ? TOK_FLOAT_LIT : TOK_INT_LIT;
 
     for (int i = 0; keywords[i].lexeme != NULL; i++)
     {
@@ -363,6 +363,10 @@ const char * tok2lexeme(TokenType tok)
         case TOK_LTE:  return "MINLIK";
         case TOK_GTE:  return "STÖLIK";
 
+        case TOK_OCH:   return "OCH";
+        case TOK_ELLER: return "ELLER";
+        case TOK_INTE:  return "INTE";
+
         case TOK_ENUM:       return "ENUM";
         case TOK_EXTERN:     return "EXTERN";
         case TOK_GOTO:       return "GÅ TILL";
@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+static double since(const struct timespec *origin, const struct timespec *t)
+{
+    return (double)(t->tv_sec - origin->tv_sec) * 1e9 + (double)(t->tv_nsec - origin->tv_nsec);
+}
+
+static double now_ns(const TraceLog *log)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return since(&log->origin, &t);
+}
+
+void trace_log_init(TraceLog *log)
+{
+    memset(log, 0, sizeof(*log));
+    clock_gettime(CLOCK_MONOTONIC, &log->origin);
+}
+
+void trace_log_free(TraceLog *log)
+{
+    free(log->events);
+    free(log->stack);
+    memset(log, 0, sizeof(*log));
+}
+
+static void add_event(TraceLog *log, const char *name, const char *cat, double start_ns, double dur_ns, int sampled)
+{
+    if (log->event_count == log->event_capacity)
+    {
+        log->event_capacity = log->event_capacity ? log->event_capacity * 2 : 1024;
+        log->events = realloc(log->events, log->event_capacity * sizeof(TraceEvent));
+
+        if (!log->events)
+        {
+            fprintf(stderr, "Fatal: failed to allocate trace events\n");
+            exit(1);
+        }
+    }
+
+    TraceEvent *e = &log->events[log->event_count++];
+
+    e->name     = name;
+    e->cat      = cat;
+    e->start_ns = start_ns;
+    e->dur_ns   = dur_ns;
+    e->sampled  = sampled;
+}
+
+//names are literals, so their addresses identify them; the last slot takes any name past the limit
+static TraceTotal *total_of(TraceLog *log, const char *name)
+{
+    size_t mask = 2 * TRACE_MAX_NAMES - 1;
+    size_t h = (size_t)(((uintptr_t)name >> 3) * 0x9E3779B97F4A7C15ull >> 32) & mask;
+
+    for (;; h = (h + 1) & mask)
+    {
+        TraceTotal *t = log->slots[h];
+
+        if (t && t->name == name)
+            return t;
+
+        if (!t)
+        {
+            if (log->total_count == TRACE_MAX_NAMES - 1)
+            {
+                t = &log->totals[TRACE_MAX_NAMES - 1];
+                t->name = "other";
+                return t;
+            }
+
+            t = &log->totals[log->total_count++];
+            t->name = name;
+            log->slots[h] = t;
+            return t;
+        }
+    }
+}
+
+void trace_begin(TraceLog *log, const char *name)
+{
+    if (log->depth == log->stack_capacity)
+    {
+        log->stack_capacity = log->stack_capacity ? log->stack_capacity * 2 : 64;
+        log->stack = realloc(log->stack, log->stack_capacity * sizeof(TraceFrame));
+
+        if (!log->stack)
+        {
+            fprintf(stderr, "Fatal: failed to allocate trace stack\n");
+            exit(1);
+        }
+    }
+
+    TraceFrame *f = &log->stack[log->depth++];
+
+    f->total    = total_of(log, name);
+    f->child_ns = 0;
+    f->total->calls++;
+    f->total->active++;
+    f->start_ns = now_ns(log);
+}
+
+void trace_end(TraceLog *log, const char *name)
+{
+    double end = now_ns(log);
+    TraceTotal *total = total_of(log, name);
+    int match = log->depth - 1;
+
+    while (match >= 0 && log->stack[match].total != total)
+        match--;
+
+    if (match < 0)
+        return;
+
+    //frames above the match were left without an end (an early return); they close here too
+    while (log->depth > match)
+    {
+        TraceFrame *f = &log->stack[--log->depth];
+        TraceTotal *t = f->total;
+        double dur = end - f->start_ns;
+
+        t->self_ns += dur - f->child_ns;
+
+        if (--t->active == 0)
+            t->total_ns += dur;
+
+        if (log->depth > 0)
+            log->stack[log->depth - 1].child_ns += dur;
+
+        if (t->kept < TRACE_FULL_LIMIT)
+        {
+            add_event(log, t->name, "parser", f->start_ns, dur, 0);
+            t->kept++;
+        }
+        else if (t->calls % TRACE_SAMPLE_EVERY == 0)
+        {
+            add_event(log, t->name, "parser", f->start_ns, dur, TRACE_SAMPLE_EVERY);
+            t->kept++;
+        }
+    }
+}
+
+void trace_span(TraceLog *log, const char *name, const char *cat, const struct timespec *start,
+                const struct timespec *end)
+{
+    add_event(log, name, cat, since(&log->origin, start), since(start, end), 0);
+}
+
+static void write_json_string(const char *s, FILE *f)
+{
+    fputc('"', f);
+
+    for (; *s; s++)
+    {
+        unsigned char c = (unsigned char)*s;
+
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+
+    fputc('"', f);
+}
+
+int write_trace_log(const TraceLog *log, const char *path, const char *source, FILE *err)
+{
+    FILE *f = fopen(path, "w");
+    int pid = (int)getpid();
+    double last = 0;
+
+    if (!f)
+    {
+        fprintf(err, "Error: Could not open %s for writing\n", path);
+        return 1;
+    }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":1,\"args\":{\"name\":", pid);
+    write_json_string(source, f);
+    fprintf(f, "}}");
+
+    //timestamps and durations are in microseconds; three decimals keep the nanoseconds
+    for (int i = 0; i < log->event_count; i++)
+    {
+        const TraceEvent *e = &log->events[i];
+
+        fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":1",
+                e->name, e->cat, e->start_ns / 1e3, e->dur_ns / 1e3, pid);
+
+        if (e->sampled)
+            fprintf(f, ",\"args\":{\"sampled\":%d}", e->sampled);
+
+        fprintf(f, "}");
+
+        if (e->start_ns + e->dur_ns > last)
+            last = e->start_ns + e->dur_ns;
+    }
+
+    fprintf(f, ",\n{\"name\":\"parser totals\",\"cat\":\"parser\",\"ph\":\"i\",\"s\":\"p\",\"ts\":%.3f,\"pid\":%d,\"tid\":1,"
+               "\"args\":{", last / 1e3, pid);
+
+    for (int i = 0, first = 1; i < TRACE_MAX_NAMES; i++)
+    {
+        const TraceTotal *t = &log->totals[i];
+
+        if (t->calls == 0)
+            continue;
+
+        fprintf(f, "%s\n  \"%s\":{\"calls\":%ld,\"kept\":%ld,\"total_us\":%.3f,\"self_us\":%.3f}",
+                first ? "" : ",", t->name, t->calls, t->kept, t->total_ns / 1e3, t->self_ns / 1e3);
+        first = 0;
+    }
+
+    fprintf(f, "}}\n]}\n");
+
+    if (fclose(f) != 0)
+    {
+        fprintf(err, "Error: Failed to write %s\n", path);
+        return 1;
+    }
+
+    return 0;
+}
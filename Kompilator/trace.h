@@ -0,0 +1,91 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <time.h>
+
+/* ---------------------------------------------
+   Trace events (--trace-events)
+
+   Records spans of one compile and writes them
+   as Chrome trace-event JSON, which Perfetto
+   and chrome://tracing open directly: one span
+   per phase (timing.h) and per parser
+   non-terminal, plus the parser's lookahead
+   scans.
+
+   Hot non-terminals such as unary_expression
+   run once per operand, so a large source would
+   give millions of spans. Each name keeps its
+   first TRACE_FULL_LIMIT spans; after that only
+   one in TRACE_SAMPLE_EVERY is kept, marked
+   with its sampling rate. Every call still
+   counts towards the per-name totals (calls,
+   inclusive and self time), written at the end
+   of the trace as the arguments of one
+   "parser totals" event.
+
+   Spans are kept in memory and written after
+   the compile, so the file I/O does not show in
+   the times. Names must outlive the log (string
+   literals).
+--------------------------------------------- */
+
+#define TRACE_FULL_LIMIT    256
+#define TRACE_SAMPLE_EVERY  64
+#define TRACE_MAX_NAMES     128     // distinct span names; more are counted as "other"
+
+typedef struct TraceEvent {
+    const char *name;
+    const char *cat;
+    double      start_ns;
+    double      dur_ns;
+    int         sampled;            // 0: every span of this name is kept, else the sampling rate
+} TraceEvent;
+
+typedef struct TraceTotal {
+    const char *name;
+    long        calls;
+    long        kept;
+    double      total_ns;           // outermost activations only, so recursion is not counted twice
+    double      self_ns;
+    int         active;             // activations on the stack
+} TraceTotal;
+
+typedef struct TraceFrame {
+    TraceTotal *total;
+    double      start_ns;
+    double      child_ns;
+} TraceFrame;
+
+typedef struct TraceLog {
+    struct timespec origin;
+
+    TraceEvent *events;
+    int         event_count;
+    int         event_capacity;
+
+    TraceTotal  totals[TRACE_MAX_NAMES];
+    TraceTotal *slots[2 * TRACE_MAX_NAMES];    // open addressing on the name's address
+    int         total_count;
+
+    TraceFrame *stack;
+    int         depth;
+    int         stack_capacity;
+} TraceLog;
+
+void trace_log_init(TraceLog *log);
+void trace_log_free(TraceLog *log);
+
+// nested spans, timed here; an end with no matching begin is ignored
+void trace_begin(TraceLog *log, const char *name);
+void trace_end(TraceLog *log, const char *name);
+
+// a span timed by the caller on CLOCK_MONOTONIC, always kept
+void trace_span(TraceLog *log, const char *name, const char *cat, const struct timespec *start,
+                const struct timespec *end);
+
+// writes the JSON to path; returns 1 if it could not
+int  write_trace_log(const TraceLog *log, const char *path, const char *source, FILE *err);
+
+#endif /* TRACE_H */
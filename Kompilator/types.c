@@ -0,0 +1,514 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+
+/* ---------------------------------------------
+   Builtin scalar types
+--------------------------------------------- */
+typedef struct BuiltinType {
+    TokenType token;
+    TypeKind  kind;
+    int       size;
+    int       is_unsigned;
+} BuiltinType;
+
+static const BuiltinType builtins[] = {
+    { TOK_TOM,         TY_VOID,  0, 0 },
+    { TOK_HEL,         TY_INT,   4, 0 },
+    { TOK_FLYT,        TY_FLOAT, 4, 0 },
+    { TOK_BOK,         TY_INT,   1, 0 },
+    { TOK_BIT,         TY_INT,   1, 1 },
+    { TOK_HALV,        TY_INT,   2, 0 },
+    { TOK_BYTE,        TY_INT,   1, 1 },
+    { TOK_ORD,         TY_INT,   2, 1 },
+    { TOK_VAL,         TY_INT,   4, 0 },
+    { TOK_KORT,        TY_INT,   2, 0 },
+    { TOK_LANG,        TY_INT,   8, 0 },
+    { TOK_DUBBEL,      TY_FLOAT, 8, 0 },
+    { TOK_LANG_DUBBEL, TY_FLOAT, 8, 0 },
+    { TOK_ERROR,       TY_ERROR, 0, 0 }
+};
+
+static void *grow(void *ptr, int *capacity, int count, size_t elem_size, const char *what)
+{
+    if (count < *capacity)
+        return ptr;
+
+    *capacity = (*capacity == 0) ? 16 : *capacity * 2;
+    ptr = realloc(ptr, (size_t)*capacity * elem_size);
+
+    if (!ptr)
+    {
+        fprintf(stderr, "Fatal: %s realloc failed\n", what);
+        exit(1);
+    }
+
+    return ptr;
+}
+
+static int new_type(TypeTable *tt, TypeKind kind)
+{
+    tt->types = grow(tt->types, &tt->type_capacity, tt->type_count, sizeof(Type), "type table");
+
+    int id = tt->type_count++;
+    Type *t = &tt->types[id];
+
+    t->kind        = kind;
+    t->token       = TOK_ERROR;
+    t->size        = 0;
+    t->align       = 1;
+    t->is_unsigned = 0;
+    t->base        = -1;
+    t->count       = -1;
+    t->info        = -1;
+
+    return id;
+}
+
+void init_type_table(TypeTable *tt, LayoutMode layout)
+{
+    memset(tt, 0, sizeof(*tt));
+    tt->layout = layout;
+
+    tt->ty_error = new_type(tt, TY_ERROR);
+    tt->ty_void  = type_builtin(tt, TOK_TOM, 0);
+    tt->ty_int   = type_builtin(tt, TOK_HEL, 0);
+    tt->ty_float = type_builtin(tt, TOK_FLYT, 0);
+    tt->ty_char  = type_builtin(tt, TOK_BOK, 0);
+}
+
+void free_type_table(TypeTable *tt)
+{
+    free(tt->types);
+    free(tt->structs);
+    free(tt->fields);
+
+    memset(tt, 0, sizeof(*tt));
+}
+
+int type_builtin(TypeTable *tt, TokenType token, int is_unsigned)
+{
+    const BuiltinType *b = builtins;
+
+    while (b->token != TOK_ERROR && b->token != token)
+        b++;
+
+    if (b->token == TOK_ERROR)
+        return tt->ty_error;
+
+    //OSIGNERAD only changes integer types
+    is_unsigned = (b->kind == TY_INT) ? (is_unsigned || b->is_unsigned) : 0;
+
+    for (int i = 0; i < tt->type_count; i++)
+    {
+        if (tt->types[i].token == token && tt->types[i].is_unsigned == is_unsigned)
+            return i;
+    }
+
+    int id = new_type(tt, b->kind);
+
+    tt->types[id].token       = token;
+    tt->types[id].size        = b->size;
+    tt->types[id].align       = (b->size > 0) ? b->size : 1;
+    tt->types[id].is_unsigned = is_unsigned;
+
+    return id;
+}
+
+int type_pointer(TypeTable *tt, int base)
+{
+    for (int i = 0; i < tt->type_count; i++)
+    {
+        if (tt->types[i].kind == TY_POINTER && tt->types[i].base == base)
+            return i;
+    }
+
+    int id = new_type(tt, TY_POINTER);
+
+    tt->types[id].size        = 8;
+    tt->types[id].align       = 8;
+    tt->types[id].is_unsigned = 1;
+    tt->types[id].base        = base;
+
+    return id;
+}
+
+int type_array(TypeTable *tt, int elem, int count)
+{
+    for (int i = 0; i < tt->type_count; i++)
+    {
+        if (tt->types[i].kind == TY_ARRAY && tt->types[i].base == elem && tt->types[i].count == count)
+            return i;
+    }
+
+    int id = new_type(tt, TY_ARRAY);
+
+    tt->types[id].base  = elem;
+    tt->types[id].count = count;
+
+    return id;
+}
+
+//each ENUM declaration is its own type, stored as a HEL
+int type_enum(TypeTable *tt)
+{
+    int id = new_type(tt, TY_ENUM);
+
+    tt->types[id].size  = 4;
+    tt->types[id].align = 4;
+
+    return id;
+}
+
+
+
+/* ---------------------------------------------
+   Structs
+--------------------------------------------- */
+int struct_lookup(const TypeTable *tt, const char *name)
+{
+    for (int i = 0; i < tt->struct_count; i++)
+    {
+        if (strcmp(tt->structs[i].name, name) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+int struct_declare(TypeTable *tt, const char *name)
+{
+    int s = struct_lookup(tt, name);
+
+    if (s >= 0)
+        return s;
+
+    tt->structs = grow(tt->structs, &tt->struct_capacity, tt->struct_count, sizeof(StructInfo), "struct table");
+
+    s = tt->struct_count++;
+
+    StructInfo *info = &tt->structs[s];
+
+    info->name         = name;
+    info->node         = -1;
+    info->first_field  = tt->field_count;
+    info->field_count  = 0;
+    info->size         = 0;
+    info->align        = 1;
+    info->layout_state = LAYOUT_STATE_NONE;
+
+    info->type = new_type(tt, TY_STRUCT);
+    tt->types[info->type].info = s;
+
+    return s;
+}
+
+//fields of one struct must be added back to back, before the next struct gets any
+void struct_add_field(TypeTable *tt, int s, const char *name, int type, int node)
+{
+    StructInfo *info = &tt->structs[s];
+
+    if (info->field_count == 0)
+        info->first_field = tt->field_count;
+
+    tt->fields = grow(tt->fields, &tt->field_capacity, tt->field_count, sizeof(StructField), "field table");
+
+    StructField *f = &tt->fields[tt->field_count++];
+
+    f->name   = name;
+    f->type   = type;
+    f->offset = 0;
+    f->node   = node;
+
+    info->field_count++;
+}
+
+int struct_find_field(const TypeTable *tt, int s, const char *name)
+{
+    const StructInfo *info = &tt->structs[s];
+
+    for (int i = 0; i < info->field_count; i++)
+    {
+        if (strcmp(tt->fields[info->first_field + i].name, name) == 0)
+            return info->first_field + i;
+    }
+
+    return -1;
+}
+
+//peels arrays down to the element type
+static int strip_arrays(const TypeTable *tt, int type)
+{
+    while (type >= 0 && tt->types[type].kind == TY_ARRAY)
+        type = tt->types[type].base;
+
+    return type;
+}
+
+int layout_struct(TypeTable *tt, int s)
+{
+    StructInfo *info = &tt->structs[s];
+    int order[info->field_count > 0 ? info->field_count : 1];
+    int offset = 0;
+    int align  = 1;
+
+    if (info->layout_state == LAYOUT_STATE_DONE)
+        return (info->size < 0) ? -1 : 0;
+
+    //reached again while its own fields are being laid out
+    if (info->layout_state == LAYOUT_STATE_ACTIVE)
+        return -1;
+
+    info->layout_state = LAYOUT_STATE_ACTIVE;
+
+    //lays out structs embedded by value first
+    for (int i = 0; i < info->field_count; i++)
+    {
+        int elem = strip_arrays(tt, tt->fields[info->first_field + i].type);
+
+        if (elem >= 0 && tt->types[elem].kind == TY_STRUCT &&
+            layout_struct(tt, tt->types[elem].info) < 0)
+        {
+            info = &tt->structs[s];
+            info->size         = -1;
+            info->layout_state = LAYOUT_STATE_DONE;
+            return -1;
+        }
+
+        order[i] = info->first_field + i;
+    }
+
+    //stable insertion sort by decreasing alignment
+    if (tt->layout == LAYOUT_REORDER)
+    {
+        for (int i = 1; i < info->field_count; i++)
+        {
+            int f = order[i];
+            int a = type_align(tt, tt->fields[f].type);
+            int j = i - 1;
+
+            while (j >= 0 && type_align(tt, tt->fields[order[j]].type) < a)
+            {
+                order[j + 1] = order[j];
+                j--;
+            }
+
+            order[j + 1] = f;
+        }
+    }
+
+    for (int i = 0; i < info->field_count; i++)
+    {
+        StructField *f = &tt->fields[order[i]];
+        int a = (tt->layout == LAYOUT_PACKED) ? 1 : type_align(tt, f->type);
+
+        offset = (offset + a - 1) / a * a;
+        f->offset = offset;
+        offset += type_size(tt, f->type);
+
+        if (a > align)
+            align = a;
+    }
+
+    info->align        = align;
+    info->size         = (offset + align - 1) / align * align;
+    info->layout_state = LAYOUT_STATE_DONE;
+
+    return 0;
+}
+
+int type_size(const TypeTable *tt, int type)
+{
+    const Type *t;
+
+    if (type < 0)
+        return 0;
+
+    t = &tt->types[type];
+
+    switch (t->kind)
+    {
+        case TY_ARRAY:
+            return (t->count < 0) ? 0 : t->count * type_size(tt, t->base);
+
+        case TY_STRUCT:
+            return (tt->structs[t->info].size < 0) ? 0 : tt->structs[t->info].size;
+
+        default:
+            return t->size;
+    }
+}
+
+int type_align(const TypeTable *tt, int type)
+{
+    const Type *t;
+
+    if (type < 0)
+        return 1;
+
+    t = &tt->types[type];
+
+    switch (t->kind)
+    {
+        case TY_ARRAY:
+            return type_align(tt, t->base);
+
+        case TY_STRUCT:
+            return tt->structs[t->info].align;
+
+        default:
+            return t->align;
+    }
+}
+
+int type_is_integer(const TypeTable *tt, int type)
+{
+    return type >= 0 && (tt->types[type].kind == TY_INT || tt->types[type].kind == TY_ENUM);
+}
+
+int type_is_arithmetic(const TypeTable *tt, int type)
+{
+    return type_is_integer(tt, type) || (type >= 0 && tt->types[type].kind == TY_FLOAT);
+}
+
+int type_is_scalar(const TypeTable *tt, int type)
+{
+    return type_is_arithmetic(tt, type) || (type >= 0 && tt->types[type].kind == TY_POINTER);
+}
+
+int type_promote(TypeTable *tt, int type)
+{
+    if (type < 0)
+        return type;
+
+    if (tt->types[type].kind == TY_ENUM ||
+        (tt->types[type].kind == TY_INT && tt->types[type].size < 4))
+        return tt->ty_int;
+
+    return type;
+}
+
+//reduced to size and signedness: the wider operand wins, unsigned wins a tie
+int type_common(TypeTable *tt, int a, int b)
+{
+    int fa = (tt->types[a].kind == TY_FLOAT);
+    int fb = (tt->types[b].kind == TY_FLOAT);
+
+    if (fa || fb)
+    {
+        if (fa && tt->types[a].size == 8)
+            return a;
+        if (fb && tt->types[b].size == 8)
+            return b;
+
+        return tt->ty_float;
+    }
+
+    a = type_promote(tt, a);
+    b = type_promote(tt, b);
+
+    if (tt->types[a].size != tt->types[b].size)
+        return (tt->types[a].size > tt->types[b].size) ? a : b;
+
+    if (tt->types[a].is_unsigned)
+        return a;
+    if (tt->types[b].is_unsigned)
+        return b;
+
+    return a;
+}
+
+const char *type_to_string(const TypeTable *tt, int type, char *buf, int buf_size)
+{
+    char inner[128];
+    const Type *t;
+
+    if (type < 0)
+    {
+        snprintf(buf, buf_size, "?");
+        return buf;
+    }
+
+    t = &tt->types[type];
+
+    switch (t->kind)
+    {
+        case TY_VOID:
+        case TY_INT:
+        case TY_FLOAT:
+            //BIT, BYTE and ORD are unsigned on their own
+            if (t->is_unsigned && t->token != TOK_BIT && t->token != TOK_BYTE && t->token != TOK_ORD)
+                snprintf(buf, buf_size, "OSIGNERAD %s", tok2lexeme(t->token));
+            else
+                snprintf(buf, buf_size, "%s", tok2lexeme(t->token));
+            break;
+
+        case TY_POINTER:
+            snprintf(buf, buf_size, "%s PEK", type_to_string(tt, t->base, inner, sizeof(inner)));
+            break;
+
+        case TY_ARRAY:
+            if (t->count < 0)
+                snprintf(buf, buf_size, "%s<>", type_to_string(tt, t->base, inner, sizeof(inner)));
+            else
+                snprintf(buf, buf_size, "%s<%d>", type_to_string(tt, t->base, inner, sizeof(inner)), t->count);
+            break;
+
+        case TY_STRUCT:
+            snprintf(buf, buf_size, "STRUKTUR %s", tt->structs[t->info].name);
+            break;
+
+        case TY_ENUM:
+            snprintf(buf, buf_size, "ENUM");
+            break;
+
+        default:
+            snprintf(buf, buf_size, "<fel>");
+            break;
+    }
+
+    return buf;
+}
+
+void dump_struct_layouts(const TypeTable *tt)
+{
+    static const char *mode_names[] = { "natural", "packed", "reorder" };
+    char type_buf[128];
+
+    for (int s = 0; s < tt->struct_count; s++)
+    {
+        const StructInfo *info = &tt->structs[s];
+
+        if (info->layout_state != LAYOUT_STATE_DONE || info->size < 0)
+            continue;
+
+        printf("STRUKTUR %s: size %d, align %d (%s)\n",
+               info->name, info->size, info->align, mode_names[tt->layout]);
+
+        for (int i = 0; i < info->field_count; i++)
+        {
+            const StructField *f = &tt->fields[info->first_field + i];
+
+            printf("    +%-4d %-20s %s\n",
+                   f->offset,
+                   type_to_string(tt, f->type, type_buf, sizeof(type_buf)),
+                   f->name);
+        }
+    }
+}
+
+int parse_layout_mode(const char *text, LayoutMode *out)
+{
+    if (strcmp(text, "natural") == 0)
+        *out = LAYOUT_NATURAL;
+    else if (strcmp(text, "packed") == 0)
+        *out = LAYOUT_PACKED;
+    else if (strcmp(text, "reorder") == 0)
+        *out = LAYOUT_REORDER;
+    else
+        return -1;
+
+    return 0;
+}
@@ -0,0 +1,122 @@
+#ifndef TYPES_H
+#define TYPES_H
+
+#include "tokenkeytab.h"
+
+/* ---------------------------------------------
+   Type table
+
+   Every distinct type gets one id. Pointer and
+   array types are interned, so two uses of
+   "HEL PEK" share an id and types can be compared
+   with ==.
+--------------------------------------------- */
+typedef enum TypeKind {
+    TY_VOID,
+    TY_INT,
+    TY_FLOAT,
+    TY_POINTER,
+    TY_ARRAY,
+    TY_STRUCT,
+    TY_ENUM,
+    TY_ERROR
+} TypeKind;
+
+/* struct layout strategies, selected with --struct-layout= */
+typedef enum LayoutMode {
+    LAYOUT_NATURAL,     // declaration order, C alignment rules
+    LAYOUT_PACKED,      // declaration order, no padding
+    LAYOUT_REORDER      // fields sorted by decreasing alignment to minimise padding
+} LayoutMode;
+
+typedef struct Type {
+    TypeKind   kind;
+    TokenType  token;       // builtin keyword (TOK_HEL, ...) or TOK_ERROR
+    int        size;        // scalar size in bytes (aggregates: see type_size)
+    int        align;
+    int        is_unsigned;
+    int        base;        // pointee / element type, -1 otherwise
+    int        count;       // array length, -1 when unknown
+    int        info;        // struct index for TY_STRUCT, -1 otherwise
+} Type;
+
+typedef struct StructField {
+    const char *name;
+    int         type;
+    int         offset;     // byte offset, valid once the struct is laid out
+    int         node;       // FIELD_DECL node, for diagnostics
+} StructField;
+
+/* StructInfo.layout_state */
+#define LAYOUT_STATE_NONE        0
+#define LAYOUT_STATE_ACTIVE      1   // being laid out; seeing it again means it contains itself
+#define LAYOUT_STATE_DONE        2
+
+typedef struct StructInfo {
+    const char *name;
+    int         node;           // STRUCT_DECL node, -1 until defined
+    int         type;           // TY_STRUCT id
+    int         first_field;    // index into TypeTable.fields
+    int         field_count;
+    int         size;
+    int         align;
+    int         layout_state;
+} StructInfo;
+
+typedef struct TypeTable {
+    Type        *types;
+    int          type_count;
+    int          type_capacity;
+
+    StructInfo  *structs;
+    int          struct_count;
+    int          struct_capacity;
+
+    StructField *fields;
+    int          field_count;
+    int          field_capacity;
+
+    LayoutMode   layout;
+
+    // ids of the predeclared types
+    int          ty_void;
+    int          ty_error;
+    int          ty_int;        // HEL
+    int          ty_float;      // FLYT
+    int          ty_char;       // BOK
+} TypeTable;
+
+
+void init_type_table(TypeTable *tt, LayoutMode layout);
+void free_type_table(TypeTable *tt);
+
+int  type_builtin(TypeTable *tt, TokenType token, int is_unsigned);
+int  type_pointer(TypeTable *tt, int base);
+int  type_array(TypeTable *tt, int elem, int count);
+int  type_enum(TypeTable *tt);
+
+int  struct_lookup(const TypeTable *tt, const char *name);
+int  struct_declare(TypeTable *tt, const char *name);
+void struct_add_field(TypeTable *tt, int s, const char *name, int type, int node);
+int  struct_find_field(const TypeTable *tt, int s, const char *name);
+
+// computes size, alignment and field offsets; returns 0, or -1 if the struct contains itself by value
+int  layout_struct(TypeTable *tt, int s);
+
+int  type_size(const TypeTable *tt, int type);
+int  type_align(const TypeTable *tt, int type);
+
+int  type_is_integer(const TypeTable *tt, int type);
+int  type_is_arithmetic(const TypeTable *tt, int type);
+int  type_is_scalar(const TypeTable *tt, int type);
+
+// integer promotion and the usual arithmetic conversions
+int  type_promote(TypeTable *tt, int type);
+int  type_common(TypeTable *tt, int a, int b);
+
+const char *type_to_string(const TypeTable *tt, int type, char *buf, int buf_size);
+void dump_struct_layouts(const TypeTable *tt);
+
+int  parse_layout_mode(const char *text, LayoutMode *out);
+
+#endif /* TYPES_H */
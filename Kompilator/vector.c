@@ -0,0 +1,1058 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "vector.h"
+
+typedef enum VecClass {
+    VC_NONE,
+    VC_CONTROL,     // the counter, its step and the exit test
+    VC_ADDRESS,     // an anchor pointer plus constant bytes
+    VC_VECTOR,      // one value per lane
+    VC_CARRIED,     // other header phis and their updates
+    VC_DEAD         // left over from earlier passes, nothing needs it
+} VecClass;
+
+//pointer phi stepped by a constant; every access goes through one
+typedef struct Anchor {
+    int       phi;
+    int       start;        // value from the preheader
+    long long step;         // bytes per iteration
+    int       root;         // start is root + root_offset
+    long long root_offset;
+    long long low;          // bytes around the pointer one iteration touches
+    long long high;
+    int       accessed;
+    int       stored;
+    int       vphi;         // the pointer in the vector loop
+    int       vnext;
+} Anchor;
+
+typedef struct Access {
+    int       anchor;
+    long long offset;
+    int       is_store;
+} Access;
+
+//header phi other than the counter: a second counter or a running integer sum
+typedef struct Carried {
+    int       phi;
+    int       init;
+    int       update;
+    int       is_sum;
+    int       operand;      // sums: what each iteration adds or subtracts
+    int       is_sub;
+    long long step;         // counters: what each iteration adds
+    int       vphi;         // sums: per-lane totals in the vector loop
+    int       vnext;
+} Carried;
+
+typedef struct VecState {
+    IrFunc     *f;
+    const Loop *loop;
+    int         header;
+    int         body;
+    int         pre;            // preheader's position among the header's predecessors
+    int         back;
+    int         counter;        // i of i < n
+    int         limit;          // n
+    int         test;
+    int         vector_bytes;
+    int         elem;           // bytes per lane, 0 until an access or operation fixes it
+    int         lanes;
+
+    unsigned char *cls;         // per value that existed before vectorising
+    int        *anchor_of;      // VC_ADDRESS: anchor
+    long long  *offset_of;      // VC_ADDRESS: bytes from the anchor
+    int        *vec;            // body value -> its vector loop value
+    int        *splat;          // loop-invariant value -> its splat, 0 if none yet
+
+    Anchor     *anchors;
+    int         anchor_count;
+    Access     *accesses;
+    int         access_count;
+    Carried    *carried;
+    int         carried_count;
+    int         (*checks)[2];   // anchor pairs compared at run time
+    int         check_count;
+
+    int         setup;          // block between the preheader and the vector loop
+    char       *why;
+    int         why_size;
+} VecState;
+
+static void *vec_alloc(size_t count, size_t size, const char *what)
+{
+    void *ptr = calloc(count + 1, size);
+
+    if (!ptr)
+    {
+        fprintf(stderr, "Fatal: failed to allocate %s\n", what);
+        exit(1);
+    }
+
+    return ptr;
+}
+
+static int reject(VecState *vs, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(vs->why, (size_t)vs->why_size, fmt, ap);
+    va_end(ap);
+
+    return 0;
+}
+
+static int inside(const VecState *vs, int value)
+{
+    return value != IR_NONE && loop_contains(vs->loop, vs->f->instrs[value].block);
+}
+
+static int is_constant(const IrFunc *f, int value, long long *c)
+{
+    if (value == IR_NONE || f->instrs[value].op != IR_CONST || ir_type_is_float(f->instrs[value].type))
+        return 0;
+
+    *c = f->instrs[value].imm;
+    return 1;
+}
+
+static int pred_slot(const IrFunc *f, int block, int pred)
+{
+    for (int p = 0; p < f->blocks[block].pred_count; p++)
+    {
+        if (f->blocks[block].preds[p] == pred)
+            return p;
+    }
+
+    return IR_NONE;
+}
+
+//every lane of the loop has the same width, which decides how many there are
+static int fix_elem(VecState *vs, IrType type)
+{
+    int size = ir_type_size(type);
+
+    if (type != IRT_I32 && type != IRT_I64 && type != IRT_F32 && type != IRT_F64)
+        return reject(vs, "works on %s values", ir_type_name(type));
+
+    if (vs->elem && vs->elem != size)
+        return reject(vs, "mixes %d- and %d-byte elements", vs->elem, size);
+
+    vs->elem = size;
+    return 1;
+}
+
+
+
+/*
+  _____ _
+ / ____| |
+| (___ | |__   __ _ _ __   ___
+ \___ \| '_ \ / _` | '_ \ / _ \
+ ____) | | | | (_| | |_) |  __/
+|_____/|_| |_|\__,_| .__/ \___|
+                   | |
+                   |_|
+*/
+
+//header: phis, i < n, branch; body: one block back to the header
+static int check_shape(VecState *vs)
+{
+    IrFunc *f = vs->f;
+    const Loop *loop = vs->loop;
+    int h = loop->header;
+    int br, test;
+    const IrInstr *cmp;
+
+    if (loop->preheader == IR_NONE || loop->latch == IR_NONE || f->blocks[h].pred_count != 2)
+        return reject(vs, "has more than one entry or back edge");
+
+    if (loop->size != 2 || loop->latch == h || f->instrs[ir_terminator(f, loop->latch)].op != IR_JMP)
+        return reject(vs, "has control flow in its body");
+
+    br = ir_terminator(f, h);
+
+    if (f->instrs[br].op != IR_BR || f->instrs[br].target[0] != loop->latch)
+        return reject(vs, "does not leave through its header test");
+
+    test = f->instrs[br].a;
+
+    if (f->instrs[br].prev != test)
+        return reject(vs, "computes more than its test in the header");
+
+    for (int i = f->blocks[h].first; i != test; i = f->instrs[i].next)
+    {
+        if (f->instrs[i].op != IR_PHI)
+            return reject(vs, "computes more than its test in the header");
+    }
+
+    cmp = &f->instrs[test];
+
+    if (cmp->op == IR_LT && f->instrs[cmp->a].op == IR_PHI && f->instrs[cmp->a].block == h && !inside(vs, cmp->b))
+    {
+        vs->counter = cmp->a;
+        vs->limit   = cmp->b;
+    }
+    else if (cmp->op == IR_GT && f->instrs[cmp->b].op == IR_PHI && f->instrs[cmp->b].block == h && !inside(vs, cmp->a))
+    {
+        vs->counter = cmp->b;
+        vs->limit   = cmp->a;
+    }
+    else
+        return reject(vs, "does not test i < n");
+
+    if (f->instrs[vs->counter].type != IRT_I32 && f->instrs[vs->counter].type != IRT_I64)
+        return reject(vs, "counts in %s", ir_type_name(f->instrs[vs->counter].type));
+
+    //the test only decides the branch
+    for (int i = 0; i < f->instr_count; i++)
+    {
+        const IrInstr *in = &f->instrs[i];
+
+        if (in->block == IR_NONE || i == br)
+            continue;
+
+        if (in->a == test || in->b == test)
+            return reject(vs, "uses its test as a value");
+
+        for (int k = 0; k < in->nargs; k++)
+        {
+            if (f->operands[in->args + k] == test)
+                return reject(vs, "uses its test as a value");
+        }
+    }
+
+    vs->header = h;
+    vs->body   = loop->latch;
+    vs->test   = test;
+    vs->pre    = pred_slot(f, h, loop->preheader);
+    vs->back   = pred_slot(f, h, loop->latch);
+
+    vs->cls[test] = VC_CONTROL;
+
+    return 1;
+}
+
+//next is phi + x, x + phi or phi - x; returns x
+static int update_operand(const IrFunc *f, int phi, int next, int *is_sub)
+{
+    const IrInstr *in = &f->instrs[next];
+
+    *is_sub = 0;
+
+    if (in->op == IR_ADD && in->a == phi)
+        return in->b;
+
+    if (in->op == IR_ADD && in->b == phi)
+        return in->a;
+
+    if (in->op == IR_SUB && in->a == phi)
+    {
+        *is_sub = 1;
+        return in->b;
+    }
+
+    return IR_NONE;
+}
+
+static int classify_phis(VecState *vs)
+{
+    IrFunc *f = vs->f;
+
+    for (int i = f->blocks[vs->header].first; f->instrs[i].op == IR_PHI; i = f->instrs[i].next)
+    {
+        const IrInstr *phi = &f->instrs[i];
+        int init = f->operands[phi->args + vs->pre];
+        int next = f->operands[phi->args + vs->back];
+        int is_sub;
+        int x = (f->instrs[next].block == vs->body) ? update_operand(f, i, next, &is_sub) : IR_NONE;
+        long long c;
+
+        if (i == vs->counter)
+        {
+            if (x == IR_NONE || is_sub || !is_constant(f, x, &c) || c != 1)
+                return reject(vs, "does not step its counter by 1");
+
+            vs->cls[i]    = VC_CONTROL;
+            vs->cls[next] = VC_CONTROL;
+        }
+        else if (phi->type == IRT_PTR)
+        {
+            Anchor *a = &vs->anchors[vs->anchor_count];
+
+            if (f->instrs[next].op != IR_OFFSET || f->instrs[next].a != i || f->instrs[next].block != vs->body)
+                return reject(vs, "moves a pointer by something other than a constant");
+
+            memset(a, 0, sizeof(*a));
+            a->phi   = i;
+            a->start = init;
+            a->step  = f->instrs[next].imm;
+
+            vs->cls[i]          = VC_ADDRESS;
+            vs->anchor_of[i]    = vs->anchor_count;
+            vs->offset_of[i]    = 0;
+            vs->cls[next]       = VC_ADDRESS;
+            vs->anchor_of[next] = vs->anchor_count;
+            vs->offset_of[next] = a->step;
+            vs->anchor_count++;
+        }
+        else if (x != IR_NONE && ir_type_is_float(phi->type))
+        {
+            return reject(vs, "sums floats, which would be added up in another order");
+        }
+        else if (x != IR_NONE)
+        {
+            Carried *c_ = &vs->carried[vs->carried_count++];
+
+            memset(c_, 0, sizeof(*c_));
+            c_->phi    = i;
+            c_->init   = init;
+            c_->update = next;
+
+            if (is_constant(f, x, &c))
+                c_->step = is_sub ? -c : c;
+            else
+            {
+                if (!fix_elem(vs, phi->type))
+                    return 0;
+
+                c_->is_sum  = 1;
+                c_->operand = x;
+                c_->is_sub  = is_sub;
+            }
+
+            vs->cls[i]    = VC_CARRIED;
+            vs->cls[next] = VC_CARRIED;
+        }
+        else
+            return reject(vs, "carries a value from one iteration to the next");
+    }
+
+    return 1;
+}
+
+
+
+/*
+  ____            _
+ |  _ \          | |
+ | |_) | ___   __| |_   _
+ |  _ < / _ \ / _` | | | |
+ | |_) | (_) | (_| | |_| |
+ |____/ \___/ \__,_|\__, |
+                     __/ |
+                    |___/
+*/
+
+//v may feed a lane-wise operation: a vector or something fixed before the loop
+static int vector_operand(VecState *vs, int v)
+{
+    if (!inside(vs, v))
+        return 1;
+
+    switch (vs->cls[v])
+    {
+        case VC_VECTOR:  return 1;
+        case VC_CONTROL: return reject(vs, "uses its counter as a value");
+        case VC_ADDRESS: return reject(vs, "uses a pointer as a value");
+        default:         return reject(vs, "uses a value carried between iterations");
+    }
+}
+
+static int access_address(VecState *vs, int v, int is_store)
+{
+    Access *acc;
+
+    if (!inside(vs, v))
+        return reject(vs, "%s an address that does not move", is_store ? "stores to" : "loads from");
+
+    if (vs->cls[v] != VC_ADDRESS)
+        return reject(vs, "%s a computed address", is_store ? "stores to" : "loads from");
+
+    acc = &vs->accesses[vs->access_count++];
+    acc->anchor   = vs->anchor_of[v];
+    acc->offset   = vs->offset_of[v];
+    acc->is_store = is_store;
+
+    vs->anchors[acc->anchor].accessed = 1;
+    vs->anchors[acc->anchor].stored  |= is_store;
+
+    return 1;
+}
+
+static void mark_operands(const IrFunc *f, const IrInstr *in, unsigned char *needed)
+{
+    if (in->a != IR_NONE)
+        needed[in->a] = 1;
+    if (in->b != IR_NONE)
+        needed[in->b] = 1;
+
+    for (int k = 0; k < in->nargs; k++)
+        needed[f->operands[in->args + k]] = 1;
+}
+
+//body values only the clean-up would delete, such as indexes replaced by pointer steps
+static void find_dead(VecState *vs)
+{
+    IrFunc *f = vs->f;
+    unsigned char *needed = vec_alloc((size_t)f->instr_count, 1, "needed values");
+
+    for (int i = 0; i < f->instr_count; i++)
+    {
+        if (f->instrs[i].block != IR_NONE && f->instrs[i].block != vs->body)
+            mark_operands(f, &f->instrs[i], needed);
+    }
+
+    for (int i = f->blocks[vs->body].last; i != IR_NONE; i = f->instrs[i].prev)
+    {
+        if (needed[i] || ir_has_side_effects(f->instrs[i].op))
+            mark_operands(f, &f->instrs[i], needed);
+        else
+            vs->cls[i] = VC_DEAD;
+    }
+
+    free(needed);
+}
+
+static int classify_body(VecState *vs)
+{
+    IrFunc *f = vs->f;
+    int term = ir_terminator(f, vs->body);
+
+    find_dead(vs);
+
+    for (int i = f->blocks[vs->body].first; i != term; i = f->instrs[i].next)
+    {
+        const IrInstr *in = &f->instrs[i];
+
+        //steps of the header phis are looked at with them; sums check what they add
+        if (vs->cls[i] != VC_NONE)
+        {
+            for (int c = 0; c < vs->carried_count; c++)
+            {
+                if (vs->carried[c].update == i && vs->carried[c].is_sum && !vector_operand(vs, vs->carried[c].operand))
+                    return 0;
+            }
+            continue;
+        }
+
+        switch (in->op)
+        {
+            case IR_OFFSET:
+                if (!inside(vs, in->a) || vs->cls[in->a] != VC_ADDRESS)
+                    return reject(vs, "computes an address that does not follow the counter");
+
+                vs->cls[i]       = VC_ADDRESS;
+                vs->anchor_of[i] = vs->anchor_of[in->a];
+                vs->offset_of[i] = vs->offset_of[in->a] + in->imm;
+                break;
+
+            case IR_LOAD:
+                if (!fix_elem(vs, in->type) || !access_address(vs, in->a, 0))
+                    return 0;
+
+                vs->cls[i] = VC_VECTOR;
+                break;
+
+            case IR_STORE:
+                if (!fix_elem(vs, f->instrs[in->b].type) || !vector_operand(vs, in->b) ||
+                    !access_address(vs, in->a, 1))
+                    return 0;
+                break;
+
+            case IR_MUL:
+                if (in->type == IRT_I64)
+                    return reject(vs, "multiplies i64 values, which has no vector instruction");
+
+                if (in->type == IRT_I32 && vs->vector_bytes < 32)
+                    return reject(vs, "multiplies i32 values, which needs AVX2");
+                /* fallthrough */
+
+            case IR_ADD:
+            case IR_SUB:
+            case IR_DIV:
+            case IR_AND:
+            case IR_OR:
+            case IR_XOR:
+                if (in->op == IR_DIV && !ir_type_is_float(in->type))
+                    return reject(vs, "divides integers, which has no vector instruction");
+
+                if (!fix_elem(vs, in->type) || !vector_operand(vs, in->a) || !vector_operand(vs, in->b))
+                    return 0;
+
+                vs->cls[i] = VC_VECTOR;
+                break;
+
+            default:
+                return reject(vs, "contains %s", ir_op_name(in->op));
+        }
+    }
+
+    if (vs->access_count == 0)
+        return reject(vs, "has no array accesses");
+
+    vs->lanes = vs->vector_bytes / vs->elem;
+
+    for (int a = 0; a < vs->anchor_count; a++)
+    {
+        if (vs->anchors[a].accessed && vs->anchors[a].step != vs->elem)
+            return reject(vs, "moves a pointer by %lld bytes, not one element", vs->anchors[a].step);
+    }
+
+    return 1;
+}
+
+
+
+/*
+  _____                            _
+ |  __ \                          | |
+ | |  | | ___ _ __   ___ _ __   __| | ___ _ __   ___ ___
+ | |  | |/ _ \ '_ \ / _ \ '_ \ / _` |/ _ \ '_ \ / __/ _ \
+ | |__| |  __/ |_) |  __/ | | | (_| |  __/ | | | (_|  __/
+ |_____/ \___| .__/ \___|_| |_|\__,_|\___|_| |_|\___\___|
+             | |
+             |_|
+*/
+
+//the value a pointer is a constant number of bytes from
+static int root_of(const IrFunc *f, int value, long long *offset)
+{
+    long long c;
+
+    *offset = 0;
+
+    for (;;)
+    {
+        const IrInstr *in = &f->instrs[value];
+
+        int index = (in->op == IR_INDEX) ? in->b : IR_NONE;
+
+        //indexes of new pointer steps are still sign extended, the clean-up folds them later
+        if (index != IR_NONE && f->instrs[index].op == IR_SEXT)
+            index = f->instrs[index].a;
+
+        if (in->op == IR_OFFSET)
+            *offset += in->imm;
+        else if (in->op == IR_INDEX && is_constant(f, index, &c))
+            *offset += c * in->imm;
+        else
+            return value;
+
+        value = in->a;
+    }
+}
+
+static int is_object(const IrFunc *f, int value)
+{
+    IrOp op = f->instrs[value].op;
+
+    return op == IR_GLOBAL || op == IR_SLOT || op == IR_STRING;
+}
+
+static int same_root(const IrFunc *f, int x, int y)
+{
+    return x == y || (is_object(f, x) && f->instrs[x].op == f->instrs[y].op && f->instrs[x].aux == f->instrs[y].aux);
+}
+
+static int check_dependences(VecState *vs)
+{
+    IrFunc *f = vs->f;
+
+    for (int a = 0; a < vs->anchor_count; a++)
+    {
+        Anchor *an = &vs->anchors[a];
+
+        an->root = root_of(f, an->start, &an->root_offset);
+        an->low  = 0;
+        an->high = 0;
+
+        for (int k = 0, first = 1; k < vs->access_count; k++)
+        {
+            long long at = vs->accesses[k].offset;
+
+            if (vs->accesses[k].anchor != a)
+                continue;
+
+            if (first || at < an->low)
+                an->low = at;
+            if (first || at + vs->elem > an->high)
+                an->high = at + vs->elem;
+
+            first = 0;
+        }
+    }
+
+    //accesses a constant distance apart: a conflict within one vector step reorders them
+    for (int x = 0; x < vs->access_count; x++)
+    {
+        for (int y = x + 1; y < vs->access_count; y++)
+        {
+            const Access *first = &vs->accesses[x];
+            const Access *later = &vs->accesses[y];
+            const Anchor *p = &vs->anchors[first->anchor];
+            const Anchor *q = &vs->anchors[later->anchor];
+            long long distance;
+
+            if ((!first->is_store && !later->is_store) || !same_root(f, p->root, q->root))
+                continue;
+
+            distance = (q->root_offset + later->offset) - (p->root_offset + first->offset);
+
+            if (distance % vs->elem != 0)
+                return reject(vs, "accesses one array at overlapping offsets");
+
+            distance /= vs->elem;
+
+            if (distance >= 1 && distance < vs->lanes)
+                return reject(vs, "has a dependence %lld iteration(s) apart", distance);
+        }
+    }
+
+    //pointers that may or may not meet get checked before the vector loop
+    for (int a = 0; a < vs->anchor_count; a++)
+    {
+        for (int b = a + 1; b < vs->anchor_count; b++)
+        {
+            const Anchor *p = &vs->anchors[a];
+            const Anchor *q = &vs->anchors[b];
+
+            if (!p->accessed || !q->accessed || (!p->stored && !q->stored) || same_root(f, p->root, q->root) ||
+                (is_object(f, p->root) && is_object(f, q->root)))
+                continue;
+
+            if (vs->check_count == VECTOR_MAX_CHECKS)
+                return reject(vs, "needs more than %d overlap checks", VECTOR_MAX_CHECKS);
+
+            vs->checks[vs->check_count][0] = a;
+            vs->checks[vs->check_count][1] = b;
+            vs->check_count++;
+        }
+    }
+
+    return 1;
+}
+
+
+
+/*
+  _____                           _   _
+ / ____|                         | | (_)
+| |  __  ___ _ __   ___ _ __ __ _| |_ _  ___  _ __
+| | |_ |/ _ \ '_ \ / _ \ '__/ _` | __| |/ _ \| '_ \
+| |__| |  __/ | | |  __/ | | (_| | |_| | (_) | | | |
+ \_____|\___|_| |_|\___|_|  \__,_|\__|_|\___/|_| |_|
+*/
+
+static int emit(IrFunc *f, int block, IrOp op, IrType type, int a, int b)
+{
+    int x = ir_new_instr(f, op, type, a, b);
+
+    ir_append(f, block, x);
+    return x;
+}
+
+static int emit_const(IrFunc *f, int block, IrType type, long long value)
+{
+    int x = emit(f, block, IR_CONST, type, IR_NONE, IR_NONE);
+
+    f->instrs[x].imm = value;
+    return x;
+}
+
+static int emit_lanes(IrFunc *f, int block, IrOp op, IrType lane, int a, int b)
+{
+    int x = emit(f, block, op, (op == IR_VSTORE) ? IRT_VOID : (op == IR_VSUM) ? lane : IRT_VEC, a, b);
+
+    f->instrs[x].aux = lane;
+    return x;
+}
+
+//two-input phi; the second input is filled in once it exists
+static int emit_phi(IrFunc *f, int block, IrType type, int first)
+{
+    int values[2] = { first, first };
+    int x = ir_new_instr(f, IR_PHI, type, IR_NONE, IR_NONE);
+
+    f->instrs[x].args  = ir_add_operands(f, values, 2);
+    f->instrs[x].nargs = 2;
+    ir_append(f, block, x);
+
+    return x;
+}
+
+static void set_second(IrFunc *f, int phi, int value)
+{
+    f->operands[f->instrs[phi].args + 1] = value;
+}
+
+static int widen(IrFunc *f, int block, int value)
+{
+    if (f->instrs[value].type == IRT_I64)
+        return value;
+
+    return emit(f, block, IR_SEXT, IRT_I64, value, IR_NONE);
+}
+
+static int narrow(IrFunc *f, int block, int value, IrType type)
+{
+    if (type == IRT_I64)
+        return value;
+
+    return emit(f, block, IR_TRUNC, type, value, IR_NONE);
+}
+
+//the same value in every lane, made once in the setup block
+static int vector_of(VecState *vs, int v)
+{
+    IrFunc *f = vs->f;
+
+    if (inside(vs, v))
+        return vs->vec[v];
+
+    if (!vs->splat[v])
+        vs->splat[v] = emit_lanes(f, vs->setup, IR_VSPLAT, f->instrs[v].type, v, IR_NONE);
+
+    return vs->splat[v];
+}
+
+static int emit_offset(IrFunc *f, int block, int base, long long bytes)
+{
+    int x;
+
+    if (bytes == 0)
+        return base;
+
+    x = emit(f, block, IR_OFFSET, IRT_PTR, base, IR_NONE);
+    f->instrs[x].imm = bytes;
+    return x;
+}
+
+static int address_of(VecState *vs, int block, int v)
+{
+    return emit_offset(vs->f, block, vs->anchors[vs->anchor_of[v]].vphi, vs->offset_of[v]);
+}
+
+//1 when the bytes the vector loop touches through anchors a and b cannot meet
+static int disjoint(VecState *vs, int trips, int a, int b)
+{
+    IrFunc *f = vs->f;
+    int low[2], high[2];
+    int pair[2] = { a, b };
+
+    for (int k = 0; k < 2; k++)
+    {
+        const Anchor *an = &vs->anchors[pair[k]];
+        int end;
+
+        end = emit(f, vs->setup, IR_INDEX, IRT_PTR, an->start, trips);
+        f->instrs[end].imm = an->step;
+
+        low[k]  = emit_offset(f, vs->setup, an->start, an->low);
+        high[k] = emit_offset(f, vs->setup, end, an->high);
+    }
+
+    return emit(f, vs->setup, IR_OR, IRT_I32,
+                emit(f, vs->setup, IR_ULE, IRT_I32, high[0], low[1]),
+                emit(f, vs->setup, IR_ULE, IRT_I32, high[1], low[0]));
+}
+
+static void generate(VecState *vs)
+{
+    IrFunc *f = vs->f;
+    int h = vs->header;
+    int ph = vs->loop->preheader;
+    int n = f->instr_count;
+    IrType counter_type = f->instrs[vs->counter].type;
+    int init = f->operands[f->instrs[vs->counter].args + vs->pre];
+    int vhead, vbody, resume;
+    int first, span, end, vi, vnext, ok = IR_NONE, term;
+    int phi_count = 0;
+
+    vs->setup = ir_new_block(f);
+    vhead     = ir_new_block(f);
+    vbody     = ir_new_block(f);
+    resume    = ir_new_block(f);
+
+    vs->vec   = vec_alloc((size_t)n, sizeof(int), "vector values");
+    vs->splat = vec_alloc((size_t)n, sizeof(int), "vector splats");
+
+    //the vector loop runs while a whole step of lanes is left
+    first = widen(f, vs->setup, init);
+    span  = emit(f, vs->setup, IR_SUB, IRT_I64, widen(f, vs->setup, vs->limit), first);
+    span  = emit(f, vs->setup, IR_AND, IRT_I64, span, emit_const(f, vs->setup, IRT_I64, -(long long)vs->lanes));
+    end   = emit(f, vs->setup, IR_ADD, IRT_I64, first, span);
+
+    if (vs->check_count > 0)
+    {
+        int trips = emit(f, vs->setup, IR_SUB, IRT_I64, end, first);
+
+        for (int c = 0; c < vs->check_count; c++)
+        {
+            int apart = disjoint(vs, trips, vs->checks[c][0], vs->checks[c][1]);
+
+            ok = (ok == IR_NONE) ? apart : emit(f, vs->setup, IR_AND, IRT_I32, ok, apart);
+        }
+    }
+
+    vi = emit_phi(f, vhead, IRT_I64, first);
+
+    for (int a = 0; a < vs->anchor_count; a++)
+        vs->anchors[a].vphi = emit_phi(f, vhead, IRT_PTR, vs->anchors[a].start);
+
+    for (int c = 0; c < vs->carried_count; c++)
+    {
+        Carried *ca = &vs->carried[c];
+
+        if (ca->is_sum)
+        {
+            IrType type = f->instrs[ca->phi].type;
+            int zero = emit_lanes(f, vs->setup, IR_VSPLAT, type, emit_const(f, vs->setup, type, 0), IR_NONE);
+
+            ca->vphi = emit_phi(f, vhead, IRT_VEC, zero);
+        }
+    }
+
+    {
+        int test = emit(f, vhead, IR_LT, IRT_I32, vi, end);
+        int br = emit(f, vhead, IR_BR, IRT_VOID, test, IR_NONE);
+
+        f->instrs[br].target[0] = vbody;
+        f->instrs[br].target[1] = resume;
+    }
+
+    //the body again, one vector instruction per scalar one
+    for (int i = f->blocks[vs->body].first; i != IR_NONE; i = f->instrs[i].next)
+    {
+        IrOp op = f->instrs[i].op;
+        IrType type = f->instrs[i].type;
+        int a = f->instrs[i].a;
+        int b = f->instrs[i].b;
+
+        if (vs->cls[i] == VC_DEAD)
+            continue;
+
+        if (op == IR_LOAD)
+        {
+            vs->vec[i] = emit_lanes(f, vbody, IR_VLOAD, type, address_of(vs, vbody, a), IR_NONE);
+        }
+        else if (op == IR_STORE)
+        {
+            int value = vector_of(vs, b);
+
+            emit_lanes(f, vbody, IR_VSTORE, f->instrs[b].type, address_of(vs, vbody, a), value);
+        }
+        else if (vs->cls[i] == VC_VECTOR)
+        {
+            static const IrOp lane_op[] = {
+                [IR_ADD] = IR_VADD, [IR_SUB] = IR_VSUB, [IR_MUL] = IR_VMUL, [IR_DIV] = IR_VDIV,
+                [IR_AND] = IR_VAND, [IR_OR]  = IR_VOR,  [IR_XOR] = IR_VXOR
+            };
+            int va = vector_of(vs, a);
+            int vb = vector_of(vs, b);
+
+            vs->vec[i] = emit_lanes(f, vbody, lane_op[op], type, va, vb);
+        }
+        else
+        {
+            for (int c = 0; c < vs->carried_count; c++)
+            {
+                Carried *ca = &vs->carried[c];
+
+                if (ca->update == i && ca->is_sum)
+                {
+                    int add = vector_of(vs, ca->operand);
+
+                    ca->vnext = emit_lanes(f, vbody, ca->is_sub ? IR_VSUB : IR_VADD, type, ca->vphi, add);
+                }
+            }
+        }
+    }
+
+    vnext = emit(f, vbody, IR_ADD, IRT_I64, vi, emit_const(f, vbody, IRT_I64, vs->lanes));
+    set_second(f, vi, vnext);
+
+    for (int a = 0; a < vs->anchor_count; a++)
+    {
+        Anchor *an = &vs->anchors[a];
+
+        an->vnext = emit_offset(f, vbody, an->vphi, an->step * vs->lanes);
+        set_second(f, an->vphi, an->vnext);
+    }
+
+    for (int c = 0; c < vs->carried_count; c++)
+    {
+        if (vs->carried[c].is_sum)
+            set_second(f, vs->carried[c].vphi, vs->carried[c].vnext);
+    }
+
+    term = emit(f, vbody, IR_JMP, IRT_VOID, IR_NONE, IR_NONE);
+    f->instrs[term].target[0] = vhead;
+
+    //where the scalar loop picks up, one value per header phi
+    for (int i = f->blocks[h].first; f->instrs[i].op == IR_PHI; i = f->instrs[i].next)
+        phi_count++;
+
+    int values[phi_count + 1];
+    int p = 0;
+
+    for (int i = f->blocks[h].first; f->instrs[i].op == IR_PHI; i = f->instrs[i].next)
+    {
+        IrType type = f->instrs[i].type;
+        int value = IR_NONE;
+
+        if (i == vs->counter)
+            value = narrow(f, resume, vi, counter_type);
+
+        for (int a = 0; a < vs->anchor_count; a++)
+        {
+            if (vs->anchors[a].phi == i)
+                value = vs->anchors[a].vphi;
+        }
+
+        for (int c = 0; c < vs->carried_count; c++)
+        {
+            const Carried *ca = &vs->carried[c];
+
+            if (ca->phi != i)
+                continue;
+
+            if (ca->is_sum)
+            {
+                value = emit(f, resume, IR_ADD, type, ca->init, emit_lanes(f, resume, IR_VSUM, type, ca->vphi, IR_NONE));
+            }
+            else
+            {
+                int done = narrow(f, resume, emit(f, resume, IR_SUB, IRT_I64, vi, first), type);
+                int moved = emit(f, resume, IR_MUL, type, done, emit_const(f, resume, type, ca->step));
+
+                value = emit(f, resume, IR_ADD, type, ca->init, moved);
+            }
+        }
+
+        values[p++] = value;
+    }
+
+    term = emit(f, resume, IR_JMP, IRT_VOID, IR_NONE, IR_NONE);
+    f->instrs[term].target[0] = h;
+
+    //preheader -> setup -> vector loop -> resume -> scalar loop; failed checks go straight to it
+    {
+        int count;
+        int *targets = ir_targets(f, ir_terminator(f, ph), &count);
+
+        for (int t = 0; t < count; t++)
+        {
+            if (targets[t] == h)
+                targets[t] = vs->setup;
+        }
+    }
+
+    term = emit(f, vs->setup, (ok == IR_NONE) ? IR_JMP : IR_BR, IRT_VOID, ok, IR_NONE);
+    f->instrs[term].target[0] = vhead;
+    f->instrs[term].target[1] = (ok == IR_NONE) ? IR_NONE : h;
+
+    ir_add_pred(f, vs->setup, ph);
+    ir_add_pred(f, vhead, vs->setup);
+    ir_add_pred(f, vhead, vbody);
+    ir_add_pred(f, vbody, vhead);
+    ir_add_pred(f, resume, vhead);
+
+    if (ok == IR_NONE)
+    {
+        f->blocks[h].preds[vs->pre] = resume;
+        p = 0;
+
+        for (int i = f->blocks[h].first; f->instrs[i].op == IR_PHI; i = f->instrs[i].next)
+            f->operands[f->instrs[i].args + vs->pre] = values[p++];
+    }
+    else
+    {
+        f->blocks[h].preds[vs->pre] = vs->setup;
+        ir_add_pred(f, h, resume);
+        p = 0;
+
+        for (int i = f->blocks[h].first; f->instrs[i].op == IR_PHI; i = f->instrs[i].next)
+        {
+            int nargs = f->instrs[i].nargs;
+            int inputs[nargs + 1];
+
+            memcpy(inputs, &f->operands[f->instrs[i].args], (size_t)nargs * sizeof(int));
+            inputs[nargs] = values[p++];
+
+            f->instrs[i].args  = ir_add_operands(f, inputs, nargs + 1);
+            f->instrs[i].nargs = nargs + 1;
+        }
+    }
+
+    f->vector_bytes = vs->vector_bytes;
+}
+
+
+
+/*
+  _____       _
+ |  __ \     (_)
+ | |  | |_ __ ___   _____ _ __
+ | |  | | '__| \ \ / / _ \ '__|
+ | |__| | |  | |\ V /  __/ |
+ |_____/|_|  |_| \_/ \___|_|
+*/
+
+int vectorise_loop(IrFunc *f, const Loop *loop, int vector_bytes, char *why, int why_size)
+{
+    VecState vs;
+    int phis = 0;
+    int lanes = 0;
+    long long first, limit;
+
+    memset(&vs, 0, sizeof(vs));
+    vs.f            = f;
+    vs.loop         = loop;
+    vs.vector_bytes = vector_bytes;
+    vs.why          = why;
+    vs.why_size     = why_size;
+
+    if (!loop->innermost)
+        return reject(&vs, "contains another loop");
+
+    for (int i = f->blocks[loop->header].first; i != IR_NONE && f->instrs[i].op == IR_PHI; i = f->instrs[i].next)
+        phis++;
+
+    vs.cls       = vec_alloc((size_t)f->instr_count, 1, "vector classes");
+    vs.anchor_of = vec_alloc((size_t)f->instr_count, sizeof(int), "vector anchors");
+    vs.offset_of = vec_alloc((size_t)f->instr_count, sizeof(long long), "vector offsets");
+    vs.anchors   = vec_alloc((size_t)phis, sizeof(Anchor), "vector anchors");
+    vs.carried   = vec_alloc((size_t)phis, sizeof(Carried), "carried values");
+    vs.accesses  = vec_alloc((size_t)f->instr_count, sizeof(Access), "vector accesses");
+    vs.checks    = vec_alloc(VECTOR_MAX_CHECKS, sizeof(*vs.checks), "overlap checks");
+
+    if (check_shape(&vs) && classify_phis(&vs) && classify_body(&vs) && check_dependences(&vs))
+    {
+        int init = f->operands[f->instrs[vs.counter].args + vs.pre];
+
+        if (is_constant(f, init, &first) && is_constant(f, vs.limit, &limit) && limit - first < vs.lanes)
+            reject(&vs, "runs %lld time(s), fewer than its %d lanes", (limit > first) ? limit - first : 0, vs.lanes);
+        else
+        {
+            generate(&vs);
+            lanes = vs.lanes;
+        }
+    }
+
+    free(vs.cls);
+    free(vs.anchor_of);
+    free(vs.offset_of);
+    free(vs.anchors);
+    free(vs.carried);
+    free(vs.accesses);
+    free(vs.checks);
+    free(vs.vec);
+    free(vs.splat);
+
+    return lanes;
+}
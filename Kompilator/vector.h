@@ -0,0 +1,54 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include "ir.h"
+#include "loop.h"
+
+/* ---------------------------------------------
+   Loop vectoriser
+
+   Works on innermost loops after index strength
+   reduction has left them in the shape
+
+       header: phis; t = i < n; br t, body, exit
+       body:   straight-line code; jmp header
+
+   with i stepping by 1 and n invariant. Each
+   array access has to go through a pointer phi
+   stepped by one element per iteration, and
+   everything the body computes has to be
+   element-wise: loads, stores, + - * / & | ^ on
+   i32, i64, f32 or f64 lanes of one size.
+   Integer running sums (s: s + arr<i>) are kept
+   per lane and added up after the loop; float
+   sums are left alone since adding them in
+   another order changes the result.
+
+   A vector loop of vector_bytes / element-size
+   lanes is put in front of the scalar one,
+   which stays as the epilogue for the remaining
+   iterations and resumes from where the vector
+   loop stopped.
+
+   Accesses through one pointer, or through
+   pointers a constant distance apart, conflict
+   when an iteration touches what a later one
+   within the same vector step touches first;
+   that is decided here. Distinct globals and
+   frame slots never overlap. Any other pair of
+   pointers where one is stored through (PEK
+   parameters may point into the same array) is
+   checked at run time, and the preheader only
+   enters the vector loop when the ranges both
+   loops touch are disjoint.
+
+   The vector instructions only exist in the
+   native back end; the bytecode has none.
+--------------------------------------------- */
+
+#define VECTOR_MAX_CHECKS     8         // pointer pairs checked for overlap at run time
+
+// returns the number of lanes the loop now runs with, or 0 with the reason in why
+int vectorise_loop(IrFunc *f, const Loop *loop, int vector_bytes, char *why, int why_size);
+
+#endif /* VECTOR_H */
@@ -0,0 +1,627 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "vm.h"
+#include "jit.h"
+
+#if defined(__GNUC__)
+#define VM_THREADED 1
+#else
+#define VM_THREADED 0
+#endif
+
+/* decoded instruction; handler is the label address of its opcode when threaded */
+struct VmCode {
+    const void *handler;
+    uint16_t    op;
+    uint16_t    dst;
+    uint16_t    a;
+    uint16_t    b;
+    int32_t     imm;
+};
+
+static void *vm_alloc(size_t size, const char *what)
+{
+    void *ptr = calloc(size ? size : 1, 1);
+
+    if (!ptr)
+    {
+        fprintf(stderr, "Fatal: failed to allocate %s\n", what);
+        exit(1);
+    }
+
+    return ptr;
+}
+
+void vm_init(VmState *vm, const VmProgram *p)
+{
+    memset(vm, 0, sizeof(*vm));
+
+    vm->program = p;
+    vm->code    = vm_alloc((size_t)(p->code_count + 1) * sizeof(VmCode), "threaded code");
+    vm->data    = vm_alloc(p->data_size, "data segment");
+    vm->image   = vm_alloc(p->data_size, "data image");
+    vm->consts  = vm_alloc((size_t)(p->const_count + 1) * sizeof(VmValue), "constant pool");
+    vm->regs    = vm_alloc((size_t)VM_REGISTER_STACK * sizeof(VmValue), "register stack");
+    vm->frames  = vm_alloc(VM_FRAME_STACK, "frame stack");
+    vm->calls   = vm_alloc((size_t)VM_CALL_DEPTH * sizeof(VmCall), "call stack");
+    vm->hot     = vm_alloc((size_t)p->func_count * sizeof(unsigned), "call counters");
+    vm->native  = vm_alloc((size_t)p->func_count * sizeof(VmNative), "compiled entries");
+
+    vm->jit_threshold = VM_JIT_THRESHOLD;
+    vm->out           = stdout;
+
+    memcpy(vm->image, p->data, p->data_size);
+
+    //pointers stored in global data now that the segment has an address
+    for (int i = 0; i < p->fixup_count; i++)
+    {
+        intptr_t address = (intptr_t)(vm->data + p->fixups[i].target);
+
+        memcpy(vm->image + p->fixups[i].at, &address, sizeof(address));
+    }
+
+    for (int i = 0; i < p->const_count; i++)
+    {
+        if (p->consts[i].kind == VM_CONST_DATA)
+            vm->consts[i].i = (intptr_t)(vm->data + p->consts[i].value.i);
+        else
+            vm->consts[i] = p->consts[i].value;
+    }
+
+    for (int i = 0; i < p->code_count; i++)
+    {
+        vm->code[i].op  = p->code[i].op;
+        vm->code[i].dst = p->code[i].dst;
+        vm->code[i].a   = p->code[i].a;
+        vm->code[i].b   = p->code[i].b;
+        vm->code[i].imm = p->code[i].imm;
+    }
+
+    vm_reset(vm);
+}
+
+void vm_reset(VmState *vm)
+{
+    memcpy(vm->data, vm->image, vm->program->data_size);
+}
+
+#if VM_PAIR_PROFILE
+static unsigned long long pair_count[OP_COUNT][OP_COUNT];
+static int pair_last = OP_NOP;
+
+static const char *pair_names[OP_COUNT] = {
+#define VM_NAME(name) #name,
+    VM_OPCODES(VM_NAME)
+#undef VM_NAME
+};
+
+static void count_pair(int op)
+{
+    pair_count[pair_last][op]++;
+    pair_last = op;
+}
+
+static void print_pairs(void)
+{
+    //selection of the 20 largest counts, cleared as they are printed
+    fprintf(stderr, "Opcode pairs:\n");
+
+    for (int n = 0; n < 20; n++)
+    {
+        int best_a = 0, best_b = 0;
+
+        for (int a = 0; a < OP_COUNT; a++)
+        {
+            for (int b = 0; b < OP_COUNT; b++)
+            {
+                if (pair_count[a][b] > pair_count[best_a][best_b])
+                {
+                    best_a = a;
+                    best_b = b;
+                }
+            }
+        }
+
+        if (!pair_count[best_a][best_b])
+            break;
+
+        fprintf(stderr, "  %-10s %-10s %llu\n", pair_names[best_a], pair_names[best_b],
+                pair_count[best_a][best_b]);
+        pair_count[best_a][best_b] = 0;
+    }
+}
+#endif
+
+void free_vm(VmState *vm)
+{
+#if VM_PAIR_PROFILE
+    print_pairs();
+#endif
+
+    jit_release(vm);
+
+    free(vm->hot);
+    free(vm->native);
+    free(vm->code);
+    free(vm->data);
+    free(vm->image);
+    free(vm->consts);
+    free(vm->regs);
+    free(vm->frames);
+    free(vm->calls);
+
+    memset(vm, 0, sizeof(*vm));
+}
+
+
+
+/*
+  _____                       _       _
+ |  __ \                     | |     | |
+ | |  | |_ __ ___  _ __   ___| |_ ___| |__
+ | |  | | '__/ _ \| '_ \ / __| __/ __| '_ \
+ | |__| | | | (_) | |_) | (__| || (__| | | |
+ |_____/|_|  \___/| .__/ \___|\__\___|_| |_|
+                  | |
+                  |_|
+*/
+
+#define R(x)    regs[ip->x]
+#define I32(v)  ((int64_t)(int32_t)(uint32_t)(v))
+
+#if VM_PAIR_PROFILE
+#define PROFILE()    count_pair(ip->op)
+#else
+#define PROFILE()    ((void)0)
+#endif
+
+#if VM_THREADED
+#define DISPATCH()   do { PROFILE(); goto *ip->handler; } while (0)
+#define CASE(name)   L_##name:
+#else
+#define DISPATCH()   do { PROFILE(); goto dispatch; } while (0)
+#define CASE(name)   case OP_##name:
+#endif
+
+#define NEXT()       do { ip++; DISPATCH(); } while (0)
+#define JUMP(target) do { ip = code + (target); DISPATCH(); } while (0)
+
+#define BINARY(name, expr)  CASE(name) { R(dst).i = (expr); NEXT(); }
+#define FBINARY(name, expr) CASE(name) { R(dst).f = (expr); NEXT(); }
+
+#define ADDRESS()    ((intptr_t)R(a).i + ip->imm)
+
+#define LOAD(name, ctype, field, cast)                          \
+    CASE(name) {                                                \
+        ctype v;                                                \
+        memcpy(&v, (const void *)ADDRESS(), sizeof(v));         \
+        R(dst).field = cast v;                                  \
+        NEXT();                                                 \
+    }
+
+#define STORE(name, ctype, value)                               \
+    CASE(name) {                                                \
+        ctype v = (ctype)(value);                               \
+        memcpy((void *)ADDRESS(), &v, sizeof(v));               \
+        NEXT();                                                 \
+    }
+
+#define BRANCH(name, cond)  CASE(name) { if (cond) JUMP(ip->imm); NEXT(); }
+
+//calls into func count towards compiling it; returns its compiled entry once there is one
+static VmNative hot_entry(VmState *vm, int func, int depth)
+{
+    if (!vm->native[func] && vm->jit_threshold > 0 && ++vm->hot[func] == vm->jit_threshold)
+    {
+        vm->native[func] = jit_compile(vm, func);
+
+        if (vm->native[func])
+            vm->native_count++;
+    }
+
+    //compiled calls nest on the C stack, deep recursion continues interpreted
+    if (depth >= VM_JIT_DEPTH)
+        return NULL;
+
+    return vm->native[func];
+}
+
+//interprets func until it returns to its caller, which may be C or compiled code
+static int vm_execute(VmState *vm, int fi, VmValue *regs, unsigned char *frame)
+{
+    const VmProgram *p = vm->program;
+    VmCode *code = vm->code;
+
+#if VM_THREADED
+#define VM_LABEL(name) &&L_##name,
+    static const void *labels[OP_COUNT] = { VM_OPCODES(VM_LABEL) };
+#undef VM_LABEL
+
+    if (p->code_count > 0 && !code[0].handler)
+    {
+        for (int i = 0; i < p->code_count; i++)
+            code[i].handler = labels[code[i].op];
+    }
+#endif
+
+    const VmFunc *func = &p->funcs[fi];
+    const VmValue *consts = vm->consts;
+    VmValue *regs_end = vm->regs + VM_REGISTER_STACK;
+    unsigned char *frames_end = vm->frames + VM_FRAME_STACK;
+    VmCall *calls = vm->calls;
+    int base = vm->depth;
+    int depth = base;
+    const VmCode *ip = code + func->code_start;
+
+    DISPATCH();
+
+#if !VM_THREADED
+dispatch:
+    switch ((VmOp)ip->op)
+    {
+#endif
+
+    CASE(NOP)   NEXT();
+    CASE(MOV)   { R(dst) = R(a); NEXT(); }
+    CASE(CONST) { R(dst) = consts[ip->imm]; NEXT(); }
+    CASE(SLOT)  { R(dst).i = (intptr_t)(frame + ip->imm); NEXT(); }
+
+    BINARY(ADD32, I32((uint64_t)R(a).i + (uint64_t)R(b).i))
+    BINARY(ADD64, (int64_t)((uint64_t)R(a).i + (uint64_t)R(b).i))
+    BINARY(SUB32, I32((uint64_t)R(a).i - (uint64_t)R(b).i))
+    BINARY(SUB64, (int64_t)((uint64_t)R(a).i - (uint64_t)R(b).i))
+    BINARY(MUL32, I32((uint64_t)R(a).i * (uint64_t)R(b).i))
+    BINARY(MUL64, (int64_t)((uint64_t)R(a).i * (uint64_t)R(b).i))
+
+    //-1 is split out so INT_MIN / -1 wraps instead of trapping
+    CASE(DIV32) {
+        if (R(b).i == 0) goto division_by_zero;
+        R(dst).i = (R(b).i == -1) ? I32(-(uint64_t)R(a).i) : I32((int32_t)R(a).i / (int32_t)R(b).i);
+        NEXT();
+    }
+    CASE(DIV64) {
+        if (R(b).i == 0) goto division_by_zero;
+        R(dst).i = (R(b).i == -1) ? (int64_t)(-(uint64_t)R(a).i) : R(a).i / R(b).i;
+        NEXT();
+    }
+    CASE(MOD32) {
+        if (R(b).i == 0) goto division_by_zero;
+        R(dst).i = (R(b).i == -1) ? 0 : I32((int32_t)R(a).i % (int32_t)R(b).i);
+        NEXT();
+    }
+    CASE(MOD64) {
+        if (R(b).i == 0) goto division_by_zero;
+        R(dst).i = (R(b).i == -1) ? 0 : R(a).i % R(b).i;
+        NEXT();
+    }
+    CASE(UDIV32) {
+        if ((uint32_t)R(b).u == 0) goto division_by_zero;
+        R(dst).i = I32((uint32_t)R(a).u / (uint32_t)R(b).u);
+        NEXT();
+    }
+    CASE(UDIV64) {
+        if (R(b).u == 0) goto division_by_zero;
+        R(dst).u = R(a).u / R(b).u;
+        NEXT();
+    }
+    CASE(UMOD32) {
+        if ((uint32_t)R(b).u == 0) goto division_by_zero;
+        R(dst).i = I32((uint32_t)R(a).u % (uint32_t)R(b).u);
+        NEXT();
+    }
+    CASE(UMOD64) {
+        if (R(b).u == 0) goto division_by_zero;
+        R(dst).u = R(a).u % R(b).u;
+        NEXT();
+    }
+
+    BINARY(AND,    R(a).i & R(b).i)
+    BINARY(OR,     R(a).i | R(b).i)
+    BINARY(XOR,    R(a).i ^ R(b).i)
+    BINARY(SHL32,  I32((uint32_t)R(a).u << (R(b).u & 31)))
+    BINARY(SHL64,  (int64_t)(R(a).u << (R(b).u & 63)))
+    BINARY(SHR,    R(a).i >> (R(b).u & 63))
+    BINARY(USHR32, I32((uint32_t)R(a).u >> (R(b).u & 31)))
+    BINARY(USHR64, (int64_t)(R(a).u >> (R(b).u & 63)))
+
+    CASE(NEG32)  { R(dst).i = I32(-(uint64_t)R(a).i); NEXT(); }
+    CASE(NEG64)  { R(dst).i = (int64_t)(-(uint64_t)R(a).i); NEXT(); }
+    CASE(NOT)    { R(dst).i = ~R(a).i; NEXT(); }
+
+    CASE(SEXT8)  { R(dst).i = (int8_t)R(a).i; NEXT(); }
+    CASE(SEXT16) { R(dst).i = (int16_t)R(a).i; NEXT(); }
+    CASE(SEXT32) { R(dst).i = (int32_t)R(a).i; NEXT(); }
+    CASE(ZEXT8)  { R(dst).i = (uint8_t)R(a).u; NEXT(); }
+    CASE(ZEXT16) { R(dst).i = (uint16_t)R(a).u; NEXT(); }
+    CASE(ZEXT32) { R(dst).i = (uint32_t)R(a).u; NEXT(); }
+
+    FBINARY(FADD, R(a).f + R(b).f)
+    FBINARY(FSUB, R(a).f - R(b).f)
+    FBINARY(FMUL, R(a).f * R(b).f)
+    FBINARY(FDIV, R(a).f / R(b).f)
+
+    CASE(FNEG)     { R(dst).f = -R(a).f; NEXT(); }
+    CASE(FROUND32) { R(dst).f = (double)(float)R(a).f; NEXT(); }
+    CASE(ITOF)     { R(dst).f = (double)R(a).i; NEXT(); }
+    CASE(UTOF)     { R(dst).f = (double)R(a).u; NEXT(); }
+    CASE(FTOI)     { R(dst).i = (int64_t)R(a).f; NEXT(); }
+
+    BINARY(EQ,  R(a).i == R(b).i)
+    BINARY(NE,  R(a).i != R(b).i)
+    BINARY(LT,  R(a).i <  R(b).i)
+    BINARY(LE,  R(a).i <= R(b).i)
+    BINARY(GT,  R(a).i >  R(b).i)
+    BINARY(GE,  R(a).i >= R(b).i)
+    BINARY(ULT, R(a).u <  R(b).u)
+    BINARY(ULE, R(a).u <= R(b).u)
+    BINARY(UGT, R(a).u >  R(b).u)
+    BINARY(UGE, R(a).u >= R(b).u)
+    BINARY(FEQ, R(a).f == R(b).f)
+    BINARY(FNE, R(a).f != R(b).f)
+    BINARY(FLT, R(a).f <  R(b).f)
+    BINARY(FLE, R(a).f <= R(b).f)
+    BINARY(FGT, R(a).f >  R(b).f)
+    BINARY(FGE, R(a).f >= R(b).f)
+
+    BINARY(OFFSET, R(a).i + ip->imm)
+    BINARY(INDEX,  (int64_t)((uint64_t)R(a).i + (uint64_t)R(b).i * (uint64_t)(int64_t)ip->imm))
+
+    LOAD(LOAD8,   int8_t,  i, (int64_t))
+    LOAD(LOAD16,  int16_t, i, (int64_t))
+    LOAD(LOAD32,  int32_t, i, (int64_t))
+    LOAD(LOAD64,  int64_t, i, (int64_t))
+    LOAD(LOADF32, float,   f, (double))
+    LOAD(LOADF64, double,  f, (double))
+
+    STORE(STORE8,   int8_t,  R(b).i)
+    STORE(STORE16,  int16_t, R(b).i)
+    STORE(STORE32,  int32_t, R(b).i)
+    STORE(STORE64,  int64_t, R(b).i)
+    STORE(STOREF32, float,   R(b).f)
+    STORE(STOREF64, double,  R(b).f)
+
+    CASE(MEMCPY) {
+        memmove((void *)(intptr_t)R(a).i, (const void *)(intptr_t)R(b).i, (size_t)ip->imm);
+        NEXT();
+    }
+    CASE(MEMZERO) {
+        memset((void *)(intptr_t)R(a).i, 0, (size_t)ip->imm);
+        NEXT();
+    }
+
+    CASE(CALL) {
+        const VmFunc *callee = &p->funcs[ip->imm];
+        VmValue *callee_regs = regs + func->reg_count;
+        unsigned char *callee_frame = frame + func->frame_size;
+
+        if (callee->is_extern)
+        {
+            fprintf(vm->out, "Runtime error in %s: call to EXTERN function %s, which has no body\n", func->name, callee->name);
+            return 1;
+        }
+
+        if (depth + 1 >= VM_CALL_DEPTH ||
+            callee_regs + callee->reg_count > regs_end ||
+            callee_frame + callee->frame_size > frames_end)
+        {
+            fprintf(vm->out, "Runtime error in %s: stack overflow calling %s\n", func->name, callee->name);
+            return 1;
+        }
+
+        for (int k = 0; k < ip->b; k++)
+            callee_regs[k] = regs[p->args[func->arg_start + ip->a + k]];
+
+        VmNative native = hot_entry(vm, ip->imm, depth);
+
+        if (native)
+        {
+            vm->depth = depth + 1;
+
+            if (native(callee_regs, callee_frame, vm))
+                return 1;
+
+            if (ip->dst != VM_NO_REG)
+                R(dst) = vm->ret;
+
+            NEXT();
+        }
+
+        calls[depth].ret   = ip;
+        calls[depth].regs  = regs;
+        calls[depth].frame = frame;
+        calls[depth].func  = (int)(func - p->funcs);
+        depth++;
+
+        func  = callee;
+        regs  = callee_regs;
+        frame = callee_frame;
+
+        JUMP(callee->code_start);
+    }
+
+    //the callee takes over this call's registers and frame and returns for it
+    CASE(TAILCALL) {
+        const VmFunc *callee = &p->funcs[ip->imm];
+        VmValue *staging = regs + func->reg_count;
+
+        if (callee->is_extern)
+        {
+            fprintf(vm->out, "Runtime error in %s: call to EXTERN function %s, which has no body\n", func->name, callee->name);
+            return 1;
+        }
+
+        if (staging + ip->b > regs_end ||
+            regs + callee->reg_count > regs_end ||
+            frame + callee->frame_size > frames_end)
+        {
+            fprintf(vm->out, "Runtime error in %s: stack overflow calling %s\n", func->name, callee->name);
+            return 1;
+        }
+
+        //arguments may be read from registers they replace, so they are gathered first
+        for (int k = 0; k < ip->b; k++)
+            staging[k] = regs[p->args[func->arg_start + ip->a + k]];
+
+        memmove(regs, staging, (size_t)ip->b * sizeof(VmValue));
+
+        VmNative native = hot_entry(vm, ip->imm, depth);
+
+        if (native)
+        {
+            vm->depth = depth;
+
+            if (native(regs, frame, vm))
+                return 1;
+
+            VmValue value = vm->ret;
+
+            if (depth == base)
+                return 0;
+
+            depth--;
+            ip    = calls[depth].ret;
+            regs  = calls[depth].regs;
+            frame = calls[depth].frame;
+            func  = &p->funcs[calls[depth].func];
+
+            if (ip->dst != VM_NO_REG)
+                R(dst) = value;
+
+            NEXT();
+        }
+
+        func = callee;
+
+        JUMP(callee->code_start);
+    }
+
+    CASE(JMP)  JUMP(ip->imm);
+    CASE(BRNZ) { if (R(a).i != 0) JUMP(ip->imm); NEXT(); }
+    CASE(BRZ)  { if (R(a).i == 0) JUMP(ip->imm); NEXT(); }
+
+    //the JMPs after the SWITCH are its table, read rather than run
+    CASE(SWITCH) {
+        uint64_t k = R(a).u;
+
+        JUMP(ip[1 + (k < (uint64_t)ip->imm ? k : (uint64_t)ip->imm)].imm);
+    }
+
+    CASE(RET) {
+        VmValue value = R(a);
+
+        if (depth == base)
+        {
+            vm->ret = value;
+            return 0;
+        }
+
+        depth--;
+        ip    = calls[depth].ret;
+        regs  = calls[depth].regs;
+        frame = calls[depth].frame;
+        func  = &p->funcs[calls[depth].func];
+
+        if (ip->dst != VM_NO_REG)
+            R(dst) = value;
+
+        NEXT();
+    }
+
+    CASE(RETV) {
+        if (depth == base)
+            return 0;
+
+        depth--;
+        ip    = calls[depth].ret;
+        regs  = calls[depth].regs;
+        frame = calls[depth].frame;
+        func  = &p->funcs[calls[depth].func];
+
+        NEXT();
+    }
+
+    //superinstructions from the peephole pass
+    BINARY(ADDI32, I32((uint64_t)R(a).i + (uint64_t)(int64_t)ip->imm))
+    BINARY(ADDI64, (int64_t)((uint64_t)R(a).i + (uint64_t)(int64_t)ip->imm))
+
+    BRANCH(BEQ,  R(a).i == R(b).i)
+    BRANCH(BNE,  R(a).i != R(b).i)
+    BRANCH(BLT,  R(a).i <  R(b).i)
+    BRANCH(BLE,  R(a).i <= R(b).i)
+    BRANCH(BGT,  R(a).i >  R(b).i)
+    BRANCH(BGE,  R(a).i >= R(b).i)
+    BRANCH(BULT, R(a).u <  R(b).u)
+    BRANCH(BULE, R(a).u <= R(b).u)
+    BRANCH(BUGT, R(a).u >  R(b).u)
+    BRANCH(BUGE, R(a).u >= R(b).u)
+
+    BRANCH(BEQK,  R(a).i == consts[ip->b].i)
+    BRANCH(BNEK,  R(a).i != consts[ip->b].i)
+    BRANCH(BLTK,  R(a).i <  consts[ip->b].i)
+    BRANCH(BLEK,  R(a).i <= consts[ip->b].i)
+    BRANCH(BGTK,  R(a).i >  consts[ip->b].i)
+    BRANCH(BGEK,  R(a).i >= consts[ip->b].i)
+    BRANCH(BULTK, R(a).u <  consts[ip->b].u)
+    BRANCH(BULEK, R(a).u <= consts[ip->b].u)
+    BRANCH(BUGTK, R(a).u >  consts[ip->b].u)
+    BRANCH(BUGEK, R(a).u >= consts[ip->b].u)
+
+#if !VM_THREADED
+        default:
+            fprintf(vm->out, "Runtime error in %s: bad opcode %d\n", func->name, ip->op);
+            return 1;
+    }
+#endif
+
+division_by_zero:
+    fprintf(vm->out, "Runtime error in %s: division by zero\n", func->name);
+    return 1;
+}
+
+int vm_invoke(VmState *vm, int func, VmValue *regs, unsigned char *frame)
+{
+    VmNative native = hot_entry(vm, func, vm->depth);
+    int failed;
+
+    vm->depth++;
+    failed = native ? native(regs, frame, vm) : vm_execute(vm, func, regs, frame);
+    vm->depth--;
+
+    return failed;
+}
+
+int vm_run(VmState *vm, long long *result)
+{
+    const VmProgram *p = vm->program;
+
+    *result = 0;
+
+    if (p->entry < 0 || p->funcs[p->entry].is_extern)
+    {
+        fprintf(vm->out, "Runtime error: program has no ENTRE function\n");
+        return 1;
+    }
+
+    const VmFunc *func = &p->funcs[p->entry];
+
+    if (func->reg_count > VM_REGISTER_STACK || func->frame_size > VM_FRAME_STACK)
+    {
+        fprintf(vm->out, "Runtime error in %s: stack overflow\n", func->name);
+        return 1;
+    }
+
+    //ENTRE parameters, if any, start out as zero
+    memset(vm->regs, 0, (size_t)func->param_count * sizeof(VmValue));
+
+    vm->depth = 0;
+    vm->ret.i = 0;
+
+    if (vm_invoke(vm, p->entry, vm->regs, vm->frames))
+        return 1;
+
+    *result = vm->ret.i;
+    return 0;
+}
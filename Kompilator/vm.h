@@ -0,0 +1,102 @@
+#ifndef VM_H
+#define VM_H
+
+#include <stdio.h>
+
+#include "bytecode.h"
+
+/* ---------------------------------------------
+   Bytecode interpreter
+
+   Runs a VmProgram in-process. Pointers are host
+   addresses: frame slots live on a private byte
+   stack and globals / string literals in a data
+   segment that is placed once, so pointer
+   arithmetic and struct copies work directly on
+   memory. vm_reset restores the data segment to
+   its initial image between runs.
+
+   With GCC / Clang the code is translated into a
+   direct-threaded array (computed goto), other
+   compilers fall back to a switch loop.
+
+   Every call site counts calls per callee; once
+   a function reaches jit_threshold calls it is
+   handed to the JIT tier (jit.h) and later calls
+   run the machine code. Counters survive
+   vm_reset, so repeated runs warm up. Compiled
+   calls nest on the C stack, so calls deeper
+   than VM_JIT_DEPTH stay interpreted.
+
+   A TAILCALL reuses the caller's register
+   window, frame and call record, so a chain of
+   tail calls (mutual recursion included) runs in
+   constant space however deep it goes.
+--------------------------------------------- */
+
+#define VM_REGISTER_STACK  (1 << 20)    // 64-bit registers across all active calls
+#define VM_FRAME_STACK     (1 << 22)    // bytes of frame slots across all active calls
+#define VM_CALL_DEPTH      (1 << 16)
+#define VM_JIT_THRESHOLD   100          // calls before a function is compiled
+#define VM_JIT_DEPTH       (1 << 12)    // deepest call that may still enter compiled code
+
+// build with -DVM_PAIR_PROFILE=1 to count executed opcode pairs; free_vm prints the most frequent
+#ifndef VM_PAIR_PROFILE
+#define VM_PAIR_PROFILE    0
+#endif
+
+typedef struct VmCode VmCode;
+typedef struct VmState VmState;
+
+/* compiled function: runs one call in the given register window and frame,
+   leaves the result in vm->ret; returns 0, or 1 after a runtime error */
+typedef int (*VmNative)(VmValue *regs, unsigned char *frame, VmState *vm);
+
+typedef struct VmJitPages {
+    void   *base;
+    size_t  size;
+} VmJitPages;
+
+typedef struct VmCall {
+    const VmCode  *ret;         // CALL instruction to resume after
+    VmValue       *regs;
+    unsigned char *frame;
+    int            func;
+} VmCall;
+
+struct VmState {
+    const VmProgram *program;
+    VmCode          *code;
+
+    unsigned char   *data;      // live globals and strings
+    unsigned char   *image;     // initial contents, fixups applied
+    VmValue         *consts;    // pool with data offsets resolved to addresses
+
+    VmValue         *regs;
+    unsigned char   *frames;
+    VmCall          *calls;
+    int              depth;     // active calls, interpreted and compiled
+    VmValue          ret;       // result of the call that returned last
+    FILE            *out;       // runtime errors, stdout unless the caller sets it
+
+    unsigned         jit_threshold;     // 0 keeps everything interpreted
+    unsigned        *hot;               // per function: calls seen so far
+    VmNative        *native;            // per function: compiled entry or NULL
+    int              native_count;
+
+    VmJitPages      *jit_pages;
+    int              jit_page_count;
+    int              jit_page_capacity;
+};
+
+void vm_init(VmState *vm, const VmProgram *p);
+void vm_reset(VmState *vm);
+void free_vm(VmState *vm);
+
+// runs ENTRE; returns 0 and stores its result, or 1 after a runtime error
+int  vm_run(VmState *vm, long long *result);
+
+// runs one call of func whose arguments are already in regs; result in vm->ret
+int  vm_invoke(VmState *vm, int func, VmValue *regs, unsigned char *frame);
+
+#endif /* VM_H */
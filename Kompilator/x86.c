@@ -0,0 +1,2452 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+#include "x86.h"
+#include "regalloc.h"
+#include "peephole.h"
+
+enum {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8,  R9,  R10, R11, R12, R13, R14, R15,
+    XMM0, XMM1, XMM2,  XMM3,  XMM4,  XMM5,  XMM6,  XMM7,
+    XMM8, XMM9, XMM10, XMM11, XMM12, XMM13, XMM14, XMM15
+};
+
+static const int int_arg_regs[6] = { RDI, RSI, RDX, RCX, R8, R9 };
+static const int callee_saved[5] = { RBX, R12, R13, R14, R15 };
+
+static const char *reg_names[4][16] = {
+    { "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+      "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b" },
+    { "ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+      "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w" },
+    { "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+      "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d" },
+    { "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+      "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15" }
+};
+
+/* where a value lives, or how to rebuild it */
+typedef enum LocKind {
+    LOC_NONE,       // unused result
+    LOC_REG,
+    LOC_STACK,      // 8 bytes (a vector: its width) at offset(%rbp), or offset(%rsp) for outgoing arguments
+    LOC_IMM,        // integer constant that fits a 32-bit immediate
+    LOC_SYM,        // address of a global, string or function plus offset
+    LOC_FRAME,      // address of a frame slot: offset(%rbp)
+    LOC_FCONST,     // float constant in .rodata
+    LOC_FUSED       // compare folded into its branch, or address folded into its load / store
+} LocKind;
+
+typedef enum SymKind {
+    SYM_GLOBAL,
+    SYM_STRING,
+    SYM_FUNC
+} SymKind;
+
+typedef struct Loc {
+    LocKind   kind;
+    int       reg;
+    int       offset;
+    int       base_rsp;
+    long long imm;
+    SymKind   sym_kind;
+    int       sym;
+} Loc;
+
+typedef struct FloatConst {
+    uint64_t bits;
+    int      is_f32;
+} FloatConst;
+
+typedef struct X86State {
+    FILE           *out;
+    const IrModule *m;
+
+    char          **func_names;     // mangled assembler symbols
+    char          **global_names;
+
+    FloatConst     *fconsts;
+    int             fconst_count;
+    int             fconst_capacity;
+
+    const IrFunc   *f;
+    int             fi;
+    Loc            *loc;
+    int            *uses;
+    int            *slot_offset;
+    int             frame_size;
+    unsigned        saved;          // callee-saved registers to restore
+    int             save_offset[16];
+    int             stub_count;
+
+    int             peephole;
+    int             report;         // allocation stats, summed over the module in total
+    RaResult        total;
+    int             total_saved;
+} X86State;
+
+static void *x86_alloc(size_t count, size_t size)
+{
+    void *ptr = calloc(count ? count : 1, size);
+
+    if (!ptr)
+    {
+        fprintf(stderr, "Fatal: x86 back end allocation failed\n");
+        exit(1);
+    }
+
+    return ptr;
+}
+
+static void emitf(X86State *s, const char *fmt, ...)
+{
+    va_list ap;
+
+    fputc('\t', s->out);
+
+    va_start(ap, fmt);
+    vfprintf(s->out, fmt, ap);
+    va_end(ap);
+
+    fputc('\n', s->out);
+}
+
+//operand strings live in a small ring so a few can be in flight in one emitf; one ring per thread for parallel batches
+static char *scratch_text(void)
+{
+    static _Thread_local char ring[8][96];
+    static _Thread_local int next;
+
+    next = (next + 1) & 7;
+    return ring[next];
+}
+
+//SSE registers are xmm at any width up to 16 bytes, ymm at 32
+static const char *reg_name(int reg, int width)
+{
+    char *text = scratch_text();
+
+    if (reg >= XMM0)
+        sprintf(text, "%%%cmm%d", (width == 32) ? 'y' : 'x', reg - XMM0);
+    else
+        sprintf(text, "%%%s", reg_names[(width == 1) ? 0 : (width == 2) ? 1 : (width == 4) ? 2 : 3][reg]);
+
+    return text;
+}
+
+static char suffix(int width)
+{
+    return (width == 1) ? 'b' : (width == 2) ? 'w' : (width == 4) ? 'l' : 'q';
+}
+
+//i8 / i16 arithmetic runs in 32-bit registers, only the low bits matter
+static int op_width(IrType type)
+{
+    return (ir_type_size(type) == 8) ? 8 : 4;
+}
+
+static int fits_i32(long long v)
+{
+    return v >= INT32_MIN && v <= INT32_MAX;
+}
+
+/* assembler symbols: K names may carry Å / Ä / Ö, which become _uXX */
+static char *mangle(const char *name)
+{
+    size_t n = strlen(name);
+    char *out = x86_alloc(n * 4 + 1, 1);
+    char *p = out;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        unsigned char c = (unsigned char)name[i];
+
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            (c >= '0' && c <= '9') || c == '_' || c == '.')
+            *p++ = (char)c;
+        else
+            p += sprintf(p, "_u%02X", c);
+    }
+
+    *p = '\0';
+    return out;
+}
+
+static int add_fconst(X86State *s, double value, int is_f32)
+{
+    FloatConst c;
+
+    memset(&c, 0, sizeof(c));
+    c.is_f32 = is_f32;
+
+    if (is_f32)
+    {
+        float narrow = (float)value;
+        uint32_t bits;
+
+        memcpy(&bits, &narrow, 4);
+        c.bits = bits;
+    }
+    else
+    {
+        memcpy(&c.bits, &value, 8);
+    }
+
+    for (int i = 0; i < s->fconst_count; i++)
+    {
+        if (s->fconsts[i].bits == c.bits && s->fconsts[i].is_f32 == c.is_f32)
+            return i;
+    }
+
+    if (s->fconst_count >= s->fconst_capacity)
+    {
+        s->fconst_capacity = s->fconst_capacity ? s->fconst_capacity * 2 : 16;
+        s->fconsts = realloc(s->fconsts, s->fconst_capacity * sizeof(FloatConst));
+
+        if (!s->fconsts)
+        {
+            fprintf(stderr, "Fatal: float constant realloc failed\n");
+            exit(1);
+        }
+    }
+
+    s->fconsts[s->fconst_count] = c;
+    return s->fconst_count++;
+}
+
+
+
+/*
+   ____                                 _
+  / __ \                               | |
+ | |  | |_ __   ___ _ __ __ _ _ __   __| |___
+ | |  | | '_ \ / _ \ '__/ _` | '_ \ / _` / __|
+ | |__| | |_) |  __/ | | (_| | | | | (_| \__ \
+  \____/| .__/ \___|_|  \__,_|_| |_|\__,_|___/
+        | |
+        |_|
+*/
+
+static const char *stack_text(const Loc *l)
+{
+    char *text = scratch_text();
+
+    sprintf(text, "%d(%%%s)", l->offset, l->base_rsp ? "rsp" : "rbp");
+    return text;
+}
+
+static int sym_is_extern(const X86State *s, const Loc *l)
+{
+    if (l->sym_kind == SYM_GLOBAL)
+        return s->m->globals[l->sym].is_extern;
+    if (l->sym_kind == SYM_FUNC)
+        return s->m->funcs[l->sym].is_extern;
+
+    return 0;
+}
+
+static const char *sym_text(const X86State *s, const Loc *l)
+{
+    char *text = scratch_text();
+    const char *name;
+    char local[32];
+
+    if (l->sym_kind == SYM_STRING)
+    {
+        sprintf(local, ".LS%d", l->sym);
+        name = local;
+    }
+    else
+    {
+        name = (l->sym_kind == SYM_GLOBAL) ? s->global_names[l->sym] : s->func_names[l->sym];
+    }
+
+    if (l->offset)
+        snprintf(text, 96, "%s%+d", name, l->offset);
+    else
+        snprintf(text, 96, "%s", name);
+
+    return text;
+}
+
+static int same_loc(const Loc *a, const Loc *b)
+{
+    if (a->kind != b->kind)
+        return 0;
+    if (a->kind == LOC_REG)
+        return a->reg == b->reg;
+    if (a->kind == LOC_STACK)
+        return a->offset == b->offset && a->base_rsp == b->base_rsp;
+
+    return 0;
+}
+
+static Loc reg_loc(int reg)
+{
+    Loc l;
+
+    memset(&l, 0, sizeof(l));
+    l.kind = LOC_REG;
+    l.reg = reg;
+
+    return l;
+}
+
+//puts an address-like location (symbol or frame slot) into reg
+static void load_address(X86State *s, const Loc *l, int reg)
+{
+    if (l->kind == LOC_FRAME)
+    {
+        emitf(s, "leaq %d(%%rbp), %s", l->offset, reg_name(reg, 8));
+        return;
+    }
+
+    if (sym_is_extern(s, l))
+    {
+        Loc base = *l;
+
+        base.offset = 0;
+        emitf(s, "movq %s@GOTPCREL(%%rip), %s", sym_text(s, &base), reg_name(reg, 8));
+
+        if (l->offset)
+            emitf(s, "addq $%d, %s", l->offset, reg_name(reg, 8));
+        return;
+    }
+
+    emitf(s, "leaq %s(%%rip), %s", sym_text(s, l), reg_name(reg, 8));
+}
+
+//loads an integer location into reg; width only picks the immediate form
+static void load_int_loc(X86State *s, const Loc *l, int reg, int width)
+{
+    switch (l->kind)
+    {
+        case LOC_REG:
+            if (l->reg != reg)
+                emitf(s, "movq %s, %s", reg_name(l->reg, 8), reg_name(reg, 8));
+            break;
+
+        case LOC_STACK:
+            emitf(s, "movq %s, %s", stack_text(l), reg_name(reg, 8));
+            break;
+
+        case LOC_IMM:
+            if (width == 8 && l->imm < 0)
+                emitf(s, "movq $%lld, %s", l->imm, reg_name(reg, 8));
+            else
+                emitf(s, "movl $%lld, %s", (width == 8) ? l->imm : (long long)(uint32_t)l->imm, reg_name(reg, 4));
+            break;
+
+        case LOC_SYM:
+        case LOC_FRAME:
+            load_address(s, l, reg);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void load_float_loc(X86State *s, const Loc *l, int reg, int is_f32)
+{
+    switch (l->kind)
+    {
+        case LOC_REG:
+            if (l->reg != reg)
+                emitf(s, "movaps %s, %s", reg_name(l->reg, 8), reg_name(reg, 8));
+            break;
+
+        case LOC_STACK:
+            emitf(s, "movsd %s, %s", stack_text(l), reg_name(reg, 8));
+            break;
+
+        case LOC_FCONST:
+            emitf(s, "%s .LC%d(%%rip), %s", is_f32 ? "movss" : "movsd", l->sym, reg_name(reg, 8));
+            break;
+
+        case LOC_IMM:
+            emitf(s, "xorps %s, %s", reg_name(reg, 8), reg_name(reg, 8));
+            break;
+
+        default:
+            break;
+    }
+}
+
+//whole SSE / AVX registers, to and from spill slots that need not be aligned
+static void move_vector(X86State *s, const Loc *dst, const Loc *src, int width)
+{
+    const char *aligned = (width == 32) ? "vmovaps" : "movaps";
+    const char *unaligned = (width == 32) ? "vmovups" : "movups";
+
+    if (dst->kind == LOC_REG && src->kind == LOC_REG)
+        emitf(s, "%s %s, %s", aligned, reg_name(src->reg, width), reg_name(dst->reg, width));
+    else if (dst->kind == LOC_REG)
+        emitf(s, "%s %s, %s", unaligned, stack_text(src), reg_name(dst->reg, width));
+    else if (src->kind == LOC_REG)
+        emitf(s, "%s %s, %s", unaligned, reg_name(src->reg, width), stack_text(dst));
+    else
+    {
+        emitf(s, "%s %s, %s", unaligned, stack_text(src), reg_name(XMM15, width));
+        emitf(s, "%s %s, %s", unaligned, reg_name(XMM15, width), stack_text(dst));
+    }
+}
+
+/* moves one location to another; memory to memory goes through r11 / xmm15. An unused
+   destination has no place to write to: its zeroed offset would be the saved %rbp */
+static void move_loc(X86State *s, const Loc *dst, const Loc *src, int is_float, int width)
+{
+    if (same_loc(dst, src) || src->kind == LOC_NONE || dst->kind == LOC_NONE)
+        return;
+
+    if (is_float && width >= 16)
+    {
+        move_vector(s, dst, src, width);
+        return;
+    }
+
+    if (is_float)
+    {
+        if (dst->kind == LOC_REG)
+        {
+            load_float_loc(s, src, dst->reg, width == 4);
+            return;
+        }
+
+        if (src->kind == LOC_REG)
+        {
+            emitf(s, "movsd %s, %s", reg_name(src->reg, 8), stack_text(dst));
+            return;
+        }
+
+        load_float_loc(s, src, XMM15, width == 4);
+        emitf(s, "movsd %%xmm15, %s", stack_text(dst));
+        return;
+    }
+
+    if (dst->kind == LOC_REG)
+    {
+        load_int_loc(s, src, dst->reg, width);
+        return;
+    }
+
+    if (src->kind == LOC_REG)
+    {
+        emitf(s, "movq %s, %s", reg_name(src->reg, 8), stack_text(dst));
+        return;
+    }
+
+    if (src->kind == LOC_IMM)
+    {
+        emitf(s, "movq $%lld, %s", src->imm, stack_text(dst));
+        return;
+    }
+
+    load_int_loc(s, src, R11, 8);
+    emitf(s, "movq %%r11, %s", stack_text(dst));
+}
+
+//vectors count as floats: they live in the same registers
+static int value_is_float(const X86State *s, int v)
+{
+    return ir_type_is_float(s->f->instrs[v].type) || s->f->instrs[v].type == IRT_VEC;
+}
+
+static int value_width(const X86State *s, int v)
+{
+    if (s->f->instrs[v].type == IRT_VEC)
+        return s->f->vector_bytes;
+
+    return ir_type_size(s->f->instrs[v].type);
+}
+
+static int is_reg(const X86State *s, int v, int reg)
+{
+    return s->loc[v].kind == LOC_REG && s->loc[v].reg == reg;
+}
+
+static int dest_reg(const X86State *s, int v, int fallback)
+{
+    return (s->loc[v].kind == LOC_REG) ? s->loc[v].reg : fallback;
+}
+
+static void load_int(X86State *s, int v, int reg)
+{
+    load_int_loc(s, &s->loc[v], reg, value_width(s, v));
+}
+
+static void load_float(X86State *s, int v, int reg)
+{
+    load_float_loc(s, &s->loc[v], reg, s->f->instrs[v].type == IRT_F32);
+}
+
+static void store_result(X86State *s, int v, int reg)
+{
+    Loc src = reg_loc(reg);
+
+    move_loc(s, &s->loc[v], &src, value_is_float(s, v), value_width(s, v));
+}
+
+//source operand text for an integer instruction of the given width
+static const char *int_src(X86State *s, int v, int width, int scratch)
+{
+    const Loc *l = &s->loc[v];
+    char *text;
+
+    switch (l->kind)
+    {
+        case LOC_REG:
+            return reg_name(l->reg, width);
+
+        case LOC_STACK:
+            return stack_text(l);
+
+        case LOC_IMM:
+            text = scratch_text();
+            sprintf(text, "$%lld", l->imm);
+            return text;
+
+        default:
+            load_int(s, v, scratch);
+            return reg_name(scratch, width);
+    }
+}
+
+static const char *float_src(X86State *s, int v, int scratch)
+{
+    const Loc *l = &s->loc[v];
+    char *text;
+
+    switch (l->kind)
+    {
+        case LOC_REG:
+            return reg_name(l->reg, 8);
+
+        case LOC_STACK:
+            return stack_text(l);
+
+        case LOC_FCONST:
+            text = scratch_text();
+            sprintf(text, ".LC%d(%%rip)", l->sym);
+            return text;
+
+        default:
+            load_float(s, v, scratch);
+            return reg_name(scratch, 8);
+    }
+}
+
+//loads v into reg widened from its own width to 64 bits
+static void load_extended(X86State *s, int v, int reg, int is_signed)
+{
+    const Loc *l = &s->loc[v];
+    int width = value_width(s, v);
+    const char *src;
+
+    if (width == 8 || l->kind == LOC_IMM || l->kind == LOC_SYM || l->kind == LOC_FRAME)
+    {
+        Loc imm = *l;
+
+        if (l->kind == LOC_IMM && !is_signed && width < 8)
+            imm.imm = l->imm & ((1LL << (width * 8)) - 1);
+
+        load_int_loc(s, &imm, reg, 8);
+        return;
+    }
+
+    src = (l->kind == LOC_REG) ? reg_name(l->reg, width) : stack_text(l);
+
+    if (width == 4)
+    {
+        if (is_signed)
+            emitf(s, "movslq %s, %s", src, reg_name(reg, 8));
+        else
+            emitf(s, "movl %s, %s", src, reg_name(reg, 4));
+        return;
+    }
+
+    emitf(s, "%s%c%c %s, %s", is_signed ? "movs" : "movz", suffix(width),
+          is_signed ? 'q' : 'l', src, reg_name(reg, is_signed ? 8 : 4));
+}
+
+
+
+/*
+  _____                 _ _      _   __  __
+ |  __ \               | | |    | | |  \/  |
+ | |__) |_ _ _ __ __ _ | | | ___| | | \  / | _____   _____  ___
+ |  ___/ _` | '__/ _` || | |/ _ \ | | |\/| |/ _ \ \ / / _ \/ __|
+ | |  | (_| | | | (_| || | |  __/ | | |  | | (_) \ V /  __/\__ \
+ |_|   \__,_|_|  \__,_||_|_|\___|_| |_|  |_|\___/ \_/ \___||___/
+
+*/
+
+typedef struct Move {
+    Loc dst;
+    Loc src;
+    int is_float;
+    int width;
+} Move;
+
+//performs every move at once; cycles are broken through rax / xmm14
+static void parallel_move(X86State *s, Move *moves, int count)
+{
+    int pending = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (moves[i].dst.kind != LOC_NONE && !same_loc(&moves[i].dst, &moves[i].src))
+            moves[pending++] = moves[i];
+    }
+
+    while (pending > 0)
+    {
+        int ready = -1;
+
+        for (int i = 0; i < pending && ready < 0; i++)
+        {
+            int blocked = 0;
+
+            for (int j = 0; j < pending; j++)
+            {
+                if (j != i && same_loc(&moves[j].src, &moves[i].dst))
+                {
+                    blocked = 1;
+                    break;
+                }
+            }
+
+            if (!blocked)
+                ready = i;
+        }
+
+        if (ready < 0)
+        {
+            Loc saved = moves[0].dst;
+            int reader = 0;
+
+            //the move that reads the saved location knows what is in it
+            for (int j = 0; j < pending; j++)
+            {
+                if (same_loc(&moves[j].src, &saved))
+                    reader = j;
+            }
+
+            Loc temp = reg_loc(moves[reader].is_float ? XMM14 : RAX);
+
+            move_loc(s, &temp, &saved, moves[reader].is_float, moves[reader].width < 8 ? 8 : moves[reader].width);
+
+            for (int j = 0; j < pending; j++)
+            {
+                if (same_loc(&moves[j].src, &saved))
+                    moves[j].src = temp;
+            }
+            continue;
+        }
+
+        move_loc(s, &moves[ready].dst, &moves[ready].src, moves[ready].is_float, moves[ready].width);
+        moves[ready] = moves[--pending];
+    }
+}
+
+static int block_has_phis(const IrFunc *f, int block)
+{
+    int first = f->blocks[block].first;
+
+    return first != IR_NONE && f->instrs[first].op == IR_PHI;
+}
+
+static void emit_edge_copies(X86State *s, int from, int to, int occurrence)
+{
+    const IrFunc *f = s->f;
+    const IrBlock *blk = &f->blocks[to];
+    int k = -1;
+    int count = 0;
+
+    for (int p = 0; p < blk->pred_count; p++)
+    {
+        if (blk->preds[p] == from && occurrence-- == 0)
+        {
+            k = p;
+            break;
+        }
+    }
+
+    if (k < 0)
+        return;
+
+    for (int i = blk->first; i != IR_NONE && f->instrs[i].op == IR_PHI; i = f->instrs[i].next)
+        count++;
+
+    Move *moves = x86_alloc(count + 1, sizeof(Move));
+    int n = 0;
+
+    for (int i = blk->first; i != IR_NONE && f->instrs[i].op == IR_PHI; i = f->instrs[i].next)
+    {
+        int v = f->operands[f->instrs[i].args + k];
+
+        moves[n].dst      = s->loc[i];
+        moves[n].src      = s->loc[v];
+        moves[n].is_float = value_is_float(s, i);
+        moves[n].width    = value_width(s, i);
+        n++;
+    }
+
+    parallel_move(s, moves, n);
+    free(moves);
+}
+
+
+
+/*
+  _____           _                   _   _
+ |_   _|         | |                 | | (_)
+   | |  _ __  ___| |_ _ __ _   _  ___| |_ _  ___  _ __  ___
+   | | | '_ \/ __| __| '__| | | |/ __| __| |/ _ \| '_ \/ __|
+  _| |_| | | \__ \ |_| |  | |_| | (__| |_| | (_) | | | \__ \
+ |_____|_| |_|___/\__|_|   \__,_|\___|\__|_|\___/|_| |_|___/
+
+*/
+
+static const char *int_cc(IrOp op)
+{
+    switch (op)
+    {
+        case IR_EQ:  return "e";
+        case IR_NE:  return "ne";
+        case IR_LT:  return "l";
+        case IR_LE:  return "le";
+        case IR_GT:  return "g";
+        case IR_GE:  return "ge";
+        case IR_ULT: return "b";
+        case IR_ULE: return "be";
+        case IR_UGT: return "a";
+        default:     return "ae";
+    }
+}
+
+static const char *invert_cc(const char *cc)
+{
+    static const char *pairs[][2] = {
+        { "e", "ne" }, { "l", "ge" }, { "le", "g" }, { "b", "ae" }, { "be", "a" }
+    };
+
+    for (int i = 0; i < 5; i++)
+    {
+        if (strcmp(cc, pairs[i][0]) == 0)
+            return pairs[i][1];
+        if (strcmp(cc, pairs[i][1]) == 0)
+            return pairs[i][0];
+    }
+
+    return "ne";
+}
+
+static int is_int_compare(IrOp op)
+{
+    return op >= IR_EQ && op <= IR_UGE;
+}
+
+//sets the flags for an integer compare and returns the condition that means true
+static const char *emit_int_compare(X86State *s, const IrInstr *in)
+{
+    int width = value_width(s, in->a);
+    const Loc *a = &s->loc[in->a];
+    const Loc *b = &s->loc[in->b];
+    char sfx = suffix(width);
+
+    if (a->kind == LOC_REG)
+        emitf(s, "cmp%c %s, %s", sfx, int_src(s, in->b, width, R11), reg_name(a->reg, width));
+    else if (a->kind == LOC_STACK && (b->kind == LOC_REG || b->kind == LOC_IMM))
+        emitf(s, "cmp%c %s, %s", sfx, int_src(s, in->b, width, R11), stack_text(a));
+    else
+    {
+        load_int(s, in->a, RAX);
+        emitf(s, "cmp%c %s, %s", sfx, int_src(s, in->b, width, R11), reg_name(RAX, width));
+    }
+
+    return int_cc(in->op);
+}
+
+static void compile_float_compare(X86State *s, int i)
+{
+    const IrInstr *in = &s->f->instrs[i];
+    int is_f32 = s->f->instrs[in->a].type == IRT_F32;
+    const char *ucomi = is_f32 ? "ucomiss" : "ucomisd";
+    int lhs = in->a;
+    int rhs = in->b;
+    const char *cc = "a";
+
+    //LT / LE are GT / GE with the operands swapped, so unordered stays false
+    if (in->op == IR_LT || in->op == IR_LE)
+    {
+        lhs = in->b;
+        rhs = in->a;
+    }
+
+    int reg = (s->loc[lhs].kind == LOC_REG) ? s->loc[lhs].reg : XMM15;
+
+    load_float(s, lhs, reg);
+    emitf(s, "%s %s, %s", ucomi, float_src(s, rhs, XMM14), reg_name(reg, 8));
+
+    switch (in->op)
+    {
+        case IR_EQ:
+            emitf(s, "sete %%al");
+            emitf(s, "setnp %%cl");
+            emitf(s, "andb %%cl, %%al");
+            break;
+
+        case IR_NE:
+            emitf(s, "setne %%al");
+            emitf(s, "setp %%cl");
+            emitf(s, "orb %%cl, %%al");
+            break;
+
+        case IR_GE:
+        case IR_LE:
+            cc = "ae";
+            /* fallthrough */
+
+        default:
+            emitf(s, "set%s %%al", cc);
+            break;
+    }
+
+    int dst = dest_reg(s, i, RAX);
+
+    emitf(s, "movzbl %%al, %s", reg_name(dst, 4));
+    store_result(s, i, dst);
+}
+
+static void compile_compare(X86State *s, int i)
+{
+    const IrInstr *in = &s->f->instrs[i];
+
+    if (value_is_float(s, in->a))
+    {
+        compile_float_compare(s, i);
+        return;
+    }
+
+    const char *cc = emit_int_compare(s, in);
+    int dst = dest_reg(s, i, RAX);
+
+    emitf(s, "set%s %%al", cc);
+    emitf(s, "movzbl %%al, %s", reg_name(dst, 4));
+    store_result(s, i, dst);
+}
+
+static void compile_int_binary(X86State *s, int i)
+{
+    const IrInstr *in = &s->f->instrs[i];
+    int width = op_width(in->type);
+    int a = in->a;
+    int b = in->b;
+    int commutative = 1;
+    const char *name;
+
+    switch (in->op)
+    {
+        case IR_ADD: name = "add"; break;
+        case IR_SUB: name = "sub"; commutative = 0; break;
+        case IR_MUL: name = "imul"; break;
+        case IR_AND: name = "and"; break;
+        case IR_OR:  name = "or"; break;
+        default:     name = "xor"; break;
+    }
+
+    int t = dest_reg(s, i, RAX);
+
+    if (is_reg(s, b, t) && !is_reg(s, a, t))
+    {
+        if (commutative)
+        {
+            a = in->b;
+            b = in->a;
+        }
+        else
+        {
+            t = RAX;
+        }
+    }
+
+    load_int(s, a, t);
+    emitf(s, "%s%c %s, %s", name, suffix(width), int_src(s, b, width, R11), reg_name(t, width));
+    store_result(s, i, t);
+}
+
+static void compile_shift(X86State *s, int i)
+{
+    const IrInstr *in = &s->f->instrs[i];
+    int width = value_width(s, i);
+    int w = op_width(in->type);
+    int t = dest_reg(s, i, RAX);
+    char count[32];
+
+    if (s->loc[in->b].kind == LOC_IMM)
+    {
+        sprintf(count, "$%lld", s->loc[in->b].imm & (w * 8 - 1));
+    }
+    else
+    {
+        load_int(s, in->b, RCX);
+        strcpy(count, "%cl");
+    }
+
+    //narrow right shifts see the value extended from its own width
+    if (in->op != IR_SHL && width < 4)
+        load_extended(s, in->a, t, in->op == IR_SHR);
+    else
+        load_int(s, in->a, t);
+
+    const char *name = (in->op == IR_SHL) ? "sal" : (in->op == IR_SHR) ? "sar" : "shr";
+
+    emitf(s, "%s%c %s, %s", name, suffix(w), count, reg_name(t, w));
+    store_result(s, i, t);
+}
+
+static void compile_divide(X86State *s, int i)
+{
+    const IrInstr *in = &s->f->instrs[i];
+    int width = value_width(s, i);
+    int is_signed = (in->op == IR_DIV || in->op == IR_MOD);
+    int w = op_width(in->type);
+    const char *divisor;
+
+    if (width < 4)
+    {
+        load_extended(s, in->a, RAX, is_signed);
+        load_extended(s, in->b, RCX, is_signed);
+        divisor = "%ecx";
+    }
+    else
+    {
+        load_int(s, in->a, RAX);
+
+        if (s->loc[in->b].kind == LOC_REG || s->loc[in->b].kind == LOC_STACK)
+        {
+            divisor = int_src(s, in->b, w, RCX);
+        }
+        else
+        {
+            load_int(s, in->b, RCX);
+            divisor = reg_name(RCX, w);
+        }
+    }
+
+    //x / -1 wraps and x % -1 is 0, as in the VM, where idiv would trap on the minimum value
+    if (is_signed)
+    {
+        int divide = s->stub_count++;
+        int done = s->stub_count++;
+
+        emitf(s, "cmp%c $-1, %s", suffix(w), divisor);
+        emitf(s, "jne .L%d_s%d", s->fi, divide);
+
+        if (in->op == IR_DIV)
+            emitf(s, "neg%c %s", suffix(w), reg_name(RAX, w));
+        else
+            emitf(s, "xorl %%edx, %%edx");
+
+        emitf(s, "jmp .L%d_s%d", s->fi, done);
+        fprintf(s->out, ".L%d_s%d:\n", s->fi, divide);
+        emitf(s, (w == 8) ? "cqto" : "cltd");
+        emitf(s, "idiv%c %s", suffix(w), divisor);
+        fprintf(s->out, ".L%d_s%d:\n", s->fi, done);
+    }
+    else
+    {
+        emitf(s, "xorl %%edx, %%edx");
+        emitf(s, "div%c %s", suffix(w), divisor);
+    }
+
+    store_result(s, i, (in->op == IR_DIV || in->op == IR_UDIV) ? RAX : RDX);
+}
+
+static void compile_float_binary(X86State *s, int i)
+{
+    const IrInstr *in = &s->f->instrs[i];
+    char sfx = (in->type == IRT_F32) ? 's' : 'd';
+    int a = in->a;
+    int b = in->b;
+    const char *name;
+    int commutative = 1;
+
+    switch (in->op)
+    {
+        case IR_ADD: name = "add"; break;
+        case IR_MUL: name = "mul"; break;
+        case IR_SUB: name = "sub"; commutative = 0; break;
+        default:     name = "div"; commutative = 0; break;
+    }
+
+    int t = dest_reg(s, i, XMM15);
+
+    if (is_reg(s, b, t) && !is_reg(s, a, t))
+    {
+        if (commutative)
+        {
+            a = in->b;
+            b = in->a;
+        }
+        else
+        {
+            t = XMM15;
+        }
+    }
+
+    load_float(s, a, t);
+    emitf(s, "%ss%c %s, %s", name, sfx, float_src(s, b, XMM14), reg_name(t, 8));
+    store_result(s, i, t);
+}
+
+static void compile_unary(X86State *s, int i)
+{
+    const IrInstr *in = &s->f->instrs[i];
+
+    if (ir_type_is_float(in->type))
+    {
+        int t = dest_reg(s, i, XMM15);
+
+        load_float(s, in->a, t);
+        emitf(s, "xorps .LNEG%d(%%rip), %s", (in->type == IRT_F32) ? 32 : 64, reg_name(t, 8));
+        store_result(s, i, t);
+        return;
+    }
+
+    int w = op_width(in->type);
+    int t = dest_reg(s, i, RAX);
+
+    load_int(s, in->a, t);
+    emitf(s, "%s%c %s", (in->op == IR_NEG) ? "neg" : "not", suffix(w), reg_name(t, w));
+    store_result(s, i, t);
+}
+
+static void compile_conversion(X86State *s, int i)
+{
+    const IrInstr *in = &s->f->instrs[i];
+    IrType from = s->f->instrs[in->a].type;
+    int from_width = ir_type_size(from);
+    int to_f32 = (in->type == IRT_F32);
+
+    switch (in->op)
+    {
+        case IR_SEXT:
+        case IR_ZEXT:
+        {
+            int t = dest_reg(s, i, RAX);
+
+            load_extended(s, in->a, t, in->op == IR_SEXT);
+            store_result(s, i, t);
+            break;
+        }
+
+        case IR_TRUNC:
+        case IR_COPY:
+        {
+            int t = dest_reg(s, i, RAX);
+
+            load_int(s, in->a, t);
+            store_result(s, i, t);
+            break;
+        }
+
+        case IR_ITOF:
+        case IR_UTOF:
+        {
+            int t = dest_reg(s, i, XMM15);
+            const char *cvt = to_f32 ? "cvtsi2ssq" : "cvtsi2sdq";
+
+            if (in->op == IR_UTOF && from_width == 8)
+            {
+                //values with the top bit set are halved, rounding to odd, and doubled back
+                load_int(s, in->a, RAX);
+                emitf(s, "xorps %s, %s", reg_name(t, 8), reg_name(t, 8));
+                emitf(s, "testq %%rax, %%rax");
+                emitf(s, "js 1f");
+                emitf(s, "%s %%rax, %s", cvt, reg_name(t, 8));
+                emitf(s, "jmp 2f");
+                fprintf(s->out, "1:\n");
+                emitf(s, "movq %%rax, %%rcx");
+                emitf(s, "shrq %%rcx");
+                emitf(s, "andl $1, %%eax");
+                emitf(s, "orq %%rax, %%rcx");
+                emitf(s, "%s %%rcx, %s", cvt, reg_name(t, 8));
+                emitf(s, "adds%c %s, %s", to_f32 ? 's' : 'd', reg_name(t, 8), reg_name(t, 8));
+                fprintf(s->out, "2:\n");
+            }
+            else
+            {
+                load_extended(s, in->a, RAX, in->op == IR_ITOF);
+                emitf(s, "xorps %s, %s", reg_name(t, 8), reg_name(t, 8));
+                emitf(s, "%s %%rax, %s", cvt, reg_name(t, 8));
+            }
+
+            store_result(s, i, t);
+            break;
+        }
+
+        case IR_FTOI:
+        {
+            int t = dest_reg(s, i, RAX);
+            int w = op_width(in->type);
+
+            emitf(s, "cvtts%c2si%c %s, %s", (from == IRT_F32) ? 's' : 'd', suffix(w),
+                  float_src(s, in->a, XMM15), reg_name(t, w));
+            store_result(s, i, t);
+            break;
+        }
+
+        case IR_FCONV:
+        {
+            int t = dest_reg(s, i, XMM15);
+
+            if (from == in->type)
+            {
+                load_float(s, in->a, t);
+            }
+            else
+            {
+                const char *src = float_src(s, in->a, XMM14);
+
+                if (s->loc[in->a].kind == LOC_REG && s->loc[in->a].reg != t)
+                    emitf(s, "xorps %s, %s", reg_name(t, 8), reg_name(t, 8));
+
+                emitf(s, "%s %s, %s", to_f32 ? "cvtsd2ss" : "cvtss2sd", src, reg_name(t, 8));
+            }
+
+            store_result(s, i, t);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+//base register of an address value, in r11 if it has none
+static int address_base(X86State *s, int v)
+{
+    if (s->loc[v].kind == LOC_REG)
+        return s->loc[v].reg;
+
+    load_int(s, v, R11);
+    return R11;
+}
+
+static int scale_ok(long long scale)
+{
+    return scale == 1 || scale == 2 || scale == 4 || scale == 8;
+}
+
+/* memory operand for a LOAD / STORE address; may use r11 and rcx */
+static const char *address_text(X86State *s, int v)
+{
+    const Loc *l = &s->loc[v];
+    const IrInstr *in = &s->f->instrs[v];
+    char *text;
+
+    if (l->kind == LOC_FRAME)
+    {
+        text = scratch_text();
+        sprintf(text, "%d(%%rbp)", l->offset);
+        return text;
+    }
+
+    if (l->kind == LOC_SYM && !sym_is_extern(s, l))
+    {
+        text = scratch_text();
+        sprintf(text, "%s(%%rip)", sym_text(s, l));
+        return text;
+    }
+
+    if (l->kind == LOC_FUSED && in->op == IR_OFFSET)
+    {
+        int base = address_base(s, in->a);
+
+        text = scratch_text();
+        sprintf(text, "%lld(%s)", in->imm, reg_name(base, 8));
+        return text;
+    }
+
+    if (l->kind == LOC_FUSED && in->op == IR_INDEX)
+    {
+        const Loc *index = &s->loc[in->b];
+        int base = address_base(s, in->a);
+
+        text = scratch_text();
+
+        if (index->kind == LOC_IMM)
+        {
+            sprintf(text, "%lld(%s)", index->imm * in->imm, reg_name(base, 8));
+            return text;
+        }
+
+        int reg = (index->kind == LOC_REG) ? index->reg : RCX;
+
+        if (reg == RCX)
+            load_int(s, in->b, RCX);
+
+        sprintf(text, "(%s,%s,%lld)", reg_name(base, 8), reg_name(reg, 8), in->imm);
+        return text;
+    }
+
+    text = scratch_text();
+    sprintf(text, "(%s)", reg_name(address_base(s, v), 8));
+    return text;
+}
+
+static void compile_address(X86State *s, int i)
+{
+    const IrInstr *in = &s->f->instrs[i];
+    int t = dest_reg(s, i, RAX);
+    int base = address_base(s, in->a);
+
+    if (in->op == IR_OFFSET)
+    {
+        emitf(s, "leaq %lld(%s), %s", in->imm, reg_name(base, 8), reg_name(t, 8));
+        store_result(s, i, t);
+        return;
+    }
+
+    const Loc *index = &s->loc[in->b];
+
+    if (index->kind == LOC_IMM && fits_i32(index->imm * in->imm))
+    {
+        emitf(s, "leaq %lld(%s), %s", index->imm * in->imm, reg_name(base, 8), reg_name(t, 8));
+    }
+    else if (scale_ok(in->imm))
+    {
+        int reg = (index->kind == LOC_REG) ? index->reg : RCX;
+
+        if (reg == RCX)
+            load_int(s, in->b, RCX);
+
+        emitf(s, "leaq (%s,%s,%lld), %s", reg_name(base, 8), reg_name(reg, 8), in->imm, reg_name(t, 8));
+    }
+    else
+    {
+        emitf(s, "imulq $%lld, %s, %%rcx", in->imm, int_src(s, in->b, 8, RCX));
+        emitf(s, "leaq (%s,%%rcx), %s", reg_name(base, 8), reg_name(t, 8));
+    }
+
+    store_result(s, i, t);
+}
+
+static void compile_load(X86State *s, int i)
+{
+    const IrInstr *in = &s->f->instrs[i];
+    const char *addr = address_text(s, in->a);
+
+    if (ir_type_is_float(in->type))
+    {
+        int t = dest_reg(s, i, XMM15);
+
+        emitf(s, "%s %s, %s", (in->type == IRT_F32) ? "movss" : "movsd", addr, reg_name(t, 8));
+        store_result(s, i, t);
+        return;
+    }
+
+    int t = dest_reg(s, i, RAX);
+
+    switch (ir_type_size(in->type))
+    {
+        case 1:  emitf(s, "movsbl %s, %s", addr, reg_name(t, 4)); break;
+        case 2:  emitf(s, "movswl %s, %s", addr, reg_name(t, 4)); break;
+        case 4:  emitf(s, "movl %s, %s", addr, reg_name(t, 4)); break;
+        default: emitf(s, "movq %s, %s", addr, reg_name(t, 8)); break;
+    }
+
+    store_result(s, i, t);
+}
+
+static void compile_store(X86State *s, int i)
+{
+    const IrInstr *in = &s->f->instrs[i];
+    IrType type = s->f->instrs[in->b].type;
+    const char *addr = address_text(s, in->a);
+    const Loc *value = &s->loc[in->b];
+
+    if (ir_type_is_float(type))
+    {
+        int reg = (value->kind == LOC_REG) ? value->reg : XMM15;
+
+        load_float(s, in->b, reg);
+        emitf(s, "%s %s, %s", (type == IRT_F32) ? "movss" : "movsd", reg_name(reg, 8), addr);
+        return;
+    }
+
+    int width = ir_type_size(type);
+
+    if (value->kind == LOC_IMM)
+    {
+        emitf(s, "mov%c $%lld, %s", suffix(width), value->imm, addr);
+        return;
+    }
+
+    int reg = (value->kind == LOC_REG) ? value->reg : RAX;
+
+    load_int(s, in->b, reg);
+    emitf(s, "mov%c %s, %s", suffix(width), reg_name(reg, width), addr);
+}
+
+//copies or clears imm bytes at [r11] from [rcx], in 8-byte words with a narrow tail
+static void compile_block_op(X86State *s, int i)
+{
+    const IrInstr *in = &s->f->instrs[i];
+    int is_copy = (in->op == IR_MEMCPY);
+    long long size = in->imm;
+    long long words = size / 8;
+    long long done = 0;
+
+    load_int(s, in->a, R11);
+
+    if (is_copy)
+        load_int(s, in->b, RCX);
+    else
+        emitf(s, "xorl %%eax, %%eax");
+
+    if (words > 16)
+    {
+        emitf(s, "movl $%lld, %%edx", words);
+        fprintf(s->out, "1:\n");
+
+        if (is_copy)
+        {
+            emitf(s, "movq (%%rcx), %%rax");
+            emitf(s, "addq $8, %%rcx");
+        }
+
+        emitf(s, "movq %%rax, (%%r11)");
+        emitf(s, "addq $8, %%r11");
+        emitf(s, "decl %%edx");
+        emitf(s, "jnz 1b");
+
+        size -= words * 8;
+    }
+
+    while (size - done > 0)
+    {
+        int chunk = (size - done >= 8) ? 8 : (size - done >= 4) ? 4 : (size - done >= 2) ? 2 : 1;
+
+        if (is_copy)
+            emitf(s, "mov%c %lld(%%rcx), %s", suffix(chunk), done, reg_name(RAX, chunk));
+
+        emitf(s, "mov%c %s, %lld(%%r11)", suffix(chunk), reg_name(RAX, chunk), done);
+        done += chunk;
+    }
+}
+
+/*
+   vector instructions: SSE2 two-operand forms for 16-byte vectors, AVX2
+   three-operand forms for 32. Vectors arrive in registers or unaligned
+   spill slots, so memory operands only ever go through movups.
+*/
+
+static int vector_reg(X86State *s, int v, int scratch)
+{
+    Loc reg = reg_loc(scratch);
+
+    if (s->loc[v].kind == LOC_REG)
+        return s->loc[v].reg;
+
+    move_loc(s, &reg, &s->loc[v], 1, value_width(s, v));
+    return scratch;
+}
+
+static void compile_vector_access(X86State *s, int i)
+{
+    const IrInstr *in = &s->f->instrs[i];
+    int width = s->f->vector_bytes;
+    const char *mov = (width == 32) ? "vmovups" : "movups";
+    const char *addr = address_text(s, in->a);
+
+    if (in->op == IR_VLOAD)
+    {
+        int t = dest_reg(s, i, XMM15);
+
+        emitf(s, "%s %s, %s", mov, addr, reg_name(t, width));
+        store_result(s, i, t);
+        return;
+    }
+
+    int reg = vector_reg(s, in->b, XMM15);
+
+    emitf(s, "%s %s, %s", mov, reg_name(reg, width), addr);
+}
+
+static void compile_splat(X86State *s, int i)
+{
+    const IrInstr *in = &s->f->instrs[i];
+    int width = s->f->vector_bytes;
+    int avx = (width == 32);
+    int t = dest_reg(s, i, XMM15);
+
+    if (ir_type_is_float(in->aux))
+    {
+        load_float(s, in->a, t);
+
+        if (avx)
+            emitf(s, "%s %s, %s", (in->aux == IRT_F32) ? "vbroadcastss" : "vbroadcastsd", reg_name(t, 16), reg_name(t, 32));
+        else if (in->aux == IRT_F32)
+            emitf(s, "shufps $0, %s, %s", reg_name(t, 16), reg_name(t, 16));
+        else
+            emitf(s, "unpcklpd %s, %s", reg_name(t, 16), reg_name(t, 16));
+    }
+    else
+    {
+        int is_64 = (in->aux == IRT_I64);
+        int reg = (s->loc[in->a].kind == LOC_REG) ? s->loc[in->a].reg : RAX;
+
+        load_int(s, in->a, reg);
+        emitf(s, "%s%s %s, %s", avx ? "v" : "", is_64 ? "movq" : "movd", reg_name(reg, is_64 ? 8 : 4), reg_name(t, 16));
+
+        if (avx)
+            emitf(s, "%s %s, %s", is_64 ? "vpbroadcastq" : "vpbroadcastd", reg_name(t, 16), reg_name(t, 32));
+        else if (is_64)
+            emitf(s, "punpcklqdq %s, %s", reg_name(t, 16), reg_name(t, 16));
+        else
+            emitf(s, "pshufd $0, %s, %s", reg_name(t, 16), reg_name(t, 16));
+    }
+
+    store_result(s, i, t);
+}
+
+static void compile_vector_binary(X86State *s, int i)
+{
+    //by lane type (i32, i64, f32, f64) and op (VADD ... VXOR); the verifier keeps out the gaps
+    static const char *names[4][7] = {
+        { "paddd", "psubd", "pmulld", "",      "pand",  "por",  "pxor"  },
+        { "paddq", "psubq", "",       "",      "pand",  "por",  "pxor"  },
+        { "addps", "subps", "mulps",  "divps", "andps", "orps", "xorps" },
+        { "addpd", "subpd", "mulpd",  "divpd", "andpd", "orpd", "xorpd" }
+    };
+    const IrInstr *in = &s->f->instrs[i];
+    int width = s->f->vector_bytes;
+    int lane = (in->aux == IRT_I32) ? 0 : (in->aux == IRT_I64) ? 1 : (in->aux == IRT_F32) ? 2 : 3;
+    const char *name = names[lane][in->op - IR_VADD];
+    int a = in->a;
+    int b = in->b;
+    int t = dest_reg(s, i, XMM15);
+
+    if (width == 32)
+    {
+        int ra = vector_reg(s, a, XMM14);
+        int rb = vector_reg(s, b, XMM15);
+
+        emitf(s, "v%s %s, %s, %s", name, reg_name(rb, 32), reg_name(ra, 32), reg_name(t, 32));
+        store_result(s, i, t);
+        return;
+    }
+
+    if (is_reg(s, b, t) && !is_reg(s, a, t))
+    {
+        if (in->op != IR_VSUB && in->op != IR_VDIV)
+        {
+            a = in->b;
+            b = in->a;
+        }
+        else
+        {
+            t = XMM15;
+        }
+    }
+
+    Loc dst = reg_loc(t);
+
+    move_loc(s, &dst, &s->loc[a], 1, width);
+
+    int rb = vector_reg(s, b, XMM14);
+
+    emitf(s, "%s %s, %s", name, reg_name(rb, 16), reg_name(t, 16));
+    store_result(s, i, t);
+}
+
+//adds the lanes pairwise: the high half onto the low one until one lane is left
+static void compile_vector_sum(X86State *s, int i)
+{
+    const IrInstr *in = &s->f->instrs[i];
+    int is_64 = (in->aux == IRT_I64);
+    const char *add = is_64 ? "paddq" : "paddd";
+    int v = vector_reg(s, in->a, XMM14);
+    int t = dest_reg(s, i, RAX);
+
+    if (s->f->vector_bytes == 32)
+    {
+        emitf(s, "vextracti128 $1, %s, %%xmm15", reg_name(v, 32));
+        emitf(s, "v%s %s, %%xmm15, %%xmm15", add, reg_name(v, 16));
+        emitf(s, "vpshufd $0x4e, %%xmm15, %%xmm14");
+        emitf(s, "v%s %%xmm14, %%xmm15, %%xmm15", add);
+
+        if (!is_64)
+        {
+            emitf(s, "vpshufd $0xb1, %%xmm15, %%xmm14");
+            emitf(s, "v%s %%xmm14, %%xmm15, %%xmm15", add);
+        }
+
+        emitf(s, "%s %%xmm15, %s", is_64 ? "vmovq" : "vmovd", reg_name(t, is_64 ? 8 : 4));
+    }
+    else
+    {
+        emitf(s, "movaps %s, %%xmm15", reg_name(v, 16));
+        emitf(s, "pshufd $0x4e, %%xmm15, %%xmm14");
+        emitf(s, "%s %%xmm14, %%xmm15", add);
+
+        if (!is_64)
+        {
+            emitf(s, "pshufd $0xb1, %%xmm15, %%xmm14");
+            emitf(s, "%s %%xmm14, %%xmm15", add);
+        }
+
+        emitf(s, "%s %%xmm15, %s", is_64 ? "movq" : "movd", reg_name(t, is_64 ? 8 : 4));
+    }
+
+    store_result(s, i, t);
+}
+
+static void compile_call(X86State *s, int i)
+{
+    const IrInstr *in = &s->f->instrs[i];
+    const IrFunc *callee = &s->m->funcs[in->aux];
+    Move *moves = x86_alloc(in->nargs + 1, sizeof(Move));
+    int move_count = 0;
+    int int_count = 0;
+    int float_count = 0;
+    int stack_count = 0;
+    int *on_stack = x86_alloc(in->nargs + 1, sizeof(int));
+
+    for (int k = 0; k < in->nargs; k++)
+    {
+        int v = s->f->operands[in->args + k];
+        int is_float = value_is_float(s, v);
+
+        if (is_float ? float_count < 8 : int_count < 6)
+        {
+            moves[move_count].dst      = reg_loc(is_float ? XMM0 + float_count++ : int_arg_regs[int_count++]);
+            moves[move_count].src      = s->loc[v];
+            moves[move_count].is_float = is_float;
+            moves[move_count].width    = value_width(s, v);
+            move_count++;
+        }
+        else
+        {
+            on_stack[stack_count++] = v;
+        }
+    }
+
+    int area = (stack_count * 8 + 15) & ~15;
+
+    if (area)
+    {
+        emitf(s, "subq $%d, %%rsp", area);
+
+        for (int k = 0; k < stack_count; k++)
+        {
+            Loc slot;
+
+            memset(&slot, 0, sizeof(slot));
+            slot.kind     = LOC_STACK;
+            slot.base_rsp = 1;
+            slot.offset   = k * 8;
+
+            move_loc(s, &slot, &s->loc[on_stack[k]], value_is_float(s, on_stack[k]), value_width(s, on_stack[k]));
+        }
+    }
+
+    parallel_move(s, moves, move_count);
+
+    //C callees may rely on narrow arguments being extended to 32 bits
+    for (int k = 0; k < move_count; k++)
+    {
+        int width = moves[k].width;
+
+        if (!moves[k].is_float && width < 4)
+            emitf(s, "movs%cl %s, %s", suffix(width), reg_name(moves[k].dst.reg, width), reg_name(moves[k].dst.reg, 4));
+    }
+
+    //a dirty upper ymm half slows down SSE code in the callee
+    if (s->f->vector_bytes == 32)
+        emitf(s, "vzeroupper");
+
+    if (callee->is_extern)
+    {
+        emitf(s, "movl $%d, %%eax", float_count);
+        emitf(s, "call %s@PLT", s->func_names[in->aux]);
+    }
+    else
+    {
+        emitf(s, "call %s", s->func_names[in->aux]);
+    }
+
+    if (area)
+        emitf(s, "addq $%d, %%rsp", area);
+
+    //a call made for its effects leaves its result where it is
+    if (in->type != IRT_VOID && s->loc[i].kind != LOC_NONE)
+        store_result(s, i, ir_type_is_float(in->type) ? XMM0 : RAX);
+
+    free(moves);
+    free(on_stack);
+}
+
+static void emit_epilogue(X86State *s)
+{
+    for (int k = 0; k < 5; k++)
+    {
+        int reg = callee_saved[k];
+
+        if (s->saved & (1u << reg))
+            emitf(s, "movq %d(%%rbp), %s", s->save_offset[reg], reg_name(reg, 8));
+    }
+
+    if (s->f->vector_bytes == 32)
+        emitf(s, "vzeroupper");
+
+    emitf(s, "leave");
+    emitf(s, "ret");
+}
+
+static void compile_return(X86State *s, int i)
+{
+    const IrInstr *in = &s->f->instrs[i];
+
+    if (in->a != IR_NONE)
+    {
+        if (value_is_float(s, in->a))
+            load_float(s, in->a, XMM0);
+        else
+            load_int(s, in->a, RAX);
+    }
+
+    emit_epilogue(s);
+}
+
+static void jump_to(X86State *s, const char *cc, int block)
+{
+    emitf(s, "j%s .L%d_%d", cc, s->fi, block);
+}
+
+static void compile_branch(X86State *s, int term, int block, int next_block)
+{
+    const IrFunc *f = s->f;
+    const IrInstr *in = &f->instrs[term];
+    int on_true = in->target[0];
+    int on_false = in->target[1];
+    int false_occurrence = (on_true == on_false) ? 1 : 0;
+    const Loc *cond = &s->loc[in->a];
+    const char *cc;
+
+    if (cond->kind == LOC_FUSED)
+    {
+        cc = emit_int_compare(s, &f->instrs[in->a]);
+    }
+    else if (cond->kind == LOC_IMM)
+    {
+        int target = cond->imm ? on_true : on_false;
+
+        emit_edge_copies(s, block, target, (target == on_false) ? false_occurrence : 0);
+
+        if (target != next_block)
+            jump_to(s, "mp", target);
+        return;
+    }
+    else
+    {
+        int width = value_width(s, in->a);
+
+        if (cond->kind == LOC_REG)
+            emitf(s, "test%c %s, %s", suffix(width), reg_name(cond->reg, width), reg_name(cond->reg, width));
+        else
+        {
+            load_int(s, in->a, RAX);
+            emitf(s, "test%c %s, %s", suffix(width), reg_name(RAX, width), reg_name(RAX, width));
+        }
+
+        cc = "ne";
+    }
+
+    if (on_true == next_block && !block_has_phis(f, on_true) && !block_has_phis(f, on_false))
+    {
+        jump_to(s, invert_cc(cc), on_false);
+        return;
+    }
+
+    if (!block_has_phis(f, on_true))
+    {
+        jump_to(s, cc, on_true);
+        emit_edge_copies(s, block, on_false, false_occurrence);
+
+        if (on_false != next_block)
+            jump_to(s, "mp", on_false);
+        return;
+    }
+
+    if (!block_has_phis(f, on_false))
+    {
+        jump_to(s, invert_cc(cc), on_false);
+        emit_edge_copies(s, block, on_true, 0);
+
+        if (on_true != next_block)
+            jump_to(s, "mp", on_true);
+        return;
+    }
+
+    //copies on both edges: the true edge gets a stub of its own
+    int stub = s->stub_count++;
+
+    emitf(s, "j%s .L%d_s%d", cc, s->fi, stub);
+    emit_edge_copies(s, block, on_false, false_occurrence);
+    jump_to(s, "mp", on_false);
+
+    fprintf(s->out, ".L%d_s%d:\n", s->fi, stub);
+    emit_edge_copies(s, block, on_true, 0);
+    jump_to(s, "mp", on_true);
+}
+
+//bounds check, then a table of offsets from itself in .rodata; edges with phis go through stubs
+static void compile_switch(X86State *s, int term, int block)
+{
+    const IrFunc *f = s->f;
+    const IrInstr *in = &f->instrs[term];
+    const int *succ = &f->cases[in->imm + 1];
+    int succ_count = f->cases[in->imm];
+    const int *table = succ + succ_count;
+    int label = s->stub_count++;
+    int *stub = x86_alloc((size_t)succ_count, sizeof(int));
+    char **target = x86_alloc((size_t)succ_count, sizeof(char *));
+
+    for (int t = 0; t < succ_count; t++)
+    {
+        stub[t] = block_has_phis(f, succ[t]) ? s->stub_count++ : -1;
+        target[t] = x86_alloc(32, 1);
+
+        if (stub[t] >= 0)
+            sprintf(target[t], ".L%d_s%d", s->fi, stub[t]);
+        else
+            sprintf(target[t], ".L%d_%d", s->fi, succ[t]);
+    }
+
+    load_int(s, in->a, RAX);
+    emitf(s, "cmpq $%d, %%rax", in->aux);
+    emitf(s, "jae %s", target[0]);
+    emitf(s, "leaq .L%d_s%d(%%rip), %%rcx", s->fi, label);
+    emitf(s, "movslq (%%rcx,%%rax,4), %%rax");
+    emitf(s, "addq %%rcx, %%rax");
+    emitf(s, "jmp *%%rax");
+
+    fprintf(s->out, "\t.pushsection .rodata\n\t.balign 4\n.L%d_s%d:\n", s->fi, label);
+
+    for (int k = 0; k < in->aux; k++)
+        fprintf(s->out, "\t.long %s - .L%d_s%d\n", target[table[k]], s->fi, label);
+
+    fprintf(s->out, "\t.popsection\n");
+
+    for (int t = 0; t < succ_count; t++)
+    {
+        if (stub[t] < 0)
+            continue;
+
+        fprintf(s->out, "%s:\n", target[t]);
+        emit_edge_copies(s, block, succ[t], 0);
+        jump_to(s, "mp", succ[t]);
+    }
+
+    for (int t = 0; t < succ_count; t++)
+        free(target[t]);
+
+    free(target);
+    free(stub);
+}
+
+static void compile_instr(X86State *s, int i, int block, int next_block)
+{
+    const IrInstr *in = &s->f->instrs[i];
+
+    //only results with a register or spill slot are computed here; the rest are unused
+    //or rebuilt where they are read. Calls still run for their effects.
+    if (ir_defines_value(in) && s->loc[i].kind != LOC_REG && s->loc[i].kind != LOC_STACK && in->op != IR_CALL)
+        return;
+
+    switch (in->op)
+    {
+        case IR_CONST:
+            //only constants too wide for an immediate get here
+            emitf(s, "movabsq $%lld, %s", in->imm, reg_name(dest_reg(s, i, RAX), 8));
+            store_result(s, i, dest_reg(s, i, RAX));
+            break;
+
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+            if (ir_type_is_float(in->type))
+                compile_float_binary(s, i);
+            else if (in->op == IR_DIV)
+                compile_divide(s, i);
+            else
+                compile_int_binary(s, i);
+            break;
+
+        case IR_AND:
+        case IR_OR:
+        case IR_XOR:
+            compile_int_binary(s, i);
+            break;
+
+        case IR_UDIV:
+        case IR_MOD:
+        case IR_UMOD:
+            compile_divide(s, i);
+            break;
+
+        case IR_SHL:
+        case IR_SHR:
+        case IR_USHR:
+            compile_shift(s, i);
+            break;
+
+        case IR_NEG:
+        case IR_NOT:
+            compile_unary(s, i);
+            break;
+
+        case IR_EQ:  case IR_NE:  case IR_LT:  case IR_LE:  case IR_GT:
+        case IR_GE:  case IR_ULT: case IR_ULE: case IR_UGT: case IR_UGE:
+            compile_compare(s, i);
+            break;
+
+        case IR_SEXT:
+        case IR_ZEXT:
+        case IR_TRUNC:
+        case IR_ITOF:
+        case IR_UTOF:
+        case IR_FTOI:
+        case IR_FCONV:
+        case IR_COPY:
+            compile_conversion(s, i);
+            break;
+
+        case IR_OFFSET:
+        case IR_INDEX:
+            compile_address(s, i);
+            break;
+
+        case IR_LOAD:
+            compile_load(s, i);
+            break;
+
+        case IR_STORE:
+            compile_store(s, i);
+            break;
+
+        case IR_MEMCPY:
+        case IR_MEMZERO:
+            compile_block_op(s, i);
+            break;
+
+        case IR_VLOAD:
+        case IR_VSTORE:
+            compile_vector_access(s, i);
+            break;
+
+        case IR_VSPLAT:
+            compile_splat(s, i);
+            break;
+
+        case IR_VADD: case IR_VSUB: case IR_VMUL: case IR_VDIV:
+        case IR_VAND: case IR_VOR:  case IR_VXOR:
+            compile_vector_binary(s, i);
+            break;
+
+        case IR_VSUM:
+            compile_vector_sum(s, i);
+            break;
+
+        case IR_CALL:
+            compile_call(s, i);
+            break;
+
+        case IR_JMP:
+            emit_edge_copies(s, block, in->target[0], 0);
+
+            if (in->target[0] != next_block)
+                jump_to(s, "mp", in->target[0]);
+            break;
+
+        case IR_BR:
+            compile_branch(s, i, block, next_block);
+            break;
+
+        case IR_SWITCH:
+            compile_switch(s, i, block);
+            break;
+
+        case IR_RET:
+            compile_return(s, i);
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+
+/*
+  ______                _   _
+ |  ____|              | | (_)
+ | |__ _   _ _ __   ___| |_ _  ___  _ __  ___
+ |  __| | | | '_ \ / __| __| |/ _ \| '_ \/ __|
+ | |  | |_| | | | | (__| |_| | (_) | | | \__ \
+ |_|   \__,_|_| |_|\___|\__|_|\___/|_| |_|___/
+
+*/
+
+static void count_uses(X86State *s)
+{
+    const IrFunc *f = s->f;
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+        {
+            const IrInstr *in = &f->instrs[i];
+
+            if (in->a >= 0)
+                s->uses[in->a]++;
+            if (in->b >= 0)
+                s->uses[in->b]++;
+
+            for (int k = 0; k < in->nargs; k++)
+                s->uses[f->operands[in->args + k]]++;
+        }
+    }
+}
+
+static int is_access(IrOp op)
+{
+    return op == IR_LOAD || op == IR_STORE || op == IR_VLOAD || op == IR_VSTORE;
+}
+
+//decides which values are rebuilt on demand instead of getting a register
+static void classify_values(X86State *s, unsigned char *skip)
+{
+    const IrFunc *f = s->f;
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+        {
+            const IrInstr *in = &f->instrs[i];
+            Loc *l = &s->loc[i];
+            int next = in->next;
+
+            switch (in->op)
+            {
+                case IR_CONST:
+                case IR_UNDEF:
+                    if (ir_type_is_float(in->type))
+                    {
+                        l->kind = LOC_FCONST;
+                        l->sym  = add_fconst(s, (in->op == IR_CONST) ? in->fimm : 0.0, in->type == IRT_F32);
+                    }
+                    else if (in->op == IR_UNDEF || fits_i32(in->imm))
+                    {
+                        l->kind = LOC_IMM;
+                        l->imm  = (in->op == IR_CONST) ? in->imm : 0;
+                    }
+                    break;
+
+                case IR_SLOT:
+                    l->kind   = LOC_FRAME;
+                    l->offset = s->slot_offset[in->aux];
+                    break;
+
+                case IR_GLOBAL:
+                case IR_STRING:
+                case IR_FUNCADDR:
+                    l->kind     = LOC_SYM;
+                    l->sym      = in->aux;
+                    l->sym_kind = (in->op == IR_GLOBAL) ? SYM_GLOBAL : (in->op == IR_STRING) ? SYM_STRING : SYM_FUNC;
+                    break;
+
+                case IR_OFFSET:
+                {
+                    const Loc *base = &s->loc[in->a];
+
+                    if ((base->kind == LOC_FRAME || base->kind == LOC_SYM) && fits_i32(base->offset + in->imm))
+                    {
+                        *l = *base;
+                        l->offset += (int)in->imm;
+                    }
+                    else if (s->uses[i] == 1 && next != IR_NONE && fits_i32(in->imm) &&
+                             is_access(f->instrs[next].op) && f->instrs[next].a == i && f->instrs[next].b != i)
+                    {
+                        l->kind = LOC_FUSED;
+                    }
+                    break;
+                }
+
+                case IR_INDEX:
+                    if (s->uses[i] == 1 && next != IR_NONE && scale_ok(in->imm) &&
+                        is_access(f->instrs[next].op) && f->instrs[next].a == i && f->instrs[next].b != i)
+                    {
+                        l->kind = LOC_FUSED;
+                    }
+                    break;
+
+                case IR_BR:
+                {
+                    //a compare right before the branch that only feeds it becomes cmp + jcc
+                    const IrInstr *cond = &f->instrs[in->a];
+
+                    if (in->prev == in->a && s->uses[in->a] == 1 && is_int_compare(cond->op) &&
+                        !ir_type_is_float(f->instrs[cond->a].type))
+                        s->loc[in->a].kind = LOC_FUSED;
+                    break;
+                }
+
+                default:
+                    break;
+            }
+        }
+    }
+
+    for (int i = 0; i < f->instr_count; i++)
+        skip[i] = (s->loc[i].kind != LOC_NONE);
+}
+
+//frame slots sit right below the saved rbp, each aligned downwards
+static int layout_slots(X86State *s)
+{
+    const IrFunc *f = s->f;
+    int frame = 0;
+
+    for (int k = 0; k < f->slot_count; k++)
+    {
+        int align = f->slots[k].align;
+
+        frame += f->slots[k].size;
+        frame = (frame + align - 1) & ~(align - 1);
+        s->slot_offset[k] = -frame;
+    }
+
+    return (frame + 7) & ~7;
+}
+
+//spill slots and callee-saved registers go below the frame slots
+static void layout_frame(X86State *s, const RaResult *ra, int frame)
+{
+    const IrFunc *f = s->f;
+    int spill_size = (f->vector_bytes > 8) ? f->vector_bytes : 8;     // room for a whole vector
+
+    for (int i = 0; i < f->instr_count; i++)
+    {
+        if (ra->spill[i] >= 0)
+        {
+            s->loc[i].kind   = LOC_STACK;
+            s->loc[i].offset = -(frame + spill_size * (ra->spill[i] + 1));
+        }
+        else if (ra->reg[i] >= 0)
+        {
+            s->loc[i] = reg_loc(ra->reg[i]);
+        }
+    }
+
+    frame += spill_size * ra->spill_count;
+
+    s->saved = 0;
+
+    for (int k = 0; k < 5; k++)
+    {
+        int reg = callee_saved[k];
+
+        if (ra->used & (1u << reg))
+        {
+            frame += 8;
+            s->saved |= 1u << reg;
+            s->save_offset[reg] = -frame;
+        }
+    }
+
+    s->frame_size = (frame + 15) & ~15;
+}
+
+static void emit_prologue(X86State *s)
+{
+    const IrFunc *f = s->f;
+    Move *moves = x86_alloc(f->param_count + 1, sizeof(Move));
+    int int_count = 0;
+    int float_count = 0;
+    int stack_count = 0;
+    int n = 0;
+
+    emitf(s, "pushq %%rbp");
+    emitf(s, "movq %%rsp, %%rbp");
+
+    if (s->frame_size)
+        emitf(s, "subq $%d, %%rsp", s->frame_size);
+
+    for (int k = 0; k < 5; k++)
+    {
+        int reg = callee_saved[k];
+
+        if (s->saved & (1u << reg))
+            emitf(s, "movq %s, %d(%%rbp)", reg_name(reg, 8), s->save_offset[reg]);
+    }
+
+    //where each parameter arrives, by its position in the signature
+    Loc *incoming = x86_alloc(f->param_count + 1, sizeof(Loc));
+
+    for (int p = 0; p < f->param_count; p++)
+    {
+        int is_float = ir_type_is_float(f->param_types[p]);
+
+        if (is_float ? float_count < 8 : int_count < 6)
+        {
+            incoming[p] = reg_loc(is_float ? XMM0 + float_count++ : int_arg_regs[int_count++]);
+        }
+        else
+        {
+            incoming[p].kind   = LOC_STACK;
+            incoming[p].offset = 16 + 8 * stack_count++;
+        }
+    }
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+        {
+            if (f->instrs[i].op != IR_PARAM)
+                continue;
+
+            moves[n].dst      = s->loc[i];
+            moves[n].src      = incoming[f->instrs[i].aux];
+            moves[n].is_float = value_is_float(s, i);
+            moves[n].width    = value_width(s, i);
+            n++;
+        }
+    }
+
+    parallel_move(s, moves, n);
+
+    free(moves);
+    free(incoming);
+}
+
+static void report_row(const char *name, const RaResult *ra, int saved)
+{
+    printf("%-20s %6d %9d %7d %5d %9d %5d %12.0f\n", name, ra->values, ra->values - ra->spilled, ra->spilled,
+           ra->spill_count, ra->coalesced, saved, ra->spill_weight);
+}
+
+static void report_function(X86State *s, const RaResult *ra)
+{
+    report_row(s->f->name, ra, __builtin_popcount(s->saved));
+
+    s->total.values       += ra->values;
+    s->total.spilled      += ra->spilled;
+    s->total.spill_count  += ra->spill_count;
+    s->total.coalesced    += ra->coalesced;
+    s->total.spill_weight += ra->spill_weight;
+    s->total_saved        += __builtin_popcount(s->saved);
+}
+
+static void compile_function(X86State *s, int fi, const RaTarget *target)
+{
+    const IrFunc *f = &s->m->funcs[fi];
+    unsigned char *skip = x86_alloc(f->instr_count, 1);
+    RaResult ra;
+    FILE *out = s->out;
+    char *text = NULL;
+    size_t size = 0;
+
+    s->f           = f;
+    s->fi          = fi;
+    s->stub_count  = 0;
+    s->loc         = x86_alloc(f->instr_count, sizeof(Loc));
+    s->uses        = x86_alloc(f->instr_count, sizeof(int));
+    s->slot_offset = x86_alloc(f->slot_count, sizeof(int));
+
+    int slots_size = layout_slots(s);
+
+    count_uses(s);
+    classify_values(s, skip);
+    ra_allocate(f, target, skip, &ra);
+    layout_frame(s, &ra, slots_size);
+
+    if (s->report)
+        report_function(s, &ra);
+
+    //the function is written to memory first, where the peephole pass can go over it
+    if (s->peephole && !(s->out = open_memstream(&text, &size)))
+    {
+        fprintf(stderr, "Fatal: failed to open assembly buffer\n");
+        exit(1);
+    }
+
+    fprintf(s->out, "\n\t.globl %s\n", s->func_names[fi]);
+    fprintf(s->out, "\t.type %s, @function\n", s->func_names[fi]);
+    fprintf(s->out, "%s:\n", s->func_names[fi]);
+
+    emit_prologue(s);
+
+    for (int b = 0; b < f->block_count; b++)
+    {
+        fprintf(s->out, ".L%d_%d:\n", fi, b);
+
+        for (int i = f->blocks[b].first; i != IR_NONE; i = f->instrs[i].next)
+            compile_instr(s, i, b, b + 1);
+    }
+
+    fprintf(s->out, "\t.size %s, .-%s\n", s->func_names[fi], s->func_names[fi]);
+
+    if (s->peephole)
+    {
+        fclose(s->out);
+        s->out = out;
+
+        peephole_x86(text, out);
+        free(text);
+    }
+
+    free_ra_result(&ra);
+    free(skip);
+    free(s->loc);
+    free(s->uses);
+    free(s->slot_offset);
+}
+
+
+
+/*
+  _____        _
+ |  __ \      | |
+ | |  | | __ _| |_ __ _
+ | |  | |/ _` | __/ _` |
+ | |__| | (_| | || (_| |
+ |_____/ \__,_|\__\__,_|
+
+*/
+
+static void emit_bytes(X86State *s, const unsigned char *bytes, int count)
+{
+    for (int i = 0; i < count; i += 16)
+    {
+        fprintf(s->out, "\t.byte ");
+
+        for (int k = i; k < count && k < i + 16; k++)
+            fprintf(s->out, "%s%d", (k == i) ? "" : ",", bytes[k]);
+
+        fprintf(s->out, "\n");
+    }
+}
+
+static void emit_global(X86State *s, int g)
+{
+    const IrModule *m = s->m;
+    const IrGlobal *glob = &m->globals[g];
+    int *reloc_at = x86_alloc(glob->size + 1, sizeof(int));
+    int zero = 1;
+
+    for (int k = 0; k < glob->size; k++)
+    {
+        reloc_at[k] = -1;
+
+        if (glob->data[k])
+            zero = 0;
+    }
+
+    for (int r = 0; r < m->reloc_count; r++)
+    {
+        if (m->relocs[r].global == g)
+        {
+            reloc_at[m->relocs[r].offset] = r;
+            zero = 0;
+        }
+    }
+
+    //STATISK locals carry a dot in their name and stay private to the module
+    if (!strchr(glob->name, '.'))
+        fprintf(s->out, "\t.globl %s\n", s->global_names[g]);
+
+    fprintf(s->out, "\t.balign %d\n", glob->align);
+    fprintf(s->out, "%s:\n", s->global_names[g]);
+
+    if (zero)
+    {
+        fprintf(s->out, "\t.zero %d\n", glob->size > 0 ? glob->size : 1);
+        free(reloc_at);
+        return;
+    }
+
+    int run = 0;
+
+    for (int k = 0; k <= glob->size; k++)
+    {
+        if (k < glob->size && reloc_at[k] < 0)
+            continue;
+
+        emit_bytes(s, glob->data + run, k - run);
+
+        if (k == glob->size)
+            break;
+
+        const IrReloc *rel = &m->relocs[reloc_at[k]];
+        Loc target;
+
+        memset(&target, 0, sizeof(target));
+        target.sym      = rel->target;
+        target.sym_kind = (rel->kind == IR_RELOC_STRING) ? SYM_STRING :
+                          (rel->kind == IR_RELOC_GLOBAL) ? SYM_GLOBAL : SYM_FUNC;
+        target.offset   = (int)rel->addend;
+
+        fprintf(s->out, "\t.quad %s\n", sym_text(s, &target));
+
+        k += 7;
+        run = k + 1;
+    }
+
+    free(reloc_at);
+}
+
+static void emit_data(X86State *s)
+{
+    const IrModule *m = s->m;
+    int has_entry = (m->entry >= 0 && !m->funcs[m->entry].is_extern);
+
+    fprintf(s->out, "\n\t.data\n");
+
+    //bounds of the writable image, so a driver can restore it between runs
+    if (has_entry)
+        fprintf(s->out, "\t.globl __kom_data_begin\n\t.balign 16\n__kom_data_begin:\n");
+
+    for (int g = 0; g < m->global_count; g++)
+    {
+        if (!m->globals[g].is_extern)
+            emit_global(s, g);
+    }
+
+    if (has_entry)
+        fprintf(s->out, "\t.globl __kom_data_end\n__kom_data_end:\n");
+
+    fprintf(s->out, "\n\t.section .rodata\n");
+
+    for (int k = 0; k < m->string_count; k++)
+    {
+        fprintf(s->out, ".LS%d:\n", k);
+        emit_bytes(s, (const unsigned char *)m->strings[k].data, m->strings[k].length + 1);
+    }
+
+    fprintf(s->out, "\t.balign 16\n");
+    fprintf(s->out, ".LNEG32:\n\t.long 0x80000000, 0, 0, 0\n");
+    fprintf(s->out, ".LNEG64:\n\t.quad 0x8000000000000000, 0\n");
+
+    for (int k = 0; k < s->fconst_count; k++)
+    {
+        if (s->fconsts[k].is_f32)
+            fprintf(s->out, "\t.balign 4\n.LC%d:\n\t.long 0x%08llx\n", k, (unsigned long long)s->fconsts[k].bits);
+        else
+            fprintf(s->out, "\t.balign 8\n.LC%d:\n\t.quad 0x%016llx\n", k, (unsigned long long)s->fconsts[k].bits);
+    }
+}
+
+static void emit_main(X86State *s)
+{
+    const IrModule *m = s->m;
+
+    if (m->entry < 0 || m->funcs[m->entry].is_extern)
+        return;
+
+    fprintf(s->out, "\n\t.text\n\t.weak main\n\t.type main, @function\nmain:\n");
+    emitf(s, "subq $8, %%rsp");
+
+    if (m->funcs[m->entry].ret_type == IRT_VOID || ir_type_is_float(m->funcs[m->entry].ret_type))
+    {
+        emitf(s, "call %s", s->func_names[m->entry]);
+        emitf(s, "xorl %%eax, %%eax");
+    }
+    else
+    {
+        emitf(s, "call %s", s->func_names[m->entry]);
+    }
+
+    emitf(s, "addq $8, %%rsp");
+    emitf(s, "ret");
+    fprintf(s->out, "\t.size main, .-main\n");
+}
+
+int emit_x86(const IrModule *m, const X86Options *options, FILE *out)
+{
+    X86State s;
+    RaTarget target;
+
+    memset(&s, 0, sizeof(s));
+    memset(&target, 0, sizeof(target));
+
+    s.out      = out;
+    s.m        = m;
+    s.report   = options->report;
+    s.peephole = options->peephole;
+
+    //the allocator hands out values that cross no call the caller-saved ones first
+    static const int int_order[] = { RBX, R12, R13, R14, R15, RSI, RDI, R8, R9, R10 };
+
+    for (int k = 0; options->allocate && k < (int)(sizeof(int_order) / sizeof(int_order[0])); k++)
+        target.int_regs[target.int_count++] = int_order[k];
+
+    for (int k = XMM0; options->allocate && k <= XMM13; k++)
+        target.float_regs[target.float_count++] = k;
+
+    for (int k = 0; k < 5; k++)
+        target.preserved |= 1u << callee_saved[k];
+
+    s.func_names   = x86_alloc(m->func_count, sizeof(char *));
+    s.global_names = x86_alloc(m->global_count, sizeof(char *));
+
+    for (int fi = 0; fi < m->func_count; fi++)
+        s.func_names[fi] = mangle(m->funcs[fi].name);
+
+    for (int g = 0; g < m->global_count; g++)
+        s.global_names[g] = mangle(m->globals[g].name);
+
+    fprintf(out, "\t.text\n");
+
+    if (options->report)
+        printf("\n%-20s %6s %9s %7s %5s %9s %5s %12s\n",
+               "function", "values", "registers", "spilled", "slots", "coalesced", "saved", "spill weight");
+
+    for (int fi = 0; fi < m->func_count; fi++)
+    {
+        if (!m->funcs[fi].is_extern)
+            compile_function(&s, fi, &target);
+    }
+
+    if (options->report)
+    {
+        report_row("total", &s.total, s.total_saved);
+        printf("\n");
+    }
+
+    emit_main(&s);
+    emit_data(&s);
+
+    fprintf(out, "\n\t.section .note.GNU-stack,\"\",@progbits\n");
+
+    for (int fi = 0; fi < m->func_count; fi++)
+        free(s.func_names[fi]);
+
+    for (int g = 0; g < m->global_count; g++)
+        free(s.global_names[g]);
+
+    free(s.func_names);
+    free(s.global_names);
+    free(s.fconsts);
+
+    return 0;
+}
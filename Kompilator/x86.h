@@ -0,0 +1,55 @@
+#ifndef X86_H
+#define X86_H
+
+#include <stdio.h>
+
+#include "ir.h"
+
+/* ---------------------------------------------
+   x86-64 back end
+
+   Writes GNU assembler (AT&T syntax) for the
+   System V AMD64 ABI: integer and pointer
+   arguments in rdi, rsi, rdx, rcx, r8, r9,
+   FLYT / DUBBEL in xmm0-7, the rest on the
+   stack; results in rax / xmm0. Struct
+   parameters are already pointers in the IR.
+
+   Values live in registers from the linear-scan
+   allocator (regalloc.h) or in spill slots.
+   rax, rcx, rdx, r11, xmm14 and xmm15 are kept
+   back as scratch for division, shifts, memory
+   to memory moves and copy cycles.
+
+   Vector values from vector.h share the xmm
+   registers: SSE2 for 16-byte vectors, AVX2 on
+   ymm for 32-byte ones, in which case a
+   vzeroupper goes before every call and return.
+
+   Constants, global / string addresses and frame
+   slot addresses are never allocated; they are
+   folded into operands and addressing modes.
+   A SWITCH jumps through a table of 32-bit
+   offsets in .rodata, so the output stays
+   position independent. A weak main calls
+   ENTRE and exits with its result.
+
+   With allocate off every value gets a stack
+   slot of its own, the baseline the allocator
+   is measured against (Bench/regalloc.sh);
+   report prints per function how many values
+   ended up in registers and slots. peephole
+   runs each function's text through
+   peephole_x86() (peephole.h).
+--------------------------------------------- */
+
+typedef struct X86Options {
+    int allocate;       // linear scan; 0 spills every value
+    int report;         // print allocation stats per function to stdout
+    int peephole;
+} X86Options;
+
+// returns the number of functions that could not be compiled
+int emit_x86(const IrModule *m, const X86Options *options, FILE *out);
+
+#endif /* X86_H */